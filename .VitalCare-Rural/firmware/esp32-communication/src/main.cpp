@@ -25,6 +25,7 @@
 #include <SPI.h>
 #include <TinyGsmClient.h>
 #include <StreamDebugger.h>
+#include <VitalCareCore.h>
 
 // Pin Definitions
 #define SD_CS_PIN 5     // MicroSD card CS pin
@@ -44,6 +45,8 @@ const char *GPRS_USER = "";   // Usually empty
 const char *GPRS_PASS = "";   // Usually empty
 
 // Remote Server Configuration (for demonstration)
+// Placeholders: this board does not speak the gateway's uplink protocol
+// (vitalcare/Uplink.h, POST /v1/uplink in host/gateway) yet
 const char *REMOTE_SERVER = "http://your-server.com/api";
 const char *BACKUP_SERVER = "http://backup-server.com/api";
 
@@ -87,14 +90,8 @@ unsigned long lastHeartbeat = 0;
 const unsigned long SYNC_INTERVAL = 30000;     // Sync every 30 seconds
 const unsigned long HEARTBEAT_INTERVAL = 5000; // Status update every 5 seconds
 
-// Emergency thresholds
-const float HEART_RATE_MIN = 50;
-const float HEART_RATE_MAX = 120;
-const float SYSTOLIC_MIN = 90;
-const float SYSTOLIC_MAX = 160;
-const float SPO2_MIN = 90;
-const float TEMP_MIN = 96.0;
-const float TEMP_MAX = 102.0;
+// Emergency thresholds (shared table in VitalCareCore)
+const vitalcare::AlertThresholds &EMERGENCY_LIMITS = vitalcare::EMERGENCY_THRESHOLDS;
 
 // Function Prototypes
 void setupSDCard();
@@ -519,20 +516,14 @@ void blinkStatusLED(int pattern)
 
 String formatDateTime(unsigned long timestamp)
 {
-  // Simple timestamp formatting
-  unsigned long seconds = timestamp / 1000;
-  unsigned long minutes = seconds / 60;
-  unsigned long hours = minutes / 60;
-
-  return String(hours % 24) + ":" +
-         (minutes % 60 < 10 ? "0" : "") + String(minutes % 60) + ":" +
-         (seconds % 60 < 10 ? "0" : "") + String(seconds % 60);
+  char buffer[16];
+  vitalcare::formatTimestamp(timestamp, buffer, sizeof(buffer));
+  return String(buffer);
 }
 
 bool isEmergency(const VitalRecord &vital)
 {
-  return (vital.heartRate < HEART_RATE_MIN || vital.heartRate > HEART_RATE_MAX ||
-          vital.systolicBP < SYSTOLIC_MIN || vital.systolicBP > SYSTOLIC_MAX ||
-          vital.spO2 < SPO2_MIN ||
-          vital.temperature < TEMP_MIN || vital.temperature > TEMP_MAX);
+  vitalcare::VitalSample sample = {vital.heartRate, vital.systolicBP, vital.diastolicBP,
+                                   vital.spO2, vital.temperature, (uint32_t)vital.timestamp};
+  return vitalcare::evaluateAlerts(sample, EMERGENCY_LIMITS) != vitalcare::ALERT_NONE;
 }
@@ -25,6 +25,7 @@
 #include <ArduinoJson.h>
 #include <WebSocketsServer.h>
 #include <ESPmDNS.h>
+#include <VitalCareCore.h>
 
 // Network Configuration
 const char *AP_SSID = "VitalCare-Rural";
@@ -454,10 +455,10 @@ void simulateVitalSigns()
     currentVitals.timestamp = millis();
     currentVitals.status = "Monitoring";
 
-    // Simple status determination
-    if (currentVitals.heartRate < 60 || currentVitals.heartRate > 100 ||
-        currentVitals.systolicBP < 90 || currentVitals.systolicBP > 140 ||
-        currentVitals.spO2 < 95 || currentVitals.temperature < 97 || currentVitals.temperature > 100)
+    // Simple status determination against the dashboard's normal ranges
+    vitalcare::VitalSample sample = {currentVitals.heartRate, currentVitals.systolicBP, currentVitals.diastolicBP,
+                                     currentVitals.spO2, currentVitals.temperature, (uint32_t)currentVitals.timestamp};
+    if (vitalcare::evaluateAlerts(sample, vitalcare::NORMAL_RANGE_THRESHOLDS) != vitalcare::ALERT_NONE)
     {
       currentVitals.status = "Alert";
     }
@@ -475,11 +476,7 @@ String generatePatientID()
 
 String formatTimestamp(unsigned long timestamp)
 {
-  unsigned long seconds = timestamp / 1000;
-  unsigned long minutes = seconds / 60;
-  unsigned long hours = minutes / 60;
-
-  return String(hours % 24) + ":" +
-         (minutes % 60 < 10 ? "0" : "") + String(minutes % 60) + ":" +
-         (seconds % 60 < 10 ? "0" : "") + String(seconds % 60);
+  char buffer[16];
+  vitalcare::formatTimestamp(timestamp, buffer, sizeof(buffer));
+  return String(buffer);
 }
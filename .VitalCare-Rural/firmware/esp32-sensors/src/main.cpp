@@ -9,6 +9,7 @@
  * - AD8232 Heart Rate Monitor (ECG)
  * - Pulse Sensor for Heart Rate detection
  * - BMP180 for Temperature and Pressure
+ * - Optional MPU-6050 accelerometer for motion artifact rejection
  * - Future: SpO2 sensor integration
  *
  * Hardware: ESP32-WROOM-32 #2 (Sensor Controller)
@@ -22,6 +23,8 @@
 #include <ArduinoJson.h>
 #include <Wire.h>
 #include <Adafruit_BMP085.h>
+#include <VitalCareCore.h>
+#include <vitalcare/WireI2cBus.h>
 
 // Pin Definitions
 #define AD8232_LO_PLUS_PIN 18  // AD8232 Leads-off detection +
@@ -39,12 +42,18 @@ const char *WIFI_PASSWORD = "VitalCare2025";
 
 // Sensor Objects
 Adafruit_BMP085 bmp180;
+vitalcare::WireI2cBus i2cBus(Wire);
+vitalcare::Mpu6050 imu(i2cBus); // Optional: motion stage is bypassed when absent
 
 // Sensor Data Structure
 struct SensorData
 {
-  float heartRateECG;    // From AD8232
-  float heartRatePulse;  // From Pulse Sensor
+  float heartRateECG;    // From AD8232 (raw, beat-to-beat)
+  float heartRatePulse;  // From Pulse Sensor (raw, beat-to-beat)
+  float heartRate;       // Fused estimate of both sources
+  float heartRateConfidence; // 0..1 confidence of the fused estimate
+  float hrvSdnn;         // ECG HRV over the last complete window (ms)
+  float hrvRmssd;
   float temperature;     // From BMP180
   float pressure;        // From BMP180 (for future BP calculation)
   float spO2;            // Future implementation
@@ -55,34 +64,48 @@ struct SensorData
 // Global Variables
 SensorData currentSensorData;
 unsigned long lastSensorRead = 0;
+unsigned long lastSignalSample = 0;
 unsigned long lastDataTransmission = 0;
+const unsigned long SIGNAL_SAMPLE_INTERVAL = 10; // Sample ECG/pulse every 10ms for beat detection
 const unsigned long SENSOR_READ_INTERVAL = 500; // Read sensors every 500ms
 const unsigned long DATA_SEND_INTERVAL = 1000;  // Send data every 1 second
 
 // Pulse Detection Variables
 int pulseSignal;
 int threshold = 2048; // Adjust based on your pulse sensor
-int BPM;
-bool pulseDetected = false;
-unsigned long lastBeat = 0;
-int beatCount = 0;
-unsigned long beatStartTime = 0;
+vitalcare::ThresholdBeatDetector pulseDetector(threshold, 100, 300);
+vitalcare::BeatChannel pulseChannel;
 
 // ECG Processing Variables
 int ecgSignal;
 bool leadsConnected = true;
-float ecgHeartRate = 0;
-int ecgBeatCount = 0;
-unsigned long ecgBeatTime = 0;
 int ecgThreshold = 2000; // Adjust based on AD8232 output
+vitalcare::ThresholdBeatDetector ecgDetector(ecgThreshold, 100, 300);
+vitalcare::BeatChannel ecgChannel;
+vitalcare::HrvAccumulator ecgHrv; // Same NN rules as the host recording analyzer
+unsigned long hrvWindowStart = 0;
+const unsigned long HRV_WINDOW = 300000; // Short-term HRV over 5 minutes
+
+// Motion Artifact Rejection (accelerometer sampled on the same tick as the ADC)
+bool imuConnected = false;
+vitalcare::MotionEstimator motion;
+vitalcare::NlmsCanceller<3, 4> pulseCanceller; // 3 axes x 4 taps, fixed-point NLMS
+float motionQuality = 1.0;                     // 1 at rest .. 0 while walking
+
+// Heart Rate Fusion (quality-weighted Kalman filter, see VitalCareCore)
+vitalcare::HeartRateFusion hrFusion;
+const unsigned long BEAT_CHANNEL_TIMEOUT = 3000; // Channel quality drops to 0 after 3s without a beat
 
 // Function Prototypes
 void setupWiFi();
 void setupSensors();
 void readAD8232();
 void readPulseSensor();
+void readMotion();
 void readBMP180();
 void calculateHeartRates();
+void onBeatDetected(vitalcare::BeatChannel &channel, float &rawRate, unsigned long now);
+float signalQuality(const vitalcare::BeatChannel &channel);
 void sendSensorData();
 void blinkHeartbeat();
 bool connectToMainController();
@@ -109,9 +132,9 @@ void setup()
   setupWiFi();
 
   // Initialize sensor data
-  currentSensorData = {0.0, 0.0, 0.0, 0.0, 0.0, false, millis()};
-  beatStartTime = millis();
-  ecgBeatTime = millis();
+  bool bmpConnected = currentSensorData.sensorsConnected;
+  currentSensorData = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, bmpConnected, millis()};
+  hrFusion.begin(millis());
 
   Serial.println("✅ Sensor Module Ready!");
   Serial.println("🔬 Monitoring vital signs...");
@@ -120,11 +143,18 @@ void setup()
 
 void loop()
 {
-  // Read sensors at specified interval
-  if (millis() - lastSensorRead >= SENSOR_READ_INTERVAL)
+  // Sample analog signals fast enough to catch every beat
+  if (millis() - lastSignalSample >= SIGNAL_SAMPLE_INTERVAL)
   {
+    readMotion();
     readAD8232();
     readPulseSensor();
+    lastSignalSample = millis();
+  }
+
+  // Read sensors at specified interval
+  if (millis() - lastSensorRead >= SENSOR_READ_INTERVAL)
+  {
     readBMP180();
     calculateHeartRates();
     lastSensorRead = millis();
@@ -175,6 +205,9 @@ void setupSensors()
 {
   Serial.println("🔧 Initializing sensors...");
 
+  // Initialize I2C (BMP180 and optional MPU-6050)
+  Wire.begin();
+
   // Initialize BMP180
   if (bmp180.begin())
   {
@@ -187,6 +220,11 @@ void setupSensors()
     currentSensorData.sensorsConnected = false;
   }
 
+  // Initialize MPU-6050 (optional, shares the I2C bus with the BMP180)
+  imu.begin();
+  imuConnected = imu.ready();
+  Serial.println(imuConnected ? "✅ MPU-6050 motion sensor ready" : "⚠️ MPU-6050 not found - motion rejection off");
+
   // Initialize AD8232 (no initialization needed, just analog read)
   Serial.println("✅ AD8232 ECG monitor ready");
 
@@ -203,62 +241,57 @@ void readAD8232()
   {
     leadsConnected = false;
     ecgSignal = 0;
+    ecgChannel.invalidate();
+    ecgHrv.breakChain();
   }
   else
   {
     leadsConnected = true;
     ecgSignal = analogRead(AD8232_OUTPUT_PIN);
 
-    // Simple peak detection for heart rate calculation
-    if (ecgSignal > ecgThreshold && (millis() - ecgBeatTime) > 300)
+    // Simple peak detection, one measurement per R-wave
+    if (ecgDetector.update(ecgSignal, millis()))
     {
-      ecgBeatCount++;
-      ecgBeatTime = millis();
-
-      // Calculate heart rate every 10 seconds
-      if (ecgBeatCount >= 10)
+      onBeatDetected(ecgChannel, currentSensorData.heartRateECG, millis());
+      if (ecgDetector.lastIntervalMs() > 0)
       {
-        unsigned long timeDiff = millis() - (ecgBeatTime - (10 * 60000 / ecgHeartRate)); // Approximate
-        if (timeDiff > 0)
-        {
-          ecgHeartRate = (ecgBeatCount * 60000.0) / timeDiff;
-          currentSensorData.heartRateECG = ecgHeartRate;
-        }
-        ecgBeatCount = 0;
+        ecgHrv.addInterval(ecgDetector.lastIntervalMs());
       }
     }
   }
 }
 
+void readMotion()
+{
+  if (!imuConnected)
+  {
+    return;
+  }
+
+  // Same tick as the ADC reads; the bus completes the read inline
+  imu.requestSample();
+  vitalcare::AccelSample accel;
+  if (imu.read(accel))
+  {
+    motion.update(accel);
+    motionQuality = motion.qualityFactor();
+  }
+}
+
 void readPulseSensor()
 {
   pulseSignal = analogRead(PULSE_SENSOR_PIN);
 
-  // Simple pulse detection algorithm
-  if (pulseSignal > threshold && !pulseDetected && (millis() - lastBeat) > 300)
+  // Cancel the acceleration-correlated artifact before beat detection
+  if (imuConnected)
   {
-    pulseDetected = true;
-    lastBeat = millis();
-    beatCount++;
-
-    // Calculate BPM every 10 beats or 10 seconds
-    if (beatCount >= 10 || (millis() - beatStartTime) > 10000)
-    {
-      unsigned long timeDiff = millis() - beatStartTime;
-      if (timeDiff > 0 && beatCount > 0)
-      {
-        BPM = (beatCount * 60000) / timeDiff;
-        currentSensorData.heartRatePulse = BPM;
-      }
-      beatCount = 0;
-      beatStartTime = millis();
-    }
+    pulseSignal = pulseCanceller.update(pulseSignal, motion.dynamicAcceleration());
   }
 
-  // Reset pulse detection when signal drops
-  if (pulseSignal < (threshold - 100))
+  // Simple pulse detection algorithm
+  if (pulseDetector.update(pulseSignal, millis()))
   {
-    pulseDetected = false;
+    onBeatDetected(pulseChannel, currentSensorData.heartRatePulse, millis());
   }
 }
 
@@ -279,31 +312,46 @@ void readBMP180()
   }
 }
 
-void calculateHeartRates()
+// Signal quality index: beat regularity scaled by motion. PPG suffers far
+// more from motion than ECG, which keeps half its weight at full motion.
+float signalQuality(const vitalcare::BeatChannel &channel)
 {
-  // Use the most reliable heart rate source
-  float finalHeartRate = 0;
+  float motionWeight = &channel == &pulseChannel ? motionQuality : 0.5 + 0.5 * motionQuality;
+  return channel.getQuality() * motionWeight;
+}
 
-  if (leadsConnected && currentSensorData.heartRateECG > 40 && currentSensorData.heartRateECG < 200)
+void onBeatDetected(vitalcare::BeatChannel &channel, float &rawRate, unsigned long now)
+{
+  // Raw per-source value is preserved; only the fused value is filtered
+  float beatRate;
+  if (channel.onBeat(now, beatRate))
   {
-    finalHeartRate = currentSensorData.heartRateECG;
+    rawRate = beatRate;
+    hrFusion.update(beatRate, signalQuality(channel), now);
   }
-  else if (currentSensorData.heartRatePulse > 40 && currentSensorData.heartRatePulse < 200)
+}
+
+void calculateHeartRates()
+{
+  unsigned long now = millis();
+
+  // A channel that has gone quiet loses its quality
+  if (!leadsConnected)
   {
-    finalHeartRate = currentSensorData.heartRatePulse;
+    ecgChannel.invalidate();
   }
+  ecgChannel.expire(now, BEAT_CHANNEL_TIMEOUT);
+  pulseChannel.expire(now, BEAT_CHANNEL_TIMEOUT);
 
-  // Apply simple filtering to reduce noise
-  static float lastHeartRate = 0;
-  if (lastHeartRate > 0)
+  hrFusion.estimate(now, currentSensorData.heartRate, currentSensorData.heartRateConfidence);
+
+  if (now - hrvWindowStart >= HRV_WINDOW)
   {
-    finalHeartRate = (finalHeartRate + lastHeartRate) / 2.0;
+    currentSensorData.hrvSdnn = ecgHrv.sdnn();
+    currentSensorData.hrvRmssd = ecgHrv.rmssd();
+    ecgHrv.reset();
+    hrvWindowStart = now;
   }
-  lastHeartRate = finalHeartRate;
-
-  // Update both readings with filtered value for consistency
-  currentSensorData.heartRateECG = finalHeartRate;
-  currentSensorData.heartRatePulse = finalHeartRate;
 }
 
 void sendSensorData()
@@ -318,6 +366,14 @@ void sendSensorData()
     DynamicJsonDocument doc(512);
     doc["heartRateECG"] = currentSensorData.heartRateECG;
     doc["heartRatePulse"] = currentSensorData.heartRatePulse;
+    doc["heartRate"] = currentSensorData.heartRate;
+    doc["heartRateConfidence"] = currentSensorData.heartRateConfidence;
+    doc["ecgQuality"] = signalQuality(ecgChannel);
+    doc["hrvSdnn"] = currentSensorData.hrvSdnn;
+    doc["hrvRmssd"] = currentSensorData.hrvRmssd;
+    doc["pulseQuality"] = signalQuality(pulseChannel);
+    doc["motionIntensity"] = motion.intensity();
+    doc["imuConnected"] = imuConnected;
     doc["temperature"] = currentSensorData.temperature;
     doc["pressure"] = currentSensorData.pressure;
     doc["spO2"] = currentSensorData.spO2; // Placeholder for future SpO2 sensor
@@ -354,19 +410,24 @@ void sendSensorData()
   // Print current readings to serial for debugging
   Serial.print("❤️ HR(ECG): " + String(currentSensorData.heartRateECG, 1));
   Serial.print(" | HR(Pulse): " + String(currentSensorData.heartRatePulse, 1));
+  Serial.print(" | HR: " + String(currentSensorData.heartRate, 1) +
+               " (" + String(currentSensorData.heartRateConfidence * 100, 0) + "%)");
   Serial.print(" | 🌡️ Temp: " + String(currentSensorData.temperature, 1) + "°F");
   Serial.print(" | 📊 Pressure: " + String(currentSensorData.pressure, 1) + " mbar");
+  if (imuConnected)
+  {
+    Serial.print(" | 🏃 Motion: " + String((1.0 - motionQuality) * 100, 0) + "%");
+  }
   Serial.println(" | 🔗 Leads: " + String(leadsConnected ? "OK" : "DISCONNECTED"));
 }
 
 void blinkHeartbeat()
 {
   // Visual feedback for detected heartbeats
-  if (currentSensorData.heartRatePulse > 0 || currentSensorData.heartRateECG > 0)
+  if (currentSensorData.heartRate > 0)
   {
-    // Calculate blink interval based on heart rate
-    float avgHeartRate = (currentSensorData.heartRatePulse + currentSensorData.heartRateECG) / 2.0;
-    unsigned long blinkInterval = 60000 / avgHeartRate; // ms per beat
+    // Calculate blink interval based on fused heart rate
+    unsigned long blinkInterval = 60000 / currentSensorData.heartRate; // ms per beat
 
     static unsigned long lastBlink = 0;
     if (millis() - lastBlink > blinkInterval)
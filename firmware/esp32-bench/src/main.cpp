@@ -0,0 +1,225 @@
+/*
+ * VitalCare Rural - On-Device Benchmarks
+ *
+ * The device counterpart of host/bench: the same benchmark sources, built
+ * for the ESP32 and timed with the CPU cycle counter instead of the host
+ * clock. Every benchmark that does not need the host simulator runs once
+ * at boot; the results are printed over serial as one Google Benchmark
+ * JSON document with cycles_per_iteration added, which Google Benchmark's
+ * compare.py diffs against the previous firmware's run:
+ *
+ *   pio run -t upload && pio device monitor | sed -n '/^{/,/^}/p' > esp32.json
+ *
+ * WiFi is never started, so the radio does not steal cycles; interrupts
+ * still run, which makes short benchmarks read a few percent high.
+ *
+ * Then the file system workload (FsWorkload.h) runs on esp32-main's "logs"
+ * partition, formatted first as SPIFFS and then as LittleFS, so the two
+ * appear side by side: FS_Append/spiffs/fill:75 against
+ * FS_Append/littlefs/fill:75, in microseconds with p99 and max. This
+ * erases the partition.
+ *
+ * Last, with an SD card in esp32-main's slot, the recording path's
+ * segment writes at the card's fill: FS_SegmentGrow/sd (a file that
+ * allocates as it grows) against FS_SegmentWrite/sd (preallocated as
+ * esp32-main does). The card is not formatted; only /bench-segment is
+ * written and removed.
+ *
+ * Hardware: ESP32-WROOM-32, nothing attached (an SD card module optional)
+ * Educational Purpose Only - Not for Medical Use
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <SD.h>
+#include <SPIFFS.h>
+
+// Benchmark sources shared with the host build (-I../../host/bench)
+#include "bench_core.cpp"
+#include "bench_i2c.cpp"
+#include "bench_motion.cpp"
+#include "bench_firmware.cpp"
+#include "FsWorkload.h"
+
+using namespace vitalcare::bench;
+
+const uint32_t MIN_RUN_MS = 200; // Per batch, as on the host
+const char *FS_PARTITION = "logs";
+const uint8_t SD_CS_PIN = 5; // esp32-main's wiring
+
+// FsWorkload adapter over SPIFFS or LittleFS; every call opens and closes
+// the file, as esp32-main does
+template <typename Fs>
+class ArduinoFs
+{
+public:
+  explicit ArduinoFs(Fs &fs) : fs(fs) {}
+
+  uint64_t totalBytes() { return fs.totalBytes(); }
+  uint64_t usedBytes() { return fs.usedBytes(); }
+
+  bool write(const char *path, const uint8_t *data, size_t length, bool append)
+  {
+    File file = fs.open(path, append ? FILE_APPEND : FILE_WRITE);
+    if (!file)
+      return false;
+    bool ok = file.write(data, length) == length;
+    file.close();
+    return ok;
+  }
+
+  bool read(const char *path, uint8_t *data, size_t length)
+  {
+    File file = fs.open(path, FILE_READ);
+    if (!file)
+      return false;
+    bool ok = file.read(data, length) == length;
+    file.close();
+    return ok;
+  }
+
+  bool touch(const char *path)
+  {
+    File file = fs.open(path, FILE_READ);
+    bool ok = (bool)file;
+    file.close();
+    return ok;
+  }
+
+  bool remove(const char *path) { return fs.remove(path); }
+  uint32_t micros() { return ::micros(); }
+
+  // Preallocated as esp32-main's SdStorageSink does: seeking past the end
+  // extends the cluster chain, then "r+" writes over it from the start
+  bool beginSegment(const char *path, uint32_t preallocate)
+  {
+    segment = fs.open(path, FILE_WRITE);
+    if (!segment)
+      return false;
+    if (preallocate == 0)
+      return true;
+    uint8_t last = 0;
+    bool ok = segment.seek(preallocate - 1) && segment.write(&last, 1) == 1;
+    segment.close();
+    if (ok)
+      segment = fs.open(path, "r+");
+    return ok && segment;
+  }
+
+  bool writeSegment(const uint8_t *data, size_t length)
+  {
+    bool ok = segment.write(data, length) == length;
+    segment.flush();
+    return ok;
+  }
+
+  void endSegment() { segment.close(); }
+
+private:
+  Fs &fs;
+  File segment;
+};
+
+static void printFsResult(const char *name, const FsResult &result, int &written)
+{
+  char line[512];
+  formatFsResultJson(name, result, line, sizeof(line));
+  Serial.printf("%s    %s", written++ ? ",\n" : "", line);
+  delay(10);
+}
+
+// Formats the partition, runs the workload and prints one entry per result
+template <typename Fs>
+static void runFileSystem(Fs &fs, const char *name, const char *mountPoint, int &written)
+{
+  if (!fs.begin(true, mountPoint, 10, FS_PARTITION) || !fs.format())
+  {
+    Serial.printf("%s    {\"name\": \"%s\", \"error\": \"no %s partition\"}", written++ ? ",\n" : "", name,
+                  FS_PARTITION);
+    return;
+  }
+  ArduinoFs<Fs> adapter(fs);
+  runFsWorkload(adapter, [&](const FsResult &result) { printFsResult(name, result, written); });
+  fs.end();
+}
+
+// Segment writes on the SD card as it is, when there is one
+static void runSdSegments(int &written)
+{
+  if (!SD.begin(SD_CS_PIN) || SD.cardType() == CARD_NONE)
+  {
+    Serial.printf("%s    {\"name\": \"sd\", \"error\": \"no SD card\"}", written++ ? ",\n" : "");
+    SD.end();
+    return;
+  }
+  ArduinoFs<fs::SDFS> adapter(SD);
+  runSegmentWorkload(adapter, [&](const FsResult &result) { printFsResult("sd", result, written); });
+  SD.end();
+}
+
+// Cycles taken by one batch of iterations; the 32-bit counter wraps after
+// ~17 s at 240 MHz, far longer than a batch
+static uint32_t runBatch(const Registration &entry, uint64_t iterations, uint64_t &items)
+{
+  State state(iterations);
+  uint32_t start = ESP.getCycleCount();
+  entry.function(state);
+  uint32_t cycles = ESP.getCycleCount() - start;
+  items = state.itemsPerIteration();
+  return cycles;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  uint32_t mhz = getCpuFrequencyMhz();
+  uint32_t minCycles = MIN_RUN_MS * 1000 * mhz;
+  Serial.printf("{\n  \"context\": {\"host_name\": \"esp32\", \"executable\": \"esp32-bench\", \"num_cpus\": 1, "
+                "\"mhz_per_cpu\": %u, \"sdk_version\": \"%s\", \"library_build_type\": \"release\"},\n"
+                "  \"benchmarks\": [\n",
+                mhz, ESP.getSdkVersion());
+
+  int written = 0;
+  for (const Registration &entry : registry())
+  {
+    // Grow the batch until it runs long enough to time reliably
+    uint64_t iterations = 1;
+    uint64_t items = 0;
+    uint32_t cycles = 0;
+    while (true)
+    {
+      cycles = runBatch(entry, iterations, items);
+      if (cycles >= minCycles || iterations >= (1ull << 32))
+      {
+        break;
+      }
+      double scale = cycles > 0 ? minCycles * 1.4 / cycles : 10.0;
+      iterations = (uint64_t)(iterations * (scale > 10.0 ? 10.0 : (scale < 1.5 ? 1.5 : scale))) + 1;
+      yield();
+    }
+
+    double cyclesPerIteration = (double)cycles / iterations;
+    double nsPerIteration = cyclesPerIteration * 1000.0 / mhz;
+    double itemsPerSecond = items ? items * 1e9 / nsPerIteration : 0;
+    // Budgets are host nanoseconds, so none is reported here
+    char line[512];
+    Result result = {entry.name, iterations, nsPerIteration, nsPerIteration, itemsPerSecond, 0,
+                     cyclesPerIteration};
+    formatResultJson(result, line, sizeof(line));
+    Serial.printf("%s    %s", written++ ? ",\n" : "", line);
+    delay(10);
+  }
+
+  // Before (SPIFFS) and after (LittleFS) on the same partition
+  runFileSystem(SPIFFS, "spiffs", "/spiffs", written);
+  runFileSystem(LittleFS, "littlefs", "/littlefs", written);
+  runSdSegments(written);
+  Serial.printf("\n  ]\n}\n");
+}
+
+void loop()
+{
+  delay(1000);
+}
@@ -6,7 +6,8 @@
  * - Real-time web dashboard with WebSocket communication
  * - Patient registration and management
  * - Direct sensor readings (AD8232, BMP180, Pulse sensor)
- * - Data storage with MicroSD card
+ * - Data storage with MicroSD card (CSV trends, EDF+ ECG/PPG recordings),
+ *   falling back to internal flash while the card is out
  * - Cellular communication with SIM800L (optional)
  * - Live vital signs display with 1-second updates
  *
@@ -21,15 +22,23 @@
 #include <WiFi.h>
 #include <WebServer.h>
 #include <WiFiAP.h>
-#include <SPIFFS.h>
 #include <ArduinoJson.h>
 #include <WebSocketsServer.h>
 #include <ESPmDNS.h>
 #include <Wire.h>
 #include <SPI.h>
 #include <SD.h>
-#include <Adafruit_BMP085.h>
+#include <esp_idf_version.h>
+#include <esp_vfs_fat.h>
+#include <LittleFS.h>
+#include <Preferences.h>
 #include <SoftwareSerial.h>
+#include <memory>
+#include <sys/time.h>
+#include <unistd.h>
+#include <VitalCareCore.h>
+#include <vitalcare/TaskI2cBus.h>
+#include <vitalcare/TaskStorageWriter.h>
 
 // Pin Definitions
 #define AD8232_LO_PLUS_PIN 18  // AD8232 Leads Off Detection +
@@ -42,7 +51,7 @@
 #define SIM800_TX_PIN 17       // SIM800L TX (connect to ESP32 RX)
 #define BUZZER_PIN 4           // Buzzer for alerts
 
-// BMP180 uses default I2C pins: SDA=21, SCL=22
+// BMP180 and MAX30102 share the default I2C pins: SDA=21, SCL=22
 
 // Network Configuration
 const char *AP_SSID = "VitalCare-Rural";
@@ -56,7 +65,81 @@ WebServer server(80);
 WebSocketsServer webSocket = WebSocketsServer(81);
 
 // Sensor Objects
-Adafruit_BMP085 bmp180;
+// All I2C sensors share one bus task; drivers submit jobs and never block loop()
+vitalcare::TaskI2cBus i2cBus(Wire);
+vitalcare::Max3010x spo2Sensor(i2cBus, vitalcare::I2C_PRIORITY_HIGH); // FIFO must not overflow
+vitalcare::Bmp180 bmp180(i2cBus);                                    // 1 s measurements, low priority
+// Sensor-to-alert processing; the host replay harness runs the same code
+vitalcare::BedsideMonitor monitor;
+uint32_t monitorSeed = 0;
+unsigned long monitorStartMs = 0;
+// Sensor-to-screen latency of the vitals frames, echoed back by dashboards
+vitalcare::LatencyTracker latency;
+uint32_t vitalsFrameSeq = 0;
+
+// Heap allocations per subsystem. The linker routes malloc/calloc/realloc/
+// free through the wrappers below (-Wl,--wrap in platformio.ini); loop()
+// code charges them to its MemoryScope, other tasks to MEMORY_OTHER.
+vitalcare::MemoryAccounting memory; // Zero-initialised, usable before setup()
+portMUX_TYPE memoryLock = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t memoryLoopTask = nullptr;
+
+extern "C"
+{
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t count, size_t size);
+  void *__real_realloc(void *ptr, size_t size);
+  void __real_free(void *ptr);
+
+  static uint8_t memoryTag()
+  {
+    return memoryLoopTask && xTaskGetCurrentTaskHandle() == memoryLoopTask ? memory.current()
+                                                                           : (uint8_t)vitalcare::MEMORY_OTHER;
+  }
+
+  static void countAllocation(size_t size)
+  {
+    uint8_t tag = memoryTag();
+    portENTER_CRITICAL(&memoryLock);
+    memory.onAllocate(tag, size);
+    portEXIT_CRITICAL(&memoryLock);
+  }
+
+  void *__wrap_malloc(size_t size)
+  {
+    void *ptr = __real_malloc(size);
+    if (ptr)
+      countAllocation(size);
+    return ptr;
+  }
+
+  void *__wrap_calloc(size_t count, size_t size)
+  {
+    void *ptr = __real_calloc(count, size);
+    if (ptr)
+      countAllocation(count * size);
+    return ptr;
+  }
+
+  void *__wrap_realloc(void *ptr, size_t size)
+  {
+    void *result = __real_realloc(ptr, size);
+    if (result && size > 0)
+      countAllocation(size);
+    return result;
+  }
+
+  void __wrap_free(void *ptr)
+  {
+    if (!ptr)
+      return;
+    uint8_t tag = memoryTag();
+    portENTER_CRITICAL(&memoryLock);
+    memory.onFree(tag);
+    portEXIT_CRITICAL(&memoryLock);
+    __real_free(ptr);
+  }
+}
 SoftwareSerial sim800(SIM800_RX_PIN, SIM800_TX_PIN);
 
 // Patient Data Structure
@@ -82,34 +165,464 @@ struct VitalSigns
   int ecgValue;
   float pressure;
   unsigned long timestamp;
-  String status;
+  const char *status; // Always a literal, so the 1 s update never allocates
+};
+
+// SD card writes (StorageQueue.h): loop() fills buffers and a writer task
+// on core 0 owns the card, so a card stalling for half a second holds up
+// nothing but the writer. Vitals block when the buffers are full (they
+// wait in the history ring until the writer confirms them); waveform
+// records are dropped and the gap marked in the EDF+ file. Channels are
+// written in this order.
+enum WriterChannel : uint8_t
+{
+  WRITER_VITALS = 0, // Trend CSV rows, ping-pong buffers
+  WRITER_BACKFILL,   // Flash logs moving to the card
+  WRITER_WAVEFORM,   // EDF+ records and the sensor capture, triple buffers
+  WRITER_CHANNELS
+};
+enum WriterFile : uint8_t
+{
+  WRITER_CSV = 0,
+  WRITER_MIGRATION,
+  WRITER_EDF,
+  WRITER_CAPTURE,
+  WRITER_FILES
+};
+const size_t WRITER_BUFFER_BYTES = 4096;
+const size_t BACKFILL_BUFFER_BYTES = 2048;
+const uint32_t FORCE_SAVE_TIMEOUT_MS = 5000; // Patient change waiting for the card
+
+// EDF+ recordings are cut into hour segments, each preallocated whole so
+// the writes that fill it never allocate clusters: an hour of 540-byte
+// records is 1.9 MB, plus the header
+const uint32_t EDF_SEGMENT_MS = 3600000;
+const uint32_t EDF_SEGMENT_BYTES = 2 * 1024 * 1024;
+const char *SPARE_SEGMENT_PATH = "/vitalcare/spare.seg";
+const char *SD_MOUNT_POINT = "/sd"; // SD.begin()'s, for POSIX truncate()
+
+// Device time: seconds of powered time since first boot, kept across
+// resets in NVS. The system clock is set from it at boot, so FAT file
+// times read in it and retention (Retention.h) can age recordings. Time
+// switched off does not count, so files on a shelved device do not age.
+const time_t DEVICE_EPOCH = 1577836800; // 2020-01-01, after FAT's 1980
+const uint32_t CLOCK_SAVE_INTERVAL_S = 600;
+Preferences clockPrefs;
+uint32_t clockSavedS = 0;
+uint32_t uploadedThrough = 0; // Upload watermark, device time
+
+uint32_t deviceTime()
+{
+  time_t now = time(nullptr);
+  return now > DEVICE_EPOCH ? (uint32_t)(now - DEVICE_EPOCH) : 0;
+}
+
+struct SegmentCounters
+{
+  uint32_t opened;        // Segments opened
+  uint32_t inlineAlloc;   // ...preallocated when opened, for want of a spare
+  uint32_t contiguous;    // Preallocations that got one contiguous run
+  uint32_t overruns;      // Writes past a segment's preallocated size
+  uint32_t preallocateUs; // The last preallocation, spare or inline
+  bool spareReady;
+};
+
+// The writer task's side: the open SD card File of each slot. Segments
+// are made from a spare file the task preallocates while it is idle, so
+// opening one at rotation time is a rename; their logical end is tracked
+// (StorageSegment) and the preallocated tail is cut off on close. The
+// rest of the idle time goes to retention, which sees the card through
+// this sink as well, without the files open in slots.
+class SdStorageSink : public vitalcare::StorageSink, public vitalcare::RetentionStore
+{
+public:
+  explicit SdStorageSink(uint32_t spareBytes)
+      : spareBytes(spareBytes), mounted(false), spareFailed(false), counts{0, 0, 0, 0, 0, false}, retention(*this),
+        clockS(0), clockUploadedS(0), retentionCopy{}
+  {
+    lock = portMUX_INITIALIZER_UNLOCKED;
+  }
+
+  bool mount() override
+  {
+    for (uint8_t slot = 0; slot < WRITER_FILES; slot++)
+      close(slot);
+    directory.close();
+    retention.restart();
+    SD.end();
+    counts.spareReady = false;
+    spareFailed = false;
+    mounted = SD.begin(SD_CS_PIN) && SD.cardType() != CARD_NONE;
+    if (!mounted)
+      return false;
+    if (!SD.exists("/vitalcare"))
+      SD.mkdir("/vitalcare");
+    // A spare left from before a reset is still good
+    File spare = SD.open(SPARE_SEGMENT_PATH, FILE_READ);
+    counts.spareReady = spare && spare.size() >= spareBytes;
+    spare.close();
+    return true;
+  }
+
+  bool open(uint8_t slot, const char *path, bool truncate) override
+  {
+    close(slot);
+    files[slot] = SD.open(path, truncate ? FILE_WRITE : FILE_APPEND);
+    paths[slot] = files[slot] ? path : "";
+    return (bool)files[slot];
+  }
+
+  bool openSegment(uint8_t slot, const char *path, uint32_t bytes) override
+  {
+    close(slot);
+    if (bytes == 0)
+      return open(slot, path, true);
+    bool fromSpare = counts.spareReady && bytes <= spareBytes;
+    if (fromSpare)
+    {
+      SD.remove(path);
+      fromSpare = SD.rename(SPARE_SEGMENT_PATH, path);
+      counts.spareReady = false;
+    }
+    spareFailed = false; // Rotation time: make the next spare
+    if (!fromSpare)
+    {
+      // In the write path after all, as the first segment after boot may
+      // be, and a full card records into a plain growing file
+      counts.inlineAlloc++;
+      if (!preallocate(path, bytes))
+        return open(slot, path, true);
+    }
+    // "r+" writes over the preallocated bytes from the start
+    files[slot] = SD.open(path, "r+");
+    if (!files[slot])
+      return false;
+    counts.opened++;
+    segments[slot].begin(fromSpare ? spareBytes : bytes);
+    paths[slot] = path;
+    return true;
+  }
+
+  uint32_t size(uint8_t slot) override
+  {
+    if (!files[slot])
+      return 0;
+    return segments[slot].bytes ? segments[slot].end : files[slot].size();
+  }
+
+  bool write(uint8_t slot, const uint8_t *data, size_t length) override
+  {
+    if (!files[slot] || files[slot].write(data, length) != length)
+      return false;
+    if (segments[slot].bytes)
+    {
+      uint32_t before = segments[slot].overruns;
+      segments[slot].wrote(length);
+      counts.overruns += segments[slot].overruns - before;
+    }
+    return true;
+  }
+
+  bool seek(uint8_t slot, uint32_t offset) override
+  {
+    if (!files[slot] || (segments[slot].bytes && !segments[slot].seek(offset)))
+      return false;
+    return files[slot].seek(offset);
+  }
+
+  bool flush(uint8_t slot) override
+  {
+    if (!files[slot])
+      return false;
+    files[slot].flush();
+    return true;
+  }
+
+  void close(uint8_t slot) override
+  {
+    files[slot].close();
+    if (segments[slot].bytes)
+    {
+      // Cut the preallocated tail off; SD's File has no truncate
+      if (mounted)
+        ::truncate((String(SD_MOUNT_POINT) + paths[slot]).c_str(), segments[slot].end);
+      segments[slot].bytes = 0;
+    }
+    paths[slot] = "";
+  }
+
+  // Preallocates the next segment's spare once one has been used (a full
+  // card is tried again at the next rotation or mount), then gives
+  // retention a step within its budget
+  bool idle() override
+  {
+    if (!mounted)
+      return false;
+    if (!counts.spareReady && !spareFailed && spareBytes > 0)
+    {
+      counts.spareReady = preallocate(SPARE_SEGMENT_PATH, spareBytes);
+      spareFailed = !counts.spareReady;
+      return true;
+    }
+    portENTER_CRITICAL(&lock);
+    uint32_t now = clockS;
+    uint32_t uploaded = clockUploadedS;
+    portEXIT_CRITICAL(&lock);
+    if (now == 0)
+      return false;
+    retention.setClock(now, uploaded);
+    bool worked = retention.step();
+    if (worked)
+    {
+      portENTER_CRITICAL(&lock);
+      retentionCopy = retention.stats();
+      portEXIT_CRITICAL(&lock);
+    }
+    return worked;
+  }
+
+  // Read from loop() without the writer's lock: whole words, for /metrics
+  SegmentCounters counters() const { return counts; }
+
+  // From loop(): device time and the upload watermark for retention
+  void setClock(uint32_t now, uint32_t uploaded)
+  {
+    portENTER_CRITICAL(&lock);
+    clockS = now;
+    clockUploadedS = uploaded;
+    portEXIT_CRITICAL(&lock);
+  }
+
+  vitalcare::RetentionStats retentionStats()
+  {
+    portENTER_CRITICAL(&lock);
+    vitalcare::RetentionStats copy = retentionCopy;
+    portEXIT_CRITICAL(&lock);
+    return copy;
+  }
+
+  const vitalcare::RetentionPolicy &retentionPolicy() const { return retention.rules(); }
+
+  // RetentionStore, in the writer task. The free count comes from the FAT
+  // after the first scan of it, which can take seconds on a large card.
+  uint64_t totalBytes() override { return SD.totalBytes(); }
+  uint64_t freeBytes() override { return SD.totalBytes() - SD.usedBytes(); }
+
+  bool rewind() override
+  {
+    directory.close();
+    directory = SD.open("/vitalcare");
+    return directory && directory.isDirectory();
+  }
+
+  bool next(vitalcare::RetentionFile &file) override
+  {
+    while (true)
+    {
+      File entry = directory.openNextFile();
+      if (!entry)
+        return false;
+      if (entry.isDirectory() || isOpen(entry.path()))
+        continue;
+      snprintf(file.path, sizeof(file.path), "%s", entry.path());
+      file.bytes = entry.size();
+      time_t modified = entry.getLastWrite();
+      file.modifiedS = modified > DEVICE_EPOCH ? (uint32_t)(modified - DEVICE_EPOCH) : 0;
+      return true;
+    }
+  }
+
+  int32_t read(const char *path, uint32_t offset, uint8_t *data, size_t length) override
+  {
+    File file = SD.open(path, FILE_READ);
+    if (!file || !file.seek(offset))
+      return -1;
+    int32_t got = offset >= file.size() ? 0 : (int32_t)file.read(data, length);
+    file.close();
+    return got;
+  }
+
+  bool write(const char *path, const uint8_t *data, size_t length, bool truncate) override
+  {
+    File file = SD.open(path, truncate ? FILE_WRITE : FILE_APPEND);
+    if (!file)
+      return false;
+    bool ok = file.write(data, length) == length;
+    file.close();
+    return ok;
+  }
+
+  bool remove(const char *path) override { return !isOpen(path) && SD.remove(path); }
+  uint32_t micros() override { return ::micros(); }
+
+private:
+  // Allocates the whole cluster chain in one go. f_expand() (through the
+  // VFS, IDF 5.1 on) finds one contiguous run of free clusters and
+  // allocates it, so the segment never waits on the FAT while recording.
+  // When the card has no run that long, or on an older core, seeking past
+  // the end makes FatFs extend the chain to there instead: allocated all
+  // the same, but from whatever clusters are free. Neither way writes
+  // the clusters: what they held before stays until overwritten, and the
+  // segment's logical end says where its data stops.
+  bool preallocate(const char *path, uint32_t bytes)
+  {
+    uint32_t start = micros();
+    SD.remove(path); // f_expand() needs an empty file
+    bool ok = false;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    String fullPath = String(SD_MOUNT_POINT) + path;
+    ok = esp_vfs_fat_create_contiguous_file(SD_MOUNT_POINT, fullPath.c_str(), bytes, true) == ESP_OK;
+    if (ok)
+      counts.contiguous++;
+    else
+      SD.remove(path);
+#endif
+    if (!ok)
+    {
+      File file = SD.open(path, FILE_WRITE);
+      if (!file)
+        return false;
+      uint8_t last = 0;
+      ok = file.seek(bytes - 1) && file.write(&last, 1) == 1;
+      file.close();
+      if (!ok)
+        SD.remove(path);
+    }
+    counts.preallocateUs = micros() - start;
+    return ok;
+  }
+
+  bool isOpen(const char *path) const
+  {
+    for (const String &open : paths)
+      if (open == path)
+        return true;
+    return false;
+  }
+
+  uint32_t spareBytes;
+  bool mounted;
+  bool spareFailed;
+  SegmentCounters counts;
+  File files[WRITER_FILES];
+  vitalcare::StorageSegment segments[WRITER_FILES];
+  String paths[WRITER_FILES]; // Open in each slot, "" if none
+  File directory;             // Retention's scan
+  vitalcare::RetentionEngine retention;
+
+  portMUX_TYPE lock; // For the members below, shared with loop()
+  uint32_t clockS;
+  uint32_t clockUploadedS;
+  vitalcare::RetentionStats retentionCopy;
+};
+
+SdStorageSink sdSink(EDF_SEGMENT_BYTES);
+vitalcare::TaskStorageWriter<WRITER_CHANNELS> sdWriter(sdSink);
+uint8_t vitalsBuffers[2 * WRITER_BUFFER_BYTES];
+uint8_t backfillBuffers[2 * BACKFILL_BUFFER_BYTES];
+uint8_t waveformBuffers[3 * WRITER_BUFFER_BYTES];
+bool sdMountPending = false;
+
+// EDF+ recording of the current patient: one 1 s data record per UI tick
+// holding the 10 Hz ECG reads and the 100 Hz PPG FIFO samples, queued on
+// the waveform channel
+class QueuedEdfOutput : public vitalcare::EdfOutput
+{
+public:
+  bool write(const uint8_t *data, size_t length) override
+  {
+    return sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_WRITE, WRITER_EDF, data, length);
+  }
+
+  bool seek(uint64_t offset) override
+  {
+    uint8_t position[4] = {(uint8_t)offset, (uint8_t)(offset >> 8), (uint8_t)(offset >> 16), (uint8_t)(offset >> 24)};
+    return sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_SEEK, WRITER_EDF, position, sizeof(position));
+  }
 };
 
+// Samples and annotations come from BedsideRecording (BedsideOutputs.h),
+// which the host heap soak runs as well
+const uint16_t ECG_SAMPLES_PER_RECORD = vitalcare::BEDSIDE_ECG_SAMPLES_PER_RECORD;
+const uint16_t PPG_SAMPLES_PER_RECORD = vitalcare::BEDSIDE_PPG_SAMPLES_PER_RECORD;
+
+QueuedEdfOutput edfOutput;
+std::unique_ptr<vitalcare::EdfWriter> edfWriter;
+uint8_t edfRecordBuffer[vitalcare::BEDSIDE_EDF_RECORD_BYTES];
+vitalcare::BedsideRecording edfRecording;
+
+// Recent history in RAM (History.h): every 1 s update and the raw waveform,
+// in PSRAM when the board has it and a smaller internal RAM ring otherwise.
+// Serves /api/history, /api/waveform and dashboard reconnect backlogs, and
+// is the write-behind cache the 30 s SD save drains.
+const uint32_t HISTORY_SECONDS_PSRAM = 24 * 3600;
+const uint32_t WAVEFORM_SECONDS_PSRAM = 300;
+const uint32_t HISTORY_SECONDS_INTERNAL = 1800;
+const uint32_t WAVEFORM_SECONDS_INTERNAL = 30;
+const uint32_t BACKLOG_MAX_RECORDS = 600; // Sent to a reconnecting dashboard
+const uint32_t BACKLOG_RECORDS_PER_MESSAGE = 16;
+vitalcare::RecordRing vitalsHistory;
+vitalcare::SampleRing ecgHistory;
+vitalcare::SampleRing redHistory;
+vitalcare::SampleRing irHistory;
+bool historyInPsram = false;
+uint32_t historySeq = 0;       // Sequence number of the newest update
+uint32_t historySaveCursor = 0;   // Next update to save, to the SD card or flash
+uint32_t historyQueuedCursor = 0; // Next update to queue for the SD card
+uint32_t historySaveDropped = 0;  // Overwritten before they were saved
+bool historyWriteFailed = false;  // Requeue from historySaveCursor once the writer is idle
+String csvOpenPath;               // Trend CSV open in the writer's WRITER_CSV slot
+// Room for the WebSocket header in front, as for the vitals frame
+char historyChunk[WEBSOCKETS_MAX_HEADER_SIZE + 1024];
+
 // Global Variables
 Patient currentPatient;
 VitalSigns currentVitals;
 bool patientRegistered = false;
-bool sdCardReady = false;
 bool sim800Ready = false;
-bool bmp180Ready = false;
+
+// Storage tiers (StorageTier.h): the SD card while it works, otherwise the
+// "logs" LittleFS partition in internal flash, moved onto the card once it
+// is back. Flash logs hold packed HistoryRecords, written a flash block at
+// a time to limit wear; EDF+ recordings and captures need the card.
+const char *ASSETS_PARTITION = "assets"; // Web files, also LittleFS
+const char *FLASH_LOG_PARTITION = "logs";
+const char *FLASH_LOG_DIR = "/vitalcare";
+const uint32_t FLASH_BLOCK_SIZE = 4096;
+const uint32_t FLASH_PROGRAM_SIZE = 256;
+const uint32_t FLASH_RESERVE_BYTES = 8 * FLASH_BLOCK_SIZE; // Free blocks LittleFS needs to copy on write
+vitalcare::SdCardHealth sdCard;
+fs::LittleFSFS flashLogs;
+bool flashLogsReady = false;
+bool flashLogsFull = false;
+vitalcare::FlashWear flashWear;
+Preferences storagePrefs; // Lifetime flash wear counters
+bool migrationPending = false;
+String migrationPath; // Flash log being moved to the card, "" between files
+uint32_t migrationOffset = 0;    // Queued for the card up to here
+uint32_t migrationConfirmed = 0; // Written to the card up to here
+bool migrationCsvOpen = false;
+bool migrationFailed = false;
+uint32_t migratedRecords = 0;
+uint32_t migratedFiles = 0;
+uint8_t edfPart = 0; // A new EDF+ file each hour and each time the card comes back
 
 // Timing variables
 unsigned long lastVitalUpdate = 0;
 unsigned long lastSensorRead = 0;
 unsigned long lastDataSave = 0;
-unsigned long lastHeartbeatTime = 0;
 
 const unsigned long VITAL_UPDATE_INTERVAL = 1000; // 1 second for UI updates
 const unsigned long SENSOR_READ_INTERVAL = 100;   // 100ms for sensor readings
 const unsigned long DATA_SAVE_INTERVAL = 30000;   // 30 seconds for SD card saves
-const unsigned long HEARTBEAT_TIMEOUT = 10000;    // 10 seconds heartbeat timeout
 
-// Pulse detection variables
-int pulseThreshold = 2048; // Adjustable threshold for pulse detection
-int lastPulseValue = 0;
-bool pulseDetected = false;
-unsigned long pulseCount = 0;
-unsigned long pulseWindow = 0;
+#ifdef VITALCARE_CAPTURE
+// Capture of every monitor input for replay on the host (Capture.h),
+// buffered in RAM and queued on the waveform channel
+bool captureActive = false;
+uint8_t captureBuffer[WRITER_BUFFER_BYTES / 2];
+size_t captureLength = 0;
+#endif
 
 // Function Prototypes
 void setupHardware();
@@ -117,8 +630,11 @@ void setupSensors();
 void setupWiFiAP();
 void setupWebServer();
 void setupWebSocket();
+void setupDeviceClock();
 void setupSDCard();
+void setupFlashLogs();
 void setupSIM800();
+void setupHistory();
 
 void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length);
 void handleRoot();
@@ -126,15 +642,39 @@ void handlePatientRegistration();
 void handleGetPatientData();
 void handleGetVitalSigns();
 void handleSystemStatus();
+void handleMetrics();
+void handleHistory();
+void handleWaveform();
+void handleStorageUploaded();
 void handleNotFound();
 
 void readSensors();
-void calculateHeartRate();
-void estimateBloodPressure();
+void updateVitals();
 void sendVitalSignsToClients();
+void handleLatencyEcho(uint8_t num, const uint8_t *payload, size_t length);
+void sendHistoryBacklog(uint8_t num, const char *url);
+size_t formatHistoryRow(uint32_t sequence, char *out, size_t capacity);
+void saveHistory(bool force);
 void saveDataToSD();
+void saveDataToFlash(bool force);
+void pollStorage();
+void migrateFlashLogs();
+void onSdWrite(bool ok);
+void takeStorageCompletions();
+uint8_t storageTier();
+void startEdfRecording(bool leadsOff = false);
+void stopEdfRecording();
+void rotateEdfRecording();
 void sendSMSAlert(String message);
-void checkForAlerts();
+void checkForAlerts(const vitalcare::BedsideDecision &decision);
+vitalcare::VitalSample toVitalSample(const VitalSigns &vitals);
+
+void startCapture();
+void captureSensors(const vitalcare::SensorInputs &inputs);
+void captureUpdate(unsigned long now, bool monitoring, bool smsReady);
+void capturePatient();
+void captureDecision(unsigned long now, const vitalcare::BedsideDecision &decision);
+void flushCapture(bool sync);
 
 String generatePatientID();
 String formatTimestamp(unsigned long timestamp);
@@ -142,6 +682,7 @@ String getSystemStatusJSON();
 
 void setup()
 {
+  memoryLoopTask = xTaskGetCurrentTaskHandle();
   Serial.begin(115200);
   delay(2000);
 
@@ -151,22 +692,26 @@ void setup()
 
   // Initialize hardware and sensors
   setupHardware();
+  setupHistory();
   setupSensors();
 
-  // Initialize SPIFFS for web files
-  if (!SPIFFS.begin(true))
+  // Initialize LittleFS for web files
+  if (!LittleFS.begin(true, "/littlefs", 10, ASSETS_PARTITION))
   {
-    Serial.println("❌ SPIFFS initialization failed");
+    Serial.println("❌ LittleFS initialization failed");
     return;
   }
-  Serial.println("✅ SPIFFS initialized");
+  Serial.println("✅ LittleFS initialized");
 
   // Setup components
   setupWiFiAP();
   setupWebServer();
   setupWebSocket();
+  setupDeviceClock();
   setupSDCard();
+  setupFlashLogs();
   setupSIM800();
+  startCapture();
 
   // Initialize mDNS
   if (MDNS.begin("vitalcare"))
@@ -185,11 +730,19 @@ void setup()
 
 void loop()
 {
-  // Handle web server requests
-  server.handleClient();
+  {
+    vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_WEB);
+
+    // Handle web server requests
+    server.handleClient();
+
+    // Handle WebSocket connections
+    webSocket.loop();
+  }
 
-  // Handle WebSocket connections
-  webSocket.loop();
+  // Run I2C completions and advance the BMP180 conversion (never blocks)
+  i2cBus.dispatchCompletions();
+  bmp180.poll(millis());
 
   // Read sensors at high frequency
   if (millis() - lastSensorRead >= SENSOR_READ_INTERVAL)
@@ -201,34 +754,56 @@ void loop()
   // Update UI every second
   if (millis() - lastVitalUpdate >= VITAL_UPDATE_INTERVAL)
   {
-    calculateHeartRate();
-    estimateBloodPressure();
-    currentVitals.timestamp = millis();
-
-    if (patientRegistered)
+    updateVitals();
+    sendVitalSignsToClients();
+    if (edfWriter)
     {
-      currentVitals.status = "Monitoring";
-      checkForAlerts();
+      // The waveform channel drops rather than blocks: a record the writer
+      // has no buffer for is skipped and the gap annotated
+      vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+      if (sdWriter.offer(WRITER_WAVEFORM, edfWriter->recordSize()))
+        edfWriter->endRecord();
+      else
+        edfWriter->skipRecord();
+      // Closing one segment and starting the next takes two headers of room
+      if (edfWriter->elapsedMs() >= EDF_SEGMENT_MS && sdWriter.room(WRITER_WAVEFORM) >= 3 * edfWriter->headerSize())
+        rotateEdfRecording();
     }
-    else
+    uint32_t now = deviceTime();
+    sdSink.setClock(now, uploadedThrough);
+    if (now - clockSavedS >= CLOCK_SAVE_INTERVAL_S)
     {
-      currentVitals.status = "No Patient";
+      clockPrefs.putUInt("seconds", now);
+      clockSavedS = now;
     }
-
-    sendVitalSignsToClients();
     lastVitalUpdate = millis();
   }
 
-  // Save data to SD card periodically
+  // Save data to SD card (or internal flash) periodically
   if (millis() - lastDataSave >= DATA_SAVE_INTERVAL)
   {
-    if (patientRegistered && sdCardReady)
+    vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+    if (patientRegistered)
     {
-      saveDataToSD();
+      saveHistory(false);
+    }
+    if (edfWriter && sdWriter.room(WRITER_WAVEFORM) >= 2 * edfWriter->headerSize())
+    {
+      // Keep the header's record count current in case power is lost
+      edfWriter->sync();
+      sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_FLUSH, WRITER_EDF, nullptr, 0);
     }
+    flushCapture(true);
+    sdWriter.submit(WRITER_WAVEFORM);
     lastDataSave = millis();
   }
 
+  // Take the writer's results, watch for the SD card coming back and move
+  // flash logs onto it
+  pollStorage();
+
+  memory.update(millis());
+
   // Small delay to prevent watchdog issues
   delay(10);
 }
@@ -252,17 +827,78 @@ void setupHardware()
   Serial.println("✅ Hardware pins configured");
 }
 
+// Sizes the history rings for PSRAM when there is some; without it, or if
+// the allocation fails, halves the internal RAM size until it fits
+void setupHistory()
+{
+  historyInPsram = psramFound();
+  uint32_t seconds = historyInPsram ? HISTORY_SECONDS_PSRAM : HISTORY_SECONDS_INTERNAL;
+  uint32_t waveformSeconds = historyInPsram ? WAVEFORM_SECONDS_PSRAM : WAVEFORM_SECONDS_INTERNAL;
+  uint8_t *records = nullptr;
+  int16_t *waveform = nullptr;
+  while (seconds >= 60)
+  {
+    size_t recordBytes = seconds * vitalcare::HISTORY_RECORD_SIZE;
+    size_t waveformBytes = waveformSeconds * (ECG_SAMPLES_PER_RECORD + 2 * PPG_SAMPLES_PER_RECORD) * sizeof(int16_t);
+    records = (uint8_t *)(historyInPsram ? ps_malloc(recordBytes) : malloc(recordBytes));
+    waveform = (int16_t *)(historyInPsram ? ps_malloc(waveformBytes) : malloc(waveformBytes));
+    if (records && waveform)
+      break;
+    free(records);
+    free(waveform);
+    records = nullptr;
+    waveform = nullptr;
+    if (historyInPsram)
+    {
+      historyInPsram = false;
+      seconds = HISTORY_SECONDS_INTERNAL;
+      waveformSeconds = WAVEFORM_SECONDS_INTERNAL;
+    }
+    else
+    {
+      seconds /= 2;
+      waveformSeconds = waveformSeconds > 2 ? waveformSeconds / 2 : 1;
+    }
+  }
+  if (!records)
+  {
+    Serial.println("❌ No memory for the history ring; SD saves hold the current reading only");
+    return;
+  }
+
+  vitalsHistory.begin(records, seconds * vitalcare::HISTORY_RECORD_SIZE, vitalcare::HISTORY_RECORD_SIZE);
+  ecgHistory.begin(waveform, waveformSeconds * ECG_SAMPLES_PER_RECORD, ECG_SAMPLES_PER_RECORD);
+  redHistory.begin(waveform + waveformSeconds * ECG_SAMPLES_PER_RECORD, waveformSeconds * PPG_SAMPLES_PER_RECORD,
+                   PPG_SAMPLES_PER_RECORD);
+  irHistory.begin(waveform + waveformSeconds * (ECG_SAMPLES_PER_RECORD + PPG_SAMPLES_PER_RECORD),
+                  waveformSeconds * PPG_SAMPLES_PER_RECORD, PPG_SAMPLES_PER_RECORD);
+  Serial.printf("✅ History: %u min of vitals and %u s of waveform in %s\n", seconds / 60, waveformSeconds,
+                historyInPsram ? "PSRAM" : "internal RAM");
+}
+
 void setupSensors()
 {
   Serial.println("🔧 Initializing sensors...");
 
-  // Initialize I2C for BMP180
+  // Initialize the shared I2C bus; from here on only the bus task touches Wire
   Wire.begin();
+  if (!i2cBus.begin())
+  {
+    Serial.println("❌ I2C bus task could not be started");
+  }
 
-  // Initialize BMP180
-  if (bmp180.begin())
+  // Probe and configure the I2C sensors (asynchronously, wait up to 500ms)
+  bmp180.begin();
+  spo2Sensor.begin();
+  unsigned long probeStart = millis();
+  while ((bmp180.busy() || spo2Sensor.busy()) && millis() - probeStart < 500)
+  {
+    i2cBus.dispatchCompletions();
+    delay(1);
+  }
+
+  if (bmp180.ready())
   {
-    bmp180Ready = true;
     Serial.println("✅ BMP180 sensor initialized");
   }
   else
@@ -270,8 +906,19 @@ void setupSensors()
     Serial.println("❌ BMP180 sensor not found");
   }
 
-  // Initialize pulse detection
-  pulseWindow = millis();
+  if (spo2Sensor.ready())
+  {
+    Serial.println("✅ MAX30102 SpO2 sensor initialized");
+  }
+  else
+  {
+    Serial.println("❌ MAX30102 SpO2 sensor not found");
+  }
+
+  // Initialize pulse detection; the seed drives the simulated BP and temperature variation
+  monitorSeed = esp_random();
+  monitorStartMs = millis();
+  monitor.begin(monitorStartMs, monitorSeed);
   Serial.println("✅ Pulse sensor configured");
   Serial.println("✅ AD8232 ECG sensor configured");
 }
@@ -302,8 +949,8 @@ void setupWebServer()
 {
   Serial.println("🔧 Setting up Web Server...");
 
-  // Serve static files from SPIFFS
-  server.serveStatic("/", SPIFFS, "/", "max-age=86400");
+  // Serve static files from LittleFS
+  server.serveStatic("/", LittleFS, "/", "max-age=86400");
 
   // API Endpoints
   server.on("/", HTTP_GET, handleRoot);
@@ -311,6 +958,10 @@ void setupWebServer()
   server.on("/api/patient", HTTP_GET, handleGetPatientData);
   server.on("/api/vitals", HTTP_GET, handleGetVitalSigns);
   server.on("/api/status", HTTP_GET, handleSystemStatus);
+  server.on("/api/metrics", HTTP_GET, handleMetrics);
+  server.on("/api/history", HTTP_GET, handleHistory);
+  server.on("/api/waveform", HTTP_GET, handleWaveform);
+  server.on("/api/storage/uploaded", HTTP_POST, handleStorageUploaded);
 
   server.onNotFound(handleNotFound);
   server.begin();
@@ -325,28 +976,77 @@ void setupWebSocket()
   Serial.println("✅ WebSocket Server started on port 81");
 }
 
+// Carries device time on from its last save (up to CLOCK_SAVE_INTERVAL_S
+// behind after a power cut) and restores the upload watermark
+void setupDeviceClock()
+{
+  clockPrefs.begin("clock", false);
+  clockSavedS = clockPrefs.getUInt("seconds", 0);
+  uploadedThrough = clockPrefs.getUInt("uploaded", 0);
+  struct timeval now = {(time_t)(DEVICE_EPOCH + clockSavedS), 0};
+  settimeofday(&now, nullptr);
+  Serial.printf("✅ Device time %lu s, uploaded through %lu s\n", (unsigned long)clockSavedS,
+                (unsigned long)uploadedThrough);
+}
+
 void setupSDCard()
 {
   Serial.println("🔧 Initializing SD Card...");
 
-  if (SD.begin(SD_CS_PIN))
+  // Mounted here, before the writer task takes the card over
+  bool mounted = sdSink.mount();
+  sdCard.begin(mounted, millis());
+  if (mounted)
   {
-    sdCardReady = true;
     Serial.println("✅ SD Card initialized");
-
-    // Create data directory if it doesn't exist
-    if (!SD.exists("/vitalcare"))
-    {
-      SD.mkdir("/vitalcare");
-      Serial.println("✅ Created /vitalcare directory");
-    }
   }
   else
   {
-    Serial.println("❌ SD Card initialization failed");
+    Serial.println("❌ SD Card initialization failed; saving to internal flash until one is inserted");
+  }
+
+  sdWriter.channel(WRITER_VITALS, vitalsBuffers, WRITER_BUFFER_BYTES, 2, vitalcare::STORAGE_BLOCK);
+  sdWriter.channel(WRITER_BACKFILL, backfillBuffers, BACKFILL_BUFFER_BYTES, 2, vitalcare::STORAGE_BLOCK);
+  sdWriter.channel(WRITER_WAVEFORM, waveformBuffers, WRITER_BUFFER_BYTES, 3, vitalcare::STORAGE_DROP);
+  // Core 0, below the I2C bus task, so sensor transfers go first
+  if (!sdWriter.begin(0, 2))
+  {
+    Serial.println("❌ SD writer task failed to start");
   }
 }
 
+void setupFlashLogs()
+{
+  Serial.println("🔧 Mounting flash fallback storage...");
+
+  if (!flashLogs.begin(true, "/logs", 4, FLASH_LOG_PARTITION))
+  {
+    Serial.println("❌ Flash fallback storage unavailable");
+    return;
+  }
+  flashLogsReady = true;
+  if (!flashLogs.exists(FLASH_LOG_DIR))
+  {
+    flashLogs.mkdir(FLASH_LOG_DIR);
+  }
+
+  flashWear.begin(FLASH_BLOCK_SIZE, FLASH_PROGRAM_SIZE, flashLogs.totalBytes() / FLASH_BLOCK_SIZE);
+  storagePrefs.begin("storage", false);
+  vitalcare::FlashWearCounters counters = {0, 0, 0, 0};
+  if (storagePrefs.getBytes("wear", &counters, sizeof(counters)) == sizeof(counters))
+  {
+    flashWear.restore(counters);
+  }
+
+  // Logs left from before a reboot still go to the card
+  File dir = flashLogs.open(FLASH_LOG_DIR);
+  File log = dir ? dir.openNextFile() : File();
+  migrationPending = (bool)log;
+  Serial.printf("✅ Flash fallback storage: %u KB free%s\n",
+                (unsigned)((flashLogs.totalBytes() - flashLogs.usedBytes()) / 1024),
+                migrationPending ? ", logs waiting for the SD card" : "");
+}
+
 void setupSIM800()
 {
   Serial.println("🔧 Initializing SIM800L...");
@@ -379,224 +1079,666 @@ void setupSIM800()
 
 void readSensors()
 {
-  // Read AD8232 ECG sensor
-  bool loPlus = digitalRead(AD8232_LO_PLUS_PIN);
-  bool loMinus = digitalRead(AD8232_LO_MINUS_PIN);
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_SENSORS);
+  vitalcare::SensorInputs inputs = {};
+  inputs.timeMs = millis();
+  uint32_t acquiredUs = micros();
+  latency.onAcquired(acquiredUs);
+
+  // Read AD8232 ECG sensor; a lead off leaves the value unread
+  inputs.leadsOff = digitalRead(AD8232_LO_PLUS_PIN) || digitalRead(AD8232_LO_MINUS_PIN);
+  if (!inputs.leadsOff)
+  {
+    inputs.ecg = analogRead(AD8232_OUTPUT_PIN);
+  }
+
+  // Read pulse sensor
+  inputs.pulse = analogRead(PULSE_SENSOR_PIN);
 
-  if (!loPlus && !loMinus)
+  // Latest BMP180 measurement (taken in the background once a second)
+  if (bmp180.ready() && bmp180.hasReading())
   {
-    // Good connection, read ECG value
-    currentVitals.ecgValue = analogRead(AD8232_OUTPUT_PIN);
+    inputs.environment = true;
+    inputs.temperatureC = bmp180.temperatureC();
+    inputs.pressurePa = bmp180.pressurePa();
   }
-  else
+
+  // Drain the MAX30102 FIFO (about 10 samples per 100 ms read)
+  inputs.spo2Ready = spo2Sensor.ready();
+  if (inputs.spo2Ready)
   {
-    // Poor connection
-    currentVitals.ecgValue = 0;
+    spo2Sensor.poll();
+    while (inputs.ppgCount < vitalcare::BEDSIDE_MAX_PPG_SAMPLES && spo2Sensor.read(inputs.ppg[inputs.ppgCount]))
+    {
+      inputs.ppgCount++;
+    }
   }
 
-  // Read pulse sensor
-  int pulseValue = analogRead(PULSE_SENSOR_PIN);
+  captureSensors(inputs);
+  bool beat = monitor.onSensors(inputs);
+  digitalWrite(PULSE_LED_PIN, beat ? HIGH : LOW);
+  if (beat)
+  {
+    latency.onBeat(acquiredUs, micros());
+  }
+
+  currentVitals.ecgValue = monitor.ecgValue();
+  currentVitals.temperature = monitor.sample().temperature;
+  currentVitals.pressure = monitor.pressureHpa();
+  currentVitals.spO2 = monitor.sample().spO2;
+
+  ecgHistory.push(vitalcare::bedsideEcgSample(inputs, currentVitals.ecgValue));
+  for (uint8_t i = 0; i < inputs.ppgCount; i++)
+  {
+    redHistory.push(vitalcare::bedsidePpgSample(inputs.ppg[i].red));
+    irHistory.push(vitalcare::bedsidePpgSample(inputs.ppg[i].ir));
+  }
+  edfRecording.onSensors(inputs, currentVitals.ecgValue);
+}
+
+// The 1 s tick: heart rate over the counting window, the BP estimate and,
+// with a patient registered, the alert check
+void updateVitals()
+{
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_VITALS);
+  unsigned long now = millis();
+  bool smsReady = sim800Ready && currentPatient.emergencyContact.length() > 0;
+  captureUpdate(now, patientRegistered, smsReady);
+  vitalcare::BedsideDecision decision = monitor.update(now, patientRegistered, smsReady);
+  // Stamped before the alert handling, whose buzzer and SMS hold the frame back
+  vitalsFrameSeq = latency.onPublished(micros(), decision.alertFlags);
+
+  const vitalcare::VitalSample &sample = monitor.sample();
+  currentVitals.heartRate = sample.heartRate;
+  currentVitals.systolicBP = sample.systolicBP;
+  currentVitals.diastolicBP = sample.diastolicBP;
+  currentVitals.timestamp = now;
 
-  // Simple pulse detection algorithm
-  if (pulseValue > pulseThreshold && lastPulseValue <= pulseThreshold)
+  if (patientRegistered)
   {
-    pulseDetected = true;
-    pulseCount++;
-    digitalWrite(PULSE_LED_PIN, HIGH);
-    lastHeartbeatTime = millis();
+    currentVitals.status = "Monitoring";
+    checkForAlerts(decision);
+    captureDecision(now, decision);
   }
   else
   {
-    digitalWrite(PULSE_LED_PIN, LOW);
+    currentVitals.status = "No Patient";
+  }
+
+  vitalcare::HistoryRecord record = {toVitalSample(currentVitals), currentVitals.pressure,
+                                     (uint16_t)currentVitals.ecgValue, decision.alertFlags};
+  uint8_t *slot = vitalsHistory.reserve();
+  if (slot)
+  {
+    vitalcare::encodeHistoryRecord(record, slot);
   }
+  historySeq = vitalsHistory.commit();
+}
 
-  lastPulseValue = pulseValue;
+vitalcare::VitalSample toVitalSample(const VitalSigns &vitals)
+{
+  return {vitals.heartRate, vitals.systolicBP, vitals.diastolicBP,
+          vitals.spO2, vitals.temperature, (uint32_t)vitals.timestamp};
+}
 
-  // Read BMP180 if available
-  if (bmp180Ready)
+void checkForAlerts(const vitalcare::BedsideDecision &decision)
+{
+  // Flags come from the shared bedside table (BedsideMonitor::update)
+  vitalcare::VitalSample sample = toVitalSample(currentVitals);
+  uint8_t alertFlags = decision.alertFlags;
+
+  if (alertFlags != vitalcare::ALERT_NONE)
   {
-    currentVitals.temperature = (bmp180.readTemperature() * 9.0 / 5.0) + 32.0; // Convert to Fahrenheit
-    currentVitals.pressure = bmp180.readPressure() / 100.0;                    // Convert to hPa
+    char alertText[192];
+    vitalcare::formatAlertMessage(alertFlags, sample, alertText, sizeof(alertText));
+    edfRecording.onAlerts(millis(), alertFlags, alertText);
+
+    currentVitals.status = "⚠️ ALERT";
+
+    // Sound buzzer
+    digitalWrite(BUZZER_PIN, HIGH);
+    delay(100);
+    digitalWrite(BUZZER_PIN, LOW);
+
+    // Send SMS if configured
+    if (decision.sms)
+    {
+      vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_SMS);
+      String smsMessage = "ALERT: " + currentPatient.name + " - " + alertText + "Location: VitalCare Rural Clinic";
+      sendSMSAlert(smsMessage);
+    }
+
+    Serial.printf("⚠️ ALERT: %s\n", alertText);
   }
   else
   {
-    // Fallback temperature simulation
-    currentVitals.temperature = 98.6 + random(-10, 11) / 10.0;
-    currentVitals.pressure = 1013.25 + random(-20, 21); // Standard atmospheric pressure
+    currentVitals.status = "✅ Normal";
+    edfRecording.onAlerts(millis(), alertFlags, "");
+  }
+}
+
+// Patient files share one name: /vitalcare/<id>_<registration s><extension>
+String patientFileName(const String &extension)
+{
+  return "/vitalcare/" + currentPatient.id + "_" + String(currentPatient.registrationTime / 1000) + extension;
+}
+
+// Queues opening a trend CSV in a writer slot for appending, with its
+// header if the file is new
+bool queueCsvOpen(uint8_t channel, uint8_t slot, const String &path)
+{
+  return sdWriter.append(channel, vitalcare::STORAGE_OPEN, slot, path.c_str(), path.length()) &&
+         sdWriter.append(channel, vitalcare::STORAGE_WRITE_HEADER, slot, vitalcare::HISTORY_CSV_HEADER,
+                         strlen(vitalcare::HISTORY_CSV_HEADER));
+}
+
+// Updates waiting to be saved, after skipping any the ring has overwritten
+uint32_t unsavedHistory()
+{
+  if (historySaveCursor < vitalsHistory.firstSequence())
+  {
+    historySaveDropped += vitalsHistory.firstSequence() - historySaveCursor;
+    historySaveCursor = vitalsHistory.firstSequence();
   }
+  return vitalsHistory.nextSequence() - historySaveCursor;
+}
 
-  // Estimate SpO2 (simplified - would need proper red/IR LED setup)
-  // For now, simulate based on pulse quality
-  if (currentVitals.ecgValue > 0)
+// The periodic save, to whichever tier is in service. While flash logs are
+// still being moved to the card, updates wait in the history ring so the
+// CSV stays in time order. force (a patient change) waits up to
+// FORCE_SAVE_TIMEOUT_MS for the card to take everything, and puts what it
+// did not take in flash.
+void saveHistory(bool force)
+{
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  unsigned long start = millis();
+  while (sdCard.ready())
   {
-    currentVitals.spO2 = 98 + random(-2, 3);
+    if (migrationPending)
+      migrateFlashLogs();
+    else
+      saveDataToSD();
+    if (!force || (!migrationPending && unsavedHistory() == 0) || millis() - start >= FORCE_SAVE_TIMEOUT_MS)
+      break;
+    delay(5);
+    takeStorageCompletions();
   }
-  else
+  if (flashLogsReady && (!sdCard.ready() || (force && unsavedHistory() > 0)))
   {
-    currentVitals.spO2 = 95; // Lower value when no signal
+    saveDataToFlash(force);
   }
 }
 
-void calculateHeartRate()
+// Queues every update since the last save as CSV rows for the writer task.
+// Rows that find no buffer wait in the history ring for the next save (the
+// vitals channel blocks, never drops); historySaveCursor moves once the
+// writer reports them on the card. After a failed write everything from
+// the cursor is queued again, so rows may repeat but are never skipped.
+void saveDataToSD()
 {
-  unsigned long currentTime = millis();
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  if (!sdCard.ready())
+    return;
 
-  // Calculate heart rate over 15-second window
-  if (currentTime - pulseWindow >= 15000)
+  String filename = patientFileName(".csv");
+  char line[128];
+  if (vitalsHistory.capacity() == 0)
   {
-    currentVitals.heartRate = (pulseCount * 60.0) / 15.0; // Convert to BPM
-    pulseCount = 0;
-    pulseWindow = currentTime;
+    // No history ring: the current reading only, if there is room for it
+    int length = snprintf(line, sizeof(line), "%lu,%.2f,%.2f,%.2f,%.2f,%.2f,%d,%.2f,%s\r\n",
+                          currentVitals.timestamp, currentVitals.heartRate, currentVitals.systolicBP,
+                          currentVitals.diastolicBP, currentVitals.spO2, currentVitals.temperature,
+                          currentVitals.ecgValue, currentVitals.pressure, currentVitals.status);
+    if (length > 0 && (size_t)length < sizeof(line) && queueCsvOpen(WRITER_VITALS, WRITER_CSV, filename) &&
+        sdWriter.append(WRITER_VITALS, vitalcare::STORAGE_WRITE, WRITER_CSV, line, length))
+    {
+      csvOpenPath = filename;
+      sdWriter.submit(WRITER_VITALS);
+      Serial.println("💾 Data queued for SD card: " + filename);
+    }
+    return;
   }
 
-  // Check for heartbeat timeout
-  if (currentTime - lastHeartbeatTime > HEARTBEAT_TIMEOUT)
+  if (historyWriteFailed)
   {
-    currentVitals.heartRate = 0;
+    if (sdWriter.queued(WRITER_VITALS) > 0)
+      return;
+    historyWriteFailed = false;
+    historyQueuedCursor = historySaveCursor;
+    csvOpenPath = "";
+  }
+  unsavedHistory();
+  if (historyQueuedCursor < historySaveCursor)
+    historyQueuedCursor = historySaveCursor;
+  if (historyQueuedCursor == vitalsHistory.nextSequence())
+    return;
+  if (csvOpenPath != filename)
+  {
+    if (!queueCsvOpen(WRITER_VITALS, WRITER_CSV, filename))
+      return;
+    csvOpenPath = filename;
   }
 
-  // Bounds checking
-  if (currentVitals.heartRate < 0)
-    currentVitals.heartRate = 0;
-  if (currentVitals.heartRate > 200)
-    currentVitals.heartRate = 200;
+  // Sector-sized writes, each tagged with the update after its last row
+  uint32_t sequence = historyQueuedCursor;
+  size_t used = 0;
+  char block[512];
+  bool queued = true;
+  for (; sequence < vitalsHistory.nextSequence(); sequence++)
+  {
+    vitalcare::HistoryRecord record;
+    vitalcare::decodeHistoryRecord(vitalsHistory.at(sequence), record);
+    size_t length = vitalcare::formatHistoryCsvRow(record, line, sizeof(line));
+    if (used + length > sizeof(block))
+    {
+      queued = sdWriter.append(WRITER_VITALS, vitalcare::STORAGE_WRITE, WRITER_CSV, block, used, sequence);
+      if (!queued)
+        break;
+      historyQueuedCursor = sequence;
+      used = 0;
+    }
+    memcpy(block + used, line, length);
+    used += length;
+  }
+  if (queued && used > 0 &&
+      sdWriter.append(WRITER_VITALS, vitalcare::STORAGE_WRITE, WRITER_CSV, block, used, sequence))
+    historyQueuedCursor = sequence;
+  sdWriter.append(WRITER_VITALS, vitalcare::STORAGE_FLUSH, WRITER_CSV, nullptr, 0);
+  sdWriter.submit(WRITER_VITALS);
+
+  uint32_t waiting = vitalsHistory.nextSequence() - historyQueuedCursor;
+  if (waiting)
+    Serial.printf("⏳ SD card busy: %u readings wait in RAM\n", (unsigned)waiting);
 }
 
-void estimateBloodPressure()
+// Appends whole flash blocks of packed HistoryRecords (one every 4 min 16 s
+// at 1 Hz), or everything unsaved when forced. Records that do not fit
+// wait in the history ring for the card.
+void saveDataToFlash(bool force)
 {
-  // Simplified BP estimation based on heart rate and other factors
-  // In a real device, this would require proper cuff and pressure sensors
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  if (!flashLogsReady || vitalsHistory.capacity() == 0)
+    return;
 
-  if (currentVitals.heartRate > 0)
+  const uint32_t recordsPerBlock = FLASH_BLOCK_SIZE / vitalcare::HISTORY_RECORD_SIZE;
+  uint32_t unsaved = unsavedHistory();
+  uint32_t count = force ? unsaved : unsaved - unsaved % recordsPerBlock;
+  if (count == 0)
+    return;
+  size_t bytes = count * vitalcare::HISTORY_RECORD_SIZE;
+  flashLogsFull = flashLogs.totalBytes() - flashLogs.usedBytes() < bytes + FLASH_RESERVE_BYTES;
+  if (flashLogsFull)
+    return;
+
+  String filename = patientFileName(".vhr");
+  File log = flashLogs.open(filename, FILE_APPEND);
+  if (!log)
   {
-    // Base values
-    float baseSystolic = 120;
-    float baseDiastolic = 80;
+    Serial.println("❌ Error opening flash log " + filename);
+    return;
+  }
+  uint32_t fileSize = log.size();
+  size_t written = 0;
+  for (uint32_t i = 0; i < count; i++, historySaveCursor++)
+  {
+    if (log.write(vitalsHistory.at(historySaveCursor), vitalcare::HISTORY_RECORD_SIZE) !=
+        vitalcare::HISTORY_RECORD_SIZE)
+      break;
+    written += vitalcare::HISTORY_RECORD_SIZE;
+  }
+  log.close();
+
+  flashWear.onAppend(fileSize, written);
+  storagePrefs.putBytes("wear", &flashWear.counters(), sizeof(vitalcare::FlashWearCounters));
+  migrationPending = true;
+  Serial.printf("💾 %u readings saved to internal flash: %s\n",
+                (unsigned)(written / vitalcare::HISTORY_RECORD_SIZE), filename.c_str());
+}
+
+// Where saves go right now
+uint8_t storageTier()
+{
+  if (sdCard.ready())
+    return vitalcare::STORAGE_TIER_SD;
+  return flashLogsReady && !flashLogsFull ? vitalcare::STORAGE_TIER_FLASH : vitalcare::STORAGE_TIER_NONE;
+}
+
+// Every SD write reports here, so a card that keeps failing (pulled out, or
+// dead) is taken out of service and saves go to flash
+void onSdWrite(bool ok)
+{
+  if (!sdCard.onWrite(ok, millis()))
+    return;
+  Serial.println("❌ SD card stopped responding; saving to internal flash");
+  // Nothing more is queued for this card. Half-filled buffers go to the
+  // writer now so they fail before the next mount rather than after it.
+  if (edfWriter)
+  {
+    Serial.printf("❌ EDF+ recording stopped: %u records\n", edfWriter->records());
+    edfRecording.abandon();
+    edfWriter.reset();
+  }
+#ifdef VITALCARE_CAPTURE
+  captureActive = false;
+#endif
+  for (uint8_t channel = 0; channel < WRITER_CHANNELS; channel++)
+  {
+    sdWriter.submit(channel);
+  }
+}
 
-    // Adjust based on heart rate
-    if (currentVitals.heartRate > 100)
+// The writer task's results: card health, mounts, and how far vitals and
+// flash logs have really reached the card
+void takeStorageCompletions()
+{
+  vitalcare::StorageCompletion completion;
+  while (sdWriter.takeCompletion(completion))
+  {
+    if (completion.channel == vitalcare::STORAGE_MOUNT)
+    {
+      sdMountPending = false;
+      if (sdCard.onProbe(completion.ok, millis()))
+      {
+        Serial.println("✅ SD card back in service");
+        if (patientRegistered)
+        {
+          startEdfRecording();
+        }
+      }
+      continue;
+    }
+
+    if (completion.channel == WRITER_VITALS)
     {
-      baseSystolic += (currentVitals.heartRate - 100) * 0.5;
-      baseDiastolic += (currentVitals.heartRate - 100) * 0.3;
+      if (!completion.ok)
+        historyWriteFailed = true;
+      else if (!historyWriteFailed && completion.tag > historySaveCursor)
+        historySaveCursor = completion.tag;
     }
-    else if (currentVitals.heartRate < 60)
+    else if (completion.channel == WRITER_BACKFILL)
     {
-      baseSystolic -= (60 - currentVitals.heartRate) * 0.3;
-      baseDiastolic -= (60 - currentVitals.heartRate) * 0.2;
+      if (!completion.ok)
+        migrationFailed = true;
+      else if (!migrationFailed && completion.tag > migrationConfirmed)
+      {
+        migratedRecords += (completion.tag - migrationConfirmed) / vitalcare::HISTORY_RECORD_SIZE;
+        migrationConfirmed = completion.tag;
+      }
     }
+    onSdWrite(completion.ok);
+  }
+}
 
-    // Add some realistic variation
-    currentVitals.systolicBP = baseSystolic + random(-5, 6);
-    currentVitals.diastolicBP = baseDiastolic + random(-3, 4);
+// Takes the writer's results, probes for a card while none is in service
+// (SdCardHealth backs off to every 30 s) and moves flash logs onto the card
+// one sector per pass. A probe waits for buffers queued for the old card
+// to fail first.
+void pollStorage()
+{
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  takeStorageCompletions();
+  if (sdCard.probeDue(millis()) && !sdMountPending)
+  {
+    bool idle = true;
+    for (uint8_t channel = 0; channel < WRITER_CHANNELS; channel++)
+    {
+      idle = idle && sdWriter.queued(channel) == 0;
+    }
+    if (idle)
+    {
+      sdMountPending = true;
+      sdWriter.requestMount();
+    }
   }
-  else
+  if (sdCard.ready() && migrationPending)
   {
-    currentVitals.systolicBP = 0;
-    currentVitals.diastolicBP = 0;
+    migrateFlashLogs();
   }
 }
 
-void checkForAlerts()
+// Queues the next rows of the oldest flash log for the patient's CSV on
+// the card, and deletes the log once the writer reports all of it there.
+// The backfill channel blocks: a pass that finds no buffer does nothing. A
+// reset part way through copies that log again from the start.
+void migrateFlashLogs()
 {
-  bool alertCondition = false;
-  String alertMessage = "";
-
-  // Check for critical vital signs
-  if (currentVitals.heartRate < 50 || currentVitals.heartRate > 120)
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  if (migrationFailed)
   {
-    alertCondition = true;
-    alertMessage += "Heart Rate: " + String(currentVitals.heartRate) + " BPM. ";
+    if (sdWriter.queued(WRITER_BACKFILL) > 0)
+      return;
+    migrationFailed = false;
+    migrationOffset = migrationConfirmed;
+    migrationCsvOpen = false;
   }
-
-  if (currentVitals.systolicBP > 160 || currentVitals.systolicBP < 80)
+  if (migrationPath.length() == 0)
   {
-    alertCondition = true;
-    alertMessage += "Blood Pressure: " + String(currentVitals.systolicBP) + "/" + String(currentVitals.diastolicBP) + " mmHg. ";
+    File dir = flashLogs.open(FLASH_LOG_DIR);
+    File next = dir ? dir.openNextFile() : File();
+    if (!next)
+    {
+      migrationPending = false;
+      return;
+    }
+    migrationPath = next.path();
+    migrationOffset = 0;
+    migrationConfirmed = 0;
+    migrationCsvOpen = false;
   }
+  String csvPath = migrationPath.substring(0, migrationPath.lastIndexOf('.')) + ".csv";
 
-  if (currentVitals.spO2 < 90)
+  File log = flashLogs.open(migrationPath, FILE_READ);
+  if (!log || !log.seek(migrationOffset))
   {
-    alertCondition = true;
-    alertMessage += "SpO2: " + String(currentVitals.spO2) + "%. ";
+    // Left on flash; saves to the card go on without it
+    Serial.println("❌ Error reading flash log " + migrationPath);
+    sdWriter.append(WRITER_BACKFILL, vitalcare::STORAGE_CLOSE, WRITER_MIGRATION, nullptr, 0);
+    sdWriter.submit(WRITER_BACKFILL);
+    migrationPending = false;
+    return;
+  }
+  if (migrationOffset >= log.size())
+  {
+    log.close();
+    sdWriter.submit(WRITER_BACKFILL);
+    if (migrationConfirmed < migrationOffset)
+      return; // Still on its way to the card
+    sdWriter.append(WRITER_BACKFILL, vitalcare::STORAGE_CLOSE, WRITER_MIGRATION, nullptr, 0);
+    sdWriter.submit(WRITER_BACKFILL);
+    flashLogs.remove(migrationPath);
+    migratedFiles++;
+    Serial.println("📦 Flash log moved to SD card: " + csvPath);
+    migrationPath = "";
+    return;
   }
 
-  if (currentVitals.temperature > 102 || currentVitals.temperature < 95)
+  char block[512];
+  if (!sdWriter.canAppend(WRITER_BACKFILL, sizeof(block)) ||
+      (!migrationCsvOpen && !queueCsvOpen(WRITER_BACKFILL, WRITER_MIGRATION, csvPath)))
   {
-    alertCondition = true;
-    alertMessage += "Temperature: " + String(currentVitals.temperature) + "°F. ";
+    log.close();
+    return;
   }
+  migrationCsvOpen = true;
 
-  if (alertCondition)
+  size_t used = 0;
+  uint32_t offset = migrationOffset;
+  uint8_t raw[vitalcare::HISTORY_RECORD_SIZE];
+  while (log.read(raw, sizeof(raw)) == sizeof(raw))
   {
-    currentVitals.status = "⚠️ ALERT";
+    vitalcare::HistoryRecord record;
+    vitalcare::decodeHistoryRecord(raw, record);
+    char line[128];
+    size_t length = vitalcare::formatHistoryCsvRow(record, line, sizeof(line));
+    if (used + length > sizeof(block))
+      break;
+    memcpy(block + used, line, length);
+    used += length;
+    offset += sizeof(raw);
+  }
+  log.close();
 
-    // Sound buzzer
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(100);
-    digitalWrite(BUZZER_PIN, LOW);
+  // Tagged with the log offset after its last row
+  if (used > 0 && sdWriter.append(WRITER_BACKFILL, vitalcare::STORAGE_WRITE, WRITER_MIGRATION, block, used, offset))
+    migrationOffset = offset;
+}
 
-    // Send SMS if configured
-    if (sim800Ready && currentPatient.emergencyContact.length() > 0)
-    {
-      String smsMessage = "ALERT: " + currentPatient.name + " - " + alertMessage + "Location: VitalCare Rural Clinic";
-      sendSMSAlert(smsMessage);
-    }
+void startEdfRecording(bool leadsOff)
+{
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  stopEdfRecording();
+  if (!sdCard.ready())
+    return;
 
-    Serial.println("⚠️ ALERT: " + alertMessage);
+  // Each hour, and a card that came back, gets a new part rather than
+  // overwriting the first
+  String filename = patientFileName(edfPart ? "-" + String(edfPart) + ".edf" : String(".edf"));
+  edfPart++;
+  uint8_t segment[4 + vitalcare::STORAGE_MAX_PATH];
+  size_t segmentLength = vitalcare::encodeStorageSegment(segment, sizeof(segment), EDF_SEGMENT_BYTES, filename.c_str());
+  if (segmentLength == 0 ||
+      !sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_OPEN_SEGMENT, WRITER_EDF, segment, segmentLength))
+  {
+    Serial.println("❌ No room to create EDF recording " + filename);
+    return;
   }
-  else
+
+  String equipment = "VitalCare-" + WiFi.softAPmacAddress();
+  equipment.replace(":", "");
+  char sex = currentPatient.gender.length() ? toupper(currentPatient.gender[0]) : 0;
+  // No RTC: the start date is unknown and the start time is the time since
+  // registration, so the parts of a recording line up
+  uint32_t sinceRegistration = (millis() - currentPatient.registrationTime) / 1000;
+  vitalcare::EdfRecordingInfo info = {currentPatient.id.c_str(), sex, currentPatient.name.c_str(), equipment.c_str(),
+                                      0, 0, 0, (uint8_t)(sinceRegistration / 3600 % 24),
+                                      (uint8_t)(sinceRegistration / 60 % 60), (uint8_t)(sinceRegistration % 60)};
+
+  edfWriter.reset(new vitalcare::EdfWriter(edfOutput, edfRecordBuffer, sizeof(edfRecordBuffer)));
+  if (!edfRecording.begin(*edfWriter, info, millis(), leadsOff))
   {
-    currentVitals.status = "✅ Normal";
+    Serial.println("❌ Error writing EDF header " + filename);
+    edfWriter.reset();
+    sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_CLOSE, WRITER_EDF, nullptr, 0);
+    return;
   }
+  Serial.println("🎙️ EDF+ recording started: " + filename);
 }
 
-void saveDataToSD()
+void stopEdfRecording()
 {
-  if (!sdCardReady)
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  if (!edfWriter)
     return;
+  bool ok = edfRecording.close(millis());
+  Serial.printf("%s EDF+ recording closed: %u records, %u skipped, %u samples padded, %u dropped\n",
+                ok ? "💾" : "❌", edfWriter->records(), edfWriter->skipped(), edfWriter->padded(),
+                edfWriter->dropped());
+  edfWriter.reset();
+  sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_CLOSE, WRITER_EDF, nullptr, 0);
+  sdWriter.submit(WRITER_WAVEFORM);
+}
 
-  String filename = "/vitalcare/" + currentPatient.id + "_" +
-                    String(currentPatient.registrationTime / 1000) + ".csv";
+// Continues the recording in the next hour's segment, carrying a leads-off
+// span that is still open over into it
+void rotateEdfRecording()
+{
+  startEdfRecording(edfRecording.ecgLeadsOff());
+}
 
-  File dataFile = SD.open(filename, FILE_APPEND);
-  if (dataFile)
-  {
-    // Write header if file is new
-    if (dataFile.size() == 0)
-    {
-      dataFile.println("timestamp,heartRate,systolicBP,diastolicBP,spO2,temperature,ecgValue,pressure,status");
-    }
+// Without VITALCARE_CAPTURE the capture hooks compile to nothing
+void startCapture()
+{
+#ifdef VITALCARE_CAPTURE
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  if (!sdCard.ready())
+    return;
 
-    // Write data
-    dataFile.print(currentVitals.timestamp);
-    dataFile.print(",");
-    dataFile.print(currentVitals.heartRate);
-    dataFile.print(",");
-    dataFile.print(currentVitals.systolicBP);
-    dataFile.print(",");
-    dataFile.print(currentVitals.diastolicBP);
-    dataFile.print(",");
-    dataFile.print(currentVitals.spO2);
-    dataFile.print(",");
-    dataFile.print(currentVitals.temperature);
-    dataFile.print(",");
-    dataFile.print(currentVitals.ecgValue);
-    dataFile.print(",");
-    dataFile.print(currentVitals.pressure);
-    dataFile.print(",");
-    dataFile.println(currentVitals.status);
-
-    dataFile.close();
-    Serial.println("💾 Data saved to SD card: " + filename);
+  char filename[40];
+  snprintf(filename, sizeof(filename), "/vitalcare/capture-%08x.vcs", (unsigned)monitorSeed);
+  captureActive = sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_CREATE, WRITER_CAPTURE, filename,
+                                  strlen(filename));
+  if (!captureActive)
+  {
+    Serial.println("❌ No room to create capture " + String(filename));
+    return;
   }
-  else
+  vitalcare::CaptureHeader header = {ESP.getEfuseMac(), monitorSeed, (uint32_t)monitorStartMs};
+  captureLength = vitalcare::encodeCaptureHeader(header, captureBuffer);
+  Serial.println("🎞️ Sensor capture started: " + String(filename));
+#endif
+}
+
+#ifdef VITALCARE_CAPTURE
+// Room for one more event at the end of the buffer, or nullptr without a capture
+uint8_t *captureSlot()
+{
+  if (!captureActive)
+    return nullptr;
+  if (captureLength + vitalcare::CAPTURE_MAX_EVENT_SIZE > sizeof(captureBuffer))
+    flushCapture(false);
+  return captureBuffer + captureLength;
+}
+#endif
+
+void captureSensors(const vitalcare::SensorInputs &inputs)
+{
+#ifdef VITALCARE_CAPTURE
+  if (uint8_t *slot = captureSlot())
+    captureLength += vitalcare::encodeCaptureSensors(inputs, slot);
+#endif
+}
+
+void captureUpdate(unsigned long now, bool monitoring, bool smsReady)
+{
+#ifdef VITALCARE_CAPTURE
+  if (uint8_t *slot = captureSlot())
+    captureLength += vitalcare::encodeCaptureUpdate(now, monitoring, smsReady, slot);
+#endif
+}
+
+void capturePatient()
+{
+#ifdef VITALCARE_CAPTURE
+  if (uint8_t *slot = captureSlot())
+    captureLength += vitalcare::encodeCapturePatient(millis(), currentPatient.id.c_str(),
+                                                     currentPatient.name.c_str(), slot);
+#endif
+}
+
+void captureDecision(unsigned long now, const vitalcare::BedsideDecision &decision)
+{
+#ifdef VITALCARE_CAPTURE
+  if (uint8_t *slot = captureSlot())
+    captureLength += vitalcare::encodeCaptureDecision(now, decision, slot);
+#endif
+}
+
+// Queues the buffered events on the waveform channel. A replay needs every
+// event, so when the channel has no room the capture stops rather than
+// leaving a gap. sync: also flush the SD file, so a reset loses at most
+// one save interval.
+void flushCapture(bool sync)
+{
+#ifdef VITALCARE_CAPTURE
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_STORAGE);
+  if (!captureActive)
+    return;
+  if (captureLength > 0 &&
+      !sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_WRITE, WRITER_CAPTURE, captureBuffer, captureLength))
   {
-    Serial.println("❌ Error opening SD card file for writing");
+    Serial.println("❌ SD card too slow for the sensor capture, capture stopped");
+    captureActive = false;
+    sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_CLOSE, WRITER_CAPTURE, nullptr, 0);
   }
+  captureLength = 0;
+  if (sync && captureActive)
+    sdWriter.append(WRITER_WAVEFORM, vitalcare::STORAGE_FLUSH, WRITER_CAPTURE, nullptr, 0);
+#endif
 }
 
 void sendSMSAlert(String message)
 {
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_SMS);
   if (!sim800Ready)
     return;
 
@@ -645,11 +1787,19 @@ void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t l
     String message;
     serializeJson(doc, message);
     webSocket.sendTXT(num, message);
+    sendHistoryBacklog(num, (const char *)payload);
     break;
   }
 
   case WStype_TEXT:
-    Serial.printf("📨 Received from [%u]: %s\n", num, payload);
+    if (length > 0 && payload[0] == '{')
+    {
+      handleLatencyEcho(num, payload, length);
+    }
+    else
+    {
+      Serial.printf("📨 Received from [%u]: %s\n", num, payload);
+    }
     break;
 
   default:
@@ -660,7 +1810,7 @@ void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t l
 void handleRoot()
 {
   // Serve embedded dashboard with enhanced features
-  String html = R"(<!DOCTYPE html>
+  String html = R"rawliteral(<!DOCTYPE html>
 <html><head><title>VitalCare Rural</title><meta name="viewport" content="width=device-width, initial-scale=1">
 <style>body{font-family:Arial;margin:0;background:#f0f8ff}
 .header{background:#2c5e9b;color:white;text-align:center;padding:1rem}
@@ -677,7 +1827,10 @@ void handleRoot()
 .info-item{background:#e8f4fd;padding:1rem;border-radius:4px;text-align:center}
 .alert{background:#fff3cd;border:1px solid #ffeaa7;color:#856404;padding:1rem;border-radius:4px;margin:1rem 0}
 .ecg-display{height:150px;border:1px solid #ddd;background:#000;color:#0f0;font-family:monospace;overflow:hidden;position:relative}
+#latencyOverlay{display:none;position:fixed;right:8px;bottom:8px;background:rgba(0,0,0,0.8);color:#0f0;font:12px monospace;padding:0.5rem;border-radius:4px;z-index:10}
+#latencyOverlay td{padding:0 0.4rem;text-align:right}
 </style></head><body>
+<div id="latencyOverlay"></div>
 <div class="header">
 <h1>🏥 VitalCare Rural</h1>
 <p>Complete Portable Health Monitoring System</p>
@@ -709,71 +1862,87 @@ void handleRoot()
 <input type="text" id="patientContact" placeholder="Contact Number">
 <input type="text" id="emergencyContact" placeholder="Emergency Contact (for SMS alerts)" >
                 <input type = "text" id = "medicalConditions" placeholder = "Known Medical Conditions">
-                    <button type = "submit" class = "btn">📝 Register Patient</ button>
-                    </ form>
-                    </ div>
+                    <button type = "submit" class = "btn">📝 Register Patient</button>
+                    </form>
+                    </div>
 
                     <div class = "card" id = "vitalsCard" style = "display:none">
-                    <h2>📊 Live Vital Signs</ h2>
-                    <div class = "alert" id = "alertBox" style = "display:none"></ div>
+                    <h2>📊 Live Vital Signs</h2>
+                    <div class = "alert" id = "alertBox" style = "display:none"></div>
 
                     <div class = "vital">
-                    <span>❤️ Heart Rate : </ span>
-                                         <div><span class = "value" id = "heartRate"> --</ span>
+                    <span>❤️ Heart Rate : </span>
+                                         <div><span class = "value" id = "heartRate"> --</span>
                                              BPM<span class = "status normal" id = "hrStatus">
-                                                 Normal</ span></ div>
-                                         </ div>
+                                                 Normal</span></div>
+                                         </div>
 
                                          <div class = "vital">
-                                         <span>🩸 Blood Pressure : </ span>
+                                         <span>🩸 Blood Pressure : </span>
                                                                    <div><span class = "value" id = "bloodPressure"> --/
-                                                                   --</ span> mmHg<span class = "status normal" id = "bpStatus"> Normal</ span></ div>
-                                                                   </ div>
+                                                                   --</span> mmHg<span class = "status normal" id = "bpStatus"> Normal</span></div>
+                                                                   </div>
 
                                                                    <div class = "vital">
-                                                                   <span>🫁 SpO2 : </ span>
+                                                                   <span>🫁 SpO2 : </span>
                                                                                    <div><span class = "value" id = "spO2"> --%
-                                                                   </ span><span class = "status normal" id = "spo2Status"> Normal</ span></ div>
-                                                                   </ div>
+                                                                   </span><span class = "status normal" id = "spo2Status"> Normal</span></div>
+                                                                   </div>
 
                                                                    <div class = "vital">
-                                                                   <span>🌡️ Temperature : </ span>
-                                                                                          <div><span class = "value" id = "temperature"> --°F</ span><span class = "status normal" id = "tempStatus">
-                                                                                              Normal</ span></ div>
-                                                                                          </ div>
+                                                                   <span>🌡️ Temperature : </span>
+                                                                                          <div><span class = "value" id = "temperature"> --°F</span><span class = "status normal" id = "tempStatus">
+                                                                                              Normal</span></div>
+                                                                                          </div>
 
                                                                                           <div class = "vital">
-                                                                                          <span>📈 ECG Signal : </ span>
-                                                                                                                <div><span class = "value" id = "ecgValue"> --</ span><span class = "status normal" id = "ecgStatus">
-                                                                                                                    Normal</ span></ div>
-                                                                                                                </ div>
+                                                                                          <span>📈 ECG Signal : </span>
+                                                                                                                <div><span class = "value" id = "ecgValue"> --</span><span class = "status normal" id = "ecgStatus">
+                                                                                                                    Normal</span></div>
+                                                                                                                </div>
 
-                                                                                                                <h3>📈 ECG Waveform</ h3>
-                                                                                                                <div class = "ecg-display" id = "ecgDisplay"></ div>
+                                                                                                                <h3>📈 ECG Waveform</h3>
+                                                                                                                <div class = "ecg-display" id = "ecgDisplay"></div>
+<h3>📉 Last 10 Minutes</h3>
+<canvas id="trendCanvas" style="width:100%;height:120px;border:1px solid #ddd"></canvas>
+<div style="font-size:0.8em"><span style="color:#dc3545">&#9473; Heart rate (0-200 BPM)</span>
+<span style="color:#2c5e9b">&#9473; SpO2 (70-100%)</span></div>
 
-                                                                                                                <button class = "btn" onclick = "exportData()">💾 Export Patient Data</ button>
-                                                                                                                </ div>
+                                                                                                                <button class = "btn" onclick = "exportData()">💾 Export Patient Data</button>
+                                                                                                                </div>
 
-                                                                                                                </ div>
+                                                                                                                </div>
 
-                                                                                                                <script> const ws = new WebSocket('ws://192.168.4.1:81');
+                                                                                                                <script> let ws = null;
   let patientRegistered = false;
   let ecgChart = [];
   let maxECGPoints = 100;
+  let lastHistorySeq = -1;
 
-  ws.onopen = function()
+  // After a drop, reconnect and ask for the updates missed in between; the
+  // monitor sends them from RAM as backlog messages
+  function connectWebSocket()
   {
-    console.log('WebSocket connected');
-  };
+    const since = lastHistorySeq >= 0 ? '/?since=' + (lastHistorySeq + 1) : '/';
+    ws = new WebSocket('ws://192.168.4.1:81' + since);
+    ws.onopen = function() { console.log('WebSocket connected'); };
+    ws.onmessage = onSocketMessage;
+    ws.onerror = function(error) { console.error('WebSocket error:', error); };
+    ws.onclose = function() { setTimeout(connectWebSocket, 2000); };
+  }
 
-  ws.onmessage = function(event)
+  function onSocketMessage(event)
   {
+    const receivedMs = performance.now();
     const data = JSON.parse(event.data);
 
-    if (data.type == = 'vitals')
+    if (data.type === 'vitals')
     {
+      echoLatency(data.seq, receivedMs);
       updateVitalSigns(data);
       updateECGDisplay(data.ecgValue || 0);
+      addTrendPoint(data.historySeq, data.heartRate, data.spO2);
+      drawTrend();
 
       // Check for alerts
       if (data.status && data.status.includes('ALERT'))
@@ -786,18 +1955,69 @@ void handleRoot()
       }
     }
 
-    if (data.type == = 'init' && data.patientRegistered)
+    if (data.type === 'backlog')
+    {
+      // Rows in the /api/history column order
+      data.records.forEach(r => {
+        addTrendPoint(r[0], r[2], r[5]);
+        updateECGDisplay(r[7]);
+      });
+      drawTrend();
+    }
+
+    if (data.type === 'init' && data.patientRegistered)
     {
       document.getElementById('patientCard').style.display = 'none';
       document.getElementById('vitalsCard').style.display = 'block';
       patientRegistered = true;
     }
-  };
+  }
 
-  ws.onerror = function(error)
+  // Heart rate and SpO2 over the last 10 minutes, by history sequence number
+  // (one per second), so gaps stay gaps
+  let trend = [];
+  const maxTrendPoints = 600;
+  function addTrendPoint(seq, heartRate, spO2)
   {
-    console.error('WebSocket error:', error);
-  };
+    if (seq === undefined)
+      return;
+    let i = trend.length;
+    while (i > 0 && trend[i - 1].seq > seq)
+      i--;
+    if (i > 0 && trend[i - 1].seq === seq)
+      return;
+    trend.splice(i, 0, {seq: seq, hr: heartRate, spo2: spO2});
+    if (trend.length > maxTrendPoints)
+      trend.shift();
+    lastHistorySeq = Math.max(lastHistorySeq, seq);
+  }
+
+  function drawTrend()
+  {
+    const canvas = document.getElementById('trendCanvas');
+    canvas.width = canvas.offsetWidth;
+    canvas.height = canvas.offsetHeight;
+    const ctx = canvas.getContext('2d');
+    const newest = trend.length ? trend[trend.length - 1].seq : 0;
+    const plot = (key, min, max, color) => {
+      ctx.strokeStyle = color;
+      ctx.lineWidth = 2;
+      ctx.beginPath();
+      let previous = null;
+      trend.forEach(p => {
+        const x = canvas.width - (newest - p.seq) * canvas.width / maxTrendPoints;
+        const y = canvas.height - Math.min(Math.max((p[key] - min) / (max - min), 0), 1) * canvas.height;
+        if (!p[key] || previous === null || p.seq - previous > 1)
+          ctx.moveTo(x, y);
+        else
+          ctx.lineTo(x, y);
+        previous = p[key] ? p.seq : null;
+      });
+      ctx.stroke();
+    };
+    plot('hr', 0, 200, '#dc3545');
+    plot('spo2', 70, 100, '#2c5e9b');
+  }
 
   function updateVitalSigns(data)
   {
@@ -865,7 +2085,7 @@ void handleRoot()
       const x = (i / ecgChart.length) * canvas.width;
       const y = canvas.height - ((ecgChart[i] / 4095) * canvas.height);
 
-      if (i == = 0)
+      if (i === 0)
       {
         ctx.moveTo(x, y);
       }
@@ -890,6 +2110,78 @@ void handleRoot()
     document.getElementById('alertBox').style.display = 'none';
   }
 
+  // Sensor-to-screen latency: once the frame has been painted (the next
+  // animation frame has started), tell the monitor how long that took here
+  let lastRenderMs = 0;
+  function echoLatency(seq, receivedMs)
+  {
+    if (!seq || document.hidden)
+      return;
+    requestAnimationFrame(function() {
+      requestAnimationFrame(function() {
+        lastRenderMs = performance.now() - receivedMs;
+        if (ws.readyState === WebSocket.OPEN)
+          ws.send(JSON.stringify({type: 'latency', seq: seq, renderMs: lastRenderMs}));
+      });
+    });
+  }
+
+  // Debug overlay with the /api/metrics latency percentiles and heap
+  // figures: open the page with ?debug or press Shift+D
+  const latencyStages = ['sampleToBeat', 'beatToPublish', 'publishToSend', 'sendToReceive',
+                         'receiveToRender', 'beatToRender', 'alarm'];
+  let latencyTimer = null;
+  function toggleLatencyOverlay()
+  {
+    const overlay = document.getElementById('latencyOverlay');
+    const show = overlay.style.display !== 'block';
+    overlay.style.display = show ? 'block' : 'none';
+    clearInterval(latencyTimer);
+    latencyTimer = show ? setInterval(updateLatencyOverlay, 2000) : null;
+    if (show)
+      updateLatencyOverlay();
+  }
+
+  function updateLatencyOverlay()
+  {
+    fetch('/api/metrics')
+      .then(response => response.json())
+      .then(data => {
+        const ms = us => (us / 1000).toFixed(us < 10000 ? 1 : 0);
+        let rows = '<tr><td></td><td>n</td><td>p50</td><td>p95</td><td>p99</td><td>max ms</td></tr>';
+        latencyStages.forEach(name => {
+          const s = data.latency[name];
+          rows += '<tr><td style="text-align:left">' + name + '</td><td>' + s.count + '</td><td>' + ms(s.p50Us) +
+                  '</td><td>' + ms(s.p95Us) + '</td><td>' + ms(s.p99Us) + '</td><td>' + ms(s.maxUs) + '</td></tr>';
+        });
+        const kb = bytes => (bytes / 1024).toFixed(0) + ' KB';
+        const m = data.memory;
+        document.getElementById('latencyOverlay').innerHTML =
+          '<table>' + rows + '</table>' + data.echoes + '/' + data.framesSent + ' frames echoed, ' + data.clients +
+          ' clients; this client renders in ' + lastRenderMs.toFixed(1) + ' ms<br>heap ' + kb(m.freeHeap) +
+          ' free (min ' + kb(m.minFreeHeap) + ', largest block ' + kb(m.largestFreeBlock) + '), PSRAM ' +
+          kb(m.freePsram) + '/' + kb(m.psramSize) + '; ' + m.allocationsPerSecond + ' allocs/s, hot path ' +
+          m.hotPathPerSecond + '/s';
+      })
+      .catch(error => console.error('Metrics update failed:', error));
+  }
+
+  document.addEventListener('keydown', function(e) {
+    if (e.key === 'D' && e.target.tagName !== 'INPUT')
+      toggleLatencyOverlay();
+  });
+  if (new URLSearchParams(location.search).has('debug'))
+    toggleLatencyOverlay();
+
+  connectWebSocket();
+  fetch('/api/history?seconds=600')
+    .then(response => response.json())
+    .then(data => {
+      data.records.forEach(r => addTrendPoint(r[0], r[2], r[5]));
+      drawTrend();
+    })
+    .catch(error => console.error('History load failed:', error));
+
   function exportData()
   {
     const link = document.createElement('a');
@@ -932,16 +2224,16 @@ void handleRoot()
 
   // Update system status periodically
   setInterval(function() { fetch('/api/status')
-                               .then(response = > response.json())
-                               .then(data = > {
+                               .then(response => response.json())
+                               .then(data => {
                                  document.getElementById('systemStatus').textContent = data.status || 'System Ready';
                                })
-                               .catch(error = > {
+                               .catch(error => {
                                  console.error('Status update failed:', error);
                                }); }, 5000);
 
 </script>
-</body></html>)";
+</body></html>)rawliteral";
   
   server.send(200, "text/html", html);
 }
@@ -955,6 +2247,10 @@ void handlePatientRegistration()
 
     if (!error)
     {
+      // The previous patient's unsaved updates go to their files first
+      if (patientRegistered)
+        saveHistory(true);
+
       currentPatient.id = generatePatientID();
       currentPatient.name = doc["name"].as<String>();
       currentPatient.age = doc["age"].as<int>();
@@ -965,6 +2261,11 @@ void handlePatientRegistration()
       currentPatient.registrationTime = millis();
 
       patientRegistered = true;
+      historySaveCursor = vitalsHistory.nextSequence(); // The CSV starts at registration
+      historyQueuedCursor = historySaveCursor;
+      edfPart = 0;
+      startEdfRecording();
+      capturePatient();
 
       Serial.println("✅ Patient registered:");
       Serial.println("👤 Name: " + currentPatient.name);
@@ -1039,15 +2340,32 @@ void handleGetVitalSigns()
 
 void handleSystemStatus()
 {
-  DynamicJsonDocument doc(512);
+  DynamicJsonDocument doc(1024);
 
   doc["status"] = "System Operational";
   doc["uptime"] = millis() / 1000;
   doc["freeHeap"] = ESP.getFreeHeap();
+  doc["minFreeHeap"] = ESP.getMinFreeHeap();
+  doc["largestFreeBlock"] = ESP.getMaxAllocHeap();
   doc["wifiConnected"] = WiFi.softAPgetStationNum();
-  doc["sdCardReady"] = sdCardReady;
+  doc["sdCardReady"] = sdCard.ready();
+  doc["storageTier"] = vitalcare::storageTierName(storageTier());
   doc["sim800Ready"] = sim800Ready;
-  doc["bmp180Ready"] = bmp180Ready;
+  doc["bmp180Ready"] = bmp180.ready();
+  doc["spo2SensorReady"] = spo2Sensor.ready();
+
+  // Shared I2C bus instrumentation
+  vitalcare::I2cBusStats i2cStats = i2cBus.statistics();
+  JsonObject i2c = doc.createNestedObject("i2cBus");
+  i2c["utilizationPercent"] = i2cBus.utilizationPermille() / 10.0;
+  i2c["transactions"] = i2cStats.completed;
+  i2c["failed"] = i2cStats.failed;
+  i2c["rejected"] = i2cStats.rejected;
+  i2c["maxOutstanding"] = i2cStats.maxOutstanding;
+  i2c["latencyHighAvgUs"] = i2cStats.averageLatencyUs(vitalcare::I2C_PRIORITY_HIGH);
+  i2c["latencyLowAvgUs"] = i2cStats.averageLatencyUs(vitalcare::I2C_PRIORITY_LOW);
+  i2c["latencyMaxUs"] = i2cStats.maxLatencyUs();
+  i2c["latencyP99Us"] = i2cStats.latencyPercentileUs(99);
   doc["patientRegistered"] = patientRegistered;
 
   String response;
@@ -1055,28 +2373,355 @@ void handleSystemStatus()
   server.send(200, "application/json", response);
 }
 
+// The collector confirms an upload: everything recorded up to "through"
+// (device time, as in /api/metrics) is off the device, so retention may
+// delete it. The watermark only moves forward and never past now.
+void handleStorageUploaded()
+{
+  DynamicJsonDocument doc(256);
+  if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain")) || !doc["through"].is<uint32_t>())
+  {
+    server.send(400, "application/json", "{\"success\":false,\"message\":\"Expected through, in device seconds\"}");
+    return;
+  }
+  uint32_t through = min(doc["through"].as<uint32_t>(), deviceTime());
+  if (through > uploadedThrough)
+  {
+    uploadedThrough = through;
+    clockPrefs.putUInt("uploaded", uploadedThrough);
+    sdSink.setClock(deviceTime(), uploadedThrough);
+  }
+
+  DynamicJsonDocument response(128);
+  response["success"] = true;
+  response["uploadedThrough"] = uploadedThrough;
+  String responseString;
+  serializeJson(response, responseString);
+  server.send(200, "application/json", responseString);
+}
+
+// Latency percentiles per stage of the sensor-to-screen path (Latency.h),
+// where the alarm stage is the safety figure, heap use per subsystem
+// (MemoryAccounting.h), the storage tiers (StorageTier.h) and retention
+// (Retention.h)
+void handleMetrics()
+{
+  DynamicJsonDocument doc(7680);
+  doc["uptime"] = millis() / 1000;
+  doc["framesSent"] = latency.framesSent();
+  doc["echoes"] = latency.echoesReceived();
+  doc["echoesDropped"] = latency.echoesDropped();
+  doc["clients"] = webSocket.connectedClients();
+
+  // Heap: fragmentation shows as a largest free block well below free heap
+  JsonObject heap = doc.createNestedObject("memory");
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t largestBlock = ESP.getMaxAllocHeap();
+  heap["freeHeap"] = freeHeap;
+  heap["minFreeHeap"] = ESP.getMinFreeHeap();
+  heap["largestFreeBlock"] = largestBlock;
+  heap["fragmentationPercent"] = freeHeap ? 100 - (int)((uint64_t)largestBlock * 100 / freeHeap) : 0;
+  heap["psramSize"] = ESP.getPsramSize();
+  heap["freePsram"] = ESP.getFreePsram();
+  heap["allocations"] = memory.allocations();
+  heap["allocationsPerSecond"] = memory.allocationsPerSecond();
+  heap["hotPathPerSecond"] = memory.hotPathPerSecond(); // 0 once running
+  heap["hotPathPeakPerSecond"] = memory.peakHotPathPerSecond();
+  heap["lastHotPathAllocationMs"] = memory.lastHotPathAllocationMs();
+  heap["historyBytes"] = vitalsHistory.bytes() + (ecgHistory.capacity() + redHistory.capacity() +
+                                                   irHistory.capacity()) * sizeof(int16_t);
+  heap["historyInPsram"] = historyInPsram;
+  heap["historySeconds"] = vitalsHistory.capacity();
+  heap["historySavePending"] = patientRegistered ? vitalsHistory.nextSequence() - historySaveCursor : 0;
+  heap["historySaveDropped"] = historySaveDropped;
+  JsonObject tags = heap.createNestedObject("subsystems");
+  for (uint8_t i = 0; i < vitalcare::MEMORY_TAGS; i++)
+  {
+    const vitalcare::MemoryTagStats &stats = memory.tag(i);
+    JsonObject tag = tags.createNestedObject(vitalcare::memoryTagName(i));
+    tag["allocations"] = stats.allocations;
+    tag["frees"] = stats.frees;
+    tag["bytes"] = stats.bytes;
+  }
+
+  // Storage tiers: SD card health, flash fallback use and estimated wear
+  // (lifetime, kept across reboots), and logs still to move to the card
+  JsonObject storage = doc.createNestedObject("storage");
+  storage["tier"] = vitalcare::storageTierName(storageTier());
+  storage["sdReady"] = sdCard.ready();
+  storage["sdInsertions"] = sdCard.insertions();
+  storage["sdRemovals"] = sdCard.removals();
+  storage["sdWriteFailures"] = sdCard.writeFailures();
+  JsonObject flash = storage.createNestedObject("flash");
+  const vitalcare::FlashWearCounters &wear = flashWear.counters();
+  flash["ready"] = flashLogsReady;
+  flash["totalBytes"] = flashLogsReady ? flashLogs.totalBytes() : 0;
+  flash["usedBytes"] = flashLogsReady ? flashLogs.usedBytes() : 0;
+  flash["full"] = flashLogsFull;
+  flash["logicalBytes"] = wear.logicalBytes;
+  flash["programmedBytes"] = wear.programmedBytes;
+  flash["writeAmplification"] = flashWear.writeAmplification();
+  flash["erases"] = wear.erases;
+  flash["erasesPerBlock"] = flashWear.erasesPerBlock();
+  JsonObject migration = storage.createNestedObject("migration");
+  migration["pending"] = migrationPending;
+  migration["records"] = migratedRecords;
+  migration["files"] = migratedFiles;
+
+  // The SD writer task: buffer write time (card stalls show in the tail)
+  // and per channel how often the producer found every buffer taken
+  static const char *const CHANNEL_NAMES[WRITER_CHANNELS] = {"vitals", "backfill", "waveform"};
+  JsonObject writer = storage.createNestedObject("writer");
+  vitalcare::LatencyHistogram writes = sdWriter.writeLatency();
+  writer["writes"] = writes.count();
+  writer["writeP50Us"] = writes.percentileUs(50);
+  writer["writeP99Us"] = writes.percentileUs(99);
+  writer["writeMaxUs"] = writes.maxUs();
+  writer["completionsLost"] = sdWriter.lostCompletions();
+  writer["edfSkippedRecords"] = edfWriter ? edfWriter->skipped() : 0;
+  SegmentCounters segments = sdSink.counters();
+  JsonObject segment = writer.createNestedObject("segments");
+  segment["bytes"] = EDF_SEGMENT_BYTES;
+  segment["opened"] = segments.opened;
+  segment["preallocatedInline"] = segments.inlineAlloc;
+  segment["contiguous"] = segments.contiguous;
+  segment["overruns"] = segments.overruns;
+  segment["lastPreallocateUs"] = segments.preallocateUs;
+  segment["spareReady"] = segments.spareReady;
+  for (uint8_t i = 0; i < WRITER_CHANNELS; i++)
+  {
+    vitalcare::StorageChannelStats stats = sdWriter.statistics(i);
+    JsonObject channel = writer.createNestedObject(CHANNEL_NAMES[i]);
+    channel["policy"] = i == WRITER_WAVEFORM ? "drop" : "block";
+    channel["queued"] = sdWriter.queued(i);
+    vitalcare::LatencyHistogram writes = sdWriter.writeLatency(i);
+    channel["writeP99Us"] = writes.percentileUs(99);
+    channel["writeMaxUs"] = writes.maxUs();
+    channel["maxQueued"] = stats.maxQueued;
+    channel["submitted"] = stats.submitted;
+    channel["written"] = stats.written;
+    channel["failed"] = stats.failed;
+    channel["overflows"] = stats.overflows;
+    channel["overflowBytes"] = stats.overflowBytes;
+  }
+
+  // Retention: as of the last scan, with what it has deleted since boot.
+  // Held files are due but not uploaded; pressure means below the free
+  // space watermark with nothing left that may go.
+  vitalcare::RetentionStats kept = sdSink.retentionStats();
+  const vitalcare::RetentionPolicy &rules = sdSink.retentionPolicy();
+  JsonObject retention = storage.createNestedObject("retention");
+  retention["deviceTime"] = deviceTime();
+  retention["uploadedThrough"] = uploadedThrough;
+  retention["scans"] = kept.scans;
+  JsonObject deleted = retention.createNestedObject("deleted");
+  for (uint8_t i = 0; i < vitalcare::RETAIN_CLASSES; i++)
+    deleted[vitalcare::retentionClassName(i)] = kept.deleted[i];
+  retention["deletedBytes"] = kept.deletedBytes;
+  retention["compacted"] = kept.compacted;
+  retention["rollupRows"] = kept.rollupRows;
+  retention["held"] = kept.held;
+  retention["failed"] = kept.failed;
+  retention["pressure"] = kept.pressure;
+  retention["freePercent"] = kept.totalBytes ? (int)(kept.freeBytes * 100 / kept.totalBytes) : 0;
+  retention["watermarkPercent"] = rules.minFreePercent;
+  retention["busyPercent"] = millis() ? kept.busyUs / 10.0 / millis() : 0;
+  retention["maxStepUs"] = kept.maxStepUs;
+
+  JsonObject stages = doc.createNestedObject("latency");
+  for (uint8_t i = 0; i < vitalcare::LATENCY_STAGES; i++)
+  {
+    const vitalcare::LatencyHistogram &histogram = latency.stage(i);
+    JsonObject stage = stages.createNestedObject(vitalcare::latencyStageName(i));
+    stage["count"] = histogram.count();
+    stage["avgUs"] = histogram.averageUs();
+    stage["p50Us"] = histogram.percentileUs(50);
+    stage["p95Us"] = histogram.percentileUs(95);
+    stage["p99Us"] = histogram.percentileUs(99);
+    stage["maxUs"] = histogram.maxUs();
+  }
+
+  String response;
+  serializeJson(doc, response);
+  server.send(200, "application/json", response);
+}
+
+// One update as a JSON array in HISTORY_COLUMNS order
+const char *HISTORY_COLUMNS = "[\"seq\",\"timestamp\",\"heartRate\",\"systolicBP\",\"diastolicBP\",\"spO2\","
+                              "\"temperature\",\"ecgValue\",\"pressure\",\"alertFlags\"]";
+
+size_t formatHistoryRow(uint32_t sequence, char *out, size_t capacity)
+{
+  const uint8_t *data = vitalsHistory.at(sequence);
+  if (!data)
+    return 0;
+  vitalcare::HistoryRecord record;
+  vitalcare::decodeHistoryRecord(data, record);
+  int length = snprintf(out, capacity, "[%u,%lu,%.1f,%.0f,%.0f,%.1f,%.1f,%u,%.1f,%u]", sequence,
+                        (unsigned long)record.vitals.timestampMs, record.vitals.heartRate, record.vitals.systolicBP,
+                        record.vitals.diastolicBP, record.vitals.spO2, record.vitals.temperature, record.ecg,
+                        record.pressureHpa, record.alertFlags);
+  return length > 0 && (size_t)length < capacity ? length : 0;
+}
+
+// GET /api/history?since=SEQ or ?seconds=N, and &limit=N (default 3600):
+// updates from the RAM ring, streamed in chunks so a full day never sits
+// in one buffer
+void handleHistory()
+{
+  uint32_t first = vitalsHistory.firstSequence();
+  uint32_t next = vitalsHistory.nextSequence();
+  uint32_t since = next > 3600 ? next - 3600 : 0;
+  if (server.hasArg("since"))
+  {
+    since = strtoul(server.arg("since").c_str(), nullptr, 10);
+  }
+  else if (server.hasArg("seconds"))
+  {
+    uint32_t seconds = strtoul(server.arg("seconds").c_str(), nullptr, 10);
+    since = next > seconds ? next - seconds : 0;
+  }
+  uint32_t limit = server.hasArg("limit") ? strtoul(server.arg("limit").c_str(), nullptr, 10) : 3600;
+  since = since < first ? first : since;
+  since = since > next ? next : since;
+  uint32_t end = next - since > limit ? since + limit : next;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  size_t used = snprintf(historyChunk, sizeof(historyChunk),
+                         "{\"first\":%u,\"next\":%u,\"from\":%u,\"inPsram\":%s,\"columns\":%s,\"records\":[",
+                         first, next, since, historyInPsram ? "true" : "false", HISTORY_COLUMNS);
+  uint32_t rows = 0;
+  for (uint32_t sequence = since; sequence < end; sequence++)
+  {
+    if (used + 100 > sizeof(historyChunk)) // A row is under 80 characters
+    {
+      server.sendContent(historyChunk, used);
+      used = 0;
+    }
+    // A row the ring has dropped meanwhile is left out, separator and all
+    size_t mark = used;
+    if (rows > 0)
+      historyChunk[used++] = ',';
+    size_t length = formatHistoryRow(sequence, historyChunk + used, sizeof(historyChunk) - used);
+    if (length == 0)
+    {
+      used = mark;
+      continue;
+    }
+    used += length;
+    rows++;
+  }
+  used += snprintf(historyChunk + used, sizeof(historyChunk) - used, "]}");
+  server.sendContent(historyChunk, used);
+  server.sendContent("");
+}
+
+// GET /api/waveform?channel=ecg|red|ir&seconds=N (default 10): the most
+// recent raw samples of one channel (ECG in ADC counts, PPG in counts / 8)
+void handleWaveform()
+{
+  String channel = server.hasArg("channel") ? server.arg("channel") : "ecg";
+  const vitalcare::SampleRing *ring = channel == "red" ? &redHistory : (channel == "ir" ? &irHistory : &ecgHistory);
+  uint32_t seconds = server.hasArg("seconds") ? strtoul(server.arg("seconds").c_str(), nullptr, 10) : 10;
+  uint32_t wanted = seconds * ring->rateHz();
+  uint32_t count = ring->count() < wanted ? ring->count() : wanted;
+  uint32_t start = ring->total() - count;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  size_t used = snprintf(historyChunk, sizeof(historyChunk),
+                         "{\"channel\":\"%s\",\"rateHz\":%u,\"firstSample\":%u,\"samples\":[",
+                         ring == &redHistory ? "red" : (ring == &irHistory ? "ir" : "ecg"), ring->rateHz(), start);
+  for (uint32_t i = start; i < start + count; i++)
+  {
+    if (used + 8 > sizeof(historyChunk))
+    {
+      server.sendContent(historyChunk, used);
+      used = 0;
+    }
+    used += snprintf(historyChunk + used, sizeof(historyChunk) - used, i == start ? "%d" : ",%d", ring->at(i));
+  }
+  used += snprintf(historyChunk + used, sizeof(historyChunk) - used, "]}");
+  server.sendContent(historyChunk, used);
+  server.sendContent("");
+}
+
+// A dashboard reconnecting with ws://.../?since=SEQ gets the updates it
+// missed (at most BACKLOG_MAX_RECORDS) from RAM, before the next frame
+void sendHistoryBacklog(uint8_t num, const char *url)
+{
+  const char *since = strstr(url, "since=");
+  if (!since)
+    return;
+  uint32_t next = vitalsHistory.nextSequence();
+  uint32_t from = strtoul(since + 6, nullptr, 10);
+  uint32_t oldest = next > BACKLOG_MAX_RECORDS ? next - BACKLOG_MAX_RECORDS : 0;
+  from = from < oldest ? oldest : from;
+  from = from < vitalsHistory.firstSequence() ? vitalsHistory.firstSequence() : from;
+
+  while (from < next)
+  {
+    char *payload = historyChunk + WEBSOCKETS_MAX_HEADER_SIZE;
+    size_t capacity = sizeof(historyChunk) - WEBSOCKETS_MAX_HEADER_SIZE;
+    size_t used = snprintf(payload, capacity, "{\"type\":\"backlog\",\"records\":[");
+    uint32_t rows = 0;
+    for (uint32_t n = 0; n < BACKLOG_RECORDS_PER_MESSAGE && from < next; n++, from++)
+    {
+      size_t mark = used;
+      if (rows > 0)
+        payload[used++] = ',';
+      size_t length = formatHistoryRow(from, payload + used, capacity - used);
+      if (length == 0)
+      {
+        used = mark;
+        continue;
+      }
+      used += length;
+      rows++;
+    }
+    used += snprintf(payload + used, capacity - used, "]}");
+    webSocket.sendTXT(num, (uint8_t *)historyChunk, used, true);
+  }
+}
+
 void handleNotFound()
 {
   server.send(404, "text/plain", "404: Page not found");
 }
 
+// Built in static storage with room for the WebSocket header in front, so
+// the library sends it without copying: the 1 s frame never allocates
+uint8_t vitalsFrame[WEBSOCKETS_MAX_HEADER_SIZE + 384];
+
 void sendVitalSignsToClients()
 {
-  DynamicJsonDocument doc(1024);
-  doc["type"] = "vitals";
-  doc["heartRate"] = currentVitals.heartRate;
-  doc["systolicBP"] = currentVitals.systolicBP;
-  doc["diastolicBP"] = currentVitals.diastolicBP;
-  doc["spO2"] = currentVitals.spO2;
-  doc["temperature"] = currentVitals.temperature;
-  doc["ecgValue"] = currentVitals.ecgValue;
-  doc["pressure"] = currentVitals.pressure;
-  doc["timestamp"] = currentVitals.timestamp;
-  doc["status"] = currentVitals.status;
+  vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_FRAMES);
+  vitalcare::VitalsFrame frame = {toVitalSample(currentVitals), (uint16_t)currentVitals.ecgValue,
+                                  currentVitals.pressure,        currentVitals.status,
+                                  vitalsFrameSeq,                historySeq};
+  char *payload = (char *)vitalsFrame + WEBSOCKETS_MAX_HEADER_SIZE;
+  size_t length =
+      vitalcare::formatVitalsFrame(frame, payload, sizeof(vitalsFrame) - WEBSOCKETS_MAX_HEADER_SIZE);
+  if (length == 0)
+    return;
+  webSocket.broadcastTXT(vitalsFrame, length, true); // Header written into the reserved bytes
+  latency.onSent(vitalsFrameSeq, micros());
+}
 
-  String message;
-  serializeJson(doc, message);
-  webSocket.broadcastTXT(message);
+// {"type":"latency","seq":N,"renderMs":T} from a dashboard that has painted
+// frame N, T ms after receiving it
+void handleLatencyEcho(uint8_t num, const uint8_t *payload, size_t length)
+{
+  uint32_t receivedUs = micros();
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, payload, length) || doc["type"] != "latency")
+  {
+    Serial.printf("📨 Received from [%u]: %.*s\n", num, (int)length, (const char *)payload);
+    return;
+  }
+  float renderMs = doc["renderMs"] | 0.0f;
+  latency.onEcho(doc["seq"] | 0u, receivedUs, renderMs > 0 ? (uint32_t)(renderMs * 1000) : 0);
 }
 
 String generatePatientID()
@@ -1086,11 +2731,7 @@ String generatePatientID()
 
 String formatTimestamp(unsigned long timestamp)
 {
-  unsigned long seconds = timestamp / 1000;
-  unsigned long minutes = seconds / 60;
-  unsigned long hours = minutes / 60;
-
-  return String(hours % 24) + ":" +
-         (minutes % 60 < 10 ? "0" : "") + String(minutes % 60) + ":" +
-         (seconds % 60 < 10 ? "0" : "") + String(seconds % 60);
+  char buffer[16];
+  vitalcare::formatTimestamp(timestamp, buffer, sizeof(buffer));
+  return String(buffer);
 }
@@ -0,0 +1,267 @@
+/*
+ * VitalCare Rural Analyzer - ECG Chunk Analysis and Merge
+ */
+
+#include "EcgAnalysis.h"
+
+#include <algorithm>
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+void analyzeChunk(const EcgRun &run, uint64_t begin, uint64_t end, const AnalysisOptions &options,
+                  ChunkResult &result)
+{
+  const uint32_t rate = run.sampleRateHz;
+  uint64_t warmup = (uint64_t)options.warmupSeconds * rate;
+  uint64_t from = begin > warmup ? begin - warmup : 0;
+
+  result.begin = begin;
+  result.end = end;
+  result.beats.clear();
+  result.leadsOff.clear();
+
+  ThresholdBeatDetector detector(options.threshold, options.hysteresis, options.refractoryMs);
+  BeatChannel channel;
+  uint32_t suppressed = 0;
+
+  // Run-relative milliseconds, advanced without a divide per sample. The
+  // clock is a function of the sample index only, so every chunking of a
+  // run sees the same times.
+  const uint32_t step = 1000 / rate;
+  const uint32_t stepRemainder = 1000 % rate;
+  uint32_t nowMs = (uint32_t)(from * 1000 / rate);
+  uint32_t remainder = (uint32_t)(from * 1000 % rate);
+  // Expire once per second of recording, on sample indices divisible by rate
+  uint32_t untilExpire = (uint32_t)((rate - from % rate) % rate);
+
+  bool leadsOff = false;
+  uint64_t leadsOffBegin = 0;
+  auto closeLeadsOff = [&](uint64_t at) {
+    uint64_t spanBegin = leadsOffBegin > begin ? leadsOffBegin : begin;
+    if (spanBegin < at)
+      result.leadsOff.push_back({spanBegin, at});
+    leadsOff = false;
+  };
+
+  run.forEachSpan(from, end, [&](const int16_t *samples, size_t count, uint64_t firstIndex) {
+    for (size_t i = 0; i < count; i++)
+    {
+      if (untilExpire == 0)
+      {
+        channel.expire(nowMs, options.channelTimeoutMs);
+        untilExpire = rate;
+      }
+      untilExpire--;
+
+      int16_t sample = samples[i];
+      if (sample == ECG_LEADS_OFF)
+      {
+        if (!leadsOff)
+        {
+          leadsOff = true;
+          leadsOffBegin = firstIndex + i;
+        }
+        channel.invalidate();
+      }
+      else
+      {
+        if (leadsOff)
+          closeLeadsOff(firstIndex + i);
+        if (detector.update(sample, nowMs))
+        {
+          float beatRate = 0;
+          bool valid = channel.onBeat(nowMs, beatRate);
+          bool noisy = detector.suppressedCount() != suppressed;
+          suppressed = detector.suppressedCount();
+          if (firstIndex + i >= begin)
+            result.beats.push_back({firstIndex + i, valid ? beatRate : 0.0f, channel.getQuality(), noisy});
+        }
+      }
+
+      nowMs += step;
+      remainder += stepRemainder;
+      if (remainder >= rate)
+      {
+        remainder -= rate;
+        nowMs++;
+      }
+    }
+  });
+  if (leadsOff)
+    closeLeadsOff(end);
+}
+
+std::vector<SampleSpan> chunkRun(const EcgRun &run, const AnalysisOptions &options)
+{
+  uint64_t chunkSamples = (uint64_t)(options.chunkMinutes ? options.chunkMinutes : 1) * 60 * run.sampleRateHz;
+  std::vector<SampleSpan> chunks;
+  for (uint64_t begin = 0; begin < run.samples; begin += chunkSamples)
+    chunks.push_back({begin, std::min(begin + chunkSamples, run.samples)});
+  return chunks;
+}
+
+const char *eventKindName(EcgEventKind kind)
+{
+  switch (kind)
+  {
+  case EVENT_LEADS_OFF:
+    return "leads_off";
+  case EVENT_PAUSE:
+    return "pause";
+  case EVENT_TACHYCARDIA:
+    return "tachycardia";
+  case EVENT_BRADYCARDIA:
+    return "bradycardia";
+  case EVENT_LOW_QUALITY:
+    return "low_quality";
+  }
+  return "unknown";
+}
+
+void mergeRun(const EcgRun &run, const std::vector<ChunkResult> &chunks, const AnalysisOptions &options,
+              RunAnalysis &analysis)
+{
+  const uint32_t rate = run.sampleRateHz;
+  const uint64_t minuteSamples = 60ull * rate;
+  analysis = RunAnalysis();
+  analysis.minutes.resize((size_t)((run.samples + minuteSamples - 1) / minuteSamples));
+  for (size_t m = 0; m < analysis.minutes.size(); m++)
+    analysis.minutes[m].minute = m;
+
+  // Leads-off spans cut at chunk edges are joined again
+  std::vector<SampleSpan> leadsOff;
+  for (const ChunkResult &chunk : chunks)
+  {
+    for (const SampleSpan &span : chunk.leadsOff)
+    {
+      if (!leadsOff.empty() && leadsOff.back().end == span.begin)
+        leadsOff.back().end = span.end;
+      else
+        leadsOff.push_back(span);
+    }
+  }
+  std::vector<uint64_t> leadsOffPerMinute(analysis.minutes.size(), 0);
+  for (const SampleSpan &span : leadsOff)
+  {
+    analysis.leadsOffSamples += span.end - span.begin;
+    for (uint64_t at = span.begin; at < span.end;)
+    {
+      uint64_t minute = at / minuteSamples;
+      uint64_t next = std::min((minute + 1) * minuteSamples, span.end);
+      leadsOffPerMinute[minute] += next - at;
+      at = next;
+    }
+    if ((span.end - span.begin) * 1000 >= (uint64_t)options.minLeadsOffMs * rate)
+      analysis.events.push_back({EVENT_LEADS_OFF, span.begin, span.end, (float)(span.end - span.begin) / rate});
+  }
+
+  // Beats in order: RR intervals, HRV and pauses
+  std::vector<double> qualitySum(analysis.minutes.size(), 0.0);
+  std::vector<double> rateSum(analysis.minutes.size(), 0.0);
+  size_t leadsOffCursor = 0;
+  bool havePrevious = false;
+  uint64_t previous = 0;
+  for (const ChunkResult &chunk : chunks)
+  {
+    for (const DetectedBeat &beat : chunk.beats)
+    {
+      size_t m = (size_t)(beat.sample / minuteSamples);
+      MinuteSummary &minute = analysis.minutes[m];
+      minute.beats++;
+      qualitySum[m] += beat.quality;
+      if (beat.noisy)
+        minute.noisyBeats++;
+      if (beat.rate > 0)
+      {
+        minute.minRate = minute.validBeats == 0 ? beat.rate : std::min(minute.minRate, beat.rate);
+        minute.maxRate = std::max(minute.maxRate, beat.rate);
+        minute.validBeats++;
+        rateSum[m] += beat.rate;
+      }
+
+      if (havePrevious)
+      {
+        while (leadsOffCursor < leadsOff.size() && leadsOff[leadsOffCursor].end <= previous)
+          leadsOffCursor++;
+        bool leadsOffBetween = leadsOffCursor < leadsOff.size() && leadsOff[leadsOffCursor].begin < beat.sample;
+        uint32_t intervalMs = (uint32_t)((beat.sample - previous) * 1000 / rate);
+
+        if (leadsOffBetween || beat.noisy || beat.quality < options.minQuality)
+          minute.hrv.breakChain();
+        else
+          minute.hrv.addInterval(intervalMs);
+        if (!leadsOffBetween && intervalMs >= options.pauseMs)
+          analysis.events.push_back({EVENT_PAUSE, previous, beat.sample, (float)intervalMs});
+      }
+      havePrevious = true;
+      previous = beat.sample;
+    }
+  }
+
+  // Minute summaries, then rhythm and quality episodes over whole minutes
+  EcgEvent open = {EVENT_LEADS_OFF, 0, 0, 0};
+  bool isOpen = false;
+  auto flush = [&]() {
+    if (isOpen)
+      analysis.events.push_back(open);
+    isOpen = false;
+  };
+
+  for (size_t m = 0; m < analysis.minutes.size(); m++)
+  {
+    MinuteSummary &minute = analysis.minutes[m];
+    uint64_t begin = m * minuteSamples;
+    uint64_t end = std::min(begin + minuteSamples, run.samples);
+    minute.leadsOffFraction = (float)leadsOffPerMinute[m] / (float)(end - begin);
+    minute.quality = minute.beats ? (float)(qualitySum[m] / minute.beats) : 0.0f;
+    minute.meanRate = minute.validBeats ? (float)(rateSum[m] / minute.validBeats) : 0.0f;
+    analysis.beats += minute.beats;
+    analysis.validBeats += minute.validBeats;
+    analysis.hrv.merge(minute.hrv);
+
+    bool noisy = minute.noisyBeats > options.maxNoisyFraction * minute.beats;
+    bool rhythm = minute.validBeats >= options.minRhythmBeats && minute.quality >= options.minQuality && !noisy;
+    EcgEventKind kind;
+    float value;
+    if (rhythm && minute.meanRate > options.limits.heartRateMax)
+    {
+      kind = EVENT_TACHYCARDIA;
+      value = minute.meanRate;
+    }
+    else if (rhythm && minute.meanRate < options.limits.heartRateMin)
+    {
+      kind = EVENT_BRADYCARDIA;
+      value = minute.meanRate;
+    }
+    else if ((minute.quality < options.minQuality || noisy) && minute.leadsOffFraction < 0.5f)
+    {
+      kind = EVENT_LOW_QUALITY;
+      value = minute.beats ? minute.quality * (minute.beats - minute.noisyBeats) / minute.beats : 0.0f;
+    }
+    else
+    {
+      flush();
+      continue;
+    }
+
+    if (isOpen && open.kind == kind && open.end == begin)
+    {
+      open.end = end;
+      open.value = kind == EVENT_TACHYCARDIA ? std::max(open.value, value) : std::min(open.value, value);
+      continue;
+    }
+    flush();
+    open = {kind, begin, end, value};
+    isOpen = true;
+  }
+  flush();
+
+  std::stable_sort(analysis.events.begin(), analysis.events.end(),
+                   [](const EcgEvent &a, const EcgEvent &b) { return a.begin < b.begin; });
+}
+
+} // namespace analyzer
+} // namespace vitalcare
@@ -0,0 +1,136 @@
+/*
+ * VitalCare Rural Analyzer - ECG Chunk Analysis and Merge
+ *
+ * A run is cut into chunks of whole minutes. Each chunk runs the same ECG
+ * chain as esp32-sensors readAD8232(): ThresholdBeatDetector on the raw
+ * ADC sample, BeatChannel for the rate and signal quality index, channel
+ * invalidated while a lead is off and expired after BEAT_CHANNEL_TIMEOUT.
+ * Beats after crossings the detector had to suppress are marked noisy:
+ * noise near the threshold fires the detector every refractory period and
+ * looks like a regular 200 BPM rhythm to the quality index.
+ *
+ * A chunk first replays a warm-up stretch before its start without keeping
+ * anything, so the detector's arming/refractory state and the quality
+ * index have settled by the first sample it owns.
+ *
+ * Chunks only report beats and leads-off spans. Everything that looks
+ * across chunk boundaries (RR intervals, HRV, pauses, rhythm episodes) is
+ * done by mergeRun() on the ordered results.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Recording.h"
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+struct AnalysisOptions
+{
+  // esp32-sensors: ecgDetector(2000, 100, 300), BEAT_CHANNEL_TIMEOUT 3000
+  int32_t threshold = 2000;
+  int32_t hysteresis = 100;
+  uint32_t refractoryMs = 300;
+  uint32_t channelTimeoutMs = 3000;
+
+  uint32_t chunkMinutes = 5;
+  uint32_t warmupSeconds = 10;
+
+  uint32_t pauseMs = 2000;        // RR at least this long with leads on
+  uint32_t minLeadsOffMs = 1000;  // Shorter leads-off blips are not events
+  float minQuality = 0.5f;        // Minutes below are low quality; rhythm needs it
+  float maxNoisyFraction = 0.1f;  // Minutes with more noisy beats are low quality
+  uint32_t minRhythmBeats = 20;   // Valid beats a minute needs for a rhythm call
+  AlertThresholds limits = BEDSIDE_THRESHOLDS;
+};
+
+struct DetectedBeat
+{
+  uint64_t sample; // Index within the run of the sample that crossed the threshold
+  float rate;      // Beat-to-beat rate (BPM), 0 when BeatChannel rejected the interval
+  float quality;   // BeatChannel quality after this beat
+  bool noisy;      // The detector suppressed crossings since the previous beat
+};
+
+struct SampleSpan
+{
+  uint64_t begin;
+  uint64_t end;
+};
+
+struct ChunkResult
+{
+  uint64_t begin = 0; // Samples owned: [begin, end)
+  uint64_t end = 0;
+  std::vector<DetectedBeat> beats;
+  std::vector<SampleSpan> leadsOff;
+};
+
+// Analyzes samples [begin, end) of run, warming up on the samples before.
+void analyzeChunk(const EcgRun &run, uint64_t begin, uint64_t end, const AnalysisOptions &options,
+                  ChunkResult &result);
+
+// Chunk boundaries of a run: whole minutes, the last chunk takes the rest.
+std::vector<SampleSpan> chunkRun(const EcgRun &run, const AnalysisOptions &options);
+
+struct MinuteSummary
+{
+  uint64_t minute = 0;  // Since the start of the run
+  uint32_t beats = 0;
+  uint32_t validBeats = 0;
+  uint32_t noisyBeats = 0;
+  float meanRate = 0;   // Mean beat-to-beat rate of the valid beats (BPM)
+  float minRate = 0;
+  float maxRate = 0;
+  float quality = 0;    // Mean signal quality index at the beats
+  float leadsOffFraction = 0;
+  HrvAccumulator hrv;
+};
+
+enum EcgEventKind
+{
+  EVENT_LEADS_OFF,
+  EVENT_PAUSE,
+  EVENT_TACHYCARDIA,
+  EVENT_BRADYCARDIA,
+  EVENT_LOW_QUALITY,
+};
+
+const char *eventKindName(EcgEventKind kind);
+
+struct EcgEvent
+{
+  EcgEventKind kind;
+  uint64_t begin; // Samples within the run
+  uint64_t end;
+  // Pause: RR (ms). Tachy/bradycardia: highest/lowest minute rate (BPM).
+  // Low quality: lowest minute quality, noisy beats counting as zero.
+  // Leads off: duration (s).
+  float value;
+};
+
+struct RunAnalysis
+{
+  std::vector<MinuteSummary> minutes;
+  std::vector<EcgEvent> events;
+  HrvAccumulator hrv; // Whole run
+  uint64_t beats = 0;
+  uint64_t validBeats = 0;
+  uint64_t leadsOffSamples = 0;
+};
+
+// Merges one run's chunk results, ordered by begin, into minute summaries
+// and an event list ordered by start.
+void mergeRun(const EcgRun &run, const std::vector<ChunkResult> &chunks, const AnalysisOptions &options,
+              RunAnalysis &analysis);
+
+} // namespace analyzer
+} // namespace vitalcare
@@ -0,0 +1,901 @@
+/*
+ * VitalCare Rural Analyzer - SD Record Log Decoder
+ */
+
+#include "RecordLogDecoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Column files are written from memory as little-endian"
+#endif
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+void RecordLogCounters::add(const RecordLogCounters &other)
+{
+  files += other.files;
+  badFiles += other.badFiles;
+  bytes += other.bytes;
+  segments += other.segments;
+  trendFiles += other.trendFiles;
+  historyLogs += other.historyLogs;
+  recordings += other.recordings;
+  blocks += other.blocks;
+  damagedBlocks += other.damagedBlocks;
+  lostBlocks += other.lostBlocks;
+  unwrittenBlocks += other.unwrittenBlocks;
+  vitals += other.vitals;
+  patients += other.patients;
+  salvaged += other.salvaged;
+  dropped += other.dropped;
+  events += other.events;
+  edfRecords += other.edfRecords;
+}
+
+// One vitals row in VitalRecord's x10 fixed point, whatever file it came from
+struct RecordLogDecoder::Row
+{
+  uint32_t sequence;
+  uint32_t timestampMs;
+  uint16_t heartRate, systolic, diastolic, spO2;
+  int16_t temperature;
+  uint8_t alertFlags;
+  uint8_t recordFlags;
+};
+
+// One file's rows for one patient, not yet appended
+struct RecordLogDecoder::Pending
+{
+  std::string key;
+  Output *output = nullptr; // looked up with the first row
+  std::string csv;
+  size_t rows = 0;
+  std::vector<uint32_t> sequence, timestampMs;
+  std::vector<float> heartRate, systolic, diastolic, spO2, temperature;
+  std::vector<uint8_t> alertFlags, recordFlags;
+};
+
+static uint16_t le16(const uint8_t *in)
+{
+  return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t le32(const uint8_t *in)
+{
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static char *putUnsigned(char *out, uint32_t value)
+{
+  char digits[10];
+  int count = 0;
+  do
+  {
+    digits[count++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  while (count)
+    *out++ = digits[--count];
+  return out;
+}
+
+// x10 fixed point as "98.6"
+static char *putTenths(char *out, int32_t value)
+{
+  if (value < 0)
+  {
+    *out++ = '-';
+    value = -value;
+  }
+  out = putUnsigned(out, (uint32_t)value / 10);
+  *out++ = '.';
+  *out++ = (char)('0' + value % 10);
+  return out;
+}
+
+// Patient ids become file names: anything but [A-Za-z0-9_-] turns into '_'
+static std::string outputKey(const char *patientId, uint64_t deviceId)
+{
+  if (patientId[0] == '\0')
+  {
+    char key[32];
+    snprintf(key, sizeof(key), "device-%016llx", (unsigned long long)deviceId);
+    return key;
+  }
+  std::string key(patientId);
+  for (char &c : key)
+  {
+    bool keep = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+    if (!keep)
+      c = '_';
+  }
+  return key;
+}
+
+static bool hasSuffix(const std::string &name, const char *suffix)
+{
+  size_t length = strlen(suffix);
+  return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+enum FileKind : uint8_t
+{
+  FILE_UNKNOWN,
+  FILE_SEGMENT,
+  FILE_TREND_CSV,
+  FILE_HISTORY_LOG,
+  FILE_EDF
+};
+
+static FileKind fileKind(const std::string &name)
+{
+  if (hasSuffix(name, ".vcl"))
+    return FILE_SEGMENT;
+  if (hasSuffix(name, ".csv") && !hasSuffix(name, "-rollup.csv"))
+    return FILE_TREND_CSV;
+  if (hasSuffix(name, ".vhr"))
+    return FILE_HISTORY_LOG;
+  if (hasSuffix(name, ".edf"))
+    return FILE_EDF;
+  return FILE_UNKNOWN;
+}
+
+static std::string baseName(const std::string &path)
+{
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Device files are named <id>_<registration s><extension>
+static std::string fileKey(const std::string &path)
+{
+  std::string name = baseName(path);
+  size_t cut = name.rfind('_');
+  if (cut == std::string::npos || cut == 0)
+    cut = name.find('.');
+  return outputKey(name.substr(0, cut).c_str(), 0);
+}
+
+static void appendCsvText(std::string &out, const std::string &text)
+{
+  out += '"';
+  for (char c : text)
+  {
+    if (c == '"')
+      out += '"';
+    out += c;
+  }
+  out += '"';
+}
+
+RecordLogDecoder::RecordLogDecoder(const std::string &outDir, const RecordLogOptions &options)
+    : outDir(outDir), options(options)
+{
+  if (this->options.groupRows == 0)
+    this->options.groupRows = 1;
+}
+
+RecordLogDecoder::~RecordLogDecoder()
+{
+  for (auto &entry : outputs)
+  {
+    if (entry.second->csv)
+      fclose(entry.second->csv);
+    if (entry.second->columns)
+      fclose(entry.second->columns);
+    if (entry.second->events)
+      fclose(entry.second->events);
+  }
+}
+
+std::vector<std::string> RecordLogDecoder::listFiles(const std::vector<std::string> &paths)
+{
+  std::vector<std::string> files;
+  for (const std::string &path : paths)
+  {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+      perror(path.c_str());
+      continue;
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+      files.push_back(path);
+      continue;
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+    {
+      perror(path.c_str());
+      continue;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *entry = readdir(dir))
+    {
+      if (fileKind(entry->d_name) != FILE_UNKNOWN)
+        names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names)
+      files.push_back(path + "/" + name);
+  }
+  return files;
+}
+
+RecordLogDecoder::Output *RecordLogDecoder::output(const std::string &key)
+{
+  std::lock_guard<std::mutex> guard(outputsLock);
+  std::unique_ptr<Output> &slot = outputs[key];
+  if (!slot)
+  {
+    slot.reset(new Output());
+    slot->base = outDir + "/" + key;
+  }
+  return slot.get();
+}
+
+// Opens out's vitals files, under out.lock
+void RecordLogDecoder::openVitals(Output &out)
+{
+  out.opened = true;
+  if (options.csv)
+  {
+    out.csv = fopen((out.base + ".csv").c_str(), "w");
+    if (!out.csv)
+    {
+      perror((out.base + ".csv").c_str());
+      out.failed = true;
+    }
+    else
+    {
+      fputs("device,segment,sequence,timestamp_ms,heart_rate,systolic,diastolic,spo2,temperature_f,alert_flags,"
+            "record_flags\n",
+            out.csv);
+    }
+  }
+  if (options.columns)
+  {
+    out.columns = fopen((out.base + ".vcc").c_str(), "wb");
+    if (!out.columns)
+    {
+      perror((out.base + ".vcc").c_str());
+      out.failed = true;
+    }
+    else
+    {
+      uint8_t header[8];
+      BinaryWriter writer(header, sizeof(header));
+      writer.u32(COLUMN_FILE_MAGIC).u8(COLUMN_FILE_VERSION).u8(COLUMN_COUNT).u16(0);
+      fwrite(header, 1, sizeof(header), out.columns);
+    }
+  }
+}
+
+void RecordLogDecoder::flush(Pending &pending, uint64_t deviceId, uint32_t segmentIndex)
+{
+  if (pending.rows == 0)
+    return;
+  Output &out = *pending.output;
+  std::lock_guard<std::mutex> guard(out.lock);
+  if (!out.opened)
+    openVitals(out);
+  if (out.csv && fwrite(pending.csv.data(), 1, pending.csv.size(), out.csv) != pending.csv.size())
+    out.failed = true;
+  if (out.columns)
+  {
+    uint8_t header[24];
+    BinaryWriter writer(header, sizeof(header));
+    writer.u32(COLUMN_GROUP_MAGIC).u32((uint32_t)pending.rows).u64(deviceId).u32(segmentIndex).u32(0);
+    size_t rows = pending.rows;
+    size_t data = rows * (7 * 4 + 2);
+    static const uint8_t ZEROS[8] = {0};
+    size_t padding = (8 - data % 8) % 8;
+    bool ok = fwrite(header, 1, sizeof(header), out.columns) == sizeof(header) &&
+              fwrite(pending.sequence.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.timestampMs.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.heartRate.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.systolic.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.diastolic.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.spO2.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.temperature.data(), 4, rows, out.columns) == rows &&
+              fwrite(pending.alertFlags.data(), 1, rows, out.columns) == rows &&
+              fwrite(pending.recordFlags.data(), 1, rows, out.columns) == rows &&
+              fwrite(ZEROS, 1, padding, out.columns) == padding;
+    if (!ok)
+      out.failed = true;
+  }
+
+  pending.csv.clear();
+  pending.rows = 0;
+  pending.sequence.clear();
+  pending.timestampMs.clear();
+  pending.heartRate.clear();
+  pending.systolic.clear();
+  pending.diastolic.clear();
+  pending.spO2.clear();
+  pending.temperature.clear();
+  pending.alertFlags.clear();
+  pending.recordFlags.clear();
+}
+
+// One file's rows, buffered per patient and appended a row group at a time
+struct RecordLogDecoder::FileRows
+{
+  FileRows(RecordLogDecoder &decoder, RecordLogCounters &counters, uint64_t deviceId, uint32_t segmentIndex)
+      : decoder(decoder), counters(counters), deviceId(deviceId), segmentIndex(segmentIndex)
+  {
+    char device[17];
+    snprintf(device, sizeof(device), "%016llx", (unsigned long long)deviceId);
+    prefixLength = snprintf(prefix, sizeof(prefix), "%s,%u,", device, segmentIndex);
+  }
+
+  // Rows from here on belong to the patient with this output key
+  void select(const std::string &key)
+  {
+    Pending &pending = pendingRows[key];
+    pending.key = key;
+    current = &pending;
+  }
+
+  void add(const Row &row)
+  {
+    Pending &rows = *current;
+    if (!rows.output)
+      rows.output = decoder.output(rows.key);
+    if (decoder.options.csv)
+    {
+      char line[160];
+      memcpy(line, prefix, (size_t)prefixLength);
+      char *out = line + prefixLength;
+      out = putUnsigned(out, row.sequence);
+      *out++ = ',';
+      out = putUnsigned(out, row.timestampMs);
+      *out++ = ',';
+      out = putTenths(out, row.heartRate);
+      *out++ = ',';
+      out = putTenths(out, row.systolic);
+      *out++ = ',';
+      out = putTenths(out, row.diastolic);
+      *out++ = ',';
+      out = putTenths(out, row.spO2);
+      *out++ = ',';
+      out = putTenths(out, row.temperature);
+      *out++ = ',';
+      out = putUnsigned(out, row.alertFlags);
+      *out++ = ',';
+      out = putUnsigned(out, row.recordFlags);
+      *out++ = '\n';
+      rows.csv.append(line, (size_t)(out - line));
+    }
+    if (decoder.options.columns)
+    {
+      rows.sequence.push_back(row.sequence);
+      rows.timestampMs.push_back(row.timestampMs);
+      rows.heartRate.push_back(row.heartRate / 10.0f);
+      rows.systolic.push_back(row.systolic / 10.0f);
+      rows.diastolic.push_back(row.diastolic / 10.0f);
+      rows.spO2.push_back(row.spO2 / 10.0f);
+      rows.temperature.push_back(row.temperature / 10.0f);
+      rows.alertFlags.push_back(row.alertFlags);
+      rows.recordFlags.push_back(row.recordFlags);
+    }
+    counters.vitals++;
+    if (++rows.rows >= decoder.options.groupRows)
+      decoder.flush(rows, deviceId, segmentIndex);
+  }
+
+  // A trend row or history record, at the same x10 precision as a VitalRecord
+  void add(const HistoryRecord &record, uint32_t sequence)
+  {
+    Row row = {sequence,
+               record.vitals.timestampMs,
+               toFixed10(record.vitals.heartRate),
+               toFixed10(record.vitals.systolicBP),
+               toFixed10(record.vitals.diastolicBP),
+               toFixed10(record.vitals.spO2),
+               toSignedFixed10(record.vitals.temperature),
+               record.alertFlags,
+               0};
+    add(row);
+  }
+
+  void flush()
+  {
+    for (auto &entry : pendingRows)
+      decoder.flush(entry.second, deviceId, segmentIndex);
+  }
+
+  RecordLogDecoder &decoder;
+  RecordLogCounters &counters;
+  uint64_t deviceId;
+  uint32_t segmentIndex;
+  char prefix[48];
+  int prefixLength;
+  std::map<std::string, Pending> pendingRows; // patients seen in this file
+  Pending *current = nullptr;
+};
+
+bool RecordLogDecoder::decodeFile(const std::string &path, RecordLogCounters &counters)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    perror(path.c_str());
+    counters.badFiles++;
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    perror(path.c_str());
+    close(fd);
+    counters.badFiles++;
+    return false;
+  }
+  size_t length = (size_t)info.st_size;
+  void *map = nullptr;
+  if (length > 0)
+  {
+    map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      perror("mmap file");
+      close(fd);
+      counters.badFiles++;
+      return false;
+    }
+    madvise(map, length, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  const uint8_t *base = (const uint8_t *)map;
+  bool decoded;
+  switch (fileKind(baseName(path)))
+  {
+  case FILE_TREND_CSV:
+    decoded = decodeTrendCsv(path, base, length, counters);
+    break;
+  case FILE_HISTORY_LOG:
+    decoded = decodeHistoryLog(path, base, length, counters);
+    break;
+  case FILE_EDF:
+    decoded = decodeEdf(path, base, length, counters);
+    break;
+  default:
+    decoded = decodeSegment(path, base, length, counters);
+    break;
+  }
+  if (map)
+    munmap(map, length);
+  if (decoded)
+  {
+    counters.files++;
+    counters.bytes += length;
+  }
+  else
+  {
+    counters.badFiles++;
+  }
+  return decoded;
+}
+
+bool RecordLogDecoder::decodeSegment(const std::string &path, const uint8_t *base, size_t length,
+                                     RecordLogCounters &counters)
+{
+  RecordLogHeader header;
+  if (length < RECORD_LOG_HEADER_SIZE || !decodeRecordLogHeader(base, length, header))
+  {
+    fprintf(stderr, "%s: bad segment header\n", path.c_str());
+    return false;
+  }
+  counters.segments++;
+
+  FileRows rows(*this, counters, header.deviceId, header.segmentIndex);
+  rows.select(outputKey(header.patientId, header.deviceId));
+
+  auto addVital = [&](const uint8_t *in) {
+    Row row = {le32(in + 4),
+               le32(in + 8),
+               le16(in + 12),
+               le16(in + 14),
+               le16(in + 16),
+               le16(in + 18),
+               (int16_t)le16(in + 20),
+               in[2],
+               in[3]};
+    rows.add(row);
+  };
+
+  auto addPatient = [&](const PatientRecord &record) {
+    {
+      std::lock_guard<std::mutex> guard(outputsLock);
+      patientRecords.push_back(PatientEntry{header.deviceId, header.segmentIndex, record});
+    }
+    counters.patients++;
+    rows.select(outputKey(record.patientId, header.deviceId));
+  };
+
+  uint64_t blockCount = length >= RECORD_LOG_BLOCK_SIZE ? length / RECORD_LOG_BLOCK_SIZE - 1 : 0;
+  uint64_t notLive = 0, notLiveAtEnd = 0;
+  for (uint64_t n = 0; n < blockCount; n++)
+  {
+    const uint8_t *in = base + recordLogBlockOffset(n);
+    RecordLogBlock block;
+    RecordLogBlockStatus status = decodeRecordLogBlock(in, block);
+    if (status == LOG_BLOCK_NOT_BLOCK || block.sequence != (uint32_t)(header.firstBlockSequence + n))
+    {
+      notLive++;
+      notLiveAtEnd++;
+      continue;
+    }
+    notLiveAtEnd = 0;
+
+    const uint8_t *record = in + RECORD_LOG_BLOCK_HEADER_SIZE;
+    size_t recordSize = uplinkRecordSize(block.recordType);
+    if (status == LOG_BLOCK_OK)
+    {
+      counters.blocks++;
+      for (uint8_t r = 0; r < block.recordCount; r++, record += recordSize)
+      {
+        if (block.recordType == UPLINK_VITAL_RECORDS)
+        {
+          addVital(record);
+        }
+        else
+        {
+          PatientRecord patient;
+          if (decodePatientRecord(record, patient))
+            addPatient(patient);
+          else
+            counters.dropped++;
+        }
+      }
+      continue;
+    }
+
+    // Bad block CRC: keep whatever still passes its record CRC-16
+    counters.damagedBlocks++;
+    for (uint8_t r = 0; r < block.recordCount; r++, record += recordSize)
+    {
+      bool good;
+      if (block.recordType == UPLINK_VITAL_RECORDS)
+      {
+        VitalRecord vital;
+        good = decodeVitalRecord(record, vital);
+        if (good)
+          addVital(record);
+      }
+      else
+      {
+        PatientRecord patient;
+        good = decodePatientRecord(record, patient);
+        if (good)
+          addPatient(patient);
+      }
+      if (good)
+        counters.salvaged++;
+      else
+        counters.dropped++;
+    }
+  }
+  counters.lostBlocks += notLive - notLiveAtEnd;
+  counters.unwrittenBlocks += notLiveAtEnd;
+
+  rows.flush();
+  return true;
+}
+
+// A row cut short by power loss (no line ending, or fields missing) is
+// dropped; its sequence number stays unused.
+bool RecordLogDecoder::decodeTrendCsv(const std::string &path, const uint8_t *base, size_t length,
+                                      RecordLogCounters &counters)
+{
+  const char *text = (const char *)base;
+  size_t headerLength = strlen(HISTORY_CSV_HEADER);
+  if (length < headerLength || memcmp(text, HISTORY_CSV_HEADER, headerLength) != 0)
+  {
+    fprintf(stderr, "%s: not a trend CSV\n", path.c_str());
+    return false;
+  }
+  counters.trendFiles++;
+
+  FileRows rows(*this, counters, 0, 0);
+  rows.select(fileKey(path));
+  uint32_t sequence = 0;
+  char line[256];
+  for (size_t at = headerLength; at < length;)
+  {
+    const char *newline = (const char *)memchr(text + at, '\n', length - at);
+    size_t lineLength = newline ? (size_t)(newline - text) - at : length - at;
+    const char *start = text + at;
+    at += lineLength + 1;
+    if (lineLength == 0 || (lineLength == 1 && start[0] == '\r'))
+      continue;
+
+    HistoryRecord record;
+    bool parsed = false;
+    if (newline && lineLength < sizeof(line))
+    {
+      memcpy(line, start, lineLength);
+      line[lineLength] = '\0';
+      parsed = parseHistoryCsvRow(line, record);
+    }
+    if (parsed)
+      rows.add(record, sequence);
+    else
+      counters.dropped++;
+    sequence++;
+  }
+  rows.flush();
+  return true;
+}
+
+bool RecordLogDecoder::decodeHistoryLog(const std::string &path, const uint8_t *base, size_t length,
+                                        RecordLogCounters &counters)
+{
+  counters.historyLogs++;
+  FileRows rows(*this, counters, 0, 0);
+  rows.select(fileKey(path));
+  size_t count = length / HISTORY_RECORD_SIZE;
+  for (size_t i = 0; i < count; i++)
+  {
+    HistoryRecord record;
+    decodeHistoryRecord(base + i * HISTORY_RECORD_SIZE, record);
+    rows.add(record, (uint32_t)i);
+  }
+  if (length % HISTORY_RECORD_SIZE)
+    counters.dropped++; // an append torn by power loss
+  rows.flush();
+  return true;
+}
+
+// Fixed-width ASCII header field, trailing spaces trimmed
+static std::string edfField(const uint8_t *in, size_t width)
+{
+  size_t length = width;
+  while (length && (in[length - 1] == ' ' || in[length - 1] == '\0'))
+    length--;
+  return std::string((const char *)in, length);
+}
+
+static bool edfInteger(const uint8_t *in, size_t width, long &value)
+{
+  std::string text = edfField(in, width);
+  char *end;
+  value = strtol(text.c_str(), &end, 10);
+  return !text.empty() && *end == '\0';
+}
+
+// Records the header counts that the file holds. A recording that was
+// never synced counts -1, and one cut into a preallocated segment is
+// followed by space never written, so records end at the first whose
+// annotation signal does not open with a timekeeping TAL.
+bool RecordLogDecoder::decodeEdf(const std::string &path, const uint8_t *base, size_t length,
+                                 RecordLogCounters &counters)
+{
+  long headerBytes = 0, headerRecords = 0, signalCount = 0;
+  bool ok = length >= 256 && edfField(base, 8) == "0" && edfInteger(base + 184, 8, headerBytes) &&
+            edfInteger(base + 236, 8, headerRecords) && edfInteger(base + 252, 4, signalCount) && signalCount > 0 &&
+            signalCount < 256 && headerBytes == 256 * (signalCount + 1) && (size_t)headerBytes <= length;
+  std::string format = ok ? edfField(base + 192, 44) : std::string();
+  std::string duration = ok ? edfField(base + 244, 8) : std::string();
+  char *end;
+  double recordSeconds = strtod(duration.c_str(), &end);
+  ok = ok && format.compare(0, 4, "EDF+") == 0 && !duration.empty() && *end == '\0' && recordSeconds > 0;
+
+  // Signal headers are field-major: every label, then every transducer, ...
+  size_t recordBytes = 0, annotationOffset = 0, annotationBytes = 0;
+  std::string signals;
+  for (long s = 0; ok && s < signalCount; s++)
+  {
+    std::string label = edfField(base + 256 + 16 * s, 16);
+    long samples;
+    ok = edfInteger(base + 256 + 216 * signalCount + 8 * s, 8, samples) && samples > 0;
+    if (label == "EDF Annotations" && annotationBytes == 0)
+    {
+      annotationOffset = recordBytes;
+      annotationBytes = (size_t)samples * 2;
+    }
+    else if (label != "EDF Annotations")
+    {
+      signals += signals.empty() ? "" : ";";
+      signals += label;
+    }
+    recordBytes += (size_t)samples * 2;
+  }
+  if (!ok || annotationBytes == 0)
+  {
+    fprintf(stderr, "%s: not an EDF+ recording\n", path.c_str());
+    return false;
+  }
+  counters.recordings++;
+
+  // The patient code is the first subfield of the patient field
+  std::string patient = edfField(base + 8, 80);
+  patient = patient.substr(0, patient.find(' '));
+  std::string key = patient.empty() || patient == "X" ? fileKey(path) : outputKey(patient.c_str(), 0);
+  std::string file = baseName(path);
+
+  uint64_t available = (length - (size_t)headerBytes) / recordBytes;
+  uint64_t count = headerRecords >= 0 ? std::min<uint64_t>((uint64_t)headerRecords, available) : available;
+  uint64_t records = 0, annotations = 0;
+  std::string events;
+  for (; records < count; records++)
+  {
+    const char *area = (const char *)base + headerBytes + records * recordBytes + annotationOffset;
+    if (area[0] != '+' && area[0] != '-')
+      break;
+
+    // TALs: onset [0x15 duration] 0x14, texts each ending 0x14, then 0x00
+    size_t at = 0;
+    while (at < annotationBytes && area[at] != '\0')
+    {
+      const char *tal = area + at;
+      size_t talLength = strnlen(tal, annotationBytes - at);
+      at += talLength + 1;
+      std::string text(tal, talLength);
+      size_t mark = text.find_first_of("\x14\x15");
+      if (mark == std::string::npos)
+        continue;
+      std::string onset = text.substr(text[0] == '+' ? 1 : 0, mark - (text[0] == '+' ? 1 : 0));
+      std::string span;
+      if (text[mark] == '\x15')
+      {
+        size_t next = text.find('\x14', mark);
+        if (next == std::string::npos)
+          continue;
+        span = text.substr(mark + 1, next - mark - 1);
+        mark = next;
+      }
+      for (size_t from = mark + 1; from < text.size();)
+      {
+        size_t next = text.find('\x14', from);
+        if (next == std::string::npos)
+          next = text.size();
+        if (next > from)
+        {
+          appendCsvText(events, file);
+          events += ',' + onset + ',' + span + ',';
+          appendCsvText(events, text.substr(from, next - from));
+          events += '\n';
+          annotations++;
+        }
+        from = next + 1;
+      }
+    }
+  }
+  counters.edfRecords += records;
+  counters.events += annotations;
+
+  if (!events.empty())
+  {
+    Output &out = *output(key);
+    std::lock_guard<std::mutex> guard(out.lock);
+    if (!out.events)
+    {
+      out.events = fopen((out.base + "-events.csv").c_str(), "w");
+      if (!out.events)
+      {
+        perror((out.base + "-events.csv").c_str());
+        out.failed = true;
+      }
+      else
+      {
+        fputs("file,onset_s,duration_s,annotation\n", out.events);
+      }
+    }
+    if (out.events && fwrite(events.data(), 1, events.size(), out.events) != events.size())
+      out.failed = true;
+  }
+
+  std::lock_guard<std::mutex> guard(outputsLock);
+  recordings.push_back(RecordingEntry{file, key, format.substr(0, 5),
+                                      edfField(base + 168, 8) + " " + edfField(base + 176, 8), signals, records,
+                                      recordSeconds, annotations});
+  return true;
+}
+
+static void putCsvText(FILE *out, const char *text)
+{
+  fputc('"', out);
+  for (const char *c = text; *c; c++)
+  {
+    if (*c == '"')
+      fputc('"', out);
+    fputc(*c, out);
+  }
+  fputc('"', out);
+}
+
+bool RecordLogDecoder::finish()
+{
+  std::lock_guard<std::mutex> guard(outputsLock);
+  std::sort(patientRecords.begin(), patientRecords.end(), [](const PatientEntry &a, const PatientEntry &b) {
+    if (a.deviceId != b.deviceId)
+      return a.deviceId < b.deviceId;
+    return a.record.sequence < b.record.sequence;
+  });
+
+  std::string path = outDir + "/patients.csv";
+  FILE *out = fopen(path.c_str(), "w");
+  if (!out)
+  {
+    perror(path.c_str());
+    failed = true;
+  }
+  else
+  {
+    fputs("device,segment,sequence,patient_id,name,age,gender,session_start_ms,file\n", out);
+    for (const PatientEntry &entry : patientRecords)
+    {
+      const PatientRecord &record = entry.record;
+      fprintf(out, "%016llx,%u,%u,", (unsigned long long)entry.deviceId, entry.segmentIndex, record.sequence);
+      putCsvText(out, record.patientId);
+      fputc(',', out);
+      putCsvText(out, record.name);
+      fprintf(out, ",%u,%c,%u,%s\n", record.age, record.gender ? record.gender : 'U', record.sessionStartMs,
+              outputKey(record.patientId, entry.deviceId).c_str());
+    }
+    if (fclose(out) != 0)
+      failed = true;
+  }
+
+  std::sort(recordings.begin(), recordings.end(),
+            [](const RecordingEntry &a, const RecordingEntry &b) { return a.file < b.file; });
+  path = outDir + "/recordings.csv";
+  out = fopen(path.c_str(), "w");
+  if (!out)
+  {
+    perror(path.c_str());
+    failed = true;
+  }
+  else
+  {
+    fputs("file,patient,format,start,records,record_duration_s,signals,annotations\n", out);
+    for (const RecordingEntry &entry : recordings)
+    {
+      putCsvText(out, entry.file.c_str());
+      fprintf(out, ",%s,%s,%s,%llu,%g,", entry.key.c_str(), entry.format.c_str(), entry.start.c_str(),
+              (unsigned long long)entry.records, entry.recordSeconds);
+      putCsvText(out, entry.signals.c_str());
+      fprintf(out, ",%llu\n", (unsigned long long)entry.annotations);
+    }
+    if (fclose(out) != 0)
+      failed = true;
+  }
+
+  for (auto &entry : outputs)
+  {
+    Output &output = *entry.second;
+    if (output.failed)
+      failed = true;
+    if (output.csv && fclose(output.csv) != 0)
+      failed = true;
+    if (output.columns && fclose(output.columns) != 0)
+      failed = true;
+    if (output.events && fclose(output.events) != 0)
+      failed = true;
+    output.csv = nullptr;
+    output.columns = nullptr;
+    output.events = nullptr;
+  }
+  return !failed;
+}
+
+} // namespace analyzer
+} // namespace vitalcare
@@ -0,0 +1,184 @@
+/*
+ * VitalCare Rural Analyzer - SD Record Log Decoder
+ *
+ * Turns the files on a device's SD card into per-patient files for
+ * analysis. Every file is memory-mapped and decoded by its name:
+ *
+ * - *.vcl: RecordLog.h segments (below)
+ * - <id>_<registration s>.csv: esp32-main's trend rows (HISTORY_CSV_HEADER).
+ *   The status column only says whether a row alerted, so alert_flags are
+ *   recomputed against BEDSIDE_THRESHOLDS as the device did
+ * - <id>_<registration s>.vhr: flash fallback logs of HistoryRecords, as
+ *   copied off the device's internal flash
+ * - <id>_<registration s>[-N].edf: EDF+ recordings. The samples are left to
+ *   EDF viewers; the annotations (leads-off, alert changes, data lost) go
+ *   to the patient's event list
+ *
+ * Device files carry neither device id nor segment (both 0 in the outputs);
+ * the patient is the file name up to its last '_' and the sequence is the
+ * row's index within its file. Rollups (-rollup.csv) are skipped: they
+ * summarise rows the trend CSVs hold.
+ *
+ * A segment is walked block by
+ * block: live blocks with a good CRC-32 are decoded straight from the page
+ * cache; a live block with a bad CRC is salvaged record by record on the
+ * records' own CRC-16. Segments carry the patient active when they were
+ * opened, so every file decodes on its own and decodeFile() runs on any
+ * number of threads at once; rows are buffered per patient and appended
+ * to that patient's outputs a row group at a time.
+ *
+ * Outputs in the output directory, per patient (vitals logged with no
+ * patient go to device-<id>):
+ *
+ * - PATIENT.csv: device,segment,sequence,timestamp_ms,heart_rate,systolic,
+ *   diastolic,spo2,temperature_f,alert_flags,record_flags
+ * - PATIENT.vcc: columnar. An 8-byte header (u32 magic "VCC1", u8 version,
+ *   u8 column count, u16 zero), then row groups, little-endian:
+ *     0  u32  magic "VCRG"
+ *     4  u32  rows
+ *     8  u64  device id
+ *     16 u32  segment index
+ *     20 u32  zero
+ *     24      the columns, rows values each: sequence u32, timestamp_ms
+ *             u32, heart_rate f32, systolic f32, diastolic f32, spo2 f32,
+ *             temperature_f f32, alert_flags u8, record_flags u8; then
+ *             zeros to a multiple of 8 bytes
+ * - PATIENT-events.csv: file,onset_s,duration_s,annotation from the
+ *   patient's EDF+ recordings (only when there are any)
+ *
+ * plus patients.csv listing every PatientRecord found and recordings.csv
+ * every EDF+ recording. Rows of one file
+ * keep log order within a row group; row groups land in the order workers
+ * finish them, so sort on (device, sequence) for a timeline.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+const uint32_t COLUMN_FILE_MAGIC = 0x31434356; // "VCC1"
+const uint32_t COLUMN_GROUP_MAGIC = 0x47524356; // "VCRG"
+const uint8_t COLUMN_FILE_VERSION = 1;
+const uint8_t COLUMN_COUNT = 9;
+
+struct RecordLogCounters
+{
+  uint64_t files = 0;            // decoded, of every kind
+  uint64_t badFiles = 0;         // unreadable or bad header
+  uint64_t bytes = 0;
+  uint64_t segments = 0;         // files by kind
+  uint64_t trendFiles = 0;
+  uint64_t historyLogs = 0;
+  uint64_t recordings = 0;
+  uint64_t blocks = 0;          // live blocks with a good CRC
+  uint64_t damagedBlocks = 0;   // live blocks with a bad CRC, salvaged
+  uint64_t lostBlocks = 0;      // unreadable blocks before a segment's last live block
+  uint64_t unwrittenBlocks = 0; // after a segment's last live block (erased or stale)
+  uint64_t vitals = 0;
+  uint64_t patients = 0;
+  uint64_t salvaged = 0; // records recovered from damaged blocks (counted in vitals/patients too)
+  uint64_t dropped = 0;  // records in damaged blocks that failed their CRC-16, trend rows that do
+                         // not parse, partial history records
+  uint64_t events = 0;   // EDF+ annotations
+  uint64_t edfRecords = 0;
+
+  void add(const RecordLogCounters &other);
+};
+
+struct RecordLogOptions
+{
+  bool csv = true;
+  bool columns = true;
+  size_t groupRows = 16384; // rows a file buffers per patient before appending
+};
+
+class RecordLogDecoder
+{
+public:
+  RecordLogDecoder(const std::string &outDir, const RecordLogOptions &options);
+  ~RecordLogDecoder();
+
+  RecordLogDecoder(const RecordLogDecoder &) = delete;
+  RecordLogDecoder &operator=(const RecordLogDecoder &) = delete;
+
+  // Files the decoder reads among paths, directories expanded, sorted by
+  // name; files named explicitly are taken whatever their name
+  static std::vector<std::string> listFiles(const std::vector<std::string> &paths);
+
+  // Decodes one file into the patients' outputs. Thread-safe; false if the
+  // file could not be read as the kind its name says.
+  bool decodeFile(const std::string &path, RecordLogCounters &counters);
+
+  // Writes patients.csv and recordings.csv and closes every output; false
+  // on a write error.
+  bool finish();
+
+  size_t patientCount() const { return outputs.size(); }
+
+private:
+  // A patient's files, opened with the first rows or events they get
+  struct Output
+  {
+    std::mutex lock;
+    std::string base; // path without extension
+    bool opened = false;
+    FILE *csv = nullptr;
+    FILE *columns = nullptr;
+    FILE *events = nullptr;
+    bool failed = false;
+  };
+
+  struct Row;
+  struct Pending;
+  struct FileRows;
+  struct PatientEntry
+  {
+    uint64_t deviceId;
+    uint32_t segmentIndex;
+    PatientRecord record;
+  };
+  struct RecordingEntry
+  {
+    std::string file;
+    std::string key;
+    std::string format; // EDF+C or EDF+D
+    std::string start;  // "dd.mm.yy hh.mm.ss" as in the header
+    std::string signals;
+    uint64_t records;
+    double recordSeconds;
+    uint64_t annotations;
+  };
+
+  Output *output(const std::string &key);
+  void openVitals(Output &out);
+  void flush(Pending &pending, uint64_t deviceId, uint32_t segmentIndex);
+  bool decodeSegment(const std::string &path, const uint8_t *base, size_t length, RecordLogCounters &counters);
+  bool decodeTrendCsv(const std::string &path, const uint8_t *base, size_t length, RecordLogCounters &counters);
+  bool decodeHistoryLog(const std::string &path, const uint8_t *base, size_t length, RecordLogCounters &counters);
+  bool decodeEdf(const std::string &path, const uint8_t *base, size_t length, RecordLogCounters &counters);
+
+  std::string outDir;
+  RecordLogOptions options;
+  std::mutex outputsLock;
+  std::map<std::string, std::unique_ptr<Output>> outputs;
+  std::vector<PatientEntry> patientRecords; // outputsLock
+  std::vector<RecordingEntry> recordings;   // outputsLock
+  bool failed = false;                      // outputsLock
+};
+
+} // namespace analyzer
+} // namespace vitalcare
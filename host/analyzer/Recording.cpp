@@ -0,0 +1,202 @@
+/*
+ * VitalCare Rural Analyzer - Memory-Mapped ECG Recordings
+ */
+
+#include "Recording.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Samples are mapped in place as little-endian i16"
+#endif
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+size_t EcgRun::segmentAt(uint64_t index) const
+{
+  auto after = std::upper_bound(segments.begin(), segments.end(), index,
+                                [](uint64_t value, const EcgSegment *segment) { return value < segment->firstSample; });
+  return after == segments.begin() ? 0 : (size_t)(after - segments.begin() - 1);
+}
+
+EcgRecording::~EcgRecording()
+{
+  for (const std::unique_ptr<EcgSegment> &segment : segmentList)
+    munmap(segment->map, segment->mapLength);
+}
+
+static bool hasSuffix(const std::string &name, const char *suffix)
+{
+  size_t length = strlen(suffix);
+  return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+bool EcgRecording::open(const std::vector<std::string> &paths)
+{
+  for (const std::string &path : paths)
+  {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+      perror(path.c_str());
+      continue;
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+      mapSegment(path);
+      continue;
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+    {
+      perror(path.c_str());
+      continue;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *entry = readdir(dir))
+    {
+      if (hasSuffix(entry->d_name, ".vce"))
+        names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names)
+      mapSegment(path + "/" + name);
+  }
+
+  buildRuns();
+  return !runList.empty();
+}
+
+bool EcgRecording::mapSegment(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    perror(path.c_str());
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < ECG_SEGMENT_HEADER_SIZE)
+  {
+    fprintf(stderr, "%s: not an ECG segment\n", path.c_str());
+    close(fd);
+    return false;
+  }
+
+  size_t length = (size_t)info.st_size;
+  void *map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    perror("mmap segment");
+    return false;
+  }
+  // Chunks are read front to back, several segments at once
+  madvise(map, length, MADV_SEQUENTIAL);
+
+  std::unique_ptr<EcgSegment> segment(new EcgSegment());
+  segment->path = path;
+  segment->map = map;
+  segment->mapLength = length;
+  if (!decodeEcgSegmentHeader((const uint8_t *)map, length, segment->header))
+  {
+    fprintf(stderr, "%s: bad segment header\n", path.c_str());
+    munmap(map, length);
+    return false;
+  }
+
+  uint64_t present = (length - ECG_SEGMENT_HEADER_SIZE) / sizeof(int16_t);
+  uint64_t declared = segment->header.sampleCount;
+  if (declared > present)
+    fprintf(stderr, "%s: torn segment, %llu of %llu samples\n", path.c_str(), (unsigned long long)present,
+            (unsigned long long)declared);
+  segment->count = declared == 0 || declared > present ? present : declared;
+  segment->samples = (const int16_t *)((const uint8_t *)map + ECG_SEGMENT_HEADER_SIZE);
+  segmentList.push_back(std::move(segment));
+  return true;
+}
+
+void EcgRecording::buildRuns()
+{
+  std::vector<EcgSegment *> ordered;
+  for (const std::unique_ptr<EcgSegment> &segment : segmentList)
+    ordered.push_back(segment.get());
+  std::sort(ordered.begin(), ordered.end(), [](const EcgSegment *a, const EcgSegment *b) {
+    if (a->header.deviceId != b->header.deviceId)
+      return a->header.deviceId < b->header.deviceId;
+    return a->header.segmentIndex < b->header.segmentIndex;
+  });
+
+  runList.clear();
+  const EcgSegment *previous = nullptr;
+  for (EcgSegment *segment : ordered)
+  {
+    if (segment->count == 0)
+      continue;
+    const EcgSegmentHeader &header = segment->header;
+    bool continues = false;
+    if (previous && previous->header.deviceId == header.deviceId &&
+        previous->header.sampleRateHz == header.sampleRateHz &&
+        header.segmentIndex == previous->header.segmentIndex + 1)
+    {
+      // Within one sample period of where the previous segment stopped
+      const EcgRun &run = runList.back();
+      uint64_t expected = ecgSampleTimeMs(run.startMs, run.samples, run.sampleRateHz);
+      uint64_t slack = 1000 / header.sampleRateHz + 1;
+      continues = header.startMs + slack >= expected && header.startMs <= expected + slack;
+    }
+    if (!continues)
+    {
+      EcgRun run;
+      run.deviceId = header.deviceId;
+      run.sampleRateHz = header.sampleRateHz;
+      run.startMs = header.startMs;
+      runList.push_back(run);
+    }
+
+    EcgRun &run = runList.back();
+    segment->firstSample = run.samples;
+    run.samples += segment->count;
+    run.segments.push_back(segment);
+    previous = segment;
+  }
+}
+
+uint64_t EcgRecording::totalSamples() const
+{
+  uint64_t total = 0;
+  for (const EcgRun &run : runList)
+    total += run.samples;
+  return total;
+}
+
+uint64_t EcgRecording::mappedBytes() const
+{
+  uint64_t total = 0;
+  for (const std::unique_ptr<EcgSegment> &segment : segmentList)
+    total += segment->mapLength;
+  return total;
+}
+
+bool EcgRecording::verify(const EcgSegment &segment)
+{
+  if (segment.header.samplesCrc == 0 || segment.count != segment.header.sampleCount)
+    return true;
+  return crc32((const uint8_t *)segment.samples, segment.count * sizeof(int16_t)) == segment.header.samplesCrc;
+}
+
+} // namespace analyzer
+} // namespace vitalcare
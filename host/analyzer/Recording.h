@@ -0,0 +1,98 @@
+/*
+ * VitalCare Rural Analyzer - Memory-Mapped ECG Recordings
+ *
+ * Maps EcgRecording.h segment files read-only and stitches them into runs:
+ * consecutive segments of one device, each starting one sample period
+ * after the previous one ends. Samples are read straight from the page
+ * cache as i16; nothing is copied. A run can be cut anywhere, so workers
+ * take chunks that cross segment boundaries via forEachSpan().
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+struct EcgSegment
+{
+  std::string path;
+  EcgSegmentHeader header;
+  const int16_t *samples = nullptr;
+  uint64_t count = 0;       // Samples present (a torn segment may hold fewer than its header says)
+  uint64_t firstSample = 0; // Index of samples[0] within its run
+  void *map = nullptr;
+  size_t mapLength = 0;
+};
+
+struct EcgRun
+{
+  uint64_t deviceId = 0;
+  uint16_t sampleRateHz = 0;
+  uint64_t startMs = 0;
+  uint64_t samples = 0;
+  std::vector<const EcgSegment *> segments;
+
+  // Calls fn(const int16_t *samples, size_t count, uint64_t firstIndex) for
+  // each contiguous piece of samples [begin, end) of the run.
+  template <typename Fn>
+  void forEachSpan(uint64_t begin, uint64_t end, Fn fn) const
+  {
+    size_t s = segmentAt(begin);
+    while (begin < end && s < segments.size())
+    {
+      const EcgSegment &segment = *segments[s];
+      uint64_t segmentEnd = segment.firstSample + segment.count;
+      uint64_t spanEnd = end < segmentEnd ? end : segmentEnd;
+      fn(segment.samples + (begin - segment.firstSample), (size_t)(spanEnd - begin), begin);
+      begin = spanEnd;
+      s++;
+    }
+  }
+
+  // Index of the segment holding sample index
+  size_t segmentAt(uint64_t index) const;
+};
+
+class EcgRecording
+{
+public:
+  EcgRecording() = default;
+  ~EcgRecording();
+
+  EcgRecording(const EcgRecording &) = delete;
+  EcgRecording &operator=(const EcgRecording &) = delete;
+
+  // Maps every segment file; directories are searched for *.vce. Files
+  // with a bad header are reported and skipped. False when nothing usable
+  // was found.
+  bool open(const std::vector<std::string> &paths);
+
+  const std::vector<EcgRun> &runs() const { return runList; }
+  const std::vector<std::unique_ptr<EcgSegment>> &segments() const { return segmentList; }
+  uint64_t totalSamples() const;
+  uint64_t mappedBytes() const;
+
+  // Checks the samples CRC of a closed segment. An open segment (CRC 0) or
+  // a torn one cannot be checked and passes.
+  static bool verify(const EcgSegment &segment);
+
+private:
+  bool mapSegment(const std::string &path);
+  void buildRuns();
+
+  std::vector<std::unique_ptr<EcgSegment>> segmentList;
+  std::vector<EcgRun> runList;
+};
+
+} // namespace analyzer
+} // namespace vitalcare
@@ -0,0 +1,84 @@
+/*
+ * VitalCare Rural Analyzer - Work-Stealing Pool
+ */
+
+#include "WorkStealingPool.h"
+
+#include <thread>
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+WorkStealingPool::WorkStealingPool(size_t threads) : steals(0)
+{
+  if (threads == 0)
+    threads = 1;
+  for (size_t i = 0; i < threads; i++)
+    workers.emplace_back(new Worker());
+  executed.assign(threads, 0);
+}
+
+void WorkStealingPool::run(std::vector<Task> &tasks)
+{
+  size_t count = workers.size();
+  steals = 0;
+  executed.assign(count, 0);
+  for (size_t w = 0; w < count; w++)
+  {
+    std::lock_guard<std::mutex> guard(workers[w]->lock);
+    workers[w]->tasks.clear();
+    for (size_t i = tasks.size() * w / count; i < tasks.size() * (w + 1) / count; i++)
+      workers[w]->tasks.push_back(i);
+  }
+
+  // No task creates tasks, so a worker that finds every deque empty is done
+  std::vector<std::thread> threads;
+  for (size_t w = 1; w < count; w++)
+    threads.emplace_back(&WorkStealingPool::work, this, w, std::ref(tasks));
+  work(0, tasks);
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+void WorkStealingPool::work(size_t self, std::vector<Task> &tasks)
+{
+  size_t task;
+  while (popOwn(self, task) || steal(self, task))
+  {
+    tasks[task]();
+    executed[self]++;
+  }
+}
+
+bool WorkStealingPool::popOwn(size_t self, size_t &task)
+{
+  Worker &worker = *workers[self];
+  std::lock_guard<std::mutex> guard(worker.lock);
+  if (worker.tasks.empty())
+    return false;
+  task = worker.tasks.front();
+  worker.tasks.pop_front();
+  return true;
+}
+
+bool WorkStealingPool::steal(size_t self, size_t &task)
+{
+  for (size_t offset = 1; offset < workers.size(); offset++)
+  {
+    Worker &victim = *workers[(self + offset) % workers.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty())
+    {
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace analyzer
+} // namespace vitalcare
@@ -0,0 +1,65 @@
+/*
+ * VitalCare Rural Analyzer - Work-Stealing Pool
+ *
+ * Runs a batch of independent tasks on a fixed set of threads. Each worker
+ * starts with a contiguous share of the tasks in its own deque and takes
+ * them from the front, so it walks its part of a recording in file order.
+ * A worker that runs dry steals from the back of another worker's deque,
+ * the task farthest from where that worker is reading. Uneven tasks
+ * (noisy stretches, cold pages, a slow core) are balanced without a
+ * shared queue that every task would contend on.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vitalcare
+{
+namespace analyzer
+{
+
+class WorkStealingPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  explicit WorkStealingPool(size_t threads);
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // Runs every task and returns once all have finished. Tasks never see
+  // each other's state; the caller merges their results afterwards.
+  void run(std::vector<Task> &tasks);
+
+  size_t threadCount() const { return workers.size(); }
+  // Totals of the last run()
+  uint64_t stealCount() const { return steals.load(); }
+  const std::vector<uint64_t> &tasksPerWorker() const { return executed; }
+
+private:
+  struct alignas(64) Worker
+  {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+
+  void work(size_t self, std::vector<Task> &tasks);
+  bool popOwn(size_t self, size_t &task);
+  bool steal(size_t self, size_t &task);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<uint64_t> executed;
+  std::atomic<uint64_t> steals;
+};
+
+} // namespace analyzer
+} // namespace vitalcare
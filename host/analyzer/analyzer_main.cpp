@@ -0,0 +1,300 @@
+/*
+ * VitalCare Rural Analyzer - Multi-Day ECG Recording Analyzer
+ *
+ * Reads raw ECG segment files (EcgRecording.h) straight from the page
+ * cache, cuts each continuous run into minute-aligned chunks and analyzes
+ * them on every core with a work-stealing pool, using the firmware's beat
+ * detector and signal quality index (EcgAnalysis.h). The chunk results are
+ * merged into per-minute summaries (rate, HRV, SQI, leads-off) and an
+ * event list (pauses, tachy/bradycardia, low quality, leads off).
+ *
+ * --check re-runs every run as one sequential chunk and compares the beats,
+ * which shows that chunking changes nothing. --verify checks the samples
+ * CRC of every closed segment first.
+ *
+ * Usage: vitalcare-ecg-analyze [--threads N] [--chunk-minutes 5]
+ *                              [--warmup-seconds 10] [--threshold 2000]
+ *                              [--minutes FILE.csv] [--events FILE.csv]
+ *                              [--verify] [--check] SEGMENT|DIR ...
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "EcgAnalysis.h"
+#include "Recording.h"
+#include "WorkStealingPool.h"
+
+using namespace vitalcare;
+using namespace vitalcare::analyzer;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// "D+HH:MM:SS" since the start of the recording
+static void formatElapsed(uint64_t ms, char *buffer, size_t capacity)
+{
+  uint64_t total = ms / 1000;
+  snprintf(buffer, capacity, "%llu+%02llu:%02llu:%02llu", (unsigned long long)(total / 86400),
+           (unsigned long long)(total / 3600 % 24), (unsigned long long)(total / 60 % 60),
+           (unsigned long long)(total % 60));
+}
+
+static uint64_t sampleMs(const EcgRun &run, uint64_t sample)
+{
+  return ecgSampleTimeMs(run.startMs, sample, run.sampleRateHz);
+}
+
+static void writeMinutes(FILE *out, const std::vector<EcgRun> &runs, const std::vector<RunAnalysis> &analyses)
+{
+  fprintf(out, "device,minute,start_ms,elapsed,beats,valid_beats,mean_hr,min_hr,max_hr,"
+               "nn,sdnn_ms,rmssd_ms,pnn50,sqi,noisy_pct,leads_off_pct\n");
+  for (size_t r = 0; r < runs.size(); r++)
+  {
+    const EcgRun &run = runs[r];
+    for (const MinuteSummary &minute : analyses[r].minutes)
+    {
+      uint64_t startMs = sampleMs(run, minute.minute * 60 * run.sampleRateHz);
+      char elapsed[32];
+      formatElapsed(startMs - run.startMs, elapsed, sizeof(elapsed));
+      fprintf(out, "%016llx,%llu,%llu,%s,%u,%u,%.1f,%.1f,%.1f,%u,%.1f,%.1f,%.1f,%.2f,%.1f,%.1f\n",
+              (unsigned long long)run.deviceId, (unsigned long long)minute.minute, (unsigned long long)startMs,
+              elapsed, minute.beats, minute.validBeats, minute.meanRate, minute.minRate, minute.maxRate,
+              minute.hrv.intervalCount(), minute.hrv.sdnn(), minute.hrv.rmssd(), minute.hrv.pnn50(),
+              minute.quality, minute.beats ? 100.0f * minute.noisyBeats / minute.beats : 0.0f,
+              minute.leadsOffFraction * 100.0f);
+    }
+  }
+}
+
+static void writeEvents(FILE *out, const std::vector<EcgRun> &runs, const std::vector<RunAnalysis> &analyses,
+                        size_t limit)
+{
+  fprintf(out, "device,event,start_ms,end_ms,elapsed,duration_s,value\n");
+  size_t written = 0;
+  for (size_t r = 0; r < runs.size(); r++)
+  {
+    const EcgRun &run = runs[r];
+    for (const EcgEvent &event : analyses[r].events)
+    {
+      if (written++ == limit)
+      {
+        fprintf(out, "...\n");
+        return;
+      }
+      uint64_t startMs = sampleMs(run, event.begin);
+      uint64_t endMs = sampleMs(run, event.end);
+      char elapsed[32];
+      formatElapsed(startMs - run.startMs, elapsed, sizeof(elapsed));
+      fprintf(out, "%016llx,%s,%llu,%llu,%s,%.1f,%.1f\n", (unsigned long long)run.deviceId,
+              eventKindName(event.kind), (unsigned long long)startMs, (unsigned long long)endMs, elapsed,
+              (endMs - startMs) / 1000.0, event.value);
+    }
+  }
+}
+
+// Compares the chunked beats of a run with one sequential pass over it
+static bool checkRun(const EcgRun &run, const std::vector<ChunkResult> &chunks, const AnalysisOptions &options)
+{
+  ChunkResult whole;
+  analyzeChunk(run, 0, run.samples, options, whole);
+
+  std::vector<DetectedBeat> chunked;
+  for (const ChunkResult &chunk : chunks)
+    chunked.insert(chunked.end(), chunk.beats.begin(), chunk.beats.end());
+
+  size_t mismatches = chunked.size() > whole.beats.size() ? chunked.size() - whole.beats.size()
+                                                          : whole.beats.size() - chunked.size();
+  float worstQuality = 0;
+  for (size_t i = 0; i < std::min(chunked.size(), whole.beats.size()); i++)
+  {
+    if (chunked[i].sample != whole.beats[i].sample)
+      mismatches++;
+    else
+      worstQuality = std::max(worstQuality, std::fabs(chunked[i].quality - whole.beats[i].quality));
+  }
+  printf("  check %016llx: %zu beats sequential, %zu chunked, %zu mismatches, max SQI difference %.4f\n",
+         (unsigned long long)run.deviceId, whole.beats.size(), chunked.size(), mismatches, worstQuality);
+  return mismatches == 0;
+}
+
+int main(int argc, char **argv)
+{
+  AnalysisOptions options;
+  int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  std::string minutesPath;
+  std::string eventsPath;
+  bool verify = false;
+  bool check = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--verify") == 0)
+      verify = true;
+    else if (strcmp(argv[i], "--check") == 0)
+      check = true;
+    else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+      threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--chunk-minutes") == 0 && hasValue)
+      options.chunkMinutes = (uint32_t)atoi(argv[++i]);
+    else if (strcmp(argv[i], "--warmup-seconds") == 0 && hasValue)
+      options.warmupSeconds = (uint32_t)atoi(argv[++i]);
+    else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+      options.threshold = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--minutes") == 0 && hasValue)
+      minutesPath = argv[++i];
+    else if (strcmp(argv[i], "--events") == 0 && hasValue)
+      eventsPath = argv[++i];
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+    else
+      paths.push_back(argv[i]);
+  }
+  if (paths.empty())
+  {
+    fprintf(stderr, "usage: %s [--threads N] [--chunk-minutes 5] [--warmup-seconds 10] [--threshold 2000] "
+                    "[--minutes FILE.csv] [--events FILE.csv] [--verify] [--check] SEGMENT|DIR ...\n",
+            argv[0]);
+    return 2;
+  }
+
+  auto openStart = std::chrono::steady_clock::now();
+  EcgRecording recording;
+  if (!recording.open(paths))
+  {
+    fprintf(stderr, "no ECG segments found\n");
+    return 1;
+  }
+  const std::vector<EcgRun> &runs = recording.runs();
+  double recordedHours = 0;
+  for (const EcgRun &run : runs)
+    recordedHours += (double)run.samples / run.sampleRateHz / 3600.0;
+  printf("%zu segments in %zu runs: %.2f h of ECG, %llu samples, %.1f MB mapped (%.3f s)\n",
+         recording.segments().size(), runs.size(), recordedHours, (unsigned long long)recording.totalSamples(),
+         recording.mappedBytes() / 1e6, seconds(openStart));
+
+  WorkStealingPool pool((size_t)std::max(1, threads));
+  int status = 0;
+
+  if (verify)
+  {
+    std::atomic<int> corrupt(0);
+    std::vector<WorkStealingPool::Task> tasks;
+    for (const std::unique_ptr<EcgSegment> &segment : recording.segments())
+    {
+      const EcgSegment *target = segment.get();
+      tasks.push_back([target, &corrupt]() {
+        if (!EcgRecording::verify(*target))
+        {
+          fprintf(stderr, "%s: samples CRC mismatch\n", target->path.c_str());
+          corrupt++;
+        }
+      });
+    }
+    auto verifyStart = std::chrono::steady_clock::now();
+    pool.run(tasks);
+    printf("Verified %zu segments: %d corrupt (%.3f s)\n", tasks.size(), corrupt.load(), seconds(verifyStart));
+    if (corrupt > 0)
+      status = 1;
+  }
+
+  // One task per chunk; results land in per-run slots, merged afterwards
+  std::vector<std::vector<ChunkResult>> results(runs.size());
+  std::vector<WorkStealingPool::Task> tasks;
+  for (size_t r = 0; r < runs.size(); r++)
+  {
+    std::vector<SampleSpan> chunks = chunkRun(runs[r], options);
+    results[r].resize(chunks.size());
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+      const EcgRun *run = &runs[r];
+      ChunkResult *result = &results[r][c];
+      SampleSpan span = chunks[c];
+      tasks.push_back([run, result, span, &options]() { analyzeChunk(*run, span.begin, span.end, options, *result); });
+    }
+  }
+
+  auto analyzeStart = std::chrono::steady_clock::now();
+  pool.run(tasks);
+  double analyzeSeconds = seconds(analyzeStart);
+
+  auto mergeStart = std::chrono::steady_clock::now();
+  std::vector<RunAnalysis> analyses(runs.size());
+  for (size_t r = 0; r < runs.size(); r++)
+    mergeRun(runs[r], results[r], options, analyses[r]);
+  double mergeSeconds = seconds(mergeStart);
+
+  printf("Analyzed %zu chunks on %zu threads in %.3f s (merge %.3f s): %.1f M samples/s, %.0fx real time, "
+         "%llu steals\n",
+         tasks.size(), pool.threadCount(), analyzeSeconds, mergeSeconds,
+         recording.totalSamples() / analyzeSeconds / 1e6, recordedHours * 3600 / (analyzeSeconds + mergeSeconds),
+         (unsigned long long)pool.stealCount());
+
+  size_t eventCounts[EVENT_LOW_QUALITY + 1] = {0};
+  for (size_t r = 0; r < runs.size(); r++)
+  {
+    const EcgRun &run = runs[r];
+    const RunAnalysis &analysis = analyses[r];
+    printf("Device %016llx from %llu ms: %.2f h, %llu beats (%llu valid), mean HR %.1f, SDNN %.1f ms, "
+           "RMSSD %.1f ms, pNN50 %.1f%%, leads off %.2f%%\n",
+           (unsigned long long)run.deviceId, (unsigned long long)run.startMs,
+           (double)run.samples / run.sampleRateHz / 3600.0, (unsigned long long)analysis.beats,
+           (unsigned long long)analysis.validBeats, analysis.hrv.meanRate(), analysis.hrv.sdnn(),
+           analysis.hrv.rmssd(), analysis.hrv.pnn50(), 100.0 * analysis.leadsOffSamples / run.samples);
+    for (const EcgEvent &event : analysis.events)
+      eventCounts[event.kind]++;
+  }
+  printf("Events:");
+  for (int kind = EVENT_LEADS_OFF; kind <= EVENT_LOW_QUALITY; kind++)
+    printf(" %s %zu", eventKindName((EcgEventKind)kind), eventCounts[kind]);
+  printf("\n");
+
+  if (eventsPath.empty())
+    writeEvents(stdout, runs, analyses, 50);
+
+  auto writeCsv = [&](const std::string &path, bool minutes) {
+    FILE *out = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (!out)
+    {
+      perror(path.c_str());
+      status = 1;
+      return;
+    }
+    if (minutes)
+      writeMinutes(out, runs, analyses);
+    else
+      writeEvents(out, runs, analyses, (size_t)-1);
+    if (out != stdout)
+      fclose(out);
+  };
+  if (!minutesPath.empty())
+    writeCsv(minutesPath, true);
+  if (!eventsPath.empty())
+    writeCsv(eventsPath, false);
+
+  if (check)
+  {
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+      if (!checkRun(runs[r], results[r], options))
+        status = 1;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,145 @@
+/*
+ * VitalCare Rural Analyzer - Synthetic ECG Recording
+ *
+ * Writes a multi-hour raw ECG recording as EcgRecording.h segment files,
+ * the way a device recording to SD would, from SimulatedEcg. A fixed script
+ * of episodes is placed at fractions of the recording so every analyzer
+ * event kind occurs: tachycardia, bradycardia, sinus pauses, a noise burst
+ * and leads-off stretches. The expected events and the true beat count are
+ * printed for comparison with vitalcare-ecg-analyze.
+ *
+ * Usage: vitalcare-ecg-synth --dir DIR [--hours 24] [--rate 500]
+ *                            [--segment-minutes 60] [--bpm 72] [--device ID]
+ *                            [--seed 1]
+ */
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "SimulatedEcg.h"
+
+using namespace vitalcare;
+using namespace vitalcare::sim;
+
+static const char *episodeName(EcgEpisode::Kind kind)
+{
+  switch (kind)
+  {
+  case EcgEpisode::RATE:
+    return "rate";
+  case EcgEpisode::PAUSE:
+    return "pause";
+  case EcgEpisode::NOISE:
+    return "noise";
+  case EcgEpisode::LEADS_OFF:
+    return "leads_off";
+  }
+  return "unknown";
+}
+
+int main(int argc, char **argv)
+{
+  std::string dir;
+  double hours = 24;
+  int rate = 500;
+  int segmentMinutes = 60;
+  float bpm = 72;
+  uint64_t deviceId = 0x5643000000000001ull;
+  uint32_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--dir") == 0)
+      dir = argv[i + 1];
+    else if (strcmp(argv[i], "--hours") == 0)
+      hours = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--rate") == 0)
+      rate = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--segment-minutes") == 0)
+      segmentMinutes = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--bpm") == 0)
+      bpm = (float)atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--device") == 0)
+      deviceId = strtoull(argv[i + 1], nullptr, 0);
+    else if (strcmp(argv[i], "--seed") == 0)
+      seed = (uint32_t)atoi(argv[i + 1]);
+  }
+  if (dir.empty() || hours <= 0 || rate < 50 || rate > 2000 || segmentMinutes < 1)
+  {
+    fprintf(stderr, "usage: %s --dir DIR [--hours 24] [--rate 500] [--segment-minutes 60] [--bpm 72] "
+                    "[--device ID] [--seed 1]\n",
+            argv[0]);
+    return 2;
+  }
+  mkdir(dir.c_str(), 0755);
+
+  double total = hours * 3600;
+  const EcgEpisode SCRIPT[] = {
+      {EcgEpisode::RATE, 0.25 * total, 20 * 60, 132},
+      {EcgEpisode::PAUSE, 0.40 * total, 3, 2600},
+      {EcgEpisode::PAUSE, 0.41 * total, 3, 3100},
+      {EcgEpisode::LEADS_OFF, 0.50 * total, 90, 0},
+      {EcgEpisode::RATE, 0.60 * total, 15 * 60, 44},
+      {EcgEpisode::NOISE, 0.70 * total, 5 * 60, 260},
+      {EcgEpisode::PAUSE, 0.75 * total, 3, 2200},
+      {EcgEpisode::LEADS_OFF, 0.85 * total, 20, 0},
+  };
+  SimulatedEcg ecg((uint16_t)rate, bpm, seed);
+  printf("Script (recording %.1f h at %d Hz, %.0f BPM resting):\n", hours, rate, bpm);
+  for (const EcgEpisode &episode : SCRIPT)
+  {
+    ecg.addEpisode(episode);
+    printf("  %-10s at %9.1f s for %6.1f s  value %.0f\n", episodeName(episode.kind), episode.startSeconds,
+           episode.durationSeconds, episode.value);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t samples = (uint64_t)(total * rate);
+  uint64_t perSegment = (uint64_t)segmentMinutes * 60 * rate;
+  std::vector<int16_t> buffer;
+  uint8_t header[ECG_SEGMENT_HEADER_SIZE];
+  uint32_t segments = 0;
+  for (uint64_t first = 0; first < samples; first += perSegment, segments++)
+  {
+    size_t count = (size_t)std::min(perSegment, samples - first);
+    buffer.resize(count);
+    ecg.generate(buffer.data(), count);
+
+    EcgSegmentHeader segment;
+    segment.adcBits = 12;
+    segment.sampleRateHz = (uint16_t)rate;
+    segment.deviceId = deviceId;
+    segment.segmentIndex = segments;
+    segment.sampleCount = (uint32_t)count;
+    segment.startMs = ecgSampleTimeMs(0, first, (uint16_t)rate);
+    segment.samplesCrc = crc32((const uint8_t *)buffer.data(), count * sizeof(int16_t));
+    encodeEcgSegmentHeader(segment, header);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/ecg-%06u.vce", segments);
+    std::string path = dir + name;
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file || fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(buffer.data(), sizeof(int16_t), count, file) != count)
+    {
+      perror(path.c_str());
+      return 1;
+    }
+    fclose(file);
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("Wrote %u segments, %llu samples (%.1f MB) in %.2f s\n", segments, (unsigned long long)samples,
+         samples * 2.0 / 1e6, elapsed);
+  printf("True beats: %llu (%llu under leads-off or noise)\n", (unsigned long long)ecg.beatCount(),
+         (unsigned long long)ecg.maskedBeatCount());
+  return 0;
+}
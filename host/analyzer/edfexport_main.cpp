@@ -0,0 +1,264 @@
+/*
+ * VitalCare Rural Analyzer - EDF+ Export
+ *
+ * Converts raw ECG recordings (EcgRecording.h segment files) into EDF+
+ * files for standard viewers, one per continuous run. Samples are read
+ * from the memory-mapped segments a record at a time and streamed through
+ * EdfWriter, so memory use does not grow with the recording. Leads-off
+ * stretches are annotated from the samples themselves (and written as
+ * midscale, not as the ECG_LEADS_OFF marker); --events adds the alerts of
+ * a vitalcare-ecg-analyze events CSV as annotations.
+ *
+ * Usage: vitalcare-edf-export --out DIR [--record-seconds 1]
+ *                             [--events FILE.csv] [--patient CODE]
+ *                             [--name NAME] [--sex M|F] SEGMENT|DIR ...
+ */
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Recording.h"
+
+using namespace vitalcare;
+using namespace vitalcare::analyzer;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+class FileEdfOutput : public EdfOutput
+{
+public:
+  explicit FileEdfOutput(FILE *file) : file(file) {}
+
+  bool write(const uint8_t *data, size_t length) override { return fwrite(data, 1, length, file) == length; }
+  bool seek(uint64_t offset) override { return fseeko(file, (off_t)offset, SEEK_SET) == 0; }
+
+private:
+  FILE *file;
+};
+
+struct AlertEvent
+{
+  uint64_t deviceId;
+  std::string kind;
+  uint64_t startMs;
+  uint64_t endMs;
+};
+
+// Alerts from a vitalcare-ecg-analyze events CSV; leads_off rows are left
+// out (the samples show those)
+static bool readEvents(const std::string &path, std::vector<AlertEvent> &events)
+{
+  FILE *in = fopen(path.c_str(), "r");
+  if (!in)
+  {
+    perror(path.c_str());
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), in))
+  {
+    unsigned long long deviceId, startMs, endMs;
+    char kind[32];
+    if (sscanf(line, "%llx,%31[^,],%llu,%llu", &deviceId, kind, &startMs, &endMs) == 4 &&
+        strcmp(kind, "leads_off") != 0)
+      events.push_back(AlertEvent{deviceId, kind, startMs, endMs});
+  }
+  fclose(in);
+  std::sort(events.begin(), events.end(),
+            [](const AlertEvent &a, const AlertEvent &b) { return a.startMs < b.startMs; });
+  return true;
+}
+
+struct ExportStats
+{
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+  uint64_t leadsOff = 0;
+  uint64_t alerts = 0;
+};
+
+static bool exportRun(const EcgRun &run, const std::string &path, uint32_t recordMs, const EdfRecordingInfo &info,
+                      const std::vector<AlertEvent> &events, ExportStats &stats)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    perror(path.c_str());
+    return false;
+  }
+  static char fileBuffer[1 << 20];
+  setvbuf(file, fileBuffer, _IOFBF, sizeof(fileBuffer));
+  FileEdfOutput output(file);
+
+  // AD8232: gain 100 around midscale of a 3.3 V ADC, so full scale is +-16.5 mV
+  uint8_t adcBits = run.segments.front()->header.adcBits;
+  if (adcBits == 0 || adcBits > 15)
+    adcBits = 12;
+  int16_t midscale = (int16_t)(1 << (adcBits - 1));
+  uint16_t perRecord = (uint16_t)((uint64_t)run.sampleRateHz * recordMs / 1000);
+  EdfSignal ecg = {"ECG",  "AD8232 chest electrodes", "mV", -16.5f, 16.5f, 0, (int16_t)((1 << adcBits) - 1),
+                   "HP:0.5Hz LP:40Hz", perRecord};
+
+  std::vector<uint8_t> record(perRecord * 2u + EDF_DEFAULT_ANNOTATION_BYTES);
+  EdfWriter edf(output, record.data(), record.size());
+  edf.addSignal(ecg);
+  if (!edf.begin(info, recordMs))
+  {
+    fprintf(stderr, "%s: cannot write the header\n", path.c_str());
+    fclose(file);
+    return false;
+  }
+
+  std::vector<int16_t> samples(perRecord);
+  size_t nextEvent = 0;
+  bool leadsOff = false;
+  uint64_t leadsOffStart = 0;
+  uint64_t runEnd = run.samples - run.samples % perRecord; // EDF+C takes whole records only
+  for (uint64_t first = 0; first < runEnd; first += perRecord)
+  {
+    size_t filled = 0;
+    run.forEachSpan(first, first + perRecord, [&](const int16_t *span, size_t count, uint64_t index) {
+      for (size_t i = 0; i < count; i++)
+      {
+        bool off = span[i] == ECG_LEADS_OFF;
+        if (off != leadsOff)
+        {
+          uint64_t atMs = ecgSampleTimeMs(0, index + i, run.sampleRateHz);
+          if (off)
+            leadsOffStart = atMs;
+          else if (edf.annotate((uint32_t)leadsOffStart, (uint32_t)(atMs - leadsOffStart), "Leads off"))
+            stats.leadsOff++;
+          leadsOff = off;
+        }
+        samples[filled + i] = off ? midscale : span[i];
+      }
+      filled += count;
+    });
+    edf.addSamples(0, samples.data(), filled);
+
+    uint64_t recordEndMs = run.startMs + ecgSampleTimeMs(0, first + perRecord, run.sampleRateHz);
+    while (nextEvent < events.size() && events[nextEvent].startMs < recordEndMs)
+    {
+      const AlertEvent &event = events[nextEvent++];
+      if (event.deviceId != run.deviceId || event.startMs < run.startMs)
+        continue;
+      char text[EDF_MAX_ANNOTATION_TEXT + 1];
+      snprintf(text, sizeof(text), "Alert: %s", event.kind.c_str());
+      if (edf.annotate((uint32_t)(event.startMs - run.startMs), (uint32_t)(event.endMs - event.startMs), text))
+        stats.alerts++;
+    }
+    edf.endRecord();
+  }
+  if (leadsOff && edf.annotate((uint32_t)leadsOffStart,
+                               (uint32_t)(ecgSampleTimeMs(0, runEnd, run.sampleRateHz) - leadsOffStart),
+                               "Leads off"))
+    stats.leadsOff++;
+
+  bool ok = edf.close();
+  stats.records += edf.records();
+  stats.bytes += edf.headerSize() + (uint64_t)edf.records() * edf.recordSize();
+  if (fclose(file) != 0 || !ok)
+  {
+    perror(path.c_str());
+    return false;
+  }
+  if (edf.annotationsDropped())
+    fprintf(stderr, "%s: %u annotations did not fit\n", path.c_str(), edf.annotationsDropped());
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  std::string outDir;
+  std::string eventsPath;
+  double recordSeconds = 1;
+  std::string patient, name;
+  char sex = 0;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--out") == 0 && hasValue)
+      outDir = argv[++i];
+    else if (strcmp(argv[i], "--events") == 0 && hasValue)
+      eventsPath = argv[++i];
+    else if (strcmp(argv[i], "--record-seconds") == 0 && hasValue)
+      recordSeconds = atof(argv[++i]);
+    else if (strcmp(argv[i], "--patient") == 0 && hasValue)
+      patient = argv[++i];
+    else if (strcmp(argv[i], "--name") == 0 && hasValue)
+      name = argv[++i];
+    else if (strcmp(argv[i], "--sex") == 0 && hasValue)
+      sex = argv[++i][0];
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+    else
+      paths.push_back(argv[i]);
+  }
+  uint32_t recordMs = (uint32_t)(recordSeconds * 1000 + 0.5);
+  if (paths.empty() || outDir.empty() || recordMs == 0)
+  {
+    fprintf(stderr, "usage: %s --out DIR [--record-seconds 1] [--events FILE.csv] [--patient CODE] [--name NAME] "
+                    "[--sex M|F] SEGMENT|DIR ...\n",
+            argv[0]);
+    return 2;
+  }
+  mkdir(outDir.c_str(), 0755);
+
+  std::vector<AlertEvent> events;
+  if (!eventsPath.empty() && !readEvents(eventsPath, events))
+    return 1;
+
+  EcgRecording recording;
+  if (!recording.open(paths))
+  {
+    fprintf(stderr, "no ECG segments found\n");
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  ExportStats stats;
+  int status = 0;
+  size_t index = 0;
+  for (const EcgRun &run : recording.runs())
+  {
+    uint64_t perRecord = (uint64_t)run.sampleRateHz * recordMs / 1000;
+    if (perRecord == 0 || perRecord * 2 + EDF_DEFAULT_ANNOTATION_BYTES > 61440 ||
+        perRecord * 1000 != (uint64_t)run.sampleRateHz * recordMs)
+    {
+      fprintf(stderr, "run %zu: %u Hz does not fit whole %u ms records\n", index++, run.sampleRateHz, recordMs);
+      status = 1;
+      continue;
+    }
+    char equipment[48];
+    snprintf(equipment, sizeof(equipment), "VitalCare-%016llx", (unsigned long long)run.deviceId);
+    EdfRecordingInfo info = {patient.c_str(), sex, name.c_str(), equipment, 0, 0, 0, 0, 0, 0};
+    char file[64];
+    snprintf(file, sizeof(file), "/%016llx-%03zu.edf", (unsigned long long)run.deviceId, index++);
+    if (!exportRun(run, outDir + file, recordMs, info, events, stats))
+      status = 1;
+  }
+  double elapsed = seconds(start);
+
+  printf("📤 %zu runs, %.1f MB of segments -> %llu EDF+ records, %.1f MB in %.3f s: %.1f MB/s read, "
+         "%llu leads-off and %llu alert annotations\n",
+         recording.runs().size(), recording.mappedBytes() / 1e6, (unsigned long long)stats.records,
+         stats.bytes / 1e6, elapsed, recording.mappedBytes() / elapsed / 1e6, (unsigned long long)stats.leadsOff,
+         (unsigned long long)stats.alerts);
+  return status;
+}
@@ -0,0 +1,119 @@
+/*
+ * VitalCare Rural Analyzer - SD Record Log Decoder
+ *
+ * Converts the files of SD cards returned from the field - record log
+ * segments (RecordLog.h), esp32-main's trend CSVs, flash history logs and
+ * EDF+ recordings - into per-patient CSV, columnar and event files
+ * (RecordLogDecoder.h). Files are decoded in parallel on a work-stealing
+ * pool, one task per file, and the throughput is reported in MB/s and
+ * GB/min.
+ *
+ * Usage: vitalcare-sdlog-decode --out DIR [--threads N] [--no-csv]
+ *                               [--no-columns] FILE|DIR ...
+ */
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RecordLogDecoder.h"
+#include "WorkStealingPool.h"
+
+using namespace vitalcare;
+using namespace vitalcare::analyzer;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+  int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  std::string outDir;
+  RecordLogOptions options;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--no-csv") == 0)
+      options.csv = false;
+    else if (strcmp(argv[i], "--no-columns") == 0)
+      options.columns = false;
+    else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+      threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--out") == 0 && hasValue)
+      outDir = argv[++i];
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+    else
+      paths.push_back(argv[i]);
+  }
+  if (paths.empty() || outDir.empty())
+  {
+    fprintf(stderr, "usage: %s --out DIR [--threads N] [--no-csv] [--no-columns] FILE|DIR ...\n", argv[0]);
+    return 2;
+  }
+  mkdir(outDir.c_str(), 0755);
+
+  std::vector<std::string> files = RecordLogDecoder::listFiles(paths);
+  if (files.empty())
+  {
+    fprintf(stderr, "no record logs, trend CSVs, history logs or EDF+ files found\n");
+    return 1;
+  }
+
+  RecordLogDecoder decoder(outDir, options);
+  WorkStealingPool pool((size_t)std::max(1, threads));
+  std::vector<RecordLogCounters> results(files.size());
+  std::vector<WorkStealingPool::Task> tasks;
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    const std::string *path = &files[i];
+    RecordLogCounters *result = &results[i];
+    tasks.push_back([&decoder, path, result]() { decoder.decodeFile(*path, *result); });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  pool.run(tasks);
+  bool written = decoder.finish();
+  double elapsed = seconds(start);
+
+  RecordLogCounters total;
+  for (const RecordLogCounters &result : results)
+    total.add(result);
+  printf("📼 %llu files (%llu unreadable), %.1f MB on %zu threads in %.3f s: %.1f MB/s, %.2f GB/min, "
+         "%llu steals\n",
+         (unsigned long long)total.files, (unsigned long long)total.badFiles, total.bytes / 1e6,
+         pool.threadCount(), elapsed, total.bytes / elapsed / 1e6, total.bytes / elapsed * 60 / 1e9,
+         (unsigned long long)pool.stealCount());
+  printf("Files: %llu segments, %llu trend CSVs, %llu history logs, %llu EDF+ recordings (%llu records, "
+         "%llu annotations)\n",
+         (unsigned long long)total.segments, (unsigned long long)total.trendFiles,
+         (unsigned long long)total.historyLogs, (unsigned long long)total.recordings,
+         (unsigned long long)total.edfRecords, (unsigned long long)total.events);
+  printf("Records: %llu vitals, %llu patient records, %llu dropped -> %zu patients in %s\n",
+         (unsigned long long)total.vitals, (unsigned long long)total.patients, (unsigned long long)total.dropped,
+         decoder.patientCount(), outDir.c_str());
+  printf("Blocks: %llu good, %llu damaged (%llu records salvaged), %llu lost, %llu unwritten\n",
+         (unsigned long long)total.blocks, (unsigned long long)total.damagedBlocks,
+         (unsigned long long)total.salvaged, (unsigned long long)total.lostBlocks,
+         (unsigned long long)total.unwrittenBlocks);
+
+  if (!written)
+  {
+    fprintf(stderr, "❌ writing the outputs failed\n");
+    return 1;
+  }
+  return 0;
+}
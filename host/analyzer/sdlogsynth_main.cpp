@@ -0,0 +1,261 @@
+/*
+ * VitalCare Rural Analyzer - Synthetic SD Record Logs
+ *
+ * Writes the record log segments (RecordLog.h) a fleet of devices would
+ * leave on their SD cards: 1 reading per --interval seconds for --days,
+ * patient sessions changing about --sessions-per-day times a day, every
+ * fifth device starting with no patient. A --damage share of vitals blocks
+ * gets one byte flipped (the block CRC fails and exactly one record with
+ * it), and each device's last segment is preallocated to full size with
+ * zeros. The counts vitalcare-sdlog-decode should report are printed.
+ *
+ * Usage: vitalcare-sdlog-synth --dir DIR [--devices 20] [--days 7]
+ *                              [--interval 1] [--segment-mb 16]
+ *                              [--sessions-per-day 2] [--damage 0.0005]
+ *                              [--seed 1]
+ */
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+using namespace vitalcare;
+
+struct SynthTotals
+{
+  uint64_t vitals = 0;
+  uint64_t patients = 0;
+  uint64_t damaged = 0;
+  uint64_t unwritten = 0;
+  uint64_t segments = 0;
+  uint64_t bytes = 0;
+};
+
+// One device's log: fills blocks, rolls segments at blocksPerSegment
+class SegmentWriter
+{
+public:
+  SegmentWriter(const std::string &dir, uint64_t deviceId, uint64_t blocksPerSegment, SynthTotals &totals)
+      : dir(dir), deviceId(deviceId), blocksPerSegment(blocksPerSegment), totals(totals)
+  {
+  }
+
+  bool write(const uint8_t *block, const char *activePatient)
+  {
+    if (!file || blocksInSegment == blocksPerSegment)
+    {
+      if (!close() || !open(activePatient))
+        return false;
+    }
+    buffer.insert(buffer.end(), block, block + RECORD_LOG_BLOCK_SIZE);
+    blocksInSegment++;
+    nextSequence++;
+    return buffer.size() < (1u << 20) || drain();
+  }
+
+  uint32_t sequence() const { return nextSequence; }
+
+  // preallocate: zero-fill the open segment to its full size first
+  bool close(bool preallocate = false)
+  {
+    if (!file)
+      return true;
+    if (preallocate)
+    {
+      totals.unwritten += blocksPerSegment - blocksInSegment;
+      buffer.resize(buffer.size() + (blocksPerSegment - blocksInSegment) * RECORD_LOG_BLOCK_SIZE, 0);
+    }
+    bool ok = drain() && fclose(file) == 0;
+    file = nullptr;
+    return ok;
+  }
+
+private:
+  bool open(const char *activePatient)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx-%06u.vcl", (unsigned long long)deviceId, segmentIndex);
+    path = dir + name;
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+      perror(path.c_str());
+      return false;
+    }
+    RecordLogHeader header = {};
+    header.deviceId = deviceId;
+    header.segmentIndex = segmentIndex++;
+    header.firstBlockSequence = nextSequence;
+    header.openedMs = 0;
+    strncpy(header.patientId, activePatient, PATIENT_ID_LENGTH);
+    buffer.assign(RECORD_LOG_BLOCK_SIZE, 0);
+    encodeRecordLogHeader(header, buffer.data());
+    blocksInSegment = 0;
+    totals.segments++;
+    return true;
+  }
+
+  bool drain()
+  {
+    if (!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+    {
+      perror(path.c_str());
+      return false;
+    }
+    totals.bytes += buffer.size();
+    buffer.clear();
+    return true;
+  }
+
+  std::string dir;
+  std::string path;
+  uint64_t deviceId;
+  uint64_t blocksPerSegment;
+  SynthTotals &totals;
+  FILE *file = nullptr;
+  std::vector<uint8_t> buffer;
+  uint32_t segmentIndex = 0;
+  uint64_t blocksInSegment = 0;
+  uint32_t nextSequence = 1;
+};
+
+int main(int argc, char **argv)
+{
+  std::string dir;
+  int devices = 20;
+  double days = 7;
+  double interval = 1;
+  int segmentMb = 16;
+  double sessionsPerDay = 2;
+  double damage = 0.0005;
+  uint32_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--dir") == 0)
+      dir = argv[i + 1];
+    else if (strcmp(argv[i], "--devices") == 0)
+      devices = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--days") == 0)
+      days = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--interval") == 0)
+      interval = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--segment-mb") == 0)
+      segmentMb = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--sessions-per-day") == 0)
+      sessionsPerDay = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--damage") == 0)
+      damage = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--seed") == 0)
+      seed = (uint32_t)atoi(argv[i + 1]);
+  }
+  if (dir.empty() || devices < 1 || days <= 0 || interval <= 0 || segmentMb < 1)
+  {
+    fprintf(stderr, "usage: %s --dir DIR [--devices 20] [--days 7] [--interval 1] [--segment-mb 16] "
+                    "[--sessions-per-day 2] [--damage 0.0005] [--seed 1]\n",
+            argv[0]);
+    return 2;
+  }
+  mkdir(dir.c_str(), 0755);
+
+  auto start = std::chrono::steady_clock::now();
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  uint64_t readings = (uint64_t)(days * 86400 / interval);
+  uint64_t blocksPerSegment = (uint64_t)segmentMb * (1 << 20) / RECORD_LOG_BLOCK_SIZE - 1;
+  double switchChance = sessionsPerDay * interval / 86400;
+  SynthTotals totals;
+  uint8_t block[RECORD_LOG_BLOCK_SIZE];
+
+  for (int d = 0; d < devices; d++)
+  {
+    uint64_t deviceId = 0x5643000000000001ull + (uint64_t)d;
+    SegmentWriter writer(dir, deviceId, blocksPerSegment, totals);
+    char activePatient[PATIENT_ID_LENGTH + 1] = "";
+    uint32_t sequence = 0;
+    int sessions = 0;
+    float heartRate = 72, systolic = 118, diastolic = 78, spO2 = 97.5f, temperature = 98.4f;
+
+    RecordLogBlockWriter vitals(block, UPLINK_VITAL_RECORDS, writer.sequence());
+    auto writeVitals = [&]() {
+      if (vitals.count() == 0)
+        return true;
+      uint8_t count = vitals.count();
+      vitals.finish();
+      if (unit(random) < damage)
+      {
+        size_t r = (size_t)(unit(random) * count) % count;
+        block[RECORD_LOG_BLOCK_HEADER_SIZE + r * VITAL_RECORD_SIZE + 4 + (size_t)(unit(random) * 18)] ^= 0x5A;
+        totals.damaged++;
+      }
+      bool ok = writer.write(block, activePatient);
+      vitals = RecordLogBlockWriter(block, UPLINK_VITAL_RECORDS, writer.sequence());
+      return ok;
+    };
+
+    for (uint64_t i = 0; i < readings; i++)
+    {
+      bool first = i == 0 && d % 5 != 4;
+      if (first || unit(random) < switchChance)
+      {
+        if (!writeVitals())
+          return 1;
+        PatientRecord patient = {};
+        patient.sequence = ++sequence;
+        snprintf(patient.patientId, sizeof(patient.patientId), "VC-%03d-%04d", d % 1000, ++sessions % 10000);
+        snprintf(patient.name, sizeof(patient.name), "Patient %d/%d", d, sessions);
+        patient.age = (uint8_t)(20 + (d * 7 + sessions * 13) % 60);
+        patient.gender = sessions % 2 ? 'F' : 'M';
+        patient.sessionStartMs = (uint32_t)(i * interval * 1000);
+        RecordLogBlockWriter patients(block, UPLINK_PATIENT_RECORDS, writer.sequence());
+        patients.add(patient);
+        patients.finish();
+        if (!writer.write(block, activePatient))
+          return 1;
+        vitals = RecordLogBlockWriter(block, UPLINK_VITAL_RECORDS, writer.sequence());
+        memcpy(activePatient, patient.patientId, sizeof(activePatient));
+        totals.patients++;
+      }
+
+      heartRate = std::min(180.0f, std::max(40.0f, heartRate + (float)(unit(random) - 0.5)));
+      systolic = std::min(190.0f, std::max(80.0f, systolic + (float)(unit(random) - 0.5) * 0.6f));
+      diastolic = std::min(120.0f, std::max(50.0f, diastolic + (float)(unit(random) - 0.5) * 0.4f));
+      spO2 = std::min(100.0f, std::max(85.0f, spO2 + (float)(unit(random) - 0.5) * 0.2f));
+      temperature = std::min(104.0f, std::max(96.0f, temperature + (float)(unit(random) - 0.5) * 0.05f));
+
+      VitalRecord record = {};
+      record.sequence = ++sequence;
+      record.vitals.heartRate = heartRate;
+      record.vitals.systolicBP = systolic;
+      record.vitals.diastolicBP = diastolic;
+      record.vitals.spO2 = spO2;
+      record.vitals.temperature = temperature;
+      record.vitals.timestampMs = (uint32_t)(i * interval * 1000);
+      record.recordFlags = unit(random) < 0.001 ? RECORD_LEADS_OFF : 0;
+      vitals.add(record);
+      totals.vitals++;
+      if (vitals.full() && !writeVitals())
+        return 1;
+    }
+    if (!writeVitals() || !writer.close(true))
+      return 1;
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("Wrote %llu segments of %d devices, %.1f MB in %.2f s\n", (unsigned long long)totals.segments, devices,
+         totals.bytes / 1e6, elapsed);
+  printf("Expect: %llu vitals (%llu written, %llu in damaged blocks dropped), %llu patient records, "
+         "%llu damaged blocks, %llu unwritten blocks\n",
+         (unsigned long long)(totals.vitals - totals.damaged), (unsigned long long)totals.vitals,
+         (unsigned long long)totals.damaged, (unsigned long long)totals.patients,
+         (unsigned long long)totals.damaged, (unsigned long long)totals.unwritten);
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * VitalCare Rural - Host Benchmark Harness
+ *
+ * Minimal Google-Benchmark-style harness with no dependencies:
+ *
+ *   static void BM_Something(vitalcare::bench::State &state)
+ *   {
+ *     while (state.keepRunning())
+ *     {
+ *       ...
+ *     }
+ *   }
+ *   VITALCARE_BENCHMARK(BM_Something);
+ *
+ * Each benchmark runs in batches until it has run for the minimum time and
+ * reports nanoseconds per iteration.
+ *
+ * Per-sample code with a hard cost budget registers it instead:
+ *
+ *   VITALCARE_BENCHMARK_BUDGET(BM_Something, 250); // ns per iteration
+ *
+ * and the runner exits non-zero if the budget is exceeded.
+ *
+ * The header has no host dependencies: the same benchmark sources also
+ * build into the firmware/esp32-bench image, whose runner counts CPU
+ * cycles instead of nanoseconds. Both runners write one formatResultJson()
+ * line per benchmark, in the layout of Google Benchmark's JSON reporter.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace vitalcare
+{
+namespace bench
+{
+
+class State
+{
+public:
+  explicit State(uint64_t iterations) : remaining(iterations), total(iterations), items(0) {}
+
+  bool keepRunning()
+  {
+    if (remaining == 0)
+    {
+      return false;
+    }
+    remaining--;
+    return true;
+  }
+
+  uint64_t iterations() const { return total; }
+
+  // Items processed per iteration (e.g. samples), for throughput reporting
+  void setItemsPerIteration(uint64_t count) { items = count; }
+  uint64_t itemsPerIteration() const { return items; }
+
+private:
+  uint64_t remaining;
+  uint64_t total;
+  uint64_t items;
+};
+
+typedef void (*BenchmarkFunction)(State &);
+
+struct Registration
+{
+  const char *name;
+  BenchmarkFunction function;
+  double budgetNs; // 0: no budget
+};
+
+inline std::vector<Registration> &registry()
+{
+  static std::vector<Registration> entries;
+  return entries;
+}
+
+struct Registrar
+{
+  Registrar(const char *name, BenchmarkFunction function, double budgetNs = 0)
+  {
+    registry().push_back({name, function, budgetNs});
+  }
+};
+
+// Prevents the optimiser from discarding a computed value
+template <typename T>
+inline void doNotOptimize(T const &value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void clobberMemory()
+{
+  asm volatile("" : : : "memory");
+}
+
+struct Result
+{
+  const char *name;
+  uint64_t iterations;
+  double realNs;             // Wall time per iteration
+  double cpuNs;              // CPU time per iteration (= realNs on the device)
+  double itemsPerSecond;     // 0: not reported
+  double budgetNs;           // 0: no budget
+  double cyclesPerIteration; // 0: not measured (host)
+};
+
+// One entry of the "benchmarks" array, without a trailing comma or newline.
+// Each entry stays on one line so baselines can be read back line by line.
+inline int formatResultJson(const Result &result, char *buffer, size_t capacity)
+{
+  int length = snprintf(buffer, capacity,
+                        "{\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", "
+                        "\"iterations\": %llu, \"real_time\": %.2f, \"cpu_time\": %.2f, \"time_unit\": \"ns\"",
+                        result.name, result.name, (unsigned long long)result.iterations, result.realNs,
+                        result.cpuNs);
+  if (length > 0 && (size_t)length < capacity && result.itemsPerSecond > 0)
+    length += snprintf(buffer + length, capacity - length, ", \"items_per_second\": %.0f", result.itemsPerSecond);
+  if (length > 0 && (size_t)length < capacity && result.budgetNs > 0)
+    length += snprintf(buffer + length, capacity - length, ", \"budget_ns\": %.0f", result.budgetNs);
+  if (length > 0 && (size_t)length < capacity && result.cyclesPerIteration > 0)
+    length += snprintf(buffer + length, capacity - length, ", \"cycles_per_iteration\": %.1f",
+                       result.cyclesPerIteration);
+  if (length > 0 && (size_t)length < capacity)
+    length += snprintf(buffer + length, capacity - length, "}");
+  return length;
+}
+
+} // namespace bench
+} // namespace vitalcare
+
+#define VITALCARE_BENCH_CONCAT2(a, b) a##b
+#define VITALCARE_BENCH_CONCAT(a, b) VITALCARE_BENCH_CONCAT2(a, b)
+// __COUNTER__, not __LINE__: the device runner includes several benchmark
+// sources into one translation unit
+#define VITALCARE_BENCHMARK(fn) \
+  static ::vitalcare::bench::Registrar VITALCARE_BENCH_CONCAT(registrar_, __COUNTER__)(#fn, fn)
+#define VITALCARE_BENCHMARK_BUDGET(fn, budgetNs) \
+  static ::vitalcare::bench::Registrar VITALCARE_BENCH_CONCAT(registrar_, __COUNTER__)(#fn, fn, budgetNs)
@@ -0,0 +1,229 @@
+/*
+ * VitalCare Rural - File System Workload
+ *
+ * Open, read and write latency of a file system as it fills, with the
+ * file sizes esp32-main uses: a 4 KB asset read whole, and 512-byte
+ * appends as the SD and flash logs make. The same workload runs on the
+ * ESP32 (esp32-bench, against SPIFFS and LittleFS on the flash partition)
+ * and on the host (vitalcare-fs-bench, against a directory), through an adapter:
+ *
+ *   struct Fs
+ *   {
+ *     uint64_t totalBytes();
+ *     uint64_t usedBytes();
+ *     bool write(const char *path, const uint8_t *data, size_t length, bool append);
+ *     bool read(const char *path, uint8_t *data, size_t length); // open, read, close
+ *     bool touch(const char *path);                              // open, close
+ *     bool remove(const char *path);
+ *     uint32_t micros();
+ *
+ *     // For runSegmentWorkload() only: one file held open
+ *     bool beginSegment(const char *path, uint32_t preallocate); // 0: empty
+ *     bool writeSegment(const uint8_t *data, size_t length);     // and flush
+ *     void endSegment();
+ *   };
+ *
+ * At each fill level the partition is first filled to that share of its
+ * size with 16 KB files; the fill files are removed at the end. Each
+ * operation is timed FS_OPERATION_RUNS times into a LatencyHistogram.
+ * Names are flat ("/bench-..."), as SPIFFS has no directories.
+ *
+ * runSegmentWorkload() is the SD writer's recording path at the current
+ * fill: a 2 MB EDF+ segment filled with 4 KB buffer writes, each flushed,
+ * once into a file that grows and allocates clusters as it goes (before)
+ * and once into a file preallocated whole (after), with the preallocation
+ * timed on its own.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <VitalCareCore.h>
+
+#include "Benchmark.h"
+
+namespace vitalcare
+{
+namespace bench
+{
+
+enum FsOperation : uint8_t
+{
+  FS_OPEN = 0,            // Open and close an existing file
+  FS_READ,                // Read a 4 KB file whole
+  FS_APPEND,              // Append 512 bytes to a growing file
+  FS_CREATE,              // Create a new 512-byte file
+  FS_SEGMENT_GROW,        // 4 KB write to a segment that grows
+  FS_SEGMENT_PREALLOCATE, // Preallocate a whole segment
+  FS_SEGMENT_WRITE,       // 4 KB write into a preallocated segment
+  FS_OPERATIONS
+};
+
+inline const char *fsOperationName(uint8_t operation)
+{
+  static const char *const NAMES[FS_OPERATIONS] = {"FS_Open",        "FS_Read",         "FS_Append",
+                                                   "FS_Create",      "FS_SegmentGrow",  "FS_SegmentPreallocate",
+                                                   "FS_SegmentWrite"};
+  return operation < FS_OPERATIONS ? NAMES[operation] : "FS_Unknown";
+}
+
+const uint8_t FS_FILL_LEVELS[] = {0, 25, 50, 75, 90}; // Percent of the partition
+const uint16_t FS_OPERATION_RUNS = 32;
+const size_t FS_FILL_FILE_BYTES = 16384;
+const size_t FS_READ_BYTES = 4096;
+const size_t FS_APPEND_BYTES = 512;
+const uint32_t FS_SEGMENT_BYTES = 2 * 1024 * 1024; // esp32-main's EDF_SEGMENT_BYTES
+const size_t FS_SEGMENT_WRITE_BYTES = 4096;        // One writer buffer
+
+struct FsResult
+{
+  uint8_t operation;
+  uint8_t targetFill; // Percent asked for
+  uint8_t fill;       // Percent reached (a full partition stops short)
+  uint16_t failures;
+  LatencyHistogram latency;
+};
+
+// One entry of the "benchmarks" array, as formatResultJson() writes, in
+// microseconds with the tail added: "FS_Append/littlefs/fill:75"
+inline int formatFsResultJson(const char *fsName, const FsResult &result, char *buffer, size_t capacity)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "%s/%s/fill:%u", fsOperationName(result.operation), fsName, result.targetFill);
+  return snprintf(buffer, capacity,
+                  "{\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", \"iterations\": %u, "
+                  "\"real_time\": %u, \"cpu_time\": %u, \"time_unit\": \"us\", \"p99_time\": %u, "
+                  "\"max_time\": %u, \"fill_percent\": %u, \"failures\": %u}",
+                  name, name, result.latency.count(), result.latency.averageUs(), result.latency.averageUs(),
+                  result.latency.percentileUs(99), result.latency.maxUs(), result.fill, result.failures);
+}
+
+// Runs the workload and hands each FsResult to emit as it is measured
+template <typename Fs, typename Emit>
+void runFsWorkload(Fs &fs, Emit emit)
+{
+  static uint8_t data[FS_FILL_FILE_BYTES];
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)(i * 131 + 7);
+
+  char path[32];
+  uint32_t fillFiles = 0;
+  uint32_t created = 0;
+  fs.write("/bench-read", data, FS_READ_BYTES, false);
+  fs.remove("/bench-append");
+  for (uint8_t level : FS_FILL_LEVELS)
+  {
+    uint64_t target = fs.totalBytes() * level / 100;
+    while (fs.usedBytes() < target)
+    {
+      snprintf(path, sizeof(path), "/bench-fill-%05u", (unsigned)fillFiles);
+      if (!fs.write(path, data, FS_FILL_FILE_BYTES, false))
+        break;
+      fillFiles++;
+    }
+    uint8_t fill = fs.totalBytes() ? (uint8_t)(fs.usedBytes() * 100 / fs.totalBytes()) : 0;
+
+    for (uint8_t operation = 0; operation <= FS_CREATE; operation++)
+    {
+      FsResult result;
+      result.operation = operation;
+      result.targetFill = level;
+      result.fill = fill;
+      result.failures = 0;
+      for (uint16_t run = 0; run < FS_OPERATION_RUNS; run++)
+      {
+        bool ok = false;
+        uint32_t start = fs.micros();
+        switch (operation)
+        {
+        case FS_OPEN:
+          ok = fs.touch("/bench-read");
+          break;
+        case FS_READ:
+          ok = fs.read("/bench-read", data, FS_READ_BYTES);
+          break;
+        case FS_APPEND:
+          ok = fs.write("/bench-append", data, FS_APPEND_BYTES, true);
+          break;
+        case FS_CREATE:
+          snprintf(path, sizeof(path), "/bench-new-%05u", (unsigned)created++);
+          ok = fs.write(path, data, FS_APPEND_BYTES, false);
+          break;
+        }
+        uint32_t elapsed = fs.micros() - start;
+        if (ok)
+          result.latency.record(elapsed);
+        else
+          result.failures++;
+      }
+      emit(result);
+    }
+  }
+
+  for (uint32_t i = 0; i < fillFiles; i++)
+  {
+    snprintf(path, sizeof(path), "/bench-fill-%05u", (unsigned)i);
+    fs.remove(path);
+  }
+  for (uint32_t i = 0; i < created; i++)
+  {
+    snprintf(path, sizeof(path), "/bench-new-%05u", (unsigned)i);
+    fs.remove(path);
+  }
+  fs.remove("/bench-read");
+  fs.remove("/bench-append");
+}
+
+// Runs the segment operations at the file system's current fill; no fill
+// files are written, so it suits a whole SD card
+template <typename Fs, typename Emit>
+void runSegmentWorkload(Fs &fs, Emit emit)
+{
+  static uint8_t data[FS_SEGMENT_WRITE_BYTES];
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)(i * 131 + 7);
+  uint8_t fill = fs.totalBytes() ? (uint8_t)(fs.usedBytes() * 100 / fs.totalBytes()) : 0;
+
+  for (uint8_t operation : {FS_SEGMENT_GROW, FS_SEGMENT_WRITE})
+  {
+    FsResult result;
+    result.operation = operation;
+    result.targetFill = fill;
+    result.fill = fill;
+    result.failures = 0;
+    fs.remove("/bench-segment");
+    bool preallocate = operation == FS_SEGMENT_WRITE;
+    uint32_t start = fs.micros();
+    bool begun = fs.beginSegment("/bench-segment", preallocate ? FS_SEGMENT_BYTES : 0);
+    if (preallocate)
+    {
+      FsResult allocation = result;
+      allocation.operation = FS_SEGMENT_PREALLOCATE;
+      if (begun)
+        allocation.latency.record(fs.micros() - start);
+      else
+        allocation.failures++;
+      emit(allocation);
+    }
+    for (uint32_t run = 0; run < FS_SEGMENT_BYTES / FS_SEGMENT_WRITE_BYTES; run++)
+    {
+      uint32_t writeStart = fs.micros();
+      bool ok = begun && fs.writeSegment(data, sizeof(data));
+      uint32_t elapsed = fs.micros() - writeStart;
+      if (ok)
+        result.latency.record(elapsed);
+      else
+        result.failures++;
+    }
+    if (begun)
+      fs.endSegment();
+    emit(result);
+  }
+  fs.remove("/bench-segment");
+}
+
+} // namespace bench
+} // namespace vitalcare
@@ -0,0 +1,197 @@
+/*
+ * VitalCare Rural - Core Library Benchmarks
+ *
+ * Per-call cost of every VitalCareCore component on the host. Anything on
+ * the per-sample path should stay in the tens of nanoseconds here.
+ */
+
+#include <cmath>
+#include <cstdint>
+
+#include <VitalCareCore.h>
+
+#include "Benchmark.h"
+
+using namespace vitalcare;
+using namespace vitalcare::bench;
+
+// Synthetic 100 Hz pulse waveform at 75 BPM, one second long
+static const int SIGNAL_LENGTH = 100;
+static int32_t pulseWave[SIGNAL_LENGTH];
+
+static void buildSignal()
+{
+  static bool built = false;
+  if (built)
+    return;
+  for (int i = 0; i < SIGNAL_LENGTH; i++)
+  {
+    double phase = fmod(i * 0.01 * 1.25, 1.0);
+    pulseWave[i] = 2000 + (int32_t)(1200 * exp(-phase * 8.0)) + (i * 37 % 21) - 10;
+  }
+  built = true;
+}
+
+static void BM_RingBufferPush(State &state)
+{
+  RingBuffer<int16_t, 256> buffer;
+  int16_t value = 0;
+  while (state.keepRunning())
+  {
+    buffer.push(value++);
+  }
+  doNotOptimize(buffer.newest());
+}
+VITALCARE_BENCHMARK(BM_RingBufferPush);
+
+static void BM_MovingAverage16(State &state)
+{
+  buildSignal();
+  MovingAverage<int32_t, 16> filter;
+  int i = 0;
+  while (state.keepRunning())
+  {
+    doNotOptimize(filter.update(pulseWave[i]));
+    i = (i + 1) % SIGNAL_LENGTH;
+  }
+}
+VITALCARE_BENCHMARK(BM_MovingAverage16);
+
+static void BM_DcBlocker(State &state)
+{
+  buildSignal();
+  DcBlocker filter;
+  int i = 0;
+  while (state.keepRunning())
+  {
+    doNotOptimize(filter.update(pulseWave[i]));
+    i = (i + 1) % SIGNAL_LENGTH;
+  }
+}
+VITALCARE_BENCHMARK(BM_DcBlocker);
+
+// Detector + channel quality + fusion, as run for every ADC sample
+static void BM_BeatPipelinePerSample(State &state)
+{
+  buildSignal();
+  ThresholdBeatDetector detector(2500);
+  BeatChannel channel;
+  HeartRateFusion fusion;
+  uint32_t now = 0;
+  int i = 0;
+  while (state.keepRunning())
+  {
+    if (detector.update(pulseWave[i], now))
+    {
+      float rate;
+      if (channel.onBeat(now, rate))
+      {
+        fusion.update(rate, channel.getQuality(), now);
+      }
+    }
+    now += 10;
+    i = (i + 1) % SIGNAL_LENGTH;
+  }
+  doNotOptimize(fusion.value());
+}
+VITALCARE_BENCHMARK(BM_BeatPipelinePerSample);
+
+static void BM_HeartRateFusionUpdate(State &state)
+{
+  HeartRateFusion fusion;
+  fusion.begin(0);
+  uint32_t now = 0;
+  float measurement = 70;
+  while (state.keepRunning())
+  {
+    now += 800;
+    measurement = measurement > 90 ? 70 : measurement + 0.5f;
+    fusion.update(measurement, 0.9f, now);
+  }
+  doNotOptimize(fusion.value());
+}
+VITALCARE_BENCHMARK(BM_HeartRateFusionUpdate);
+
+static void BM_EvaluateAlerts(State &state)
+{
+  VitalSample vitals = {72, 120, 80, 98, 98.6f, 0};
+  while (state.keepRunning())
+  {
+    vitals.heartRate = vitals.heartRate > 130 ? 40 : vitals.heartRate + 1;
+    doNotOptimize(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS));
+  }
+}
+VITALCARE_BENCHMARK(BM_EvaluateAlerts);
+
+static void BM_JsonVitalsMessage(State &state)
+{
+  char buffer[256];
+  VitalSample vitals = {72, 120, 80, 98, 98.6f, 123456};
+  while (state.keepRunning())
+  {
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject()
+        .string("type", "vitals")
+        .number("heartRate", vitals.heartRate)
+        .number("systolicBP", vitals.systolicBP)
+        .number("diastolicBP", vitals.diastolicBP)
+        .number("spO2", vitals.spO2)
+        .number("temperature", vitals.temperature)
+        .integer("timestamp", vitals.timestampMs)
+        .string("status", "Monitoring")
+        .endObject();
+    doNotOptimize(json.size());
+    vitals.timestampMs++;
+  }
+}
+VITALCARE_BENCHMARK(BM_JsonVitalsMessage);
+
+static void BM_FormatTimestamp(State &state)
+{
+  char buffer[16];
+  uint32_t now = 0;
+  while (state.keepRunning())
+  {
+    doNotOptimize(formatTimestamp(now, buffer, sizeof(buffer)));
+    now += 1000;
+  }
+}
+VITALCARE_BENCHMARK(BM_FormatTimestamp);
+
+static void BM_VitalRecordEncode(State &state)
+{
+  uint8_t out[VITAL_RECORD_SIZE];
+  VitalRecord record = {0, {72, 120, 80, 98, 98.6f, 0}, 0, 0};
+  while (state.keepRunning())
+  {
+    record.sequence++;
+    encodeVitalRecord(record, out);
+    clobberMemory();
+  }
+}
+VITALCARE_BENCHMARK(BM_VitalRecordEncode);
+
+static void BM_VitalRecordDecode(State &state)
+{
+  uint8_t in[VITAL_RECORD_SIZE];
+  VitalRecord record = {42, {72, 120, 80, 98, 98.6f, 1000}, 0, 0};
+  encodeVitalRecord(record, in);
+  while (state.keepRunning())
+  {
+    doNotOptimize(decodeVitalRecord(in, record));
+  }
+}
+VITALCARE_BENCHMARK(BM_VitalRecordDecode);
+
+static void BM_Crc32_4KiB(State &state)
+{
+  static uint8_t block[4096];
+  for (size_t i = 0; i < sizeof(block); i++)
+    block[i] = (uint8_t)(i * 31);
+  state.setItemsPerIteration(sizeof(block));
+  while (state.keepRunning())
+  {
+    doNotOptimize(crc32(block, sizeof(block)));
+  }
+}
+VITALCARE_BENCHMARK(BM_Crc32_4KiB);
@@ -0,0 +1,369 @@
+/*
+ * VitalCare Rural - Firmware Hot Path Benchmarks
+ *
+ * The work esp32-main does on its timers, rebuilt from the same
+ * VitalCareCore calls: the 100 ms readSensors() tick, ECG beat (QRS)
+ * detection per sample, sendVitalSignsToClients() and the binary record it
+ * would send instead, checkForAlerts(), the latency stamps of each frame,
+ * and the codecs behind the SD log, the uplink and the EDF+ recording.
+ * Nothing here touches the simulator, so the file also builds into the
+ * esp32-bench image for cycle counts.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <VitalCareCore.h>
+
+#include "Benchmark.h"
+
+using namespace vitalcare;
+using namespace vitalcare::bench;
+
+// Four seconds of AD8232 ECG at 250 Hz (72 BPM) and 100 Hz MAX30102 PPG
+static const int ECG_LENGTH = 1000;
+static const int PPG_LENGTH = 400;
+static int32_t ecgSamples[ECG_LENGTH];
+static PpgSample ppgSamples[PPG_LENGTH];
+
+static void buildFirmwareSignals()
+{
+  static bool built = false;
+  if (built)
+    return;
+  for (int i = 0; i < ECG_LENGTH; i++)
+  {
+    double phase = fmod(i / 250.0 * 1.2, 1.0); // Seconds into the beat / period
+    double r = (phase - 0.30) / 0.012;
+    double t = (phase - 0.60) / 0.05;
+    ecgSamples[i] = 1800 + (int32_t)(1100 * exp(-r * r) + 180 * exp(-t * t)) + (i * 37 % 31) - 15;
+  }
+  for (int i = 0; i < PPG_LENGTH; i++)
+  {
+    double pulse = exp(-fmod(i / 100.0 * 1.2, 1.0) * 5.0);
+    ppgSamples[i] = {(uint32_t)(90000 + 1200 * pulse), (uint32_t)(110000 + 2000 * pulse)};
+  }
+  built = true;
+}
+
+// Accepts and discards the bytes of an EDF+ recording
+class NullEdfOutput : public EdfOutput
+{
+public:
+  bool write(const uint8_t *, size_t) override { return true; }
+  bool seek(uint64_t) override { return true; }
+};
+
+// esp32-main's recording layout: ECG at 10 Hz plus PPG red/IR at 100 Hz
+static const EdfSignal ECG_SIGNAL = {"ECG", "AD8232 chest electrodes", "mV", -16.5f, 16.5f, 0, 4095,
+                                     "HP:0.5Hz LP:40Hz", 10};
+static const EdfSignal PPG_RED_SIGNAL = {"PPG Red", "MAX30102", "counts", 0, 32767, 0, 32767, "", 100};
+static const EdfSignal PPG_IR_SIGNAL = {"PPG IR", "MAX30102", "counts", 0, 32767, 0, 32767, "", 100};
+
+static void beginFirmwareRecording(EdfWriter &edf)
+{
+  edf.addSignal(ECG_SIGNAL);
+  edf.addSignal(PPG_RED_SIGNAL);
+  edf.addSignal(PPG_IR_SIGNAL);
+  EdfRecordingInfo info = {"VC-001-0001", 'F', "Bench", "VitalCare-5643000000000001", 0, 0, 0, 0, 0, 0};
+  edf.begin(info, 1000);
+}
+
+// One readSensors() call: ECG and pulse samples, pulse beat detection,
+// ten PPG samples into the SpO2 estimator and 21 samples into the EDF+
+// recording (whose 1 s endRecord() is amortised over ten ticks)
+static void BM_ReadSensorsTick(State &state)
+{
+  buildFirmwareSignals();
+  ThresholdBeatDetector pulseDetector(2048, 0, 0);
+  BeatRateWindow heartRateWindow(15000, 10000);
+  SpO2Estimator spo2Estimator;
+  NullEdfOutput output;
+  static uint8_t record[(10 + 100 + 100) * 2 + EDF_DEFAULT_ANNOTATION_BYTES];
+  EdfWriter edf(output, record, sizeof(record));
+  beginFirmwareRecording(edf);
+
+  uint32_t now = 0;
+  int ecg = 0;
+  int ppg = 0;
+  int tick = 0;
+  heartRateWindow.begin(now);
+  while (state.keepRunning())
+  {
+    int32_t ecgValue = ecgSamples[ecg];
+    edf.addSample(0, (int16_t)ecgValue);
+    if (pulseDetector.update(ppgSamples[ppg].ir >> 6, now))
+      heartRateWindow.onBeat(now);
+    for (int i = 0; i < 10; i++)
+    {
+      const PpgSample &sample = ppgSamples[ppg + i];
+      spo2Estimator.update(sample);
+      edf.addSample(1, (int16_t)(sample.red >> 3));
+      edf.addSample(2, (int16_t)(sample.ir >> 3));
+    }
+    doNotOptimize(heartRateWindow.update(now));
+    doNotOptimize(spo2Estimator.spO2());
+    if (++tick == 10)
+    {
+      edf.endRecord();
+      tick = 0;
+    }
+    now += 100;
+    ecg = (ecg + 25) % ECG_LENGTH;
+    ppg = (ppg + 10) % PPG_LENGTH;
+  }
+}
+VITALCARE_BENCHMARK(BM_ReadSensorsTick);
+
+// ECG QRS detection as run on every AD8232 sample: threshold detector with
+// refractory period, then the channel's rate and quality tracking
+static void BM_EcgQrsDetectPerSample(State &state)
+{
+  buildFirmwareSignals();
+  ThresholdBeatDetector detector(2000, 100, 300);
+  BeatChannel channel;
+  uint32_t now = 0;
+  int i = 0;
+  float rate = 0;
+  state.setItemsPerIteration(1);
+  while (state.keepRunning())
+  {
+    if (detector.update(ecgSamples[i], now))
+      channel.onBeat(now, rate);
+    now += 4;
+    i = i + 1 == ECG_LENGTH ? 0 : i + 1;
+  }
+  doNotOptimize(rate);
+  doNotOptimize(channel.getQuality());
+}
+VITALCARE_BENCHMARK_BUDGET(BM_EcgQrsDetectPerSample, 50);
+
+static void BM_EmaFilter(State &state)
+{
+  buildFirmwareSignals();
+  EmaFilter filter(0.1f);
+  int i = 0;
+  while (state.keepRunning())
+  {
+    doNotOptimize(filter.update((float)ecgSamples[i]));
+    i = i + 1 == ECG_LENGTH ? 0 : i + 1;
+  }
+}
+VITALCARE_BENCHMARK(BM_EmaFilter);
+
+// The full sendVitalSignsToClients() message, built with JsonWriter
+static void BM_SendVitalsJson(State &state)
+{
+  char buffer[320];
+  float heartRate = 72;
+  uint32_t timestamp = 123456;
+  while (state.keepRunning())
+  {
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject()
+        .string("type", "vitals")
+        .number("heartRate", heartRate)
+        .number("systolicBP", 121.0f)
+        .number("diastolicBP", 79.0f)
+        .number("spO2", 97.5f)
+        .number("temperature", 98.6f)
+        .integer("ecgValue", 2048)
+        .number("pressure", 1013.25f)
+        .integer("timestamp", timestamp)
+        .string("status", "Monitoring")
+        .integer("seq", timestamp / 1000)
+        .endObject();
+    doNotOptimize(json.size());
+    heartRate = heartRate > 120 ? 60 : heartRate + 0.5f;
+    timestamp += 1000;
+  }
+}
+VITALCARE_BENCHMARK(BM_SendVitalsJson);
+
+// The same reading as the binary record the uplink and SD log carry
+static void BM_SendVitalsBinary(State &state)
+{
+  uint8_t out[VITAL_RECORD_SIZE];
+  VitalRecord record = {0, {72, 121, 79, 97.5f, 98.6f, 123456}, 0, 0};
+  while (state.keepRunning())
+  {
+    record.sequence++;
+    record.vitals.timestampMs += 1000;
+    encodeVitalRecord(record, out);
+    clobberMemory();
+  }
+}
+VITALCARE_BENCHMARK(BM_SendVitalsBinary);
+
+// checkForAlerts() on a reading that raises two alerts: evaluation plus
+// the message text the monitor shows and sends
+static void BM_CheckForAlerts(State &state)
+{
+  char text[192];
+  VitalSample vitals = {132, 165, 95, 89, 98.6f, 0};
+  while (state.keepRunning())
+  {
+    uint8_t flags = evaluateAlerts(vitals, BEDSIDE_THRESHOLDS);
+    if (flags != ALERT_NONE)
+      doNotOptimize(formatAlertMessage(flags, vitals, text, sizeof(text)));
+    vitals.timestampMs += 1000;
+  }
+}
+VITALCARE_BENCHMARK(BM_CheckForAlerts);
+
+// The latency stamps of one 1 s frame: ten reads with a beat, the
+// snapshot, the send and one dashboard's echo
+static void BM_LatencyFrame(State &state)
+{
+  LatencyTracker tracker;
+  uint32_t nowUs = 0;
+  while (state.keepRunning())
+  {
+    for (int read = 0; read < 10; read++)
+    {
+      tracker.onAcquired(nowUs);
+      if (read == 4)
+        tracker.onBeat(nowUs, nowUs + 180);
+      nowUs += 100000;
+    }
+    uint32_t seq = tracker.onPublished(nowUs, (nowUs >> 20) & 1 ? ALERT_SPO2 : ALERT_NONE);
+    tracker.onSent(seq, nowUs + 2500);
+    tracker.onEcho(seq, nowUs + 21000, 9000 + (nowUs >> 10) % 4000);
+  }
+  doNotOptimize(tracker.stage(LATENCY_BEAT_TO_RENDER).percentileUs(99));
+}
+VITALCARE_BENCHMARK(BM_LatencyFrame);
+
+static void BM_PatientRecordEncode(State &state)
+{
+  uint8_t out[PATIENT_RECORD_SIZE];
+  PatientRecord record = {};
+  strncpy(record.patientId, "VC-001-0001", sizeof(record.patientId));
+  strncpy(record.name, "Bench Patient", sizeof(record.name));
+  record.age = 42;
+  record.gender = 'F';
+  while (state.keepRunning())
+  {
+    record.sequence++;
+    encodePatientRecord(record, out);
+    clobberMemory();
+  }
+}
+VITALCARE_BENCHMARK(BM_PatientRecordEncode);
+
+// A full SD log block: 20 vitals records plus the block CRC
+static void BM_RecordLogBlockEncode(State &state)
+{
+  static uint8_t block[RECORD_LOG_BLOCK_SIZE];
+  VitalRecord record = {0, {72, 121, 79, 97.5f, 98.6f, 0}, 0, 0};
+  uint32_t sequence = 0;
+  state.setItemsPerIteration(recordLogBlockCapacity(UPLINK_VITAL_RECORDS));
+  while (state.keepRunning())
+  {
+    RecordLogBlockWriter writer(block, UPLINK_VITAL_RECORDS, ++sequence);
+    while (!writer.full())
+    {
+      record.sequence++;
+      writer.add(record);
+    }
+    doNotOptimize(writer.finish());
+  }
+}
+VITALCARE_BENCHMARK(BM_RecordLogBlockEncode);
+
+static void BM_RecordLogBlockDecode(State &state)
+{
+  static uint8_t block[RECORD_LOG_BLOCK_SIZE];
+  VitalRecord record = {0, {72, 121, 79, 97.5f, 98.6f, 0}, 0, 0};
+  RecordLogBlockWriter writer(block, UPLINK_VITAL_RECORDS, 1);
+  while (writer.add(record))
+    record.sequence++;
+  writer.finish();
+  state.setItemsPerIteration(writer.count());
+  while (state.keepRunning())
+  {
+    RecordLogBlock header;
+    if (decodeRecordLogBlock(block, header) == LOG_BLOCK_OK)
+    {
+      for (uint8_t i = 0; i < header.recordCount; i++)
+        decodeVitalRecord(block + RECORD_LOG_BLOCK_HEADER_SIZE + i * VITAL_RECORD_SIZE, record);
+    }
+    doNotOptimize(record);
+  }
+}
+VITALCARE_BENCHMARK(BM_RecordLogBlockDecode);
+
+// A 30-record uplink batch, the size the device sends every 30 s
+static const uint16_t BENCH_BATCH_RECORDS = 30;
+
+static void BM_UplinkBatchEncode30(State &state)
+{
+  static uint8_t batch[UPLINK_HEADER_SIZE + BENCH_BATCH_RECORDS * VITAL_RECORD_SIZE];
+  VitalRecord record = {0, {72, 121, 79, 97.5f, 98.6f, 0}, 0, 0};
+  uint32_t sequence = 0;
+  state.setItemsPerIteration(BENCH_BATCH_RECORDS);
+  while (state.keepRunning())
+  {
+    UplinkBatchWriter writer(batch, sizeof(batch), UPLINK_VITAL_RECORDS, 0x5643000000000001ull, ++sequence);
+    while (!writer.full())
+    {
+      record.sequence++;
+      writer.add(record);
+    }
+    doNotOptimize(writer.finish());
+  }
+}
+VITALCARE_BENCHMARK(BM_UplinkBatchEncode30);
+
+static void BM_UplinkBatchDecode30(State &state)
+{
+  static uint8_t batch[UPLINK_HEADER_SIZE + BENCH_BATCH_RECORDS * VITAL_RECORD_SIZE];
+  VitalRecord record = {0, {72, 121, 79, 97.5f, 98.6f, 0}, 0, 0};
+  UplinkBatchWriter writer(batch, sizeof(batch), UPLINK_VITAL_RECORDS, 0x5643000000000001ull, 1);
+  while (writer.add(record))
+    record.sequence++;
+  size_t length = writer.finish();
+  state.setItemsPerIteration(BENCH_BATCH_RECORDS);
+  while (state.keepRunning())
+  {
+    UplinkBatchHeader header;
+    if (decodeUplinkHeader(batch, length, header) &&
+        crc32(batch + UPLINK_HEADER_SIZE, header.payloadLength) == header.payloadCrc)
+    {
+      for (uint16_t i = 0; i < header.recordCount; i++)
+        decodeVitalRecord(batch + UPLINK_HEADER_SIZE + i * VITAL_RECORD_SIZE, record);
+    }
+    doNotOptimize(record);
+  }
+}
+VITALCARE_BENCHMARK(BM_UplinkBatchDecode30);
+
+// One second of the recording: 210 samples, an annotation and endRecord()
+static void BM_EdfRecordSecond(State &state)
+{
+  buildFirmwareSignals();
+  NullEdfOutput output;
+  static uint8_t record[(10 + 100 + 100) * 2 + EDF_DEFAULT_ANNOTATION_BYTES];
+  EdfWriter edf(output, record, sizeof(record));
+  beginFirmwareRecording(edf);
+  static int16_t ecg[10], red[100], ir[100];
+  for (int i = 0; i < 100; i++)
+  {
+    red[i] = (int16_t)(ppgSamples[i].red >> 3);
+    ir[i] = (int16_t)(ppgSamples[i].ir >> 3);
+    if (i < 10)
+      ecg[i] = (int16_t)ecgSamples[i * 25];
+  }
+  uint32_t second = 0;
+  while (state.keepRunning())
+  {
+    edf.addSamples(0, ecg, 10);
+    edf.addSamples(1, red, 100);
+    edf.addSamples(2, ir, 100);
+    edf.annotate(second++ * 1000, 0, "Alert: heart_rate_high");
+    edf.endRecord();
+  }
+  doNotOptimize(edf.records());
+}
+VITALCARE_BENCHMARK(BM_EdfRecordSecond);
@@ -0,0 +1,57 @@
+/*
+ * VitalCare Rural - Shared I2C Bus Benchmarks
+ *
+ * Bookkeeping cost the bus manager adds to every transaction: enqueue,
+ * priority pick, instrumentation and completion hand-back. On the ESP32
+ * this runs inside short critical sections, so it has to stay tiny
+ * compared with the ~100 us wire time of a register read.
+ */
+
+#include <VitalCareCore.h>
+
+#include "Benchmark.h"
+
+using namespace vitalcare;
+using namespace vitalcare::bench;
+
+static void countCompletion(void *context, const I2cTransaction &, I2cStatus)
+{
+  (*static_cast<uint32_t *>(context))++;
+}
+
+static void BM_I2cSchedulerRoundTrip(State &state)
+{
+  I2cScheduler scheduler;
+  uint8_t buffer[6];
+  uint32_t completed = 0;
+  uint32_t clock = 0;
+  I2cTransaction transaction = {0x57, 0x07, false, I2C_PRIORITY_NORMAL, sizeof(buffer), buffer,
+                                &countCompletion, &completed};
+  while (state.keepRunning())
+  {
+    transaction.priority = (uint8_t)(clock % 3);
+    scheduler.enqueue(transaction, clock);
+    I2cJob job;
+    scheduler.next(job);
+    scheduler.finish(job, I2C_OK, clock + 10, clock + 180);
+    scheduler.takeCompletion(job);
+    job.transaction.callback(job.transaction.context, job.transaction, job.status);
+    clock += 200;
+  }
+  doNotOptimize(completed);
+}
+VITALCARE_BENCHMARK(BM_I2cSchedulerRoundTrip);
+
+static void BM_I2cLatencyPercentile(State &state)
+{
+  I2cBusStats stats = I2cBusStats();
+  for (uint32_t i = 0; i < 10000; i++)
+    stats.latencyHistogram[I2cBusStats::bucketFor((i * 7919) % 5000)]++;
+  uint8_t percent = 50;
+  while (state.keepRunning())
+  {
+    doNotOptimize(stats.latencyPercentileUs(percent));
+    percent = percent == 99 ? 50 : percent + 1;
+  }
+}
+VITALCARE_BENCHMARK(BM_I2cLatencyPercentile);
@@ -0,0 +1,199 @@
+/*
+ * VitalCare Rural - Host Benchmark Runner
+ *
+ * Usage: vitalcare-bench [--json FILE] [--baseline FILE] [--tolerance 0.25]
+ *                        [filter]
+ * Runs every registered benchmark whose name contains filter. --json writes
+ * the results in Google Benchmark's JSON layout; --baseline compares with
+ * such a file from an earlier build and counts every benchmark more than
+ * --tolerance slower as a regression. Exits with 1 if any benchmark
+ * exceeded its cost budget or regressed.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "Benchmark.h"
+
+using namespace vitalcare::bench;
+
+static const double MIN_RUN_SECONDS = 0.2;
+
+// real_time of every benchmark in a file written by --json
+static bool readBaseline(const char *path, std::map<std::string, double> &baseline)
+{
+  FILE *in = fopen(path, "r");
+  if (!in)
+  {
+    perror(path);
+    return false;
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), in))
+  {
+    const char *name = strstr(line, "\"name\": \"");
+    const char *time = strstr(line, "\"real_time\": ");
+    if (!name || !time)
+      continue;
+    name += 9;
+    const char *end = strchr(name, '"');
+    if (end)
+      baseline[std::string(name, end - name)] = strtod(time + 13, nullptr);
+  }
+  fclose(in);
+  return true;
+}
+
+static void writeContext(FILE *out, const char *executable)
+{
+  char date[32];
+  time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+  char host[64] = "";
+  gethostname(host, sizeof(host) - 1);
+#ifdef NDEBUG
+  const char *buildType = "release";
+#else
+  const char *buildType = "debug";
+#endif
+  fprintf(out,
+          "{\n  \"context\": {\"date\": \"%s\", \"host_name\": \"%s\", \"executable\": \"%s\", \"num_cpus\": %u, "
+          "\"library_build_type\": \"%s\"},\n  \"benchmarks\": [\n",
+          date, host, executable, std::thread::hardware_concurrency(), buildType);
+}
+
+int main(int argc, char **argv)
+{
+  const char *filter = nullptr;
+  const char *jsonPath = nullptr;
+  const char *baselinePath = nullptr;
+  double tolerance = 0.25;
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--json") == 0 && hasValue)
+      jsonPath = argv[++i];
+    else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+      baselinePath = argv[++i];
+    else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+      tolerance = atof(argv[++i]);
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr, "usage: %s [--json FILE] [--baseline FILE] [--tolerance 0.25] [filter]\n", argv[0]);
+      return 2;
+    }
+    else
+      filter = argv[i];
+  }
+
+  std::map<std::string, double> baseline;
+  if (baselinePath && !readBaseline(baselinePath, baseline))
+    return 1;
+  FILE *json = nullptr;
+  if (jsonPath)
+  {
+    json = fopen(jsonPath, "w");
+    if (!json)
+    {
+      perror(jsonPath);
+      return 1;
+    }
+    writeContext(json, argv[0]);
+  }
+
+  int overBudget = 0;
+  int regressed = 0;
+  int written = 0;
+  printf("%-40s %14s %14s %16s %12s %10s\n", "Benchmark", "Iterations", "ns/iter", "items/s", "budget",
+         baselinePath ? "vs base" : "");
+  for (const Registration &entry : registry())
+  {
+    if (filter && !strstr(entry.name, filter))
+    {
+      continue;
+    }
+
+    // Grow the batch until it runs long enough to time reliably
+    uint64_t iterations = 1;
+    double seconds = 0;
+    double cpuSeconds = 0;
+    uint64_t items = 0;
+    while (true)
+    {
+      State state(iterations);
+      std::clock_t cpuStart = std::clock();
+      auto start = std::chrono::steady_clock::now();
+      entry.function(state);
+      auto end = std::chrono::steady_clock::now();
+      cpuSeconds = (double)(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+      seconds = std::chrono::duration<double>(end - start).count();
+      items = state.itemsPerIteration();
+      if (seconds >= MIN_RUN_SECONDS || iterations >= (1ull << 40))
+      {
+        break;
+      }
+      double scale = seconds > 0 ? MIN_RUN_SECONDS * 1.4 / seconds : 10.0;
+      iterations = (uint64_t)(iterations * (scale > 10.0 ? 10.0 : (scale < 1.5 ? 1.5 : scale))) + 1;
+    }
+
+    double nsPerIteration = seconds * 1e9 / iterations;
+    double itemsPerSecond = items ? (double)items * iterations / seconds : 0;
+    char itemsText[32] = "-";
+    if (items)
+      snprintf(itemsText, sizeof(itemsText), "%.0f", itemsPerSecond);
+    char budgetText[32] = "";
+    if (entry.budgetNs > 0)
+    {
+      bool within = nsPerIteration <= entry.budgetNs;
+      snprintf(budgetText, sizeof(budgetText), "%s %.0f", within ? "ok <=" : "OVER", entry.budgetNs);
+      overBudget += within ? 0 : 1;
+    }
+    char baselineText[32] = "";
+    auto previous = baseline.find(entry.name);
+    if (previous != baseline.end() && previous->second > 0)
+    {
+      double change = nsPerIteration / previous->second - 1;
+      bool slower = change > tolerance;
+      snprintf(baselineText, sizeof(baselineText), "%+.1f%%%s", change * 100, slower ? " SLOW" : "");
+      regressed += slower ? 1 : 0;
+    }
+    printf("%-40s %14llu %14.1f %16s %12s %10s\n", entry.name, (unsigned long long)iterations, nsPerIteration,
+           itemsText, budgetText, baselineText);
+
+    if (json)
+    {
+      char line[512];
+      Result result = {entry.name, iterations, nsPerIteration, cpuSeconds * 1e9 / iterations, itemsPerSecond,
+                       entry.budgetNs, 0};
+      formatResultJson(result, line, sizeof(line));
+      fprintf(json, "%s    %s", written++ ? ",\n" : "", line);
+    }
+  }
+
+  if (json)
+  {
+    fprintf(json, "\n  ]\n}\n");
+    if (fclose(json) != 0)
+    {
+      perror(jsonPath);
+      return 1;
+    }
+  }
+  if (overBudget)
+  {
+    printf("%d benchmark(s) over budget\n", overBudget);
+  }
+  if (regressed)
+  {
+    printf("%d benchmark(s) more than %.0f%% slower than %s\n", regressed, tolerance * 100, baselinePath);
+  }
+  return overBudget || regressed ? 1 : 0;
+}
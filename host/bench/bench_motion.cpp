@@ -0,0 +1,94 @@
+/*
+ * VitalCare Rural - Motion Artifact Benchmarks
+ *
+ * The motion stage runs on every 10 ms ADC tick of esp32-sensors, so it
+ * carries a hard per-sample budget. On this host the whole stage (gravity
+ * removal, intensity, 3x4-tap NLMS) must stay under 250 ns per sample; at
+ * the ESP32's roughly 30x lower throughput that is ~10 us, 0.1% of a tick.
+ */
+
+#include <cmath>
+#include <cstdint>
+
+#include <VitalCareCore.h>
+
+#include "Benchmark.h"
+
+using namespace vitalcare;
+using namespace vitalcare::bench;
+
+// One second of walking: accelerometer plus PPG with correlated artifact
+static const int MOTION_LENGTH = 100;
+static AccelSample accelWave[MOTION_LENGTH];
+static int32_t ppgWave[MOTION_LENGTH];
+
+static void buildMotion()
+{
+  static bool built = false;
+  if (built)
+    return;
+  for (int i = 0; i < MOTION_LENGTH; i++)
+  {
+    double step = 2 * M_PI * 1.8 * i / 100.0;
+    accelWave[i] = {(int16_t)(4000 * sin(step)), (int16_t)(2500 * cos(step)), (int16_t)(16384 + 1500 * sin(2 * step))};
+    double pulse = fmod(i * 1.3 / 100.0, 1.0);
+    ppgWave[i] = 2000 + (int32_t)(150 * exp(-pulse * 5.0)) + accelWave[i].x / 30;
+  }
+  built = true;
+}
+
+static void BM_MotionEstimator(State &state)
+{
+  buildMotion();
+  MotionEstimator motion;
+  int i = 0;
+  while (state.keepRunning())
+  {
+    motion.update(accelWave[i]);
+    doNotOptimize(motion.intensity());
+    i = (i + 1) % MOTION_LENGTH;
+  }
+}
+VITALCARE_BENCHMARK(BM_MotionEstimator);
+
+static void BM_NlmsCanceller3x4(State &state)
+{
+  buildMotion();
+  MotionEstimator motion;
+  NlmsCanceller<3, 4> canceller;
+  int16_t references[3][MOTION_LENGTH];
+  for (int i = 0; i < MOTION_LENGTH; i++)
+  {
+    motion.update(accelWave[i]);
+    for (int axis = 0; axis < 3; axis++)
+      references[axis][i] = motion.dynamicAcceleration()[axis];
+  }
+  int i = 0;
+  while (state.keepRunning())
+  {
+    const int16_t sample[3] = {references[0][i], references[1][i], references[2][i]};
+    doNotOptimize(canceller.update(ppgWave[i], sample));
+    i = (i + 1) % MOTION_LENGTH;
+  }
+}
+VITALCARE_BENCHMARK(BM_NlmsCanceller3x4);
+
+// Everything esp32-sensors does per tick for motion rejection
+static void BM_MotionStagePerSample(State &state)
+{
+  buildMotion();
+  MotionEstimator motion;
+  NlmsCanceller<3, 4> canceller;
+  ThresholdBeatDetector detector(2075, 40, 300);
+  uint32_t nowMs = 0;
+  int i = 0;
+  while (state.keepRunning())
+  {
+    motion.update(accelWave[i]);
+    int32_t cleaned = canceller.update(ppgWave[i], motion.dynamicAcceleration());
+    doNotOptimize(detector.update(cleaned, nowMs));
+    nowMs += 10;
+    i = (i + 1) % MOTION_LENGTH;
+  }
+}
+VITALCARE_BENCHMARK_BUDGET(BM_MotionStagePerSample, 250);
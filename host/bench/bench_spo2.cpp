@@ -0,0 +1,69 @@
+/*
+ * VitalCare Rural - SpO2 Pipeline Benchmarks
+ *
+ * Cost of the MAX3010x path: estimator work per 100 Hz sample and a full
+ * 100 ms FIFO drain through the driver against the simulated device.
+ */
+
+#include <VitalCareCore.h>
+
+#include "Benchmark.h"
+#include "SimulatedI2cBus.h"
+#include "SimulatedMax30102.h"
+
+using namespace vitalcare;
+using namespace vitalcare::bench;
+
+static void BM_SpO2EstimatorPerSample(State &state)
+{
+  sim::SimulatedI2cBus bus;
+  sim::SimulatedMax30102 device(96.0f, 75.0f);
+  bus.attach(device);
+  Max3010x sensor(bus);
+  sensor.begin();
+  bus.drain();
+
+  // Ten seconds of pre-generated samples, replayed in a loop
+  static PpgSample samples[1000];
+  int count = 0;
+  while (count < 1000)
+  {
+    sensor.poll();
+    bus.advance(100000);
+    while (count < 1000 && sensor.read(samples[count]))
+      count++;
+  }
+
+  SpO2Estimator estimator;
+  int i = 0;
+  while (state.keepRunning())
+  {
+    doNotOptimize(estimator.update(samples[i]));
+    i = (i + 1) % count;
+  }
+  doNotOptimize(estimator.spO2x10());
+}
+VITALCARE_BENCHMARK(BM_SpO2EstimatorPerSample);
+
+static void BM_Max3010xFifoDrain100ms(State &state)
+{
+  sim::SimulatedI2cBus bus;
+  sim::SimulatedMax30102 device(96.0f, 75.0f);
+  bus.attach(device);
+  Max3010x sensor(bus);
+  sensor.begin();
+  bus.drain();
+
+  PpgSample sample = {0, 0};
+  while (state.keepRunning())
+  {
+    sensor.poll();
+    bus.advance(100000);
+    while (sensor.read(sample))
+    {
+    }
+  }
+  doNotOptimize(sample.ir);
+  state.setItemsPerIteration(Max3010x::SAMPLE_RATE_HZ / 10);
+}
+VITALCARE_BENCHMARK(BM_Max3010xFifoDrain100ms);
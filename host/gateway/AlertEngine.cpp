@@ -0,0 +1,416 @@
+/*
+ * VitalCare Rural Gateway - Central Alert Evaluation
+ */
+
+#include "AlertEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VITALCARE_ALERTS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+size_t thresholdRulesFor(const AlertThresholds &limits, ThresholdRule *rules, size_t capacity)
+{
+  // SpO2 has no upper limit; 0 means no oximeter reading, which has a rule
+  // of its own firing below the smallest positive reading
+  const ThresholdRule table[] = {
+      {FIELD_HEART_RATE, limits.heartRateMin, limits.heartRateMax, false, ALERT_HEART_RATE},
+      {FIELD_SYSTOLIC, limits.systolicMin, limits.systolicMax, false, ALERT_BLOOD_PRESSURE},
+      {FIELD_SPO2, limits.spO2Min, INFINITY, true, ALERT_SPO2},
+      {FIELD_TEMPERATURE, limits.temperatureMin, limits.temperatureMax, false, ALERT_TEMPERATURE},
+      {FIELD_SPO2, std::numeric_limits<float>::denorm_min(), INFINITY, false, ALERT_SPO2_NO_READING},
+  };
+  size_t count = std::min(capacity, sizeof(table) / sizeof(table[0]));
+  std::copy(table, table + count, rules);
+  return count;
+}
+
+float vitalField(const VitalSample &vitals, VitalField field)
+{
+  switch (field)
+  {
+  case FIELD_HEART_RATE:
+    return vitals.heartRate;
+  case FIELD_SYSTOLIC:
+    return vitals.systolicBP;
+  case FIELD_DIASTOLIC:
+    return vitals.diastolicBP;
+  case FIELD_SPO2:
+    return vitals.spO2;
+  case FIELD_TEMPERATURE:
+    return vitals.temperature;
+  default:
+    return 0;
+  }
+}
+
+static void thresholdScalar(const float *values, size_t count, const ThresholdRule &rule, uint32_t *flags)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    float value = values[i];
+    bool fires = value < rule.min || value > rule.max;
+    if (rule.zeroIsMissing)
+      fires = fires && value > 0;
+    if (fires)
+      flags[i] |= rule.flag;
+  }
+}
+
+// Windows starting at first.. The slope is numerator / denominator of the
+// least-squares fit, compared without dividing; times are seconds from the
+// window's first reading.
+static void trendScalarFrom(size_t first, const float *values, const uint32_t *times, size_t count,
+                            const TrendRule &rule, uint32_t bit, uint32_t *flags)
+{
+  size_t window = rule.window;
+  const float n = (float)window;
+  const float direction = (float)rule.direction;
+  const float limit = rule.perMinute / 60.0f;
+  for (size_t j = first; j + window <= count; j++)
+  {
+    float sumT = 0, sumX = 0, sumTT = 0, sumTX = 0, minX = INFINITY;
+    for (size_t k = 0; k < window; k++)
+    {
+      float t = (float)(int32_t)(times[j + k] - times[j]) * 0.001f;
+      float x = values[j + k];
+      sumT = sumT + t;
+      sumX = sumX + x;
+      sumTT = sumTT + t * t;
+      sumTX = sumTX + t * x;
+      minX = x < minX ? x : minX;
+    }
+    float numerator = n * sumTX - sumT * sumX;
+    float denominator = n * sumTT - sumT * sumT;
+    if (minX > 0 && denominator > 0 && direction * numerator > limit * denominator)
+      flags[j + window - 1] |= bit;
+  }
+}
+
+static void trendScalar(const float *values, const uint32_t *times, size_t count, const TrendRule &rule,
+                        uint32_t bit, uint32_t *flags)
+{
+  trendScalarFrom(0, values, times, count, rule, bit, flags);
+}
+
+static const AlertKernels SCALAR_KERNELS = {"scalar", thresholdScalar, trendScalar};
+
+const AlertKernels &scalarAlertKernels()
+{
+  return SCALAR_KERNELS;
+}
+
+#if VITALCARE_ALERTS_AVX2
+
+__attribute__((target("avx2"))) static void thresholdAvx2(const float *values, size_t count,
+                                                          const ThresholdRule &rule, uint32_t *flags)
+{
+  const __m256 low = _mm256_set1_ps(rule.min);
+  const __m256 high = _mm256_set1_ps(rule.max);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256i bit = _mm256_set1_epi32((int)rule.flag);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256 value = _mm256_loadu_ps(values + i);
+    __m256 fires = _mm256_or_ps(_mm256_cmp_ps(value, low, _CMP_LT_OQ), _mm256_cmp_ps(value, high, _CMP_GT_OQ));
+    if (rule.zeroIsMissing)
+      fires = _mm256_and_ps(fires, _mm256_cmp_ps(value, zero, _CMP_GT_OQ));
+    __m256i *out = (__m256i *)(flags + i);
+    _mm256_storeu_si256(out, _mm256_or_si256(_mm256_loadu_si256(out),
+                                             _mm256_and_si256(_mm256_castps_si256(fires), bit)));
+  }
+  thresholdScalar(values + i, count - i, rule, flags + i);
+}
+
+// Eight windows at a time; lane l is the window starting at j + l, so step
+// k of all eight is one unaligned load of consecutive readings
+__attribute__((target("avx2"))) static void trendAvx2(const float *values, const uint32_t *times, size_t count,
+                                                      const TrendRule &rule, uint32_t bit, uint32_t *flags)
+{
+  size_t window = rule.window;
+  const __m256 n = _mm256_set1_ps((float)window);
+  const __m256 direction = _mm256_set1_ps((float)rule.direction);
+  const __m256 limit = _mm256_set1_ps(rule.perMinute / 60.0f);
+  const __m256 scale = _mm256_set1_ps(0.001f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256i bits = _mm256_set1_epi32((int)bit);
+  size_t j = 0;
+  for (; j + window + 7 <= count; j += 8)
+  {
+    __m256i start = _mm256_loadu_si256((const __m256i *)(times + j));
+    __m256 sumT = zero, sumX = zero, sumTT = zero, sumTX = zero;
+    __m256 minX = _mm256_set1_ps(INFINITY);
+    for (size_t k = 0; k < window; k++)
+    {
+      __m256i stamp = _mm256_loadu_si256((const __m256i *)(times + j + k));
+      __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(stamp, start)), scale);
+      __m256 x = _mm256_loadu_ps(values + j + k);
+      sumT = _mm256_add_ps(sumT, t);
+      sumX = _mm256_add_ps(sumX, x);
+      sumTT = _mm256_add_ps(sumTT, _mm256_mul_ps(t, t));
+      sumTX = _mm256_add_ps(sumTX, _mm256_mul_ps(t, x));
+      minX = _mm256_min_ps(x, minX);
+    }
+    __m256 numerator = _mm256_sub_ps(_mm256_mul_ps(n, sumTX), _mm256_mul_ps(sumT, sumX));
+    __m256 denominator = _mm256_sub_ps(_mm256_mul_ps(n, sumTT), _mm256_mul_ps(sumT, sumT));
+    __m256 fires = _mm256_and_ps(_mm256_cmp_ps(minX, zero, _CMP_GT_OQ), _mm256_cmp_ps(denominator, zero, _CMP_GT_OQ));
+    fires = _mm256_and_ps(fires, _mm256_cmp_ps(_mm256_mul_ps(direction, numerator),
+                                               _mm256_mul_ps(limit, denominator), _CMP_GT_OQ));
+    __m256i *out = (__m256i *)(flags + j + window - 1);
+    _mm256_storeu_si256(out, _mm256_or_si256(_mm256_loadu_si256(out),
+                                             _mm256_and_si256(_mm256_castps_si256(fires), bits)));
+  }
+  trendScalarFrom(j, values, times, count, rule, bit, flags);
+}
+
+static const AlertKernels AVX2_KERNELS = {"avx2", thresholdAvx2, trendAvx2};
+
+const AlertKernels *avx2AlertKernels()
+{
+  return __builtin_cpu_supports("avx2") ? &AVX2_KERNELS : nullptr;
+}
+
+#else
+
+const AlertKernels *avx2AlertKernels()
+{
+  return nullptr;
+}
+
+#endif
+
+// Per worker thread, grown to the largest batch seen
+struct AlertWorkspace
+{
+  std::vector<VitalRecord> records;
+  std::vector<uint8_t> valid;
+  std::vector<float> columns[FIELD_COUNT];
+  std::vector<uint32_t> flags;
+  std::vector<AlertResult> results;
+  // Trend series: the device's closed periods, then those its in-sequence
+  // records close (and a gap wherever its clock went back)
+  std::vector<float> series[FIELD_COUNT];
+  std::vector<uint32_t> times;
+  std::vector<uint32_t> trendFlags;
+  std::vector<int32_t> seriesIndex; // per record: the latest period closed, -1 when not in the series
+  std::vector<uint8_t> closes;      // per record: it closed that period
+
+  void reserve(size_t count, size_t history)
+  {
+    if (records.size() >= count)
+      return;
+    records.resize(count);
+    valid.resize(count);
+    flags.resize(count);
+    results.resize(count);
+    seriesIndex.resize(count);
+    closes.resize(count);
+    times.resize(2 * count + history);
+    trendFlags.resize(2 * count + history);
+    for (size_t f = 0; f < FIELD_COUNT; f++)
+    {
+      columns[f].resize(count);
+      series[f].resize(2 * count + history);
+    }
+  }
+};
+
+static thread_local AlertWorkspace workspace;
+
+AlertEngine::AlertEngine(const AlertThresholds &limits, const TrendRule *trendRules, size_t trendRuleCount,
+                         KernelChoice choice, uint32_t trendPeriodMs, uint32_t holdoffMs)
+    : kernels(&scalarAlertKernels()), trendCount(std::min(trendRuleCount, MAX_TREND_RULES)),
+      trendPeriodMs(std::max<uint32_t>(1, trendPeriodMs)), holdoffMs(holdoffMs)
+{
+  if (choice == KERNELS_AUTO && avx2AlertKernels())
+    kernels = avx2AlertKernels();
+  thresholdCount = thresholdRulesFor(limits, thresholds, sizeof(thresholds) / sizeof(thresholds[0]));
+  for (size_t r = 0; r < trendCount; r++)
+  {
+    trends[r] = trendRules[r];
+    trends[r].window = (uint8_t)std::max<size_t>(2, std::min<size_t>(trends[r].window, MAX_WINDOW));
+  }
+}
+
+size_t AlertEngine::evaluate(uint64_t deviceId, const uint8_t *records, size_t count, AlertResult *results)
+{
+  AlertWorkspace &work = workspace;
+  work.reserve(count, HISTORY);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    VitalRecord &record = work.records[i];
+    work.valid[i] = decodeVitalRecord(records + i * VITAL_RECORD_SIZE, record);
+    for (size_t f = 0; f < FIELD_COUNT; f++)
+      work.columns[f][i] = work.valid[i] ? vitalField(record.vitals, (VitalField)f) : 0;
+  }
+
+  std::fill(work.flags.begin(), work.flags.begin() + count, 0);
+  for (size_t r = 0; r < thresholdCount; r++)
+    kernels->threshold(work.columns[thresholds[r].field].data(), count, thresholds[r], work.flags.data());
+  for (size_t i = 0; i < count; i++)
+    work.results[i] = AlertResult{work.valid[i] ? (uint8_t)work.flags[i] : (uint8_t)0, 0, 0};
+
+  if (trendCount > 0)
+    evaluateTrends(deviceId, count, work.results.data());
+
+  size_t alerting = 0;
+  uint64_t thresholdRecords = 0;
+  uint64_t raised = 0;
+  uint64_t missed = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    const AlertResult &result = work.results[i];
+    thresholdRecords += result.threshold != 0;
+    missed += (result.threshold & ~work.records[i].alertFlags) != 0;
+    alerting += result.threshold != 0 || result.trend != 0;
+    if (result.trendRaised)
+    {
+      raised += __builtin_popcount(result.trendRaised);
+      if (listener)
+        listener(deviceId, work.records[i], result);
+    }
+  }
+  if (results)
+    std::copy(work.results.begin(), work.results.begin() + count, results);
+
+  stats.records += count;
+  stats.thresholdRecords += thresholdRecords;
+  stats.trendRaised += raised;
+  stats.deviceMissed += missed;
+  return alerting;
+}
+
+void AlertEngine::evaluateTrends(uint64_t deviceId, size_t count, AlertResult *results)
+{
+  AlertWorkspace &work = workspace;
+  Shard &shard = shardFor(deviceId);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  DeviceHistory &device = shard.devices[deviceId];
+
+  size_t length = device.count;
+  for (size_t f = 0; f < FIELD_COUNT; f++)
+    std::copy(device.values[f], device.values[f] + length, work.series[f].begin());
+  std::copy(device.times, device.times + length, work.times.begin());
+
+  // A period's value is the mean of its readings, 0 for a vital with none
+  auto appendOpenPeriod = [&]() {
+    for (size_t f = 0; f < FIELD_COUNT; f++)
+      work.series[f][length] = device.readings[f] ? device.sums[f] / device.readings[f] : 0;
+    work.times[length] = device.period * trendPeriodMs;
+    length++;
+  };
+
+  for (size_t i = 0; i < count; i++)
+  {
+    const VitalRecord &record = work.records[i];
+    work.closes[i] = false;
+    if (!work.valid[i] || (device.seen && (int32_t)(record.sequence - device.lastSequence) <= 0))
+    {
+      work.seriesIndex[i] = -1;
+      continue;
+    }
+    device.seen = true;
+    device.lastSequence = record.sequence;
+
+    uint32_t period = record.vitals.timestampMs / trendPeriodMs;
+    if (device.open && period != device.period)
+    {
+      appendOpenPeriod();
+      work.closes[i] = true;
+      if (period < device.period)
+      {
+        // The device's clock went back: a period of no readings keeps
+        // every window off the jump
+        for (size_t f = 0; f < FIELD_COUNT; f++)
+          work.series[f][length] = 0;
+        work.times[length] = period * trendPeriodMs;
+        length++;
+      }
+    }
+    if (!device.open || period != device.period)
+    {
+      device.open = true;
+      device.period = period;
+      std::fill(device.sums, device.sums + FIELD_COUNT, 0.0f);
+      std::fill(device.readings, device.readings + FIELD_COUNT, 0);
+    }
+    for (size_t f = 0; f < FIELD_COUNT; f++)
+    {
+      float value = work.columns[f][i];
+      if (value > 0)
+      {
+        device.sums[f] += value;
+        device.readings[f]++;
+      }
+    }
+    work.seriesIndex[i] = (int32_t)length - 1;
+  }
+
+  std::fill(work.trendFlags.begin(), work.trendFlags.begin() + length, 0);
+  for (size_t r = 0; r < trendCount; r++)
+    kernels->trend(work.series[trends[r].field].data(), work.times.data(), length, trends[r], 1u << r,
+                   work.trendFlags.data());
+
+  // A record that closes no period carries the state on; one that closes
+  // a period takes its trends and raises the new ones past their hold-off
+  for (size_t i = 0; i < count; i++)
+  {
+    if (work.seriesIndex[i] < 0)
+      continue;
+    if (!work.closes[i])
+    {
+      results[i].trend = device.trendState;
+      continue;
+    }
+    uint8_t trend = (uint8_t)work.trendFlags[work.seriesIndex[i]];
+    uint8_t raised = trend & ~device.trendState;
+    uint32_t now = work.records[i].vitals.timestampMs;
+    for (size_t r = 0; r < trendCount; r++)
+    {
+      uint8_t bit = (uint8_t)(1u << r);
+      if (!(raised & bit))
+        continue;
+      // A clock that went back makes the difference huge: no hold-off
+      if ((device.raised & bit) && now - device.raisedMs[r] < holdoffMs)
+      {
+        raised &= (uint8_t)~bit;
+        continue;
+      }
+      device.raised |= bit;
+      device.raisedMs[r] = now;
+    }
+    results[i].trend = trend;
+    results[i].trendRaised = raised;
+    device.trendState = trend;
+  }
+
+  size_t keep = std::min(length, HISTORY);
+  for (size_t f = 0; f < FIELD_COUNT; f++)
+    std::copy(work.series[f].begin() + (length - keep), work.series[f].begin() + length, device.values[f]);
+  std::copy(work.times.begin() + (length - keep), work.times.begin() + length, device.times);
+  device.count = (uint8_t)keep;
+}
+
+bool AlertingSink::storeVitals(uint64_t deviceId, const uint8_t *records, size_t count)
+{
+  if (!next.storeVitals(deviceId, records, count))
+    return false;
+  engine.evaluate(deviceId, records, count, nullptr);
+  return true;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,242 @@
+/*
+ * VitalCare Rural Gateway - Central Alert Evaluation
+ *
+ * Re-evaluates every stored vital record against a rule table, whatever
+ * the device decided. Threshold rules come from a shared AlertThresholds
+ * table, so with EMERGENCY_THRESHOLDS a record alerts exactly when
+ * isEmergency() on the communication module would (BEDSIDE_THRESHOLDS:
+ * checkForAlerts() on the single-ESP32 monitor). Trend rules look at a
+ * device's recent readings: the least-squares slope of one vital over a
+ * window of time, rising or falling faster than a limit per minute. A
+ * device cannot raise those, since it only keeps its current reading.
+ *
+ * Trends are fitted to periods, not records: a device's in-sequence
+ * records are averaged per period of its own timestamps (10 s by
+ * default), so 1 Hz records and 10 s rollups give the same window and
+ * the same noise. A period counts once a later record closes it. A rule
+ * that clears and holds again is raised once per hold-off per device.
+ *
+ * Records are evaluated a batch at a time in struct-of-arrays form: one
+ * float column per vital and one pass per rule over the column. Trend
+ * windows are not gathered either: lane j of a pass is the window starting
+ * at column index j, so consecutive lanes load consecutive readings. The
+ * passes use AVX2 when the CPU has it and a scalar loop otherwise; both
+ * do the same float operations in the same order and agree bit for bit.
+ *
+ * Readings of 0 mean "no reading" (VitalSample) and are left out of a
+ * period's mean; a trend window with a period of none in it does not
+ * fire. Records that arrive out of sequence (an SD replay after an outage)
+ * are checked against the thresholds only. A device clock that goes back
+ * (a reboot) starts the windows over.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include <VitalCareCore.h>
+
+#include "Ingest.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+enum VitalField : uint8_t
+{
+  FIELD_HEART_RATE,
+  FIELD_SYSTOLIC,
+  FIELD_DIASTOLIC,
+  FIELD_SPO2,
+  FIELD_TEMPERATURE,
+  FIELD_COUNT,
+};
+
+// Fires outside [min, max]; with zeroIsMissing a reading of 0 never fires
+struct ThresholdRule
+{
+  VitalField field;
+  float min;
+  float max;
+  bool zeroIsMissing;
+  uint8_t flag; // AlertFlag
+};
+
+enum TrendDirection : int8_t
+{
+  TREND_FALLING = -1,
+  TREND_RISING = 1,
+};
+
+// Fires when the slope over the last `window` values (this one included)
+// moves in `direction` by more than perMinute units a minute. The engine
+// feeds one value per trend period, so the window spans window periods.
+struct TrendRule
+{
+  const char *name;
+  VitalField field;
+  TrendDirection direction;
+  uint8_t window;
+  float perMinute;
+};
+
+const uint32_t TREND_PERIOD_MS = 10000;   // One rollup period
+const uint32_t TREND_HOLDOFF_MS = 300000; // Between raises of one rule
+
+// Gateway defaults: windows of 80 s
+const TrendRule DEFAULT_TREND_RULES[] = {
+    {"heartRateRising", FIELD_HEART_RATE, TREND_RISING, 8, 10.0f},
+    {"spO2Falling", FIELD_SPO2, TREND_FALLING, 8, 2.0f},
+    {"systolicFalling", FIELD_SYSTOLIC, TREND_FALLING, 8, 10.0f},
+    {"temperatureRising", FIELD_TEMPERATURE, TREND_RISING, 8, 0.5f},
+};
+const size_t DEFAULT_TREND_RULE_COUNT = sizeof(DEFAULT_TREND_RULES) / sizeof(DEFAULT_TREND_RULES[0]);
+
+const size_t MAX_THRESHOLD_RULES = 5;
+
+// The comparisons evaluateAlerts() makes, one rule each. Returns the count.
+size_t thresholdRulesFor(const AlertThresholds &limits, ThresholdRule *rules, size_t capacity);
+
+float vitalField(const VitalSample &vitals, VitalField field);
+
+// One pass of one rule over a column. flags[i] |= the rule's bit for every
+// reading that fires. For trends, times are the readings' device
+// timestamps (ms) and index i fires on the window values[i - window + 1 .. i];
+// the first window - 1 indices are never set.
+struct AlertKernels
+{
+  const char *name;
+  void (*threshold)(const float *values, size_t count, const ThresholdRule &rule, uint32_t *flags);
+  void (*trend)(const float *values, const uint32_t *times, size_t count, const TrendRule &rule, uint32_t bit,
+                uint32_t *flags);
+};
+
+const AlertKernels &scalarAlertKernels();
+// Null when the build or the CPU has no AVX2
+const AlertKernels *avx2AlertKernels();
+
+struct AlertResult
+{
+  uint8_t threshold;   // AlertFlag bits
+  uint8_t trend;       // bit r: trend rule r holds at this record
+  uint8_t trendRaised; // bits of trend that did not hold at the previous record
+};
+
+struct AlertStats
+{
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> thresholdRecords{0}; // records with any threshold flag
+  std::atomic<uint64_t> trendRaised{0};      // trend rules newly holding
+  std::atomic<uint64_t> deviceMissed{0};     // threshold flags the device did not set itself
+};
+
+class AlertEngine
+{
+public:
+  static const size_t MAX_TREND_RULES = 8;
+  static const size_t MAX_WINDOW = 16;
+
+  enum KernelChoice
+  {
+    KERNELS_AUTO,
+    KERNELS_SCALAR,
+  };
+
+  // Called on the evaluating thread for each record that raises a trend
+  typedef std::function<void(uint64_t deviceId, const VitalRecord &record, const AlertResult &result)> Listener;
+
+  AlertEngine(const AlertThresholds &limits = EMERGENCY_THRESHOLDS, const TrendRule *trends = DEFAULT_TREND_RULES,
+              size_t trendCount = DEFAULT_TREND_RULE_COUNT, KernelChoice choice = KERNELS_AUTO,
+              uint32_t trendPeriodMs = TREND_PERIOD_MS, uint32_t holdoffMs = TREND_HOLDOFF_MS);
+
+  // Evaluates count encoded VitalRecords of one device, in arrival order.
+  // results (optional) gets one entry per record; undecodable records get
+  // zeros. Returns the number of records with any alert. Thread-safe.
+  size_t evaluate(uint64_t deviceId, const uint8_t *records, size_t count, AlertResult *results);
+
+  void setListener(Listener listener) { this->listener = listener; }
+
+  const char *kernelName() const { return kernels->name; }
+  const TrendRule &trendRule(size_t index) const { return trends[index]; }
+  size_t trendRuleCount() const { return trendCount; }
+  const AlertStats &statistics() const { return stats; }
+
+private:
+  static const size_t SHARDS = 64;
+  static const size_t HISTORY = MAX_WINDOW - 1;
+
+  // The closed periods a window ending at a device's next period still
+  // needs, and the sums of the period still open
+  struct DeviceHistory
+  {
+    bool seen = false;
+    uint32_t lastSequence = 0;
+    uint8_t trendState = 0;
+    uint8_t count = 0;
+    float values[FIELD_COUNT][HISTORY];
+    uint32_t times[HISTORY];
+    bool open = false;
+    uint32_t period = 0; // Of the open period
+    float sums[FIELD_COUNT];
+    uint16_t readings[FIELD_COUNT];
+    uint8_t raised = 0; // Rules raised at raisedMs[r]
+    uint32_t raisedMs[MAX_TREND_RULES];
+  };
+
+  struct Shard
+  {
+    std::mutex lock;
+    std::unordered_map<uint64_t, DeviceHistory> devices;
+  };
+
+  void evaluateTrends(uint64_t deviceId, size_t count, AlertResult *results);
+
+  Shard &shardFor(uint64_t deviceId) { return shards[(deviceId * 0x9E3779B97F4A7C15ull) >> 58]; }
+
+  const AlertKernels *kernels;
+  ThresholdRule thresholds[MAX_THRESHOLD_RULES];
+  size_t thresholdCount;
+  TrendRule trends[MAX_TREND_RULES];
+  size_t trendCount;
+  uint32_t trendPeriodMs;
+  uint32_t holdoffMs;
+  Listener listener;
+  Shard shards[SHARDS];
+  AlertStats stats;
+};
+
+// Stores through to another sink, then runs the stored vitals through the
+// alert engine: only records the ingest admitted are evaluated, once.
+class AlertingSink : public RecordSink
+{
+public:
+  AlertingSink(RecordSink &next, AlertEngine &engine) : next(next), engine(engine) {}
+
+  bool storeVitals(uint64_t deviceId, const uint8_t *records, size_t count) override;
+  bool storePatients(uint64_t deviceId, const uint8_t *records, size_t count) override
+  {
+    return next.storePatients(deviceId, records, count);
+  }
+  void flush() override { next.flush(); }
+  bool contains(uint64_t deviceId, bool vitals, uint32_t sequence) override
+  {
+    return next.contains(deviceId, vitals, sequence);
+  }
+  void recentSequences(uint64_t deviceId, bool vitals, uint32_t window, std::vector<uint32_t> &out) override
+  {
+    next.recentSequences(deviceId, vitals, window, out);
+  }
+
+private:
+  RecordSink &next;
+  AlertEngine &engine;
+};
+
+} // namespace gateway
+} // namespace vitalcare
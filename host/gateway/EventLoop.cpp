@@ -0,0 +1,185 @@
+/*
+ * VitalCare Rural Gateway - Event Loop
+ */
+
+#include "EventLoop.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const int MAX_EVENTS = 256;
+
+EventLoop::EventLoop() : running(false)
+{
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollFd >= 0 && wakeFd >= 0)
+  {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+  }
+}
+
+EventLoop::~EventLoop()
+{
+  if (wakeFd >= 0)
+    close(wakeFd);
+  if (epollFd >= 0)
+    close(epollFd);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler)
+{
+  epoll_event event = {};
+  event.events = events;
+  event.data.fd = fd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+  {
+    perror("epoll_ctl(ADD)");
+    return false;
+  }
+  handlers[fd] = std::move(handler);
+  return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events)
+{
+  epoll_event event = {};
+  event.events = events;
+  event.data.fd = fd;
+  return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void EventLoop::remove(int fd)
+{
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  handlers.erase(fd);
+}
+
+void EventLoop::post(Task task)
+{
+  bool wasEmpty;
+  {
+    std::lock_guard<std::mutex> guard(postedLock);
+    wasEmpty = posted.empty();
+    posted.push_back(std::move(task));
+  }
+  // One wake-up per burst of posts is enough
+  if (wasEmpty)
+  {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void EventLoop::every(uint32_t intervalMs, Task task)
+{
+  timers.push_back({intervalMs, nowMs() + intervalMs, std::move(task)});
+}
+
+void EventLoop::stop()
+{
+  post([this]() { running = false; });
+}
+
+uint64_t EventLoop::nowMs()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void EventLoop::run()
+{
+  running = true;
+  epoll_event events[MAX_EVENTS];
+  while (running)
+  {
+    int count = epoll_wait(epollFd, events, MAX_EVENTS, nextTimeoutMs());
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      break;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      int fd = events[i].data.fd;
+      if (fd == wakeFd)
+      {
+        uint64_t value;
+        ssize_t got = read(wakeFd, &value, sizeof(value));
+        (void)got;
+        continue;
+      }
+      // A handler earlier in this batch may have closed this fd
+      auto it = handlers.find(fd);
+      if (it != handlers.end())
+      {
+        Handler handler = it->second;
+        handler(events[i].events);
+      }
+    }
+
+    drainPosted();
+    runTimers();
+  }
+}
+
+void EventLoop::drainPosted()
+{
+  {
+    std::lock_guard<std::mutex> guard(postedLock);
+    draining.swap(posted);
+  }
+  for (Task &task : draining)
+    task();
+  draining.clear();
+}
+
+int EventLoop::nextTimeoutMs() const
+{
+  {
+    std::lock_guard<std::mutex> guard(postedLock);
+    if (!posted.empty())
+      return 0;
+  }
+  if (timers.empty())
+    return -1;
+  uint64_t now = nowMs();
+  uint64_t earliest = timers[0].dueMs;
+  for (const Timer &timer : timers)
+    earliest = timer.dueMs < earliest ? timer.dueMs : earliest;
+  return earliest <= now ? 0 : (int)(earliest - now);
+}
+
+void EventLoop::runTimers()
+{
+  uint64_t now = nowMs();
+  for (Timer &timer : timers)
+  {
+    if (timer.dueMs <= now)
+    {
+      timer.dueMs = now + timer.intervalMs;
+      timer.task();
+    }
+  }
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,77 @@
+/*
+ * VitalCare Rural Gateway - Event Loop
+ *
+ * Single-threaded epoll loop. File descriptors are registered with a
+ * handler that receives the ready events; other threads hand work back to
+ * the loop with post(), which wakes it through an eventfd. Timers run from
+ * the same loop at millisecond resolution.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+class EventLoop
+{
+public:
+  typedef std::function<void(uint32_t events)> Handler;
+  typedef std::function<void()> Task;
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool valid() const { return epollFd >= 0 && wakeFd >= 0; }
+
+  bool add(int fd, uint32_t events, Handler handler);
+  bool modify(int fd, uint32_t events);
+  void remove(int fd);
+
+  // Thread-safe: runs task on the loop thread
+  void post(Task task);
+
+  // Runs task every intervalMs on the loop thread
+  void every(uint32_t intervalMs, Task task);
+
+  // Runs until stop() (thread-safe)
+  void run();
+  void stop();
+
+  static uint64_t nowMs();
+
+private:
+  struct Timer
+  {
+    uint32_t intervalMs;
+    uint64_t dueMs;
+    Task task;
+  };
+
+  void drainPosted();
+  int nextTimeoutMs() const;
+  void runTimers();
+
+  int epollFd;
+  int wakeFd;
+  bool running;
+  std::unordered_map<int, Handler> handlers;
+  std::vector<Timer> timers;
+
+  mutable std::mutex postedLock;
+  std::vector<Task> posted;
+  std::vector<Task> draining;
+};
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,309 @@
+/*
+ * VitalCare Rural Gateway - Gorilla Column Codecs
+ *
+ * Bit-packed encoders for time-series columns, after Facebook's Gorilla:
+ *
+ * - DeltaOfDeltaEncoder: integers that advance at a near-constant rate
+ *   (timestamps, sequence numbers). A 1 Hz device with a few ms of jitter
+ *   costs 1-9 bits per row instead of 32.
+ * - XorEncoder: 32-bit floats. Each value is XORed with the previous one
+ *   and only the meaningful bits are kept; unchanged values cost one bit.
+ *   Vitals are x10 fixed point on the wire so float32 loses nothing.
+ * - RepeatEncoder: small codes (flags) that rarely change.
+ *
+ * Streams are MSB-first and can be decoded while still being appended to.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+class BitWriter
+{
+public:
+  void write(uint64_t value, unsigned bits)
+  {
+    while (bits > 0)
+    {
+      unsigned used = bitCount & 7;
+      if (used == 0)
+        bytes.push_back(0);
+      unsigned take = 8 - used < bits ? 8 - used : bits;
+      uint8_t part = (uint8_t)((value >> (bits - take)) & ((1u << take) - 1));
+      bytes.back() |= (uint8_t)(part << (8 - used - take));
+      bits -= take;
+      bitCount += take;
+    }
+  }
+
+  void writeBit(bool bit) { write(bit ? 1 : 0, 1); }
+
+  void clear()
+  {
+    bytes.clear();
+    bitCount = 0;
+  }
+
+  const uint8_t *data() const { return bytes.data(); }
+  size_t bits() const { return bitCount; }
+  size_t byteLength() const { return bytes.size(); }
+
+private:
+  std::vector<uint8_t> bytes;
+  size_t bitCount = 0;
+};
+
+class BitReader
+{
+public:
+  BitReader(const uint8_t *data, size_t bits) : data(data), bitCount(bits), position(0) {}
+
+  uint64_t read(unsigned bits)
+  {
+    uint64_t value = 0;
+    if (position + bits > bitCount)
+    {
+      position = bitCount + 1; // sticky underflow
+      return 0;
+    }
+    while (bits > 0)
+    {
+      unsigned used = position & 7;
+      unsigned take = 8 - used < bits ? 8 - used : bits;
+      uint8_t byte = data[position >> 3];
+      value = (value << take) | ((byte >> (8 - used - take)) & ((1u << take) - 1));
+      bits -= take;
+      position += take;
+    }
+    return value;
+  }
+
+  bool readBit() { return read(1) != 0; }
+  bool ok() const { return position <= bitCount; }
+
+private:
+  const uint8_t *data;
+  size_t bitCount;
+  size_t position;
+};
+
+inline int64_t signExtend(uint64_t value, unsigned bits)
+{
+  uint64_t sign = 1ull << (bits - 1);
+  return (int64_t)((value ^ sign) - sign);
+}
+
+// Control codes: 0 = same delta, 10 = 7 bits, 110 = 9 bits, 1110 = 12
+// bits, 1111 = 64 bits
+class DeltaOfDeltaEncoder
+{
+public:
+  void append(BitWriter &out, int64_t value)
+  {
+    if (count == 0)
+    {
+      out.write((uint64_t)value, 64);
+    }
+    else
+    {
+      int64_t delta = value - previous;
+      int64_t dod = delta - previousDelta;
+      if (dod == 0)
+        out.writeBit(false);
+      else if (dod >= -64 && dod <= 63)
+      {
+        out.write(0x2, 2);
+        out.write((uint64_t)dod & 0x7F, 7);
+      }
+      else if (dod >= -256 && dod <= 255)
+      {
+        out.write(0x6, 3);
+        out.write((uint64_t)dod & 0x1FF, 9);
+      }
+      else if (dod >= -2048 && dod <= 2047)
+      {
+        out.write(0xE, 4);
+        out.write((uint64_t)dod & 0xFFF, 12);
+      }
+      else
+      {
+        out.write(0xF, 4);
+        out.write((uint64_t)dod, 64);
+      }
+      previousDelta = delta;
+    }
+    previous = value;
+    count++;
+  }
+
+private:
+  int64_t previous = 0;
+  int64_t previousDelta = 0;
+  uint32_t count = 0;
+};
+
+class DeltaOfDeltaDecoder
+{
+public:
+  int64_t next(BitReader &in)
+  {
+    if (count++ == 0)
+    {
+      previous = (int64_t)in.read(64);
+      return previous;
+    }
+    int64_t dod = 0;
+    if (in.readBit())
+    {
+      if (!in.readBit())
+        dod = signExtend(in.read(7), 7);
+      else if (!in.readBit())
+        dod = signExtend(in.read(9), 9);
+      else if (!in.readBit())
+        dod = signExtend(in.read(12), 12);
+      else
+        dod = (int64_t)in.read(64);
+    }
+    previousDelta += dod;
+    previous += previousDelta;
+    return previous;
+  }
+
+private:
+  int64_t previous = 0;
+  int64_t previousDelta = 0;
+  uint32_t count = 0;
+};
+
+// Control codes: 0 = same value, 10 = meaningful bits fit the previous
+// window, 11 = 5 bits leading zeros + 5 bits (length - 1) + bits
+class XorEncoder
+{
+public:
+  void append(BitWriter &out, float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (count++ == 0)
+    {
+      out.write(bits, 32);
+      previous = bits;
+      return;
+    }
+
+    uint32_t x = bits ^ previous;
+    previous = bits;
+    if (x == 0)
+    {
+      out.writeBit(false);
+      return;
+    }
+    unsigned leading = __builtin_clz(x);
+    unsigned trailing = __builtin_ctz(x);
+    if (window && leading >= windowLeading && trailing >= windowTrailing)
+    {
+      out.write(0x2, 2);
+      out.write(x >> windowTrailing, 32 - windowLeading - windowTrailing);
+      return;
+    }
+    unsigned length = 32 - leading - trailing;
+    out.write(0x3, 2);
+    out.write(leading, 5);
+    out.write(length - 1, 5);
+    out.write(x >> trailing, length);
+    window = true;
+    windowLeading = leading;
+    windowTrailing = trailing;
+  }
+
+private:
+  uint32_t previous = 0;
+  uint32_t count = 0;
+  bool window = false;
+  unsigned windowLeading = 0;
+  unsigned windowTrailing = 0;
+};
+
+class XorDecoder
+{
+public:
+  float next(BitReader &in)
+  {
+    if (count++ == 0)
+    {
+      previous = (uint32_t)in.read(32);
+    }
+    else if (in.readBit())
+    {
+      if (in.readBit())
+      {
+        windowLeading = (unsigned)in.read(5);
+        unsigned length = (unsigned)in.read(5) + 1;
+        windowTrailing = 32 - windowLeading - length;
+      }
+      unsigned length = 32 - windowLeading - windowTrailing;
+      previous ^= (uint32_t)in.read(length) << windowTrailing;
+    }
+    float value;
+    memcpy(&value, &previous, sizeof(value));
+    return value;
+  }
+
+private:
+  uint32_t previous = 0;
+  uint32_t count = 0;
+  unsigned windowLeading = 0;
+  unsigned windowTrailing = 0;
+};
+
+// 0 = same as previous, 1 + bits = new value
+class RepeatEncoder
+{
+public:
+  explicit RepeatEncoder(unsigned bits) : width(bits) {}
+
+  void append(BitWriter &out, uint32_t value)
+  {
+    if (count++ > 0 && value == previous)
+    {
+      out.writeBit(false);
+      return;
+    }
+    out.writeBit(true);
+    out.write(value, width);
+    previous = value;
+  }
+
+private:
+  unsigned width;
+  uint32_t previous = 0;
+  uint32_t count = 0;
+};
+
+class RepeatDecoder
+{
+public:
+  explicit RepeatDecoder(unsigned bits) : width(bits) {}
+
+  uint32_t next(BitReader &in)
+  {
+    if (in.readBit())
+      previous = (uint32_t)in.read(width);
+    return previous;
+  }
+
+private:
+  unsigned width;
+  uint32_t previous = 0;
+};
+
+} // namespace gateway
+} // namespace vitalcare
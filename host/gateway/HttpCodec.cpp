@@ -0,0 +1,222 @@
+/*
+ * VitalCare Rural Gateway - HTTP/1.1 Framing
+ */
+
+#include "HttpCodec.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const char *statusText(int status)
+{
+  switch (status)
+  {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 413:
+    return "Payload Too Large";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Error";
+  }
+}
+
+static const char *findHeaderEnd(const char *data, size_t length)
+{
+  for (size_t i = 3; i < length; i++)
+  {
+    if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+      return data + i + 1;
+  }
+  return nullptr;
+}
+
+// Splits "a b c\r\n" style start lines and walks the header block; shared
+// by requests and responses.
+static ParseResult parseMessage(const char *data, size_t length, size_t maxBody, bool request,
+                                HttpMessage &message, size_t &consumed)
+{
+  const char *end = findHeaderEnd(data, length < HTTP_MAX_HEADER ? length : HTTP_MAX_HEADER);
+  if (!end)
+    return length >= HTTP_MAX_HEADER ? PARSE_ERROR : PARSE_INCOMPLETE;
+
+  const char *line = data;
+  const char *lineEnd = (const char *)memchr(line, '\r', end - line);
+  const char *firstSpace = (const char *)memchr(line, ' ', lineEnd - line);
+  if (!firstSpace)
+    return PARSE_ERROR;
+  const char *secondSpace = (const char *)memchr(firstSpace + 1, ' ', lineEnd - firstSpace - 1);
+  if (!secondSpace)
+    return PARSE_ERROR;
+
+  std::string version;
+  if (request)
+  {
+    message.method.assign(line, firstSpace);
+    message.path.assign(firstSpace + 1, secondSpace);
+    version.assign(secondSpace + 1, lineEnd);
+  }
+  else
+  {
+    version.assign(line, firstSpace);
+    message.status = atoi(std::string(firstSpace + 1, secondSpace).c_str());
+  }
+  if (version.compare(0, 5, "HTTP/") != 0)
+    return PARSE_ERROR;
+  message.keepAlive = version != "HTTP/1.0";
+
+  size_t contentLength = 0;
+  line = lineEnd + 2;
+  while (line < end - 2)
+  {
+    lineEnd = (const char *)memchr(line, '\r', end - line);
+    const char *colon = (const char *)memchr(line, ':', lineEnd - line);
+    if (!colon)
+      return PARSE_ERROR;
+    const char *value = colon + 1;
+    while (value < lineEnd && *value == ' ')
+      value++;
+    size_t nameLength = colon - line;
+    size_t valueLength = lineEnd - value;
+
+    if (nameLength == 14 && strncasecmp(line, "Content-Length", 14) == 0)
+    {
+      char *parsedEnd;
+      contentLength = strtoul(std::string(value, valueLength).c_str(), &parsedEnd, 10);
+    }
+    else if (nameLength == 10 && strncasecmp(line, "Connection", 10) == 0)
+    {
+      if (valueLength == 5 && strncasecmp(value, "close", 5) == 0)
+        message.keepAlive = false;
+      else if (valueLength == 10 && strncasecmp(value, "keep-alive", 10) == 0)
+        message.keepAlive = true;
+    }
+    else if (nameLength == 7 && strncasecmp(line, "Upgrade", 7) == 0)
+    {
+      message.upgradeWebSocket = valueLength == 9 && strncasecmp(value, "websocket", 9) == 0;
+    }
+    else if (nameLength == 17 && strncasecmp(line, "Sec-WebSocket-Key", 17) == 0)
+    {
+      message.webSocketKey.assign(value, valueLength);
+    }
+    else if (nameLength == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0)
+    {
+      return PARSE_ERROR; // chunked bodies are not supported
+    }
+    line = lineEnd + 2;
+  }
+
+  if (contentLength > maxBody)
+    return PARSE_ERROR;
+  size_t headerLength = end - data;
+  if (length < headerLength + contentLength)
+    return PARSE_INCOMPLETE;
+
+  message.bodyOffset = headerLength;
+  message.bodyLength = contentLength;
+  consumed = headerLength + contentLength;
+  return PARSE_COMPLETE;
+}
+
+ParseResult parseHttpRequest(const char *data, size_t length, size_t maxBody, HttpMessage &request,
+                             size_t &consumed)
+{
+  return parseMessage(data, length, maxBody, true, request, consumed);
+}
+
+ParseResult parseHttpResponse(const char *data, size_t length, size_t maxBody, HttpMessage &response,
+                              size_t &consumed)
+{
+  return parseMessage(data, length, maxBody, false, response, consumed);
+}
+
+void appendHttpResponse(std::string &out, int status, const char *contentType, const void *body, size_t length,
+                        bool keepAlive)
+{
+  char header[256];
+  int written = snprintf(header, sizeof(header),
+                         "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                         status, statusText(status), contentType, length, keepAlive ? "keep-alive" : "close");
+  out.append(header, written);
+  out.append((const char *)body, length);
+}
+
+void appendHttpRequest(std::string &out, const char *method, const char *path, const char *contentType,
+                       const void *body, size_t length)
+{
+  char header[256];
+  int written = snprintf(header, sizeof(header),
+                         "%s %s HTTP/1.1\r\nHost: gateway\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                         method, path, contentType, length);
+  out.append(header, written);
+  out.append((const char *)body, length);
+}
+
+std::string httpTargetPath(const std::string &target)
+{
+  return target.substr(0, target.find('?'));
+}
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool httpQueryParameter(const std::string &target, const char *name, std::string &value)
+{
+  size_t query = target.find('?');
+  if (query == std::string::npos)
+    return false;
+  size_t nameLength = strlen(name);
+  for (size_t start = query + 1; start < target.size();)
+  {
+    size_t end = target.find('&', start);
+    if (end == std::string::npos)
+      end = target.size();
+    if (end - start > nameLength && target.compare(start, nameLength, name) == 0 &&
+        target[start + nameLength] == '=')
+    {
+      value.clear();
+      for (size_t i = start + nameLength + 1; i < end; i++)
+      {
+        int high = i + 2 < end ? hexDigit(target[i + 1]) : -1;
+        int low = i + 2 < end ? hexDigit(target[i + 2]) : -1;
+        if (target[i] == '%' && high >= 0 && low >= 0)
+        {
+          value += (char)(high * 16 + low);
+          i += 2;
+        }
+        else
+        {
+          value += target[i] == '+' ? ' ' : target[i];
+        }
+      }
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,65 @@
+/*
+ * VitalCare Rural Gateway - HTTP/1.1 Framing
+ *
+ * Just enough HTTP/1.1 for binary uplinks: Content-Length bodies, keep-alive
+ * and pipelining. No chunked encoding; devices always know their batch size.
+ * The same parser reads responses for the synthetic fleet. Query strings
+ * are only read for the dashboard's GET endpoints.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+enum ParseResult
+{
+  PARSE_INCOMPLETE,
+  PARSE_COMPLETE,
+  PARSE_ERROR,
+};
+
+const size_t HTTP_MAX_HEADER = 8192;
+
+struct HttpMessage
+{
+  // Request: method and path. Response: status.
+  std::string method;
+  std::string path;
+  int status = 0;
+
+  size_t bodyOffset = 0; // from the start of the parsed data
+  size_t bodyLength = 0;
+  bool keepAlive = true;
+
+  // WebSocket opening handshake (Upgrade: websocket)
+  bool upgradeWebSocket = false;
+  std::string webSocketKey;
+};
+
+// Parses one request from the front of data. On PARSE_COMPLETE, consumed
+// is the size of the whole message (headers and body).
+ParseResult parseHttpRequest(const char *data, size_t length, size_t maxBody, HttpMessage &request,
+                             size_t &consumed);
+ParseResult parseHttpResponse(const char *data, size_t length, size_t maxBody, HttpMessage &response,
+                              size_t &consumed);
+
+void appendHttpResponse(std::string &out, int status, const char *contentType, const void *body, size_t length,
+                        bool keepAlive);
+void appendHttpRequest(std::string &out, const char *method, const char *path, const char *contentType,
+                       const void *body, size_t length);
+
+// A request target without its query string
+std::string httpTargetPath(const std::string &target);
+// The percent-decoded value of name=value in the target's query string;
+// false when the parameter is absent
+bool httpQueryParameter(const std::string &target, const char *name, std::string &value);
+
+} // namespace gateway
+} // namespace vitalcare
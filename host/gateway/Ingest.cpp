@@ -0,0 +1,319 @@
+/*
+ * VitalCare Rural Gateway - Batch Ingest
+ */
+
+#include "Ingest.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static_assert(IngestService::SHARDS == 64, "shardFor() takes the top 6 hash bits");
+
+StoreSink::StoreSink(const std::string &directory, const StoreOptions &options)
+    : directory(directory), store(directory, options), patients(nullptr)
+{
+}
+
+StoreSink::~StoreSink()
+{
+  if (patients)
+    fclose(patients);
+}
+
+bool StoreSink::open()
+{
+  std::string path = directory + "/patients.log";
+  if (!loadPatients(path))
+    return false;
+  patients = fopen(path.c_str(), "ab");
+  return patients && store.open();
+}
+
+bool StoreSink::loadPatients(const std::string &path)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return true; // first start
+  const size_t entrySize = 8 + PATIENT_RECORD_SIZE;
+  uint8_t entry[8 + PATIENT_RECORD_SIZE];
+  long whole = 0;
+  while (fread(entry, 1, entrySize, file) == entrySize)
+  {
+    PatientRecord record = {};
+    if (decodePatientRecord(entry + 8, record))
+      patientSequences[BinaryReader(entry, 8).u64()].add(record.sequence);
+    whole += (long)entrySize;
+  }
+  fclose(file);
+  // Cut a torn tail so the next append starts on an entry boundary
+  if (truncate(path.c_str(), whole) != 0)
+  {
+    perror(path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool StoreSink::storeVitals(uint64_t deviceId, const uint8_t *records, size_t count)
+{
+  return store.append(deviceId, records, count);
+}
+
+bool StoreSink::storePatients(uint64_t deviceId, const uint8_t *records, size_t count)
+{
+  // Rare (one per session) and small: written through, flushed per batch
+  uint8_t id[8];
+  BinaryWriter(id, sizeof(id)).u64(deviceId);
+  std::lock_guard<std::mutex> guard(lock);
+  bool ok = true;
+  for (size_t i = 0; i < count; i++)
+  {
+    ok = fwrite(id, 1, sizeof(id), patients) == sizeof(id) && ok;
+    ok = fwrite(records + i * PATIENT_RECORD_SIZE, 1, PATIENT_RECORD_SIZE, patients) == PATIENT_RECORD_SIZE && ok;
+  }
+  ok = fflush(patients) == 0 && ok;
+  if (ok)
+  {
+    SequenceRuns &sequences = patientSequences[deviceId];
+    for (size_t i = 0; i < count; i++)
+    {
+      PatientRecord record = {};
+      decodePatientRecord(records + i * PATIENT_RECORD_SIZE, record);
+      sequences.add(record.sequence);
+    }
+  }
+  return ok;
+}
+
+void StoreSink::flush()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  fflush(patients);
+}
+
+bool StoreSink::contains(uint64_t deviceId, bool vitals, uint32_t sequence)
+{
+  if (vitals)
+    return store.contains(deviceId, sequence);
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = patientSequences.find(deviceId);
+  return found != patientSequences.end() && found->second.contains(sequence);
+}
+
+void StoreSink::recentSequences(uint64_t deviceId, bool vitals, uint32_t window, std::vector<uint32_t> &out)
+{
+  if (vitals)
+  {
+    store.recentSequences(deviceId, window, out);
+    return;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = patientSequences.find(deviceId);
+  if (found == patientSequences.end() || found->second.empty())
+    return;
+  uint32_t highest = found->second.highest();
+  found->second.collect(highest >= window ? highest - window + 1 : 0, highest, out);
+}
+
+IngestService::Admission IngestService::SequenceWindow::admit(uint32_t sequence)
+{
+  const uint32_t words = DEDUP_WINDOW / 64;
+  if (!seen)
+  {
+    seen = true;
+    highest = sequence;
+    memset(bits, 0, sizeof(bits));
+    bits[(sequence / 64) % words] |= 1ull << (sequence % 64);
+    return ADMIT_NEW;
+  }
+
+  if ((int32_t)(sequence - highest) > 0)
+  {
+    // Slide forward, clearing the slots that now represent new sequences
+    uint32_t advance = sequence - highest;
+    if (advance >= DEDUP_WINDOW)
+    {
+      memset(bits, 0, sizeof(bits));
+    }
+    else
+    {
+      for (uint32_t s = highest + 1; s != sequence + 1; s++)
+        bits[(s / 64) % words] &= ~(1ull << (s % 64));
+    }
+    highest = sequence;
+    bits[(sequence / 64) % words] |= 1ull << (sequence % 64);
+    return ADMIT_NEW;
+  }
+
+  if (highest - sequence >= DEDUP_WINDOW)
+  {
+    return ADMIT_TOO_OLD;
+  }
+  uint64_t &word = bits[(sequence / 64) % words];
+  uint64_t mask = 1ull << (sequence % 64);
+  if (word & mask)
+  {
+    return ADMIT_DUPLICATE;
+  }
+  word |= mask;
+  return ADMIT_NEW;
+}
+
+void IngestService::SequenceWindow::forget(uint32_t sequence)
+{
+  if (seen && highest - sequence < DEDUP_WINDOW)
+    bits[(sequence / 64) % (DEDUP_WINDOW / 64)] &= ~(1ull << (sequence % 64));
+}
+
+IngestService::SequenceWindow &IngestService::windowFor(uint64_t deviceId, bool vitals, DeviceTable *owned,
+                                                        std::unique_lock<std::mutex> &guard)
+{
+  DeviceTable *devices = owned;
+  if (!devices)
+  {
+    Shard &shard = shardFor(deviceId);
+    guard = std::unique_lock<std::mutex>(shard.lock);
+    devices = &shard.devices;
+  }
+  auto found = devices->find(deviceId);
+  if (found == devices->end())
+  {
+    found = devices->emplace(deviceId, DeviceState()).first;
+    knownDevices++;
+    std::vector<uint32_t> stored;
+    sink.recentSequences(deviceId, true, DEDUP_WINDOW, stored);
+    for (uint32_t sequence : stored)
+      found->second.vitals.admit(sequence);
+    stored.clear();
+    sink.recentSequences(deviceId, false, DEDUP_WINDOW, stored);
+    for (uint32_t sequence : stored)
+      found->second.patients.admit(sequence);
+  }
+  return vitals ? found->second.vitals : found->second.patients;
+}
+
+UplinkAck IngestService::process(const uint8_t *batch, size_t length, DeviceTable *owned)
+{
+  UplinkAck ack = {};
+  UplinkBatchHeader header;
+  stats.batches++;
+  stats.bytes += length;
+
+  if (!decodeUplinkHeader(batch, length, header))
+  {
+    ack.status = UPLINK_BAD_HEADER;
+    stats.badBatches++;
+    return ack;
+  }
+  ack.recordType = header.recordType;
+  ack.deviceId = header.deviceId;
+  ack.batchSequence = header.batchSequence;
+
+  const uint8_t *payload = batch + UPLINK_HEADER_SIZE;
+  if (length != UPLINK_HEADER_SIZE + header.payloadLength || crc32(payload, header.payloadLength) != header.payloadCrc)
+  {
+    ack.status = UPLINK_BAD_PAYLOAD;
+    stats.badBatches++;
+    return ack;
+  }
+
+  // Decode outside any shard lock; only the sequence bookkeeping is shared
+  size_t recordSize = uplinkRecordSize(header.recordType);
+  bool vitalBatch = header.recordType == UPLINK_VITAL_RECORDS;
+  uint32_t sequences[UPLINK_MAX_RECORDS];
+  bool valid[UPLINK_MAX_RECORDS];
+  for (uint16_t i = 0; i < header.recordCount; i++)
+  {
+    const uint8_t *record = payload + i * recordSize;
+    if (vitalBatch)
+    {
+      VitalRecord vital = {};
+      valid[i] = decodeVitalRecord(record, vital);
+      sequences[i] = vital.sequence;
+    }
+    else
+    {
+      PatientRecord patient = {};
+      valid[i] = decodePatientRecord(record, patient);
+      sequences[i] = patient.sequence;
+    }
+  }
+
+  Admission admissions[UPLINK_MAX_RECORDS];
+  {
+    std::unique_lock<std::mutex> guard;
+    SequenceWindow &window = windowFor(header.deviceId, vitalBatch, owned, guard);
+    for (uint16_t i = 0; i < header.recordCount; i++)
+      admissions[i] = valid[i] ? window.admit(sequences[i]) : ADMIT_DUPLICATE;
+  }
+
+  // Records behind the window are new unless the sink has them
+  bool admitted[UPLINK_MAX_RECORDS];
+  for (uint16_t i = 0; i < header.recordCount; i++)
+  {
+    admitted[i] = admissions[i] == ADMIT_NEW ||
+                  (admissions[i] == ADMIT_TOO_OLD && !sink.contains(header.deviceId, vitalBatch, sequences[i]));
+  }
+
+  // Store runs of admitted records in one call each
+  bool stored = true;
+  uint16_t i = 0;
+  while (stored && i < header.recordCount)
+  {
+    if (!valid[i])
+    {
+      ack.rejected++;
+      i++;
+      continue;
+    }
+    if (!admitted[i])
+    {
+      ack.duplicates++;
+      i++;
+      continue;
+    }
+    uint16_t start = i;
+    while (i < header.recordCount && valid[i] && admitted[i])
+      i++;
+    const uint8_t *run = payload + start * recordSize;
+    stored = vitalBatch ? sink.storeVitals(header.deviceId, run, i - start)
+                        : sink.storePatients(header.deviceId, run, i - start);
+    ack.accepted += i - start;
+  }
+
+  if (!stored)
+  {
+    // Let the retry through dedup; records stored before the failure may
+    // be stored twice, which beats losing the rest
+    std::unique_lock<std::mutex> guard;
+    SequenceWindow &window = windowFor(header.deviceId, vitalBatch, owned, guard);
+    for (uint16_t r = 0; r < header.recordCount; r++)
+    {
+      if (valid[r] && admitted[r])
+        window.forget(sequences[r]);
+    }
+    stats.storeFailures++;
+    UplinkAck busy = {};
+    busy.status = UPLINK_BUSY;
+    busy.recordType = header.recordType;
+    busy.deviceId = header.deviceId;
+    busy.batchSequence = header.batchSequence;
+    return busy;
+  }
+
+  stats.accepted += ack.accepted;
+  stats.duplicates += ack.duplicates;
+  stats.rejected += ack.rejected;
+  ack.status = UPLINK_OK;
+  return ack;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,165 @@
+/*
+ * VitalCare Rural Gateway - Batch Ingest
+ *
+ * Validation, deduplication and storage of uplink batches, independent of
+ * the transport they arrived on. Safe to call from many worker threads.
+ *
+ * Deduplication is by (device, record type, record sequence). Each device
+ * keeps a sliding window of the last DEDUP_WINDOW sequences, seeded from
+ * the sink when the device is first seen (after a restart, the window is
+ * what the store holds). Anything older than the window is looked up in
+ * the sink, which is what a device replaying its SD log after a long
+ * outage needs; two batches racing with the same old record may both
+ * store it, but nothing is acked as stored that was not.
+ *
+ * The windows live in 64 locked shards, or, when the caller owns a set of
+ * devices outright (an IngestPipeline shard worker), in the caller's own
+ * DeviceTable with no lock at all.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "TimeSeriesStore.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+// Where accepted records go. Called concurrently from worker threads; a
+// false return means nothing can be promised about those records.
+class RecordSink
+{
+public:
+  virtual ~RecordSink() {}
+  virtual bool storeVitals(uint64_t deviceId, const uint8_t *records, size_t count) = 0;
+  virtual bool storePatients(uint64_t deviceId, const uint8_t *records, size_t count) = 0;
+  virtual void flush() {}
+
+  // What is stored already, so deduplication holds across restarts and
+  // beyond the window. The defaults know of nothing.
+  virtual bool contains(uint64_t, bool /* vitals */, uint32_t /* sequence */) { return false; }
+  // Appends the stored sequences within window below the device's highest
+  virtual void recentSequences(uint64_t, bool /* vitals */, uint32_t /* window */, std::vector<uint32_t> &) {}
+};
+
+// Counts only (benchmarks, load tests without disk)
+class NullSink : public RecordSink
+{
+public:
+  bool storeVitals(uint64_t, const uint8_t *, size_t) override { return true; }
+  bool storePatients(uint64_t, const uint8_t *, size_t) override { return true; }
+};
+
+// Vitals go to the time-series store (durable when this returns);
+// PatientRecords are appended as [u64 device id][record] to patients.log,
+// whose sequences are read back on open.
+class StoreSink : public RecordSink
+{
+public:
+  StoreSink(const std::string &directory, const StoreOptions &options = StoreOptions());
+  ~StoreSink() override;
+
+  bool open();
+  TimeSeriesStore &timeSeries() { return store; }
+
+  bool storeVitals(uint64_t deviceId, const uint8_t *records, size_t count) override;
+  bool storePatients(uint64_t deviceId, const uint8_t *records, size_t count) override;
+  void flush() override;
+  bool contains(uint64_t deviceId, bool vitals, uint32_t sequence) override;
+  void recentSequences(uint64_t deviceId, bool vitals, uint32_t window, std::vector<uint32_t> &out) override;
+
+private:
+  bool loadPatients(const std::string &path);
+
+  std::string directory;
+  TimeSeriesStore store;
+  std::mutex lock;
+  FILE *patients;
+  std::unordered_map<uint64_t, SequenceRuns> patientSequences;
+};
+
+struct IngestStats
+{
+  std::atomic<uint64_t> batches{0};
+  std::atomic<uint64_t> badBatches{0};
+  std::atomic<uint64_t> accepted{0};
+  std::atomic<uint64_t> duplicates{0};
+  std::atomic<uint64_t> rejected{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> storeFailures{0};
+};
+
+class IngestService
+{
+public:
+  static const uint32_t DEDUP_WINDOW = 4096;
+  static const size_t SHARDS = 64;
+
+  enum Admission
+  {
+    ADMIT_NEW,       // marked seen
+    ADMIT_DUPLICATE, // seen within the window
+    ADMIT_TOO_OLD    // behind the window: ask the sink
+  };
+
+  struct SequenceWindow
+  {
+    bool seen = false;
+    uint32_t highest = 0;
+    uint64_t bits[DEDUP_WINDOW / 64] = {};
+
+    Admission admit(uint32_t sequence);
+    // Undoes admit() for records that could not be stored
+    void forget(uint32_t sequence);
+  };
+
+  struct DeviceState
+  {
+    SequenceWindow vitals;
+    SequenceWindow patients;
+  };
+  typedef std::unordered_map<uint64_t, DeviceState> DeviceTable;
+
+  explicit IngestService(RecordSink &sink) : sink(sink) {}
+
+  // Validates, deduplicates and stores one batch; the ack says what
+  // happened to it. With owned, the device's windows are kept in that
+  // table without locking: the caller must be the only thread processing
+  // the devices in it.
+  UplinkAck process(const uint8_t *batch, size_t length, DeviceTable *owned = nullptr);
+
+  const IngestStats &statistics() const { return stats; }
+  size_t deviceCount() const { return knownDevices; }
+
+private:
+  struct Shard
+  {
+    std::mutex lock;
+    std::unordered_map<uint64_t, DeviceState> devices;
+  };
+
+  Shard &shardFor(uint64_t deviceId) { return shards[(deviceId * 0x9E3779B97F4A7C15ull) >> 58]; }
+  // Locks guard when the window is in a shared shard; a device's windows
+  // are seeded from the sink when it is first seen
+  SequenceWindow &windowFor(uint64_t deviceId, bool vitals, DeviceTable *owned, std::unique_lock<std::mutex> &guard);
+
+  RecordSink &sink;
+  Shard shards[SHARDS];
+  std::atomic<size_t> knownDevices{0};
+  IngestStats stats;
+};
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,280 @@
+/*
+ * VitalCare Rural Gateway - Sharded Ingest Pipeline
+ */
+
+#include "IngestPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static_assert(IngestPipeline::SLOTS == 1024, "slotOf() takes the top 10 hash bits");
+
+static uint64_t nowUs()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+IngestPipeline::IngestPipeline(IngestService &ingest, size_t shardCount, size_t queueCapacity) : ingest(ingest)
+{
+  if (shardCount == 0)
+    shardCount = 1;
+  for (size_t i = 0; i < shardCount; i++)
+    shards.emplace_back(new Shard(queueCapacity));
+  for (size_t s = 0; s < SLOTS; s++)
+    slots[s].owner.store((uint32_t)(s % shardCount), std::memory_order_relaxed);
+  for (size_t i = 0; i < shardCount; i++)
+    shards[i]->thread = std::thread(&IngestPipeline::run, this, i);
+}
+
+IngestPipeline::~IngestPipeline()
+{
+  shutdown();
+}
+
+bool IngestPipeline::submit(std::shared_ptr<std::vector<uint8_t>> batch, Completion done)
+{
+  if (stopping.load(std::memory_order_acquire))
+    return false;
+  UplinkBatchHeader header;
+  uint64_t deviceId = 0;
+  uint16_t records = 0;
+  if (decodeUplinkHeader(batch->data(), batch->size(), header))
+  {
+    deviceId = header.deviceId;
+    records = header.recordCount;
+  }
+
+  size_t slot = slotOf(deviceId);
+  Job *job = new Job{std::move(batch), std::move(done), nowUs(), (uint16_t)slot, records, false, 0, {}};
+  // rebalance() waits for routing to drop to 0 before queueing its marker
+  slots[slot].routing.fetch_add(1, std::memory_order_seq_cst);
+  Shard &shard = *shards[slots[slot].owner.load(std::memory_order_seq_cst)];
+  shard.enqueued++; // before the push so depth never reads negative
+  bool queued = shard.queue.push(job);
+  slots[slot].routing.fetch_sub(1, std::memory_order_release);
+  if (!queued)
+  {
+    shard.enqueued--;
+    shard.refused++;
+    delete job;
+    return false;
+  }
+  wakeUp(shard);
+  return true;
+}
+
+void IngestPipeline::wakeUp(Shard &shard)
+{
+  // Pairs with the fence in run(): either the worker sees the new work or
+  // we see it going to sleep
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (shard.sleeping.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> guard(shard.sleepLock);
+    shard.wake.notify_one();
+  }
+}
+
+void IngestPipeline::run(size_t index)
+{
+  Shard &shard = *shards[index];
+  while (true)
+  {
+    // Slots moved in: their parked batches go first once the old shard let go
+    if (!shard.parked.empty() &&
+        slots[shard.parked.front()->slot].incoming.load(std::memory_order_acquire) != (int32_t)index)
+    {
+      while (!shard.parked.empty())
+      {
+        Job *job = shard.parked.front();
+        shard.parked.pop_front();
+        handle(shard, job);
+      }
+      continue;
+    }
+
+    Job *job;
+    if (shard.queue.pop(job))
+    {
+      if (!job->marker && slots[job->slot].incoming.load(std::memory_order_acquire) == (int32_t)index)
+        shard.parked.push_back(job);
+      else
+        handle(shard, job);
+      continue;
+    }
+
+    if (stopping.load(std::memory_order_acquire) && shard.parked.empty())
+      return; // stopping and drained
+    shard.lagUs.store(0, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> guard(shard.sleepLock);
+    shard.sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool blocked = shard.parked.empty() ||
+                   slots[shard.parked.front()->slot].incoming.load(std::memory_order_acquire) == (int32_t)index;
+    if (shard.queue.empty() && blocked && !(stopping.load(std::memory_order_acquire) && shard.parked.empty()))
+      shard.wake.wait_for(guard, std::chrono::milliseconds(100));
+    shard.sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+void IngestPipeline::handle(Shard &shard, Job *job)
+{
+  if (job->marker)
+  {
+    // Everything queued here for the slots is done: hand their windows over
+    for (uint16_t moved : job->movedSlots)
+      slots[moved].incoming.store(-1, std::memory_order_release);
+    wakeUp(*shards[job->target]);
+    delete job;
+    return;
+  }
+
+  Slot &slot = slots[job->slot];
+  uint64_t waited = nowUs() - job->enqueuedUs;
+  shard.lagUs.store(waited, std::memory_order_relaxed);
+  shard.waitUs.fetch_add(waited, std::memory_order_relaxed);
+  UplinkAck ack = ingest.process(job->batch->data(), job->batch->size(), &slot.devices);
+  slot.records.fetch_add(job->records, std::memory_order_relaxed);
+  shard.records.fetch_add(job->records, std::memory_order_relaxed);
+  shard.processed.fetch_add(1, std::memory_order_release);
+  if (job->done)
+    job->done(ack);
+  delete job;
+}
+
+bool IngestPipeline::rebalance()
+{
+  size_t count = shards.size();
+  std::vector<uint64_t> load(count, 0);
+  uint64_t slotLoad[SLOTS];
+  uint64_t total = 0;
+  for (size_t s = 0; s < SLOTS; s++)
+  {
+    uint64_t records = slots[s].records.load(std::memory_order_relaxed);
+    slotLoad[s] = records - slots[s].lastRecords;
+    slots[s].lastRecords = records;
+    load[slots[s].owner.load(std::memory_order_relaxed)] += slotLoad[s];
+    total += slotLoad[s];
+  }
+
+  if (!moving.empty())
+  {
+    if (slots[moving.front()].incoming.load(std::memory_order_acquire) >= 0)
+      return false;
+    moving.clear();
+  }
+  if (count < 2 || stopping.load(std::memory_order_acquire))
+    return false;
+
+  size_t hot = 0, cold = 0;
+  for (size_t i = 1; i < count; i++)
+  {
+    if (load[i] > load[hot])
+      hot = i;
+    if (load[i] < load[cold])
+      cold = i;
+  }
+  double mean = (double)total / count;
+  if (load[hot] < REBALANCE_MIN_RECORDS || load[hot] < REBALANCE_RATIO * mean)
+    return false;
+
+  // Hot's busiest slots that close the gap without making cold the new hot
+  std::vector<uint16_t> candidates;
+  for (size_t s = 0; s < SLOTS; s++)
+  {
+    if (slots[s].owner.load(std::memory_order_relaxed) == hot && slotLoad[s] > 0)
+      candidates.push_back((uint16_t)s);
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [&slotLoad](uint16_t a, uint16_t b) { return slotLoad[a] > slotLoad[b]; });
+  uint64_t gap = (load[hot] - load[cold]) / 2;
+  uint64_t taken = 0;
+  for (uint16_t s : candidates)
+  {
+    if (taken + slotLoad[s] <= gap)
+    {
+      moving.push_back(s);
+      taken += slotLoad[s];
+    }
+  }
+  if (moving.empty())
+    return false; // one device is the whole load; moving it only moves the problem
+
+  // New batches go to cold and park there; batches already being routed to
+  // hot are pushed before the marker
+  for (uint16_t s : moving)
+  {
+    slots[s].incoming.store((int32_t)cold, std::memory_order_seq_cst);
+    slots[s].owner.store((uint32_t)cold, std::memory_order_seq_cst);
+  }
+  for (uint16_t s : moving)
+  {
+    while (slots[s].routing.load(std::memory_order_seq_cst) != 0)
+      std::this_thread::yield();
+  }
+  Job *marker = new Job{nullptr, nullptr, nowUs(), moving.front(), 0, true, (uint32_t)cold, moving};
+  while (!shards[hot]->queue.push(marker))
+    std::this_thread::yield(); // hot is draining; parked batches wait for this
+  wakeUp(*shards[hot]);
+  moveCount++;
+  return true;
+}
+
+void IngestPipeline::shutdown()
+{
+  if (joined)
+    return;
+  joined = true;
+  stopping.store(true, std::memory_order_release);
+  for (std::unique_ptr<Shard> &shard : shards)
+  {
+    {
+      std::lock_guard<std::mutex> guard(shard->sleepLock);
+      shard->wake.notify_one();
+    }
+    if (shard->thread.joinable())
+      shard->thread.join();
+  }
+}
+
+IngestShardMetrics IngestPipeline::metrics(size_t index) const
+{
+  const Shard &shard = *shards[index];
+  IngestShardMetrics metrics = {};
+  metrics.batches = shard.processed.load(std::memory_order_acquire);
+  uint64_t enqueued = shard.enqueued.load(std::memory_order_relaxed);
+  metrics.depth = enqueued > metrics.batches ? (size_t)(enqueued - metrics.batches) : 0;
+  metrics.lagMs = shard.lagUs.load(std::memory_order_relaxed) / 1000.0;
+  metrics.meanWaitMs = metrics.batches ? shard.waitUs.load(std::memory_order_relaxed) / 1000.0 / metrics.batches : 0;
+  metrics.records = shard.records.load(std::memory_order_relaxed);
+  metrics.refused = shard.refused.load(std::memory_order_relaxed);
+  for (size_t s = 0; s < SLOTS; s++)
+  {
+    if (slots[s].owner.load(std::memory_order_relaxed) == index)
+      metrics.slots++;
+  }
+  return metrics;
+}
+
+size_t IngestPipeline::queueDepth() const
+{
+  size_t depth = 0;
+  for (size_t i = 0; i < shards.size(); i++)
+  {
+    const Shard &shard = *shards[i];
+    uint64_t processed = shard.processed.load(std::memory_order_acquire);
+    uint64_t enqueued = shard.enqueued.load(std::memory_order_relaxed);
+    depth += enqueued > processed ? (size_t)(enqueued - processed) : 0;
+  }
+  return depth;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,154 @@
+/*
+ * VitalCare Rural Gateway - Sharded Ingest Pipeline
+ *
+ * Records of one device must be applied in order; devices are independent.
+ * Device ids hash onto SLOTS routing slots and each slot belongs to one of
+ * N single-threaded shard workers, each draining its own MpscQueue. All of
+ * a device's batches are processed by one thread in arrival order, and a
+ * slot's deduplication windows belong to that thread alone, so ingest
+ * takes no lock (the sinks keep their per-series locks, which no longer
+ * see two writers for one device).
+ *
+ * Metrics per shard: queue depth, lag (how long the batch being processed
+ * waited in the queue; 0 when idle), mean queue wait, batches and records
+ * processed, batches refused on a full queue and slots owned.
+ *
+ * rebalance() compares the records each shard processed since the previous
+ * call. When the busiest shard did more than REBALANCE_RATIO times the
+ * mean, its busiest slots that together close at most half the gap to the
+ * idlest shard move there; a hot clinic is a handful of hot slots. A move
+ * keeps per-device order with any number of producers: the slots' owner
+ * changes first, then the rebalancer waits out producers still routing to
+ * the old shard (a per-slot counter) and queues one marker behind their
+ * batches. The new shard parks the slots' batches until the old one
+ * reaches the marker and hands the slots' windows over. One move is in
+ * flight at a time.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Ingest.h"
+#include "MpscQueue.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+struct IngestShardMetrics
+{
+  size_t depth;
+  double lagMs;
+  double meanWaitMs;
+  uint64_t batches;
+  uint64_t records;
+  uint64_t refused;
+  size_t slots;
+};
+
+class IngestPipeline
+{
+public:
+  typedef std::function<void(const UplinkAck &ack)> Completion;
+
+  static const size_t SLOTS = 1024;
+  static const size_t DEFAULT_QUEUE_CAPACITY = 1024;
+  static constexpr double REBALANCE_RATIO = 1.5;
+  static const uint64_t REBALANCE_MIN_RECORDS = 1000; // per interval; below this nothing is hot
+
+  IngestPipeline(IngestService &ingest, size_t shards, size_t queueCapacity = DEFAULT_QUEUE_CAPACITY);
+  ~IngestPipeline();
+
+  IngestPipeline(const IngestPipeline &) = delete;
+  IngestPipeline &operator=(const IngestPipeline &) = delete;
+
+  // Routes the batch by the device id in its header (undecodable batches
+  // route as device 0 and are rejected there); done runs on the shard
+  // worker. False when that shard's queue is full or the pipeline is
+  // stopping.
+  bool submit(std::shared_ptr<std::vector<uint8_t>> batch, Completion done);
+
+  // Makes at most one move; true if it did. One thread at a time (the
+  // gateway's I/O loop).
+  bool rebalance();
+
+  // Finishes queued batches, then joins the workers
+  void shutdown();
+
+  size_t shardCount() const { return shards.size(); }
+  IngestShardMetrics metrics(size_t shard) const;
+  size_t queueDepth() const;
+  uint64_t moves() const { return moveCount; }
+
+  size_t slotOf(uint64_t deviceId) const { return (size_t)((deviceId * 0x9E3779B97F4A7C15ull) >> 54); }
+  size_t shardOf(uint64_t deviceId) const { return slots[slotOf(deviceId)].owner.load(std::memory_order_acquire); }
+
+private:
+  struct Job
+  {
+    std::shared_ptr<std::vector<uint8_t>> batch;
+    Completion done;
+    uint64_t enqueuedUs;
+    uint16_t slot;
+    uint16_t records;
+    bool marker; // movedSlots go to target after this
+    uint32_t target;
+    std::vector<uint16_t> movedSlots;
+  };
+
+  struct Slot
+  {
+    std::atomic<uint32_t> owner{0};
+    std::atomic<int32_t> incoming{-1};  // shard parking the slot's batches during a move
+    std::atomic<uint32_t> routing{0};   // producers between reading owner and pushing
+    std::atomic<uint64_t> records{0};
+    uint64_t lastRecords = 0;           // rebalance()
+    IngestService::DeviceTable devices; // the owner's only
+  };
+
+  struct Shard
+  {
+    explicit Shard(size_t capacity) : queue(capacity) {}
+
+    MpscQueue<Job *> queue;
+    std::deque<Job *> parked; // batches of a slot moving in, in order
+    std::thread thread;
+
+    std::atomic<bool> sleeping{false};
+    std::mutex sleepLock;
+    std::condition_variable wake;
+
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> refused{0};
+    std::atomic<uint64_t> waitUs{0};
+    std::atomic<uint64_t> lagUs{0};
+  };
+
+  void run(size_t index);
+  void handle(Shard &shard, Job *job);
+  void wakeUp(Shard &shard);
+
+  IngestService &ingest;
+  std::vector<std::unique_ptr<Shard>> shards;
+  Slot slots[SLOTS];
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> moveCount{0};
+  std::vector<uint16_t> moving; // rebalance()
+  bool joined = false;
+};
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,105 @@
+/*
+ * VitalCare Rural Gateway - Bounded MPSC Queue
+ *
+ * Lock-free ring for many producers and one consumer (Vyukov's bounded
+ * queue with the consumer side simplified). Each cell carries a sequence
+ * number: a producer claims a slot by advancing the tail with a CAS and
+ * publishes it by storing sequence = position + 1; the consumer takes the
+ * cell once it sees that sequence and hands it back for the next lap with
+ * position + capacity. push() fails instead of waiting when the ring is
+ * full, so callers can answer "busy" like WorkerPool::submit().
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+template <typename T>
+class MpscQueue
+{
+public:
+  // capacity is rounded up to a power of two
+  explicit MpscQueue(size_t capacity) : head(0)
+  {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    mask = size - 1;
+    cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // Any thread; false when full
+  bool push(T value)
+  {
+    size_t position = tail.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true)
+    {
+      cell = &cells[position & mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+      if (difference == 0)
+      {
+        if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (difference < 0)
+      {
+        return false; // the consumer has not freed this cell yet
+      }
+      else
+      {
+        position = tail.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // The consumer thread only
+  bool pop(T &value)
+  {
+    Cell &cell = cells[head & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+      return false;
+    value = std::move(cell.value);
+    cell.sequence.store(head + mask + 1, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+  // The consumer thread only
+  bool empty() const { return cells[head & mask].sequence.load(std::memory_order_acquire) != head + 1; }
+
+  size_t capacity() const { return mask + 1; }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> tail; // producers
+  alignas(64) size_t head;              // consumer
+};
+
+} // namespace gateway
+} // namespace vitalcare
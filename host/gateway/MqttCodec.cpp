@@ -0,0 +1,236 @@
+/*
+ * VitalCare Rural Gateway - MQTT 3.1.1 Framing
+ */
+
+#include "MqttCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static void appendRemainingLength(std::string &out, size_t length)
+{
+  do
+  {
+    uint8_t digit = length & 0x7F;
+    length >>= 7;
+    out.push_back((char)(length ? digit | 0x80 : digit));
+  } while (length);
+}
+
+static void appendU16(std::string &out, uint16_t value)
+{
+  out.push_back((char)(value >> 8));
+  out.push_back((char)value);
+}
+
+static void appendString(std::string &out, const std::string &value)
+{
+  appendU16(out, (uint16_t)value.size());
+  out.append(value);
+}
+
+// Cursor over a packet body; MQTT integers are big-endian
+struct MqttReader
+{
+  const uint8_t *data;
+  size_t length;
+  size_t offset;
+  bool ok;
+
+  MqttReader(const MqttPacket &packet) : data(packet.body), length(packet.length), offset(0), ok(true) {}
+
+  uint8_t u8()
+  {
+    if (offset + 1 > length)
+    {
+      ok = false;
+      return 0;
+    }
+    return data[offset++];
+  }
+
+  uint16_t u16()
+  {
+    if (offset + 2 > length)
+    {
+      ok = false;
+      return 0;
+    }
+    uint16_t value = (uint16_t)((data[offset] << 8) | data[offset + 1]);
+    offset += 2;
+    return value;
+  }
+
+  std::string string()
+  {
+    uint16_t size = u16();
+    if (!ok || offset + size > length)
+    {
+      ok = false;
+      return std::string();
+    }
+    std::string value((const char *)data + offset, size);
+    offset += size;
+    return value;
+  }
+};
+
+ParseResult parseMqttPacket(const uint8_t *data, size_t length, size_t maxPacket, MqttPacket &packet,
+                            size_t &consumed)
+{
+  if (length < 2)
+    return PARSE_INCOMPLETE;
+
+  size_t remaining = 0;
+  size_t offset = 1;
+  for (int shift = 0;; shift += 7)
+  {
+    if (shift > 21)
+      return PARSE_ERROR; // more than four length bytes
+    if (offset >= length)
+      return PARSE_INCOMPLETE;
+    uint8_t digit = data[offset++];
+    remaining |= (size_t)(digit & 0x7F) << shift;
+    if (!(digit & 0x80))
+      break;
+  }
+  if (remaining > maxPacket)
+    return PARSE_ERROR;
+  if (length < offset + remaining)
+    return PARSE_INCOMPLETE;
+
+  packet.type = data[0] >> 4;
+  packet.flags = data[0] & 0x0F;
+  packet.body = data + offset;
+  packet.length = remaining;
+  consumed = offset + remaining;
+  return PARSE_COMPLETE;
+}
+
+bool parseMqttPublish(const MqttPacket &packet, MqttPublish &publish)
+{
+  MqttReader reader(packet);
+  publish.qos = (packet.flags >> 1) & 0x03;
+  publish.topic = reader.string();
+  publish.packetId = publish.qos > 0 ? reader.u16() : 0;
+  if (!reader.ok || publish.qos > 2)
+    return false;
+  publish.payload = packet.body + reader.offset;
+  publish.payloadLength = packet.length - reader.offset;
+  return true;
+}
+
+bool parseMqttConnect(const MqttPacket &packet, std::string &clientId)
+{
+  MqttReader reader(packet);
+  std::string protocol = reader.string();
+  uint8_t level = reader.u8();
+  reader.u8(); // connect flags: will/credentials are ignored
+  reader.u16(); // keep-alive
+  clientId = reader.string();
+  return reader.ok && protocol == "MQTT" && level == 4;
+}
+
+bool parseMqttSubscribe(const MqttPacket &packet, uint16_t &packetId, std::string &filter)
+{
+  MqttReader reader(packet);
+  packetId = reader.u16();
+  filter = reader.string();
+  reader.u8(); // requested QoS
+  return reader.ok && !filter.empty();
+}
+
+bool parseMqttAck(const MqttPacket &packet, uint16_t &packetId)
+{
+  MqttReader reader(packet);
+  packetId = reader.u16();
+  return reader.ok;
+}
+
+bool mqttTopicMatches(const std::string &filter, const std::string &topic)
+{
+  size_t f = 0;
+  size_t t = 0;
+  while (f < filter.size())
+  {
+    if (filter[f] == '#')
+      return true;
+    if (filter[f] == '+')
+    {
+      while (t < topic.size() && topic[t] != '/')
+        t++;
+      f++;
+      continue;
+    }
+    if (t >= topic.size() || filter[f] != topic[t])
+      return false;
+    f++;
+    t++;
+  }
+  return t == topic.size();
+}
+
+void appendMqttConnect(std::string &out, const std::string &clientId, uint16_t keepAliveSeconds)
+{
+  out.push_back((char)(MQTT_CONNECT << 4));
+  appendRemainingLength(out, 10 + 2 + clientId.size());
+  appendString(out, "MQTT");
+  out.push_back(4);    // protocol level 3.1.1
+  out.push_back(0x02); // clean session
+  appendU16(out, keepAliveSeconds);
+  appendString(out, clientId);
+}
+
+void appendMqttConnack(std::string &out, uint8_t returnCode)
+{
+  out.push_back((char)(MQTT_CONNACK << 4));
+  out.push_back(2);
+  out.push_back(0); // no session present
+  out.push_back((char)returnCode);
+}
+
+void appendMqttPublish(std::string &out, const std::string &topic, uint8_t qos, uint16_t packetId,
+                       const void *payload, size_t length)
+{
+  out.push_back((char)((MQTT_PUBLISH << 4) | (qos << 1)));
+  appendRemainingLength(out, 2 + topic.size() + (qos ? 2 : 0) + length);
+  appendString(out, topic);
+  if (qos)
+    appendU16(out, packetId);
+  out.append((const char *)payload, length);
+}
+
+void appendMqttPuback(std::string &out, uint16_t packetId)
+{
+  out.push_back((char)(MQTT_PUBACK << 4));
+  out.push_back(2);
+  appendU16(out, packetId);
+}
+
+void appendMqttSubscribe(std::string &out, uint16_t packetId, const std::string &filter, uint8_t qos)
+{
+  out.push_back((char)((MQTT_SUBSCRIBE << 4) | 0x02)); // reserved flags
+  appendRemainingLength(out, 2 + 2 + filter.size() + 1);
+  appendU16(out, packetId);
+  appendString(out, filter);
+  out.push_back((char)qos);
+}
+
+void appendMqttSuback(std::string &out, uint16_t packetId, uint8_t grantedQos)
+{
+  out.push_back((char)(MQTT_SUBACK << 4));
+  out.push_back(3);
+  appendU16(out, packetId);
+  out.push_back((char)grantedQos);
+}
+
+void appendMqttPingresp(std::string &out)
+{
+  out.push_back((char)(MQTT_PINGRESP << 4));
+  out.push_back(0);
+}
+
+} // namespace gateway
+} // namespace vitalcare
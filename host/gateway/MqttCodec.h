@@ -0,0 +1,82 @@
+/*
+ * VitalCare Rural Gateway - MQTT 3.1.1 Framing
+ *
+ * The subset a device uplink needs: CONNECT/CONNACK, PUBLISH at QoS 0 and 1
+ * with PUBACK, SUBSCRIBE/SUBACK for the ack topic, PINGREQ/PINGRESP and
+ * DISCONNECT. The gateway is the only "broker" these devices talk to, so
+ * there is no retained state, will message or session persistence.
+ *
+ * Topics:
+ *   vitalcare/<device>/uplink   device -> gateway, payload is one batch
+ *   vitalcare/<device>/ack      gateway -> device, payload is the batch ack
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "HttpCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+enum MqttPacketType : uint8_t
+{
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8,
+  MQTT_SUBACK = 9,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14,
+};
+
+struct MqttPacket
+{
+  uint8_t type = 0;
+  uint8_t flags = 0;
+  const uint8_t *body = nullptr; // variable header and payload
+  size_t length = 0;
+};
+
+struct MqttPublish
+{
+  std::string topic;
+  uint8_t qos = 0;
+  uint16_t packetId = 0;
+  const uint8_t *payload = nullptr;
+  size_t payloadLength = 0;
+};
+
+// Splits one packet off the front of data (fixed header and remaining
+// length). On PARSE_COMPLETE, consumed is the full packet size.
+ParseResult parseMqttPacket(const uint8_t *data, size_t length, size_t maxPacket, MqttPacket &packet,
+                            size_t &consumed);
+
+bool parseMqttPublish(const MqttPacket &packet, MqttPublish &publish);
+// Client id of a CONNECT; false if the protocol is not MQTT 3.1.1
+bool parseMqttConnect(const MqttPacket &packet, std::string &clientId);
+// Packet id and first topic filter of a SUBSCRIBE
+bool parseMqttSubscribe(const MqttPacket &packet, uint16_t &packetId, std::string &filter);
+bool parseMqttAck(const MqttPacket &packet, uint16_t &packetId);
+
+// MQTT wildcard match: '+' one level, '#' the rest
+bool mqttTopicMatches(const std::string &filter, const std::string &topic);
+
+void appendMqttConnect(std::string &out, const std::string &clientId, uint16_t keepAliveSeconds);
+void appendMqttConnack(std::string &out, uint8_t returnCode);
+void appendMqttPublish(std::string &out, const std::string &topic, uint8_t qos, uint16_t packetId,
+                       const void *payload, size_t length);
+void appendMqttPuback(std::string &out, uint16_t packetId);
+void appendMqttSubscribe(std::string &out, uint16_t packetId, const std::string &filter, uint8_t qos);
+void appendMqttSuback(std::string &out, uint16_t packetId, uint8_t grantedQos);
+void appendMqttPingresp(std::string &out);
+
+} // namespace gateway
+} // namespace vitalcare
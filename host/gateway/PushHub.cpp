@@ -0,0 +1,406 @@
+/*
+ * VitalCare Rural Gateway - Live Push Hub
+ */
+
+#include "PushHub.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "WebSocketCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const size_t READ_CHUNK = 4096;
+static const size_t MAX_CLIENT_INPUT = 64 * 1024;
+static const size_t MAX_CLIENT_FRAME = 4096;
+static const int MAX_IOVECS = 64;
+// A shard this far behind drops keyed messages at publish time
+static const size_t INBOX_LIMIT = 65536;
+
+PushHub::PushHub(size_t senderThreads, size_t queueLimit) : queueLimit(queueLimit ? queueLimit : 1)
+{
+  for (size_t i = 0; i < (senderThreads ? senderThreads : 1); i++)
+    shards.emplace_back(new Shard());
+}
+
+PushHub::~PushHub()
+{
+  stop();
+}
+
+void PushHub::start()
+{
+  if (running)
+    return;
+  running = true;
+  for (std::unique_ptr<Shard> &shard : shards)
+  {
+    Shard *s = shard.get();
+    s->thread = std::thread([s]() { s->loop.run(); });
+  }
+}
+
+void PushHub::stop()
+{
+  if (!running)
+    return;
+  running = false;
+  for (std::unique_ptr<Shard> &shard : shards)
+  {
+    Shard *s = shard.get();
+    s->loop.post([this, s]() {
+      while (!s->clients.empty())
+        closeClient(*s, *s->clients.begin()->second);
+      s->loop.stop();
+    });
+  }
+  for (std::unique_ptr<Shard> &shard : shards)
+    shard->thread.join();
+}
+
+void PushHub::adopt(int fd, std::string greeting)
+{
+  if (!running)
+  {
+    close(fd);
+    return;
+  }
+  Shard *shard = shards[nextShard++ % shards.size()].get();
+  Message message = greeting.empty() ? nullptr : std::make_shared<const std::string>(std::move(greeting));
+  shard->loop.post([this, shard, fd, message]() { attach(*shard, fd, message); });
+}
+
+void PushHub::publish(uint64_t coalesceKey, const char *text, size_t length)
+{
+  std::string frame;
+  frame.reserve(length + 10);
+  appendWebSocketFrame(frame, WS_TEXT, text, length);
+  publish(coalesceKey, std::make_shared<const std::string>(std::move(frame)));
+}
+
+void PushHub::publish(uint64_t coalesceKey, Message frame)
+{
+  stats.published++;
+  for (std::unique_ptr<Shard> &shard : shards)
+  {
+    Shard *s = shard.get();
+    bool wasEmpty;
+    {
+      std::lock_guard<std::mutex> guard(s->inboxLock);
+      if (coalesceKey != 0 && s->inbox.size() >= INBOX_LIMIT)
+      {
+        stats.dropped++;
+        continue;
+      }
+      wasEmpty = s->inbox.empty();
+      s->inbox.push_back(Queued{coalesceKey, 0, frame});
+    }
+    // One drain per burst: the shard moves the whole inbox at once
+    if (wasEmpty)
+      s->loop.post([this, s]() { drainInbox(*s); });
+  }
+}
+
+void PushHub::drainInbox(Shard &shard)
+{
+  {
+    std::lock_guard<std::mutex> guard(shard.inboxLock);
+    shard.delivering.swap(shard.inbox);
+  }
+  uint64_t coalesced = 0;
+  uint64_t dropped = 0;
+  for (auto &entry : shard.clients)
+  {
+    for (const Queued &item : shard.delivering)
+    {
+      Enqueued result = enqueue(*entry.second, item);
+      coalesced += result == ENQUEUE_COALESCED;
+      dropped += result == ENQUEUE_DROPPED;
+    }
+  }
+  shard.delivering.clear();
+  stats.coalesced += coalesced;
+  stats.dropped += dropped;
+
+  // flush() may close the client it is given, never another one
+  for (auto it = shard.clients.begin(); it != shard.clients.end();)
+  {
+    Client &client = *it->second;
+    ++it;
+    flush(shard, client);
+  }
+}
+
+void PushHub::attach(Shard &shard, int fd, Message greeting)
+{
+  std::unique_ptr<Client> client(new Client());
+  client->fd = fd;
+  client->events = EPOLLIN;
+  if (!shard.loop.add(fd, EPOLLIN, [this, &shard, fd](uint32_t events) { onEvents(shard, fd, events); }))
+  {
+    close(fd);
+    return;
+  }
+  if (greeting)
+    append(*client, 0, greeting);
+  Client &attached = *client;
+  shard.clients[fd] = std::move(client);
+  stats.clients++;
+  flush(shard, attached);
+}
+
+PushHub::Enqueued PushHub::enqueue(Client &client, const Queued &item)
+{
+  if (client.closing || client.overrun)
+    return ENQUEUE_CLOSING;
+
+  if (item.key != 0)
+  {
+    auto found = client.keyed.find(item.key);
+    if (found != client.keyed.end())
+    {
+      size_t index = found->second - client.queue.front().position;
+      // The front message may be half written; then the new one queues behind it
+      if (index > 0 || client.frontOffset == 0)
+      {
+        client.queue[index].message = item.message;
+        return ENQUEUE_COALESCED;
+      }
+    }
+  }
+
+  if (client.pending >= queueLimit)
+  {
+    if (item.key != 0)
+      return ENQUEUE_DROPPED;
+    // An alert cannot be dropped: it takes the place of the oldest unsent
+    // live reading, and a client with none to give up goes
+    if (!evictKeyed(client))
+    {
+      client.overrun = true;
+      return ENQUEUE_CLOSING;
+    }
+    append(client, item.key, item.message);
+    return ENQUEUE_DROPPED;
+  }
+
+  append(client, item.key, item.message);
+  return ENQUEUE_QUEUED;
+}
+
+void PushHub::append(Client &client, uint64_t key, const Message &message)
+{
+  uint64_t position = client.nextPosition++;
+  client.queue.push_back(Queued{key, position, message});
+  client.pending++;
+  if (key != 0)
+    client.keyed[key] = position;
+}
+
+// Leaves a tombstone so positions stay consecutive; flush() skips it
+bool PushHub::evictKeyed(Client &client)
+{
+  for (size_t i = client.frontOffset ? 1 : 0; i < client.queue.size(); i++)
+  {
+    Queued &queued = client.queue[i];
+    if (queued.key != 0 && queued.message)
+    {
+      client.keyed.erase(queued.key);
+      queued.message.reset();
+      client.pending--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PushHub::popFront(Client &client)
+{
+  Queued &front = client.queue.front();
+  if (front.message)
+  {
+    client.pending--;
+    if (front.key != 0)
+    {
+      auto found = client.keyed.find(front.key);
+      if (found != client.keyed.end() && found->second == front.position)
+        client.keyed.erase(found);
+    }
+  }
+  client.queue.pop_front();
+  client.frontOffset = 0;
+}
+
+void PushHub::onEvents(Shard &shard, int fd, uint32_t events)
+{
+  auto it = shard.clients.find(fd);
+  if (it == shard.clients.end())
+    return;
+  Client &client = *it->second;
+
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+  {
+    if (!readInput(client))
+    {
+      closeClient(shard, client);
+      return;
+    }
+  }
+  flush(shard, client);
+}
+
+// Answers pings and closes; false when the client has gone or misbehaves
+bool PushHub::readInput(Client &client)
+{
+  char chunk[READ_CHUNK];
+  while (true)
+  {
+    ssize_t got = recv(client.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+    if (got > 0)
+    {
+      client.input.append(chunk, got);
+      if (client.input.size() > MAX_CLIENT_INPUT)
+        return false;
+      continue;
+    }
+    if (got == 0)
+      return false;
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      break;
+    return false;
+  }
+
+  size_t offset = 0;
+  while (offset < client.input.size())
+  {
+    WebSocketFrame frame;
+    size_t consumed = 0;
+    ParseResult parsed = parseWebSocketFrame((const uint8_t *)client.input.data() + offset,
+                                             client.input.size() - offset, MAX_CLIENT_FRAME, frame, consumed);
+    if (parsed == PARSE_INCOMPLETE)
+      break;
+    if (parsed == PARSE_ERROR)
+      return false;
+    offset += consumed;
+
+    if (frame.opcode == WS_PING || frame.opcode == WS_CLOSE)
+    {
+      // Control answers bypass the limit: they are tiny and owed
+      std::string reply;
+      appendWebSocketFrame(reply, frame.opcode == WS_PING ? WS_PONG : WS_CLOSE, frame.payload.data(),
+                           frame.payload.size());
+      append(client, 0, std::make_shared<const std::string>(std::move(reply)));
+      if (frame.opcode == WS_CLOSE)
+      {
+        client.closing = true;
+        break;
+      }
+    }
+    // Data frames from a screen carry nothing we act on
+  }
+  client.input.erase(0, offset);
+  return true;
+}
+
+void PushHub::flush(Shard &shard, Client &client)
+{
+  if (client.overrun)
+  {
+    stats.slowClosed++;
+    closeClient(shard, client);
+    return;
+  }
+
+  uint64_t delivered = 0;
+  uint64_t written = 0;
+  while (true)
+  {
+    while (!client.queue.empty() && !client.queue.front().message)
+      popFront(client);
+    if (client.queue.empty())
+      break;
+
+    iovec iov[MAX_IOVECS];
+    int count = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < client.queue.size() && count < MAX_IOVECS; i++)
+    {
+      if (!client.queue[i].message)
+        continue;
+      const std::string &message = *client.queue[i].message;
+      size_t skip = i == 0 ? client.frontOffset : 0;
+      iov[count].iov_base = (void *)(message.data() + skip);
+      iov[count].iov_len = message.size() - skip;
+      total += iov[count].iov_len;
+      count++;
+    }
+    msghdr header = {};
+    header.msg_iov = iov;
+    header.msg_iovlen = count;
+    ssize_t sent = sendmsg(client.fd, &header, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      stats.delivered += delivered;
+      stats.bytes += written;
+      closeClient(shard, client);
+      return;
+    }
+
+    written += sent;
+    size_t left = sent;
+    while (left > 0)
+    {
+      while (!client.queue.front().message)
+        popFront(client);
+      size_t remaining = client.queue.front().message->size() - client.frontOffset;
+      if (left < remaining)
+      {
+        client.frontOffset += left;
+        break;
+      }
+      left -= remaining;
+      popFront(client);
+      delivered++;
+    }
+    if ((size_t)sent < total)
+      break; // socket buffer full
+  }
+  stats.delivered += delivered;
+  stats.bytes += written;
+
+  if (client.queue.empty() && client.closing)
+  {
+    closeClient(shard, client);
+    return;
+  }
+  uint32_t events = EPOLLIN | (client.queue.empty() ? 0u : (uint32_t)EPOLLOUT);
+  if (events != client.events)
+  {
+    client.events = events;
+    shard.loop.modify(client.fd, events);
+  }
+}
+
+void PushHub::closeClient(Shard &shard, Client &client)
+{
+  int fd = client.fd;
+  shard.loop.remove(fd);
+  close(fd);
+  stats.clients--;
+  shard.clients.erase(fd); // destroys client
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,143 @@
+/*
+ * VitalCare Rural Gateway - Live Push Hub
+ *
+ * Fans live vitals and alerts out to WebSocket clients (central monitoring
+ * screens). A message is framed once into a shared, reference-counted
+ * buffer; every client queue holds a pointer to it and the sender writes it
+ * with sendmsg() straight from that buffer, so a message costs one
+ * serialization however many clients see it.
+ *
+ * Clients are sharded by connection over a few sender threads, each with
+ * its own event loop. publish() only appends to each shard's inbox, so
+ * ingest workers never wait on a socket.
+ *
+ * Each client has a bounded queue. A message with a coalescing key (live
+ * vitals of one device) replaces a queued, unsent message with the same
+ * key, so a slow screen skips to the newest reading instead of falling
+ * behind. When the queue is full, new keyed messages are dropped, and an
+ * unkeyed message (alert) evicts the oldest unsent keyed one instead. A
+ * client whose queue holds nothing but alerts is disconnected rather than
+ * silently losing one.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "EventLoop.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+struct PushStats
+{
+  std::atomic<uint64_t> clients{0};    // connected now
+  std::atomic<uint64_t> published{0};  // messages published
+  std::atomic<uint64_t> delivered{0};  // messages written to a client in full
+  std::atomic<uint64_t> coalesced{0};  // replaced by a newer message in a client queue
+  std::atomic<uint64_t> dropped{0};    // keyed messages refused or evicted by a full queue
+  std::atomic<uint64_t> slowClosed{0}; // clients disconnected for a full queue
+  std::atomic<uint64_t> bytes{0};
+};
+
+class PushHub
+{
+public:
+  // One framed WebSocket message, shared by every queue that holds it
+  typedef std::shared_ptr<const std::string> Message;
+
+  static const size_t DEFAULT_QUEUE_LIMIT = 256;
+
+  PushHub(size_t senderThreads, size_t queueLimit = DEFAULT_QUEUE_LIMIT);
+  ~PushHub();
+
+  PushHub(const PushHub &) = delete;
+  PushHub &operator=(const PushHub &) = delete;
+
+  void start();
+  // Stops the sender threads and closes every client
+  void stop();
+
+  // Takes over a connected socket. greeting (the handshake answer) is sent
+  // before any message. Thread-safe.
+  void adopt(int fd, std::string greeting);
+
+  // Frames text as one WebSocket text message and queues it for every
+  // client. coalesceKey 0 means never coalesce. Thread-safe.
+  void publish(uint64_t coalesceKey, const char *text, size_t length);
+  void publish(uint64_t coalesceKey, Message frame);
+
+  size_t senderCount() const { return shards.size(); }
+  const PushStats &statistics() const { return stats; }
+
+private:
+  struct Queued
+  {
+    uint64_t key;
+    uint64_t position; // consecutive within a client queue
+    Message message;   // null: evicted
+  };
+
+  struct Client
+  {
+    int fd;
+    uint32_t events = 0;
+    std::deque<Queued> queue;
+    std::unordered_map<uint64_t, uint64_t> keyed; // coalescing key -> position of its queued message
+    uint64_t nextPosition = 0;
+    size_t pending = 0;     // queued messages, not counting evicted ones
+    size_t frontOffset = 0; // bytes of the front message already written
+    std::string input;
+    bool closing = false; // close once the queue has drained
+    bool overrun = false; // queue full of messages that cannot be dropped
+  };
+
+  struct Shard
+  {
+    EventLoop loop;
+    std::thread thread;
+    std::mutex inboxLock;
+    std::vector<Queued> inbox; // published, not yet in the client queues
+    std::vector<Queued> delivering;
+    std::unordered_map<int, std::unique_ptr<Client>> clients;
+  };
+
+  enum Enqueued
+  {
+    ENQUEUE_QUEUED,
+    ENQUEUE_COALESCED,
+    ENQUEUE_DROPPED,
+    ENQUEUE_CLOSING, // client is on its way out
+  };
+
+  void drainInbox(Shard &shard);
+  void attach(Shard &shard, int fd, Message greeting);
+  Enqueued enqueue(Client &client, const Queued &item);
+  void append(Client &client, uint64_t key, const Message &message);
+  bool evictKeyed(Client &client);
+  void popFront(Client &client);
+  void onEvents(Shard &shard, int fd, uint32_t events);
+  bool readInput(Client &client);
+  void flush(Shard &shard, Client &client);
+  void closeClient(Shard &shard, Client &client);
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  size_t queueLimit;
+  std::atomic<uint64_t> nextShard{0};
+  std::atomic<bool> running{false};
+  PushStats stats;
+};
+
+} // namespace gateway
+} // namespace vitalcare
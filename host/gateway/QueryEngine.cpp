@@ -0,0 +1,249 @@
+/*
+ * VitalCare Rural Gateway - Rollup Query Engine
+ */
+
+#include "QueryEngine.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const char *const FIELD_NAMES[FIELD_COUNT] = {"heartRate", "systolicBP", "diastolicBP", "spO2", "temperature"};
+
+const char *vitalFieldName(VitalField field)
+{
+  return field < FIELD_COUNT ? FIELD_NAMES[field] : "unknown";
+}
+
+bool parseVitalField(const char *name, VitalField &field)
+{
+  for (size_t f = 0; f < FIELD_COUNT; f++)
+  {
+    if (strcmp(name, FIELD_NAMES[f]) == 0)
+    {
+      field = (VitalField)f;
+      return true;
+    }
+  }
+  return false;
+}
+
+QueryEngine::QueryEngine(RollupStore &store, size_t scanThreads, size_t cacheSpans)
+    : store(store), scanners(scanThreads ? scanThreads : 1, 1024), cacheCapacity(cacheSpans)
+{
+}
+
+bool QueryEngine::plan(const RollupQuery &query, QueryPlan &plan) const
+{
+  if (query.toSeconds <= query.fromSeconds)
+    return false;
+  uint32_t step = std::max(query.stepSeconds, ROLLUP_TIER_SECONDS[TIER_MINUTE]);
+
+  int chosen = -1;
+  if (query.forceTier >= 0 && query.forceTier < ROLLUP_TIERS)
+  {
+    chosen = query.forceTier;
+  }
+  else
+  {
+    for (int t = ROLLUP_TIERS - 1; t >= 0 && chosen < 0; t--)
+    {
+      if (step % ROLLUP_TIER_SECONDS[t] == 0 && query.fromSeconds >= store.retainedFrom((RollupTier)t))
+        chosen = t;
+    }
+    // No tier both fits the step and reaches back far enough: the finest that reaches back
+    for (int t = 0; t < ROLLUP_TIERS && chosen < 0; t++)
+    {
+      if (query.fromSeconds >= store.retainedFrom((RollupTier)t))
+        chosen = t;
+    }
+    if (chosen < 0)
+      chosen = TIER_DAY;
+  }
+
+  uint32_t width = ROLLUP_TIER_SECONDS[chosen];
+  uint64_t wide = ((uint64_t)step + width - 1) / width * width;
+  uint64_t from = query.fromSeconds - query.fromSeconds % wide;
+  uint64_t to = ((uint64_t)query.toSeconds + wide - 1) / wide * wide;
+  if ((to - from) / wide > MAX_POINTS || to > UINT32_MAX)
+    return false;
+
+  plan.tier = (RollupTier)chosen;
+  plan.stepSeconds = (uint32_t)wide;
+  plan.fromSeconds = (uint32_t)from;
+  plan.toSeconds = (uint32_t)to;
+  plan.points = (size_t)((to - from) / wide);
+  return true;
+}
+
+bool QueryEngine::run(const RollupQuery &query, QueryResult &result)
+{
+  if (!plan(query, result.plan))
+    return false;
+  const QueryPlan &plan = result.plan;
+
+  std::vector<uint64_t> devices = query.devices.empty() ? store.seriesIds() : query.devices;
+  std::sort(devices.begin(), devices.end());
+  devices.erase(std::unique(devices.begin(), devices.end()), devices.end());
+  uint64_t signature = 0xCBF29CE484222325ull;
+  auto mix = [&signature](uint64_t value) { signature = (signature ^ value) * 0x100000001B3ull; };
+  for (uint64_t device : devices)
+    mix(device);
+  mix(((uint64_t)query.field << 40) | ((uint64_t)plan.tier << 32) | plan.stepSeconds);
+  // A scan task walks its devices shard by shard
+  std::sort(devices.begin(), devices.end(), [this](uint64_t a, uint64_t b) {
+    size_t shardA = store.shardOf(a), shardB = store.shardOf(b);
+    return shardA != shardB ? shardA < shardB : a < b;
+  });
+
+  // Spans of SPAN_POINTS steps aligned to the epoch, so every query with
+  // the same step shares them
+  uint64_t spanLength = (uint64_t)plan.stepSeconds * SPAN_POINTS;
+  uint64_t firstSpan = plan.fromSeconds - plan.fromSeconds % spanLength;
+  size_t spanCount = (size_t)((plan.toSeconds - firstSpan + spanLength - 1) / spanLength);
+  std::vector<QueryPoint> spans(spanCount * SPAN_POINTS);
+  uint32_t settled = store.settledBefore();
+  uint64_t generation = store.lateGeneration();
+
+  std::vector<bool> cacheable(spanCount);
+  std::vector<size_t> missing;
+  for (size_t s = 0; s < spanCount; s++)
+  {
+    uint64_t start = firstSpan + s * spanLength;
+    cacheable[s] = start + spanLength <= settled;
+    if (cacheable[s] && lookup(SpanKey{signature, (uint32_t)start}, generation, &spans[s * SPAN_POINTS]))
+      result.cachedSpans++;
+    else
+      missing.push_back(s);
+  }
+
+  // Consecutive missing spans are scanned as one range
+  std::vector<std::pair<size_t, size_t>> ranges; // first span, span count
+  for (size_t s : missing)
+  {
+    if (!ranges.empty() && ranges.back().first + ranges.back().second == s)
+      ranges.back().second++;
+    else
+      ranges.emplace_back(s, 1);
+  }
+
+  size_t parts = missing.empty() ? 0 : std::min(scanners.threadCount() + 1, devices.size());
+  std::vector<std::vector<QueryPoint>> partials(parts);
+  std::atomic<size_t> bucketsRead{0};
+  auto scanPart = [&](size_t part) {
+    std::vector<QueryPoint> &points = partials[part];
+    points.assign(spans.size(), QueryPoint());
+    size_t read = 0;
+    for (size_t d = devices.size() * part / parts; d < devices.size() * (part + 1) / parts; d++)
+    {
+      for (const std::pair<size_t, size_t> &range : ranges)
+      {
+        uint64_t from = firstSpan + range.first * spanLength;
+        read += store.scan(devices[d], plan.tier, query.field, (uint32_t)from,
+                           (uint32_t)std::min<uint64_t>(from + range.second * spanLength, UINT32_MAX),
+                           plan.stepSeconds, points.data() + range.first * SPAN_POINTS);
+      }
+    }
+    bucketsRead += read;
+  };
+
+  std::mutex doneLock;
+  std::condition_variable done;
+  size_t remaining = parts > 0 ? parts - 1 : 0;
+  for (size_t part = 1; part < parts; part++)
+  {
+    bool queued = scanners.submit([&, part]() {
+      scanPart(part);
+      std::lock_guard<std::mutex> guard(doneLock);
+      if (--remaining == 0)
+        done.notify_all();
+    });
+    if (!queued)
+    {
+      scanPart(part);
+      std::lock_guard<std::mutex> guard(doneLock);
+      remaining--;
+    }
+  }
+  if (parts > 0)
+    scanPart(0);
+  {
+    std::unique_lock<std::mutex> guard(doneLock);
+    done.wait(guard, [&remaining]() { return remaining == 0; });
+  }
+
+  for (size_t s : missing)
+  {
+    QueryPoint *span = &spans[s * SPAN_POINTS];
+    for (const std::vector<QueryPoint> &partial : partials)
+    {
+      for (size_t i = 0; i < SPAN_POINTS; i++)
+        span[i].merge(partial[s * SPAN_POINTS + i]);
+    }
+    if (cacheable[s])
+      insert(SpanKey{signature, (uint32_t)(firstSpan + s * spanLength)}, generation, span);
+  }
+
+  size_t offset = (size_t)((plan.fromSeconds - firstSpan) / plan.stepSeconds);
+  result.points.assign(spans.begin() + offset, spans.begin() + offset + plan.points);
+  result.devices = devices.size();
+  result.spans = spanCount;
+  result.bucketsRead = bucketsRead;
+
+  stats.queries++;
+  stats.spans += spanCount;
+  stats.cachedSpans += result.cachedSpans;
+  stats.bucketsRead += result.bucketsRead;
+  return true;
+}
+
+bool QueryEngine::lookup(const SpanKey &key, uint64_t generation, QueryPoint *points)
+{
+  std::lock_guard<std::mutex> guard(cacheLock);
+  auto found = cache.find(key);
+  if (found == cache.end())
+    return false;
+  if (found->second->generation != generation)
+  {
+    lru.erase(found->second);
+    cache.erase(found);
+    return false;
+  }
+  lru.splice(lru.begin(), lru, found->second);
+  std::copy(found->second->points.begin(), found->second->points.end(), points);
+  return true;
+}
+
+void QueryEngine::insert(const SpanKey &key, uint64_t generation, const QueryPoint *points)
+{
+  if (cacheCapacity == 0)
+    return;
+  std::lock_guard<std::mutex> guard(cacheLock);
+  auto found = cache.find(key);
+  if (found != cache.end())
+  {
+    lru.erase(found->second);
+    cache.erase(found);
+  }
+  lru.push_front(CachedSpan{key, generation, std::vector<QueryPoint>(points, points + SPAN_POINTS)});
+  cache[key] = lru.begin();
+  while (cache.size() > cacheCapacity)
+  {
+    cache.erase(lru.back().key);
+    lru.pop_back();
+  }
+}
+
+void QueryEngine::clearCache()
+{
+  std::lock_guard<std::mutex> guard(cacheLock);
+  cache.clear();
+  lru.clear();
+}
+
+} // namespace gateway
+} // namespace vitalcare
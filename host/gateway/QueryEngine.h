@@ -0,0 +1,134 @@
+/*
+ * VitalCare Rural Gateway - Rollup Query Engine
+ *
+ * Answers "this vital for these devices from..to at this resolution".
+ *
+ * - Planner: picks the coarsest rollup tier whose bucket width divides the
+ *   requested step and that still holds the start of the range; the step
+ *   is rounded up to a multiple of the tier width. A week at 15 min reads
+ *   672 buckets per device instead of 10080 minute buckets.
+ * - Scan: the devices are split into contiguous runs of store shards and
+ *   scanned in parallel on the engine's own threads; partial results merge
+ *   into one series (count, mean, min, max per step).
+ * - Cache: results are kept per time bucket, SPAN_POINTS steps aligned to
+ *   the epoch, keyed by device set, vital, tier and step. Only settled
+ *   spans are cached, and a record landing in a settled bucket (an SD
+ *   backlog) invalidates them all, so a cached span is never stale. A
+ *   dashboard re-asking "the last 7 days" rescans only its newest span.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "RollupStore.h"
+#include "WorkerPool.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+struct RollupQuery
+{
+  std::vector<uint64_t> devices; // empty: every series
+  VitalField field = FIELD_HEART_RATE;
+  uint32_t fromSeconds = 0;
+  uint32_t toSeconds = 0;
+  uint32_t stepSeconds = 0;
+  int forceTier = -1; // benchmarks: skip the planner's choice
+};
+
+struct QueryPlan
+{
+  RollupTier tier;
+  uint32_t stepSeconds;
+  uint32_t fromSeconds; // aligned to the step
+  uint32_t toSeconds;
+  size_t points;
+};
+
+struct QueryResult
+{
+  QueryPlan plan;
+  std::vector<QueryPoint> points; // plan.points, stepSeconds apart from fromSeconds
+  size_t devices = 0;
+  size_t spans = 0;
+  size_t cachedSpans = 0;
+  size_t bucketsRead = 0;
+};
+
+struct QueryStats
+{
+  std::atomic<uint64_t> queries{0};
+  std::atomic<uint64_t> spans{0};
+  std::atomic<uint64_t> cachedSpans{0};
+  std::atomic<uint64_t> bucketsRead{0};
+};
+
+const char *vitalFieldName(VitalField field);
+// Accepts the JSON names (heartRate, systolicBP, ...)
+bool parseVitalField(const char *name, VitalField &field);
+
+class QueryEngine
+{
+public:
+  static const size_t SPAN_POINTS = 64;
+  static const size_t MAX_POINTS = 100000;
+  static const size_t DEFAULT_CACHE_SPANS = 8192;
+
+  QueryEngine(RollupStore &store, size_t scanThreads, size_t cacheSpans = DEFAULT_CACHE_SPANS);
+
+  QueryEngine(const QueryEngine &) = delete;
+  QueryEngine &operator=(const QueryEngine &) = delete;
+
+  // False for an empty range or one of more than MAX_POINTS steps
+  bool plan(const RollupQuery &query, QueryPlan &plan) const;
+  // Thread-safe; scans run on the engine's threads and the caller's
+  bool run(const RollupQuery &query, QueryResult &result);
+
+  void clearCache();
+  RollupStore &rollups() { return store; }
+  const QueryStats &statistics() const { return stats; }
+
+private:
+  struct SpanKey
+  {
+    uint64_t signature;
+    uint32_t start;
+    bool operator==(const SpanKey &other) const { return signature == other.signature && start == other.start; }
+  };
+  struct SpanKeyHash
+  {
+    size_t operator()(const SpanKey &key) const { return (size_t)(key.signature ^ (key.start * 0x9E3779B97F4A7C15ull)); }
+  };
+  struct CachedSpan
+  {
+    SpanKey key;
+    uint64_t generation;
+    std::vector<QueryPoint> points;
+  };
+
+  bool lookup(const SpanKey &key, uint64_t generation, QueryPoint *points);
+  void insert(const SpanKey &key, uint64_t generation, const QueryPoint *points);
+
+  RollupStore &store;
+  WorkerPool scanners;
+
+  std::mutex cacheLock;
+  std::list<CachedSpan> lru; // most recent first
+  std::unordered_map<SpanKey, std::list<CachedSpan>::iterator, SpanKeyHash> cache;
+  size_t cacheCapacity;
+
+  QueryStats stats;
+};
+
+} // namespace gateway
+} // namespace vitalcare
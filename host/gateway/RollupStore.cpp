@@ -0,0 +1,343 @@
+/*
+ * VitalCare Rural Gateway - Downsampled Rollups
+ */
+
+#include "RollupStore.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const uint32_t ROLLUP_MAGIC = 0x31524356; // "VCR1"
+
+void RollupBucket::add(const VitalRecord &record)
+{
+  records++;
+  if (record.alertFlags)
+    alertRecords++;
+  for (size_t f = 0; f < FIELD_COUNT; f++)
+  {
+    float value = vitalField(record.vitals, (VitalField)f);
+    if (value == 0)
+      continue;
+    VitalAggregate &aggregate = vitals[f];
+    int16_t fixed = (int16_t)lroundf(std::max(-3276.0f, std::min(value, 3276.0f)) * 10.0f);
+    if (aggregate.count == 0 || fixed < aggregate.min)
+      aggregate.min = fixed;
+    if (aggregate.count == 0 || fixed > aggregate.max)
+      aggregate.max = fixed;
+    aggregate.sum += value;
+    aggregate.count++;
+  }
+}
+
+void QueryPoint::merge(const VitalAggregate &aggregate)
+{
+  float low = aggregate.min / 10.0f;
+  float high = aggregate.max / 10.0f;
+  min = count == 0 || low < min ? low : min;
+  max = count == 0 || high > max ? high : max;
+  count += aggregate.count;
+  sum += aggregate.sum;
+}
+
+void QueryPoint::merge(const QueryPoint &other)
+{
+  if (other.count == 0)
+    return;
+  min = count == 0 || other.min < min ? other.min : min;
+  max = count == 0 || other.max > max ? other.max : max;
+  count += other.count;
+  sum += other.sum;
+}
+
+RollupStore::RollupStore(const RollupOptions &options) : options(options)
+{
+}
+
+uint32_t RollupStore::settledBefore() const
+{
+  uint32_t now = newest;
+  return now > SETTLE_SECONDS ? now - SETTLE_SECONDS : 0;
+}
+
+uint32_t RollupStore::retainedFrom(RollupTier tier) const
+{
+  const uint32_t days[ROLLUP_TIERS] = {options.minuteDays, options.quarterDays, options.dayDays};
+  uint64_t horizon = (uint64_t)days[tier] * 86400;
+  uint32_t now = newest;
+  return days[tier] == 0 || now <= horizon ? 0 : now - (uint32_t)horizon;
+}
+
+void RollupStore::addRecords(uint64_t deviceId, const VitalRecord *records, size_t count, uint64_t receivedMs)
+{
+  if (count == 0)
+    return;
+  const VitalRecord *latest = records;
+  for (size_t i = 1; i < count; i++)
+  {
+    if ((int32_t)(records[i].sequence - latest->sequence) > 0)
+      latest = &records[i];
+  }
+
+  Shard &shard = shards[shardOf(deviceId)];
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  Series &series = shard.series[deviceId];
+  // Only live data moves the anchor: a backlog's newest record is old
+  if (!series.anchored || (int32_t)(latest->sequence - series.anchorSequence) > 0)
+  {
+    series.anchored = true;
+    series.anchorSequence = latest->sequence;
+    series.anchorOffsetMs = (int64_t)receivedMs - (int64_t)latest->vitals.timestampMs;
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    int64_t wallMs = series.anchorOffsetMs + records[i].vitals.timestampMs;
+    if (wallMs >= 0 && wallMs / 1000 <= UINT32_MAX)
+      addLocked(series, records[i], (uint32_t)(wallMs / 1000));
+  }
+}
+
+void RollupStore::add(uint64_t deviceId, const VitalRecord &record, uint32_t wallSeconds)
+{
+  Shard &shard = shards[shardOf(deviceId)];
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  addLocked(shard.series[deviceId], record, wallSeconds);
+}
+
+void RollupStore::addLocked(Series &series, const VitalRecord &record, uint32_t wallSeconds)
+{
+  uint32_t seen = newest;
+  while (wallSeconds > seen && !newest.compare_exchange_weak(seen, wallSeconds))
+    ;
+  stats.records++;
+  if (wallSeconds < settledBefore())
+  {
+    late++;
+    stats.lateRecords++;
+  }
+
+  for (size_t t = 0; t < ROLLUP_TIERS; t++)
+  {
+    uint32_t width = ROLLUP_TIER_SECONDS[t];
+    uint32_t start = wallSeconds - wallSeconds % width;
+    uint32_t retained = retainedFrom((RollupTier)t);
+    if (start + width <= retained)
+      continue; // older than the tier keeps
+
+    std::deque<RollupBucket> &buckets = series.tiers[t];
+    while (!buckets.empty() && buckets.front().start + width <= retained)
+    {
+      buckets.pop_front();
+      stats.buckets[t]--;
+    }
+
+    // In order is the common case: the newest bucket or a new one after it
+    RollupBucket *bucket;
+    if (!buckets.empty() && buckets.back().start == start)
+    {
+      bucket = &buckets.back();
+    }
+    else if (buckets.empty() || buckets.back().start < start)
+    {
+      buckets.push_back(RollupBucket{start, 0, 0, {}});
+      stats.buckets[t]++;
+      bucket = &buckets.back();
+    }
+    else
+    {
+      auto it = std::lower_bound(buckets.begin(), buckets.end(), start,
+                                 [](const RollupBucket &b, uint32_t value) { return b.start < value; });
+      if (it == buckets.end() || it->start != start)
+      {
+        it = buckets.insert(it, RollupBucket{start, 0, 0, {}});
+        stats.buckets[t]++;
+      }
+      bucket = &*it;
+    }
+    bucket->add(record);
+  }
+}
+
+size_t RollupStore::scan(uint64_t deviceId, RollupTier tier, VitalField field, uint32_t fromSeconds,
+                         uint32_t toSeconds, uint32_t stepSeconds, QueryPoint *points)
+{
+  Shard &shard = shards[shardOf(deviceId)];
+  std::shared_lock<std::shared_mutex> guard(shard.lock);
+  auto found = shard.series.find(deviceId);
+  if (found == shard.series.end())
+    return 0;
+
+  const std::deque<RollupBucket> &buckets = found->second.tiers[tier];
+  auto it = std::lower_bound(buckets.begin(), buckets.end(), fromSeconds,
+                             [](const RollupBucket &b, uint32_t value) { return b.start < value; });
+  size_t read = 0;
+  for (; it != buckets.end() && it->start < toSeconds; ++it, ++read)
+  {
+    const VitalAggregate &aggregate = it->vitals[field];
+    if (aggregate.count)
+      points[(it->start - fromSeconds) / stepSeconds].merge(aggregate);
+  }
+  return read;
+}
+
+std::vector<uint64_t> RollupStore::seriesIds()
+{
+  std::vector<uint64_t> ids;
+  for (Shard &shard : shards)
+  {
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    for (auto &entry : shard.series)
+      ids.push_back(entry.first);
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+bool RollupStore::save(const std::string &path)
+{
+  std::string temporary = path + ".tmp";
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (!file)
+  {
+    perror(temporary.c_str());
+    return false;
+  }
+
+  uint32_t crc = 0;
+  bool ok = true;
+  auto write = [&](const void *data, size_t length) {
+    crc = crc32((const uint8_t *)data, length, crc);
+    ok = fwrite(data, 1, length, file) == length && ok;
+  };
+  write(&ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC));
+  uint32_t seriesCount = 0;
+  for (Shard &shard : shards)
+  {
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    for (auto &entry : shard.series)
+    {
+      write(&entry.first, sizeof(entry.first));
+      for (size_t t = 0; t < ROLLUP_TIERS; t++)
+      {
+        const std::deque<RollupBucket> &buckets = entry.second.tiers[t];
+        uint32_t count = (uint32_t)buckets.size();
+        write(&count, sizeof(count));
+        for (const RollupBucket &bucket : buckets)
+          write(&bucket, sizeof(bucket));
+      }
+      seriesCount++;
+    }
+  }
+  write(&seriesCount, sizeof(seriesCount));
+  ok = fwrite(&crc, 1, sizeof(crc), file) == sizeof(crc) && ok;
+  ok = fflush(file) == 0 && fdatasync(fileno(file)) == 0 && ok;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+  {
+    perror(path.c_str());
+    unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool RollupStore::load(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return errno == ENOENT; // first start
+  struct stat info;
+  const uint8_t *data = nullptr;
+  size_t length = 0;
+  if (fstat(fd, &info) == 0 && info.st_size >= 12)
+  {
+    length = (size_t)info.st_size;
+    void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    data = map == MAP_FAILED ? nullptr : (const uint8_t *)map;
+  }
+  ::close(fd);
+
+  uint32_t magic = 0, stored = 0, expectedSeries = 0;
+  if (data)
+  {
+    memcpy(&magic, data, 4);
+    memcpy(&expectedSeries, data + length - 8, 4);
+    memcpy(&stored, data + length - 4, 4);
+  }
+  if (!data || magic != ROLLUP_MAGIC || crc32(data, length - 4) != stored)
+  {
+    fprintf(stderr, "%s is damaged; rollups start empty\n", path.c_str());
+    if (data)
+      munmap((void *)data, length);
+    return false;
+  }
+
+  size_t offset = 4;
+  size_t end = length - 8;
+  uint32_t loaded = 0;
+  uint32_t latest = 0;
+  while (offset + 8 <= end)
+  {
+    uint64_t deviceId;
+    memcpy(&deviceId, data + offset, 8);
+    offset += 8;
+    Shard &shard = shards[shardOf(deviceId)];
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    Series &series = shard.series[deviceId];
+    for (size_t t = 0; t < ROLLUP_TIERS && offset + 4 <= end; t++)
+    {
+      uint32_t count;
+      memcpy(&count, data + offset, 4);
+      offset += 4;
+      if (offset + (uint64_t)count * sizeof(RollupBucket) > end)
+        break;
+      std::deque<RollupBucket> &buckets = series.tiers[t];
+      buckets.resize(count);
+      for (uint32_t b = 0; b < count; b++, offset += sizeof(RollupBucket))
+        memcpy(&buckets[b], data + offset, sizeof(RollupBucket));
+      if (count > 0)
+        latest = std::max(latest, buckets.back().start);
+      stats.buckets[t] += count;
+    }
+    loaded++;
+  }
+  munmap((void *)data, length);
+  newest = std::max<uint32_t>(newest, latest);
+  return loaded == expectedSeries;
+}
+
+bool RollupSink::storeVitals(uint64_t deviceId, const uint8_t *records, size_t count)
+{
+  if (!next.storeVitals(deviceId, records, count))
+    return false;
+  VitalRecord decoded[UPLINK_MAX_RECORDS];
+  size_t valid = 0;
+  for (size_t i = 0; i < count && valid < UPLINK_MAX_RECORDS; i++)
+  {
+    if (decodeVitalRecord(records + i * VITAL_RECORD_SIZE, decoded[valid]))
+      valid++;
+  }
+  uint64_t nowMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+  rollups.addRecords(deviceId, decoded, valid, nowMs);
+  return true;
+}
+
+} // namespace gateway
+} // namespace vitalcare
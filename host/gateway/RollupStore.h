@@ -0,0 +1,203 @@
+/*
+ * VitalCare Rural Gateway - Downsampled Rollups
+ *
+ * Dashboards ask for days to a year of a vital at minute-to-day
+ * resolution. Decoding that from the raw store on every request would
+ * touch millions of rows, so the gateway keeps three rollup tiers per
+ * series, materialized as records are stored:
+ *
+ *   1 min   kept minuteDays (30)
+ *   15 min  kept quarterDays (730)
+ *   1 day   kept forever
+ *
+ * A bucket holds count, sum, min and max of each vital over its records
+ * (a reading of 0 is "no reading" and is left out) and how many records
+ * carried alert flags. Buckets are placed in wall-clock time: a device
+ * only has millis(), so each upload that advances the device's sequence
+ * anchors its clock to the gateway's (upload latency of a few seconds is
+ * well inside a minute bucket). Backlog records replayed from the SD
+ * card use the same anchor and land in the past buckets they belong to.
+ *
+ * Tiers are sharded by device like the store; scans take a shard's lock
+ * shared so queries run in parallel with each other and with ingest.
+ * Rollups are saved to rollups.vcr on checkpoint and on close and loaded
+ * on open; a crash loses the rollup updates since the last checkpoint
+ * (the raw records are in the store).
+ *
+ * rollups.vcr (native byte order; it never leaves the gateway):
+ *   u32 magic "VCR1", then per series u64 device id and per tier u32
+ *   bucket count + RollupBucket array; u32 series count, u32 CRC-32.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "AlertEngine.h"
+#include "Ingest.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+enum RollupTier : uint8_t
+{
+  TIER_MINUTE,
+  TIER_QUARTER_HOUR,
+  TIER_DAY,
+  ROLLUP_TIERS,
+};
+
+const uint32_t ROLLUP_TIER_SECONDS[ROLLUP_TIERS] = {60, 15 * 60, 24 * 60 * 60};
+const char *const ROLLUP_TIER_NAMES[ROLLUP_TIERS] = {"1m", "15m", "1d"};
+
+struct RollupOptions
+{
+  uint32_t minuteDays = 30;
+  uint32_t quarterDays = 730;
+  uint32_t dayDays = 0; // 0: forever
+};
+
+// min/max are x10 fixed point like VitalRecord
+struct VitalAggregate
+{
+  float sum;
+  uint32_t count;
+  int16_t min;
+  int16_t max;
+};
+
+struct RollupBucket
+{
+  uint32_t start; // wall clock, seconds
+  uint32_t records;
+  uint32_t alertRecords;
+  VitalAggregate vitals[FIELD_COUNT];
+
+  void add(const VitalRecord &record);
+};
+
+// One output step of a query: the buckets merged over devices and time
+struct QueryPoint
+{
+  uint64_t count = 0;
+  double sum = 0;
+  float min = 0;
+  float max = 0;
+
+  void merge(const VitalAggregate &aggregate);
+  void merge(const QueryPoint &other);
+  double mean() const { return count ? sum / count : 0.0; }
+};
+
+struct RollupStats
+{
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> lateRecords{0}; // into settled buckets (backlog replays)
+  std::atomic<uint64_t> buckets[ROLLUP_TIERS] = {};
+};
+
+class RollupStore
+{
+public:
+  // Buckets older than this before the newest data are settled: results
+  // over them can be cached until a late record arrives
+  static const uint32_t SETTLE_SECONDS = 2 * 60 * 60;
+
+  explicit RollupStore(const RollupOptions &options = RollupOptions());
+
+  RollupStore(const RollupStore &) = delete;
+  RollupStore &operator=(const RollupStore &) = delete;
+
+  // Anchors the device's clock (receivedMs: gateway wall clock, ms) and
+  // rolls the records up. Thread-safe.
+  void addRecords(uint64_t deviceId, const VitalRecord *records, size_t count, uint64_t receivedMs);
+  // One record at a known wall-clock time. Thread-safe.
+  void add(uint64_t deviceId, const VitalRecord &record, uint32_t wallSeconds);
+
+  // Merges field of one device's tier buckets in [fromSeconds, toSeconds)
+  // into points[(bucket.start - fromSeconds) / stepSeconds]. Returns the
+  // number of buckets read.
+  size_t scan(uint64_t deviceId, RollupTier tier, VitalField field, uint32_t fromSeconds, uint32_t toSeconds,
+              uint32_t stepSeconds, QueryPoint *points);
+
+  std::vector<uint64_t> seriesIds();
+  size_t shardOf(uint64_t deviceId) const { return (deviceId * 0x9E3779B97F4A7C15ull) >> 58; }
+
+  // Newest wall-clock second seen and the start of the settled range
+  uint32_t newestSeconds() const { return newest; }
+  uint32_t settledBefore() const;
+  // Changes whenever a record lands in a settled bucket
+  uint64_t lateGeneration() const { return late; }
+  // Oldest second a tier still holds, given its retention
+  uint32_t retainedFrom(RollupTier tier) const;
+
+  bool save(const std::string &path);
+  bool load(const std::string &path);
+
+  const RollupStats &statistics() const { return stats; }
+
+private:
+  static const size_t SHARDS = 64;
+
+  struct Series
+  {
+    std::deque<RollupBucket> tiers[ROLLUP_TIERS]; // by start, only buckets with records
+    bool anchored = false;
+    uint32_t anchorSequence = 0;
+    int64_t anchorOffsetMs = 0; // wall ms - device ms
+  };
+
+  struct Shard
+  {
+    std::shared_mutex lock;
+    std::unordered_map<uint64_t, Series> series;
+  };
+
+  void addLocked(Series &series, const VitalRecord &record, uint32_t wallSeconds);
+
+  RollupOptions options;
+  Shard shards[SHARDS];
+  std::atomic<uint32_t> newest{0};
+  std::atomic<uint64_t> late{0};
+  RollupStats stats;
+};
+
+// Stores through to another sink, then rolls the stored vitals up
+class RollupSink : public RecordSink
+{
+public:
+  RollupSink(RecordSink &next, RollupStore &rollups) : next(next), rollups(rollups) {}
+
+  bool storeVitals(uint64_t deviceId, const uint8_t *records, size_t count) override;
+  bool storePatients(uint64_t deviceId, const uint8_t *records, size_t count) override
+  {
+    return next.storePatients(deviceId, records, count);
+  }
+  void flush() override { next.flush(); }
+  bool contains(uint64_t deviceId, bool vitals, uint32_t sequence) override
+  {
+    return next.contains(deviceId, vitals, sequence);
+  }
+  void recentSequences(uint64_t deviceId, bool vitals, uint32_t window, std::vector<uint32_t> &out) override
+  {
+    next.recentSequences(deviceId, vitals, window, out);
+  }
+
+private:
+  RecordSink &next;
+  RollupStore &rollups;
+};
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,839 @@
+/*
+ * VitalCare Rural Gateway - Uplink Server
+ */
+
+#include "Server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "HttpCodec.h"
+#include "MqttCodec.h"
+#include "WebSocketCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+const size_t Server::MAX_BATCH_BYTES = UPLINK_HEADER_SIZE + UPLINK_MAX_RECORDS * PATIENT_RECORD_SIZE;
+
+static const size_t READ_CHUNK = 16 * 1024;
+static const size_t COMPACT_THRESHOLD = 64 * 1024;
+static const char UPLINK_SUFFIX[] = "/uplink";
+
+// One live message: the record's vitals, tagged with the device
+static size_t formatLiveMessage(char *buffer, size_t capacity, const char *type, uint64_t deviceId,
+                                const VitalRecord &record, uint32_t count, const char *rules = nullptr)
+{
+  char device[24];
+  snprintf(device, sizeof(device), "%llu", (unsigned long long)deviceId); // beyond a JS number
+  JsonWriter json(buffer, capacity);
+  json.beginObject()
+      .string("type", type)
+      .string("device", device)
+      .integer("sequence", record.sequence)
+      .integer("timestamp", record.vitals.timestampMs)
+      .number("heartRate", record.vitals.heartRate, 1)
+      .number("systolicBP", record.vitals.systolicBP, 1)
+      .number("diastolicBP", record.vitals.diastolicBP, 1)
+      .number("spO2", record.vitals.spO2, 1)
+      .number("temperature", record.vitals.temperature, 1)
+      .integer("alerts", record.alertFlags)
+      .integer("flags", record.recordFlags);
+  if (count > 1)
+    json.integer("count", count);
+  if (rules)
+    json.string("rules", rules);
+  json.endObject();
+  return json.ok() ? json.size() : 0;
+}
+
+// Runs on a worker after a batch is stored: the device's newest reading
+// (coalesced per device) and, if any record alerts, its newest alert.
+static void publishLive(PushHub &hub, const uint8_t *batch, size_t length)
+{
+  UplinkBatchHeader header;
+  if (!decodeUplinkHeader(batch, length, header) || header.recordType != UPLINK_VITAL_RECORDS ||
+      header.recordCount == 0)
+    return;
+
+  VitalRecord newest;
+  VitalRecord alert;
+  uint32_t alerts = 0;
+  bool found = false;
+  for (uint16_t i = 0; i < header.recordCount; i++)
+  {
+    VitalRecord record;
+    if (!decodeVitalRecord(batch + UPLINK_HEADER_SIZE + i * VITAL_RECORD_SIZE, record))
+      continue;
+    if (!found || record.sequence > newest.sequence)
+      newest = record;
+    found = true;
+    if (record.alertFlags != 0 && (alerts++ == 0 || record.sequence > alert.sequence))
+      alert = record;
+  }
+  if (!found)
+    return;
+
+  char buffer[384];
+  size_t size = formatLiveMessage(buffer, sizeof(buffer), "vitals", header.deviceId, newest, 1);
+  if (size > 0)
+    hub.publish(header.deviceId, buffer, size);
+  if (alerts > 0)
+  {
+    size = formatLiveMessage(buffer, sizeof(buffer), "alert", header.deviceId, alert, alerts);
+    if (size > 0)
+      hub.publish(0, buffer, size);
+  }
+}
+
+static bool parseSeconds(const std::string &text, uint32_t &seconds)
+{
+  char *end = nullptr;
+  unsigned long long value = strtoull(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || value > UINT32_MAX)
+    return false;
+  seconds = (uint32_t)value;
+  return true;
+}
+
+// Reads ?field=&from=&to=&step=&devices= of a query request. Defaults: heart
+// rate over the last 24 h, about 1000 points, every device.
+static const char *parseRollupQuery(const std::string &target, RollupQuery &query)
+{
+  std::string value;
+  if (httpQueryParameter(target, "field", value) && !parseVitalField(value.c_str(), query.field))
+    return "unknown field\n";
+  query.toSeconds = (uint32_t)time(nullptr);
+  if (httpQueryParameter(target, "to", value) && !parseSeconds(value, query.toSeconds))
+    return "bad to\n";
+  query.fromSeconds = query.toSeconds > 86400 ? query.toSeconds - 86400 : 0;
+  if (httpQueryParameter(target, "from", value) && !parseSeconds(value, query.fromSeconds))
+    return "bad from\n";
+  if (query.toSeconds <= query.fromSeconds)
+    return "empty range\n";
+  query.stepSeconds = (query.toSeconds - query.fromSeconds) / 1000;
+  if (httpQueryParameter(target, "step", value) && !parseSeconds(value, query.stepSeconds))
+    return "bad step\n";
+  if (httpQueryParameter(target, "devices", value))
+  {
+    for (size_t start = 0; start < value.size();)
+    {
+      size_t end = value.find(',', start);
+      if (end == std::string::npos)
+        end = value.size();
+      char *parsed = nullptr;
+      std::string id = value.substr(start, end - start);
+      query.devices.push_back(strtoull(id.c_str(), &parsed, 10));
+      if (id.empty() || *parsed != '\0')
+        return "bad devices\n";
+      start = end + 1;
+    }
+  }
+  return nullptr;
+}
+
+// Steps without readings are left out
+static std::string formatQueryResult(const RollupQuery &query, const QueryResult &result)
+{
+  const QueryPlan &plan = result.plan;
+  std::vector<char> buffer(512 + result.points.size() * 96);
+  JsonWriter json(buffer.data(), buffer.size());
+  json.beginObject()
+      .string("field", vitalFieldName(query.field))
+      .string("tier", ROLLUP_TIER_NAMES[plan.tier])
+      .integer("from", plan.fromSeconds)
+      .integer("to", plan.toSeconds)
+      .integer("step", plan.stepSeconds)
+      .integer("devices", result.devices)
+      .integer("spans", result.spans)
+      .integer("cachedSpans", result.cachedSpans)
+      .integer("bucketsRead", result.bucketsRead)
+      .beginArray("points");
+  for (size_t i = 0; i < result.points.size(); i++)
+  {
+    const QueryPoint &point = result.points[i];
+    if (point.count == 0)
+      continue;
+    json.beginObject()
+        .integer("t", plan.fromSeconds + (uint64_t)i * plan.stepSeconds)
+        .integer("n", point.count)
+        .number("mean", point.mean())
+        .number("min", point.min, 1)
+        .number("max", point.max, 1)
+        .endObject();
+  }
+  json.endArray().endObject();
+  return std::string(json.c_str(), json.size()) + "\n";
+}
+
+Server::Server(EventLoop &loop, WorkerPool &workers, IngestService &ingest)
+    : loop(loop), workers(workers), ingest(ingest), pipeline(nullptr), pushHub(nullptr), alertEngine(nullptr),
+      queryEngine(nullptr),
+      nextId(1), accepted(0), busyResponses(0), lastLogMs(EventLoop::nowMs()), lastLogRecords(0)
+{
+}
+
+void Server::setAlertEngine(AlertEngine *engine)
+{
+  alertEngine = engine;
+  // Runs on the worker that stored the record
+  engine->setListener([this](uint64_t deviceId, const VitalRecord &record, const AlertResult &result) {
+    if (!pushHub)
+      return;
+    char rules[256] = "";
+    size_t length = 0;
+    for (size_t r = 0; r < alertEngine->trendRuleCount() && length < sizeof(rules); r++)
+    {
+      if (result.trendRaised & (1u << r))
+        length += snprintf(rules + length, sizeof(rules) - length, "%s%s", length ? "," : "",
+                           alertEngine->trendRule(r).name);
+    }
+    char buffer[512];
+    size_t size = formatLiveMessage(buffer, sizeof(buffer), "trend", deviceId, record, 1, rules);
+    if (size > 0)
+      pushHub->publish(0, buffer, size);
+  });
+}
+
+Server::~Server()
+{
+  while (!connections.empty())
+    closeConnection(*connections.begin()->second);
+  for (Listener *listener : {&httpListener, &mqttListener})
+  {
+    if (listener->fd >= 0)
+    {
+      loop.remove(listener->fd);
+      close(listener->fd);
+    }
+  }
+}
+
+bool Server::listenHttp(uint16_t port)
+{
+  return listen(httpListener, port, PROTOCOL_HTTP);
+}
+
+bool Server::listenMqtt(uint16_t port)
+{
+  return listen(mqttListener, port, PROTOCOL_MQTT);
+}
+
+bool Server::listen(Listener &listener, uint16_t port, Protocol protocol)
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    perror("socket");
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, (sockaddr *)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+  {
+    perror("bind/listen");
+    close(fd);
+    return false;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(fd, (sockaddr *)&address, &length);
+
+  listener.fd = fd;
+  listener.port = ntohs(address.sin_port);
+  const Listener *bound = &listener;
+  return loop.add(fd, EPOLLIN, [this, bound, protocol](uint32_t) { accept(*bound, protocol); });
+}
+
+void Server::accept(const Listener &listener, Protocol protocol)
+{
+  while (true)
+  {
+    int fd = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        perror("accept4");
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->id = nextId++;
+    connection->fd = fd;
+    connection->protocol = protocol;
+    connection->events = EPOLLIN;
+    uint64_t id = connection->id;
+    if (!loop.add(fd, EPOLLIN, [this, id](uint32_t events) { onEvents(id, events); }))
+    {
+      close(fd);
+      continue;
+    }
+    connections[id] = std::move(connection);
+    accepted++;
+  }
+}
+
+void Server::onEvents(uint64_t id, uint32_t events)
+{
+  auto it = connections.find(id);
+  if (it == connections.end())
+    return;
+  Connection &connection = *it->second;
+
+  if (events & EPOLLIN)
+  {
+    if (!readInput(connection))
+    {
+      closeConnection(connection);
+      return;
+    }
+    processInput(connection);
+  }
+  else if (events & (EPOLLHUP | EPOLLERR))
+  {
+    closeConnection(connection);
+    return;
+  }
+  flush(connection);
+}
+
+// False when the peer has gone (EOF or error)
+bool Server::readInput(Connection &connection)
+{
+  char chunk[READ_CHUNK];
+  while (true)
+  {
+    ssize_t got = recv(connection.fd, chunk, sizeof(chunk), 0);
+    if (got > 0)
+    {
+      connection.input.append(chunk, got);
+      if ((size_t)got < sizeof(chunk))
+        return true;
+      continue;
+    }
+    if (got == 0)
+      return false;
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+}
+
+void Server::processInput(Connection &connection)
+{
+  while (!connection.busy && !connection.closing && !connection.upgrading &&
+         connection.inputOffset < connection.input.size())
+  {
+    bool progressed =
+        connection.protocol == PROTOCOL_HTTP ? handleHttp(connection) : handleMqtt(connection);
+    if (!progressed)
+      break;
+  }
+
+  if (connection.inputOffset == connection.input.size())
+  {
+    connection.input.clear();
+    connection.inputOffset = 0;
+  }
+  else if (connection.inputOffset > COMPACT_THRESHOLD)
+  {
+    connection.input.erase(0, connection.inputOffset);
+    connection.inputOffset = 0;
+  }
+  updateInterest(connection);
+}
+
+// Handles one request; false if more input is needed or the connection is
+// closing
+bool Server::handleHttp(Connection &connection)
+{
+  const char *data = connection.input.data() + connection.inputOffset;
+  size_t length = connection.input.size() - connection.inputOffset;
+  HttpMessage request;
+  size_t consumed = 0;
+
+  ParseResult result = parseHttpRequest(data, length, MAX_BATCH_BYTES, request, consumed);
+  if (result == PARSE_INCOMPLETE)
+    return false;
+  if (result == PARSE_ERROR)
+  {
+    appendHttpResponse(connection.output, 400, "text/plain", "bad request\n", 12, false);
+    connection.closing = true;
+    return false;
+  }
+
+  connection.inputOffset += consumed;
+  connection.keepAlive = request.keepAlive;
+  if (!request.keepAlive)
+    connection.closing = true; // after this response
+
+  std::string path = httpTargetPath(request.path);
+  if (path == "/api/v1/uplink")
+  {
+    if (request.method != "POST")
+    {
+      appendHttpResponse(connection.output, 405, "text/plain", "POST only\n", 10, request.keepAlive);
+      return true;
+    }
+    // closing is re-checked after the ack goes out
+    connection.closing = false;
+    submitBatch(connection, (const uint8_t *)data + request.bodyOffset, request.bodyLength);
+    return true;
+  }
+  if (path == "/api/v1/live" && request.method == "GET" && pushHub)
+  {
+    if (!request.upgradeWebSocket || request.webSocketKey.empty())
+    {
+      appendHttpResponse(connection.output, 400, "text/plain", "WebSocket upgrade required\n", 27, false);
+      connection.closing = true;
+      return false;
+    }
+    appendWebSocketHandshake(connection.greeting, request.webSocketKey);
+    connection.upgrading = true;
+    return false;
+  }
+  if (path == "/api/v1/stats" && request.method == "GET")
+  {
+    std::string body = statsJson();
+    appendHttpResponse(connection.output, 200, "application/json", body.data(), body.size(), request.keepAlive);
+    return true;
+  }
+  if (path == "/api/v1/query" && request.method == "GET" && queryEngine)
+  {
+    RollupQuery query;
+    QueryPlan plan;
+    const char *error = parseRollupQuery(request.path, query);
+    if (!error && !queryEngine->plan(query, plan))
+      error = "too many points for the step\n";
+    if (error)
+    {
+      appendHttpResponse(connection.output, 400, "text/plain", error, strlen(error), request.keepAlive);
+      return true;
+    }
+    // closing is re-checked after the response goes out
+    connection.closing = false;
+    submitQuery(connection, query);
+    return true;
+  }
+  if (path == "/health" && request.method == "GET")
+  {
+    appendHttpResponse(connection.output, 200, "text/plain", "ok\n", 3, request.keepAlive);
+    return true;
+  }
+  appendHttpResponse(connection.output, 404, "text/plain", "not found\n", 10, request.keepAlive);
+  return true;
+}
+
+bool Server::handleMqtt(Connection &connection)
+{
+  const uint8_t *data = (const uint8_t *)connection.input.data() + connection.inputOffset;
+  size_t length = connection.input.size() - connection.inputOffset;
+  MqttPacket packet;
+  size_t consumed = 0;
+
+  ParseResult result = parseMqttPacket(data, length, MAX_BATCH_BYTES + 256, packet, consumed);
+  if (result == PARSE_INCOMPLETE)
+    return false;
+  if (result == PARSE_ERROR || (!connection.mqttConnected && packet.type != MQTT_CONNECT))
+  {
+    connection.closing = true;
+    return false;
+  }
+  connection.inputOffset += consumed;
+
+  switch (packet.type)
+  {
+  case MQTT_CONNECT:
+  {
+    std::string clientId;
+    bool ok = parseMqttConnect(packet, clientId);
+    appendMqttConnack(connection.output, ok ? 0 : 1); // 1: unacceptable protocol version
+    connection.mqttConnected = ok;
+    connection.closing = !ok;
+    return ok;
+  }
+
+  case MQTT_PUBLISH:
+  {
+    MqttPublish publish;
+    size_t suffix = sizeof(UPLINK_SUFFIX) - 1;
+    if (!parseMqttPublish(packet, publish) || publish.qos > 1 || publish.topic.size() < suffix ||
+        publish.topic.compare(publish.topic.size() - suffix, suffix, UPLINK_SUFFIX) != 0)
+    {
+      connection.closing = true; // QoS 2 and unknown topics are not served
+      return false;
+    }
+    connection.qos = publish.qos;
+    connection.packetId = publish.packetId;
+    connection.ackTopic = publish.topic.substr(0, publish.topic.size() - suffix) + "/ack";
+    submitBatch(connection, publish.payload, publish.payloadLength);
+    return true;
+  }
+
+  case MQTT_SUBSCRIBE:
+  {
+    uint16_t packetId;
+    std::string filter;
+    if (!parseMqttSubscribe(packet, packetId, filter))
+    {
+      connection.closing = true;
+      return false;
+    }
+    connection.subscriptions.push_back(filter);
+    appendMqttSuback(connection.output, packetId, 0);
+    return true;
+  }
+
+  case MQTT_PINGREQ:
+    appendMqttPingresp(connection.output);
+    return true;
+
+  case MQTT_DISCONNECT:
+    connection.closing = true;
+    return false;
+
+  default:
+    return true; // PUBACK for our QoS 0 acks never arrives; anything else is ignored
+  }
+}
+
+void Server::submitBatch(Connection &connection, const uint8_t *batch, size_t length)
+{
+  connection.busy = true;
+  std::shared_ptr<std::vector<uint8_t>> copy = std::make_shared<std::vector<uint8_t>>(batch, batch + length);
+  uint64_t id = connection.id;
+  PushHub *hub = pushHub;
+  bool queued;
+  if (pipeline)
+  {
+    queued = pipeline->submit(copy, [this, id, copy, hub](const UplinkAck &ack) {
+      if (hub && ack.status == UPLINK_OK && ack.accepted > 0)
+        publishLive(*hub, copy->data(), copy->size());
+      loop.post([this, id, ack]() { completeBatch(id, ack); });
+    });
+  }
+  else
+  {
+    queued = workers.submit([this, id, copy, hub]() {
+      UplinkAck ack = ingest.process(copy->data(), copy->size());
+      if (hub && ack.status == UPLINK_OK && ack.accepted > 0)
+        publishLive(*hub, copy->data(), copy->size());
+      loop.post([this, id, ack]() { completeBatch(id, ack); });
+    });
+  }
+  if (queued)
+    return;
+
+  UplinkAck ack = {};
+  UplinkBatchHeader header;
+  if (decodeUplinkHeader(batch, length, header))
+  {
+    ack.recordType = header.recordType;
+    ack.deviceId = header.deviceId;
+    ack.batchSequence = header.batchSequence;
+  }
+  ack.status = UPLINK_BUSY;
+  busyResponses++;
+  // Answer after the current parse step, like a worker completion would
+  loop.post([this, id, ack]() { completeBatch(id, ack); });
+}
+
+void Server::completeBatch(uint64_t id, const UplinkAck &ack)
+{
+  auto it = connections.find(id);
+  if (it == connections.end())
+    return; // device went away; its retry will be deduplicated
+  Connection &connection = *it->second;
+  connection.busy = false;
+
+  uint8_t encoded[UPLINK_ACK_SIZE];
+  encodeUplinkAck(ack, encoded);
+  if (connection.protocol == PROTOCOL_HTTP)
+  {
+    int status = ack.status == UPLINK_OK ? 200 : (ack.status == UPLINK_BUSY ? 503 : 400);
+    appendHttpResponse(connection.output, status, "application/octet-stream", encoded, sizeof(encoded),
+                       connection.keepAlive);
+    connection.closing = !connection.keepAlive;
+  }
+  else
+  {
+    // A busy batch is not acknowledged so the device republishes it
+    if (connection.qos == 1 && ack.status != UPLINK_BUSY)
+      appendMqttPuback(connection.output, connection.packetId);
+    for (const std::string &filter : connection.subscriptions)
+    {
+      if (mqttTopicMatches(filter, connection.ackTopic))
+      {
+        appendMqttPublish(connection.output, connection.ackTopic, 0, 0, encoded, sizeof(encoded));
+        break;
+      }
+    }
+  }
+
+  processInput(connection);
+  flush(connection);
+}
+
+void Server::submitQuery(Connection &connection, const RollupQuery &query)
+{
+  connection.busy = true;
+  uint64_t id = connection.id;
+  QueryEngine *engine = queryEngine;
+  bool queued = workers.submit([this, id, engine, query]() {
+    QueryResult result;
+    int status = 200;
+    std::shared_ptr<std::string> body;
+    if (engine->run(query, result))
+    {
+      body = std::make_shared<std::string>(formatQueryResult(query, result));
+    }
+    else
+    {
+      status = 400; // retention moved under the plan
+      body = std::make_shared<std::string>("too many points for the step\n");
+    }
+    loop.post([this, id, status, body]() { completeQuery(id, status, body); });
+  });
+  if (queued)
+    return;
+
+  busyResponses++;
+  std::shared_ptr<std::string> body = std::make_shared<std::string>("busy\n");
+  loop.post([this, id, body]() { completeQuery(id, 503, body); });
+}
+
+void Server::completeQuery(uint64_t id, int status, std::shared_ptr<std::string> body)
+{
+  auto it = connections.find(id);
+  if (it == connections.end())
+    return;
+  Connection &connection = *it->second;
+  connection.busy = false;
+  appendHttpResponse(connection.output, status, status == 200 ? "application/json" : "text/plain", body->data(),
+                     body->size(), connection.keepAlive);
+  connection.closing = !connection.keepAlive;
+
+  processInput(connection);
+  flush(connection);
+}
+
+void Server::flush(Connection &connection)
+{
+  while (connection.outputOffset < connection.output.size())
+  {
+    ssize_t sent = send(connection.fd, connection.output.data() + connection.outputOffset,
+                        connection.output.size() - connection.outputOffset, MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+      connection.outputOffset += sent;
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (sent < 0 && errno == EINTR)
+      continue;
+    closeConnection(connection);
+    return;
+  }
+
+  if (connection.outputOffset == connection.output.size())
+  {
+    connection.output.clear();
+    connection.outputOffset = 0;
+    if (connection.upgrading && !connection.busy)
+    {
+      handOver(connection);
+      return;
+    }
+    if (connection.closing && !connection.busy)
+    {
+      closeConnection(connection);
+      return;
+    }
+  }
+  updateInterest(connection);
+}
+
+void Server::updateInterest(Connection &connection)
+{
+  // Stop reading while a batch is in flight: input waits in the socket
+  uint32_t events = 0;
+  if (!connection.busy && !connection.closing && !connection.upgrading)
+    events |= EPOLLIN;
+  if (connection.outputOffset < connection.output.size())
+    events |= EPOLLOUT;
+  if (events != connection.events)
+  {
+    connection.events = events;
+    loop.modify(connection.fd, events);
+  }
+}
+
+void Server::closeConnection(Connection &connection)
+{
+  loop.remove(connection.fd);
+  close(connection.fd);
+  connections.erase(connection.id); // destroys connection
+}
+
+// The socket now belongs to the hub, which answers the handshake
+void Server::handOver(Connection &connection)
+{
+  int fd = connection.fd;
+  std::string greeting = std::move(connection.greeting);
+  loop.remove(fd);
+  connections.erase(connection.id); // destroys connection
+  pushHub->adopt(fd, std::move(greeting));
+}
+
+std::string Server::statsJson()
+{
+  const IngestStats &stats = ingest.statistics();
+  std::vector<char> buffer(1280 + (pipeline ? pipeline->shardCount() * 160 : 0));
+  JsonWriter json(buffer.data(), buffer.size());
+  json.beginObject()
+      .integer("batches", stats.batches)
+      .integer("badBatches", stats.badBatches)
+      .integer("accepted", stats.accepted)
+      .integer("duplicates", stats.duplicates)
+      .integer("rejected", stats.rejected)
+      .integer("bytes", stats.bytes)
+      .integer("busy", busyResponses)
+      .integer("devices", ingest.deviceCount())
+      .integer("connections", connections.size())
+      .integer("queueDepth", workers.queueDepth() + (pipeline ? pipeline->queueDepth() : 0));
+  if (pipeline)
+  {
+    json.beginObject("pipeline").integer("moves", pipeline->moves()).beginArray("shards");
+    for (size_t i = 0; i < pipeline->shardCount(); i++)
+    {
+      IngestShardMetrics shard = pipeline->metrics(i);
+      json.beginObject()
+          .integer("depth", shard.depth)
+          .number("lagMs", shard.lagMs, 3)
+          .number("meanWaitMs", shard.meanWaitMs, 3)
+          .integer("batches", shard.batches)
+          .integer("records", shard.records)
+          .integer("refused", shard.refused)
+          .integer("slots", shard.slots)
+          .endObject();
+    }
+    json.endArray().endObject();
+  }
+  if (pushHub)
+  {
+    const PushStats &push = pushHub->statistics();
+    json.beginObject("live")
+        .integer("clients", push.clients)
+        .integer("published", push.published)
+        .integer("delivered", push.delivered)
+        .integer("coalesced", push.coalesced)
+        .integer("dropped", push.dropped)
+        .integer("slowClosed", push.slowClosed)
+        .endObject();
+  }
+  if (alertEngine)
+  {
+    const AlertStats &rules = alertEngine->statistics();
+    json.beginObject("rules")
+        .string("kernels", alertEngine->kernelName())
+        .integer("records", rules.records)
+        .integer("thresholdRecords", rules.thresholdRecords)
+        .integer("trendRaised", rules.trendRaised)
+        .integer("deviceMissed", rules.deviceMissed)
+        .endObject();
+  }
+  if (queryEngine)
+  {
+    const RollupStats &rollups = queryEngine->rollups().statistics();
+    const QueryStats &queries = queryEngine->statistics();
+    json.beginObject("rollups")
+        .integer("records", rollups.records)
+        .integer("lateRecords", rollups.lateRecords)
+        .integer("minuteBuckets", rollups.buckets[TIER_MINUTE])
+        .integer("quarterHourBuckets", rollups.buckets[TIER_QUARTER_HOUR])
+        .integer("dayBuckets", rollups.buckets[TIER_DAY])
+        .endObject()
+        .beginObject("queries")
+        .integer("queries", queries.queries)
+        .integer("spans", queries.spans)
+        .integer("cachedSpans", queries.cachedSpans)
+        .integer("bucketsRead", queries.bucketsRead)
+        .endObject();
+  }
+  json.endObject();
+  return std::string(json.c_str(), json.size()) + "\n";
+}
+
+void Server::logStatistics()
+{
+  uint64_t now = EventLoop::nowMs();
+  const IngestStats &stats = ingest.statistics();
+  uint64_t records = stats.accepted + stats.duplicates;
+  double seconds = (now - lastLogMs) / 1000.0;
+  printf("[gateway] %.0f rec/s | accepted %llu dup %llu rejected %llu bad %llu busy %llu | %zu conn, queue %zu\n",
+         seconds > 0 ? (records - lastLogRecords) / seconds : 0.0, (unsigned long long)stats.accepted.load(),
+         (unsigned long long)stats.duplicates.load(), (unsigned long long)stats.rejected.load(),
+         (unsigned long long)stats.badBatches.load(), (unsigned long long)busyResponses, connections.size(),
+         workers.queueDepth());
+  if (pipeline)
+  {
+    // depth/lag per shard
+    std::string shards;
+    for (size_t i = 0; i < pipeline->shardCount(); i++)
+    {
+      IngestShardMetrics shard = pipeline->metrics(i);
+      char entry[64];
+      snprintf(entry, sizeof(entry), "%s%zu/%.1f", i ? " " : "", shard.depth, shard.lagMs);
+      shards += entry;
+    }
+    printf("[shards] depth/lag ms %s | %llu moves\n", shards.c_str(), (unsigned long long)pipeline->moves());
+  }
+  if (pushHub)
+  {
+    const PushStats &push = pushHub->statistics();
+    printf("[live] %llu clients | published %llu delivered %llu coalesced %llu dropped %llu slow closed %llu\n",
+           (unsigned long long)push.clients.load(), (unsigned long long)push.published.load(),
+           (unsigned long long)push.delivered.load(), (unsigned long long)push.coalesced.load(),
+           (unsigned long long)push.dropped.load(), (unsigned long long)push.slowClosed.load());
+  }
+  if (alertEngine)
+  {
+    const AlertStats &rules = alertEngine->statistics();
+    printf("[rules] %s | %llu records, %llu over a threshold (%llu the device missed), %llu trends raised\n",
+           alertEngine->kernelName(), (unsigned long long)rules.records.load(),
+           (unsigned long long)rules.thresholdRecords.load(), (unsigned long long)rules.deviceMissed.load(),
+           (unsigned long long)rules.trendRaised.load());
+  }
+  if (queryEngine)
+  {
+    const RollupStats &rollups = queryEngine->rollups().statistics();
+    const QueryStats &queries = queryEngine->statistics();
+    printf("[query] %llu records rolled up (%llu late) | %llu queries, %llu/%llu spans cached, %llu buckets read\n",
+           (unsigned long long)rollups.records.load(), (unsigned long long)rollups.lateRecords.load(),
+           (unsigned long long)queries.queries.load(), (unsigned long long)queries.cachedSpans.load(),
+           (unsigned long long)queries.spans.load(), (unsigned long long)queries.bucketsRead.load());
+  }
+  fflush(stdout);
+  lastLogMs = now;
+  lastLogRecords = records;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,170 @@
+/*
+ * VitalCare Rural Gateway - Uplink Server
+ *
+ * Accepts device connections over HTTP and MQTT on one event loop and hands
+ * each batch to the worker pool for ingest, or with an IngestPipeline to
+ * the shard worker that owns the device. A connection has at most one
+ * batch in flight: further pipelined requests wait in its input buffer,
+ * which keeps acks in order and stops reading until the batch is done (TCP
+ * back-pressure on the device rather than unbounded queues here).
+ *
+ * HTTP:
+ *   POST /api/v1/uplink   body = batch, response body = ack
+ *                         (200, 400 on a bad batch, 503 when busy)
+ *   GET  /api/v1/stats    ingest (and pipeline shard, push, alert rule,
+ *                         rollup and query) counters as JSON
+ *   GET  /api/v1/live     WebSocket upgrade: live vitals and alerts as JSON
+ *                         text messages, fanned out by the PushHub; with
+ *                         an AlertEngine also the trends it raises
+ *   GET  /api/v1/query    with a QueryEngine: one vital over time from the
+ *                         rollups, ?field=heartRate&from=&to=&step= (unix
+ *                         seconds) [&devices=id,id]; runs on the workers
+ *                         like a batch (503 when busy)
+ *   GET  /health
+ *
+ * MQTT: PUBLISH to vitalcare/<device>/uplink. QoS 1 publishes get their
+ * PUBACK once the batch is stored; clients subscribed to the matching
+ * .../ack topic also get the ack as a QoS 0 PUBLISH.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AlertEngine.h"
+#include "EventLoop.h"
+#include "Ingest.h"
+#include "IngestPipeline.h"
+#include "PushHub.h"
+#include "QueryEngine.h"
+#include "WorkerPool.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+class Server
+{
+public:
+  static const size_t MAX_BATCH_BYTES;
+
+  Server(EventLoop &loop, WorkerPool &workers, IngestService &ingest);
+  ~Server();
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  // Port 0 picks a free port; httpPort()/mqttPort() report it
+  bool listenHttp(uint16_t port);
+  bool listenMqtt(uint16_t port);
+  uint16_t httpPort() const { return httpListener.port; }
+  uint16_t mqttPort() const { return mqttListener.port; }
+
+  // Batches go to the pipeline's shard workers instead of the worker pool
+  // (which keeps running queries). The pipeline must outlive the server.
+  void setIngestPipeline(IngestPipeline *ingestPipeline) { pipeline = ingestPipeline; }
+  // Enables /api/v1/live; accepted vitals are published to the hub
+  void setPushHub(PushHub *hub) { pushHub = hub; }
+  // Reports the engine's counters and publishes the trends it raises on
+  // the live feed. The engine must outlive the server.
+  void setAlertEngine(AlertEngine *engine);
+  // Enables /api/v1/query and reports rollup and query counters. The
+  // engine must outlive the server.
+  void setQueryEngine(QueryEngine *engine) { queryEngine = engine; }
+
+  // Logs throughput since the previous call. Runs on the loop thread.
+  void logStatistics();
+
+  size_t connectionCount() const { return connections.size(); }
+  uint64_t busyCount() const { return busyResponses; }
+
+private:
+  enum Protocol : uint8_t
+  {
+    PROTOCOL_HTTP,
+    PROTOCOL_MQTT,
+  };
+
+  struct Listener
+  {
+    int fd = -1;
+    uint16_t port = 0;
+  };
+
+  struct Connection
+  {
+    uint64_t id;
+    int fd;
+    Protocol protocol;
+    uint32_t events = 0;
+
+    std::string input;
+    size_t inputOffset = 0;
+    std::string output;
+    size_t outputOffset = 0;
+
+    bool busy = false;    // a batch or query is with the workers
+    bool closing = false; // close once the output has drained
+
+    // Reply context of the batch in flight
+    bool keepAlive = true;
+    uint8_t qos = 0;
+    uint16_t packetId = 0;
+    std::string ackTopic;
+
+    bool mqttConnected = false;
+    std::vector<std::string> subscriptions;
+
+    // Handed to the push hub once the output has drained
+    bool upgrading = false;
+    std::string greeting;
+  };
+
+  bool listen(Listener &listener, uint16_t port, Protocol protocol);
+  void accept(const Listener &listener, Protocol protocol);
+  void onEvents(uint64_t id, uint32_t events);
+
+  bool readInput(Connection &connection);
+  void processInput(Connection &connection);
+  bool handleHttp(Connection &connection);
+  bool handleMqtt(Connection &connection);
+  void submitBatch(Connection &connection, const uint8_t *batch, size_t length);
+  void completeBatch(uint64_t id, const UplinkAck &ack);
+  void submitQuery(Connection &connection, const RollupQuery &query);
+  void completeQuery(uint64_t id, int status, std::shared_ptr<std::string> body);
+
+  void flush(Connection &connection);
+  void updateInterest(Connection &connection);
+  void closeConnection(Connection &connection);
+  void handOver(Connection &connection);
+
+  std::string statsJson();
+
+  EventLoop &loop;
+  WorkerPool &workers;
+  IngestService &ingest;
+  IngestPipeline *pipeline;
+  PushHub *pushHub;
+  AlertEngine *alertEngine;
+  QueryEngine *queryEngine;
+  Listener httpListener;
+  Listener mqttListener;
+
+  uint64_t nextId;
+  std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+
+  uint64_t accepted;
+  uint64_t busyResponses;
+  uint64_t lastLogMs;
+  uint64_t lastLogRecords;
+};
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,576 @@
+/*
+ * VitalCare Rural Gateway - Columnar Time-Series Store
+ */
+
+#include "TimeSeriesStore.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const uint32_t CHUNK_MAGIC = 0x31434356; // "VCC1"
+static const size_t VALUE_COLUMNS = 5;
+
+static std::string segmentPath(const std::string &directory, uint32_t number)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/segment-%06u.vcs", number);
+  return directory + name;
+}
+
+static uint16_t packFlags(const VitalRecord &record)
+{
+  return (uint16_t)(record.alertFlags | (record.recordFlags << 8));
+}
+
+void SequenceRuns::add(uint32_t sequence)
+{
+  auto next = runs.upper_bound(sequence);
+  if (next != runs.begin())
+  {
+    auto run = std::prev(next);
+    if (sequence <= run->second)
+      return;
+    if (sequence == run->second + 1)
+    {
+      run->second = sequence;
+      if (next != runs.end() && next->first == sequence + 1)
+      {
+        run->second = next->second;
+        runs.erase(next);
+      }
+      return;
+    }
+  }
+  if (next != runs.end() && next->first == sequence + 1)
+  {
+    uint32_t last = next->second;
+    runs.erase(next);
+    runs.emplace(sequence, last);
+    return;
+  }
+  runs.emplace(sequence, sequence);
+}
+
+bool SequenceRuns::contains(uint32_t sequence) const
+{
+  auto next = runs.upper_bound(sequence);
+  return next != runs.begin() && sequence <= std::prev(next)->second;
+}
+
+void SequenceRuns::collect(uint32_t from, uint32_t to, std::vector<uint32_t> &out) const
+{
+  auto run = runs.upper_bound(from);
+  if (run != runs.begin())
+    run = std::prev(run);
+  for (; run != runs.end() && run->first <= to; ++run)
+  {
+    uint32_t first = std::max(run->first, from);
+    uint32_t last = std::min(run->second, to);
+    for (uint64_t s = first; s <= last; s++)
+      out.push_back((uint32_t)s);
+  }
+}
+
+void TimeSeriesStore::HeadChunk::append(const VitalRecord &record, uint64_t lsn, uint32_t entryIndex)
+{
+  const float vitals[VALUE_COLUMNS] = {record.vitals.heartRate, record.vitals.systolicBP, record.vitals.diastolicBP,
+                                       record.vitals.spO2, record.vitals.temperature};
+  uint32_t timestamp = record.vitals.timestampMs;
+  timestamps.append(columns[COLUMN_TIMESTAMP], timestamp);
+  sequences.append(columns[COLUMN_SEQUENCE], record.sequence);
+  flags.append(columns[COLUMN_FLAGS], packFlags(record));
+  for (size_t i = 0; i < VALUE_COLUMNS; i++)
+    values[i].append(columns[COLUMN_HEART_RATE + i], vitals[i]);
+
+  minTs = rows == 0 || timestamp < minTs ? timestamp : minTs;
+  maxTs = rows == 0 || timestamp > maxTs ? timestamp : maxTs;
+  rows++;
+  lastLsn = lsn;
+  lastEntryEnd = entryIndex + 1;
+}
+
+size_t TimeSeriesStore::HeadChunk::bytes() const
+{
+  size_t total = 0;
+  for (const BitWriter &column : columns)
+    total += column.byteLength();
+  return total;
+}
+
+TimeSeriesStore::TimeSeriesStore(const std::string &directory, const StoreOptions &options)
+    : directory(directory), options(options), wal(directory, options.syncWal), opened(false)
+{
+}
+
+TimeSeriesStore::~TimeSeriesStore()
+{
+  close();
+}
+
+bool TimeSeriesStore::open()
+{
+  std::vector<uint32_t> numbers;
+  if (DIR *dir = opendir(directory.c_str()))
+  {
+    while (dirent *entry = readdir(dir))
+    {
+      unsigned number;
+      if (sscanf(entry->d_name, "segment-%06u.vcs", &number) == 1)
+        numbers.push_back(number);
+    }
+    closedir(dir);
+  }
+  else
+  {
+    perror(directory.c_str());
+    return false;
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  // Segment numbers are dense from 1; a gap means a lost file
+  for (size_t i = 0; i < numbers.size(); i++)
+  {
+    if (numbers[i] != i + 1 || !loadSegment(numbers[i]))
+    {
+      fprintf(stderr, "segment %u missing or unreadable\n", (unsigned)(i + 1));
+      return false;
+    }
+  }
+  if (segments.empty() && !openSegment(1, true))
+    return false;
+
+  bool replayed = wal.open([this](uint64_t lsn, uint64_t deviceId, const uint8_t *records, size_t count) {
+    Shard &shard = shardFor(deviceId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Series &series = shard.series[deviceId];
+    if (lsn > series.sealedLsn)
+      appendRows(series, deviceId, records, count, lsn);
+    else if (lsn == series.sealedLsn && series.sealedEntryEnd < count)
+      appendRows(series, deviceId, records, count, lsn, series.sealedEntryEnd);
+  });
+  opened = replayed;
+  return replayed;
+}
+
+void TimeSeriesStore::close()
+{
+  if (!opened)
+    return;
+  checkpoint();
+  wal.close();
+  std::lock_guard<std::mutex> guard(segmentLock);
+  for (std::unique_ptr<Segment> &segment : segments)
+  {
+    munmap((void *)segment->map, options.segmentBytes);
+    ::close(segment->fd);
+  }
+  segments.clear();
+  opened = false;
+}
+
+bool TimeSeriesStore::openSegment(uint32_t number, bool create)
+{
+  int fd = ::open(segmentPath(directory, number).c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+  if (fd < 0)
+  {
+    perror("open segment");
+    return false;
+  }
+  // Preallocated (sparse) to the full size so one mapping covers every
+  // chunk ever written to it
+  if (create && ftruncate(fd, options.segmentBytes) != 0)
+  {
+    perror("ftruncate segment");
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, options.segmentBytes, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    perror("mmap segment");
+    ::close(fd);
+    return false;
+  }
+  madvise(map, options.segmentBytes, MADV_RANDOM);
+
+  std::unique_ptr<Segment> segment(new Segment());
+  segment->fd = fd;
+  segment->map = (const uint8_t *)map;
+  segments.push_back(std::move(segment));
+  return true;
+}
+
+bool TimeSeriesStore::loadSegment(uint32_t number)
+{
+  if (!openSegment(number, false))
+    return false;
+  Segment &segment = *segments.back();
+  uint32_t segmentIndex = (uint32_t)segments.size() - 1;
+
+  // Chunks are contiguous; the first one that does not verify (torn by a
+  // crash before the checkpoint synced it) ends the segment. Its rows are
+  // still in the log.
+  uint32_t offset = 0;
+  while (offset + CHUNK_HEADER + 4 <= options.segmentBytes)
+  {
+    const uint8_t *chunk = segment.map + offset;
+    BinaryReader reader(chunk, CHUNK_HEADER);
+    uint32_t magic = reader.u32();
+    uint32_t length = reader.u32();
+    if (magic != CHUNK_MAGIC || length < CHUNK_HEADER + 4 || offset + length > options.segmentBytes)
+      break;
+    uint32_t crc = (uint32_t)(chunk[length - 4] | (chunk[length - 3] << 8) | (chunk[length - 2] << 16) |
+                              ((uint32_t)chunk[length - 1] << 24));
+    if (crc32(chunk, length - 4) != crc)
+      break;
+
+    uint64_t deviceId = reader.u64();
+    ChunkRef ref = {segmentIndex, offset, length, 0, 0, 0};
+    ref.rows = reader.u32();
+    ref.minTs = reader.u32();
+    ref.maxTs = reader.u32();
+    uint32_t lastEntryEnd = reader.u32();
+    uint64_t lastLsn = reader.u64();
+    for (size_t c = 0; c < STORE_COLUMNS; c++)
+      columnBits[c] += reader.u32();
+
+    Series &series = shardFor(deviceId).series[deviceId];
+    series.chunks.push_back(ref);
+    decodeSequences(chunk, ref.rows, series.sequences);
+    if (lastLsn > series.sealedLsn || (lastLsn == series.sealedLsn && lastEntryEnd > series.sealedEntryEnd))
+    {
+      series.sealedLsn = lastLsn;
+      series.sealedEntryEnd = lastEntryEnd;
+    }
+    sealedRows += ref.rows;
+    sealedBytes += length;
+    chunkCount++;
+    offset = (offset + length + 7) & ~7u;
+  }
+  segment.used = offset;
+  return true;
+}
+
+bool TimeSeriesStore::append(uint64_t deviceId, const uint8_t *records, size_t count)
+{
+  uint64_t lsn;
+  {
+    // The LSN is taken under the shard lock, so a series' rows are in LSN
+    // order and lastLsn/sealedLsn really cover everything below them
+    std::shared_lock<std::shared_mutex> logging(checkpointLock);
+    Shard &shard = shardFor(deviceId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    lsn = wal.append(deviceId, records, count);
+    appendRows(shard.series[deviceId], deviceId, records, count, lsn);
+  }
+  wal.waitDurable(lsn);
+  return wal.ok();
+}
+
+// Called with the shard lock held
+void TimeSeriesStore::appendRows(Series &series, uint64_t deviceId, const uint8_t *records, size_t count,
+                                 uint64_t lsn, size_t first)
+{
+  for (size_t i = first; i < count; i++)
+  {
+    VitalRecord record;
+    if (!decodeVitalRecord(records + i * VITAL_RECORD_SIZE, record))
+      continue;
+    if (!series.head)
+      series.head.reset(new HeadChunk());
+    series.head->append(record, lsn, (uint32_t)i);
+    series.sequences.add(record.sequence);
+    if (series.head->rows >= options.chunkRows)
+      seal(series, deviceId);
+  }
+}
+
+// Called with the shard lock held
+bool TimeSeriesStore::seal(Series &series, uint64_t deviceId)
+{
+  HeadChunk &head = *series.head;
+  size_t length = CHUNK_HEADER + head.bytes() + 4;
+  std::vector<uint8_t> chunk(length);
+  BinaryWriter writer(chunk.data(), length);
+  writer.u32(CHUNK_MAGIC)
+      .u32((uint32_t)length)
+      .u64(deviceId)
+      .u32(head.rows)
+      .u32(head.minTs)
+      .u32(head.maxTs)
+      .u32(head.lastEntryEnd)
+      .u64(head.lastLsn);
+  for (const BitWriter &column : head.columns)
+    writer.u32((uint32_t)column.bits());
+  for (const BitWriter &column : head.columns)
+    writer.bytes(column.data(), column.byteLength());
+  writer.u32(crc32(chunk.data(), length - 4));
+
+  ChunkRef ref = {0, 0, (uint32_t)length, head.rows, head.minTs, head.maxTs};
+  if (!writeChunk(chunk, ref))
+    return false; // keep the head; the log still has it
+
+  for (size_t c = 0; c < STORE_COLUMNS; c++)
+    columnBits[c] += head.columns[c].bits();
+  sealedRows += head.rows;
+  sealedBytes += length;
+  chunkCount++;
+  series.chunks.push_back(ref);
+  series.sealedLsn = head.lastLsn;
+  series.sealedEntryEnd = head.lastEntryEnd;
+  series.head.reset();
+  return true;
+}
+
+bool TimeSeriesStore::writeChunk(const std::vector<uint8_t> &chunk, ChunkRef &ref)
+{
+  std::lock_guard<std::mutex> guard(segmentLock);
+  if (chunk.size() > options.segmentBytes)
+    return false;
+  Segment *segment = segments.back().get();
+  if (segment->used + chunk.size() > options.segmentBytes)
+  {
+    // Sync the full segment before any chunk lands in the next one, so a
+    // crash can only tear the tail of the newest segment
+    if (segment->dirty && fdatasync(segment->fd) != 0)
+      return false;
+    segment->dirty = false;
+    if (!openSegment((uint32_t)segments.size() + 1, true))
+      return false;
+    segment = segments.back().get();
+  }
+
+  if (pwrite(segment->fd, chunk.data(), chunk.size(), segment->used) != (ssize_t)chunk.size())
+  {
+    perror("write chunk");
+    return false;
+  }
+  ref.segment = (uint32_t)segments.size() - 1;
+  ref.offset = segment->used;
+  segment->used = (uint32_t)((segment->used + chunk.size() + 7) & ~(size_t)7);
+  segment->dirty = true;
+  return true;
+}
+
+bool TimeSeriesStore::syncSegments()
+{
+  std::lock_guard<std::mutex> guard(segmentLock);
+  bool ok = true;
+  for (std::unique_ptr<Segment> &segment : segments)
+  {
+    if (segment->dirty)
+    {
+      ok = fdatasync(segment->fd) == 0 && ok;
+      segment->dirty = false;
+    }
+  }
+  return ok;
+}
+
+bool TimeSeriesStore::checkpoint()
+{
+  std::lock_guard<std::mutex> running(checkpointRun);
+  {
+    // No append is between its log entry and its head rows while rotating,
+    // so every entry in the old files is in a head below
+    std::unique_lock<std::shared_mutex> exclusive(checkpointLock);
+    if (!wal.rotate())
+      return false;
+  }
+
+  bool ok = true;
+  for (Shard &shard : shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (auto &entry : shard.series)
+    {
+      if (entry.second.head && entry.second.head->rows > 0)
+        ok = seal(entry.second, entry.first) && ok;
+    }
+  }
+  if (!ok || !syncSegments())
+    return false;
+  wal.dropRotated();
+  return true;
+}
+
+void TimeSeriesStore::decodeSequences(const uint8_t *chunk, uint32_t rows, SequenceRuns &out)
+{
+  BinaryReader reader(chunk + 40, 8);
+  size_t timestampBits = reader.u32();
+  size_t sequenceBits = reader.u32();
+  BitReader column(chunk + CHUNK_HEADER + (timestampBits + 7) / 8, sequenceBits);
+  DeltaOfDeltaDecoder sequences;
+  for (uint32_t row = 0; row < rows; row++)
+    out.add((uint32_t)sequences.next(column));
+}
+
+size_t TimeSeriesStore::decodeColumns(const uint8_t *const columns[STORE_COLUMNS], const size_t bits[STORE_COLUMNS],
+                                      uint32_t rows, uint32_t fromMs, uint32_t toMs, std::vector<VitalRecord> &out)
+{
+  BitReader readers[STORE_COLUMNS] = {
+      {columns[0], bits[0]}, {columns[1], bits[1]}, {columns[2], bits[2]}, {columns[3], bits[3]},
+      {columns[4], bits[4]}, {columns[5], bits[5]}, {columns[6], bits[6]}, {columns[7], bits[7]},
+  };
+  DeltaOfDeltaDecoder timestamps;
+  DeltaOfDeltaDecoder sequences;
+  RepeatDecoder flags(16);
+  XorDecoder values[VALUE_COLUMNS];
+
+  size_t added = 0;
+  for (uint32_t row = 0; row < rows; row++)
+  {
+    VitalRecord record;
+    record.vitals.timestampMs = (uint32_t)timestamps.next(readers[COLUMN_TIMESTAMP]);
+    record.sequence = (uint32_t)sequences.next(readers[COLUMN_SEQUENCE]);
+    uint32_t packed = flags.next(readers[COLUMN_FLAGS]);
+    record.alertFlags = (uint8_t)packed;
+    record.recordFlags = (uint8_t)(packed >> 8);
+    record.vitals.heartRate = values[0].next(readers[COLUMN_HEART_RATE]);
+    record.vitals.systolicBP = values[1].next(readers[COLUMN_SYSTOLIC]);
+    record.vitals.diastolicBP = values[2].next(readers[COLUMN_DIASTOLIC]);
+    record.vitals.spO2 = values[3].next(readers[COLUMN_SPO2]);
+    record.vitals.temperature = values[4].next(readers[COLUMN_TEMPERATURE]);
+    if (record.vitals.timestampMs >= fromMs && record.vitals.timestampMs <= toMs)
+    {
+      out.push_back(record);
+      added++;
+    }
+  }
+  return added;
+}
+
+size_t TimeSeriesStore::query(uint64_t deviceId, uint32_t fromMs, uint32_t toMs, std::vector<VitalRecord> &out)
+{
+  // One pass under the lock: the chunk list and the head decoded in place,
+  // so a seal in between cannot hide or repeat rows
+  std::vector<ChunkRef> chunks;
+  std::vector<VitalRecord> headRows;
+  {
+    Shard &shard = shardFor(deviceId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.series.find(deviceId);
+    if (it == shard.series.end())
+      return 0;
+    for (const ChunkRef &ref : it->second.chunks)
+    {
+      if (ref.maxTs >= fromMs && ref.minTs <= toMs)
+        chunks.push_back(ref);
+    }
+    const HeadChunk *head = it->second.head.get();
+    if (head && head->maxTs >= fromMs && head->minTs <= toMs)
+    {
+      const uint8_t *columns[STORE_COLUMNS];
+      size_t bits[STORE_COLUMNS];
+      for (size_t c = 0; c < STORE_COLUMNS; c++)
+      {
+        columns[c] = head->columns[c].data();
+        bits[c] = head->columns[c].bits();
+      }
+      decodeColumns(columns, bits, head->rows, fromMs, toMs, headRows);
+    }
+  }
+
+  std::vector<const uint8_t *> bases;
+  {
+    std::lock_guard<std::mutex> guard(segmentLock);
+    for (const ChunkRef &ref : chunks)
+      bases.push_back(segments[ref.segment]->map + ref.offset);
+  }
+
+  // Sealed chunks are immutable: decode them from the mapping unlocked
+  size_t added = 0;
+  for (size_t i = 0; i < chunks.size(); i++)
+  {
+    BinaryReader reader(bases[i] + 40, STORE_COLUMNS * 4);
+    const uint8_t *columns[STORE_COLUMNS];
+    size_t bits[STORE_COLUMNS];
+    const uint8_t *data = bases[i] + CHUNK_HEADER;
+    for (size_t c = 0; c < STORE_COLUMNS; c++)
+    {
+      bits[c] = reader.u32();
+      columns[c] = data;
+      data += (bits[c] + 7) / 8;
+    }
+    added += decodeColumns(columns, bits, chunks[i].rows, fromMs, toMs, out);
+  }
+  out.insert(out.end(), headRows.begin(), headRows.end());
+  return added + headRows.size();
+}
+
+bool TimeSeriesStore::contains(uint64_t deviceId, uint32_t sequence)
+{
+  Shard &shard = shardFor(deviceId);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto it = shard.series.find(deviceId);
+  return it != shard.series.end() && it->second.sequences.contains(sequence);
+}
+
+void TimeSeriesStore::recentSequences(uint64_t deviceId, uint32_t window, std::vector<uint32_t> &out)
+{
+  Shard &shard = shardFor(deviceId);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto it = shard.series.find(deviceId);
+  if (it == shard.series.end() || it->second.sequences.empty())
+    return;
+  uint32_t highest = it->second.sequences.highest();
+  it->second.sequences.collect(highest >= window ? highest - window + 1 : 0, highest, out);
+}
+
+std::vector<uint64_t> TimeSeriesStore::seriesIds()
+{
+  std::vector<uint64_t> ids;
+  for (Shard &shard : shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (auto &entry : shard.series)
+      ids.push_back(entry.first);
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+StoreStats TimeSeriesStore::statistics()
+{
+  StoreStats stats;
+  for (Shard &shard : shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    stats.series += shard.series.size();
+    for (auto &entry : shard.series)
+    {
+      if (!entry.second.head)
+        continue;
+      stats.headRows += entry.second.head->rows;
+      stats.headBytes += entry.second.head->bytes();
+      for (size_t c = 0; c < STORE_COLUMNS; c++)
+        stats.columnBits[c] += entry.second.head->columns[c].bits();
+    }
+  }
+  for (size_t c = 0; c < STORE_COLUMNS; c++)
+    stats.columnBits[c] += columnBits[c];
+  stats.chunks = chunkCount;
+  stats.sealedRows = sealedRows;
+  stats.sealedBytes = sealedBytes;
+  {
+    std::lock_guard<std::mutex> guard(segmentLock);
+    stats.segments = segments.size();
+  }
+  stats.wal = wal.statistics();
+  return stats;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,235 @@
+/*
+ * VitalCare Rural Gateway - Columnar Time-Series Store
+ *
+ * Vitals are stored per series (one device = one patient session) in
+ * column chunks of up to chunkRows rows. Each column is compressed with the
+ * Gorilla codecs: delta-of-delta timestamps and sequence numbers, XOR
+ * floats for the five vitals, repeat coding for the flags.
+ *
+ * - Appends go to the write-ahead log first and into the series' open
+ *   (head) chunk in memory; append() returns once the log entry is durable.
+ * - A full head chunk is sealed: serialised with a CRC into the active
+ *   segment file. Segments are preallocated and memory-mapped read-only,
+ *   so queries decode sealed chunks straight from the page cache.
+ * - checkpoint() seals every head, syncs the segments and drops the log
+ *   files they cover. On open, segments are scanned back into the chunk
+ *   index and the log is replayed on top. Each chunk carries the last LSN
+ *   it contains and how far into that entry it reaches (a batch can span
+ *   two chunks), so replay skips exactly what was already sealed.
+ *
+ * Chunk (8-byte aligned in segment-NNNNNN.vcs):
+ *   0  u32 magic "VCC1"     4  u32 length incl. CRC
+ *   8  u64 device id        16 u32 rows
+ *   20 u32 min timestamp    24 u32 max timestamp
+ *   28 u32 records of the last LSN's entry covered (end index)
+ *   32 u64 last LSN         40 u32 x 8 column lengths (bits)
+ *   72 column bytes ...     length-4: CRC-32 of everything before
+ *
+ * Timestamps are the device's millis(), as in VitalRecord.
+ *
+ * Each series also keeps the sequence numbers it holds as runs in memory
+ * (rebuilt from the sequence column on open), so the ingest can tell
+ * whether a record it no longer remembers was stored.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Gorilla.h"
+#include "WriteAheadLog.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+struct StoreOptions
+{
+  bool syncWal = true;
+  uint32_t chunkRows = 1024;
+  uint32_t segmentBytes = 64u << 20;
+};
+
+enum StoreColumn
+{
+  COLUMN_TIMESTAMP,
+  COLUMN_SEQUENCE,
+  COLUMN_FLAGS,
+  COLUMN_HEART_RATE,
+  COLUMN_SYSTOLIC,
+  COLUMN_DIASTOLIC,
+  COLUMN_SPO2,
+  COLUMN_TEMPERATURE,
+  STORE_COLUMNS
+};
+
+struct StoreStats
+{
+  uint64_t series = 0;
+  uint64_t chunks = 0;
+  uint64_t segments = 0;
+  uint64_t sealedRows = 0;
+  uint64_t sealedBytes = 0; // chunk bytes including headers
+  uint64_t headRows = 0;
+  uint64_t headBytes = 0;
+  uint64_t columnBits[STORE_COLUMNS] = {};
+  WalStats wal;
+
+  double bytesPerSample() const
+  {
+    uint64_t rows = sealedRows + headRows;
+    return rows ? (double)(sealedBytes + headBytes) / rows : 0.0;
+  }
+};
+
+// Sorted, disjoint [first, last] runs of sequence numbers. A device numbers
+// its records consecutively, so a series is a handful of runs.
+class SequenceRuns
+{
+public:
+  void add(uint32_t sequence);
+  bool contains(uint32_t sequence) const;
+  bool empty() const { return runs.empty(); }
+  uint32_t highest() const { return runs.empty() ? 0 : runs.rbegin()->second; }
+  // Appends the sequences in [from, to] to out, ascending
+  void collect(uint32_t from, uint32_t to, std::vector<uint32_t> &out) const;
+
+private:
+  std::map<uint32_t, uint32_t> runs; // first -> last
+};
+
+class TimeSeriesStore
+{
+public:
+  static const size_t CHUNK_HEADER = 72;
+
+  TimeSeriesStore(const std::string &directory, const StoreOptions &options = StoreOptions());
+  ~TimeSeriesStore();
+
+  TimeSeriesStore(const TimeSeriesStore &) = delete;
+  TimeSeriesStore &operator=(const TimeSeriesStore &) = delete;
+
+  // Loads the segments and replays the log
+  bool open();
+  // Checkpoints and releases everything
+  void close();
+
+  // Stores encoded, already validated VitalRecords; returns once durable
+  bool append(uint64_t deviceId, const uint8_t *records, size_t count);
+
+  // Appends the rows of one series with fromMs <= timestamp <= toMs to
+  // out, oldest chunk first. Returns the number of rows added.
+  size_t query(uint64_t deviceId, uint32_t fromMs, uint32_t toMs, std::vector<VitalRecord> &out);
+
+  // Whether a series holds a row with this sequence number
+  bool contains(uint64_t deviceId, uint32_t sequence);
+  // Appends the sequence numbers a series holds in the window below (and
+  // including) its highest to out, ascending
+  void recentSequences(uint64_t deviceId, uint32_t window, std::vector<uint32_t> &out);
+
+  bool checkpoint();
+  uint64_t walBytes() { return wal.fileBytes(); }
+
+  std::vector<uint64_t> seriesIds();
+  StoreStats statistics();
+
+private:
+  struct ChunkRef
+  {
+    uint32_t segment;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t rows;
+    uint32_t minTs;
+    uint32_t maxTs;
+  };
+
+  struct HeadChunk
+  {
+    BitWriter columns[STORE_COLUMNS];
+    DeltaOfDeltaEncoder timestamps;
+    DeltaOfDeltaEncoder sequences;
+    RepeatEncoder flags{16};
+    XorEncoder values[5];
+    uint32_t rows = 0;
+    uint32_t minTs = 0;
+    uint32_t maxTs = 0;
+    uint64_t lastLsn = 0;
+    uint32_t lastEntryEnd = 0;
+
+    void append(const VitalRecord &record, uint64_t lsn, uint32_t entryIndex);
+    size_t bytes() const;
+  };
+
+  struct Series
+  {
+    std::vector<ChunkRef> chunks;
+    std::unique_ptr<HeadChunk> head;
+    SequenceRuns sequences;
+    uint64_t sealedLsn = 0;
+    uint32_t sealedEntryEnd = 0;
+  };
+
+  struct Shard
+  {
+    std::mutex lock;
+    std::unordered_map<uint64_t, Series> series;
+  };
+
+  struct Segment
+  {
+    int fd = -1;
+    const uint8_t *map = nullptr;
+    uint32_t used = 0;
+    bool dirty = false;
+  };
+
+  static const size_t SHARDS = 64;
+
+  Shard &shardFor(uint64_t deviceId) { return shards[(deviceId * 0x9E3779B97F4A7C15ull) >> 58]; }
+
+  bool openSegment(uint32_t number, bool create);
+  bool loadSegment(uint32_t number);
+  void appendRows(Series &series, uint64_t deviceId, const uint8_t *records, size_t count, uint64_t lsn,
+                  size_t first = 0);
+  bool seal(Series &series, uint64_t deviceId);
+  bool writeChunk(const std::vector<uint8_t> &chunk, ChunkRef &ref);
+  bool syncSegments();
+
+  static void decodeSequences(const uint8_t *chunk, uint32_t rows, SequenceRuns &out);
+  static size_t decodeColumns(const uint8_t *const columns[STORE_COLUMNS], const size_t bits[STORE_COLUMNS],
+                              uint32_t rows, uint32_t fromMs, uint32_t toMs, std::vector<VitalRecord> &out);
+
+  std::string directory;
+  StoreOptions options;
+  WriteAheadLog wal;
+  bool opened;
+
+  // Appends hold it shared; checkpoint() takes it to rotate the log
+  std::shared_mutex checkpointLock;
+  std::mutex checkpointRun;
+  Shard shards[SHARDS];
+
+  std::mutex segmentLock;
+  std::vector<std::unique_ptr<Segment>> segments;
+
+  std::atomic<uint64_t> sealedRows{0};
+  std::atomic<uint64_t> sealedBytes{0};
+  std::atomic<uint64_t> chunkCount{0};
+  std::atomic<uint64_t> columnBits[STORE_COLUMNS] = {};
+};
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,187 @@
+/*
+ * VitalCare Rural Gateway - Uplink Client
+ */
+
+#include "UplinkClient.h"
+
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+
+#include "HttpCodec.h"
+#include "MqttCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+UplinkClient::UplinkClient(EventLoop &loop, uint64_t deviceId, bool mqtt)
+    : loop(loop), deviceId(deviceId), useMqtt(mqtt)
+{
+  topic = "vitalcare/" + std::to_string(deviceId) + "/uplink";
+}
+
+UplinkClient::~UplinkClient()
+{
+  if (fd >= 0)
+  {
+    loop.remove(fd);
+    close(fd);
+  }
+}
+
+bool UplinkClient::connect(const sockaddr_in &address)
+{
+  fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || ::connect(fd, (const sockaddr *)&address, sizeof(address)) != 0)
+  {
+    perror("connect");
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  registered = EPOLLIN;
+  if (!loop.add(fd, EPOLLIN, [this](uint32_t events) { onEvents(events); }))
+    return false;
+
+  if (useMqtt)
+  {
+    appendMqttConnect(output, "vc-" + std::to_string(deviceId), 60);
+    appendMqttSubscribe(output, 1, "vitalcare/" + std::to_string(deviceId) + "/ack", 0);
+    flush();
+  }
+  return true;
+}
+
+void UplinkClient::send(const uint8_t *batch, size_t length)
+{
+  if (broken)
+    return;
+  if (useMqtt)
+  {
+    packetId = packetId == 0xFFFF ? 1 : packetId + 1;
+    appendMqttPublish(output, topic, 1, packetId, batch, length);
+  }
+  else
+    appendHttpRequest(output, "POST", "/api/v1/uplink", "application/octet-stream", batch, length);
+  flush();
+}
+
+void UplinkClient::onEvents(uint32_t events)
+{
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+  {
+    char chunk[16 * 1024];
+    while (true)
+    {
+      ssize_t got = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+      if (got > 0)
+      {
+        input.append(chunk, got);
+        continue;
+      }
+      if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      {
+        fail("connection closed by gateway");
+        return;
+      }
+      break;
+    }
+    parseInput();
+  }
+  if (!broken)
+    flush();
+}
+
+void UplinkClient::parseInput()
+{
+  size_t offset = 0;
+  while (!broken && offset < input.size())
+  {
+    size_t consumed = 0;
+    const uint8_t *ack = nullptr;
+    size_t ackLength = 0;
+    if (useMqtt)
+    {
+      MqttPacket packet;
+      ParseResult parsed =
+          parseMqttPacket((const uint8_t *)input.data() + offset, input.size() - offset, 1 << 20, packet, consumed);
+      if (parsed == PARSE_INCOMPLETE)
+        break;
+      if (parsed == PARSE_ERROR)
+        return fail("bad MQTT packet");
+      MqttPublish publish;
+      if (packet.type == MQTT_PUBLISH && parseMqttPublish(packet, publish))
+      {
+        ack = publish.payload;
+        ackLength = publish.payloadLength;
+      }
+    }
+    else
+    {
+      HttpMessage response;
+      ParseResult parsed = parseHttpResponse(input.data() + offset, input.size() - offset, 1 << 20, response, consumed);
+      if (parsed == PARSE_INCOMPLETE)
+        break;
+      if (parsed == PARSE_ERROR)
+        return fail("bad HTTP response");
+      ack = (const uint8_t *)input.data() + offset + response.bodyOffset;
+      ackLength = response.bodyLength;
+    }
+
+    if (ack)
+    {
+      UplinkAck decoded;
+      if (!decodeUplinkAck(ack, ackLength, decoded))
+        return fail("undecodable ack");
+      if (ackHandler)
+        ackHandler(decoded);
+    }
+    offset += consumed;
+  }
+  input.erase(0, offset);
+}
+
+void UplinkClient::flush()
+{
+  while (outputOffset < output.size())
+  {
+    ssize_t sent = ::send(fd, output.data() + outputOffset, output.size() - outputOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent > 0)
+    {
+      outputOffset += sent;
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      break;
+    return fail("send failed");
+  }
+  if (outputOffset == output.size())
+  {
+    output.clear();
+    outputOffset = 0;
+  }
+  uint32_t events = EPOLLIN | (output.empty() ? 0u : (uint32_t)EPOLLOUT);
+  if (events != registered)
+  {
+    registered = events;
+    loop.modify(fd, events);
+  }
+}
+
+void UplinkClient::fail(const char *reason)
+{
+  if (broken)
+    return;
+  broken = true;
+  if (failureHandler)
+    failureHandler(reason);
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,79 @@
+/*
+ * VitalCare Rural Gateway - Uplink Client
+ *
+ * The device end of the uplink, for the host load tools: one connection to
+ * the gateway registered on an EventLoop. send() frames a batch as HTTP
+ * (POST /api/v1/uplink) or MQTT (QoS 1 PUBLISH to vitalcare/<id>/uplink,
+ * acks subscribed on vitalcare/<id>/ack) and every ack that comes back is
+ * decoded and handed to the ack handler. Whether an ack was expected is the
+ * caller's business.
+ */
+
+#pragma once
+
+#include <netinet/in.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <VitalCareCore.h>
+
+#include "EventLoop.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+class UplinkClient
+{
+public:
+  typedef std::function<void(const UplinkAck &ack)> AckHandler;
+  typedef std::function<void(const char *reason)> FailureHandler;
+
+  UplinkClient(EventLoop &loop, uint64_t deviceId, bool mqtt);
+  ~UplinkClient();
+
+  UplinkClient(const UplinkClient &) = delete;
+  UplinkClient &operator=(const UplinkClient &) = delete;
+
+  void setAckHandler(AckHandler handler) { ackHandler = std::move(handler); }
+  // Called once, when the connection breaks or the gateway sends garbage
+  void setFailureHandler(FailureHandler handler) { failureHandler = std::move(handler); }
+
+  // Blocking connect keeps start-up simple; all I/O after it is non-blocking.
+  // MQTT CONNECT and SUBSCRIBE are queued ahead of the first batch.
+  bool connect(const sockaddr_in &address);
+
+  void send(const uint8_t *batch, size_t length);
+
+  bool mqtt() const { return useMqtt; }
+  bool failed() const { return broken; }
+  size_t queuedBytes() const { return output.size() - outputOffset; }
+
+private:
+  void onEvents(uint32_t events);
+  void parseInput();
+  void flush();
+  void fail(const char *reason);
+
+  EventLoop &loop;
+  uint64_t deviceId;
+  bool useMqtt;
+  std::string topic;
+  AckHandler ackHandler;
+  FailureHandler failureHandler;
+
+  int fd = -1;
+  uint32_t registered = 0;
+  std::string input;
+  std::string output;
+  size_t outputOffset = 0;
+  uint16_t packetId = 0;
+  bool broken = false;
+};
+
+} // namespace gateway
+} // namespace vitalcare
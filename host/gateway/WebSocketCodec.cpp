@@ -0,0 +1,190 @@
+/*
+ * VitalCare Rural Gateway - WebSocket Framing
+ */
+
+#include "WebSocketCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t rotateLeft(uint32_t value, int bits)
+{
+  return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1 is only used for the handshake, so a plain one-shot version will do
+static void sha1(const uint8_t *data, size_t length, uint8_t digest[20])
+{
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+  std::string message((const char *)data, length);
+  message.push_back((char)0x80);
+  while (message.size() % 64 != 56)
+    message.push_back(0);
+  uint64_t bits = (uint64_t)length * 8;
+  for (int i = 7; i >= 0; i--)
+    message.push_back((char)(bits >> (i * 8)));
+
+  for (size_t block = 0; block < message.size(); block += 64)
+  {
+    const uint8_t *p = (const uint8_t *)message.data() + block;
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+      w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 80; i++)
+      w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++)
+    {
+      uint32_t f, k;
+      if (i < 20)
+      {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      }
+      else if (i < 40)
+      {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      }
+      else if (i < 60)
+      {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      }
+      else
+      {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t next = rotateLeft(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotateLeft(b, 30);
+      b = a;
+      a = next;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int i = 0; i < 5; i++)
+  {
+    digest[4 * i] = (uint8_t)(h[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(h[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(h[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)h[i];
+  }
+}
+
+static std::string base64(const uint8_t *data, size_t length)
+{
+  static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < length; i += 3)
+  {
+    uint32_t triple = (uint32_t)data[i] << 16;
+    if (i + 1 < length)
+      triple |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length)
+      triple |= data[i + 2];
+    out.push_back(ALPHABET[(triple >> 18) & 63]);
+    out.push_back(ALPHABET[(triple >> 12) & 63]);
+    out.push_back(i + 1 < length ? ALPHABET[(triple >> 6) & 63] : '=');
+    out.push_back(i + 2 < length ? ALPHABET[triple & 63] : '=');
+  }
+  return out;
+}
+
+std::string webSocketAccept(const std::string &key)
+{
+  std::string input = key + WEBSOCKET_GUID;
+  uint8_t digest[20];
+  sha1((const uint8_t *)input.data(), input.size(), digest);
+  return base64(digest, sizeof(digest));
+}
+
+void appendWebSocketHandshake(std::string &out, const std::string &key)
+{
+  out += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+  out += webSocketAccept(key);
+  out += "\r\n\r\n";
+}
+
+void appendWebSocketFrame(std::string &out, uint8_t opcode, const void *payload, size_t length)
+{
+  out.push_back((char)(0x80 | opcode));
+  if (length < 126)
+  {
+    out.push_back((char)length);
+  }
+  else if (length <= 0xFFFF)
+  {
+    out.push_back((char)126);
+    out.push_back((char)(length >> 8));
+    out.push_back((char)length);
+  }
+  else
+  {
+    out.push_back((char)127);
+    for (int i = 7; i >= 0; i--)
+      out.push_back((char)((uint64_t)length >> (i * 8)));
+  }
+  out.append((const char *)payload, length);
+}
+
+ParseResult parseWebSocketFrame(const uint8_t *data, size_t length, size_t maxPayload, WebSocketFrame &frame,
+                                size_t &consumed)
+{
+  if (length < 2)
+    return PARSE_INCOMPLETE;
+  frame.final = (data[0] & 0x80) != 0;
+  frame.opcode = data[0] & 0x0F;
+  bool masked = (data[1] & 0x80) != 0;
+  uint64_t payloadLength = data[1] & 0x7F;
+  size_t offset = 2;
+
+  if (!masked || (data[0] & 0x70) != 0)
+    return PARSE_ERROR; // unmasked client frame or an extension we did not agree to
+  if (payloadLength == 126)
+  {
+    if (length < offset + 2)
+      return PARSE_INCOMPLETE;
+    payloadLength = (uint64_t)data[2] << 8 | data[3];
+    offset += 2;
+  }
+  else if (payloadLength == 127)
+  {
+    if (length < offset + 8)
+      return PARSE_INCOMPLETE;
+    payloadLength = 0;
+    for (int i = 0; i < 8; i++)
+      payloadLength = payloadLength << 8 | data[offset + i];
+    offset += 8;
+  }
+  if ((frame.opcode & 0x8) && (payloadLength > 125 || !frame.final))
+    return PARSE_ERROR;
+  if (payloadLength > maxPayload)
+    return PARSE_ERROR;
+
+  if (length < offset + 4 + payloadLength)
+    return PARSE_INCOMPLETE;
+  const uint8_t *mask = data + offset;
+  offset += 4;
+  frame.payload.resize(payloadLength);
+  for (size_t i = 0; i < payloadLength; i++)
+    frame.payload[i] = (char)(data[offset + i] ^ mask[i & 3]);
+  consumed = offset + payloadLength;
+  return PARSE_COMPLETE;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,56 @@
+/*
+ * VitalCare Rural Gateway - WebSocket Framing (RFC 6455)
+ *
+ * The subset a push feed needs: the opening handshake answer, unmasked
+ * server frames, and parsing of the masked frames a browser sends back
+ * (close, ping, pong; data frames are read and ignored). No extensions,
+ * no fragmented sends.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "HttpCodec.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+enum WebSocketOpcode : uint8_t
+{
+  WS_CONTINUATION = 0x0,
+  WS_TEXT = 0x1,
+  WS_BINARY = 0x2,
+  WS_CLOSE = 0x8,
+  WS_PING = 0x9,
+  WS_PONG = 0xA,
+};
+
+struct WebSocketFrame
+{
+  uint8_t opcode = 0;
+  bool final = true;
+  std::string payload; // unmasked
+};
+
+// Sec-WebSocket-Accept for a client's Sec-WebSocket-Key
+std::string webSocketAccept(const std::string &key);
+
+// "101 Switching Protocols" answer to an upgrade request
+void appendWebSocketHandshake(std::string &out, const std::string &key);
+
+// One unmasked frame (server to client)
+void appendWebSocketFrame(std::string &out, uint8_t opcode, const void *payload, size_t length);
+
+// Parses one frame from the front of data. Client frames must be masked;
+// an unmasked one, a control frame over 125 bytes or a payload over
+// maxPayload is a PARSE_ERROR.
+ParseResult parseWebSocketFrame(const uint8_t *data, size_t length, size_t maxPayload, WebSocketFrame &frame,
+                                size_t &consumed);
+
+} // namespace gateway
+} // namespace vitalcare
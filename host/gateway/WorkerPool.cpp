@@ -0,0 +1,76 @@
+/*
+ * VitalCare Rural Gateway - Worker Pool
+ */
+
+#include "WorkerPool.h"
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+WorkerPool::WorkerPool(size_t threadCount, size_t queueCapacity) : capacity(queueCapacity), stopping(false)
+{
+  for (size_t i = 0; i < threadCount; i++)
+    threads.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+  shutdown();
+}
+
+bool WorkerPool::submit(Job job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping || jobs.size() >= capacity)
+      return false;
+    jobs.push_back(std::move(job));
+  }
+  available.notify_one();
+  return true;
+}
+
+void WorkerPool::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping && threads.empty())
+      return;
+    stopping = true;
+  }
+  available.notify_all();
+  for (std::thread &thread : threads)
+  {
+    if (thread.joinable())
+      thread.join();
+  }
+  threads.clear();
+}
+
+size_t WorkerPool::queueDepth()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return jobs.size();
+}
+
+void WorkerPool::run()
+{
+  while (true)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      available.wait(guard, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty())
+        return; // stopping and drained
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,56 @@
+/*
+ * VitalCare Rural Gateway - Worker Pool
+ *
+ * Fixed set of threads draining one bounded job queue. The I/O loop never
+ * blocks on it: submit() refuses work when the queue is full so the
+ * caller can answer "busy" and let the device retry.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+class WorkerPool
+{
+public:
+  typedef std::function<void()> Job;
+
+  WorkerPool(size_t threads, size_t queueCapacity);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // False when the queue is full or the pool is stopping
+  bool submit(Job job);
+
+  // Finishes queued jobs, then joins the threads
+  void shutdown();
+
+  size_t threadCount() const { return threads.size(); }
+  size_t queueDepth();
+
+private:
+  void run();
+
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable available;
+  std::deque<Job> jobs;
+  size_t capacity;
+  bool stopping;
+};
+
+} // namespace gateway
+} // namespace vitalcare
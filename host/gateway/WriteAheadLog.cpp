@@ -0,0 +1,269 @@
+/*
+ * VitalCare Rural Gateway - Write-Ahead Log
+ */
+
+#include "WriteAheadLog.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <VitalCareCore.h>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+static const size_t ENTRY_HEADER = 4 + 4 + 8 + 8 + 2;
+
+static std::string walPath(const std::string &directory, uint32_t number)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/wal-%06u.log", number);
+  return directory + name;
+}
+
+static std::vector<uint32_t> listWalFiles(const std::string &directory)
+{
+  std::vector<uint32_t> numbers;
+  DIR *dir = opendir(directory.c_str());
+  if (!dir)
+    return numbers;
+  while (dirent *entry = readdir(dir))
+  {
+    unsigned number;
+    if (sscanf(entry->d_name, "wal-%06u.log", &number) == 1)
+      numbers.push_back(number);
+  }
+  closedir(dir);
+  std::sort(numbers.begin(), numbers.end());
+  return numbers;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string &directory, bool sync)
+    : directory(directory), sync(sync), fd(-1), fileNumber(0), nextLsn(1), pendingLsn(0), durableLsn(0),
+      committing(false), stopping(false), failed(false), currentFileBytes(0)
+{
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+  close();
+}
+
+bool WriteAheadLog::open(const ReplayFn &replay)
+{
+  oldFiles = listWalFiles(directory);
+  uint64_t highest = 0;
+  std::vector<uint8_t> content;
+  for (uint32_t number : oldFiles)
+  {
+    int file = ::open(walPath(directory, number).c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+      perror("open wal");
+      return false;
+    }
+    off_t size = lseek(file, 0, SEEK_END);
+    content.resize(size);
+    bool readOk = pread(file, content.data(), size, 0) == size;
+    ::close(file);
+    if (!readOk)
+      return false;
+
+    size_t offset = 0;
+    while (offset + ENTRY_HEADER <= content.size())
+    {
+      BinaryReader reader(content.data() + offset, ENTRY_HEADER);
+      uint32_t length = reader.u32();
+      uint32_t crc = reader.u32();
+      if (length < ENTRY_HEADER || offset + length > content.size() ||
+          crc32(content.data() + offset + 8, length - 8) != crc)
+        break; // torn write at the tail
+      uint64_t lsn = reader.u64();
+      uint64_t deviceId = reader.u64();
+      uint16_t count = reader.u16();
+      if (ENTRY_HEADER + (size_t)count * VITAL_RECORD_SIZE != length)
+        break;
+      replay(lsn, deviceId, content.data() + offset + ENTRY_HEADER, count);
+      highest = std::max(highest, lsn);
+      offset += length;
+    }
+  }
+
+  nextLsn = highest + 1;
+  durableLsn = highest;
+  pendingLsn = highest;
+  if (!openFile(oldFiles.empty() ? 1 : oldFiles.back() + 1))
+    return false;
+  stopping = false;
+  committer = std::thread(&WriteAheadLog::commitLoop, this);
+  return true;
+}
+
+bool WriteAheadLog::openFile(uint32_t number)
+{
+  int file = ::open(walPath(directory, number).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (file < 0)
+  {
+    perror("open wal");
+    return false;
+  }
+  fd = file;
+  fileNumber = number;
+  currentFileBytes = 0;
+  return true;
+}
+
+void WriteAheadLog::close()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  pendingReady.notify_all();
+  if (committer.joinable())
+    committer.join();
+  if (fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+uint64_t WriteAheadLog::append(uint64_t deviceId, const uint8_t *records, size_t count)
+{
+  size_t length = ENTRY_HEADER + count * VITAL_RECORD_SIZE;
+  uint64_t lsn;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    lsn = nextLsn++;
+    size_t offset = pending.size();
+    pending.resize(offset + length);
+    uint8_t *entry = pending.data() + offset;
+    BinaryWriter(entry, ENTRY_HEADER).u32((uint32_t)length).u32(0).u64(lsn).u64(deviceId).u16((uint16_t)count);
+    memcpy(entry + ENTRY_HEADER, records, count * VITAL_RECORD_SIZE);
+    BinaryWriter(entry + 4, 4).u32(crc32(entry + 8, length - 8));
+    pendingLsn = lsn;
+    stats.entries++;
+  }
+  pendingReady.notify_one();
+  return lsn;
+}
+
+void WriteAheadLog::waitDurable(uint64_t lsn)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  committed.wait(guard, [this, lsn]() { return durableLsn >= lsn || failed; });
+}
+
+void WriteAheadLog::commitLoop()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true)
+  {
+    pendingReady.wait(guard, [this]() { return stopping || !pending.empty(); });
+    if (pending.empty())
+      return; // stopping and drained
+
+    writing.swap(pending);
+    uint64_t batchLsn = pendingLsn;
+    committing = true;
+    guard.unlock();
+
+    // Everything appended while this write and sync run forms the next group
+    auto start = std::chrono::steady_clock::now();
+    size_t offset = 0;
+    bool ok = true;
+    while (offset < writing.size())
+    {
+      ssize_t written = write(fd, writing.data() + offset, writing.size() - offset);
+      if (written <= 0)
+      {
+        perror("write wal");
+        ok = false;
+        break;
+      }
+      offset += written;
+    }
+    if (ok && sync && fdatasync(fd) != 0)
+    {
+      perror("fdatasync wal");
+      ok = false;
+    }
+    uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+    guard.lock();
+    stats.commits++;
+    stats.bytes += writing.size();
+    stats.syncNs += elapsed;
+    currentFileBytes += writing.size();
+    writing.clear();
+    committing = false;
+    // A failed log cannot promise durability; waiters are released and
+    // ok() turns false
+    failed = failed || !ok;
+    durableLsn = batchLsn;
+    committed.notify_all();
+  }
+}
+
+bool WriteAheadLog::rotate()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  committed.wait(guard, [this]() { return (pending.empty() && !committing) || failed; });
+  int previous = fd;
+  uint32_t previousNumber = fileNumber;
+  if (!openFile(fileNumber + 1))
+  {
+    fd = previous;
+    fileNumber = previousNumber;
+    return false;
+  }
+  ::close(previous);
+  guard.unlock();
+  oldFiles.push_back(previousNumber);
+  return true;
+}
+
+void WriteAheadLog::dropRotated()
+{
+  for (uint32_t number : oldFiles)
+    unlink(walPath(directory, number).c_str());
+  oldFiles.clear();
+}
+
+bool WriteAheadLog::ok()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return !failed;
+}
+
+uint64_t WriteAheadLog::lastLsn()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return nextLsn - 1;
+}
+
+uint64_t WriteAheadLog::fileBytes()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return currentFileBytes;
+}
+
+WalStats WriteAheadLog::statistics()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return stats;
+}
+
+} // namespace gateway
+} // namespace vitalcare
@@ -0,0 +1,103 @@
+/*
+ * VitalCare Rural Gateway - Write-Ahead Log
+ *
+ * Every vitals batch is logged before it is acked. Appends only copy into
+ * a buffer; one committer thread writes whatever has accumulated and
+ * fdatasync()s it, so concurrent workers share each sync (group commit)
+ * and the sync rate, not the batch rate, bounds the disk.
+ *
+ * Files are wal-NNNNNN.log in the store directory. A checkpoint rotates to
+ * a new file, makes everything logged before it durable elsewhere, and
+ * then drops the old files.
+ *
+ * Entry: u32 length, u32 CRC-32 (of what follows), u64 LSN, u64 device id,
+ *        u16 record count, count x VITAL_RECORD_SIZE bytes
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vitalcare
+{
+namespace gateway
+{
+
+struct WalStats
+{
+  uint64_t entries = 0;
+  uint64_t commits = 0;
+  uint64_t bytes = 0;
+  uint64_t syncNs = 0;
+};
+
+class WriteAheadLog
+{
+public:
+  typedef std::function<void(uint64_t lsn, uint64_t deviceId, const uint8_t *records, size_t count)> ReplayFn;
+
+  // sync = false skips fdatasync (benchmarks, tmpfs)
+  WriteAheadLog(const std::string &directory, bool sync = true);
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  // Replays every intact entry of the existing files in LSN order, then
+  // opens a new file for appends. Returns false on I/O errors; a torn
+  // tail entry just ends the replay.
+  bool open(const ReplayFn &replay);
+  void close();
+
+  // Buffers an entry and returns its LSN; durable once waitDurable(lsn)
+  // returns.
+  uint64_t append(uint64_t deviceId, const uint8_t *records, size_t count);
+  void waitDurable(uint64_t lsn);
+
+  // Starts a new file once everything appended so far is durable.
+  // dropRotated() later deletes the files before it, when the caller has
+  // made their contents durable elsewhere. Call both from one thread.
+  bool rotate();
+  void dropRotated();
+
+  // False once a write or sync has failed; nothing appended since is safe
+  bool ok();
+  uint64_t lastLsn();
+  uint64_t fileBytes();
+  WalStats statistics();
+
+private:
+  bool openFile(uint32_t number);
+  void commitLoop();
+
+  std::string directory;
+  bool sync;
+  int fd;
+  uint32_t fileNumber;
+  std::vector<uint32_t> oldFiles;
+
+  std::mutex lock;
+  std::condition_variable pendingReady;
+  std::condition_variable committed;
+  std::vector<uint8_t> pending;
+  std::vector<uint8_t> writing;
+  uint64_t nextLsn;
+  uint64_t pendingLsn;
+  uint64_t durableLsn;
+  bool committing;
+  bool stopping;
+  bool failed;
+  uint64_t currentFileBytes;
+  WalStats stats;
+  std::thread committer;
+};
+
+} // namespace gateway
+} // namespace vitalcare
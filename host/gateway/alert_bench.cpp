@@ -0,0 +1,297 @@
+/*
+ * VitalCare Rural Gateway - Alert Evaluation Benchmark
+ *
+ * Records per second per core for central alert evaluation, scalar against
+ * AVX2. Generates rollup-rate VitalRecords for a fleet (random walks with
+ * deterioration episodes: heart rate climbing, SpO2 dropping, fever) and
+ * reports:
+ *
+ * - kernel throughput: the threshold and trend passes over one large
+ *   struct-of-arrays column set
+ * - engine throughput: AlertEngine::evaluate() on uplink-sized batches,
+ *   devices interleaved as they arrive at the gateway (decode, history and
+ *   edge detection included)
+ *
+ * and checks that both kernel sets agree record for record, and that the
+ * threshold flags equal evaluateAlerts() against the same table.
+ *
+ * Usage: vitalcare-alert-bench [--devices 1000] [--records 2000] [--batch 30]
+ *                              [--repeat 5] [--table emergency|bedside]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "AlertEngine.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One device's records at a 10 s rollup period, with the odd episode
+static void generateDevice(uint64_t deviceId, size_t count, std::vector<uint8_t> &out)
+{
+  std::mt19937 random((uint32_t)deviceId * 2654435761u);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  std::uniform_real_distribution<float> roll(0.0f, 1.0f);
+  float heartRate = 62 + deviceId % 25;
+  float systolic = 118;
+  float spO2 = 97.5f;
+  float temperature = 98.3f;
+  uint32_t timestamp = (uint32_t)(deviceId * 7919);
+  int episode = 0;
+  int episodeLeft = 0;
+
+  size_t offset = out.size();
+  out.resize(offset + count * VITAL_RECORD_SIZE);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (episodeLeft == 0 && roll(random) < 0.01f)
+    {
+      episode = 1 + (int)(roll(random) * 3.0f);
+      episodeLeft = 20;
+    }
+    if (episodeLeft > 0)
+    {
+      episodeLeft--;
+      if (episode == 1)
+        heartRate += 4;
+      else if (episode == 2)
+        spO2 -= 0.6f;
+      else
+        temperature += 0.15f;
+    }
+    else
+    {
+      // Drift back towards the device's baseline
+      heartRate += (62 + deviceId % 25 - heartRate) * 0.1f + noise(random);
+      spO2 += (97.5f - spO2) * 0.1f + 0.2f * noise(random);
+      temperature += (98.3f - temperature) * 0.1f + 0.05f * noise(random);
+      systolic += (118 - systolic) * 0.1f + 2 * noise(random);
+    }
+    timestamp += 10000 + (uint32_t)(roll(random) * 50);
+
+    VitalRecord record = {};
+    record.sequence = (uint32_t)i + 1;
+    record.vitals.heartRate = heartRate;
+    record.vitals.systolicBP = systolic;
+    record.vitals.diastolicBP = systolic * 0.66f;
+    record.vitals.spO2 = roll(random) < 0.02f ? 0 : spO2; // finger out of the clip
+    record.vitals.temperature = temperature;
+    record.vitals.timestampMs = timestamp;
+    record.alertFlags = evaluateAlerts(record.vitals, EMERGENCY_THRESHOLDS);
+    encodeVitalRecord(record, out.data() + offset + i * VITAL_RECORD_SIZE);
+  }
+}
+
+struct Columns
+{
+  std::vector<float> values[FIELD_COUNT];
+  std::vector<uint32_t> times;
+};
+
+// Runs every rule over the columns; returns the best time of repeat runs
+static double runKernels(const AlertKernels &kernels, const Columns &columns, const ThresholdRule *thresholds,
+                         size_t thresholdCount, bool trends, int repeat, std::vector<uint32_t> &flags)
+{
+  size_t count = columns.times.size();
+  double best = 1e30;
+  for (int run = 0; run < repeat; run++)
+  {
+    std::fill(flags.begin(), flags.end(), 0);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < thresholdCount; r++)
+      kernels.threshold(columns.values[thresholds[r].field].data(), count, thresholds[r], flags.data());
+    if (trends)
+    {
+      for (size_t r = 0; r < DEFAULT_TREND_RULE_COUNT; r++)
+      {
+        const TrendRule &rule = DEFAULT_TREND_RULES[r];
+        kernels.trend(columns.values[rule.field].data(), columns.times.data(), count, rule, 0x100u << r,
+                      flags.data());
+      }
+    }
+    best = std::min(best, seconds(start));
+  }
+  return best;
+}
+
+struct EngineRun
+{
+  double seconds;
+  std::vector<AlertResult> results;
+  uint64_t thresholdRecords;
+  uint64_t trendRaised;
+};
+
+// Batches from every device in turn, the way uploads interleave
+static EngineRun runEngine(AlertEngine::KernelChoice choice, const AlertThresholds &table,
+                           const std::vector<uint8_t> &records, size_t devices, size_t perDevice, size_t batch)
+{
+  AlertEngine engine(table, DEFAULT_TREND_RULES, DEFAULT_TREND_RULE_COUNT, choice);
+  EngineRun run;
+  run.results.resize(devices * perDevice);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t first = 0; first < perDevice; first += batch)
+  {
+    size_t count = std::min(batch, perDevice - first);
+    for (size_t device = 0; device < devices; device++)
+    {
+      size_t index = device * perDevice + first;
+      engine.evaluate(device + 1, records.data() + index * VITAL_RECORD_SIZE, count, run.results.data() + index);
+    }
+  }
+  run.seconds = seconds(start);
+  run.thresholdRecords = engine.statistics().thresholdRecords;
+  run.trendRaised = engine.statistics().trendRaised;
+  return run;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-alert-bench [--devices N] [--records N] [--batch N] [--repeat N]\n"
+                  "                             [--table emergency|bedside]\n");
+}
+
+int main(int argc, char **argv)
+{
+  size_t devices = 1000;
+  size_t perDevice = 2000;
+  size_t batch = 30;
+  int repeat = 5;
+  const AlertThresholds *table = &EMERGENCY_THRESHOLDS;
+  const char *tableName = "emergency";
+
+  for (int i = 1; i < argc; i += 2)
+  {
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const char *option = argv[i];
+    const char *value = argv[i + 1];
+    if (strcmp(option, "--devices") == 0)
+      devices = (size_t)atol(value);
+    else if (strcmp(option, "--records") == 0)
+      perDevice = (size_t)atol(value);
+    else if (strcmp(option, "--batch") == 0)
+      batch = (size_t)atol(value);
+    else if (strcmp(option, "--repeat") == 0)
+      repeat = atoi(value);
+    else if (strcmp(option, "--table") == 0 && strcmp(value, "emergency") == 0)
+      table = &EMERGENCY_THRESHOLDS;
+    else if (strcmp(option, "--table") == 0 && strcmp(value, "bedside") == 0)
+      table = &BEDSIDE_THRESHOLDS;
+    else
+    {
+      usage();
+      return 2;
+    }
+    if (strcmp(option, "--table") == 0)
+      tableName = value;
+  }
+  devices = std::max<size_t>(1, devices);
+  perDevice = std::max<size_t>(1, perDevice);
+  batch = std::max<size_t>(1, std::min<size_t>(batch, UPLINK_MAX_RECORDS));
+  repeat = std::max(1, repeat);
+
+  std::vector<uint8_t> records;
+  records.reserve(devices * perDevice * VITAL_RECORD_SIZE);
+  for (size_t device = 0; device < devices; device++)
+    generateDevice(device + 1, perDevice, records);
+  size_t total = devices * perDevice;
+
+  Columns columns;
+  std::vector<VitalRecord> decoded(total);
+  for (size_t f = 0; f < FIELD_COUNT; f++)
+    columns.values[f].resize(total);
+  columns.times.resize(total);
+  for (size_t i = 0; i < total; i++)
+  {
+    decodeVitalRecord(records.data() + i * VITAL_RECORD_SIZE, decoded[i]);
+    for (size_t f = 0; f < FIELD_COUNT; f++)
+      columns.values[f][i] = vitalField(decoded[i].vitals, (VitalField)f);
+    columns.times[i] = decoded[i].vitals.timestampMs;
+  }
+
+  ThresholdRule thresholds[MAX_THRESHOLD_RULES];
+  size_t thresholdCount = thresholdRulesFor(*table, thresholds, MAX_THRESHOLD_RULES);
+  const AlertKernels *avx2 = avx2AlertKernels();
+  printf("🚨 alert-bench: %zu devices x %zu records (%zu), batches of %zu, %s thresholds + %zu trend rules, "
+         "AVX2 %s\n",
+         devices, perDevice, total, batch, tableName, DEFAULT_TREND_RULE_COUNT, avx2 ? "available" : "not available");
+
+  bool ok = true;
+  std::vector<uint32_t> scalarFlags(total), avx2Flags(total);
+  printf("kernels, one core (best of %d):\n", repeat);
+  for (int trends = 0; trends < 2; trends++)
+  {
+    const char *what = trends ? "thresholds + trends" : "thresholds";
+    double scalarTime =
+        runKernels(scalarAlertKernels(), columns, thresholds, thresholdCount, trends, repeat, scalarFlags);
+    printf("  %-20s scalar %8.1f M records/s", what, total / scalarTime / 1e6);
+    if (avx2)
+    {
+      double avx2Time = runKernels(*avx2, columns, thresholds, thresholdCount, trends, repeat, avx2Flags);
+      bool same = scalarFlags == avx2Flags;
+      ok = ok && same;
+      printf("   avx2 %8.1f M records/s   x%.1f%s", total / avx2Time / 1e6, scalarTime / avx2Time,
+             same ? "" : "   ❌ results differ");
+    }
+    printf("\n");
+  }
+
+  // The column pass must be evaluateAlerts() record by record
+  size_t thresholdMismatch = 0;
+  for (size_t i = 0; i < total; i++)
+  {
+    if ((scalarFlags[i] & 0xFF) != evaluateAlerts(decoded[i].vitals, *table))
+      thresholdMismatch++;
+  }
+
+  printf("engine, batches of %zu from interleaved devices, one core:\n", batch);
+  EngineRun scalarRun = runEngine(AlertEngine::KERNELS_SCALAR, *table, records, devices, perDevice, batch);
+  printf("  scalar %8.2f M records/s", total / scalarRun.seconds / 1e6);
+  if (avx2)
+  {
+    EngineRun avx2Run = runEngine(AlertEngine::KERNELS_AUTO, *table, records, devices, perDevice, batch);
+    bool same = avx2Run.thresholdRecords == scalarRun.thresholdRecords &&
+                avx2Run.trendRaised == scalarRun.trendRaised &&
+                std::equal(avx2Run.results.begin(), avx2Run.results.end(), scalarRun.results.begin(),
+                           [](const AlertResult &a, const AlertResult &b) {
+                             return a.threshold == b.threshold && a.trend == b.trend && a.trendRaised == b.trendRaised;
+                           });
+    ok = ok && same;
+    printf("   avx2 %8.2f M records/s   x%.1f%s", total / avx2Run.seconds / 1e6, scalarRun.seconds / avx2Run.seconds,
+           same ? "" : "   ❌ results differ");
+  }
+  printf("\n");
+  for (size_t i = 0; i < total; i++)
+  {
+    if (scalarRun.results[i].threshold != evaluateAlerts(decoded[i].vitals, *table))
+      thresholdMismatch++;
+  }
+  printf("  %llu records over a threshold, %llu trends raised\n", (unsigned long long)scalarRun.thresholdRecords,
+         (unsigned long long)scalarRun.trendRaised);
+
+  ok = ok && thresholdMismatch == 0;
+  if (thresholdMismatch)
+    printf("❌ %zu threshold results differ from evaluateAlerts()\n", thresholdMismatch);
+  if (!ok)
+    return 1;
+  printf("✅ scalar and vector results identical, thresholds match evaluateAlerts()\n");
+  return 0;
+}
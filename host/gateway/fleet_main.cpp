@@ -0,0 +1,1143 @@
+/*
+ * VitalCare Rural Gateway - Synthetic Device Fleet
+ *
+ * Load test for vitalcare-gateway, in two modes. Every device is a task on
+ * one of a few event loops (no thread per device) with its own connection,
+ * HTTP or MQTT.
+ *
+ * --mode load (default) measures throughput. Each device sends a
+ * PatientRecord batch and then VitalRecord batches closed-loop: the next
+ * batch goes out when the previous one is acked. A fraction of batches is
+ * sent twice, as a device does when an ack is lost, and the acks must
+ * report exactly those records as duplicates.
+ *
+ * --mode sim behaves like a district's devices rather than a traffic
+ * generator. Each device runs the device pipeline on a virtual clock:
+ *
+ *   SimulatedEcg (100 Hz) -> ThresholdBeatDetector -> BeatChannel ->
+ *   HeartRateFusion, drifting BP/SpO2/temperature -> evaluateAlerts ->
+ *   VitalRollup -> outbox -> UplinkBatchWriter -> gateway
+ *
+ * A device uploads its outbox every --upload-seconds, and at once when a
+ * reading crosses the emergency limits; --alert-share of the devices go
+ * through a tachycardia episode. The link to the gateway is impaired in
+ * both directions: latency and jitter, and a --loss share of batches and of
+ * acks dropped. A lost batch or ack costs the device an ack timeout and a
+ * resend of the same batch, which the gateway must count as duplicates.
+ * UPLINK_BUSY backs the device off exponentially. Reported: ack round-trip
+ * and record age (rollup closed to ack received, real time) percentiles,
+ * the outbox depth as backpressure builds, and a reconciliation of records
+ * generated, confirmed, dropped on a full outbox and still pending against
+ * the gateway's accepted counter.
+ *
+ * Usage: vitalcare-fleet [--mode load|sim] [--host 127.0.0.1] [--http-port 8080]
+ *                        [--mqtt-port 1883] [--devices 200|2000] [--protocol http|mqtt|mixed]
+ *                        [--batch 100|64] [--seconds 10|30] [--threads N]
+ *          load mode:    [--duplicate-rate 0.05] [--min-rate 0]
+ *          sim mode:     [--speedup 10] [--rollup-seconds 10] [--upload-seconds 60]
+ *                        [--loss 0.01] [--latency-ms 50] [--jitter-ms 20]
+ *                        [--ack-timeout-ms 2000] [--alert-share 0.05] [--check-stats 1]
+ *                        [--run N]
+ *
+ * Both modes exit non-zero if an ack disagrees with its batch or a device
+ * fails. Load mode also fails below --min-rate acked records/s; sim mode
+ * when records are unaccounted for, or (with --check-stats 1, on an
+ * otherwise idle gateway) when the gateway accepted a different number of
+ * records than the devices had confirmed. Sim device ids include --run
+ * (default: the start time), so each run is a new set of devices to the
+ * gateway.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "EventLoop.h"
+#include "SimulatedEcg.h"
+#include "UplinkClient.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+// --devices, --seconds and --batch of 0 take the mode's default
+struct FleetOptions
+{
+  std::string mode = "load";
+  std::string host = "127.0.0.1";
+  int httpPort = 8080;
+  int mqttPort = 1883;
+  int devices = 0;
+  std::string protocol = "mixed";
+  int batch = 0;
+  double seconds = 0;
+  int threads = 0;
+
+  // Load mode
+  double duplicateRate = 0.05;
+  double minRate = 0;
+
+  // Sim mode
+  double speedup = 10;
+  int rollupSeconds = 10;
+  int uploadSeconds = 60;
+  double loss = 0.01;
+  int latencyMs = 50;
+  int jitterMs = 20;
+  int ackTimeoutMs = 2000;
+  double alertShare = 0.05;
+  bool checkStats = true;
+  uint32_t run = 0; // part of the device ids, so runs do not collide in the store
+};
+
+static uint64_t nowUs()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction)
+{
+  if (sorted.empty())
+    return 0;
+  size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+// Device index's protocol and the gateway port it connects to
+static sockaddr_in deviceTarget(const FleetOptions &options, const sockaddr_in &address, int index, bool &mqtt)
+{
+  mqtt = options.protocol == "mqtt" || (options.protocol == "mixed" && index % 2 == 1);
+  sockaddr_in target = address;
+  target.sin_port = htons((uint16_t)(mqtt ? options.mqttPort : options.httpPort));
+  return target;
+}
+
+// Devices on event loop t: the first devices % threads loops get one more
+static int loopDevices(const FleetOptions &options, int t)
+{
+  return options.devices / options.threads + (t < options.devices % options.threads ? 1 : 0);
+}
+
+// Load mode: closed-loop batches with deliberate resends
+
+struct FleetResult
+{
+  uint64_t batches = 0;
+  uint64_t uniqueSent = 0;    // records in first sends, acked
+  uint64_t duplicateSent = 0; // records in deliberate resends, acked
+  uint64_t accepted = 0;
+  uint64_t duplicates = 0;
+  uint64_t rejected = 0;
+  uint64_t busy = 0;
+  uint64_t mismatches = 0;
+  uint64_t failedDevices = 0;
+  std::vector<uint32_t> latenciesUs;
+};
+
+class Device
+{
+public:
+  Device(EventLoop &loop, FleetResult &result, uint64_t deviceId, bool mqtt, const FleetOptions &options,
+         uint32_t seed)
+      : result(result), deviceId(deviceId), options(options), random(seed), client(loop, deviceId, mqtt),
+        batch(UPLINK_HEADER_SIZE + UPLINK_MAX_RECORDS * PATIENT_RECORD_SIZE)
+  {
+    client.setAckHandler([this](const UplinkAck &ack) { handleAck(ack); });
+    client.setFailureHandler([this](const char *reason) { fail(reason); });
+  }
+
+  bool connect(const sockaddr_in &address)
+  {
+    if (!client.connect(address))
+      return false;
+    sendNext();
+    return true;
+  }
+
+  // Resends a batch the gateway was too busy for
+  void poll(uint64_t now)
+  {
+    if (retryAtUs && now >= retryAtUs)
+    {
+      retryAtUs = 0;
+      transmit();
+    }
+  }
+
+  void stopSending() { stopping = true; }
+  bool idle() const { return !inFlight || failed; }
+
+private:
+  void sendNext()
+  {
+    if (stopping || failed)
+      return;
+
+    // Deliberate duplicate: the previous batch again, as after a lost ack
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    if (batchLength > 0 && roll(random) < options.duplicateRate)
+    {
+      resend = true;
+    }
+    else
+    {
+      resend = false;
+      buildBatch();
+    }
+    transmit();
+  }
+
+  void buildBatch()
+  {
+    if (!patientSent)
+    {
+      UplinkBatchWriter writer(batch.data(), batch.size(), UPLINK_PATIENT_RECORDS, deviceId, batchSequence++);
+      PatientRecord patient = {};
+      patient.sequence = 1;
+      snprintf(patient.patientId, sizeof(patient.patientId), "VCR%llu", (unsigned long long)deviceId);
+      snprintf(patient.name, sizeof(patient.name), "Synthetic Patient %llu", (unsigned long long)deviceId);
+      patient.age = (uint8_t)(20 + deviceId % 60);
+      patient.gender = deviceId % 2 ? 'F' : 'M';
+      writer.add(patient);
+      batchLength = writer.finish();
+      batchCount = writer.count();
+      patientSent = true;
+      return;
+    }
+
+    UplinkBatchWriter writer(batch.data(), batch.size(), UPLINK_VITAL_RECORDS, deviceId, batchSequence++);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    for (int i = 0; i < options.batch; i++)
+    {
+      VitalRecord record = {};
+      record.sequence = recordSequence++;
+      record.vitals.timestampMs = record.sequence * 1000;
+      record.vitals.heartRate = 72.0f + 4.0f * noise(random);
+      record.vitals.systolicBP = 120.0f + 5.0f * noise(random);
+      record.vitals.diastolicBP = 80.0f + 3.0f * noise(random);
+      record.vitals.spO2 = 97.0f + 0.5f * noise(random);
+      record.vitals.temperature = 98.6f + 0.2f * noise(random);
+      writer.add(record);
+    }
+    batchLength = writer.finish();
+    batchCount = writer.count();
+  }
+
+  void transmit()
+  {
+    inFlight = true;
+    sentAtUs = nowUs();
+    client.send(batch.data(), batchLength);
+  }
+
+  void handleAck(const UplinkAck &ack)
+  {
+    if (!inFlight)
+      return fail("unexpected ack");
+
+    if (ack.status == UPLINK_BUSY)
+    {
+      result.busy++;
+      retryAtUs = nowUs() + 5000;
+      return;
+    }
+    inFlight = false;
+    result.latenciesUs.push_back((uint32_t)(nowUs() - sentAtUs));
+    result.batches++;
+    result.accepted += ack.accepted;
+    result.duplicates += ack.duplicates;
+    result.rejected += ack.rejected;
+
+    // Every record of a first send is new; every record of a resend is not
+    bool expected = ack.status == UPLINK_OK && ack.deviceId == deviceId && ack.rejected == 0 &&
+                    ack.accepted == (resend ? 0 : batchCount) && ack.duplicates == (resend ? batchCount : 0);
+    if (!expected)
+      result.mismatches++;
+    if (resend)
+      result.duplicateSent += batchCount;
+    else
+      result.uniqueSent += batchCount;
+    sendNext();
+  }
+
+  void fail(const char *reason)
+  {
+    if (!failed)
+    {
+      fprintf(stderr, "device %llu: %s\n", (unsigned long long)deviceId, reason);
+      failed = true;
+      result.failedDevices++;
+    }
+  }
+
+  FleetResult &result;
+  uint64_t deviceId;
+  const FleetOptions &options;
+  std::mt19937 random;
+  UplinkClient client;
+
+  std::vector<uint8_t> batch;
+  size_t batchLength = 0;
+  uint16_t batchCount = 0;
+  uint32_t batchSequence = 1;
+  uint32_t recordSequence = 1;
+  bool patientSent = false;
+  bool resend = false;
+  bool inFlight = false;
+  bool stopping = false;
+  bool failed = false;
+  uint64_t sentAtUs = 0;
+  uint64_t retryAtUs = 0;
+};
+
+static void runLoadThread(const FleetOptions &options, const sockaddr_in &address, int firstDevice, int deviceCount,
+                          FleetResult &result)
+{
+  EventLoop loop;
+  std::vector<std::unique_ptr<Device>> devices;
+  for (int i = 0; i < deviceCount; i++)
+  {
+    int index = firstDevice + i;
+    bool mqtt;
+    sockaddr_in target = deviceTarget(options, address, index, mqtt);
+    devices.emplace_back(new Device(loop, result, 0x5643000000000000ull + index, mqtt, options, 1234u + index));
+    if (!devices.back()->connect(target))
+    {
+      result.failedDevices++;
+      devices.pop_back();
+    }
+  }
+
+  uint64_t stopAtUs = nowUs() + (uint64_t)(options.seconds * 1e6);
+  uint64_t drainUntilUs = stopAtUs + 5000000;
+  bool draining = false;
+  loop.every(1, [&]() {
+    uint64_t now = nowUs();
+    bool idle = true;
+    for (std::unique_ptr<Device> &device : devices)
+    {
+      if (!draining && now >= stopAtUs)
+        device->stopSending();
+      device->poll(now);
+      idle = idle && device->idle();
+    }
+    draining = draining || now >= stopAtUs;
+    if (draining && (idle || now >= drainUntilUs))
+      loop.stop();
+  });
+  loop.run();
+}
+
+static int runLoad(const FleetOptions &options, const sockaddr_in &address)
+{
+  printf("🚑 fleet: %d devices (%s), %d records/batch, %.0f s, %.0f%% duplicate batches, %d threads\n",
+         options.devices, options.protocol.c_str(), options.batch, options.seconds, options.duplicateRate * 100,
+         options.threads);
+  fflush(stdout);
+
+  std::vector<FleetResult> results(options.threads);
+  std::vector<std::thread> threads;
+  uint64_t startUs = nowUs();
+  int first = 0;
+  for (int t = 0; t < options.threads; t++)
+  {
+    int count = loopDevices(options, t);
+    threads.emplace_back(runLoadThread, std::cref(options), std::cref(address), first, count, std::ref(results[t]));
+    first += count;
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  double elapsed = (nowUs() - startUs) / 1e6;
+
+  FleetResult total;
+  for (FleetResult &result : results)
+  {
+    total.batches += result.batches;
+    total.uniqueSent += result.uniqueSent;
+    total.duplicateSent += result.duplicateSent;
+    total.accepted += result.accepted;
+    total.duplicates += result.duplicates;
+    total.rejected += result.rejected;
+    total.busy += result.busy;
+    total.mismatches += result.mismatches;
+    total.failedDevices += result.failedDevices;
+    total.latenciesUs.insert(total.latenciesUs.end(), result.latenciesUs.begin(), result.latenciesUs.end());
+  }
+  std::sort(total.latenciesUs.begin(), total.latenciesUs.end());
+
+  uint64_t records = total.uniqueSent + total.duplicateSent;
+  double rate = records / elapsed;
+  printf("batches %llu, records %llu in %.2f s: %.0f records/s\n", (unsigned long long)total.batches,
+         (unsigned long long)records, elapsed, rate);
+  printf("accepted %llu (sent %llu new), duplicates %llu (sent %llu again), rejected %llu, busy retries %llu\n",
+         (unsigned long long)total.accepted, (unsigned long long)total.uniqueSent,
+         (unsigned long long)total.duplicates, (unsigned long long)total.duplicateSent,
+         (unsigned long long)total.rejected, (unsigned long long)total.busy);
+  printf("ack latency p50 %u us, p99 %u us, max %u us\n", percentile(total.latenciesUs, 0.50),
+         percentile(total.latenciesUs, 0.99), total.latenciesUs.empty() ? 0 : total.latenciesUs.back());
+
+  bool ok = true;
+  if (total.mismatches > 0 || total.accepted != total.uniqueSent || total.duplicates != total.duplicateSent)
+  {
+    printf("❌ %llu acks disagree with what was sent\n", (unsigned long long)total.mismatches);
+    ok = false;
+  }
+  if (total.failedDevices > 0)
+  {
+    printf("❌ %llu devices failed\n", (unsigned long long)total.failedDevices);
+    ok = false;
+  }
+  if (options.minRate > 0 && rate < options.minRate)
+  {
+    printf("❌ below the required %.0f records/s\n", options.minRate);
+    ok = false;
+  }
+  if (ok)
+    printf("✅ all acks consistent\n");
+  return ok ? 0 : 1;
+}
+
+// Sim mode: the device pipeline on a virtual clock over an impaired link
+
+const uint16_t ECG_RATE_HZ = 100;
+const uint32_t BEAT_TIMEOUT_MS = 3000;
+const size_t OUTBOX_CAPACITY = 1024;
+const uint32_t BUSY_BACKOFF_MIN_MS = 100;
+const uint32_t BUSY_BACKOFF_MAX_MS = 5000;
+const uint32_t DRAIN_SECONDS = 15;
+// Virtual seconds a device catches up per tick, so a saturated simulator
+// shows lag instead of starving its sockets
+const int MAX_STEPS_PER_TICK = 5;
+
+// Per event loop. The atomics are read by the main thread's progress line.
+struct SimResult
+{
+  std::atomic<uint64_t> confirmed{0}; // records acked
+  std::atomic<uint64_t> busy{0};
+  std::atomic<uint64_t> timeouts{0};
+  std::atomic<uint64_t> outboxTotal{0};
+  std::atomic<uint64_t> outboxMax{0};
+  std::atomic<uint64_t> lagMs{0}; // furthest a device is behind the virtual clock
+
+  uint64_t generated = 0;
+  uint64_t dropped = 0; // outbox full
+  uint64_t pending = 0; // still in the outbox at the end
+  uint64_t emergencies = 0;
+  uint64_t batches = 0;
+  uint64_t resends = 0;
+  uint64_t lostUplinks = 0;
+  uint64_t lostAcks = 0;
+  uint64_t staleAcks = 0;
+  uint64_t duplicates = 0; // records the gateway reported as already stored
+  uint64_t mismatches = 0;
+  uint64_t failedDevices = 0;
+  uint64_t peakOutbox = 0;
+  std::vector<uint32_t> ackRttMs;
+  std::vector<uint32_t> recordAgeMs;
+  std::vector<uint32_t> emergencyAgeMs;
+};
+
+// Impaired link for one event loop: deliveries wait here until their time,
+// polled by the loop's 1 ms tick.
+class DelayLine
+{
+public:
+  void schedule(uint64_t dueUs, EventLoop::Task task)
+  {
+    pending.push(Entry{dueUs, order++, std::move(task)});
+  }
+
+  void run(uint64_t now)
+  {
+    while (!pending.empty() && pending.top().dueUs <= now)
+    {
+      EventLoop::Task task = std::move(const_cast<Entry &>(pending.top()).task);
+      pending.pop();
+      task();
+    }
+  }
+
+  bool empty() const { return pending.empty(); }
+
+private:
+  struct Entry
+  {
+    uint64_t dueUs;
+    uint64_t order; // FIFO among equal times
+    EventLoop::Task task;
+
+    bool operator>(const Entry &other) const
+    {
+      return dueUs != other.dueUs ? dueUs > other.dueUs : order > other.order;
+    }
+  };
+
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> pending;
+  uint64_t order = 0;
+};
+
+class VirtualDevice
+{
+public:
+  VirtualDevice(EventLoop &loop, DelayLine &link, SimResult &result, uint64_t deviceId, bool mqtt,
+                const FleetOptions &options, uint32_t seed, bool alerting)
+      : link(link), result(result), deviceId(deviceId), options(options), random(seed),
+        client(loop, deviceId, mqtt), ecg(ECG_RATE_HZ, 66.0f + seed % 16, seed), detector(2000, 100, 300),
+        batch(UPLINK_HEADER_SIZE + UPLINK_MAX_RECORDS * VITAL_RECORD_SIZE)
+  {
+    client.setAckHandler([this](const UplinkAck &ack) { onAck(ack); });
+    client.setFailureHandler([this](const char *reason) { fail(reason); });
+
+    // Devices power up at different times and upload out of step
+    std::uniform_int_distribution<uint32_t> phase(0, options.uploadSeconds * 1000);
+    clockMs = phase(random);
+    startMs = clockMs;
+    nextUploadMs = clockMs + phase(random);
+    fusion.begin(0);
+
+    if (alerting)
+    {
+      // Tachycardia somewhere in the run, long enough to cross the limit
+      double span = options.seconds * options.speedup;
+      std::uniform_real_distribution<double> start(span * 0.1, std::max(span * 0.6, span * 0.1 + 1));
+      ecg.addEpisode(sim::EcgEpisode{sim::EcgEpisode::RATE, start(random), 180.0, 150.0f});
+    }
+  }
+
+  bool connect(const sockaddr_in &address) { return client.connect(address); }
+
+  // Runs the sensor pipeline up to the virtual time and the uplink state
+  // machine at the real time.
+  void advance(uint64_t virtualMs, uint64_t now)
+  {
+    if (failed)
+      return;
+    uint64_t target = virtualMs + startMs;
+    for (int steps = 0; !stopping && steps < MAX_STEPS_PER_TICK && clockMs + 1000 <= target; steps++)
+      stepSecond();
+    lag = stopping || target < clockMs ? 0 : target - clockMs;
+
+    if (inFlight && now >= ackDeadlineUs)
+    {
+      result.timeouts++;
+      transmit(now);
+    }
+    else if (!inFlight && now >= retryAtUs && !outbox.empty() && (uploadNow || clockMs >= nextUploadMs))
+    {
+      startBatch(now);
+    }
+  }
+
+  // End of run: close the open rollup and upload everything left
+  void stopSensing()
+  {
+    if (!stopping)
+    {
+      closeRollup();
+      stopping = true;
+      uploadNow = true;
+    }
+  }
+
+  void finish()
+  {
+    result.pending += outbox.size();
+    if (failed)
+      result.failedDevices++;
+  }
+
+  bool idle() const { return failed || (outbox.empty() && !inFlight); }
+  size_t outboxDepth() const { return outbox.size(); }
+  uint64_t lagMs() const { return lag; }
+
+private:
+  void stepSecond()
+  {
+    int16_t samples[ECG_RATE_HZ];
+    ecg.generate(samples, ECG_RATE_HZ);
+    for (uint16_t i = 0; i < ECG_RATE_HZ; i++)
+    {
+      uint32_t t = (uint32_t)(clockMs + i * 1000 / ECG_RATE_HZ);
+      float beatRate;
+      if (detector.update(samples[i], t) && channel.onBeat(t, beatRate))
+        fusion.update(beatRate, channel.getQuality(), t);
+    }
+    clockMs += 1000;
+    channel.expire((uint32_t)clockMs, BEAT_TIMEOUT_MS);
+
+    // Slow mean-reverting drift for the vitals without a simulated sensor
+    std::normal_distribution<float> step(0.0f, 1.0f);
+    systolic += 0.05f * (120.0f - systolic) + 0.8f * step(random);
+    diastolic += 0.05f * (80.0f - diastolic) + 0.5f * step(random);
+    spO2 = std::min(100.0f, spO2 + 0.05f * (97.5f - spO2) + 0.1f * step(random));
+    temperature += 0.02f * (98.4f - temperature) + 0.02f * step(random);
+
+    VitalSample sample = {};
+    float confidence;
+    fusion.estimate((uint32_t)clockMs, sample.heartRate, confidence);
+    sample.systolicBP = systolic;
+    sample.diastolicBP = diastolic;
+    sample.spO2 = spO2;
+    sample.temperature = temperature;
+    sample.timestampMs = (uint32_t)clockMs;
+
+    // No heart rate yet is not an emergency: the firmware waits for the first estimate
+    uint8_t alerts = sample.heartRate > 0 ? evaluateAlerts(sample, EMERGENCY_THRESHOLDS) : 0;
+    rollup.add(sample, alerts, alerts ? RECORD_EMERGENCY : 0);
+
+    bool emergency = alerts != 0 && !inEmergency;
+    inEmergency = alerts != 0;
+    if (emergency)
+    {
+      // Close the period early so the alert leaves the device now
+      result.emergencies++;
+      closeRollup();
+      uploadNow = true;
+    }
+    else if (rollup.readingCount() >= options.rollupSeconds)
+    {
+      closeRollup();
+    }
+  }
+
+  void closeRollup()
+  {
+    VitalRecord record;
+    if (!rollup.finish(recordSequence, record))
+      return;
+    recordSequence++;
+    result.generated++;
+    // The in-flight batch stays at the front of the outbox, so a full
+    // outbox drops the new record rather than the oldest
+    if (!outbox.tryPush(record))
+    {
+      result.dropped++;
+      return;
+    }
+    createdUs.push(nowUs());
+  }
+
+  void startBatch(uint64_t now)
+  {
+    UplinkBatchWriter writer(batch.data(), batch.size(), UPLINK_VITAL_RECORDS, deviceId, batchSequence);
+    for (size_t i = 0; i < outbox.size() && writer.count() < options.batch; i++)
+      writer.add(outbox[i]);
+    batchLength = writer.finish();
+    batchCount = writer.count();
+    attempts = 0;
+    uploadNow = false;
+    nextUploadMs = clockMs + (uint64_t)options.uploadSeconds * 1000;
+    result.batches++;
+    transmit(now);
+  }
+
+  void transmit(uint64_t now)
+  {
+    if (attempts > 0)
+      result.resends++;
+    attempts++;
+    inFlight = true;
+    sentAtUs = now;
+    ackDeadlineUs = now + (uint64_t)options.ackTimeoutMs * 1000;
+
+    if (lost())
+    {
+      result.lostUplinks++;
+      return;
+    }
+    // The bytes are copied: a delayed copy may still be on the wire when the
+    // next batch is built
+    std::shared_ptr<std::vector<uint8_t>> bytes =
+        std::make_shared<std::vector<uint8_t>>(batch.begin(), batch.begin() + batchLength);
+    link.schedule(now + delayUs(), [this, bytes]() { client.send(bytes->data(), bytes->size()); });
+  }
+
+  void onAck(const UplinkAck &ack)
+  {
+    if (lost())
+    {
+      result.lostAcks++;
+      return;
+    }
+    link.schedule(nowUs() + delayUs(), [this, ack]() { handleAck(ack); });
+  }
+
+  void handleAck(const UplinkAck &ack)
+  {
+    if (failed)
+      return;
+    // The answer to an earlier copy of a batch that has since been acked
+    if (!inFlight || ack.batchSequence != batchSequence)
+    {
+      result.staleAcks++;
+      return;
+    }
+    uint64_t now = nowUs();
+    if (ack.status == UPLINK_BUSY)
+    {
+      result.busy++;
+      inFlight = false;
+      retryAtUs = now + (uint64_t)backoffMs * 1000;
+      backoffMs = std::min(backoffMs * 2, BUSY_BACKOFF_MAX_MS);
+      uploadNow = true;
+      return;
+    }
+    backoffMs = BUSY_BACKOFF_MIN_MS;
+
+    // Only a batch that went out once must be all new
+    bool expected = ack.status == UPLINK_OK && ack.deviceId == deviceId && ack.rejected == 0 &&
+                    ack.accepted + ack.duplicates == batchCount && (attempts > 1 || ack.accepted == batchCount);
+    if (!expected)
+      result.mismatches++;
+    result.duplicates += ack.duplicates;
+    result.ackRttMs.push_back((uint32_t)((now - sentAtUs) / 1000));
+
+    for (uint16_t i = 0; i < batchCount; i++)
+    {
+      uint32_t age = (uint32_t)((now - createdUs[i]) / 1000);
+      result.recordAgeMs.push_back(age);
+      if (outbox[i].recordFlags & RECORD_EMERGENCY)
+        result.emergencyAgeMs.push_back(age);
+    }
+    outbox.discard(batchCount);
+    createdUs.discard(batchCount);
+    result.confirmed += batchCount;
+
+    inFlight = false;
+    batchSequence++;
+    // A backlog goes out batch after batch
+    if (!outbox.empty() && (outbox.size() >= (size_t)options.batch || stopping))
+      uploadNow = true;
+  }
+
+  uint64_t delayUs()
+  {
+    std::uniform_int_distribution<int> jitter(-options.jitterMs, options.jitterMs);
+    return (uint64_t)std::max(0, options.latencyMs + jitter(random)) * 1000;
+  }
+
+  bool lost()
+  {
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    return options.loss > 0 && roll(random) < options.loss;
+  }
+
+  void fail(const char *reason)
+  {
+    if (!failed)
+    {
+      fprintf(stderr, "device %llu: %s\n", (unsigned long long)deviceId, reason);
+      failed = true;
+    }
+  }
+
+  DelayLine &link;
+  SimResult &result;
+  uint64_t deviceId;
+  const FleetOptions &options;
+  std::mt19937 random;
+  UplinkClient client;
+
+  sim::SimulatedEcg ecg;
+  ThresholdBeatDetector detector;
+  BeatChannel channel;
+  HeartRateFusion fusion;
+  float systolic = 120.0f;
+  float diastolic = 80.0f;
+  float spO2 = 97.5f;
+  float temperature = 98.4f;
+  VitalRollup rollup;
+  bool inEmergency = false;
+
+  RingBuffer<VitalRecord, OUTBOX_CAPACITY> outbox;
+  RingBuffer<uint64_t, OUTBOX_CAPACITY> createdUs; // real time each outbox record was closed
+
+  std::vector<uint8_t> batch;
+  size_t batchLength = 0;
+  uint16_t batchCount = 0;
+  uint32_t batchSequence = 1;
+  uint32_t recordSequence = 1;
+  uint32_t attempts = 0;
+  bool inFlight = false;
+  bool uploadNow = false;
+  bool stopping = false;
+  bool failed = false;
+  uint64_t clockMs = 0;      // virtual device clock
+  uint64_t startMs = 0;      // virtual clock at power-up
+  uint64_t lag = 0;
+  uint64_t nextUploadMs = 0; // virtual
+  uint64_t sentAtUs = 0;
+  uint64_t ackDeadlineUs = 0;
+  uint64_t retryAtUs = 0;
+  uint32_t backoffMs = BUSY_BACKOFF_MIN_MS;
+};
+
+static void runSimThread(const FleetOptions &options, const sockaddr_in &address, int firstDevice, int deviceCount,
+                         SimResult &result)
+{
+  EventLoop loop;
+  DelayLine link;
+  std::mt19937 random(99u + firstDevice);
+  std::uniform_real_distribution<double> roll(0.0, 1.0);
+  std::vector<std::unique_ptr<VirtualDevice>> devices;
+  for (int i = 0; i < deviceCount; i++)
+  {
+    int index = firstDevice + i;
+    bool mqtt;
+    sockaddr_in target = deviceTarget(options, address, index, mqtt);
+    uint64_t deviceId = 0x5653000000000000ull + ((uint64_t)options.run << 24) + index;
+    devices.emplace_back(new VirtualDevice(loop, link, result, deviceId, mqtt, options, 7919u * (index + 1),
+                                           roll(random) < options.alertShare));
+    if (!devices.back()->connect(target))
+    {
+      result.failedDevices++;
+      devices.pop_back();
+    }
+  }
+
+  uint64_t startUs = nowUs();
+  uint64_t stopAtUs = startUs + (uint64_t)(options.seconds * 1e6);
+  uint64_t drainUntilUs = stopAtUs + (DRAIN_SECONDS * 1000 + options.ackTimeoutMs) * 1000ull;
+  bool draining = false;
+  uint64_t lastDepthUs = 0;
+  loop.every(1, [&]() {
+    uint64_t now = nowUs();
+    uint64_t virtualMs = (uint64_t)((std::min(now, stopAtUs) - startUs) / 1000 * options.speedup);
+    link.run(now);
+    if (!draining && now >= stopAtUs)
+    {
+      draining = true;
+      for (std::unique_ptr<VirtualDevice> &device : devices)
+        device->stopSensing();
+    }
+
+    bool idle = link.empty();
+    for (std::unique_ptr<VirtualDevice> &device : devices)
+    {
+      device->advance(virtualMs, now);
+      idle = idle && device->idle();
+    }
+
+    if (now - lastDepthUs >= 100000)
+    {
+      uint64_t total = 0;
+      uint64_t deepest = 0;
+      uint64_t lag = 0;
+      for (std::unique_ptr<VirtualDevice> &device : devices)
+      {
+        total += device->outboxDepth();
+        deepest = std::max<uint64_t>(deepest, device->outboxDepth());
+        lag = std::max(lag, device->lagMs());
+      }
+      result.outboxTotal = total;
+      result.outboxMax = deepest;
+      result.lagMs = lag;
+      result.peakOutbox = std::max(result.peakOutbox, deepest);
+      lastDepthUs = now;
+    }
+    if (draining && (idle || now >= drainUntilUs))
+      loop.stop();
+  });
+  loop.run();
+
+  for (std::unique_ptr<VirtualDevice> &device : devices)
+    device->finish();
+}
+
+// Blocking GET of the gateway's accepted-records counter; -1 on failure.
+static int64_t fetchAccepted(const sockaddr_in &address, int httpPort)
+{
+  sockaddr_in target = address;
+  target.sin_port = htons((uint16_t)httpPort);
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (const sockaddr *)&target, sizeof(target)) != 0)
+  {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  const char request[] = "GET /api/v1/stats HTTP/1.1\r\nHost: gateway\r\nConnection: close\r\n\r\n";
+  send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL);
+  std::string response;
+  char chunk[4096];
+  ssize_t got;
+  while ((got = recv(fd, chunk, sizeof(chunk), 0)) > 0)
+    response.append(chunk, got);
+  close(fd);
+
+  size_t field = response.find("\"accepted\":");
+  if (field == std::string::npos)
+    return -1;
+  return strtoll(response.c_str() + field + 11, nullptr, 10);
+}
+
+static void printPercentiles(const char *label, std::vector<uint32_t> &values)
+{
+  std::sort(values.begin(), values.end());
+  printf("%-20s n %-8zu p50 %6u ms  p90 %6u ms  p99 %6u ms  max %6u ms\n", label, values.size(),
+         percentile(values, 0.50), percentile(values, 0.90), percentile(values, 0.99),
+         values.empty() ? 0 : values.back());
+}
+
+static int runSim(const FleetOptions &options, const sockaddr_in &address)
+{
+  printf("🚑 fleet sim: %d devices (%s) on %d loops, %.0f s at %.0fx, rollup %d s, upload %d s\n", options.devices,
+         options.protocol.c_str(), options.threads, options.seconds, options.speedup, options.rollupSeconds,
+         options.uploadSeconds);
+  printf("   link: %d +- %d ms, %.1f%% loss each way, ack timeout %d ms; %.0f%% of devices alerting; run %u\n",
+         options.latencyMs, options.jitterMs, options.loss * 100, options.ackTimeoutMs, options.alertShare * 100,
+         options.run);
+  fflush(stdout);
+
+  int64_t acceptedBefore = options.checkStats ? fetchAccepted(address, options.httpPort) : -1;
+  if (options.checkStats && acceptedBefore < 0)
+    printf("⚠️ gateway stats unavailable on port %d, skipping the gateway check\n", options.httpPort);
+
+  std::vector<std::unique_ptr<SimResult>> results;
+  std::vector<std::thread> threads;
+  uint64_t startUs = nowUs();
+  int first = 0;
+  for (int t = 0; t < options.threads; t++)
+  {
+    int count = loopDevices(options, t);
+    results.emplace_back(new SimResult());
+    threads.emplace_back(runSimThread, std::cref(options), std::cref(address), first, count, std::ref(*results[t]));
+    first += count;
+  }
+
+  // Progress once a second while the devices run
+  uint64_t lastConfirmed = 0;
+  uint64_t lastUs = startUs;
+  uint64_t endUs = startUs + (uint64_t)(options.seconds * 1e6);
+  while (nowUs() + 1000000 <= endUs)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t confirmed = 0, busy = 0, timeouts = 0, depth = 0, deepest = 0, lag = 0;
+    for (std::unique_ptr<SimResult> &result : results)
+    {
+      confirmed += result->confirmed;
+      busy += result->busy;
+      timeouts += result->timeouts;
+      depth += result->outboxTotal;
+      deepest = std::max<uint64_t>(deepest, result->outboxMax);
+      lag = std::max<uint64_t>(lag, result->lagMs);
+    }
+    uint64_t now = nowUs();
+    printf("[fleet] %5.0f s virtual | %7.0f rec/s acked | busy %llu timeouts %llu | outbox avg %.1f max %llu"
+           " | lag %.1f s\n",
+           (now - startUs) / 1e6 * options.speedup, (confirmed - lastConfirmed) * 1e6 / (now - lastUs),
+           (unsigned long long)busy, (unsigned long long)timeouts, (double)depth / options.devices,
+           (unsigned long long)deepest, lag / 1000.0);
+    fflush(stdout);
+    lastConfirmed = confirmed;
+    lastUs = now;
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  double elapsed = (nowUs() - startUs) / 1e6;
+
+  SimResult total;
+  for (std::unique_ptr<SimResult> &result : results)
+  {
+    total.confirmed += result->confirmed;
+    total.busy += result->busy;
+    total.timeouts += result->timeouts;
+    total.generated += result->generated;
+    total.dropped += result->dropped;
+    total.pending += result->pending;
+    total.emergencies += result->emergencies;
+    total.batches += result->batches;
+    total.resends += result->resends;
+    total.lostUplinks += result->lostUplinks;
+    total.lostAcks += result->lostAcks;
+    total.staleAcks += result->staleAcks;
+    total.duplicates += result->duplicates;
+    total.mismatches += result->mismatches;
+    total.failedDevices += result->failedDevices;
+    total.peakOutbox = std::max(total.peakOutbox, result->peakOutbox);
+    total.ackRttMs.insert(total.ackRttMs.end(), result->ackRttMs.begin(), result->ackRttMs.end());
+    total.recordAgeMs.insert(total.recordAgeMs.end(), result->recordAgeMs.begin(), result->recordAgeMs.end());
+    total.emergencyAgeMs.insert(total.emergencyAgeMs.end(), result->emergencyAgeMs.begin(),
+                                result->emergencyAgeMs.end());
+  }
+  uint64_t confirmed = total.confirmed;
+
+  printf("records generated %llu, confirmed %llu, dropped %llu (outbox full), pending %llu, in %.1f s\n",
+         (unsigned long long)total.generated, (unsigned long long)confirmed, (unsigned long long)total.dropped,
+         (unsigned long long)total.pending, elapsed);
+  printf("batches %llu, resends %llu, lost uplinks %llu, lost acks %llu, ack timeouts %llu, busy %llu, stale acks "
+         "%llu, duplicates %llu\n",
+         (unsigned long long)total.batches, (unsigned long long)total.resends,
+         (unsigned long long)total.lostUplinks, (unsigned long long)total.lostAcks,
+         (unsigned long long)total.timeouts.load(), (unsigned long long)total.busy.load(),
+         (unsigned long long)total.staleAcks, (unsigned long long)total.duplicates);
+  printf("emergencies %llu, peak outbox %llu records\n", (unsigned long long)total.emergencies,
+         (unsigned long long)total.peakOutbox);
+  printPercentiles("ack round trip", total.ackRttMs);
+  printPercentiles("record age", total.recordAgeMs);
+  printPercentiles("emergency age", total.emergencyAgeMs);
+
+  bool ok = true;
+  if (total.mismatches > 0)
+  {
+    printf("❌ %llu acks disagree with their batch\n", (unsigned long long)total.mismatches);
+    ok = false;
+  }
+  if (confirmed != total.generated - total.dropped - total.pending)
+  {
+    printf("❌ %lld records unaccounted for\n",
+           (long long)(total.generated - total.dropped - total.pending) - (long long)confirmed);
+    ok = false;
+  }
+  if (total.failedDevices > 0)
+  {
+    printf("❌ %llu devices failed\n", (unsigned long long)total.failedDevices);
+    ok = false;
+  }
+  if (acceptedBefore >= 0)
+  {
+    int64_t acceptedAfter = fetchAccepted(address, options.httpPort);
+    int64_t accepted = acceptedAfter - acceptedBefore;
+    printf("gateway accepted %lld new records\n", (long long)accepted);
+    // Records still pending may or may not have reached the gateway
+    if (acceptedAfter < 0 || accepted < (int64_t)confirmed || accepted > (int64_t)(confirmed + total.pending))
+    {
+      printf("❌ gateway accepted count does not match the %llu confirmed records\n", (unsigned long long)confirmed);
+      ok = false;
+    }
+  }
+  if (ok)
+    printf("✅ every record accounted for\n");
+  return ok ? 0 : 1;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-fleet [--mode load|sim] [--host H] [--http-port P] [--mqtt-port P]\n"
+                  "                       [--devices N] [--protocol http|mqtt|mixed] [--batch N] [--seconds S]\n"
+                  "                       [--threads N]\n"
+                  "  load mode:           [--duplicate-rate F] [--min-rate R]\n"
+                  "  sim mode:            [--speedup X] [--rollup-seconds S] [--upload-seconds S] [--loss F]\n"
+                  "                       [--latency-ms MS] [--jitter-ms MS] [--ack-timeout-ms MS]\n"
+                  "                       [--alert-share F] [--check-stats 0|1] [--run N]\n");
+}
+
+int main(int argc, char **argv)
+{
+  FleetOptions options;
+  for (int i = 1; i < argc; i += 2)
+  {
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const char *option = argv[i];
+    const char *value = argv[i + 1];
+    if (strcmp(option, "--mode") == 0)
+      options.mode = value;
+    else if (strcmp(option, "--host") == 0)
+      options.host = value;
+    else if (strcmp(option, "--http-port") == 0)
+      options.httpPort = atoi(value);
+    else if (strcmp(option, "--mqtt-port") == 0)
+      options.mqttPort = atoi(value);
+    else if (strcmp(option, "--devices") == 0)
+      options.devices = atoi(value);
+    else if (strcmp(option, "--protocol") == 0)
+      options.protocol = value;
+    else if (strcmp(option, "--batch") == 0)
+      options.batch = atoi(value);
+    else if (strcmp(option, "--seconds") == 0)
+      options.seconds = atof(value);
+    else if (strcmp(option, "--threads") == 0)
+      options.threads = atoi(value);
+    else if (strcmp(option, "--duplicate-rate") == 0)
+      options.duplicateRate = atof(value);
+    else if (strcmp(option, "--min-rate") == 0)
+      options.minRate = atof(value);
+    else if (strcmp(option, "--speedup") == 0)
+      options.speedup = atof(value);
+    else if (strcmp(option, "--rollup-seconds") == 0)
+      options.rollupSeconds = atoi(value);
+    else if (strcmp(option, "--upload-seconds") == 0)
+      options.uploadSeconds = atoi(value);
+    else if (strcmp(option, "--loss") == 0)
+      options.loss = atof(value);
+    else if (strcmp(option, "--latency-ms") == 0)
+      options.latencyMs = atoi(value);
+    else if (strcmp(option, "--jitter-ms") == 0)
+      options.jitterMs = atoi(value);
+    else if (strcmp(option, "--ack-timeout-ms") == 0)
+      options.ackTimeoutMs = atoi(value);
+    else if (strcmp(option, "--alert-share") == 0)
+      options.alertShare = atof(value);
+    else if (strcmp(option, "--check-stats") == 0)
+      options.checkStats = atoi(value) != 0;
+    else if (strcmp(option, "--run") == 0)
+      options.run = (uint32_t)strtoul(value, nullptr, 10);
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  bool sim = options.mode == "sim";
+  if ((!sim && options.mode != "load") ||
+      (options.protocol != "http" && options.protocol != "mqtt" && options.protocol != "mixed"))
+  {
+    usage();
+    return 2;
+  }
+
+  // A load test saturates a few hundred connections; a simulated district is
+  // thousands of devices uploading small batches now and then
+  if (options.devices <= 0)
+    options.devices = sim ? 2000 : 200;
+  if (options.seconds <= 0)
+    options.seconds = sim ? 30 : 10;
+  if (options.batch <= 0)
+    options.batch = sim ? 64 : 100;
+  options.batch = std::min(options.batch, (int)UPLINK_MAX_RECORDS);
+  if (options.threads <= 0)
+    options.threads = (int)std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+  options.threads = std::min(options.threads, options.devices);
+
+  options.rollupSeconds = std::max(1, std::min(options.rollupSeconds, 3600));
+  options.uploadSeconds = std::max(1, options.uploadSeconds);
+  options.speedup = std::max(0.1, options.speedup);
+  options.jitterMs = std::max(0, std::min(options.jitterMs, options.latencyMs));
+  options.ackTimeoutMs = std::max(options.ackTimeoutMs, 2 * (options.latencyMs + options.jitterMs) + 100);
+  if (options.run == 0)
+    options.run = (uint32_t)time(nullptr);
+  options.run &= 0xFFFFFF;
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1)
+  {
+    fprintf(stderr, "bad host address %s\n", options.host.c_str());
+    return 2;
+  }
+
+  return sim ? runSim(options, address) : runLoad(options, address);
+}
@@ -0,0 +1,288 @@
+/*
+ * VitalCare Rural Gateway - Daemon
+ *
+ * District-office endpoint for device uplinks (REMOTE_SERVER in
+ * esp32-communication). One epoll loop owns every socket; --ingest-shards
+ * single-threaded shard workers validate, deduplicate and store batches,
+ * each device always on the same shard (0: the worker pool does it, with
+ * locked deduplication). The worker pool runs queries and checkpoints.
+ * Shards are rebalanced every second when one is unusually hot.
+ *
+ * Usage: vitalcare-gateway [--http-port 8080] [--mqtt-port 1883]
+ *                          [--workers N] [--queue 4096] [--ingest-shards N]
+ *                          [--data-dir DIR] [--sync 1] [--stats-interval 5]
+ *                          [--push-threads 2] [--push-queue 256]
+ *                          [--alerts emergency|bedside|off]
+ *                          [--query-threads 2]
+ *
+ * With --data-dir vitals go to the time-series store in DIR (acked once
+ * the write-ahead log is synced; --sync 0 skips the fdatasync) and patient
+ * records to DIR/patients.log. Without it records are validated and
+ * counted but not stored.
+ *
+ * Central monitoring screens connect to ws://<host>:<http-port>/api/v1/live;
+ * --push-threads sender threads fan the live feed out to them (0 turns the
+ * feed off) and --push-queue bounds each screen's queue.
+ *
+ * --alerts re-evaluates every stored vital record centrally: the threshold
+ * table of isEmergency() (emergency) or checkForAlerts() (bedside), plus
+ * trend rules no device can raise; raised trends go out on the live feed.
+ *
+ * Stored vitals are also rolled up into 1 min, 15 min and 1 day buckets
+ * that GET /api/v1/query reads with --query-threads scan threads. With
+ * --data-dir the rollups are kept in DIR/rollups.vcr, saved with every
+ * store checkpoint and on shutdown.
+ */
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "AlertEngine.h"
+#include "EventLoop.h"
+#include "Ingest.h"
+#include "IngestPipeline.h"
+#include "PushHub.h"
+#include "QueryEngine.h"
+#include "RollupStore.h"
+#include "Server.h"
+#include "WorkerPool.h"
+
+using namespace vitalcare::gateway;
+
+static const uint64_t CHECKPOINT_WAL_BYTES = 64ull << 20;
+
+static void logStoreStatistics(TimeSeriesStore &store)
+{
+  StoreStats stats = store.statistics();
+  printf("[store] %llu series, %llu chunks, %llu rows, %.2f bytes/sample | wal %llu commits, %.1f entries/commit\n",
+         (unsigned long long)stats.series, (unsigned long long)stats.chunks,
+         (unsigned long long)(stats.sealedRows + stats.headRows), stats.bytesPerSample(),
+         (unsigned long long)stats.wal.commits, stats.wal.commits ? (double)stats.wal.entries / stats.wal.commits : 0.0);
+  fflush(stdout);
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-gateway [--http-port P] [--mqtt-port P] [--workers N] [--queue N]\n"
+                  "                         [--ingest-shards N]\n"
+                  "                         [--data-dir DIR] [--sync 0|1] [--stats-interval S]\n"
+                  "                         [--push-threads N] [--push-queue N]\n"
+                  "                         [--alerts emergency|bedside|off] [--query-threads N]\n");
+}
+
+int main(int argc, char **argv)
+{
+  int httpPort = 8080;
+  int mqttPort = 1883;
+  unsigned workers = std::thread::hardware_concurrency();
+  unsigned queue = 4096;
+  int ingestShards = -1; // as many as workers
+  unsigned statsInterval = 5;
+  unsigned pushThreads = 2;
+  unsigned pushQueue = PushHub::DEFAULT_QUEUE_LIMIT;
+  std::string dataDir;
+  StoreOptions storeOptions;
+  const char *alertTable = "emergency";
+  unsigned queryThreads = 2;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *option = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!value)
+    {
+      usage();
+      return 2;
+    }
+    if (strcmp(option, "--http-port") == 0)
+      httpPort = atoi(value);
+    else if (strcmp(option, "--mqtt-port") == 0)
+      mqttPort = atoi(value);
+    else if (strcmp(option, "--workers") == 0)
+      workers = (unsigned)atoi(value);
+    else if (strcmp(option, "--queue") == 0)
+      queue = (unsigned)atoi(value);
+    else if (strcmp(option, "--ingest-shards") == 0)
+      ingestShards = atoi(value);
+    else if (strcmp(option, "--data-dir") == 0)
+      dataDir = value;
+    else if (strcmp(option, "--sync") == 0)
+      storeOptions.syncWal = atoi(value) != 0;
+    else if (strcmp(option, "--stats-interval") == 0)
+      statsInterval = (unsigned)atoi(value);
+    else if (strcmp(option, "--push-threads") == 0)
+      pushThreads = (unsigned)atoi(value);
+    else if (strcmp(option, "--push-queue") == 0)
+      pushQueue = (unsigned)atoi(value);
+    else if (strcmp(option, "--alerts") == 0)
+      alertTable = value;
+    else if (strcmp(option, "--query-threads") == 0)
+      queryThreads = (unsigned)atoi(value);
+    else
+    {
+      usage();
+      return 2;
+    }
+    i++;
+  }
+  if (workers == 0)
+    workers = 1;
+  if (ingestShards < 0)
+    ingestShards = (int)workers;
+  const vitalcare::AlertThresholds *alertLimits = nullptr;
+  if (strcmp(alertTable, "emergency") == 0)
+    alertLimits = &vitalcare::EMERGENCY_THRESHOLDS;
+  else if (strcmp(alertTable, "bedside") == 0)
+    alertLimits = &vitalcare::BEDSIDE_THRESHOLDS;
+  else if (strcmp(alertTable, "off") != 0)
+  {
+    usage();
+    return 2;
+  }
+
+  // Block the shutdown signals before any thread starts; the loop reads
+  // them from a signalfd
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  int signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  std::unique_ptr<RecordSink> sink;
+  StoreSink *store = nullptr;
+  if (dataDir.empty())
+  {
+    sink.reset(new NullSink());
+  }
+  else
+  {
+    store = new StoreSink(dataDir, storeOptions);
+    sink.reset(store);
+    if (!store->open())
+    {
+      fprintf(stderr, "cannot open the store in %s\n", dataDir.c_str());
+      return 1;
+    }
+    logStoreStatistics(store->timeSeries()); // what was recovered
+  }
+  RollupStore rollups;
+  std::string rollupPath = dataDir.empty() ? std::string() : dataDir + "/rollups.vcr";
+  if (!rollupPath.empty())
+    rollups.load(rollupPath);
+
+  EventLoop loop;
+  if (!loop.valid() || signalFd < 0)
+  {
+    perror("event loop");
+    return 1;
+  }
+  // Rollups and alerts work on what the ingest admits, after it is stored
+  RollupSink rolling(*sink, rollups);
+  std::unique_ptr<AlertEngine> alerts;
+  std::unique_ptr<AlertingSink> alerting;
+  RecordSink *ingestSink = &rolling;
+  if (alertLimits)
+  {
+    alerts.reset(new AlertEngine(*alertLimits));
+    alerting.reset(new AlertingSink(rolling, *alerts));
+    ingestSink = alerting.get();
+  }
+  IngestService ingest(*ingestSink);
+  WorkerPool pool(workers, queue);
+  Server server(loop, pool, ingest);
+  std::unique_ptr<IngestPipeline> pipeline;
+  if (ingestShards > 0)
+  {
+    // Each shard queue takes its share of --queue
+    pipeline.reset(new IngestPipeline(ingest, (size_t)ingestShards, std::max(64u, queue / ingestShards)));
+    server.setIngestPipeline(pipeline.get());
+  }
+  std::unique_ptr<PushHub> hub;
+  if (pushThreads > 0)
+  {
+    hub.reset(new PushHub(pushThreads, pushQueue));
+    hub->start();
+    server.setPushHub(hub.get());
+  }
+  if (alerts)
+    server.setAlertEngine(alerts.get());
+  QueryEngine queries(rollups, queryThreads);
+  server.setQueryEngine(&queries);
+
+  if ((httpPort > 0 && !server.listenHttp((uint16_t)httpPort)) ||
+      (mqttPort > 0 && !server.listenMqtt((uint16_t)mqttPort)))
+  {
+    return 1;
+  }
+
+  loop.add(signalFd, EPOLLIN, [&loop, signalFd](uint32_t) {
+    signalfd_siginfo info;
+    while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+      ;
+    loop.stop();
+  });
+  if (pipeline)
+    loop.every(1000, [&pipeline]() { pipeline->rebalance(); });
+  if (statsInterval > 0)
+  {
+    loop.every(statsInterval * 1000, [&server, store]() {
+      server.logStatistics();
+      if (store)
+        logStoreStatistics(store->timeSeries());
+    });
+  }
+  if (store)
+  {
+    // Checkpoints seal and sync on a worker, never on the I/O loop
+    std::shared_ptr<std::atomic<bool>> checkpointing = std::make_shared<std::atomic<bool>>(false);
+    loop.every(1000, [&pool, &rollups, rollupPath, store, checkpointing]() {
+      if (store->timeSeries().walBytes() < CHECKPOINT_WAL_BYTES || checkpointing->exchange(true))
+        return;
+      if (!pool.submit([&rollups, rollupPath, store, checkpointing]() {
+            store->timeSeries().checkpoint();
+            rollups.save(rollupPath);
+            *checkpointing = false;
+          }))
+        *checkpointing = false;
+    });
+  }
+
+  printf("🏥 VitalCare gateway: HTTP %u, MQTT %u, %u workers, %d ingest shards, %u push threads, alerts %s%s%s%s, "
+         "%u query threads, %s\n",
+         server.httpPort(), server.mqttPort(), workers, ingestShards, pushThreads, alertTable, alerts ? " (" : "",
+         alerts ? alerts->kernelName() : "", alerts ? ")" : "", queryThreads,
+         dataDir.empty() ? "not storing records" : dataDir.c_str());
+  fflush(stdout);
+
+  loop.run();
+
+  loop.remove(signalFd);
+  close(signalFd);
+  if (pipeline)
+    pipeline->shutdown();
+  pool.shutdown();
+  if (hub)
+    hub->stop(); // workers no longer publish
+  sink->flush();
+  server.logStatistics();
+  if (store)
+  {
+    store->timeSeries().close(); // final checkpoint
+    rollups.save(rollupPath);
+    logStoreStatistics(store->timeSeries());
+  }
+  printf("gateway stopped\n");
+  return 0;
+}
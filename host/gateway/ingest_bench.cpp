@@ -0,0 +1,346 @@
+/*
+ * VitalCare Rural Gateway - Ingest Pipeline Benchmark
+ *
+ * Pushes uplink batches in process through the locked worker-pool path and
+ * through IngestPipeline, into a sink that checks each device's records
+ * arrive in sequence order. The load is skewed: a "hot clinic" of devices
+ * that all start on shard 0 uploads --hot-factor times as often as the
+ * rest. Reports:
+ *
+ * - records/s for the worker pool and for the pipeline at 1, 2, 4, ...
+ *   --shards shards (scaling needs as many cores as shards)
+ * - each shard's share of the records in the first and the last 0.5 s,
+ *   with and without rebalancing, and the moves made
+ *
+ * and fails unless every batch was acked in full and the pipeline stored
+ * every device's records in order.
+ *
+ * Usage: vitalcare-ingest-bench [--devices 2000] [--hot-share 0.05]
+ *                               [--hot-factor 20] [--shards 4]
+ *                               [--producers 2] [--seconds 3] [--batch 30]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Ingest.h"
+#include "IngestPipeline.h"
+#include "WorkerPool.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Counts records stored out of sequence order, per device
+class OrderSink : public RecordSink
+{
+public:
+  explicit OrderSink(size_t devices) : last(devices + 1) {}
+
+  bool storeVitals(uint64_t deviceId, const uint8_t *records, size_t count) override
+  {
+    std::atomic<uint32_t> &newest = last[deviceId];
+    for (size_t i = 0; i < count; i++)
+    {
+      VitalRecord record = {};
+      decodeVitalRecord(records + i * VITAL_RECORD_SIZE, record);
+      if (record.sequence <= newest.load(std::memory_order_relaxed))
+        outOfOrder++;
+      newest.store(record.sequence, std::memory_order_relaxed);
+    }
+    return true;
+  }
+  bool storePatients(uint64_t, const uint8_t *, size_t) override { return true; }
+
+  std::vector<std::atomic<uint32_t>> last;
+  std::atomic<uint64_t> outOfOrder{0};
+};
+
+struct Workload
+{
+  size_t devices;
+  std::vector<bool> hot;
+  int hotFactor;
+  size_t producers;
+  size_t batch;
+  double seconds;
+};
+
+struct RunResult
+{
+  double seconds;
+  uint64_t records;
+  uint64_t accepted;
+  uint64_t outOfOrder;
+  uint64_t moves;
+  std::vector<uint64_t> firstShare; // records per shard, first 0.5 s
+  std::vector<uint64_t> lastShare;  // and last 0.5 s
+};
+
+static std::shared_ptr<std::vector<uint8_t>> makeBatch(uint64_t deviceId, uint32_t &sequence, uint32_t batchSequence,
+                                                       size_t count)
+{
+  std::shared_ptr<std::vector<uint8_t>> batch =
+      std::make_shared<std::vector<uint8_t>>(UPLINK_HEADER_SIZE + count * VITAL_RECORD_SIZE);
+  UplinkBatchWriter writer(batch->data(), batch->size(), UPLINK_VITAL_RECORDS, deviceId, batchSequence);
+  for (size_t i = 0; i < count; i++)
+  {
+    VitalRecord record = {};
+    record.sequence = ++sequence;
+    record.vitals.heartRate = 72;
+    record.vitals.systolicBP = 118;
+    record.vitals.diastolicBP = 78;
+    record.vitals.spO2 = 97.5f;
+    record.vitals.temperature = 98.4f;
+    record.vitals.timestampMs = sequence * 10000u;
+    writer.add(record);
+  }
+  batch->resize(writer.finish());
+  return batch;
+}
+
+// submit(batch, acked) queues one batch or returns false when full.
+// Producer p owns the devices with id % producers == p, so each device's
+// batches are submitted from one thread in order.
+template <typename Submit, typename Sample>
+static RunResult drive(const Workload &load, OrderSink &sink, Submit submit, Sample sample)
+{
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> submitted{0}, acked{0}, accepted{0};
+  std::vector<std::thread> producers;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t p = 0; p < load.producers; p++)
+  {
+    producers.emplace_back([&, p]() {
+      std::vector<uint32_t> sequences(load.devices + 1, 0), batches(load.devices + 1, 0);
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        for (size_t device = 1 + p; device <= load.devices && !stop.load(std::memory_order_relaxed);
+             device += load.producers)
+        {
+          int repeats = load.hot[device] ? load.hotFactor : 1;
+          for (int r = 0; r < repeats; r++)
+          {
+            std::shared_ptr<std::vector<uint8_t>> batch =
+                makeBatch(device, sequences[device], ++batches[device], load.batch);
+            submitted++;
+            while (!submit(batch, [&acked, &accepted](const UplinkAck &ack) {
+              accepted += ack.status == UPLINK_OK ? ack.accepted : 0;
+              acked++;
+            }))
+              std::this_thread::yield();
+          }
+        }
+      }
+    });
+  }
+
+  RunResult result;
+  std::vector<uint64_t> early, late;
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  result.firstShare = sample();
+  std::this_thread::sleep_for(std::chrono::milliseconds((int)(load.seconds * 1000) - 1000));
+  early = sample();
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  late = sample();
+  stop = true;
+  for (std::thread &producer : producers)
+    producer.join();
+  while (acked.load() < submitted.load())
+    std::this_thread::yield();
+
+  result.seconds = seconds(start);
+  result.records = submitted * load.batch;
+  result.accepted = accepted;
+  result.outOfOrder = sink.outOfOrder;
+  result.moves = 0;
+  for (size_t i = 0; i < late.size(); i++)
+    result.lastShare.push_back(late[i] - early[i]);
+  return result;
+}
+
+static RunResult runPool(const Workload &load, size_t threads)
+{
+  OrderSink sink(load.devices);
+  IngestService ingest(sink);
+  WorkerPool pool(threads, 4096);
+  RunResult result = drive(
+      load, sink,
+      [&](std::shared_ptr<std::vector<uint8_t>> batch, IngestPipeline::Completion done) {
+        return pool.submit([&ingest, batch, done]() { done(ingest.process(batch->data(), batch->size())); });
+      },
+      []() { return std::vector<uint64_t>(); });
+  pool.shutdown();
+  return result;
+}
+
+static RunResult runPipeline(const Workload &load, size_t shards, bool rebalancing)
+{
+  OrderSink sink(load.devices);
+  IngestService ingest(sink);
+  IngestPipeline pipeline(ingest, shards, 1024);
+  std::atomic<bool> stop{false};
+  std::thread rebalancer([&]() {
+    while (rebalancing && !stop)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      pipeline.rebalance();
+    }
+  });
+  RunResult result = drive(
+      load, sink,
+      [&](std::shared_ptr<std::vector<uint8_t>> batch, IngestPipeline::Completion done) {
+        return pipeline.submit(std::move(batch), std::move(done));
+      },
+      [&]() {
+        std::vector<uint64_t> records;
+        for (size_t i = 0; i < pipeline.shardCount(); i++)
+          records.push_back(pipeline.metrics(i).records);
+        return records;
+      });
+  stop = true;
+  rebalancer.join();
+  pipeline.shutdown();
+  result.moves = pipeline.moves();
+  return result;
+}
+
+// "62% 13% 12% 13% (max/mean 2.5)"
+static void printShares(const std::vector<uint64_t> &records)
+{
+  uint64_t total = 0, most = 0;
+  for (uint64_t r : records)
+  {
+    total += r;
+    most = std::max(most, r);
+  }
+  for (uint64_t r : records)
+    printf("%3.0f%% ", total ? 100.0 * r / total : 0.0);
+  printf("(max/mean %.2f)", total ? (double)most * records.size() / total : 0.0);
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-ingest-bench [--devices N] [--hot-share F] [--hot-factor N] [--shards N]\n"
+                  "                              [--producers N] [--seconds S] [--batch N]\n");
+}
+
+int main(int argc, char **argv)
+{
+  size_t devices = 2000;
+  double hotShare = 0.05;
+  int hotFactor = 20;
+  size_t shards = 4;
+  size_t producers = 2;
+  double runSeconds = 3;
+  size_t batch = 30;
+
+  for (int i = 1; i < argc; i += 2)
+  {
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const char *option = argv[i];
+    const char *value = argv[i + 1];
+    if (strcmp(option, "--devices") == 0)
+      devices = (size_t)atol(value);
+    else if (strcmp(option, "--hot-share") == 0)
+      hotShare = atof(value);
+    else if (strcmp(option, "--hot-factor") == 0)
+      hotFactor = atoi(value);
+    else if (strcmp(option, "--shards") == 0)
+      shards = (size_t)atol(value);
+    else if (strcmp(option, "--producers") == 0)
+      producers = (size_t)atol(value);
+    else if (strcmp(option, "--seconds") == 0)
+      runSeconds = atof(value);
+    else if (strcmp(option, "--batch") == 0)
+      batch = (size_t)atol(value);
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  devices = std::max<size_t>(1, devices);
+  hotFactor = std::max(1, hotFactor);
+  shards = std::max<size_t>(1, shards);
+  producers = std::max<size_t>(1, producers);
+  runSeconds = std::max(1.5, runSeconds);
+  batch = std::max<size_t>(1, std::min<size_t>(batch, UPLINK_MAX_RECORDS));
+
+  // The hot clinic: devices that start out on shard 0
+  Workload load{devices, std::vector<bool>(devices + 1, false), hotFactor, producers, batch, runSeconds};
+  {
+    OrderSink sink(0);
+    IngestService ingest(sink);
+    IngestPipeline routing(ingest, shards, 64);
+    size_t wanted = (size_t)(devices * hotShare), hotCount = 0;
+    for (size_t device = 1; device <= devices && hotCount < wanted; device++)
+    {
+      if (routing.shardOf(device) == 0)
+      {
+        load.hot[device] = true;
+        hotCount++;
+      }
+    }
+    printf("🏭 ingest-bench: %zu devices, %zu hot (x%d uploads, all on shard 0 at start), %zu producers, "
+           "batches of %zu, %u cores\n",
+           devices, hotCount, hotFactor, producers, batch, std::thread::hardware_concurrency());
+  }
+
+  bool ok = true;
+  auto report = [&ok](const char *name, const RunResult &result, bool ordered) {
+    bool complete = result.accepted == result.records;
+    ok = ok && complete && (!ordered || result.outOfOrder == 0);
+    printf("%-34s %6.2f M records/s, %llu out of order%s\n", name, result.accepted / result.seconds / 1e6,
+           (unsigned long long)result.outOfOrder, complete ? "" : "   ❌ not every record acked");
+  };
+
+  char name[64];
+  snprintf(name, sizeof(name), "worker pool, %zu threads", shards);
+  report(name, runPool(load, shards), false);
+  for (size_t count = 1; count <= shards; count *= 2)
+  {
+    bool last = count * 2 > shards;
+    RunResult result = runPipeline(load, last ? shards : count, true);
+    snprintf(name, sizeof(name), "pipeline, %zu shard%s", last ? shards : count, (last ? shards : count) > 1 ? "s" : "");
+    report(name, result, true);
+    if (last && shards > 1)
+    {
+      RunResult fixed = runPipeline(load, shards, false);
+      report("pipeline, no rebalancing", fixed, true);
+      printf("  shard load, no rebalancing: first 0.5 s ");
+      printShares(fixed.firstShare);
+      printf("  last 0.5 s ");
+      printShares(fixed.lastShare);
+      printf("\n  shard load, rebalancing:    first 0.5 s ");
+      printShares(result.firstShare);
+      printf("  last 0.5 s ");
+      printShares(result.lastShare);
+      printf("  %llu moves\n", (unsigned long long)result.moves);
+    }
+    if (last)
+      break;
+  }
+
+  if (!ok)
+    return 1;
+  printf("✅ every batch acked in full, every device's records stored in order\n");
+  return 0;
+}
@@ -0,0 +1,385 @@
+/*
+ * VitalCare Rural Gateway - Live Push Benchmark
+ *
+ * Fan-out throughput of the PushHub at monitoring-room scale. Connects
+ * --clients loopback WebSocket clients to a hub, publishes live vitals for
+ * --devices devices at --rate messages/s (with a share of alerts) and
+ * measures what the clients receive. A --slow-share of the clients read
+ * only a little every 50 ms with a small receive buffer, so their queues
+ * fill and coalescing has to keep them current.
+ *
+ * Usage: vitalcare-push-bench [--clients 1000] [--senders 2] [--readers 2]
+ *                             [--devices 200] [--rate 2000] [--seconds 5]
+ *                             [--slow-share 0.05] [--alert-share 0.01]
+ *                             [--queue 256]
+ *
+ * Reports messages published and delivered per second, publish-to-receive
+ * latency on the fast clients, and what coalescing did for the slow ones.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PushHub.h"
+
+using namespace vitalcare::gateway;
+
+struct BenchOptions
+{
+  int clients = 1000;
+  int senders = 2;
+  int readers = 2;
+  int devices = 200;
+  double rate = 2000;
+  double seconds = 5;
+  double slowShare = 0.05;
+  double alertShare = 0.01;
+  int queue = (int)PushHub::DEFAULT_QUEUE_LIMIT;
+};
+
+struct BenchClient
+{
+  int fd = -1;
+  bool slow = false;
+  std::string input;
+  uint64_t received = 0;
+  uint64_t alerts = 0;
+};
+
+static uint64_t nowUs()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Splits server frames (unmasked) off the client's input. Every payload
+// starts {"sent":<us>,"type":"..."; latency is sampled one in eight.
+static void consumeFrames(BenchClient &client, std::vector<uint32_t> *latencies)
+{
+  size_t offset = 0;
+  uint64_t now = 0;
+  while (client.input.size() - offset >= 2)
+  {
+    const uint8_t *data = (const uint8_t *)client.input.data() + offset;
+    size_t available = client.input.size() - offset;
+    uint64_t length = data[1] & 0x7F;
+    size_t header = 2;
+    if (length == 126)
+    {
+      if (available < 4)
+        break;
+      length = (uint64_t)data[2] << 8 | data[3];
+      header = 4;
+    }
+    if (available < header + length)
+      break;
+
+    const char *payload = (const char *)data + header;
+    client.received++;
+    if (memmem(payload, std::min<size_t>(length, 48), "\"type\":\"alert\"", 14))
+      client.alerts++;
+    if (latencies && client.received % 8 == 0)
+    {
+      if (now == 0)
+        now = nowUs();
+      uint64_t sent = strtoull(payload + 8, nullptr, 10);
+      latencies->push_back((uint32_t)(now - sent));
+    }
+    offset += header + length;
+  }
+  client.input.erase(0, offset);
+}
+
+// Reads the fast clients as quickly as they are written to
+static void runFastReader(std::vector<BenchClient *> clients, std::atomic<bool> &stop,
+                          std::vector<uint32_t> &latencies)
+{
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  for (size_t i = 0; i < clients.size(); i++)
+  {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = i;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i]->fd, &event);
+  }
+  epoll_event events[256];
+  char chunk[64 * 1024];
+  while (!stop)
+  {
+    int count = epoll_wait(epollFd, events, 256, 50);
+    for (int e = 0; e < count; e++)
+    {
+      BenchClient &client = *clients[events[e].data.u64];
+      ssize_t got;
+      while ((got = recv(client.fd, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0)
+        client.input.append(chunk, got);
+      consumeFrames(client, &latencies);
+    }
+  }
+  close(epollFd);
+}
+
+// Reads the slow clients a little at a time
+static void runSlowReader(std::vector<BenchClient *> clients, std::atomic<bool> &stop)
+{
+  char chunk[2048];
+  while (!stop)
+  {
+    for (BenchClient *client : clients)
+    {
+      ssize_t got = recv(client->fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+      if (got > 0)
+      {
+        client->input.append(chunk, got);
+        consumeFrames(*client, nullptr);
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction)
+{
+  if (sorted.empty())
+    return 0;
+  size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-push-bench [--clients N] [--senders N] [--readers N] [--devices N]\n"
+                  "                            [--rate MSG_PER_S] [--seconds S] [--slow-share F]\n"
+                  "                            [--alert-share F] [--queue N]\n");
+}
+
+int main(int argc, char **argv)
+{
+  BenchOptions options;
+  for (int i = 1; i < argc; i += 2)
+  {
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const char *option = argv[i];
+    const char *value = argv[i + 1];
+    if (strcmp(option, "--clients") == 0)
+      options.clients = atoi(value);
+    else if (strcmp(option, "--senders") == 0)
+      options.senders = atoi(value);
+    else if (strcmp(option, "--readers") == 0)
+      options.readers = atoi(value);
+    else if (strcmp(option, "--devices") == 0)
+      options.devices = atoi(value);
+    else if (strcmp(option, "--rate") == 0)
+      options.rate = atof(value);
+    else if (strcmp(option, "--seconds") == 0)
+      options.seconds = atof(value);
+    else if (strcmp(option, "--slow-share") == 0)
+      options.slowShare = atof(value);
+    else if (strcmp(option, "--alert-share") == 0)
+      options.alertShare = atof(value);
+    else if (strcmp(option, "--queue") == 0)
+      options.queue = atoi(value);
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  options.clients = std::max(1, options.clients);
+  options.senders = std::max(1, options.senders);
+  options.readers = std::max(1, options.readers);
+  options.devices = std::max(1, options.devices);
+  options.rate = std::max(1.0, options.rate);
+
+  // Loopback listener the clients connect through; the accepted ends go to the hub
+  int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0 ||
+      getsockname(listener, (sockaddr *)&address, &length) != 0)
+  {
+    perror("listen");
+    return 1;
+  }
+
+  PushHub hub(options.senders, options.queue);
+  hub.start();
+
+  std::vector<std::unique_ptr<BenchClient>> clients;
+  std::vector<BenchClient *> fastClients[64];
+  std::vector<BenchClient *> slowClients;
+  int readers = std::min(options.readers, 64);
+  int slowEvery = options.slowShare > 0 ? std::max(1, (int)(1.0 / options.slowShare + 0.5)) : 0;
+  for (int i = 0; i < options.clients; i++)
+  {
+    std::unique_ptr<BenchClient> client(new BenchClient());
+    client->slow = slowEvery > 0 && i % slowEvery == slowEvery - 1;
+    client->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->slow)
+    {
+      int small = 16 * 1024;
+      setsockopt(client->fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    }
+    if (connect(client->fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+      perror("connect");
+      return 1;
+    }
+    int server = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (server < 0)
+    {
+      perror("accept4");
+      return 1;
+    }
+    int one = 1;
+    setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    hub.adopt(server, std::string());
+    if (client->slow)
+      slowClients.push_back(client.get());
+    else
+      fastClients[i % readers].push_back(client.get());
+    clients.push_back(std::move(client));
+  }
+  close(listener);
+  while (hub.statistics().clients < (uint64_t)options.clients)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  printf("📡 push-bench: %d clients (%zu slow) on %d sender threads, %d devices, %.0f msg/s for %.0f s, queue %d\n",
+         options.clients, slowClients.size(), options.senders, options.devices, options.rate, options.seconds,
+         options.queue);
+  fflush(stdout);
+
+  std::atomic<bool> stopReaders(false);
+  std::vector<std::vector<uint32_t>> latencies(readers);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++)
+    threads.emplace_back(runFastReader, fastClients[r], std::ref(stopReaders), std::ref(latencies[r]));
+  threads.emplace_back(runSlowReader, slowClients, std::ref(stopReaders));
+
+  // Publish on a fixed schedule: message n is due at start + n / rate
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> roll(0.0, 1.0);
+  uint64_t startUs = nowUs();
+  uint64_t endUs = startUs + (uint64_t)(options.seconds * 1e6);
+  uint64_t published = 0;
+  uint64_t alerts = 0;
+  uint64_t serializeUs = 0;
+  char buffer[384];
+  while (true)
+  {
+    uint64_t now = nowUs();
+    if (now >= endUs)
+      break;
+    uint64_t due = (uint64_t)((now - startUs) / 1e6 * options.rate);
+    if (published >= due)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+    for (; published < due; published++)
+    {
+      uint64_t before = nowUs();
+      int device = (int)(published % options.devices);
+      bool alert = roll(random) < options.alertShare;
+      int size = snprintf(buffer, sizeof(buffer),
+                          "{\"sent\":%llu,\"type\":\"%s\",\"device\":\"%d\",\"sequence\":%llu,\"timestamp\":%llu,"
+                          "\"heartRate\":%.1f,\"systolicBP\":120.0,\"diastolicBP\":80.0,\"spO2\":97.5,"
+                          "\"temperature\":98.6,\"alerts\":%d,\"flags\":0}",
+                          (unsigned long long)before, alert ? "alert" : "vitals", device,
+                          (unsigned long long)published, (unsigned long long)(before / 1000),
+                          70.0 + device % 30, alert ? 1 : 0);
+      hub.publish(alert ? 0 : (uint64_t)device + 1, buffer, (size_t)size);
+      serializeUs += nowUs() - before;
+      alerts += alert;
+    }
+  }
+  double publishSeconds = (nowUs() - startUs) / 1e6;
+
+  // Let the fast clients drain
+  uint64_t lastDelivered = 0;
+  for (int i = 0; i < 40; i++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    uint64_t delivered = hub.statistics().delivered;
+    if (delivered == lastDelivered)
+      break;
+    lastDelivered = delivered;
+  }
+  double elapsed = (nowUs() - startUs) / 1e6;
+  stopReaders = true;
+  for (std::thread &thread : threads)
+    thread.join();
+
+  const PushStats &stats = hub.statistics();
+  uint64_t fastReceived = 0, fastMin = UINT64_MAX, slowReceived = 0, slowAlerts = 0, fastCount = 0;
+  for (std::unique_ptr<BenchClient> &client : clients)
+  {
+    if (client->slow)
+    {
+      slowReceived += client->received;
+      slowAlerts += client->alerts;
+    }
+    else
+    {
+      fastReceived += client->received;
+      fastMin = std::min(fastMin, client->received);
+      fastCount++;
+    }
+  }
+  std::vector<uint32_t> all;
+  for (std::vector<uint32_t> &part : latencies)
+    all.insert(all.end(), part.begin(), part.end());
+  std::sort(all.begin(), all.end());
+
+  printf("published %llu messages (%llu alerts) in %.2f s: %.0f msg/s, %.2f us to serialize and publish each\n",
+         (unsigned long long)published, (unsigned long long)alerts, publishSeconds, published / publishSeconds,
+         published ? (double)serializeUs / published : 0.0);
+  printf("delivered %llu messages in %.2f s: %.0f msg/s to clients, %.1f MB/s\n",
+         (unsigned long long)stats.delivered.load(), elapsed, stats.delivered / elapsed,
+         stats.bytes / elapsed / 1e6);
+  if (fastCount > 0)
+  {
+    printf("fast clients: %.1f%% of messages received on average, worst client %.1f%%\n",
+           100.0 * fastReceived / fastCount / std::max<uint64_t>(1, published),
+           100.0 * fastMin / std::max<uint64_t>(1, published));
+    printf("latency publish to receive: p50 %u us, p99 %u us, max %u us\n", percentile(all, 0.50),
+           percentile(all, 0.99), all.empty() ? 0 : all.back());
+  }
+  if (!slowClients.empty())
+  {
+    printf("slow clients: %.0f messages each read so far (%.0f of %llu alerts), coalesced %llu, dropped %llu, "
+           "disconnected %llu\n",
+           (double)slowReceived / slowClients.size(), (double)slowAlerts / slowClients.size(),
+           (unsigned long long)alerts, (unsigned long long)stats.coalesced.load(),
+           (unsigned long long)stats.dropped.load(), (unsigned long long)stats.slowClosed.load());
+  }
+
+  hub.stop();
+  for (std::unique_ptr<BenchClient> &client : clients)
+    close(client->fd);
+  return 0;
+}
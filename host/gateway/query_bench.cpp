@@ -0,0 +1,297 @@
+/*
+ * VitalCare Rural Gateway - Rollup Query Benchmark
+ *
+ * Generates a year of vitals for a fleet (one record per device every
+ * --interval seconds, random walks around a per-device baseline), rolls it
+ * up through RollupStore and reports:
+ *
+ * - ingest: records per second through the three tiers
+ * - query latency, p50 and p99, for typical dashboard requests: cold
+ *   (cache cleared before every query) and warm (repeated, only unsettled
+ *   spans rescanned), with the tier the planner chose and the buckets read;
+ *   where the minute tier still covers the range, the same query forced
+ *   onto it for comparison
+ *
+ * and checks that a planned query equals a brute-force aggregate of the
+ * generated records, and equals the same query forced onto the minute tier.
+ *
+ * Usage: vitalcare-query-bench [--devices 40] [--clinic 10] [--days 365]
+ *                              [--interval 60] [--threads 2] [--repeat 50]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "QueryEngine.h"
+#include "RollupStore.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+static const uint32_t EPOCH_START = 1700006400; // a midnight, UTC
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Generator
+{
+  std::mt19937 random;
+  std::normal_distribution<float> noise{0.0f, 1.0f};
+  std::uniform_real_distribution<float> roll{0.0f, 1.0f};
+  float baseline;
+  float heartRate;
+  float systolic = 118;
+  float spO2 = 97.5f;
+  float temperature = 98.3f;
+  uint32_t sequence = 0;
+
+  explicit Generator(uint64_t deviceId)
+      : random((uint32_t)deviceId * 2654435761u), baseline(62.0f + deviceId % 25), heartRate(baseline)
+  {
+  }
+
+  VitalRecord next(uint32_t wallSeconds)
+  {
+    // Slow daily rhythm plus noise
+    float circadian = 6.0f * sinf((wallSeconds % 86400) * 7.2722e-5f);
+    heartRate += (baseline + circadian - heartRate) * 0.1f + noise(random);
+    spO2 += (97.5f - spO2) * 0.1f + 0.2f * noise(random);
+    temperature += (98.3f - temperature) * 0.1f + 0.05f * noise(random);
+    systolic += (118 - systolic) * 0.1f + 2 * noise(random);
+
+    VitalRecord record = {};
+    record.sequence = ++sequence;
+    record.vitals.heartRate = roundf(heartRate * 10.0f) / 10.0f;
+    record.vitals.systolicBP = roundf(systolic * 10.0f) / 10.0f;
+    record.vitals.diastolicBP = roundf(systolic * 6.6f) / 10.0f;
+    record.vitals.spO2 = roll(random) < 0.02f ? 0 : roundf(std::min(spO2, 100.0f) * 10.0f) / 10.0f;
+    record.vitals.temperature = roundf(temperature * 10.0f) / 10.0f;
+    record.vitals.timestampMs = wallSeconds * 1000u;
+    record.alertFlags = evaluateAlerts(record.vitals, EMERGENCY_THRESHOLDS);
+    return record;
+  }
+};
+
+struct Latency
+{
+  double p50;
+  double p99;
+  size_t bucketsRead;
+  size_t cachedSpans;
+  size_t spans;
+};
+
+static Latency measure(QueryEngine &engine, const RollupQuery &query, int repeat, bool cold)
+{
+  std::vector<double> times;
+  QueryResult result;
+  if (!cold)
+    engine.run(query, result); // fill the cache
+  for (int run = 0; run < repeat; run++)
+  {
+    if (cold)
+      engine.clearCache();
+    result = QueryResult();
+    auto start = std::chrono::steady_clock::now();
+    engine.run(query, result);
+    times.push_back(seconds(start) * 1e3);
+  }
+  std::sort(times.begin(), times.end());
+  return Latency{times[times.size() / 2], times[std::min(times.size() - 1, times.size() * 99 / 100)],
+                 result.bucketsRead, result.cachedSpans, result.spans};
+}
+
+static bool samePoints(const std::vector<QueryPoint> &a, const std::vector<QueryPoint> &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    if (a[i].count != b[i].count || a[i].min != b[i].min || a[i].max != b[i].max ||
+        fabs(a[i].mean() - b[i].mean()) > 1e-3 * std::max(1.0, fabs(b[i].mean())))
+      return false;
+  }
+  return true;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-query-bench [--devices N] [--clinic N] [--days N] [--interval SECONDS]\n"
+                  "                             [--threads N] [--repeat N]\n");
+}
+
+int main(int argc, char **argv)
+{
+  size_t devices = 40;
+  size_t clinic = 10;
+  uint32_t days = 365;
+  uint32_t interval = 60;
+  size_t threads = 2;
+  int repeat = 50;
+
+  for (int i = 1; i < argc; i += 2)
+  {
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const char *option = argv[i];
+    const char *value = argv[i + 1];
+    if (strcmp(option, "--devices") == 0)
+      devices = (size_t)atol(value);
+    else if (strcmp(option, "--clinic") == 0)
+      clinic = (size_t)atol(value);
+    else if (strcmp(option, "--days") == 0)
+      days = (uint32_t)atol(value);
+    else if (strcmp(option, "--interval") == 0)
+      interval = (uint32_t)atol(value);
+    else if (strcmp(option, "--threads") == 0)
+      threads = (size_t)atol(value);
+    else if (strcmp(option, "--repeat") == 0)
+      repeat = atoi(value);
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  devices = std::max<size_t>(1, devices);
+  clinic = std::max<size_t>(1, std::min(clinic, devices));
+  days = std::max<uint32_t>(8, days);
+  interval = std::max<uint32_t>(1, interval);
+  threads = std::max<size_t>(1, threads);
+  repeat = std::max(1, repeat);
+
+  uint32_t end = EPOCH_START + days * 86400;
+  size_t perDevice = (size_t)days * 86400 / interval;
+  printf("📈 query-bench: %zu devices (clinics of %zu) x %u days, a record every %u s (%zu records), "
+         "%zu scan threads\n",
+         devices, clinic, days, interval, devices * perDevice, threads);
+
+  // Brute-force reference: clinic 0, heart rate, the last 7 days hourly
+  RollupQuery reference;
+  for (size_t d = 0; d < clinic; d++)
+    reference.devices.push_back(d + 1);
+  reference.field = FIELD_HEART_RATE;
+  reference.fromSeconds = end - 7 * 86400;
+  reference.toSeconds = end;
+  reference.stepSeconds = 3600;
+  std::vector<QueryPoint> expected(7 * 24);
+
+  // Devices upload in turn, a record each, as the fleet does live
+  RollupStore store;
+  std::vector<Generator> generators;
+  for (size_t d = 0; d < devices; d++)
+    generators.emplace_back(d + 1);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < perDevice; i++)
+  {
+    uint32_t wall = EPOCH_START + (uint32_t)(i * interval);
+    for (size_t d = 0; d < devices; d++)
+    {
+      VitalRecord record = generators[d].next(wall);
+      store.add(d + 1, record, wall);
+      if (d < clinic && wall >= reference.fromSeconds)
+      {
+        float value = record.vitals.heartRate;
+        QueryPoint point;
+        point.count = 1;
+        point.sum = value;
+        point.min = point.max = roundf(value * 10.0f) / 10.0f;
+        expected[(wall - reference.fromSeconds) / 3600].merge(point);
+      }
+    }
+  }
+  double ingestTime = seconds(start);
+  const RollupStats &rollupStats = store.statistics();
+  printf("ingest: %.2f M records/s, buckets 1m %llu  15m %llu  1d %llu (%.0f MB)\n",
+         devices * perDevice / ingestTime / 1e6, (unsigned long long)rollupStats.buckets[TIER_MINUTE].load(),
+         (unsigned long long)rollupStats.buckets[TIER_QUARTER_HOUR].load(),
+         (unsigned long long)rollupStats.buckets[TIER_DAY].load(),
+         (rollupStats.buckets[0] + rollupStats.buckets[1] + rollupStats.buckets[2]) * sizeof(RollupBucket) / 1e6);
+
+  QueryEngine engine(store, threads);
+  bool ok = true;
+
+  QueryResult planned, forced;
+  engine.run(reference, planned);
+  RollupQuery minuteOnly = reference;
+  minuteOnly.forceTier = TIER_MINUTE;
+  engine.run(minuteOnly, forced);
+  bool matchesReference = samePoints(planned.points, expected);
+  bool matchesMinute = samePoints(planned.points, forced.points);
+  ok = matchesReference && matchesMinute;
+  printf("check: 7 d hourly over clinic 0 on %s %s brute force, %s the minute tier\n",
+         ROLLUP_TIER_NAMES[planned.plan.tier], matchesReference ? "equals" : "❌ differs from",
+         matchesMinute ? "equals" : "❌ differs from");
+
+  struct Case
+  {
+    const char *name;
+    uint32_t span;
+    uint32_t step;
+    size_t deviceCount; // 0: the fleet
+  };
+  const Case cases[] = {
+      {"24 h @ 1 min, one device", 86400, 60, 1},
+      {"24 h @ 15 min, clinic", 86400, 900, clinic},
+      {"7 d @ 15 min, clinic", 7 * 86400, 900, clinic},
+      {"30 d @ 1 h, clinic", 30 * 86400, 3600, clinic},
+      {"90 d @ 1 h, fleet", 90 * 86400, 3600, 0},
+      {"365 d @ 1 d, clinic", 365 * 86400, 86400, clinic},
+      {"365 d @ 1 d, fleet", 365 * 86400, 86400, 0},
+  };
+
+  printf("%-28s %-4s %9s %9s %9s %9s %10s %14s\n", "query (heart rate)", "tier", "cold p50", "cold p99", "warm p50",
+         "warm p99", "buckets", "1m-only p50");
+  for (const Case &c : cases)
+  {
+    if (c.span > days * 86400u)
+      continue;
+    RollupQuery query;
+    for (size_t d = 0; d < c.deviceCount; d++)
+      query.devices.push_back(d + 1);
+    query.field = FIELD_HEART_RATE;
+    query.fromSeconds = end - c.span;
+    query.toSeconds = end;
+    query.stepSeconds = c.step;
+
+    QueryPlan plan;
+    if (!engine.plan(query, plan))
+    {
+      printf("%-28s not plannable\n", c.name);
+      ok = false;
+      continue;
+    }
+    Latency cold = measure(engine, query, repeat, true);
+    Latency warm = measure(engine, query, repeat, false);
+    printf("%-28s %-4s %7.3f ms %6.3f ms %6.3f ms %6.3f ms %10zu", c.name, ROLLUP_TIER_NAMES[plan.tier], cold.p50,
+           cold.p99, warm.p50, warm.p99, cold.bucketsRead);
+    if (plan.tier != TIER_MINUTE && query.fromSeconds >= store.retainedFrom(TIER_MINUTE))
+    {
+      query.forceTier = TIER_MINUTE;
+      Latency minute = measure(engine, query, repeat, true);
+      printf(" %8.3f ms x%.0f", minute.p50, minute.p50 / std::max(cold.p50, 1e-6));
+    }
+    printf("\n");
+  }
+
+  const QueryStats &queryStats = engine.statistics();
+  printf("%llu queries, %.1f%% of spans from the cache\n", (unsigned long long)queryStats.queries.load(),
+         100.0 * queryStats.cachedSpans / std::max<uint64_t>(1, queryStats.spans));
+  if (!ok)
+    return 1;
+  printf("✅ rollup results equal brute force and the minute tier\n");
+  return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * VitalCare Rural Gateway - Time-Series Store Benchmark
+ *
+ * Generates realistic 1 Hz VitalRecord streams for a fleet (heart rate
+ * random walk, BP that changes only on cuff measurements, slowly moving
+ * SpO2 and temperature, a few ms of timestamp jitter), ingests them through
+ * the store exactly as the gateway does, and reports:
+ *
+ * - bytes per sample on disk and per column, against the 24-byte record
+ * - ingest rows/s (write-ahead log with group commit, sealing)
+ * - query rows/s for full-series scans and 1-hour range queries
+ * - reopen time (segment scan) and a row-by-row check against the input
+ *
+ * Usage: vitalcare-tsdb-bench [--devices 200] [--hours 24] [--batch 60]
+ *                             [--threads N] [--sync 0] [--dir DIR]
+ * Any other option, or a value that is not a number in range, prints the
+ * usage and exits with 2.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Arguments.h"
+#include "TimeSeriesStore.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Deterministic per-device stream, so it can be regenerated for the check
+class VitalsGenerator
+{
+public:
+  explicit VitalsGenerator(uint64_t deviceId) : random((uint32_t)deviceId * 2654435761u)
+  {
+    heartRate = 65 + (deviceId % 20);
+    spO2 = 97;
+    temperature = 98.4f;
+  }
+
+  VitalRecord next()
+  {
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    VitalRecord record = {};
+    record.sequence = ++sequence;
+    record.vitals.timestampMs = 5000 + sequence * 1000 + jitter(random);
+
+    heartRate += 0.3f * noise(random) + 0.01f * (72 - heartRate);
+    if (sequence % 300 == 1)
+    {
+      systolic = roundf(118 + 6 * noise(random));
+      diastolic = roundf(78 + 4 * noise(random));
+    }
+    if (sequence % 30 == 0)
+      spO2 = std::min(100.0f, std::max(90.0f, spO2 + roundf(0.6f * noise(random))));
+    if (sequence % 60 == 0)
+      temperature += 0.1f * roundf(noise(random));
+
+    record.vitals.heartRate = heartRate;
+    record.vitals.systolicBP = systolic;
+    record.vitals.diastolicBP = diastolic;
+    record.vitals.spO2 = spO2;
+    record.vitals.temperature = temperature;
+    record.alertFlags = heartRate > 100 ? 1 : 0;
+    return record;
+  }
+
+private:
+  std::mt19937 random;
+  uint32_t sequence = 0;
+  float heartRate;
+  float systolic = 120;
+  float diastolic = 80;
+  float spO2;
+  float temperature;
+};
+
+static uint64_t deviceIdFor(int index)
+{
+  return 0x5643000000000000ull + index;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: vitalcare-tsdb-bench [--devices N] [--hours H] [--batch N] [--threads N] [--sync 0|1]\n"
+                  "                            [--dir DIR]\n");
+}
+
+int main(int argc, char **argv)
+{
+  int devices = 200;
+  double hours = 24;
+  int batch = 60;
+  int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  bool sync = false;
+  std::string dir;
+
+  for (int i = 1; i < argc; i += 2)
+  {
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const char *option = argv[i];
+    const char *value = argv[i + 1];
+    uint64_t number = 0;
+    bool ok;
+    if (strcmp(option, "--devices") == 0)
+    {
+      ok = tools::parseUnsigned(value, 1000000, number);
+      devices = (int)number;
+    }
+    else if (strcmp(option, "--hours") == 0)
+      ok = tools::parseNumber(value, 0, 24 * 365, hours);
+    else if (strcmp(option, "--batch") == 0)
+    {
+      ok = tools::parseUnsigned(value, UPLINK_MAX_RECORDS, number);
+      batch = (int)number;
+    }
+    else if (strcmp(option, "--threads") == 0)
+    {
+      ok = tools::parseUnsigned(value, 1024, number);
+      threads = (int)number;
+    }
+    else if (strcmp(option, "--sync") == 0)
+    {
+      ok = tools::parseUnsigned(value, 1, number);
+      sync = number != 0;
+    }
+    else if (strcmp(option, "--dir") == 0)
+    {
+      ok = value[0] != '\0' && value[0] != '-';
+      dir = value;
+    }
+    else
+      ok = false;
+    if (!ok)
+    {
+      usage();
+      return 2;
+    }
+  }
+  devices = std::max(1, devices);
+  threads = std::max(1, std::min(threads, devices));
+  batch = std::max(1, batch);
+  uint32_t rowsPerDevice = (uint32_t)(hours * 3600);
+
+  bool temporary = dir.empty();
+  if (temporary)
+  {
+    char pattern[] = "/tmp/vitalcare-tsdb-XXXXXX";
+    if (!mkdtemp(pattern))
+    {
+      perror("mkdtemp");
+      return 1;
+    }
+    dir = pattern;
+  }
+
+  StoreOptions options;
+  options.syncWal = sync;
+  printf("%d devices x %.1f h at 1 Hz = %llu rows, batches of %d, %d threads, wal sync %s, %s\n", devices, hours,
+         (unsigned long long)devices * rowsPerDevice, batch, threads, sync ? "on" : "off", dir.c_str());
+
+  // Ingest: each thread owns a slice of the fleet and uploads one batch
+  // per device in turn, as the gateway workers would see it
+  {
+    TimeSeriesStore store(dir, options);
+    if (!store.open())
+      return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+      workers.emplace_back([&, t]() {
+        std::vector<VitalsGenerator> generators;
+        for (int d = t; d < devices; d += threads)
+          generators.emplace_back(deviceIdFor(d));
+        std::vector<uint8_t> encoded(batch * VITAL_RECORD_SIZE);
+        for (uint32_t row = 0; row < rowsPerDevice; row += batch)
+        {
+          uint32_t count = std::min<uint32_t>(batch, rowsPerDevice - row);
+          for (size_t g = 0; g < generators.size(); g++)
+          {
+            for (uint32_t i = 0; i < count; i++)
+              encodeVitalRecord(generators[g].next(), encoded.data() + i * VITAL_RECORD_SIZE);
+            store.append(deviceIdFor(t + (int)g * threads), encoded.data(), count);
+          }
+        }
+      });
+    }
+    for (std::thread &worker : workers)
+      worker.join();
+    double ingestSeconds = seconds(start);
+
+    auto checkpointStart = std::chrono::steady_clock::now();
+    store.checkpoint();
+    double checkpointSeconds = seconds(checkpointStart);
+
+    StoreStats stats = store.statistics();
+    uint64_t rows = stats.sealedRows + stats.headRows;
+    printf("\ningest   %.2f s: %.2f M rows/s (includes encoding the input)\n", ingestSeconds,
+           rows / ingestSeconds / 1e6);
+    printf("wal      %llu entries in %llu commits (%.1f per group), %.1f MB, avg sync %.1f us\n",
+           (unsigned long long)stats.wal.entries, (unsigned long long)stats.wal.commits,
+           stats.wal.commits ? (double)stats.wal.entries / stats.wal.commits : 0.0, stats.wal.bytes / 1e6,
+           stats.wal.commits ? stats.wal.syncNs / 1e3 / stats.wal.commits : 0.0);
+    printf("checkpoint %.3f s, %llu chunks in %llu segments\n", checkpointSeconds, (unsigned long long)stats.chunks,
+           (unsigned long long)stats.segments);
+    printf("\nsize     %.2f bytes/sample (%.1fx smaller than %zu-byte VitalRecords), %.1f MB\n",
+           stats.bytesPerSample(), VITAL_RECORD_SIZE / stats.bytesPerSample(), VITAL_RECORD_SIZE,
+           (stats.sealedBytes + stats.headBytes) / 1e6);
+    static const char *NAMES[STORE_COLUMNS] = {"timestamp", "sequence",  "flags", "heartRate",
+                                               "systolic",  "diastolic", "spO2",  "temperature"};
+    for (size_t c = 0; c < STORE_COLUMNS; c++)
+      printf("  %-12s %6.2f bits/sample\n", NAMES[c], rows ? (double)stats.columnBits[c] / rows : 0.0);
+  }
+
+  // Reopen: segments are scanned back into the index
+  TimeSeriesStore store(dir, options);
+  auto openStart = std::chrono::steady_clock::now();
+  if (!store.open())
+    return 1;
+  printf("\nreopen   %.3f s\n", seconds(openStart));
+
+  // Full scans, one series per task, all threads
+  std::vector<uint64_t> ids = store.seriesIds();
+  std::atomic<uint64_t> scanned(0);
+  std::atomic<uint64_t> mismatches(0);
+  auto scanStart = std::chrono::steady_clock::now();
+  {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+      workers.emplace_back([&, t]() {
+        std::vector<VitalRecord> rows;
+        for (size_t s = t; s < ids.size(); s += threads)
+        {
+          rows.clear();
+          scanned += store.query(ids[s], 0, UINT32_MAX, rows);
+        }
+      });
+    }
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+  double scanSeconds = seconds(scanStart);
+  printf("scan     %llu rows in %.3f s: %.1f M rows/s\n", (unsigned long long)scanned.load(), scanSeconds,
+         scanned / scanSeconds / 1e6);
+
+  // Random 1-hour windows
+  const int QUERIES = 20000;
+  std::atomic<uint64_t> windowRows(0);
+  auto rangeStart = std::chrono::steady_clock::now();
+  {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+      workers.emplace_back([&, t]() {
+        std::mt19937 random(t);
+        std::vector<VitalRecord> rows;
+        for (int q = t; q < QUERIES; q += threads)
+        {
+          uint64_t id = ids[random() % ids.size()];
+          uint32_t from = 5000 + (uint32_t)(random() % std::max<uint32_t>(1, rowsPerDevice)) * 1000;
+          rows.clear();
+          windowRows += store.query(id, from, from + 3600 * 1000, rows);
+        }
+      });
+    }
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+  double rangeSeconds = seconds(rangeStart);
+  printf("range    %d 1-hour queries in %.3f s: %.0f queries/s, %.1f us each, %.0f rows avg\n", QUERIES,
+         rangeSeconds, QUERIES / rangeSeconds, rangeSeconds * 1e6 * threads / QUERIES,
+         (double)windowRows / QUERIES);
+
+  // Lossless: every row of a few devices must match the generator exactly
+  // (after the record's x10 fixed point)
+  for (int d = 0; d < std::min(devices, 8); d++)
+  {
+    std::vector<VitalRecord> rows;
+    store.query(deviceIdFor(d), 0, UINT32_MAX, rows);
+    VitalsGenerator generator(deviceIdFor(d));
+    if (rows.size() != rowsPerDevice)
+      mismatches++;
+    for (const VitalRecord &row : rows)
+    {
+      uint8_t expected[VITAL_RECORD_SIZE];
+      uint8_t actual[VITAL_RECORD_SIZE];
+      encodeVitalRecord(generator.next(), expected);
+      encodeVitalRecord(row, actual);
+      if (memcmp(expected, actual, VITAL_RECORD_SIZE) != 0)
+        mismatches++;
+    }
+  }
+  printf("check    %s\n", mismatches == 0 ? "all rows identical" : "MISMATCH");
+
+  store.close();
+  if (temporary)
+  {
+    std::string command = "rm -rf '" + dir + "'";
+    if (system(command.c_str()) != 0)
+      fprintf(stderr, "could not remove %s\n", dir.c_str());
+  }
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/*
+ * VitalCare Rural - Simulated BMP180
+ *
+ * Simulated I2C device with the BMP180 register map: chip id, the 22-byte
+ * calibration block and the control/result registers. A conversion takes
+ * its datasheet time on the bus clock; reading the result early returns
+ * the previous conversion and is counted, which catches drivers that do
+ * not wait long enough. Calibration is the datasheet's worked example;
+ * the default raw readings give 15.0 degC and about 1012 hPa.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <vitalcare/Bmp180.h>
+
+#include "SimulatedI2cBus.h"
+
+namespace vitalcare
+{
+namespace sim
+{
+
+class SimulatedBmp180 : public SimulatedI2cDevice
+{
+public:
+  SimulatedBmp180() : nowUs(0), conversionDoneUs(0), earlyReads(0), conversions(0)
+  {
+    memset(registers, 0, sizeof(registers));
+    registers[Bmp180::REG_CHIP_ID] = Bmp180::CHIP_ID;
+    static const int16_t CALIBRATION[11] = {408, -72, -14383, (int16_t)32741, (int16_t)32757, 23153,
+                                            6190, 4, -32768, -8711, 2868};
+    for (int i = 0; i < 11; i++)
+    {
+      registers[Bmp180::REG_CALIBRATION + i * 2] = (uint8_t)((uint16_t)CALIBRATION[i] >> 8);
+      registers[Bmp180::REG_CALIBRATION + i * 2 + 1] = (uint8_t)CALIBRATION[i];
+    }
+    setRaw(27898, 34293);
+  }
+
+  // Uncompensated readings for the next conversions; UP is given at
+  // oversampling 0 and scales by 2^oss like the real sensor
+  void setRaw(uint16_t ut, uint32_t up)
+  {
+    rawTemperature = ut;
+    rawPressure = up;
+  }
+
+  void disconnect(bool value) { absent = value; }
+
+  uint8_t address() const override { return Bmp180::ADDRESS; }
+
+  void advanceTo(uint64_t timeUs) override
+  {
+    nowUs = timeUs;
+    if ((registers[Bmp180::REG_CONTROL] & 0x20) && nowUs >= conversionDoneUs)
+    {
+      // Conversion finished: latch the result and clear SCO
+      registers[Bmp180::REG_CONTROL] &= (uint8_t)~0x20;
+      if (pendingCommand == Bmp180::CMD_TEMPERATURE)
+      {
+        registers[Bmp180::REG_RESULT] = (uint8_t)(rawTemperature >> 8);
+        registers[Bmp180::REG_RESULT + 1] = (uint8_t)rawTemperature;
+      }
+      else
+      {
+        uint8_t oss = (uint8_t)(pendingCommand >> 6);
+        uint32_t value = (rawPressure << oss) << (8 - oss);
+        registers[Bmp180::REG_RESULT] = (uint8_t)(value >> 16);
+        registers[Bmp180::REG_RESULT + 1] = (uint8_t)(value >> 8);
+        registers[Bmp180::REG_RESULT + 2] = (uint8_t)value;
+      }
+      conversions++;
+    }
+  }
+
+  I2cStatus transfer(const I2cTransaction &transaction) override
+  {
+    if (absent)
+    {
+      return I2C_NACK;
+    }
+    if (transaction.write)
+    {
+      for (uint16_t i = 0; i < transaction.length; i++)
+        registers[(uint8_t)(transaction.reg + i)] = transaction.data[i];
+      if (transaction.reg == Bmp180::REG_CONTROL && transaction.length > 0)
+        startConversion(transaction.data[0]);
+      return I2C_OK;
+    }
+
+    if (transaction.reg == Bmp180::REG_RESULT && (registers[Bmp180::REG_CONTROL] & 0x20))
+    {
+      earlyReads++;
+    }
+    for (uint16_t i = 0; i < transaction.length; i++)
+      transaction.data[i] = registers[(uint8_t)(transaction.reg + i)];
+    return I2C_OK;
+  }
+
+  uint32_t earlyReadCount() const { return earlyReads; }
+  uint32_t conversionCount() const { return conversions; }
+
+private:
+  void startConversion(uint8_t command)
+  {
+    static const uint32_t PRESSURE_US[] = {4500, 7500, 13500, 25500};
+    pendingCommand = command;
+    uint32_t duration = command == Bmp180::CMD_TEMPERATURE ? 4500 : PRESSURE_US[(command >> 6) & 0x03];
+    conversionDoneUs = nowUs + duration;
+    registers[Bmp180::REG_CONTROL] = (uint8_t)(command | 0x20);
+  }
+
+  uint8_t registers[256];
+  uint64_t nowUs;
+  uint64_t conversionDoneUs;
+  uint8_t pendingCommand = 0;
+  uint16_t rawTemperature = 0;
+  uint32_t rawPressure = 0;
+  bool absent = false;
+  uint32_t earlyReads;
+  uint32_t conversions;
+};
+
+} // namespace sim
+} // namespace vitalcare
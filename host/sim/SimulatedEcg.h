@@ -0,0 +1,236 @@
+/*
+ * VitalCare Rural - Simulated AD8232 ECG
+ *
+ * Synthetic single-lead ECG as the AD8232 delivers it to a 12-bit ADC:
+ * PQRST beats on a wandering baseline with sensor noise, scripted rhythm
+ * episodes (heart rate, pauses), noise bursts and leads-off stretches.
+ * Beats are stamped from precomputed PQRS and T templates, the T wave
+ * placed after the R peak by Bazett's QT scaling, so a day at 500 Hz takes
+ * seconds to generate. The generator counts the beats it placed, giving
+ * analyzers a ground truth to check against.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <vitalcare/EcgRecording.h>
+
+namespace vitalcare
+{
+namespace sim
+{
+
+struct EcgEpisode
+{
+  enum Kind
+  {
+    RATE,       // Rhythm at value BPM
+    PAUSE,      // One RR interval stretched to value ms
+    NOISE,      // Noise standard deviation raised to value ADC counts
+    LEADS_OFF,  // Leads off: ECG_LEADS_OFF samples
+  };
+  Kind kind;
+  double startSeconds;
+  double durationSeconds;
+  float value;
+};
+
+class SimulatedEcg
+{
+public:
+  static const int32_t BASELINE = 1700;
+  static const int32_t R_AMPLITUDE = 900; // Peak ~2600 against the 2000 firmware threshold
+
+  SimulatedEcg(uint16_t sampleRateHz = 500, float heartRateBpm = 72.0f, uint32_t seed = 1)
+      : rate(sampleRateHz), restingBpm(heartRateBpm), random(seed), gaussian(0.0f, 1.0f),
+        nextBeat(0), beats(0), maskedBeats(0), generated(0)
+  {
+    buildTemplate();
+    nextBeat = (uint64_t)(0.3 * rate);
+  }
+
+  void addEpisode(const EcgEpisode &episode) { episodes.push_back(episode); }
+
+  // Writes the next count samples.
+  void generate(int16_t *out, size_t count)
+  {
+    uint64_t first = generated;
+    uint64_t end = first + count;
+    std::vector<int32_t> signal(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+      double t = (double)(first + i) / rate;
+      // Respiration-like baseline wander: 0.25 Hz, +-40 counts
+      double wander = 40.0 * std::sin(2.0 * M_PI * 0.25 * t);
+      signal[i] = BASELINE + (int32_t)wander + (int32_t)std::lround(gaussian(random) * noiseAt(t));
+    }
+
+    // Beats whose template overlaps this block, including ones placed last block
+    while (nextBeat < end + templateBefore)
+    {
+      uint64_t interval = nextInterval((double)nextBeat / rate);
+      // QT shortens with the rate: T peak at 260 ms for RR 833 ms
+      size_t tOffset = (size_t)(0.26 * rate * std::sqrt((double)interval / rate / 0.833));
+      placedBeats.push_back({nextBeat, tOffset});
+      nextBeat += interval;
+    }
+    for (const PlacedBeat &placed : placedBeats)
+    {
+      uint64_t beat = placed.sample;
+      if (beat >= first && beat < end)
+      {
+        double t = (double)beat / rate;
+        beats++;
+        if (leadsOffAt(t) || episodeAt(t, EcgEpisode::NOISE))
+          maskedBeats++;
+      }
+      int64_t from = (int64_t)beat - (int64_t)templateBefore;
+      for (size_t k = 0; k < shape.size(); k++)
+      {
+        int64_t index = from + (int64_t)k - (int64_t)first;
+        if (index >= 0 && index < (int64_t)count)
+          signal[index] += shape[k];
+      }
+      from = (int64_t)(beat + placed.tOffset) - (int64_t)(tShape.size() / 2);
+      for (size_t k = 0; k < tShape.size(); k++)
+      {
+        int64_t index = from + (int64_t)k - (int64_t)first;
+        if (index >= 0 && index < (int64_t)count)
+          signal[index] += tShape[k];
+      }
+    }
+    while (!placedBeats.empty() && placedBeats.front().sample + templateAfter <= end)
+    {
+      placedBeats.erase(placedBeats.begin());
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      double t = (double)(first + i) / rate;
+      int32_t value = signal[i] < 0 ? 0 : (signal[i] > 4095 ? 4095 : signal[i]);
+      out[i] = leadsOffAt(t) ? ECG_LEADS_OFF : (int16_t)value;
+    }
+    generated = end;
+  }
+
+  // Beats whose R peak lies in the samples generated so far
+  uint64_t beatCount() const { return beats; }
+  // Of those, beats hidden by leads-off or a noise burst
+  uint64_t maskedBeatCount() const { return maskedBeats; }
+
+private:
+  struct PlacedBeat
+  {
+    uint64_t sample; // R peak
+    size_t tOffset;  // T peak after the R peak (samples)
+  };
+
+  // Gaussian PQRS waves relative to the R peak, and a T wave centred on its peak
+  void buildTemplate()
+  {
+    struct Wave
+    {
+      float amplitude;
+      float centreMs;
+      float widthMs;
+    };
+    static const Wave WAVES[] = {
+        {90, -180, 25},          // P
+        {-70, -28, 8},           // Q
+        {R_AMPLITUDE, 0, 9},     // R
+        {-160, 26, 10},          // S
+    };
+    const float T_AMPLITUDE = 230;
+    const float T_WIDTH_MS = 45;
+    templateBefore = (size_t)(0.3 * rate);
+    templateAfter = (size_t)(0.45 * rate);
+    shape.assign(templateBefore + templateAfter, 0);
+    for (size_t k = 0; k < shape.size(); k++)
+    {
+      float ms = ((float)k - (float)templateBefore) * 1000.0f / rate;
+      float sum = 0;
+      for (const Wave &wave : WAVES)
+      {
+        float z = (ms - wave.centreMs) / wave.widthMs;
+        sum += wave.amplitude * std::exp(-0.5f * z * z);
+      }
+      shape[k] = (int32_t)std::lround(sum);
+    }
+
+    size_t half = (size_t)(0.15 * rate);
+    tShape.assign(2 * half + 1, 0);
+    for (size_t k = 0; k < tShape.size(); k++)
+    {
+      float z = ((float)k - (float)half) * 1000.0f / rate / T_WIDTH_MS;
+      tShape[k] = (int32_t)std::lround(T_AMPLITUDE * std::exp(-0.5f * z * z));
+    }
+  }
+
+  const EcgEpisode *episodeAt(double t, EcgEpisode::Kind kind) const
+  {
+    for (const EcgEpisode &episode : episodes)
+    {
+      if (episode.kind == kind && t >= episode.startSeconds && t < episode.startSeconds + episode.durationSeconds)
+        return &episode;
+    }
+    return nullptr;
+  }
+
+  float noiseAt(double t) const
+  {
+    const EcgEpisode *noise = episodeAt(t, EcgEpisode::NOISE);
+    return noise ? noise->value : 12.0f;
+  }
+
+  bool leadsOffAt(double t) const { return episodeAt(t, EcgEpisode::LEADS_OFF) != nullptr; }
+
+  // RR interval in samples: respiratory sinus arrhythmia plus beat jitter
+  uint64_t nextInterval(double t)
+  {
+    const EcgEpisode *pause = episodeAt(t, EcgEpisode::PAUSE);
+    if (pause && !pauseTaken(pause))
+    {
+      takenPauses.push_back(pause);
+      return (uint64_t)(pause->value * rate / 1000.0f);
+    }
+    const EcgEpisode *episode = episodeAt(t, EcgEpisode::RATE);
+    double bpm = episode ? episode->value : restingBpm;
+    double rr = 60.0 / bpm;
+    rr *= 1.0 + 0.04 * std::sin(2.0 * M_PI * 0.25 * t) + 0.01 * gaussian(random);
+    return (uint64_t)(rr * rate);
+  }
+
+  bool pauseTaken(const EcgEpisode *pause) const
+  {
+    for (const EcgEpisode *taken : takenPauses)
+    {
+      if (taken == pause)
+        return true;
+    }
+    return false;
+  }
+
+  uint16_t rate;
+  float restingBpm;
+  std::mt19937 random;
+  std::normal_distribution<float> gaussian;
+  std::vector<EcgEpisode> episodes;
+  std::vector<const EcgEpisode *> takenPauses;
+  std::vector<int32_t> shape;
+  std::vector<int32_t> tShape;
+  size_t templateBefore;
+  size_t templateAfter;
+  std::vector<PlacedBeat> placedBeats;
+  uint64_t nextBeat;
+  uint64_t beats;
+  uint64_t maskedBeats;
+  uint64_t generated;
+};
+
+} // namespace sim
+} // namespace vitalcare
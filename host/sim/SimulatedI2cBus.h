@@ -0,0 +1,140 @@
+/*
+ * VitalCare Rural - Simulated Shared I2C Bus
+ *
+ * Host-side asynchronous I2cBus built on the same I2cScheduler as the
+ * ESP32 TaskI2cBus: priorities, queue limits and instrumentation behave
+ * identically. Transfers take their 400 kHz wire time on a virtual clock,
+ * and completions are dispatched as they finish, so several simulated
+ * devices can share the bus and contend for it like the real ones.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vitalcare/I2cBus.h>
+#include <vitalcare/I2cScheduler.h>
+
+namespace vitalcare
+{
+namespace sim
+{
+
+class SimulatedI2cDevice
+{
+public:
+  virtual ~SimulatedI2cDevice() {}
+
+  virtual uint8_t address() const = 0;
+  // Performs a register transfer; called when the job reaches the bus.
+  virtual I2cStatus transfer(const I2cTransaction &transaction) = 0;
+  // Brings the device's own clock (conversions, FIFO filling) up to date.
+  virtual void advanceTo(uint64_t nowUs) { (void)nowUs; }
+};
+
+class SimulatedI2cBus : public I2cBus
+{
+public:
+  static const uint8_t MAX_DEVICES = 8;
+
+  explicit SimulatedI2cBus(uint32_t clockHz = 400000) : clockHz(clockHz), deviceCount(0), nowUs(0), busyUntilUs(0)
+  {
+  }
+
+  bool attach(SimulatedI2cDevice &device)
+  {
+    if (deviceCount >= MAX_DEVICES)
+      return false;
+    devices[deviceCount++] = &device;
+    device.advanceTo(nowUs);
+    return true;
+  }
+
+  bool submit(const I2cTransaction &transaction) override
+  {
+    return scheduler.enqueue(transaction, (uint32_t)nowUs);
+  }
+
+  // Runs the bus for the given time: jobs execute back to back in priority
+  // order and their callbacks run as each one finishes.
+  void advance(uint32_t microseconds)
+  {
+    uint64_t target = nowUs + microseconds;
+    while (true)
+    {
+      uint64_t start = busyUntilUs > nowUs ? busyUntilUs : nowUs;
+      if (!scheduler.pending() || start >= target)
+        break;
+
+      I2cJob job;
+      scheduler.next(job);
+      uint64_t end = start + wireTimeUs(job.transaction);
+      advanceDevices(start);
+      I2cStatus status = execute(job.transaction);
+      scheduler.finish(job, status, (uint32_t)start, (uint32_t)end);
+      busyUntilUs = end;
+      nowUs = end < target ? end : target;
+      dispatch();
+    }
+    nowUs = target;
+    advanceDevices(nowUs);
+    dispatch();
+  }
+
+  // Completes everything queued (including work the callbacks submit)
+  void drain()
+  {
+    while (scheduler.pending())
+      advance(1000);
+  }
+
+  // Wire time: address + register (+ repeated-start address for reads) +
+  // data, 9 clocks per byte, plus start/stop
+  uint32_t wireTimeUs(const I2cTransaction &transaction) const
+  {
+    uint32_t bytes = 2 + (transaction.write ? 0 : 1) + transaction.length;
+    return (uint32_t)(((uint64_t)bytes * 9 + 2) * 1000000 / clockHz);
+  }
+
+  uint64_t now() const { return nowUs; }
+  const I2cBusStats &statistics() const { return scheduler.statistics(); }
+  uint16_t utilizationPermille() { return scheduler.utilizationPermille((uint32_t)nowUs); }
+
+private:
+  I2cStatus execute(const I2cTransaction &transaction)
+  {
+    for (uint8_t i = 0; i < deviceCount; i++)
+    {
+      if (devices[i]->address() == transaction.address)
+        return devices[i]->transfer(transaction);
+    }
+    return I2C_NACK;
+  }
+
+  void advanceDevices(uint64_t timeUs)
+  {
+    for (uint8_t i = 0; i < deviceCount; i++)
+      devices[i]->advanceTo(timeUs);
+  }
+
+  void dispatch()
+  {
+    I2cJob job;
+    while (scheduler.takeCompletion(job))
+    {
+      if (job.transaction.callback)
+        job.transaction.callback(job.transaction.context, job.transaction, job.status);
+    }
+  }
+
+  uint32_t clockHz;
+  SimulatedI2cDevice *devices[MAX_DEVICES];
+  uint8_t deviceCount;
+  I2cScheduler scheduler;
+  uint64_t nowUs;
+  uint64_t busyUntilUs;
+};
+
+} // namespace sim
+} // namespace vitalcare
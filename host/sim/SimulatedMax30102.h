@@ -0,0 +1,183 @@
+/*
+ * VitalCare Rural - Simulated MAX30102
+ *
+ * Simulated I2C device that behaves like a MAX30102: register file,
+ * 32-sample FIFO with write/read pointers, overflow counter and rollover.
+ * The FIFO is filled from a synthetic red/IR PPG whose red/IR modulation
+ * ratio is chosen to give a known SpO2, so the driver and estimator can be
+ * exercised end to end without hardware. Attach it to a SimulatedI2cBus.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <vitalcare/I2cBus.h>
+#include <vitalcare/Max3010x.h>
+
+#include "SimulatedI2cBus.h"
+
+namespace vitalcare
+{
+namespace sim
+{
+
+class SimulatedMax30102 : public SimulatedI2cDevice
+{
+public:
+  SimulatedMax30102(float spo2Percent = 97.0f, float heartRateBpm = 72.0f, uint16_t sampleRateHz = 100)
+      : sampleRate(sampleRateHz), heartRate(heartRateBpm), sampleClockUs(0), phase(0), noiseState(12345)
+  {
+    memset(registers, 0, sizeof(registers));
+    memset(fifo, 0, sizeof(fifo));
+    registers[Max3010x::REG_PART_ID] = Max3010x::PART_ID;
+    setSpO2(spo2Percent);
+  }
+
+  // Target saturation; sets the red modulation through R = (110 - SpO2) / 25
+  void setSpO2(float percent)
+  {
+    spo2 = percent;
+    ratio = (110.0f - percent) / 25.0f;
+  }
+
+  void setHeartRate(float bpm) { heartRate = bpm; }
+  void setNoise(uint32_t amplitude) { noiseAmplitude = amplitude; }
+  void disconnect(bool value) { absent = value; }
+
+  uint8_t address() const override { return Max3010x::ADDRESS; }
+
+  // Produces samples into the FIFO up to the given time while the sensor
+  // is in SpO2 mode.
+  void advanceTo(uint64_t nowUs) override
+  {
+    uint32_t period = 1000000u / sampleRate;
+    while (nowUs - sampleClockUs >= period)
+    {
+      sampleClockUs += period;
+      if ((registers[Max3010x::REG_MODE_CONFIG] & 0x07) == 0x03)
+      {
+        produceSample();
+      }
+    }
+  }
+
+  I2cStatus transfer(const I2cTransaction &transaction) override
+  {
+    if (absent)
+    {
+      return I2C_NACK;
+    }
+    uint8_t reg = transaction.reg;
+    for (uint16_t i = 0; i < transaction.length; i++)
+    {
+      if (transaction.write)
+      {
+        registers[reg] = transaction.data[i];
+        if (reg == Max3010x::REG_FIFO_WR_PTR || reg == Max3010x::REG_FIFO_RD_PTR)
+        {
+          fifoCount = (registers[Max3010x::REG_FIFO_WR_PTR] - registers[Max3010x::REG_FIFO_RD_PTR]) & 0x1F;
+          fifoByte = 0;
+        }
+      }
+      else if (reg == Max3010x::REG_FIFO_DATA)
+      {
+        transaction.data[i] = readFifoByte();
+        continue; // FIFO_DATA does not auto-increment
+      }
+      else
+      {
+        transaction.data[i] = registers[reg];
+      }
+      reg++;
+    }
+    return I2C_OK;
+  }
+
+  float trueSpO2() const { return spo2; }
+  uint8_t fifoLevel() const { return fifoCount; }
+
+private:
+  uint8_t readFifoByte()
+  {
+    uint8_t &readPointer = registers[Max3010x::REG_FIFO_RD_PTR];
+    uint8_t value = fifo[readPointer][fifoByte];
+    if (++fifoByte == Max3010x::BYTES_PER_SAMPLE)
+    {
+      // Popping a complete sample advances RD_PTR and clears OVF_COUNTER
+      fifoByte = 0;
+      if (fifoCount > 0)
+      {
+        readPointer = (readPointer + 1) & 0x1F;
+        fifoCount--;
+        registers[Max3010x::REG_OVF_COUNTER] = 0;
+      }
+    }
+    return value;
+  }
+
+  void produceSample()
+  {
+    // Pulse shape: fast systolic upstroke, exponential diastolic run-off
+    phase += heartRate / 60.0f / sampleRate;
+    if (phase >= 1.0f)
+      phase -= 1.0f;
+    float pulse = phase < 0.12f ? phase / 0.12f : expf(-(phase - 0.12f) * 4.0f);
+
+    // Blood absorbs: detected light falls as volume rises
+    const float irDc = 120000.0f, redDc = 90000.0f, irModulation = 0.02f;
+    float redModulation = irModulation * ratio;
+    uint32_t ir = (uint32_t)(irDc * (1.0f - irModulation * pulse)) + noise();
+    uint32_t red = (uint32_t)(redDc * (1.0f - redModulation * pulse)) + noise();
+
+    uint8_t &writePointer = registers[Max3010x::REG_FIFO_WR_PTR];
+    uint8_t *slot = fifo[writePointer];
+    slot[0] = (uint8_t)(red >> 16) & 0x03;
+    slot[1] = (uint8_t)(red >> 8);
+    slot[2] = (uint8_t)red;
+    slot[3] = (uint8_t)(ir >> 16) & 0x03;
+    slot[4] = (uint8_t)(ir >> 8);
+    slot[5] = (uint8_t)ir;
+
+    if (fifoCount == Max3010x::FIFO_DEPTH)
+    {
+      // Full: with rollover the oldest unread sample is overwritten
+      if (registers[Max3010x::REG_OVF_COUNTER] < 0x1F)
+        registers[Max3010x::REG_OVF_COUNTER]++;
+      registers[Max3010x::REG_FIFO_RD_PTR] = (registers[Max3010x::REG_FIFO_RD_PTR] + 1) & 0x1F;
+    }
+    else
+    {
+      fifoCount++;
+    }
+    writePointer = (writePointer + 1) & 0x1F;
+  }
+
+  uint32_t noise()
+  {
+    if (noiseAmplitude == 0)
+      return 0;
+    noiseState = noiseState * 1664525u + 1013904223u;
+    return (noiseState >> 8) % noiseAmplitude;
+  }
+
+  uint8_t registers[256];
+  uint8_t fifo[Max3010x::FIFO_DEPTH][Max3010x::BYTES_PER_SAMPLE];
+  uint8_t fifoByte = 0;
+  uint8_t fifoCount = 0;
+
+  uint16_t sampleRate;
+  float heartRate;
+  float spo2 = 0;
+  float ratio = 0;
+  uint64_t sampleClockUs;
+  float phase;
+  uint32_t noiseAmplitude = 40;
+  uint32_t noiseState;
+  bool absent = false;
+};
+
+} // namespace sim
+} // namespace vitalcare
@@ -0,0 +1,82 @@
+/*
+ * VitalCare Rural - Host Test Harness
+ *
+ * Minimal unit test harness with no dependencies, in the style of the
+ * benchmark harness:
+ *
+ *   VITALCARE_TEST(RingBuffer, OverwritesOldest)
+ *   {
+ *     ...
+ *     CHECK(buffer.full());
+ *     CHECK_EQ(buffer.oldest(), 2);
+ *   }
+ *
+ * A failed check reports its file and line and the test goes on, so one
+ * run shows every broken expectation. The runner takes a suite name and
+ * runs only that suite; ctest registers one test per suite.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace vitalcare
+{
+namespace test
+{
+
+typedef void (*TestFunction)();
+
+struct Registration
+{
+  const char *suite;
+  const char *name;
+  TestFunction function;
+};
+
+inline std::vector<Registration> &registry()
+{
+  static std::vector<Registration> entries;
+  return entries;
+}
+
+inline unsigned &failures()
+{
+  static unsigned count = 0;
+  return count;
+}
+
+struct Registrar
+{
+  Registrar(const char *suite, const char *name, TestFunction function)
+  {
+    registry().push_back({suite, name, function});
+  }
+};
+
+inline void fail(const char *file, int line, const char *expression)
+{
+  std::printf("  ❌ %s:%d: %s\n", file, line, expression);
+  failures()++;
+}
+
+} // namespace test
+} // namespace vitalcare
+
+#define VITALCARE_TEST(suite, name)                                                              \
+  static void test_##suite##_##name();                                                           \
+  static ::vitalcare::test::Registrar registrar_##suite##_##name(#suite, #name, test_##suite##_##name); \
+  static void test_##suite##_##name()
+
+#define CHECK(condition)                                           \
+  do                                                               \
+  {                                                                \
+    if (!(condition))                                              \
+      ::vitalcare::test::fail(__FILE__, __LINE__, #condition);     \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) CHECK((actual) == (expected))
+
+#define CHECK_NEAR(actual, expected, tolerance) CHECK(std::fabs((double)(actual) - (double)(expected)) <= (tolerance))
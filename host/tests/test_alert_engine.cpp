@@ -0,0 +1,185 @@
+/*
+ * VitalCare Rural - Gateway alert engine tests
+ */
+
+#include <random>
+#include <vector>
+
+#include "Test.h"
+
+#include "AlertEngine.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+// One device's records, heart rate given per record, the rest steady
+struct Stream
+{
+  std::vector<uint8_t> bytes;
+  uint32_t sequence = 0;
+
+  void add(uint32_t timestampMs, float heartRate, float spO2 = 97.0f, float temperature = 98.6f)
+  {
+    VitalRecord record = {};
+    record.sequence = ++sequence;
+    record.vitals = {heartRate, 120.0f, 80.0f, spO2, temperature, timestampMs};
+    bytes.resize(bytes.size() + VITAL_RECORD_SIZE);
+    encodeVitalRecord(record, bytes.data() + bytes.size() - VITAL_RECORD_SIZE);
+  }
+
+  size_t count() const { return bytes.size() / VITAL_RECORD_SIZE; }
+};
+
+// Evaluates in uplink-sized batches; returns the trend raises of one rule
+static uint64_t raises(AlertEngine &engine, uint64_t deviceId, const Stream &stream, size_t rule = 0,
+                       std::vector<AlertResult> *all = nullptr)
+{
+  std::vector<AlertResult> results(stream.count());
+  for (size_t first = 0; first < stream.count(); first += 30)
+  {
+    size_t count = std::min<size_t>(30, stream.count() - first);
+    engine.evaluate(deviceId, stream.bytes.data() + first * VITAL_RECORD_SIZE, count, results.data() + first);
+  }
+  uint64_t raised = 0;
+  for (const AlertResult &result : results)
+    raised += (result.trendRaised >> rule) & 1;
+  if (all)
+    *all = results;
+  return raised;
+}
+
+VITALCARE_TEST(AlertEngine, OneHertzNoiseRaisesNoTrends)
+{
+  // What vitalcare-fleet sends: 1 Hz readings with white noise around steady vitals
+  AlertEngine engine(EMERGENCY_THRESHOLDS, DEFAULT_TREND_RULES, DEFAULT_TREND_RULE_COUNT, AlertEngine::KERNELS_SCALAR);
+  std::mt19937 random(7);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  for (uint64_t device = 1; device <= 20; device++)
+  {
+    Stream stream;
+    for (uint32_t s = 0; s < 3600; s++)
+      stream.add(1000 * s, 72.0f + 4.0f * noise(random), 97.0f + 0.5f * noise(random),
+                 98.6f + 0.2f * noise(random));
+    raises(engine, device, stream);
+  }
+  CHECK_EQ(engine.statistics().records.load(), 72000u);
+  CHECK_EQ(engine.statistics().trendRaised.load(), 0u);
+}
+
+VITALCARE_TEST(AlertEngine, OneHertzRampRaisesOnce)
+{
+  AlertEngine engine;
+  std::mt19937 random(3);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  Stream stream;
+  // Steady for 5 min, then +20 BPM a minute for 3 min, then steady again
+  for (uint32_t s = 0; s < 900; s++)
+  {
+    float rate = 70.0f + (s < 300 ? 0 : s < 480 ? (s - 300) / 3.0f : 60.0f);
+    stream.add(1000 * s, rate + 2.0f * noise(random));
+  }
+  std::vector<AlertResult> results;
+  CHECK_EQ(raises(engine, 1, stream, 0, &results), 1u);
+  size_t first = 0;
+  while (first < results.size() && !(results[first].trendRaised & 1))
+    first++;
+  // Within two windows of the ramp starting, and never before it
+  CHECK(first > 300 && first < 300 + 160);
+  CHECK_EQ(results.back().trend, 0);
+}
+
+VITALCARE_TEST(AlertEngine, RollupsAndRawRecordsAgree)
+{
+  // The same ramp as 10 s rollups and as 1 Hz records raises at the same period
+  AlertEngine rollupEngine, rawEngine;
+  Stream rollups, raw;
+  for (uint32_t s = 0; s < 600; s++)
+  {
+    float rate = 70.0f + (s < 200 ? 0 : (s - 200) / 3.0f);
+    if (s % 10 == 0)
+      rollups.add(1000 * s, 70.0f + (s < 200 ? 0 : (s + 4.5f - 200) / 3.0f));
+    raw.add(1000 * s, rate);
+  }
+  std::vector<AlertResult> rollupResults, rawResults;
+  CHECK_EQ(raises(rollupEngine, 1, rollups, 0, &rollupResults), 1u);
+  CHECK_EQ(raises(rawEngine, 1, raw, 0, &rawResults), 1u);
+  size_t rollupAt = 0, rawAt = 0;
+  while (!(rollupResults[rollupAt].trendRaised & 1))
+    rollupAt++;
+  while (!(rawResults[rawAt].trendRaised & 1))
+    rawAt++;
+  CHECK_EQ(rawAt, rollupAt * 10);
+}
+
+VITALCARE_TEST(AlertEngine, HoldOffLimitsRaises)
+{
+  // A rate stepping up and back every 2 min trends on each rise
+  AlertEngine engine;
+  Stream stream;
+  for (uint32_t s = 0; s < 1800; s++)
+  {
+    uint32_t phase = s % 240;
+    float rate = phase < 60 ? 70.0f + phase / 2.0f : phase < 120 ? 100.0f - (phase - 60) / 2.0f : 70.0f;
+    stream.add(1000 * s, rate);
+  }
+  // 30 min: a rise every 4 min, raised at most once per 5 min
+  uint64_t raised = raises(engine, 1, stream);
+  CHECK(raised >= 4 && raised <= 6);
+
+  AlertEngine noHoldOff(EMERGENCY_THRESHOLDS, DEFAULT_TREND_RULES, DEFAULT_TREND_RULE_COUNT,
+                        AlertEngine::KERNELS_AUTO, TREND_PERIOD_MS, 0);
+  CHECK(raises(noHoldOff, 1, stream) > raised);
+}
+
+VITALCARE_TEST(AlertEngine, ClockGoingBackIsNotATrend)
+{
+  AlertEngine engine;
+  Stream stream;
+  for (uint32_t s = 0; s < 300; s++)
+    stream.add(5000000 + 1000 * s, 60.0f);
+  // Reboot: millis() starts over, the rate is now higher but steady
+  for (uint32_t s = 0; s < 300; s++)
+    stream.add(1000 * s, 95.0f);
+  CHECK_EQ(raises(engine, 1, stream), 0u);
+  CHECK_EQ(engine.statistics().trendRaised.load(), 0u);
+}
+
+VITALCARE_TEST(AlertEngine, OutOfSequenceRecordsSkipTrends)
+{
+  AlertEngine engine;
+  Stream stream;
+  for (uint32_t s = 0; s < 300; s++)
+    stream.add(1000 * s, 70.0f + (s < 100 ? 0 : (s - 100) / 2.0f));
+  std::vector<AlertResult> results;
+  raises(engine, 1, stream, 0, &results);
+  CHECK(results.back().trend & 1);
+
+  // An SD replay of the first minute: thresholds only
+  std::vector<AlertResult> replayed(60);
+  engine.evaluate(1, stream.bytes.data(), 60, replayed.data());
+  for (const AlertResult &result : replayed)
+    CHECK(result.trend == 0 && result.trendRaised == 0);
+}
+
+VITALCARE_TEST(AlertEngine, ThresholdsMatchEvaluateAlerts)
+{
+  // Missing SpO2 among low and normal readings, through both kernel sets
+  Stream stream;
+  const float spO2s[] = {97.0f, 0.0f, 85.0f, 0.0f, 89.9f, 90.0f, 1e-3f, 0.0f, 99.0f, 0.0f, 80.0f};
+  for (uint32_t i = 0; i < 40; i++)
+    stream.add(1000 * i, i % 7 == 0 ? 130.0f : 72.0f, spO2s[i % 11]);
+  for (AlertEngine::KernelChoice choice : {AlertEngine::KERNELS_SCALAR, AlertEngine::KERNELS_AUTO})
+  {
+    AlertEngine engine(EMERGENCY_THRESHOLDS, DEFAULT_TREND_RULES, DEFAULT_TREND_RULE_COUNT, choice);
+    std::vector<AlertResult> results(stream.count());
+    engine.evaluate(1, stream.bytes.data(), stream.count(), results.data());
+    for (size_t i = 0; i < stream.count(); i++)
+    {
+      VitalRecord record = {};
+      decodeVitalRecord(stream.bytes.data() + i * VITAL_RECORD_SIZE, record);
+      CHECK_EQ(results[i].threshold, evaluateAlerts(record.vitals, EMERGENCY_THRESHOLDS));
+    }
+    CHECK_EQ(results[1].threshold, ALERT_SPO2_NO_READING);
+    CHECK_EQ(results[2].threshold, ALERT_SPO2);
+  }
+}
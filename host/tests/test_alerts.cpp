@@ -0,0 +1,106 @@
+/*
+ * VitalCare Rural - Alert evaluation tests
+ */
+
+#include <cstring>
+
+#include "Test.h"
+
+#include "vitalcare/Alerts.h"
+
+using namespace vitalcare;
+
+static VitalSample normalVitals()
+{
+  return {72.0f, 120.0f, 80.0f, 98.0f, 98.6f, 1000};
+}
+
+VITALCARE_TEST(Alerts, NormalVitalsRaiseNothing)
+{
+  VitalSample vitals = normalVitals();
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_NONE);
+  CHECK_EQ(evaluateAlerts(vitals, EMERGENCY_THRESHOLDS), ALERT_NONE);
+  CHECK_EQ(evaluateAlerts(vitals, NORMAL_RANGE_THRESHOLDS), ALERT_NONE);
+}
+
+VITALCARE_TEST(Alerts, EachVitalSetsItsFlag)
+{
+  VitalSample vitals = normalVitals();
+  vitals.heartRate = 130;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_HEART_RATE);
+  vitals = normalVitals();
+  vitals.systolicBP = 170;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_BLOOD_PRESSURE);
+  vitals = normalVitals();
+  vitals.spO2 = 85;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_SPO2);
+  vitals = normalVitals();
+  vitals.temperature = 103;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_TEMPERATURE);
+  vitals.heartRate = 40;
+  vitals.spO2 = 80;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_HEART_RATE | ALERT_SPO2 | ALERT_TEMPERATURE);
+}
+
+VITALCARE_TEST(Alerts, LimitsAreInclusive)
+{
+  VitalSample vitals = normalVitals();
+  vitals.heartRate = BEDSIDE_THRESHOLDS.heartRateMax;
+  vitals.systolicBP = BEDSIDE_THRESHOLDS.systolicMin;
+  vitals.spO2 = BEDSIDE_THRESHOLDS.spO2Min;
+  vitals.temperature = BEDSIDE_THRESHOLDS.temperatureMax;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_NONE);
+}
+
+VITALCARE_TEST(Alerts, MissingSpO2IsNotDesaturation)
+{
+  VitalSample vitals = normalVitals();
+  vitals.spO2 = 0;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_SPO2_NO_READING);
+  CHECK_EQ(evaluateAlerts(vitals, EMERGENCY_THRESHOLDS), ALERT_SPO2_NO_READING);
+  vitals.heartRate = 0; // No finger: no pulse either
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_HEART_RATE | ALERT_SPO2_NO_READING);
+
+  char message[128];
+  formatAlertMessage(ALERT_SPO2_NO_READING, vitals, message, sizeof(message));
+  CHECK_EQ(std::strcmp(message, "SpO2: no reading, check the sensor. "), 0);
+}
+
+VITALCARE_TEST(Alerts, TablesDiffer)
+{
+  // 92 mmHg is fine at the bedside but outside the dashboard's normal range
+  VitalSample vitals = normalVitals();
+  vitals.systolicBP = 85;
+  CHECK_EQ(evaluateAlerts(vitals, BEDSIDE_THRESHOLDS), ALERT_NONE);
+  CHECK_EQ(evaluateAlerts(vitals, EMERGENCY_THRESHOLDS), ALERT_BLOOD_PRESSURE);
+}
+
+VITALCARE_TEST(Alerts, MessageListsFlaggedVitals)
+{
+  VitalSample vitals = normalVitals();
+  vitals.heartRate = 130;
+  vitals.spO2 = 85;
+  char message[128];
+  size_t length = formatAlertMessage(ALERT_HEART_RATE | ALERT_SPO2, vitals, message, sizeof(message));
+  CHECK_EQ(std::strcmp(message, "Heart Rate: 130.00 BPM. SpO2: 85.00%. "), 0);
+  CHECK_EQ(length, std::strlen(message));
+
+  vitals.systolicBP = 170;
+  length = formatAlertMessage(ALERT_BLOOD_PRESSURE, vitals, message, sizeof(message));
+  CHECK_EQ(std::strcmp(message, "Blood Pressure: 170.00/80.00 mmHg. "), 0);
+  CHECK_EQ(formatAlertMessage(ALERT_NONE, vitals, message, sizeof(message)), 0u);
+  CHECK_EQ(message[0], '\0');
+}
+
+VITALCARE_TEST(Alerts, MessageTruncatesToCapacity)
+{
+  VitalSample vitals = normalVitals();
+  char message[64];
+  std::memset(message, 'x', sizeof(message));
+  // Not a constant, or the compiler warns about the truncation under test
+  volatile size_t capacity = 16;
+  size_t length = formatAlertMessage(ALERT_HEART_RATE | ALERT_TEMPERATURE, vitals, message, capacity);
+  CHECK_EQ(length, capacity - 1);
+  CHECK_EQ(std::strlen(message), capacity - 1);
+  CHECK_EQ(formatAlertMessage(ALERT_HEART_RATE, vitals, message, 0), 0u);
+}
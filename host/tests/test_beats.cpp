@@ -0,0 +1,172 @@
+/*
+ * VitalCare Rural - Beat detection and heart rate fusion tests
+ */
+
+#include "Test.h"
+
+#include "vitalcare/BeatDetector.h"
+#include "vitalcare/HeartRateFusion.h"
+
+using namespace vitalcare;
+
+// A square pulse of width widthMs every periodMs, sampled at 1 kHz
+static uint32_t countBeats(ThresholdBeatDetector &detector, uint32_t periodMs, uint32_t widthMs, uint32_t durationMs)
+{
+  uint32_t beats = 0;
+  for (uint32_t t = 0; t < durationMs; t++)
+    beats += detector.update(t % periodMs < widthMs ? 1000 : 0, t) ? 1 : 0;
+  return beats;
+}
+
+VITALCARE_TEST(BeatDetector, CountsCleanBeats)
+{
+  ThresholdBeatDetector detector(500);
+  // 75 BPM for 8 s: beats at 0, 800, ..., 7200
+  CHECK_EQ(countBeats(detector, 800, 50, 8000), 10u);
+  CHECK_EQ(detector.beatCount(), 10u);
+  CHECK_EQ(detector.lastIntervalMs(), 800u);
+  CHECK_EQ(detector.lastBeatMs(), 7200u);
+  CHECK_EQ(detector.suppressedCount(), 0u);
+}
+
+VITALCARE_TEST(BeatDetector, HysteresisKeepsOneBeatPerPulse)
+{
+  ThresholdBeatDetector detector(500, 100);
+  CHECK(detector.update(600, 0));
+  // Dips that stay above threshold - hysteresis do not re-arm
+  CHECK(!detector.update(450, 10));
+  CHECK(!detector.update(600, 20));
+  CHECK(!detector.update(300, 400));
+  CHECK(detector.update(600, 800));
+  CHECK_EQ(detector.beatCount(), 2u);
+}
+
+VITALCARE_TEST(BeatDetector, RefractoryPeriodSuppresses)
+{
+  ThresholdBeatDetector detector(500, 100, 300);
+  CHECK(detector.update(1000, 0));
+  CHECK(!detector.update(0, 100));
+  CHECK(!detector.update(1000, 200)); // Inside 300 ms
+  CHECK_EQ(detector.suppressedCount(), 1u);
+  CHECK(!detector.update(0, 250));
+  CHECK(detector.update(1000, 600));
+  CHECK_EQ(detector.beatCount(), 2u);
+  CHECK_EQ(detector.lastIntervalMs(), 600u);
+  detector.reset();
+  CHECK_EQ(detector.beatCount(), 0u);
+  CHECK_EQ(detector.suppressedCount(), 0u);
+}
+
+VITALCARE_TEST(BeatDetector, ChannelRateAndQuality)
+{
+  BeatChannel channel;
+  float rate = 0;
+  CHECK(!channel.onBeat(1000, rate)); // The first beat has no interval
+  uint32_t now = 1000;
+  for (int i = 0; i < 20; i++)
+  {
+    now += 800;
+    CHECK(channel.onBeat(now, rate));
+    CHECK_NEAR(rate, 75.0, 0.01);
+  }
+  CHECK(channel.getQuality() > 0.95f);
+  CHECK_NEAR(channel.getRate(), 75.0, 0.01);
+}
+
+VITALCARE_TEST(BeatDetector, ChannelRejectsImplausibleIntervals)
+{
+  BeatChannel channel;
+  float rate = 0;
+  uint32_t now = 0;
+  channel.onBeat(now, rate);
+  for (int i = 0; i < 10; i++)
+    channel.onBeat(now += 1000, rate);
+  float quality = channel.getQuality();
+  rate = -1;
+  // 100 ms is 600 BPM: a double count
+  CHECK(!channel.onBeat(now += 100, rate));
+  CHECK_EQ(rate, -1.0f);
+  CHECK_NEAR(channel.getQuality(), quality * 0.5f, 1e-6);
+  CHECK_NEAR(channel.getRate(), 60.0, 0.01);
+}
+
+VITALCARE_TEST(BeatDetector, ChannelExpiresWithoutBeats)
+{
+  BeatChannel channel;
+  float rate = 0;
+  channel.expire(0, 3000);
+  CHECK_EQ(channel.getQuality(), 0.0f);
+  channel.onBeat(0, rate);
+  for (uint32_t t = 1000; t <= 10000; t += 1000)
+    channel.onBeat(t, rate);
+  channel.expire(12000, 3000);
+  CHECK(channel.getQuality() > 0);
+  channel.expire(13001, 3000);
+  CHECK_EQ(channel.getQuality(), 0.0f);
+}
+
+VITALCARE_TEST(HeartRateFusion, FirstBeatSetsRate)
+{
+  HeartRateFusion fusion;
+  fusion.begin(0);
+  float rate = 0, confidence = 0;
+  CHECK(!fusion.estimate(0, rate, confidence));
+  fusion.update(72.0f, 1.0f, 100);
+  CHECK(fusion.estimate(100, rate, confidence));
+  CHECK_NEAR(rate, 72.0, 1e-4);
+  CHECK(confidence > 0.8f);
+}
+
+VITALCARE_TEST(HeartRateFusion, LowQualityIsIgnored)
+{
+  HeartRateFusion fusion;
+  fusion.begin(0);
+  fusion.update(72.0f, 1.0f, 0);
+  fusion.update(150.0f, HeartRateFusion::MIN_QUALITY / 2, 500);
+  CHECK_NEAR(fusion.value(), 72.0, 1e-4);
+}
+
+VITALCARE_TEST(HeartRateFusion, CleanChannelDominates)
+{
+  HeartRateFusion fusion;
+  fusion.begin(0);
+  uint32_t now = 0;
+  // Clean ECG at 70 BPM, noisy PPG reading 90
+  for (int i = 0; i < 60; i++)
+  {
+    now += 850;
+    fusion.update(70.0f, 1.0f, now);
+    fusion.update(90.0f, 0.2f, now + 50);
+  }
+  CHECK(fusion.value() > 69.0f && fusion.value() < 72.0f);
+}
+
+VITALCARE_TEST(HeartRateFusion, OutlierGateStillTracksSteps)
+{
+  HeartRateFusion fusion;
+  fusion.begin(0);
+  uint32_t now = 0;
+  for (int i = 0; i < 30; i++)
+    fusion.update(60.0f, 1.0f, now += 1000);
+  fusion.update(120.0f, 1.0f, now += 1000);
+  CHECK(fusion.value() < 80.0f); // One outlier only nudges
+  for (int i = 0; i < 30; i++)
+    fusion.update(120.0f, 1.0f, now += 500);
+  CHECK_NEAR(fusion.value(), 120.0, 2.0);
+}
+
+VITALCARE_TEST(HeartRateFusion, SilenceResetsEstimate)
+{
+  HeartRateFusion fusion;
+  fusion.begin(0);
+  fusion.update(80.0f, 1.0f, 0);
+  float rate = 0, confidence = 0;
+  CHECK(fusion.estimate(10000, rate, confidence));
+  float earlier = confidence;
+  CHECK(fusion.estimate(50000, rate, confidence));
+  CHECK(confidence < earlier);
+  // Variance reaches the prior after (400 - 9) / 4 s
+  CHECK(!fusion.estimate(200000, rate, confidence));
+  CHECK_EQ(rate, 0.0f);
+  CHECK_EQ(fusion.value(), 0.0f);
+}
@@ -0,0 +1,132 @@
+/*
+ * VitalCare Rural - RingBuffer and filter tests
+ */
+
+#include "Test.h"
+
+#include "vitalcare/Filters.h"
+#include "vitalcare/RingBuffer.h"
+
+using namespace vitalcare;
+
+VITALCARE_TEST(RingBuffer, PushPopInOrder)
+{
+  RingBuffer<int, 4> buffer;
+  CHECK(buffer.empty());
+  CHECK(buffer.push(1));
+  CHECK(buffer.push(2));
+  CHECK(buffer.push(3));
+  CHECK_EQ(buffer.size(), 3u);
+  CHECK_EQ(buffer.oldest(), 1);
+  CHECK_EQ(buffer.newest(), 3);
+  int value = 0;
+  CHECK(buffer.pop(value));
+  CHECK_EQ(value, 1);
+  CHECK(buffer.pop(value));
+  CHECK_EQ(value, 2);
+  CHECK_EQ(buffer.size(), 1u);
+}
+
+VITALCARE_TEST(RingBuffer, PushOverwritesOldestWhenFull)
+{
+  RingBuffer<int, 4> buffer;
+  for (int i = 1; i <= 4; i++)
+    CHECK(buffer.push(i));
+  CHECK(buffer.full());
+  CHECK(!buffer.push(5));
+  CHECK_EQ(buffer.size(), 4u);
+  CHECK_EQ(buffer.oldest(), 2);
+  CHECK_EQ(buffer.newest(), 5);
+  for (size_t i = 0; i < buffer.size(); i++)
+    CHECK_EQ(buffer[i], (int)i + 2);
+}
+
+VITALCARE_TEST(RingBuffer, TryPushRefusesWhenFull)
+{
+  RingBuffer<int, 2> buffer;
+  CHECK(buffer.tryPush(1));
+  CHECK(buffer.tryPush(2));
+  CHECK(!buffer.tryPush(3));
+  CHECK_EQ(buffer.oldest(), 1);
+  CHECK_EQ(buffer.newest(), 2);
+}
+
+VITALCARE_TEST(RingBuffer, PopEmptyAndDiscard)
+{
+  RingBuffer<int, 8> buffer;
+  int value = 42;
+  CHECK(!buffer.pop(value));
+  CHECK_EQ(value, 42);
+  for (int i = 0; i < 6; i++)
+    buffer.push(i);
+  buffer.discard(4);
+  CHECK_EQ(buffer.size(), 2u);
+  CHECK_EQ(buffer.oldest(), 4);
+  buffer.discard(10);
+  CHECK(buffer.empty());
+}
+
+VITALCARE_TEST(RingBuffer, WrapsAround)
+{
+  RingBuffer<int, 4> buffer;
+  int value = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    buffer.push(i);
+    if (buffer.size() == 3)
+      buffer.pop(value);
+  }
+  CHECK_EQ(buffer.size(), 2u);
+  CHECK_EQ(buffer[0], 8);
+  CHECK_EQ(buffer[1], 9);
+  buffer.clear();
+  CHECK(buffer.empty());
+}
+
+VITALCARE_TEST(Filters, MovingAverageOverWindow)
+{
+  MovingAverage<int32_t, 4> average;
+  CHECK_EQ(average.value(), 0);
+  CHECK_EQ(average.update(4), 4);
+  CHECK_EQ(average.update(8), 6);
+  CHECK(!average.ready());
+  average.update(12);
+  CHECK_EQ(average.update(16), 10);
+  CHECK(average.ready());
+  // 4 leaves the window
+  CHECK_EQ(average.update(20), 14);
+  average.reset();
+  CHECK(!average.ready());
+  CHECK_EQ(average.value(), 0);
+}
+
+VITALCARE_TEST(Filters, EmaPrimesThenSmooths)
+{
+  EmaFilter ema(0.5f);
+  CHECK(!ema.ready());
+  CHECK_NEAR(ema.update(10.0f), 10.0, 1e-6);
+  CHECK(ema.ready());
+  CHECK_NEAR(ema.update(20.0f), 15.0, 1e-6);
+  CHECK_NEAR(ema.update(20.0f), 17.5, 1e-6);
+  ema.reset();
+  CHECK(!ema.ready());
+  CHECK_NEAR(ema.update(-4.0f), -4.0, 1e-6);
+}
+
+VITALCARE_TEST(Filters, DcBlockerRemovesOffset)
+{
+  DcBlocker blocker;
+  // The first sample primes the blocker instead of producing a step
+  CHECK_EQ(blocker.update(2048), 0);
+  int32_t output = 0;
+  for (int i = 0; i < 5000; i++)
+    output = blocker.update(2048);
+  CHECK_EQ(output, 0);
+
+  // A step decays back towards zero
+  int32_t step = blocker.update(2548);
+  CHECK_EQ(step, 500);
+  for (int i = 0; i < 2000; i++)
+    output = blocker.update(2548);
+  CHECK(output >= 0 && output < 5);
+}
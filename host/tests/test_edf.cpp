@@ -0,0 +1,228 @@
+/*
+ * VitalCare Rural - EDF+ writer tests
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+#include "vitalcare/Edf.h"
+
+using namespace vitalcare;
+
+namespace
+{
+
+// A file in memory: writes go at the position, over or past the end
+class MemoryEdfOutput : public EdfOutput
+{
+public:
+  bool write(const uint8_t *data, size_t length) override
+  {
+    if (position + length > bytes.size())
+      bytes.resize(position + length);
+    memcpy(bytes.data() + position, data, length);
+    position += length;
+    return true;
+  }
+
+  bool seek(uint64_t offset) override
+  {
+    if (offset > bytes.size())
+      return false;
+    position = (size_t)offset;
+    return true;
+  }
+
+  std::vector<uint8_t> bytes;
+  size_t position = 0;
+};
+
+// A header field with its padding spaces trimmed
+std::string field(const std::vector<uint8_t> &bytes, size_t offset, size_t width)
+{
+  std::string text(bytes.begin() + offset, bytes.begin() + offset + width);
+  return text.substr(0, text.find_last_not_of(' ') + 1);
+}
+
+// Signal s's value of a signal header field. Fields are field-major: the
+// field's values for all ns signals (annotations included) start at
+// 256 + ns * fieldOffset.
+std::string signalField(const std::vector<uint8_t> &bytes, size_t ns, size_t s, size_t fieldOffset, size_t width)
+{
+  return field(bytes, 256 + ns * fieldOffset + s * width, width);
+}
+
+int16_t sampleAt(const std::vector<uint8_t> &bytes, size_t offset)
+{
+  return (int16_t)(uint16_t)(bytes[offset] | bytes[offset + 1] << 8);
+}
+
+const EdfSignal ECG = {"ECG", "AD8232 chest electrodes", "mV", -16.5f, 16.5f, 0, 4095, "HP:0.5Hz LP:40Hz", 4};
+const EdfSignal PPG = {"PPG IR", "MAX30102 IR LED", "counts", 0, 262143, 0, 32767, "", 2};
+const EdfRecordingInfo INFO = {"P-01", 'F', "Jane Doe", "VitalCare-0001", 2026, 10, 18, 9, 5, 3};
+
+} // namespace
+
+VITALCARE_TEST(Edf, HeaderLayout)
+{
+  MemoryEdfOutput output;
+  uint8_t record[64];
+  EdfWriter edf(output, record, sizeof(record));
+  CHECK(edf.addSignal(ECG));
+  CHECK(edf.addSignal(PPG));
+  CHECK(edf.begin(INFO, 1000, 24));
+  CHECK(!edf.addSignal(ECG)); // Too late
+
+  const std::vector<uint8_t> &bytes = output.bytes;
+  CHECK_EQ(edf.headerSize(), 1024u);
+  CHECK_EQ(bytes.size(), 1024u);
+  CHECK_EQ(field(bytes, 0, 8), "0");
+  CHECK_EQ(field(bytes, 8, 80), "P-01 F X Jane_Doe");
+  CHECK_EQ(field(bytes, 88, 80), "Startdate 18-OCT-2026 X X VitalCare-0001");
+  CHECK_EQ(field(bytes, 168, 8), "18.10.26");
+  CHECK_EQ(field(bytes, 176, 8), "09.05.03");
+  CHECK_EQ(field(bytes, 184, 8), "1024");
+  CHECK_EQ(field(bytes, 192, 44), "EDF+C");
+  CHECK_EQ(field(bytes, 236, 8), "-1"); // Still recording
+  CHECK_EQ(field(bytes, 244, 8), "1");
+  CHECK_EQ(field(bytes, 252, 4), "3");
+
+  // Field-major signal headers, the annotation signal last
+  const size_t ns = 3;
+  CHECK_EQ(signalField(bytes, ns, 0, 0, 16), "ECG");
+  CHECK_EQ(signalField(bytes, ns, 2, 0, 16), "EDF Annotations");
+  CHECK_EQ(signalField(bytes, ns, 1, 16, 80), "MAX30102 IR LED");
+  CHECK_EQ(signalField(bytes, ns, 0, 96, 8), "mV");
+  CHECK_EQ(signalField(bytes, ns, 0, 104, 8), "-16.5");
+  CHECK_EQ(signalField(bytes, ns, 1, 112, 8), "262143");
+  CHECK_EQ(signalField(bytes, ns, 2, 104, 8), "-1");
+  CHECK_EQ(signalField(bytes, ns, 0, 120, 8), "0");
+  CHECK_EQ(signalField(bytes, ns, 2, 128, 8), "32767");
+  CHECK_EQ(signalField(bytes, ns, 0, 136, 80), "HP:0.5Hz LP:40Hz");
+  CHECK_EQ(signalField(bytes, ns, 0, 216, 8), "4");
+  CHECK_EQ(signalField(bytes, ns, 1, 216, 8), "2");
+  CHECK_EQ(signalField(bytes, ns, 2, 216, 8), "12"); // 24 annotation bytes
+  CHECK_EQ(edf.recordSize(), 4u * 2 + 2 * 2 + 24);
+
+  // Without a clock the date is the EDF+ placeholder
+  MemoryEdfOutput undated;
+  EdfWriter noClock(undated, record, sizeof(record));
+  EdfRecordingInfo info = INFO;
+  info.year = 0;
+  info.patientSex = 0;
+  info.patientCode = "";
+  CHECK(noClock.begin(info, 1000, 24));
+  CHECK_EQ(field(undated.bytes, 8, 80), "X X X Jane_Doe");
+  CHECK_EQ(field(undated.bytes, 88, 80), "Startdate X X X VitalCare-0001");
+  CHECK_EQ(field(undated.bytes, 168, 8), "01.01.85");
+  CHECK_EQ(field(undated.bytes, 252, 4), "1");
+}
+
+VITALCARE_TEST(Edf, RecordsAreLaidOutSignalAfterSignal)
+{
+  MemoryEdfOutput output;
+  uint8_t record[64];
+  EdfWriter edf(output, record, sizeof(record));
+  edf.addSignal(ECG);
+  edf.addSignal(PPG);
+  CHECK(edf.begin(INFO, 1000, 24));
+
+  const int16_t ecg[] = {100, -200, 300, 400, 500};
+  CHECK_EQ(edf.addSamples(0, ecg, 5), 4u);
+  CHECK(edf.addSample(1, 7));
+  CHECK(edf.annotate(500, 0, "Leads off"));
+  CHECK(edf.endRecord());
+  CHECK_EQ(edf.dropped(), 1u);
+  CHECK_EQ(edf.padded(), 1u); // The PPG's second sample repeats its first
+
+  const std::vector<uint8_t> &bytes = output.bytes;
+  CHECK_EQ(bytes.size(), 1024u + edf.recordSize());
+  CHECK_EQ(sampleAt(bytes, 1024), 100);
+  CHECK_EQ(sampleAt(bytes, 1026), -200);
+  CHECK_EQ(sampleAt(bytes, 1030), 400);
+  CHECK_EQ(sampleAt(bytes, 1032), 7);
+  CHECK_EQ(sampleAt(bytes, 1034), 7);
+
+  // The timekeeping TAL, then the annotation, in the 24 bytes left
+  const char expected[] = "+0\x14\x14\0+0.5\x14Leads off\x14";
+  CHECK_EQ(memcmp(bytes.data() + 1036, expected, sizeof(expected)), 0);
+}
+
+VITALCARE_TEST(Edf, SyncAndClosePatchRecordCountAndDuration)
+{
+  MemoryEdfOutput output;
+  uint8_t record[256];
+  EdfWriter edf(output, record, sizeof(record));
+  edf.addSignal(ECG);
+  CHECK(edf.begin(INFO, 250));
+  CHECK_EQ(field(output.bytes, 244, 8), "0.25");
+
+  for (int i = 0; i < 3; i++)
+  {
+    edf.addSample(0, (int16_t)i);
+    CHECK(edf.endRecord());
+  }
+  CHECK(edf.sync());
+  CHECK_EQ(field(output.bytes, 236, 8), "3");
+  CHECK_EQ(output.position, output.bytes.size()); // Back at the end
+
+  // The next record goes after the others, not over the header; its
+  // timekeeping TAL is its start
+  edf.addSample(0, 42);
+  CHECK(edf.endRecord());
+  const size_t size = edf.recordSize();
+  CHECK_EQ(output.bytes.size(), 768u + 4 * size);
+  CHECK_EQ(sampleAt(output.bytes, 768 + 3 * size), 42);
+  CHECK_EQ(memcmp(output.bytes.data() + 768 + 3 * size + 8, "+0.75\x14\x14", 7), 0);
+
+  // close() ends the partial record and writes the final count
+  edf.addSample(0, 43);
+  CHECK(edf.close());
+  CHECK_EQ(edf.records(), 5u);
+  CHECK_EQ(field(output.bytes, 236, 8), "5");
+  CHECK_EQ(field(output.bytes, 192, 44), "EDF+C");
+  CHECK_EQ(output.bytes.size(), 768u + 5 * size);
+  CHECK(!edf.endRecord());
+  CHECK(!edf.close());
+}
+
+VITALCARE_TEST(Edf, SkippedRecordsMakeTheFileDiscontinuous)
+{
+  MemoryEdfOutput output;
+  uint8_t record[64];
+  EdfWriter edf(output, record, sizeof(record));
+  edf.addSignal(ECG);
+  CHECK(edf.begin(INFO, 1000, 40));
+  CHECK(edf.endRecord());
+  CHECK(edf.skipRecord());
+  CHECK(edf.skipRecord());
+  CHECK(edf.endRecord());
+  CHECK(edf.close());
+
+  const size_t size = edf.recordSize();
+  CHECK_EQ(edf.records(), 2u);
+  CHECK_EQ(edf.skipped(), 2u);
+  CHECK_EQ(output.bytes.size(), 768u + 2 * size);
+  CHECK_EQ(field(output.bytes, 192, 44), "EDF+D");
+  CHECK_EQ(field(output.bytes, 236, 8), "2");
+
+  // The second record starts after the gap and says what was lost
+  const char expected[] = "+3\x14\x14\0+1\x15"
+                          "2\x14"
+                          "Data lost\x14";
+  CHECK_EQ(memcmp(output.bytes.data() + 768 + size + 8, expected, sizeof(expected)), 0);
+}
+
+VITALCARE_TEST(Edf, BeginRejectsRecordsLargerThanTheBuffer)
+{
+  MemoryEdfOutput output;
+  uint8_t record[16];
+  EdfWriter edf(output, record, sizeof(record));
+  edf.addSignal(ECG);
+  CHECK(!edf.begin(INFO, 1000)); // 8 sample bytes + 120 annotation bytes
+  CHECK(output.bytes.empty());
+  CHECK(!edf.addSample(0, 1));
+}
@@ -0,0 +1,275 @@
+/*
+ * VitalCare Rural - Gateway ingest tests
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+#include "Ingest.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+namespace
+{
+
+// Remembers what it stored; can be told to fail
+class MemorySink : public RecordSink
+{
+public:
+  bool storeVitals(uint64_t deviceId, const uint8_t *records, size_t count) override
+  {
+    if (failing)
+      return false;
+    for (size_t i = 0; i < count; i++)
+    {
+      VitalRecord record = {};
+      decodeVitalRecord(records + i * VITAL_RECORD_SIZE, record);
+      vitals.push_back(record.sequence);
+      stored.insert(key(deviceId, record.sequence));
+    }
+    return true;
+  }
+  bool storePatients(uint64_t, const uint8_t *, size_t count) override
+  {
+    patients += count;
+    return !failing;
+  }
+  bool contains(uint64_t deviceId, bool vitalRecords, uint32_t sequence) override
+  {
+    lookups++;
+    return vitalRecords && stored.count(key(deviceId, sequence)) > 0;
+  }
+
+  static uint64_t key(uint64_t deviceId, uint32_t sequence) { return deviceId << 32 | sequence; }
+
+  bool failing = false;
+  std::vector<uint32_t> vitals;
+  std::set<uint64_t> stored;
+  size_t patients = 0;
+  size_t lookups = 0;
+};
+
+// One uplink batch of vital records with the given sequences
+std::vector<uint8_t> vitalBatch(uint64_t deviceId, const std::vector<uint32_t> &sequences, uint32_t batchSequence = 1)
+{
+  std::vector<uint8_t> buffer(UPLINK_HEADER_SIZE + sequences.size() * VITAL_RECORD_SIZE);
+  UplinkBatchWriter batch(buffer.data(), buffer.size(), UPLINK_VITAL_RECORDS, deviceId, batchSequence);
+  for (uint32_t sequence : sequences)
+  {
+    VitalRecord record = {};
+    record.sequence = sequence;
+    record.vitals = {72.0f, 120.0f, 80.0f, 97.0f, 98.6f, sequence * 1000};
+    batch.add(record);
+  }
+  buffer.resize(batch.finish());
+  return buffer;
+}
+
+std::vector<uint32_t> range(uint32_t first, uint32_t last)
+{
+  std::vector<uint32_t> sequences;
+  for (uint32_t s = first; s <= last; s++)
+    sequences.push_back(s);
+  return sequences;
+}
+
+UplinkAck send(IngestService &ingest, const std::vector<uint8_t> &batch)
+{
+  return ingest.process(batch.data(), batch.size());
+}
+
+struct StoreDir
+{
+  std::string path;
+
+  StoreDir()
+  {
+    char name[] = "/tmp/vitalcare-ingest-XXXXXX";
+    path = mkdtemp(name);
+  }
+  ~StoreDir() { std::system(("rm -rf '" + path + "'").c_str()); }
+};
+
+} // namespace
+
+VITALCARE_TEST(Ingest, UplinkFramingRoundTrips)
+{
+  std::vector<uint8_t> batch = vitalBatch(42, range(1, 3), 7);
+  CHECK_EQ(batch.size(), UPLINK_HEADER_SIZE + 3 * VITAL_RECORD_SIZE);
+
+  UplinkBatchHeader header = {};
+  CHECK(decodeUplinkHeader(batch.data(), batch.size(), header));
+  CHECK_EQ(header.recordType, UPLINK_VITAL_RECORDS);
+  CHECK_EQ(header.recordCount, 3);
+  CHECK_EQ(header.deviceId, 42u);
+  CHECK_EQ(header.batchSequence, 7u);
+  CHECK_EQ(header.payloadCrc, crc32(batch.data() + UPLINK_HEADER_SIZE, header.payloadLength));
+  CHECK(!decodeUplinkHeader(batch.data(), UPLINK_HEADER_SIZE - 1, header));
+
+  UplinkAck ack = {UPLINK_BUSY, UPLINK_VITAL_RECORDS, 5, 42, 7, 2, 1};
+  uint8_t encoded[UPLINK_ACK_SIZE];
+  CHECK_EQ(encodeUplinkAck(ack, encoded), UPLINK_ACK_SIZE);
+  UplinkAck decoded = {};
+  CHECK(decodeUplinkAck(encoded, sizeof(encoded), decoded));
+  CHECK_EQ(decoded.status, UPLINK_BUSY);
+  CHECK_EQ(decoded.accepted, 5);
+  CHECK_EQ(decoded.deviceId, 42u);
+  CHECK_EQ(decoded.batchSequence, 7u);
+  CHECK_EQ(decoded.duplicates, 2);
+  CHECK_EQ(decoded.rejected, 1);
+}
+
+VITALCARE_TEST(Ingest, RejectsDamagedFraming)
+{
+  MemorySink sink;
+  IngestService ingest(sink);
+
+  std::vector<uint8_t> badHeader = vitalBatch(1, range(1, 3));
+  badHeader[9] ^= 0x01; // device id, under the header CRC
+  CHECK_EQ(send(ingest, badHeader).status, UPLINK_BAD_HEADER);
+
+  std::vector<uint8_t> badPayload = vitalBatch(1, range(1, 3));
+  badPayload[UPLINK_HEADER_SIZE + 10] ^= 0x01;
+  CHECK_EQ(send(ingest, badPayload).status, UPLINK_BAD_PAYLOAD);
+
+  std::vector<uint8_t> truncated = vitalBatch(1, range(1, 3));
+  truncated.pop_back();
+  CHECK_EQ(send(ingest, truncated).status, UPLINK_BAD_PAYLOAD);
+
+  CHECK(sink.vitals.empty());
+  CHECK_EQ(ingest.statistics().badBatches.load(), 3u);
+}
+
+VITALCARE_TEST(Ingest, WindowAdmitsEachSequenceOnce)
+{
+  IngestService::SequenceWindow window;
+  CHECK_EQ(window.admit(100), IngestService::ADMIT_NEW);
+  CHECK_EQ(window.admit(100), IngestService::ADMIT_DUPLICATE);
+  CHECK_EQ(window.admit(98), IngestService::ADMIT_NEW); // out of order, within the window
+  CHECK_EQ(window.admit(98), IngestService::ADMIT_DUPLICATE);
+  CHECK_EQ(window.admit(101), IngestService::ADMIT_NEW);
+
+  // Sliding forward clears the slots the new sequences reuse
+  uint32_t far = 100 + IngestService::DEDUP_WINDOW;
+  CHECK_EQ(window.admit(far), IngestService::ADMIT_NEW);
+  CHECK_EQ(window.admit(98 + IngestService::DEDUP_WINDOW), IngestService::ADMIT_NEW);
+  CHECK_EQ(window.admit(101), IngestService::ADMIT_DUPLICATE);
+  CHECK_EQ(window.admit(100), IngestService::ADMIT_TOO_OLD);
+  CHECK_EQ(window.admit(98), IngestService::ADMIT_TOO_OLD);
+
+  window.forget(far);
+  CHECK_EQ(window.admit(far), IngestService::ADMIT_NEW);
+}
+
+VITALCARE_TEST(Ingest, AckCountsSplitAcceptedDuplicateRejected)
+{
+  MemorySink sink;
+  IngestService ingest(sink);
+  CHECK_EQ(send(ingest, vitalBatch(5, range(1, 10))).accepted, 10);
+
+  // 6..15 with record 12 corrupted: 5 old, 4 new, 1 rejected
+  std::vector<uint8_t> batch = vitalBatch(5, range(6, 15), 2);
+  batch[UPLINK_HEADER_SIZE + 6 * VITAL_RECORD_SIZE + 8] ^= 0xFF;
+  UplinkBatchHeader header = {};
+  CHECK(decodeUplinkHeader(batch.data(), batch.size(), header));
+  header.payloadCrc = crc32(batch.data() + UPLINK_HEADER_SIZE, header.payloadLength);
+  encodeUplinkHeader(header, batch.data());
+
+  UplinkAck ack = send(ingest, batch);
+  CHECK_EQ(ack.status, UPLINK_OK);
+  CHECK_EQ(ack.deviceId, 5u);
+  CHECK_EQ(ack.batchSequence, 2u);
+  CHECK_EQ(ack.duplicates, 5);
+  CHECK_EQ(ack.accepted, 4);
+  CHECK_EQ(ack.rejected, 1);
+  CHECK_EQ(sink.vitals.size(), 14u);
+
+  // Another device's windows are its own
+  CHECK_EQ(send(ingest, vitalBatch(6, range(1, 10))).accepted, 10);
+  CHECK_EQ(ingest.deviceCount(), 2u);
+}
+
+VITALCARE_TEST(Ingest, FailedStoreIsRetriable)
+{
+  MemorySink sink;
+  IngestService ingest(sink);
+  sink.failing = true;
+  CHECK_EQ(send(ingest, vitalBatch(1, range(1, 5))).status, UPLINK_BUSY);
+  sink.failing = false;
+  UplinkAck retry = send(ingest, vitalBatch(1, range(1, 5)));
+  CHECK_EQ(retry.status, UPLINK_OK);
+  CHECK_EQ(retry.accepted, 5);
+  CHECK_EQ(retry.duplicates, 0);
+}
+
+VITALCARE_TEST(Ingest, OldSequencesAreCheckedAgainstTheSink)
+{
+  MemorySink sink;
+  IngestService ingest(sink);
+  uint32_t last = 2 * IngestService::DEDUP_WINDOW;
+  // Everything but 10..19, which the device still has on its SD card
+  std::vector<uint32_t> live = range(1, 9);
+  std::vector<uint32_t> rest = range(20, last);
+  live.insert(live.end(), rest.begin(), rest.end());
+  for (size_t first = 0; first < live.size(); first += UPLINK_MAX_RECORDS)
+  {
+    std::vector<uint32_t> part(live.begin() + first,
+                               live.begin() + std::min(live.size(), first + UPLINK_MAX_RECORDS));
+    CHECK_EQ(send(ingest, vitalBatch(3, part)).status, UPLINK_OK);
+  }
+  CHECK_EQ(sink.lookups, 0u);
+
+  // The backfill is far behind the window: stored ones are duplicates,
+  // the missing ones are stored, not acked unseen
+  UplinkAck ack = send(ingest, vitalBatch(3, range(1, 30)));
+  CHECK_EQ(ack.status, UPLINK_OK);
+  CHECK_EQ(ack.accepted, 10);
+  CHECK_EQ(ack.duplicates, 20);
+  CHECK_EQ(sink.lookups, 30u);
+  CHECK_EQ(sink.vitals.size(), (size_t)last);
+  CHECK_EQ(send(ingest, vitalBatch(3, range(10, 19))).duplicates, 10);
+}
+
+VITALCARE_TEST(Ingest, WindowsAreSeededFromTheStoreAfterARestart)
+{
+  StoreDir dir;
+  {
+    StoreSink sink(dir.path);
+    CHECK(sink.open());
+    IngestService ingest(sink);
+    CHECK_EQ(send(ingest, vitalBatch(9, range(1, 100))).accepted, 100);
+
+    uint8_t buffer[UPLINK_HEADER_SIZE + PATIENT_RECORD_SIZE];
+    UplinkBatchWriter batch(buffer, sizeof(buffer), UPLINK_PATIENT_RECORDS, 9, 1);
+    PatientRecord patient = {};
+    patient.sequence = 1;
+    strcpy(patient.patientId, "P-0009");
+    batch.add(patient);
+    CHECK_EQ(ingest.process(buffer, batch.finish()).accepted, 1);
+  }
+
+  StoreSink sink(dir.path);
+  CHECK(sink.open());
+  IngestService ingest(sink);
+  UplinkAck ack = send(ingest, vitalBatch(9, range(95, 105), 2));
+  CHECK_EQ(ack.status, UPLINK_OK);
+  CHECK_EQ(ack.duplicates, 6);
+  CHECK_EQ(ack.accepted, 5);
+
+  uint8_t buffer[UPLINK_HEADER_SIZE + PATIENT_RECORD_SIZE];
+  UplinkBatchWriter batch(buffer, sizeof(buffer), UPLINK_PATIENT_RECORDS, 9, 3);
+  PatientRecord patient = {};
+  patient.sequence = 1;
+  strcpy(patient.patientId, "P-0009");
+  batch.add(patient);
+  CHECK_EQ(ingest.process(buffer, batch.finish()).duplicates, 1);
+
+  std::vector<VitalRecord> rows;
+  CHECK_EQ(sink.timeSeries().query(9, 0, UINT32_MAX, rows), 105u);
+}
@@ -0,0 +1,43 @@
+/*
+ * VitalCare Rural - Host Test Runner
+ *
+ * Usage: vitalcare_tests [SUITE]
+ *
+ * Runs every registered test, or only SUITE's, and exits 1 if a check
+ * failed.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "Test.h"
+
+int main(int argc, char **argv)
+{
+  if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+  {
+    std::fprintf(stderr, "Usage: %s [SUITE]\n", argv[0]);
+    return 2;
+  }
+  const char *suite = argc == 2 ? argv[1] : nullptr;
+
+  unsigned run = 0;
+  for (const vitalcare::test::Registration &test : vitalcare::test::registry())
+  {
+    if (suite && std::strcmp(suite, test.suite) != 0)
+      continue;
+    unsigned before = vitalcare::test::failures();
+    test.function();
+    std::printf("%s %s.%s\n", vitalcare::test::failures() == before ? "✅" : "❌", test.suite, test.name);
+    run++;
+  }
+
+  if (run == 0)
+  {
+    std::fprintf(stderr, "❌ No tests in suite %s\n", suite ? suite : "(all)");
+    return 1;
+  }
+  unsigned failed = vitalcare::test::failures();
+  std::printf("%u tests, %u failed checks\n", run, failed);
+  return failed ? 1 : 0;
+}
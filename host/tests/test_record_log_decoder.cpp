@@ -0,0 +1,206 @@
+/*
+ * VitalCare Rural Analyzer - SD card decoder tests
+ *
+ * Writes the files esp32-main leaves on its card with the library's own
+ * writers and checks what the decoder makes of them.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Test.h"
+
+#include "RecordLogDecoder.h"
+
+using namespace vitalcare;
+using namespace vitalcare::analyzer;
+
+namespace
+{
+
+class FileEdfOutput : public EdfOutput
+{
+public:
+  explicit FileEdfOutput(FILE *file) : file(file) {}
+
+  bool write(const uint8_t *data, size_t length) override { return fwrite(data, 1, length, file) == length; }
+  bool seek(uint64_t offset) override { return fseeko(file, (off_t)offset, SEEK_SET) == 0; }
+
+private:
+  FILE *file;
+};
+
+struct TempDir
+{
+  std::string path;
+
+  TempDir()
+  {
+    char name[] = "/tmp/vitalcare-sdlog-XXXXXX";
+    path = mkdtemp(name);
+  }
+  ~TempDir() { std::system(("rm -rf '" + path + "'").c_str()); }
+};
+
+HistoryRecord reading(uint32_t timestampMs, float heartRate)
+{
+  HistoryRecord record = {};
+  record.vitals = {heartRate, 120.0f, 80.0f, 97.0f, 98.6f, timestampMs};
+  record.pressureHpa = 1010.0f;
+  record.ecg = 2000;
+  record.alertFlags = evaluateAlerts(record.vitals, BEDSIDE_THRESHOLDS);
+  return record;
+}
+
+std::vector<std::string> readLines(const std::string &path)
+{
+  std::vector<std::string> lines;
+  FILE *in = fopen(path.c_str(), "r");
+  if (!in)
+    return lines;
+  char line[512];
+  while (fgets(line, sizeof(line), in))
+  {
+    line[strcspn(line, "\n")] = '\0';
+    lines.push_back(line);
+  }
+  fclose(in);
+  return lines;
+}
+
+// One second records of a 10-sample "ECG" signal
+void writeEdf(const std::string &path, uint32_t records, bool close, size_t preallocated)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  FileEdfOutput output(file);
+  uint8_t buffer[20 + EDF_DEFAULT_ANNOTATION_BYTES];
+  EdfWriter edf(output, buffer, sizeof(buffer));
+  edf.addSignal({"ECG", "AD8232 chest electrodes", "mV", -16.5f, 16.5f, 0, 4095, "", 10});
+  EdfRecordingInfo info = {"VC-7", 'F', "Test Patient", "VitalCare-1", 0, 0, 0, 0, 0, 0};
+  edf.begin(info, 1000);
+  for (uint32_t r = 0; r < records; r++)
+  {
+    for (int i = 0; i < 10; i++)
+      edf.addSample(0, (int16_t)(2000 + i));
+    if (r == 1)
+      edf.annotate(1500, 2000, "Leads off");
+    edf.endRecord();
+  }
+  if (close)
+    edf.close();
+  fseeko(file, 0, SEEK_END);
+  std::vector<uint8_t> zeros(preallocated, 0);
+  fwrite(zeros.data(), 1, zeros.size(), file);
+  fclose(file);
+}
+
+} // namespace
+
+VITALCARE_TEST(RecordLogDecoder, DecodesDeviceFiles)
+{
+  TempDir dir;
+  std::string card = dir.path + "/card";
+  std::string out = dir.path + "/out";
+  CHECK_EQ(mkdir(card.c_str(), 0755), 0);
+  CHECK_EQ(mkdir(out.c_str(), 0755), 0);
+
+  // Trend CSV: two rows, the second alerting, then a row cut short
+  FILE *csv = fopen((card + "/VC-7_1700.csv").c_str(), "wb");
+  fputs(HISTORY_CSV_HEADER, csv);
+  char line[128];
+  formatHistoryCsvRow(reading(1000, 72.0f), line, sizeof(line));
+  fputs(line, csv);
+  formatHistoryCsvRow(reading(2000, 140.0f), line, sizeof(line));
+  fputs(line, csv);
+  fputs("3000,72.00,12", csv);
+  fclose(csv);
+
+  // Flash history log: three records and a torn append
+  FILE *log = fopen((card + "/VC-7_1700.vhr").c_str(), "wb");
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    uint8_t raw[HISTORY_RECORD_SIZE];
+    encodeHistoryRecord(reading(4000 + i * 1000, 80.0f), raw);
+    fwrite(raw, 1, sizeof(raw), log);
+  }
+  fwrite("torn", 1, 4, log);
+  fclose(log);
+
+  // A closed recording, and one never synced in a preallocated segment
+  writeEdf(card + "/VC-7_1700.edf", 4, true, 0);
+  writeEdf(card + "/VC-7_1700-1.edf", 3, false, 4096);
+
+  // Rollups repeat the trend rows and are skipped
+  FILE *rollup = fopen((card + "/VC-7_1700-rollup.csv").c_str(), "wb");
+  fputs("start\n", rollup);
+  fclose(rollup);
+
+  std::vector<std::string> files = RecordLogDecoder::listFiles({card});
+  CHECK_EQ(files.size(), 4u);
+
+  RecordLogDecoder decoder(out, RecordLogOptions());
+  RecordLogCounters counters;
+  for (const std::string &file : files)
+    CHECK(decoder.decodeFile(file, counters));
+  CHECK(decoder.finish());
+
+  CHECK_EQ(counters.files, 4u);
+  CHECK_EQ(counters.badFiles, 0u);
+  CHECK_EQ(counters.trendFiles, 1u);
+  CHECK_EQ(counters.historyLogs, 1u);
+  CHECK_EQ(counters.recordings, 2u);
+  CHECK_EQ(counters.vitals, 5u);
+  CHECK_EQ(counters.dropped, 2u); // the cut row and the torn record
+  CHECK_EQ(counters.edfRecords, 7u);
+  CHECK_EQ(counters.events, 2u);
+  CHECK_EQ(decoder.patientCount(), 1u);
+
+  std::vector<std::string> rows = readLines(out + "/VC-7.csv");
+  CHECK_EQ(rows.size(), 6u);
+  if (rows.size() == 6)
+  {
+    CHECK_EQ(rows[1], "0000000000000000,0,0,1000,72.0,120.0,80.0,97.0,98.6,0,0");
+    CHECK_EQ(rows[2], "0000000000000000,0,1,2000,140.0,120.0,80.0,97.0,98.6,1,0");
+    CHECK_EQ(rows[3].compare(0, 26, "0000000000000000,0,0,4000,"), 0);
+  }
+
+  std::vector<std::string> events = readLines(out + "/VC-7-events.csv");
+  CHECK_EQ(events.size(), 3u);
+  if (events.size() == 3)
+  {
+    CHECK_EQ(events[1], "\"VC-7_1700-1.edf\",1.5,2,\"Leads off\"");
+    CHECK_EQ(events[2], "\"VC-7_1700.edf\",1.5,2,\"Leads off\"");
+  }
+
+  std::vector<std::string> recordings = readLines(out + "/recordings.csv");
+  CHECK_EQ(recordings.size(), 3u);
+  if (recordings.size() == 3)
+  {
+    CHECK_EQ(recordings[1], "\"VC-7_1700-1.edf\",VC-7,EDF+C,01.01.85 00.00.00,3,1,\"ECG\",1");
+    CHECK_EQ(recordings[2], "\"VC-7_1700.edf\",VC-7,EDF+C,01.01.85 00.00.00,4,1,\"ECG\",1");
+  }
+}
+
+VITALCARE_TEST(RecordLogDecoder, RejectsForeignFiles)
+{
+  TempDir dir;
+  std::string path = dir.path + "/notes.csv";
+  FILE *file = fopen(path.c_str(), "wb");
+  fputs("some,other,csv\n1,2,3\n", file);
+  fclose(file);
+  std::string edf = dir.path + "/empty.edf";
+  fclose(fopen(edf.c_str(), "wb"));
+
+  RecordLogDecoder decoder(dir.path, RecordLogOptions());
+  RecordLogCounters counters;
+  CHECK(!decoder.decodeFile(path, counters));
+  CHECK(!decoder.decodeFile(edf, counters));
+  CHECK_EQ(counters.badFiles, 2u);
+  CHECK_EQ(counters.files, 0u);
+}
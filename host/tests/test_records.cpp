@@ -0,0 +1,208 @@
+/*
+ * VitalCare Rural - Encoding and record format tests
+ */
+
+#include <cstring>
+
+// GCC follows the JsonWriter chain below through every inlined append and
+// reports a write past the buffer that the capacity checks rule out
+#pragma GCC diagnostic ignored "-Wstringop-overflow"
+
+#include "Test.h"
+
+#include "vitalcare/Alerts.h"
+#include "vitalcare/Encoding.h"
+#include "vitalcare/History.h"
+#include "vitalcare/Records.h"
+
+using namespace vitalcare;
+
+VITALCARE_TEST(Encoding, Timestamp)
+{
+  char text[16];
+  CHECK_EQ(formatTimestamp(3723000, text, sizeof(text)), 7u);
+  CHECK_EQ(std::strcmp(text, "1:02:03"), 0);
+  formatTimestamp(25 * 3600000u, text, sizeof(text));
+  CHECK_EQ(std::strcmp(text, "1:00:00"), 0);
+}
+
+VITALCARE_TEST(Encoding, JsonWriter)
+{
+  char text[128];
+  JsonWriter json(text, sizeof(text));
+  json.beginObject()
+      .string("id", "a\"b")
+      .number("hr", 72.456, 1)
+      .integer("seq", 7)
+      .boolean("alert", false)
+      .beginArray("ecg")
+      .integerValue(1)
+      .integerValue(-2)
+      .endArray()
+      .endObject();
+  CHECK(json.ok());
+  CHECK_EQ(std::strcmp(text, "{\"id\":\"a\\\"b\",\"hr\":72.5,\"seq\":7,\"alert\":false,\"ecg\":[1,-2]}"), 0);
+
+  char small[32];
+  volatile size_t capacity = 8; // Not a constant, so the overflow is not a warning
+  JsonWriter overflow(small, capacity);
+  overflow.beginObject().string("name", "too long").endObject();
+  CHECK(!overflow.ok());
+  CHECK_EQ(std::strlen(small), capacity - 1);
+}
+
+VITALCARE_TEST(Encoding, BinaryRoundTrip)
+{
+  uint8_t buffer[32];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  writer.u8(0xAB).u16(0x1234).u32(0xDEADBEEF).i16(-5).f32(1.5f).u64(0x0102030405060708ull);
+  CHECK(writer.ok());
+  CHECK_EQ(writer.size(), 21u);
+  CHECK_EQ(buffer[1], 0x34); // Little-endian
+  CHECK_EQ(buffer[2], 0x12);
+
+  BinaryReader reader(buffer, writer.size());
+  CHECK_EQ(reader.u8(), 0xAB);
+  CHECK_EQ(reader.u16(), 0x1234);
+  CHECK_EQ(reader.u32(), 0xDEADBEEFu);
+  CHECK_EQ(reader.i16(), -5);
+  CHECK_EQ(reader.f32(), 1.5f);
+  CHECK_EQ(reader.u64(), 0x0102030405060708ull);
+  CHECK(reader.ok());
+  CHECK_EQ(reader.remaining(), 0u);
+  CHECK_EQ(reader.u8(), 0);
+  CHECK(!reader.ok());
+
+  BinaryWriter full(buffer, 3);
+  full.u16(1).u16(2);
+  CHECK(!full.ok());
+  CHECK_EQ(full.size(), 2u);
+}
+
+VITALCARE_TEST(Records, VitalRecordRoundTrip)
+{
+  VitalRecord record = {42, {72.5f, 118.0f, 79.5f, 97.3f, 98.6f, 123456}, ALERT_SPO2, RECORD_UPLOADED};
+  uint8_t bytes[VITAL_RECORD_SIZE];
+  CHECK_EQ(encodeVitalRecord(record, bytes), VITAL_RECORD_SIZE);
+  CHECK_EQ(bytes[0], VITAL_RECORD_MAGIC);
+
+  VitalRecord decoded = {};
+  CHECK(decodeVitalRecord(bytes, decoded));
+  CHECK_EQ(decoded.sequence, 42u);
+  CHECK_EQ(decoded.vitals.timestampMs, 123456u);
+  CHECK_EQ(decoded.alertFlags, ALERT_SPO2);
+  CHECK_EQ(decoded.recordFlags, RECORD_UPLOADED);
+  CHECK_NEAR(decoded.vitals.heartRate, 72.5, 0.05);
+  CHECK_NEAR(decoded.vitals.systolicBP, 118.0, 0.05);
+  CHECK_NEAR(decoded.vitals.diastolicBP, 79.5, 0.05);
+  CHECK_NEAR(decoded.vitals.spO2, 97.3, 0.05);
+  CHECK_NEAR(decoded.vitals.temperature, 98.6, 0.05);
+}
+
+VITALCARE_TEST(Records, FixedPointClamps)
+{
+  VitalRecord record = {1, {-5.0f, 9000.0f, NAN, 0.0f, -40.0f, 0}, 0, 0};
+  uint8_t bytes[VITAL_RECORD_SIZE];
+  encodeVitalRecord(record, bytes);
+  VitalRecord decoded = {};
+  CHECK(decodeVitalRecord(bytes, decoded));
+  CHECK_EQ(decoded.vitals.heartRate, 0.0f);
+  CHECK_NEAR(decoded.vitals.systolicBP, 6553.5, 0.01);
+  CHECK_EQ(decoded.vitals.diastolicBP, 0.0f);
+  CHECK_NEAR(decoded.vitals.temperature, -40.0, 0.01);
+}
+
+VITALCARE_TEST(Records, VitalRecordRejectsCorruption)
+{
+  VitalRecord record = {7, {80.0f, 120.0f, 80.0f, 98.0f, 98.6f, 5000}, 0, 0};
+  uint8_t bytes[VITAL_RECORD_SIZE];
+  encodeVitalRecord(record, bytes);
+  VitalRecord decoded;
+
+  // Every single-bit flip in the body or the CRC is caught
+  for (size_t i = 0; i < VITAL_RECORD_SIZE * 8; i++)
+  {
+    uint8_t corrupt[VITAL_RECORD_SIZE];
+    std::memcpy(corrupt, bytes, sizeof(corrupt));
+    corrupt[i / 8] ^= (uint8_t)(1 << (i % 8));
+    CHECK(!decodeVitalRecord(corrupt, decoded));
+  }
+
+  uint8_t wrongVersion[VITAL_RECORD_SIZE];
+  std::memcpy(wrongVersion, bytes, sizeof(wrongVersion));
+  wrongVersion[1] = VITAL_RECORD_VERSION + 1;
+  uint16_t crc = crc16Ccitt(wrongVersion, VITAL_RECORD_SIZE - 2);
+  wrongVersion[VITAL_RECORD_SIZE - 2] = (uint8_t)crc;
+  wrongVersion[VITAL_RECORD_SIZE - 1] = (uint8_t)(crc >> 8);
+  CHECK(!decodeVitalRecord(wrongVersion, decoded));
+}
+
+VITALCARE_TEST(Records, PatientRecordRoundTrip)
+{
+  PatientRecord record = {};
+  record.sequence = 3;
+  std::strcpy(record.patientId, "VC123456");
+  std::strcpy(record.name, "Thirty characters fill a name"); // 29
+  std::strcat(record.name, "!");
+  record.age = 54;
+  record.gender = 'F';
+  record.sessionStartMs = 99000;
+  uint8_t bytes[PATIENT_RECORD_SIZE];
+  CHECK_EQ(encodePatientRecord(record, bytes), PATIENT_RECORD_SIZE);
+
+  PatientRecord decoded = {};
+  CHECK(decodePatientRecord(bytes, decoded));
+  CHECK_EQ(decoded.sequence, 3u);
+  CHECK_EQ(std::strcmp(decoded.patientId, "VC123456"), 0);
+  CHECK_EQ(std::strlen(decoded.name), PATIENT_NAME_LENGTH);
+  CHECK_EQ(std::strncmp(decoded.name, record.name, PATIENT_NAME_LENGTH), 0);
+  CHECK_EQ(decoded.age, 54);
+  CHECK_EQ(decoded.gender, 'F');
+  CHECK_EQ(decoded.sessionStartMs, 99000u);
+
+  bytes[40] ^= 0x01;
+  CHECK(!decodePatientRecord(bytes, decoded));
+  bytes[40] ^= 0x01;
+  bytes[0] = VITAL_RECORD_MAGIC;
+  CHECK(!decodePatientRecord(bytes, decoded));
+}
+
+VITALCARE_TEST(Records, ChecksumsMatchReferenceValues)
+{
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  CHECK_EQ(crc16Ccitt(check, sizeof(check)), 0x29B1);
+  CHECK_EQ(crc32(check, sizeof(check)), 0xCBF43926u);
+  // In pieces
+  CHECK_EQ(crc32(check + 4, 5, crc32(check, 4)), 0xCBF43926u);
+}
+
+VITALCARE_TEST(Records, HistoryCsvRowRoundTrip)
+{
+  HistoryRecord record = {};
+  record.vitals = {72.5f, 118.0f, 76.0f, 97.5f, 98.6f, 123456};
+  record.pressureHpa = 1013.25f;
+  record.ecg = 2048;
+  char line[128];
+  size_t length = formatHistoryCsvRow(record, line, sizeof(line));
+  CHECK(length > 0);
+  CHECK_EQ(std::strcmp(line, "123456,72.50,118.00,76.00,97.50,98.60,2048,1013.25,✅ Normal\r\n"), 0);
+
+  HistoryRecord parsed = {};
+  CHECK(parseHistoryCsvRow(line, parsed));
+  CHECK_EQ(parsed.vitals.timestampMs, 123456u);
+  CHECK_NEAR(parsed.vitals.heartRate, 72.5, 1e-4);
+  CHECK_NEAR(parsed.vitals.temperature, 98.6, 1e-4);
+  CHECK_EQ(parsed.ecg, 2048);
+  CHECK_NEAR(parsed.pressureHpa, 1013.25, 1e-3);
+  CHECK_EQ(parsed.alertFlags, ALERT_NONE);
+
+  // The status only says "ALERT"; the flags come back from the thresholds
+  record.vitals.spO2 = 85.0f;
+  record.alertFlags = evaluateAlerts(record.vitals, BEDSIDE_THRESHOLDS);
+  formatHistoryCsvRow(record, line, sizeof(line));
+  CHECK(parseHistoryCsvRow(line, parsed));
+  CHECK_EQ(parsed.alertFlags, ALERT_SPO2);
+
+  CHECK(!parseHistoryCsvRow("123456,72.50,118.00,76", parsed));
+  CHECK(!parseHistoryCsvRow(HISTORY_CSV_HEADER, parsed));
+}
@@ -0,0 +1,323 @@
+/*
+ * VitalCare Rural - Recording retention tests
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+#include "vitalcare/Retention.h"
+
+using namespace vitalcare;
+
+namespace
+{
+
+const uint32_t DAY_S = 86400;
+const uint32_t NOW_S = 200 * DAY_S;
+
+// A card in memory; each operation costs the clock costUs
+class MemoryCard : public RetentionStore
+{
+public:
+  explicit MemoryCard(uint64_t capacity) : capacity(capacity) {}
+
+  void add(const std::string &path, const std::string &data, uint32_t modifiedS)
+  {
+    files[path] = {data, modifiedS};
+  }
+  bool has(const std::string &path) const { return files.count(path) > 0; }
+
+  uint64_t totalBytes() override { return capacity; }
+  uint64_t freeBytes() override
+  {
+    uint64_t used = 0;
+    for (const auto &entry : files)
+      used += entry.second.data.size();
+    return capacity - used;
+  }
+
+  bool rewind() override
+  {
+    clockUs += costUs;
+    cursor.clear();
+    listing = true;
+    return true;
+  }
+
+  bool next(RetentionFile &file) override
+  {
+    clockUs += costUs;
+    auto it = listing ? files.upper_bound(cursor) : files.end();
+    if (it == files.end())
+    {
+      listing = false;
+      return false;
+    }
+    cursor = it->first;
+    snprintf(file.path, sizeof(file.path), "%s", it->first.c_str());
+    file.bytes = (uint32_t)it->second.data.size();
+    file.modifiedS = it->second.modifiedS;
+    return true;
+  }
+
+  int32_t read(const char *path, uint32_t offset, uint8_t *data, size_t length) override
+  {
+    clockUs += costUs;
+    auto it = files.find(path);
+    if (it == files.end())
+      return -1;
+    const std::string &text = it->second.data;
+    if (offset >= text.size())
+      return 0;
+    size_t take = std::min(length, text.size() - offset);
+    memcpy(data, text.data() + offset, take);
+    return (int32_t)take;
+  }
+
+  bool write(const char *path, const uint8_t *data, size_t length, bool truncate) override
+  {
+    clockUs += costUs;
+    Entry &file = files[path];
+    if (truncate)
+      file.data.clear();
+    file.data.append((const char *)data, length);
+    file.modifiedS = NOW_S;
+    return true;
+  }
+
+  bool remove(const char *path) override
+  {
+    clockUs += costUs;
+    removed.push_back(path);
+    return files.erase(path) > 0;
+  }
+
+  uint32_t micros() override { return clockUs; }
+
+  struct Entry
+  {
+    std::string data;
+    uint32_t modifiedS;
+  };
+
+  uint64_t capacity;
+  std::map<std::string, Entry> files;
+  std::vector<std::string> removed;
+  std::string cursor;
+  bool listing = false;
+  uint32_t clockUs = 0;
+  uint32_t costUs = 0;
+};
+
+// Steps until the engine has nothing left to do this scan interval
+void runScan(RetentionEngine &engine)
+{
+  for (int i = 0; i < 100000 && engine.step(); i++)
+  {
+  }
+}
+
+// A trend CSV of one reading a second from startMs
+std::string trendCsv(uint32_t startMs, uint32_t rows)
+{
+  std::string text = "timestamp,heartRate,systolicBP,diastolicBP,spO2,temperature,ecgValue,pressure,status\r\n";
+  for (uint32_t i = 0; i < rows; i++)
+  {
+    char row[128];
+    snprintf(row, sizeof(row), "%lu,72.0,120.0,80.0,97.0,98.6,2048,1013.25,%s\r\n",
+             (unsigned long)(startMs + i * 1000), i == 70 ? "ALERT" : "NORMAL");
+    text += row;
+  }
+  return text;
+}
+
+RetentionPolicy policy(uint32_t waveformS, uint32_t vitalsS, uint8_t minFreePercent)
+{
+  RetentionPolicy rules = DEFAULT_RETENTION;
+  rules.maxAgeS[RETAIN_WAVEFORM] = waveformS;
+  rules.maxAgeS[RETAIN_VITALS] = vitalsS;
+  rules.minFreePercent = minFreePercent;
+  return rules;
+}
+
+} // namespace
+
+VITALCARE_TEST(Retention, ClassesFilesByName)
+{
+  CHECK_EQ(retentionClass("/vitalcare/P-01_0001.edf"), RETAIN_WAVEFORM);
+  CHECK_EQ(retentionClass("/vitalcare/capture.vcs"), RETAIN_WAVEFORM);
+  CHECK_EQ(retentionClass("/vitalcare/P-01.csv"), RETAIN_VITALS);
+  CHECK_EQ(retentionClass("/vitalcare/P-01-rollup.csv"), RETAIN_ROLLUP);
+  CHECK_EQ(retentionClass("/vitalcare/spare.seg"), RETAIN_KEEP);
+  CHECK_EQ(retentionClass(".edf.tmp"), RETAIN_KEEP);
+  CHECK(strcmp(retentionClassName(RETAIN_KEEP), "keep") == 0);
+}
+
+VITALCARE_TEST(Retention, AgeDeletesWaveformAndCompactsVitals)
+{
+  MemoryCard card(1u << 30);
+  card.add("/v/old.edf", std::string(4096, 'x'), NOW_S - 8 * DAY_S);
+  card.add("/v/new.edf", std::string(4096, 'x'), NOW_S - 6 * DAY_S);
+  card.add("/v/old.csv", trendCsv(60000, 120), NOW_S - 91 * DAY_S);
+  card.add("/v/new.csv", trendCsv(60000, 10), NOW_S - 89 * DAY_S);
+  card.add("/v/old-rollup.csv.bak", "kept", 0);
+  card.add("/v/spare.seg", std::string(512, 0), 0);
+
+  RetentionEngine engine(card, policy(7 * DAY_S, 90 * DAY_S, 10));
+  CHECK(!engine.step()); // No clock yet
+  engine.setClock(NOW_S, NOW_S);
+  runScan(engine);
+
+  CHECK(!card.has("/v/old.edf"));
+  CHECK(card.has("/v/new.edf"));
+  CHECK(!card.has("/v/old.csv"));
+  CHECK(card.has("/v/new.csv"));
+  CHECK(card.has("/v/old-rollup.csv.bak"));
+  CHECK(card.has("/v/spare.seg"));
+  CHECK(!engine.busy());
+
+  const RetentionStats &stats = engine.stats();
+  CHECK_EQ(stats.scans, 1u);
+  CHECK_EQ(stats.deleted[RETAIN_WAVEFORM], 1u);
+  CHECK_EQ(stats.deleted[RETAIN_VITALS], 1u);
+  CHECK_EQ(stats.compacted, 1u);
+  CHECK_EQ(stats.rollupRows, 2u);
+  CHECK_EQ(stats.failed, 0u);
+  CHECK_EQ(stats.held, 0u);
+
+  // Two minutes of readings: a row per minute, the alert in the second
+  CHECK(card.has("/v/old-rollup.csv"));
+  const std::string &rollup = card.files["/v/old-rollup.csv"].data;
+  CHECK_EQ(rollup.compare(0, strlen(RETENTION_ROLLUP_HEADER), RETENTION_ROLLUP_HEADER), 0);
+  unsigned long timestamp = 0;
+  unsigned readings = 0, alert = 2;
+  float heartRate = 0;
+  const char *row = rollup.c_str() + strlen(RETENTION_ROLLUP_HEADER);
+  CHECK_EQ(sscanf(row, "%lu,%u,%f,%*f,%*f,%*f,%*f,%u", &timestamp, &readings, &heartRate, &alert), 4);
+  CHECK_EQ(timestamp, 119000ul);
+  CHECK_EQ(readings, 60u);
+  CHECK_NEAR(heartRate, 72.0f, 0.01f);
+  CHECK_EQ(alert, 0u);
+  row = strchr(row, '\n') + 1;
+  CHECK_EQ(sscanf(row, "%lu,%u,%f,%*f,%*f,%*f,%*f,%u", &timestamp, &readings, &heartRate, &alert), 4);
+  CHECK_EQ(timestamp, 179000ul);
+  CHECK_EQ(alert, 1u);
+
+  // Rollups are kept forever
+  engine.setClock(NOW_S + 1000 * DAY_S, NOW_S + 1000 * DAY_S);
+  runScan(engine);
+  CHECK(card.has("/v/old-rollup.csv"));
+}
+
+VITALCARE_TEST(Retention, UploadPendingFilesAreHeld)
+{
+  MemoryCard card(1u << 30);
+  card.add("/v/a.edf", "x", NOW_S - 30 * DAY_S);
+  card.add("/v/b.edf", "x", NOW_S - 20 * DAY_S);
+  card.add("/v/c.csv", trendCsv(0, 5), NOW_S - 100 * DAY_S);
+
+  // Collected up to between a and b: b is past its age but not uploaded
+  RetentionEngine engine(card, policy(7 * DAY_S, 90 * DAY_S, 10));
+  engine.setClock(NOW_S, NOW_S - 25 * DAY_S);
+  runScan(engine);
+  CHECK(!card.has("/v/a.edf"));
+  CHECK(card.has("/v/b.edf"));
+  CHECK(!card.has("/v/c.csv"));
+  CHECK_EQ(engine.stats().held, 1u);
+
+  // Once the watermark passes it, it goes at the next scan
+  engine.setClock(NOW_S + DEFAULT_RETENTION.scanIntervalS, NOW_S);
+  runScan(engine);
+  CHECK(!card.has("/v/b.edf"));
+  CHECK_EQ(engine.stats().held, 0u);
+  CHECK_EQ(engine.stats().scans, 2u);
+}
+
+VITALCARE_TEST(Retention, WatermarkDeletesOldestWaveformFirst)
+{
+  // 10% of 10000 bytes must stay free; 9800 are used and nothing is due
+  MemoryCard card(10000);
+  card.add("/v/a.csv", std::string(2500, ','), NOW_S - 50 * DAY_S);
+  card.add("/v/b.edf", std::string(2500, 'x'), NOW_S - 3 * DAY_S);
+  card.add("/v/c.edf", std::string(2500, 'x'), NOW_S - 4 * DAY_S);
+  card.add("/v/d.edf", std::string(2300, 'x'), NOW_S - 2 * DAY_S);
+
+  RetentionEngine engine(card, policy(7 * DAY_S, 90 * DAY_S, 10));
+  engine.setClock(NOW_S, NOW_S);
+  runScan(engine);
+
+  // The oldest waveform went even though the CSV is older; one was enough
+  CHECK(card.removed == std::vector<std::string>({"/v/c.edf"}));
+  CHECK(card.has("/v/a.csv"));
+  CHECK_EQ(engine.stats().deleted[RETAIN_WAVEFORM], 1u);
+  CHECK_EQ(engine.stats().deletedBytes, 2500u);
+  CHECK(!engine.stats().pressure);
+
+  // Filling up again takes the next, oldest first, until free
+  card.add("/v/e.edf", std::string(2400, 'x'), NOW_S);
+  engine.setClock(NOW_S + DEFAULT_RETENTION.scanIntervalS, NOW_S + DEFAULT_RETENTION.scanIntervalS);
+  runScan(engine);
+  CHECK(card.removed == std::vector<std::string>({"/v/c.edf", "/v/b.edf"}));
+  CHECK(card.has("/v/d.edf"));
+  CHECK(card.has("/v/e.edf"));
+  CHECK_EQ(engine.stats().scans, 4u);
+}
+
+VITALCARE_TEST(Retention, WatermarkNeverTakesUploadPendingFiles)
+{
+  MemoryCard card(10000);
+  card.add("/v/a.edf", std::string(4000, 'x'), NOW_S - 2 * DAY_S);
+  card.add("/v/b.edf", std::string(5500, 'x'), NOW_S - 1 * DAY_S);
+  card.add("/v/keep.bin", std::string(400, 'x'), 0);
+
+  RetentionEngine engine(card, policy(7 * DAY_S, 90 * DAY_S, 10));
+  engine.setClock(NOW_S, NOW_S - 3 * DAY_S);
+  runScan(engine);
+  CHECK(card.removed.empty());
+  CHECK_EQ(engine.stats().held, 2u);
+  CHECK(engine.stats().pressure); // Below the watermark with nothing to delete
+}
+
+VITALCARE_TEST(Retention, StepsStayWithinTheTimeBudget)
+{
+  MemoryCard card(1u << 30);
+  for (int i = 0; i < 20; i++)
+  {
+    char path[32];
+    snprintf(path, sizeof(path), "/v/%02d.edf", i);
+    card.add(path, "x", NOW_S - 10 * DAY_S);
+  }
+  card.costUs = 600;
+
+  // 1000 us a second: a second's credit runs out during the second step
+  RetentionPolicy rules = policy(7 * DAY_S, 90 * DAY_S, 10);
+  rules.budgetUsPerS = 1000;
+  RetentionEngine engine(card, rules);
+  engine.setClock(NOW_S, NOW_S);
+  CHECK(engine.step()); // The rewind
+  CHECK(engine.step()); // An entry and its delete
+  CHECK(!engine.step());
+  CHECK_EQ(engine.stats().busyUs, 1800u);
+  CHECK_EQ(engine.stats().maxStepUs, 1200u);
+
+  // Credit comes back with time, but no more than a second's worth
+  card.clockUs += 10000000;
+  int steps = 0;
+  while (engine.step())
+    steps++;
+  CHECK_EQ(steps, 1);
+
+  while (engine.busy())
+  {
+    card.clockUs += 1000000;
+    runScan(engine);
+  }
+  CHECK_EQ(engine.stats().deleted[RETAIN_WAVEFORM], 20u);
+  CHECK(engine.stats().busyUs <= (uint64_t)card.clockUs / 1000 + rules.budgetUsPerS + 1200);
+}
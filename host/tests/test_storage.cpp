@@ -0,0 +1,99 @@
+/*
+ * VitalCare Rural - Storage write queue tests
+ */
+
+#include <cstring>
+
+#include "Test.h"
+
+#include "vitalcare/StorageQueue.h"
+
+using namespace vitalcare;
+
+VITALCARE_TEST(StorageQueue, AppendSubmitsFullBuffers)
+{
+  uint8_t storage[2 * 32];
+  StorageChannel channel;
+  channel.begin(storage, 32, 2, STORAGE_BLOCK);
+  uint8_t payload[20] = {0};
+  CHECK(channel.append(STORAGE_WRITE, 0, payload, sizeof(payload), 7));
+  CHECK_EQ(channel.queued(), 0);
+  CHECK(channel.append(STORAGE_WRITE, 0, payload, sizeof(payload)));
+  CHECK_EQ(channel.queued(), 1); // The first did not fit the second
+  CHECK(!channel.append(STORAGE_WRITE, 0, payload, sizeof(payload)));
+  CHECK_EQ(channel.stats().overflows, 1u);
+
+  size_t length = 0;
+  uint32_t tag = 0;
+  const uint8_t *data = channel.take(length, tag);
+  CHECK(data == storage);
+  CHECK_EQ(length, 24u);
+  CHECK_EQ(tag, 7u);
+  channel.release(true);
+  CHECK_EQ(channel.stats().written, 1u);
+}
+
+VITALCARE_TEST(StorageQueue, TakeWaitsForReservedCopies)
+{
+  uint8_t storage[2 * 32];
+  StorageChannel channel;
+  channel.begin(storage, 32, 2, STORAGE_BLOCK);
+  uint8_t buffer = 0xFF;
+  uint8_t *out = channel.reserve(STORAGE_WRITE, 1, 5, 0, buffer);
+  CHECK(out != nullptr);
+  CHECK_EQ(buffer, 0);
+  channel.submit();
+  CHECK_EQ(channel.queued(), 1);
+
+  size_t length = 0;
+  uint32_t tag = 0;
+  CHECK(channel.take(length, tag) == nullptr); // Still being copied
+  std::memcpy(out, "hello", 5);
+  CHECK(channel.commit(buffer)); // Next for the writer now
+  const uint8_t *data = channel.take(length, tag);
+  CHECK(data != nullptr);
+  CHECK_EQ(length, 9u);
+  CHECK_EQ(data[0], STORAGE_WRITE);
+  CHECK_EQ(data[1], 1);
+  CHECK_EQ(std::memcmp(data + STORAGE_COMMAND_HEADER_SIZE, "hello", 5), 0);
+  channel.release(true);
+
+  // A commit into a buffer still filling frees nothing for the writer
+  out = channel.reserve(STORAGE_FLUSH, 1, 0, 0, buffer);
+  CHECK(out != nullptr);
+  CHECK(!channel.commit(buffer));
+  CHECK(channel.take(length, tag) == nullptr);
+}
+
+VITALCARE_TEST(StorageQueue, LaterBuffersWaitBehindAReservedCopy)
+{
+  uint8_t storage[2 * 32];
+  StorageChannel channel;
+  channel.begin(storage, 32, 2, STORAGE_BLOCK);
+  uint8_t first = 0xFF;
+  uint8_t *out = channel.reserve(STORAGE_WRITE, 1, 20, 1, first);
+  CHECK(out != nullptr);
+  uint8_t payload[20] = {0};
+  CHECK(channel.append(STORAGE_WRITE, 2, payload, sizeof(payload), 2)); // Into the second buffer
+  channel.submit();
+  CHECK_EQ(channel.queued(), 2);
+
+  // The writer must not skip ahead: files would see writes out of order
+  size_t length = 0;
+  uint32_t tag = 0;
+  CHECK(channel.take(length, tag) == nullptr);
+  std::memset(out, 0xAB, 20);
+  CHECK(channel.commit(first));
+  const uint8_t *data = channel.take(length, tag);
+  CHECK(data != nullptr);
+  CHECK_EQ(tag, 1u);
+  CHECK_EQ(data[1], 1);
+  CHECK_EQ(data[STORAGE_COMMAND_HEADER_SIZE], 0xAB);
+  channel.release(true);
+  data = channel.take(length, tag);
+  CHECK(data != nullptr);
+  CHECK_EQ(tag, 2u);
+  CHECK_EQ(data[1], 2);
+  channel.release(true);
+  CHECK(channel.take(length, tag) == nullptr);
+}
@@ -0,0 +1,270 @@
+/*
+ * VitalCare Rural - Gateway time-series store tests
+ */
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+#include "Gorilla.h"
+#include "TimeSeriesStore.h"
+#include "WriteAheadLog.h"
+
+using namespace vitalcare;
+using namespace vitalcare::gateway;
+
+namespace
+{
+
+struct StoreDir
+{
+  std::string path;
+
+  StoreDir()
+  {
+    char name[] = "/tmp/vitalcare-tsdb-XXXXXX";
+    path = mkdtemp(name);
+  }
+  ~StoreDir() { std::system(("rm -rf '" + path + "'").c_str()); }
+};
+
+// Encoded vital records first..first+count-1, one per second
+std::vector<uint8_t> vitalRecords(uint32_t first, size_t count)
+{
+  std::vector<uint8_t> bytes(count * VITAL_RECORD_SIZE);
+  for (size_t i = 0; i < count; i++)
+  {
+    VitalRecord record = {};
+    record.sequence = first + (uint32_t)i;
+    record.vitals = {70.0f + i % 7, 120.0f, 80.0f, 97.5f, 98.6f, record.sequence * 1000 + (uint32_t)(i % 3)};
+    record.alertFlags = i % 50 == 0 ? 1 : 0;
+    encodeVitalRecord(record, bytes.data() + i * VITAL_RECORD_SIZE);
+  }
+  return bytes;
+}
+
+} // namespace
+
+VITALCARE_TEST(Gorilla, BitsRoundTrip)
+{
+  BitWriter writer;
+  writer.writeBit(true);
+  writer.write(0x5, 3);
+  writer.write(0x1234, 13);
+  writer.write(0xFEDCBA9876543210ull, 64);
+  CHECK_EQ(writer.bits(), 81u);
+  CHECK_EQ(writer.byteLength(), 11u);
+
+  BitReader reader(writer.data(), writer.bits());
+  CHECK(reader.readBit());
+  CHECK_EQ(reader.read(3), 0x5u);
+  CHECK_EQ(reader.read(13), 0x1234u);
+  CHECK_EQ(reader.read(64), 0xFEDCBA9876543210ull);
+  CHECK(reader.ok());
+  CHECK_EQ(reader.read(1), 0u); // past the end
+  CHECK(!reader.ok());
+}
+
+VITALCARE_TEST(Gorilla, DeltaOfDeltaRoundTrips)
+{
+  // Steady, jittered, each control code's range and a huge jump
+  const int64_t values[] = {1000,   2000,   3000,   4003,   4999,   6000,    6100,   6400,
+                            7300,   9300,   9301,   -5,     1ll << 40, (1ll << 40) + 1, 0, 0};
+  BitWriter column;
+  DeltaOfDeltaEncoder encoder;
+  for (int64_t value : values)
+    encoder.append(column, value);
+
+  BitReader reader(column.data(), column.bits());
+  DeltaOfDeltaDecoder decoder;
+  for (int64_t value : values)
+    CHECK_EQ(decoder.next(reader), value);
+  CHECK(reader.ok());
+
+  // A 1 Hz clock costs one bit per row once the delta is known
+  BitWriter steady;
+  DeltaOfDeltaEncoder clock;
+  for (int64_t t = 0; t < 100; t++)
+    clock.append(steady, t * 1000);
+  CHECK_EQ(steady.bits(), 64u + 16u + 98u);
+}
+
+VITALCARE_TEST(Gorilla, XorRoundTrips)
+{
+  const float values[] = {72.0f, 72.0f, 72.5f, 71.9f, 0.0f, -40.5f, 98.6f, 98.6f, 1e-3f, 3.4e38f, 72.0f};
+  BitWriter column;
+  XorEncoder encoder;
+  for (float value : values)
+    encoder.append(column, value);
+
+  BitReader reader(column.data(), column.bits());
+  XorDecoder decoder;
+  for (float value : values)
+    CHECK_EQ(decoder.next(reader), value);
+  CHECK(reader.ok());
+
+  // Repeats cost one bit each
+  BitWriter same;
+  XorEncoder repeat;
+  for (int i = 0; i < 10; i++)
+    repeat.append(same, 97.5f);
+  CHECK_EQ(same.bits(), 32u + 9u);
+}
+
+VITALCARE_TEST(Gorilla, RepeatRoundTrips)
+{
+  const uint32_t values[] = {0, 0, 0, 0x101, 0x101, 1, 0, 0xFFFF, 0xFFFF, 0};
+  BitWriter column;
+  RepeatEncoder encoder(16);
+  for (uint32_t value : values)
+    encoder.append(column, value);
+
+  BitReader reader(column.data(), column.bits());
+  RepeatDecoder decoder(16);
+  for (uint32_t value : values)
+    CHECK_EQ(decoder.next(reader), value);
+  CHECK(reader.ok());
+}
+
+VITALCARE_TEST(WriteAheadLog, TornTailEndsReplay)
+{
+  StoreDir dir;
+  std::vector<uint8_t> records = vitalRecords(1, 3);
+  {
+    WriteAheadLog wal(dir.path, false);
+    CHECK(wal.open([](uint64_t, uint64_t, const uint8_t *, size_t) {}));
+    for (uint64_t device = 1; device <= 3; device++)
+      wal.waitDurable(wal.append(device, records.data(), 3));
+    CHECK(wal.ok());
+    CHECK_EQ(wal.lastLsn(), 3u);
+  }
+
+  // Tear the last entry as a crash mid-write would
+  std::string path = dir.path + "/wal-000001.log";
+  CHECK_EQ(truncate(path.c_str(), (off_t)(2 * (26 + 3 * VITAL_RECORD_SIZE) + 20)), 0);
+
+  std::vector<uint64_t> lsns;
+  std::vector<uint64_t> devices;
+  WriteAheadLog wal(dir.path, false);
+  CHECK(wal.open([&](uint64_t lsn, uint64_t deviceId, const uint8_t *data, size_t count) {
+    lsns.push_back(lsn);
+    devices.push_back(deviceId);
+    CHECK_EQ(count, 3u);
+    CHECK(std::equal(data, data + count * VITAL_RECORD_SIZE, records.data()));
+  }));
+  CHECK_EQ(lsns.size(), 2u);
+  CHECK(lsns == std::vector<uint64_t>({1, 2}));
+  CHECK(devices == std::vector<uint64_t>({1, 2}));
+
+  // Appends carry on after what was replayed, in a new file
+  uint64_t lsn = wal.append(4, records.data(), 3);
+  wal.waitDurable(lsn);
+  CHECK_EQ(lsn, 3u);
+  CHECK(access((dir.path + "/wal-000002.log").c_str(), F_OK) == 0);
+}
+
+VITALCARE_TEST(WriteAheadLog, CorruptEntryEndsReplay)
+{
+  StoreDir dir;
+  std::vector<uint8_t> records = vitalRecords(1, 2);
+  {
+    WriteAheadLog wal(dir.path, false);
+    CHECK(wal.open([](uint64_t, uint64_t, const uint8_t *, size_t) {}));
+    for (int i = 0; i < 3; i++)
+      wal.waitDurable(wal.append(7, records.data(), 2));
+  }
+
+  // Flip a record byte of the second entry: its CRC no longer matches
+  std::string path = dir.path + "/wal-000001.log";
+  FILE *file = fopen(path.c_str(), "r+b");
+  CHECK(file != nullptr);
+  long entry = 26 + 2 * VITAL_RECORD_SIZE;
+  fseek(file, entry + 30, SEEK_SET);
+  int byte = fgetc(file);
+  fseek(file, entry + 30, SEEK_SET);
+  fputc(byte ^ 0x40, file);
+  fclose(file);
+
+  size_t replayed = 0;
+  WriteAheadLog wal(dir.path, false);
+  CHECK(wal.open([&](uint64_t, uint64_t, const uint8_t *, size_t) { replayed++; }));
+  CHECK_EQ(replayed, 1u);
+}
+
+VITALCARE_TEST(TimeSeriesStore, ReopenReplaysWithoutDuplicates)
+{
+  StoreDir dir;
+  StoreDir crashed;
+  StoreOptions options;
+  options.syncWal = false;
+  options.chunkRows = 16; // batches of 10 span chunks
+  options.segmentBytes = 1u << 20;
+
+  const uint32_t total = 95;
+  {
+    TimeSeriesStore store(dir.path, options);
+    CHECK(store.open());
+    for (uint32_t first = 1; first <= total; first += 10)
+    {
+      size_t count = std::min<uint32_t>(10, total - first + 1);
+      std::vector<uint8_t> records = vitalRecords(first, count);
+      CHECK(store.append(11, records.data(), count));
+      if (first == 41)
+        CHECK(store.checkpoint());
+      std::vector<uint8_t> other = vitalRecords(first, 1);
+      CHECK(store.append(12, other.data(), 1));
+    }
+
+    // A crash now: sealed chunks and the log, but no final checkpoint
+    CHECK_EQ(std::system(("cp -a '" + dir.path + "/.' '" + crashed.path + "'").c_str()), 0);
+  }
+
+  for (const std::string &path : {crashed.path, dir.path})
+  {
+    TimeSeriesStore store(path, options);
+    CHECK(store.open());
+    std::vector<VitalRecord> rows;
+    CHECK_EQ(store.query(11, 0, UINT32_MAX, rows), (size_t)total);
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+      CHECK_EQ(rows[i].sequence, i + 1);
+      CHECK_EQ(rows[i].vitals.timestampMs, (i + 1) * 1000 + (i % 10) % 3);
+    }
+    rows.clear();
+    CHECK_EQ(store.query(12, 0, UINT32_MAX, rows), 10u);
+    CHECK(store.seriesIds() == std::vector<uint64_t>({11, 12}));
+
+    // The sequence index is rebuilt from the chunks and the log
+    CHECK(store.contains(11, 1));
+    CHECK(store.contains(11, total));
+    CHECK(!store.contains(11, total + 1));
+    CHECK(!store.contains(12, 2));
+    std::vector<uint32_t> recent;
+    store.recentSequences(11, 5, recent);
+    CHECK(recent == std::vector<uint32_t>({91, 92, 93, 94, 95}));
+  }
+}
+
+VITALCARE_TEST(TimeSeriesStore, QueryFiltersByTime)
+{
+  StoreDir dir;
+  StoreOptions options;
+  options.syncWal = false;
+  options.chunkRows = 8;
+  options.segmentBytes = 1u << 20;
+  TimeSeriesStore store(dir.path, options);
+  CHECK(store.open());
+  std::vector<uint8_t> records = vitalRecords(1, 40);
+  CHECK(store.append(3, records.data(), 40));
+
+  std::vector<VitalRecord> rows;
+  CHECK_EQ(store.query(3, 10000, 19999, rows), 10u);
+  CHECK_EQ(rows.front().sequence, 10u);
+  CHECK_EQ(rows.back().sequence, 19u);
+  rows.clear();
+  CHECK_EQ(store.query(4, 0, UINT32_MAX, rows), 0u);
+}
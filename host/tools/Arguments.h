@@ -0,0 +1,72 @@
+/*
+ * VitalCare Rural - Host Tool Arguments
+ *
+ * The host tools take positional arguments only. These checks take an
+ * argument whole or not at all: "8h" and "" are not numbers, and anything
+ * starting with '-' ("--help") is refused before a tool can take it for a
+ * file name or a count. A tool prints its usage line and exits with 2 when
+ * one fails. Gateway programs that take "--option value" pairs check the
+ * values with the same parsers.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace vitalcare
+{
+namespace tools
+{
+
+// No argument after the program name looks like an option
+inline bool positionalOnly(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (argv[i][0] == '-')
+      return false;
+  }
+  return true;
+}
+
+// Decimal, 0x hex or 0 octal, as strtoull() reads them, up to max
+inline bool parseUnsigned(const char *text, uint64_t max, uint64_t &value)
+{
+  if (text[0] < '0' || text[0] > '9')
+    return false;
+  errno = 0;
+  char *end;
+  unsigned long long parsed = strtoull(text, &end, 0);
+  if (*end != '\0' || errno == ERANGE || parsed > max)
+    return false;
+  value = parsed;
+  return true;
+}
+
+inline bool parseUnsigned(const char *text, uint32_t &value)
+{
+  uint64_t parsed;
+  if (!parseUnsigned(text, UINT32_MAX, parsed))
+    return false;
+  value = (uint32_t)parsed;
+  return true;
+}
+
+// A finite number within [min, max]
+inline bool parseNumber(const char *text, double min, double max, double &value)
+{
+  if ((text[0] < '0' || text[0] > '9') && text[0] != '.')
+    return false;
+  char *end;
+  double parsed = strtod(text, &end);
+  if (*end != '\0' || !std::isfinite(parsed) || parsed < min || parsed > max)
+    return false;
+  value = parsed;
+  return true;
+}
+
+} // namespace tools
+} // namespace vitalcare
@@ -0,0 +1,128 @@
+/*
+ * VitalCare Rural - Synthetic Sensor Capture
+ *
+ * Writes the sensor capture (Capture.h) a VITALCARE_CAPTURE build would
+ * record overnight, from simulated sensors on esp32-main's schedule: a
+ * 100 ms read of the AD8232 (SimulatedEcg), the pulse sensor and the
+ * MAX30102 (real driver on SimulatedI2cBus), a BMP180 reading, and a 1 s
+ * update. A patient with an emergency contact registers after 10 s; an
+ * hour in, the leads come off for two minutes, and halfway through SpO2
+ * falls to the given value for ten minutes. Decisions come from the same
+ * BedsideMonitor, as the device records them, so `vitalcare-replay` must match.
+ *
+ * Usage: vitalcare-capture-synth OUT.vcs [hours] [desaturated spo2%] [seed]
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Arguments.h"
+#include "SimulatedEcg.h"
+#include "SimulatedI2cBus.h"
+#include "SimulatedMax30102.h"
+
+using namespace vitalcare;
+using namespace vitalcare::tools;
+
+int main(int argc, char **argv)
+{
+  double hours = 8.0;
+  double desaturatedSpO2 = 88.0;
+  uint32_t seed = 1;
+  if (argc < 2 || argc > 5 || !positionalOnly(argc, argv) ||
+      (argc > 2 && (!parseNumber(argv[2], 0, 1000, hours) || hours <= 0)) ||
+      (argc > 3 && !parseNumber(argv[3], 0, 100, desaturatedSpO2)) || (argc > 4 && !parseUnsigned(argv[4], seed)))
+  {
+    fprintf(stderr, "usage: %s OUT.vcs [hours] [desaturated spo2%%] [seed]\n", argv[0]);
+    return 2;
+  }
+  float desaturated = (float)desaturatedSpO2;
+  FILE *out = fopen(argv[1], "wb");
+  if (!out)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  const uint32_t READ_MS = 100;
+  const uint32_t UPDATE_MS = 1000;
+  const uint32_t REGISTER_MS = 10000;
+  const uint16_t ECG_RATE_HZ = 500;
+  const float HEART_RATE = 72.0f;
+  uint32_t endMs = (uint32_t)(hours * 3600000);
+  uint32_t leadsOffMs = 3600000, leadsOnMs = leadsOffMs + 120000;
+  uint32_t desatMs = endMs / 2, desatEndMs = desatMs + 600000;
+
+  sim::SimulatedEcg ecg(ECG_RATE_HZ, HEART_RATE, seed);
+  ecg.addEpisode({sim::EcgEpisode::LEADS_OFF, leadsOffMs / 1000.0, (leadsOnMs - leadsOffMs) / 1000.0, 0});
+  sim::SimulatedI2cBus bus;
+  sim::SimulatedMax30102 oximeter(97.0f, HEART_RATE);
+  bus.attach(oximeter);
+  Max3010x spo2Sensor(bus);
+  spo2Sensor.begin();
+  bus.drain();
+
+  BedsideMonitor monitor;
+  monitor.begin(0, seed);
+  std::vector<uint8_t> capture(CAPTURE_HEADER_SIZE);
+  CaptureHeader header = {0x5643000000000001ull, seed, 0};
+  encodeCaptureHeader(header, capture.data());
+  uint8_t event[CAPTURE_MAX_EVENT_SIZE];
+  auto append = [&](size_t length) { capture.insert(capture.end(), event, event + length); };
+
+  std::vector<int16_t> ecgSamples(ECG_RATE_HZ * READ_MS / 1000);
+  bool registered = false;
+  uint64_t sms = 0;
+  for (uint32_t now = READ_MS; now <= endMs; now += READ_MS)
+  {
+    oximeter.setSpO2(now >= desatMs && now < desatEndMs ? desaturated : 97.0f);
+    bus.advance(READ_MS * 1000);
+    ecg.generate(ecgSamples.data(), ecgSamples.size());
+
+    SensorInputs inputs = {};
+    inputs.timeMs = now;
+    int16_t ecgValue = ecgSamples.back();
+    inputs.leadsOff = ecgValue == ECG_LEADS_OFF;
+    inputs.ecg = inputs.leadsOff ? 0 : (uint16_t)ecgValue;
+    double phase = fmod(now / 1000.0 * HEART_RATE / 60.0, 1.0);
+    inputs.pulse = (uint16_t)(1800 + 700 * exp(-phase * 6.0) + (now / READ_MS * 37 % 41));
+    inputs.environment = true;
+    inputs.temperatureC = 36.9f + 0.2f * (float)sin(now / 3600000.0);
+    inputs.pressurePa = 101200.0f;
+    inputs.spo2Ready = spo2Sensor.ready();
+    spo2Sensor.poll();
+    bus.drain();
+    while (inputs.ppgCount < BEDSIDE_MAX_PPG_SAMPLES && spo2Sensor.read(inputs.ppg[inputs.ppgCount]))
+      inputs.ppgCount++;
+    append(encodeCaptureSensors(inputs, event));
+    monitor.onSensors(inputs);
+
+    if (!registered && now >= REGISTER_MS)
+    {
+      append(encodeCapturePatient(now, "VCR10000123", "Synthetic Patient", event));
+      registered = true;
+    }
+    if (now % UPDATE_MS == 0)
+    {
+      append(encodeCaptureUpdate(now, registered, registered, event));
+      BedsideDecision decision = monitor.update(now, registered, registered);
+      if (registered)
+        append(encodeCaptureDecision(now, decision, event));
+      sms += decision.sms ? 1 : 0;
+    }
+  }
+
+  if (fwrite(capture.data(), 1, capture.size(), out) != capture.size() || fclose(out) != 0)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  printf("Wrote %.1f h of capture, %.1f MB: SpO2 %.0f%% from %.2f h for 10 min, leads off at 1 h; "
+         "the device would have sent %llu SMS\n",
+         hours, capture.size() / 1e6, desaturated, desatMs / 3600000.0, (unsigned long long)sms);
+  return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * VitalCare Rural - File System Benchmark
+ *
+ * Runs esp32-bench's file system workload (host/bench/FsWorkload.h) against
+ * a directory: open, 4 KB read, 512-byte append and create latency at 0 to
+ * 90% fill. Point it at an SD card in a reader to see how the card and FAT
+ * behave as they fill, or at any directory with a capacity to fill within.
+ * Writes are fsync()ed before close, as the device flushes on close; reads
+ * come from the page cache once a file has been read.
+ *
+ * Then the recording path's segment writes at the fill left: 4 KB writes
+ * into a 2 MB file that grows against one preallocated first (zeros
+ * written and synced), each fdatasync()ed, with the worst case and tail of
+ * each; the preallocation is the segment rotation's cost, moved to idle
+ * time on the device.
+ *
+ * Without CAPACITY_MB the fill levels are of the whole file system
+ * (statvfs), so only use that on a card or partition set aside for it.
+ * The device runs the same workload on SPIFFS and LittleFS; its JSON and
+ * this tool's share names and layout.
+ *
+ * Usage: vitalcare-fs-bench DIR [CAPACITY_MB] [OUT.json]
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "Arguments.h"
+#include "FsWorkload.h"
+
+using namespace vitalcare;
+using namespace vitalcare::bench;
+using namespace vitalcare::tools;
+
+class DirectoryFs
+{
+public:
+  DirectoryFs(const char *directory, uint64_t capacity)
+      : root(directory), capacity(capacity), written(0), segment(-1), segmentPosition(0), segmentEnd(0)
+  {
+  }
+
+  uint64_t totalBytes()
+  {
+    if (capacity)
+      return capacity;
+    struct statvfs info;
+    return statvfs(root.c_str(), &info) == 0 ? (uint64_t)info.f_blocks * info.f_frsize : 0;
+  }
+
+  uint64_t usedBytes()
+  {
+    if (capacity)
+      return written;
+    struct statvfs info;
+    return statvfs(root.c_str(), &info) == 0 ? (uint64_t)(info.f_blocks - info.f_bfree) * info.f_frsize : 0;
+  }
+
+  bool write(const char *path, const uint8_t *data, size_t length, bool append)
+  {
+    if (capacity && written + length > capacity)
+      return false;
+    std::string full = root + path;
+    uint64_t before = fileSize(full);
+    int fd = open(full.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0)
+      return false;
+    bool ok = ::write(fd, data, length) == (ssize_t)length && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    written = written - (append ? 0 : before) + (ok ? length : 0);
+    return ok;
+  }
+
+  bool read(const char *path, uint8_t *data, size_t length)
+  {
+    int fd = open((root + path).c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    bool ok = ::read(fd, data, length) == (ssize_t)length;
+    return close(fd) == 0 && ok;
+  }
+
+  bool touch(const char *path)
+  {
+    int fd = open((root + path).c_str(), O_RDONLY);
+    return fd >= 0 && close(fd) == 0;
+  }
+
+  bool remove(const char *path)
+  {
+    std::string full = root + path;
+    uint64_t size = fileSize(full);
+    if (unlink(full.c_str()) != 0)
+      return false;
+    written -= size < written ? size : written;
+    return true;
+  }
+
+  bool beginSegment(const char *path, uint32_t preallocate)
+  {
+    if (capacity && written + preallocate > capacity)
+      return false;
+    segment = open((root + path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (segment < 0)
+      return false;
+    // Zeros rather than posix_fallocate(): ext4 leaves fallocated extents
+    // unwritten and converts each on its first write, an allocation of its
+    // own, where FAT's preallocated clusters are plain overwrites
+    static const uint8_t zeros[65536] = {};
+    bool ok = true;
+    for (uint32_t at = 0; ok && at < preallocate; at += sizeof(zeros))
+    {
+      size_t length = preallocate - at < sizeof(zeros) ? preallocate - at : sizeof(zeros);
+      ok = ::write(segment, zeros, length) == (ssize_t)length;
+    }
+    ok = ok && fsync(segment) == 0 && lseek(segment, 0, SEEK_SET) == 0;
+    segmentPosition = 0;
+    segmentEnd = preallocate;
+    written += preallocate;
+    if (!ok)
+      endSegment();
+    return ok;
+  }
+
+  bool writeSegment(const uint8_t *data, size_t length)
+  {
+    if (capacity && segmentPosition + length > segmentEnd && written + length > capacity)
+      return false;
+    bool ok = ::write(segment, data, length) == (ssize_t)length && fdatasync(segment) == 0;
+    segmentPosition += ok ? length : 0;
+    if (segmentPosition > segmentEnd)
+    {
+      written += segmentPosition - segmentEnd;
+      segmentEnd = segmentPosition;
+    }
+    return ok;
+  }
+
+  void endSegment()
+  {
+    close(segment);
+    segment = -1;
+  }
+
+  uint32_t micros()
+  {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+private:
+  static uint64_t fileSize(const std::string &path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? (uint64_t)info.st_size : 0;
+  }
+
+  std::string root;
+  uint64_t capacity; // 0: the whole file system
+  uint64_t written;  // Bytes in benchmark files, against capacity
+  int segment;
+  uint64_t segmentPosition;
+  uint64_t segmentEnd; // Written or preallocated
+};
+
+int main(int argc, char **argv)
+{
+  double capacityMb = 0;
+  if (argc < 2 || argc > 4 || !positionalOnly(argc, argv) ||
+      (argc > 2 && !parseNumber(argv[2], 0, 1024.0 * 1024 * 1024, capacityMb)))
+  {
+    fprintf(stderr, "usage: %s DIR [CAPACITY_MB] [OUT.json]\n", argv[0]);
+    return 2;
+  }
+  uint64_t capacity = (uint64_t)(capacityMb * 1024 * 1024);
+  FILE *json = nullptr;
+  if (argc > 3)
+  {
+    json = fopen(argv[3], "w");
+    if (!json)
+    {
+      perror(argv[3]);
+      return 1;
+    }
+    fprintf(json,
+            "{\n  \"context\": {\"executable\": \"vitalcare-fs-bench\", \"directory\": \"%s\"},\n"
+            "  \"benchmarks\": [\n",
+            argv[1]);
+  }
+
+  DirectoryFs fs(argv[1], capacity);
+  if (fs.totalBytes() == 0)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  printf("📂 %s: %.1f MB, %.0f%% used\n", argv[1], fs.totalBytes() / 1048576.0,
+         fs.usedBytes() * 100.0 / fs.totalBytes());
+  printf("%-32s %6s %10s %10s %10s %9s\n", "Benchmark", "fill", "avg us", "p99 us", "max us", "failures");
+  int written = 0;
+  uint32_t failures = 0;
+  auto report = [&](const FsResult &result) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s/dir/fill:%u", fsOperationName(result.operation), result.targetFill);
+    printf("%-32s %5u%% %10u %10u %10u %9u\n", name, result.fill, result.latency.averageUs(),
+           result.latency.percentileUs(99), result.latency.maxUs(), result.failures);
+    failures += result.failures;
+    if (json)
+    {
+      char line[512];
+      formatFsResultJson("dir", result, line, sizeof(line));
+      fprintf(json, "%s    %s", written++ ? ",\n" : "", line);
+    }
+  };
+  runFsWorkload(fs, report);
+  runSegmentWorkload(fs, report);
+
+  if (json)
+  {
+    fprintf(json, "\n  ]\n}\n");
+    if (fclose(json) != 0)
+    {
+      perror(argv[3]);
+      return 1;
+    }
+  }
+  if (failures)
+    printf("⚠️ %u operations failed (file system full?)\n", failures);
+  return 0;
+}
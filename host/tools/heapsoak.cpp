@@ -0,0 +1,282 @@
+/*
+ * VitalCare Rural - Hot Path Heap Soak
+ *
+ * Runs esp32-main's timers on a virtual clock for hours, from simulated
+ * sensors, and counts every C++ heap allocation made along the way with
+ * the MemoryAccounting esp32-main reports in /api/metrics. Each tick calls
+ * the library code the device's loop() calls:
+ * - the 100 ms sensor read: BedsideMonitor, latency stamps, the waveform
+ *   history rings and BedsideRecording's EDF+ samples, and the capture event
+ * - the 1 s update: the decision, the alert text and annotation, the
+ *   history record and formatVitalsFrame() with its dashboard echo
+ * - the 30 s save: the history ring's CSV rows and the EDF+ header sync
+ * A patient registers at 10 s, SpO2 dips for ten minutes in the middle and
+ * the leads come off for two, so the alert paths run too. After the first
+ * minute the hot path (sensors, vitals, frames) must not allocate at all;
+ * the tool exits with 1 if it does. Only the pins, the radio, the web
+ * server and the SD card writer are left out; ctest soaks two hours.
+ *
+ * Usage: vitalcare-heap-soak [hours] [seed]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "SimulatedEcg.h"
+#include "SimulatedI2cBus.h"
+#include "SimulatedMax30102.h"
+
+using namespace vitalcare;
+
+// Zero-initialised, so allocations by static constructors are counted too
+static MemoryAccounting memory;
+
+static void *allocate(size_t size)
+{
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  memory.onAllocate(memory.current(), size);
+  return ptr;
+}
+
+static void release(void *ptr)
+{
+  if (!ptr)
+    return;
+  memory.onFree(memory.current());
+  free(ptr);
+}
+
+void *operator new(size_t size)
+{
+  return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  release(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  release(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  release(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+  release(ptr);
+}
+
+class NullEdfOutput : public EdfOutput
+{
+public:
+  bool write(const uint8_t *, size_t) override { return true; }
+  bool seek(uint64_t) override { return true; }
+};
+
+int main(int argc, char **argv)
+{
+  double hours = argc > 1 ? atof(argv[1]) : 24.0;
+  uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 1;
+
+  const uint32_t READ_MS = 100;
+  const uint32_t UPDATE_MS = 1000;
+  const uint32_t SAVE_MS = 30000;
+  const uint32_t REGISTER_MS = 10000;
+  const uint32_t WARMUP_MS = 60000;
+  const uint32_t HISTORY_SECONDS = 1800; // esp32-main without PSRAM
+  const uint32_t WAVEFORM_SECONDS = 30;
+  const uint16_t ECG_RATE_HZ = 500;
+  const float HEART_RATE = 72.0f;
+  uint32_t endMs = (uint32_t)(hours * 3600000);
+  uint32_t desatMs = endMs / 2, desatEndMs = desatMs + 600000;
+  double leadsOffSeconds = endMs / 4000.0;
+
+  // The simulated hardware is set up and run unscoped, as MEMORY_OTHER
+  sim::SimulatedEcg ecg(ECG_RATE_HZ, HEART_RATE, seed);
+  ecg.addEpisode({sim::EcgEpisode::LEADS_OFF, leadsOffSeconds, 120, 0});
+  sim::SimulatedI2cBus bus;
+  sim::SimulatedMax30102 oximeter(97.0f, HEART_RATE);
+  bus.attach(oximeter);
+  Max3010x spo2Sensor(bus);
+  spo2Sensor.begin();
+  bus.drain();
+  std::vector<int16_t> ecgSamples(ECG_RATE_HZ * READ_MS / 1000);
+
+  // esp32-main's state, all of it allocated up front as on the device
+  BedsideMonitor monitor;
+  monitor.begin(0, seed);
+  LatencyTracker latency;
+  static uint8_t historyRecords[HISTORY_SECONDS * HISTORY_RECORD_SIZE];
+  static int16_t waveform[WAVEFORM_SECONDS * (BEDSIDE_ECG_SAMPLES_PER_RECORD + 2 * BEDSIDE_PPG_SAMPLES_PER_RECORD)];
+  RecordRing vitalsHistory;
+  SampleRing ecgHistory, redHistory, irHistory;
+  vitalsHistory.begin(historyRecords, sizeof(historyRecords), HISTORY_RECORD_SIZE);
+  ecgHistory.begin(waveform, WAVEFORM_SECONDS * BEDSIDE_ECG_SAMPLES_PER_RECORD, BEDSIDE_ECG_SAMPLES_PER_RECORD);
+  redHistory.begin(waveform + WAVEFORM_SECONDS * BEDSIDE_ECG_SAMPLES_PER_RECORD,
+                   WAVEFORM_SECONDS * BEDSIDE_PPG_SAMPLES_PER_RECORD, BEDSIDE_PPG_SAMPLES_PER_RECORD);
+  irHistory.begin(waveform + WAVEFORM_SECONDS * (BEDSIDE_ECG_SAMPLES_PER_RECORD + BEDSIDE_PPG_SAMPLES_PER_RECORD),
+                  WAVEFORM_SECONDS * BEDSIDE_PPG_SAMPLES_PER_RECORD, BEDSIDE_PPG_SAMPLES_PER_RECORD);
+  NullEdfOutput edfOutput;
+  static uint8_t edfRecord[BEDSIDE_EDF_RECORD_BYTES];
+  EdfWriter edf(edfOutput, edfRecord, sizeof(edfRecord));
+  BedsideRecording recording;
+  EdfRecordingInfo info = {"VCR10000123", 'F', "Soak", "VitalCare-5643000000000001", 0, 0, 0, 0, 0, 0};
+  static uint8_t captureEvent[CAPTURE_MAX_EVENT_SIZE];
+  static char frame[384];
+  static char alertText[192];
+  static char csvLine[128];
+  static char csvBlock[512]; // One sector-sized writer command on the device
+  uint32_t saveCursor = 0;
+  uint32_t frameSeq = 0, historySeq = 0;
+  uint64_t checksum = 0, alertTicks = 0;
+
+  uint32_t warmHotPath = 0, warmAll = 0;
+  bool warm = false;
+  for (uint32_t now = READ_MS; now <= endMs; now += READ_MS)
+  {
+    uint32_t nowUs = now * 1000;
+    oximeter.setSpO2(now >= desatMs && now < desatEndMs ? 86.0f : 97.0f);
+    bus.advance(READ_MS * 1000);
+    ecg.generate(ecgSamples.data(), ecgSamples.size());
+    bool registered = now >= REGISTER_MS;
+
+    {
+      MemoryScope scope(memory, MEMORY_SENSORS);
+      SensorInputs inputs = {};
+      inputs.timeMs = now;
+      latency.onAcquired(nowUs);
+      int16_t ecgValue = ecgSamples.back();
+      inputs.leadsOff = ecgValue == ECG_LEADS_OFF;
+      inputs.ecg = inputs.leadsOff ? 0 : (uint16_t)ecgValue;
+      inputs.pulse = (uint16_t)(now % 833 < 100 ? 2600 : 1800);
+      inputs.environment = true;
+      inputs.temperatureC = 36.9f;
+      inputs.pressurePa = 101200.0f;
+      inputs.spo2Ready = spo2Sensor.ready();
+      spo2Sensor.poll();
+      bus.drain();
+      while (inputs.ppgCount < BEDSIDE_MAX_PPG_SAMPLES && spo2Sensor.read(inputs.ppg[inputs.ppgCount]))
+        inputs.ppgCount++;
+      checksum += encodeCaptureSensors(inputs, captureEvent);
+      if (monitor.onSensors(inputs))
+        latency.onBeat(nowUs, nowUs + 150);
+      ecgHistory.push(bedsideEcgSample(inputs, monitor.ecgValue()));
+      for (uint8_t i = 0; i < inputs.ppgCount; i++)
+      {
+        redHistory.push(bedsidePpgSample(inputs.ppg[i].red));
+        irHistory.push(bedsidePpgSample(inputs.ppg[i].ir));
+      }
+      recording.onSensors(inputs, monitor.ecgValue());
+    }
+
+    if (now % UPDATE_MS == 0)
+    {
+      const char *status = "No Patient";
+      {
+        MemoryScope scope(memory, MEMORY_VITALS);
+        BedsideDecision decision = monitor.update(now, registered, registered);
+        frameSeq = latency.onPublished(nowUs, decision.alertFlags);
+        if (registered)
+        {
+          status = "✅ Normal";
+          if (decision.alertFlags != ALERT_NONE)
+          {
+            formatAlertMessage(decision.alertFlags, monitor.sample(), alertText, sizeof(alertText));
+            status = "⚠️ ALERT";
+            alertTicks++;
+          }
+          recording.onAlerts(now, decision.alertFlags, alertText);
+        }
+        HistoryRecord record = {monitor.sample(), monitor.pressureHpa(), monitor.ecgValue(), decision.alertFlags};
+        record.vitals.timestampMs = now;
+        encodeHistoryRecord(record, vitalsHistory.reserve());
+        historySeq = vitalsHistory.commit();
+      }
+      {
+        MemoryScope scope(memory, MEMORY_FRAMES);
+        VitalsFrame vitals = {monitor.sample(), monitor.ecgValue(), monitor.pressureHpa(), status, frameSeq,
+                              historySeq};
+        vitals.vitals.timestampMs = now;
+        checksum += formatVitalsFrame(vitals, frame, sizeof(frame));
+        latency.onSent(frameSeq, nowUs + 2000);
+        latency.onEcho(frameSeq, nowUs + 20000, 9000);
+      }
+      {
+        MemoryScope scope(memory, MEMORY_STORAGE);
+        // The recording starts with the patient, as startEdfRecording() does
+        if (registered && !recording.recording())
+          recording.begin(edf, info, now);
+        edf.endRecord();
+      }
+    }
+
+    if (now % SAVE_MS == 0 && registered)
+    {
+      // saveDataToSD(): the updates since the last save as CSV rows, in
+      // sector-sized blocks
+      MemoryScope scope(memory, MEMORY_STORAGE);
+      size_t used = 0;
+      for (; saveCursor < vitalsHistory.nextSequence(); saveCursor++)
+      {
+        HistoryRecord record;
+        decodeHistoryRecord(vitalsHistory.at(saveCursor), record);
+        size_t length = formatHistoryCsvRow(record, csvLine, sizeof(csvLine));
+        if (used + length > sizeof(csvBlock))
+        {
+          checksum += used;
+          used = 0;
+        }
+        memcpy(csvBlock + used, csvLine, length);
+        used += length;
+      }
+      checksum += used;
+      edf.sync();
+    }
+
+    memory.update(now);
+    if (!warm && now >= WARMUP_MS)
+    {
+      warm = true;
+      warmHotPath = memory.hotPathAllocations();
+      warmAll = memory.allocations();
+    }
+  }
+  recording.close(endMs);
+
+  uint32_t steadyHotPath = memory.hotPathAllocations() - warmHotPath;
+  printf("%.1f h soaked: %u frames, %llu alerting, %u records in the EDF+ file (checksum %llu)\n", hours,
+         latency.framesSent(), (unsigned long long)alertTicks, edf.records(), (unsigned long long)checksum);
+  printf("%-8s %12s %12s %14s\n", "tag", "allocations", "frees", "bytes");
+  for (uint8_t i = 0; i < MEMORY_TAGS; i++)
+  {
+    const MemoryTagStats &stats = memory.tag(i);
+    printf("%-8s %12u %12u %14llu%s\n", memoryTagName(i), stats.allocations, stats.frees,
+           (unsigned long long)stats.bytes, isHotPath(i) ? "  (hot path)" : "");
+  }
+  printf("after the first minute: %u allocations, %u on the hot path\n", memory.allocations() - warmAll,
+         steadyHotPath);
+  if (steadyHotPath)
+  {
+    printf("❌ the hot path allocates in steady state (peak %u/s)\n", memory.peakHotPathPerSecond());
+    return 1;
+  }
+  printf("✅ no steady-state hot path allocations\n");
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * VitalCare Rural - Sensor Capture Replay
+ *
+ * Replays a device's sensor capture (Capture.h) through the same
+ * BedsideMonitor the firmware runs, on a virtual clock taken from the
+ * capture's timestamps, and writes the vitals, alerts and SMS decisions of
+ * every 1 s update as CSV. Two firmware versions replayed against one
+ * capture diff line by line. Decisions the device recorded are checked
+ * against the replay; the tool exits with 1 if any differ.
+ *
+ * Usage: vitalcare-replay CAPTURE.vcs [OUT.csv]   (CSV to stdout without OUT)
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+using namespace vitalcare;
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+  FILE *in = fopen(path, "rb");
+  if (!in)
+  {
+    perror(path);
+    return false;
+  }
+  uint8_t chunk[1 << 16];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+    data.insert(data.end(), chunk, chunk + n);
+  bool ok = !ferror(in);
+  fclose(in);
+  return ok;
+}
+
+// The dashboard's status for an update, as esp32-main sets it
+static const char *statusText(bool monitoring, const BedsideDecision &decision)
+{
+  if (!monitoring)
+    return "no_patient";
+  return decision.alertFlags != ALERT_NONE ? "alert" : "normal";
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s CAPTURE.vcs [OUT.csv]\n", argv[0]);
+    return 2;
+  }
+  std::vector<uint8_t> data;
+  CaptureHeader header;
+  if (!readFile(argv[1], data) || !decodeCaptureHeader(data.data(), data.size(), header))
+  {
+    fprintf(stderr, "%s: not a sensor capture\n", argv[1]);
+    return 1;
+  }
+  FILE *out = argc > 2 ? fopen(argv[2], "w") : stdout;
+  if (!out)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  BedsideMonitor monitor;
+  monitor.begin(header.startMs, header.seed);
+  CaptureReader reader(data.data() + CAPTURE_HEADER_SIZE, data.size() - CAPTURE_HEADER_SIZE);
+  CaptureEvent event;
+  char patientName[PATIENT_NAME_LENGTH + 1] = "";
+  BedsideDecision last = {ALERT_NONE, false};
+  uint32_t lastTimeMs = header.startMs;
+  uint64_t reads = 0, updates = 0, alerts = 0, sms = 0, checked = 0, mismatches = 0;
+
+  fprintf(out, "time_ms,heart_rate,systolic_bp,diastolic_bp,spo2,temperature_f,ecg,pressure_hpa,status,"
+               "alert_flags,sms,message\n");
+  while (reader.next(event))
+  {
+    switch (event.type)
+    {
+    case CAPTURE_SENSORS:
+      monitor.onSensors(event.sensors);
+      reads++;
+      break;
+    case CAPTURE_PATIENT:
+      snprintf(patientName, sizeof(patientName), "%s", event.patientName);
+      break;
+    case CAPTURE_UPDATE:
+    {
+      last = monitor.update(event.timeMs, event.monitoring, event.smsReady);
+      updates++;
+      alerts += last.alertFlags != ALERT_NONE ? 1 : 0;
+      sms += last.sms ? 1 : 0;
+
+      // The alert text checkForAlerts() shows, or the SMS it sends with it
+      const VitalSample &vitals = monitor.sample();
+      char alertText[192] = "";
+      char message[320] = "";
+      if (last.alertFlags != ALERT_NONE)
+        formatAlertMessage(last.alertFlags, vitals, alertText, sizeof(alertText));
+      if (last.sms)
+        snprintf(message, sizeof(message), "ALERT: %s - %sLocation: VitalCare Rural Clinic", patientName,
+                 alertText);
+      else
+        snprintf(message, sizeof(message), "%s", alertText);
+      for (char *c = message; *c; c++)
+        *c = *c == '"' ? '\'' : (*c == '\n' ? ' ' : *c);
+      fprintf(out, "%u,%.2f,%.2f,%.2f,%.1f,%.2f,%u,%.2f,%s,%u,%d,\"%s\"\n", event.timeMs, vitals.heartRate,
+              vitals.systolicBP, vitals.diastolicBP, vitals.spO2, vitals.temperature, monitor.ecgValue(),
+              monitor.pressureHpa(), statusText(event.monitoring, last), last.alertFlags, last.sms ? 1 : 0, message);
+      break;
+    }
+    case CAPTURE_DECISION:
+      // What the device did after the update just replayed
+      checked++;
+      if (event.decision.alertFlags != last.alertFlags || event.decision.sms != last.sms)
+      {
+        if (mismatches++ == 0)
+          fprintf(stderr, "⚠️ first divergence at %u ms: device flags %u sms %d, replay flags %u sms %d\n",
+                  event.timeMs, event.decision.alertFlags, event.decision.sms ? 1 : 0, last.alertFlags,
+                  last.sms ? 1 : 0);
+      }
+      break;
+    }
+    lastTimeMs = event.timeMs;
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (out != stdout && fclose(out) != 0)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+
+  double virtualSeconds = (lastTimeMs - header.startMs) / 1000.0;
+  fprintf(stderr, "▶️ device %016llx seed %08x: %.1f h replayed in %.3f s (%.0fx real time)%s\n",
+          (unsigned long long)header.deviceId, header.seed, virtualSeconds / 3600, elapsed,
+          elapsed > 0 ? virtualSeconds / elapsed : 0.0, reader.truncated() ? ", capture cut short" : "");
+  fprintf(stderr, "%llu sensor reads, %llu updates, %llu alerting, %llu SMS; %llu/%llu device decisions matched\n",
+          (unsigned long long)reads, (unsigned long long)updates, (unsigned long long)alerts,
+          (unsigned long long)sms, (unsigned long long)(checked - mismatches), (unsigned long long)checked);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,391 @@
+/*
+ * VitalCare Rural - Retention Simulation
+ *
+ * Runs esp32-main's RetentionEngine (Retention.h) for months of device time
+ * against a simulated SD card, in 1 s steps with the engine's time budget
+ * charged by the card. Each day a patient is monitored for 4 to 10 hours:
+ * a 1 Hz trend CSV and hourly EDF+ segments of 540 bytes a second. A
+ * collector uploads everything every second evening. For OUTAGE_DAYS from
+ * day 100 it does not come, so data piles up unuploaded.
+ *
+ * The card checks every delete:
+ * - nothing written after the upload watermark goes
+ * - rollups and unknown files never go
+ * - a trend CSV goes only once its rollup accounts for every row
+ * At the end, no uploaded file may be more than a day past its age, no
+ * write may have failed for a full card, and the engine must have stayed
+ * within its budget. Any of these failing exits with 1.
+ *
+ * Usage: vitalcare-retention-sim [CARD_MB] [DAYS] [OUTAGE_DAYS] [SEED]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+
+#include <VitalCareCore.h>
+
+#include "Arguments.h"
+
+using namespace vitalcare;
+using namespace vitalcare::tools;
+
+const uint32_t EDF_BYTES_PER_S = 540;
+const uint32_t EDF_HEADER_BYTES = 1024;
+const uint32_t SEGMENT_S = 3600;
+const uint32_t CLUSTER_BYTES = 32768;
+const char *CSV_HEADER = "timestamp,heartRate,systolicBP,diastolicBP,spO2,temperature,ecgValue,pressure,status\r\n";
+
+// Card time per operation over SPI, in microseconds
+const uint32_t COST_REWIND_US = 3000;
+const uint32_t COST_ENTRY_US = 800;
+const uint32_t COST_READ_US = 3000;
+const uint32_t COST_WRITE_US = 2000;
+const uint32_t COST_CLUSTER_FREE_US = 300;
+
+struct SimFile
+{
+  uint64_t bytes;
+  uint32_t modifiedS;
+  bool open;        // Being written: not listed
+  uint32_t rows;    // Trend CSVs: rows, generated on read
+  uint32_t startMs; // ...timestamp of the first
+  std::string text; // Anything else written through the store
+};
+
+class SimulatedCard : public RetentionStore
+{
+public:
+  explicit SimulatedCard(uint64_t capacity)
+      : capacity(capacity), used(0), clockUs(0), uploadedS(0), violations(0), writeFailures(0)
+  {
+    char row[128];
+    rowBytes = formatRow(0, 0, row);
+  }
+
+  uint64_t totalBytes() override { return capacity; }
+  uint64_t freeBytes() override { return capacity - used; }
+
+  bool rewind() override
+  {
+    clockUs += COST_REWIND_US;
+    cursor.clear();
+    listing = true;
+    return true;
+  }
+
+  // By name after the last one listed, so deletes and new files in
+  // between are handled as FAT's directory walk does
+  bool next(RetentionFile &file) override
+  {
+    clockUs += COST_ENTRY_US;
+    auto it = listing ? files.upper_bound(cursor) : files.end();
+    while (it != files.end() && it->second.open)
+      it++;
+    if (it == files.end())
+    {
+      listing = false;
+      return false;
+    }
+    cursor = it->first;
+    snprintf(file.path, sizeof(file.path), "%s", it->first.c_str());
+    file.bytes = (uint32_t)it->second.bytes;
+    file.modifiedS = it->second.modifiedS;
+    return true;
+  }
+
+  int32_t read(const char *path, uint32_t offset, uint8_t *data, size_t length) override
+  {
+    clockUs += COST_READ_US;
+    auto it = files.find(path);
+    if (it == files.end())
+      return -1;
+    const SimFile &file = it->second;
+    size_t headerBytes = strlen(CSV_HEADER);
+    size_t done = 0;
+    while (done < length && offset + done < file.bytes)
+    {
+      uint64_t at = offset + done;
+      if (file.rows == 0)
+        data[done++] = at < file.text.size() ? (uint8_t)file.text[at] : 0;
+      else if (at < headerBytes)
+        data[done++] = (uint8_t)CSV_HEADER[at];
+      else
+      {
+        uint32_t index = (uint32_t)((at - headerBytes) / rowBytes);
+        char row[128];
+        formatRow(index, file.startMs, row);
+        size_t from = (size_t)((at - headerBytes) % rowBytes);
+        size_t take = rowBytes - from < length - done ? rowBytes - from : length - done;
+        memcpy(data + done, row + from, take);
+        done += take;
+      }
+    }
+    return (int32_t)done;
+  }
+
+  bool write(const char *path, const uint8_t *data, size_t length, bool truncate) override
+  {
+    clockUs += COST_WRITE_US;
+    SimFile &file = files[path];
+    if (truncate)
+    {
+      used -= file.bytes;
+      file.bytes = 0;
+      file.text.clear();
+    }
+    if (!grow(file, length))
+      return false;
+    file.text.append((const char *)data, length);
+    file.modifiedS = nowS;
+    return true;
+  }
+
+  bool remove(const char *path) override
+  {
+    auto it = files.find(path);
+    if (it == files.end())
+      return false;
+    const SimFile &file = it->second;
+    clockUs += COST_WRITE_US + COST_CLUSTER_FREE_US * (uint32_t)((file.bytes + CLUSTER_BYTES - 1) / CLUSTER_BYTES);
+    uint8_t fileClass = retentionClass(path);
+    if (file.modifiedS > uploadedS)
+      violation(path, "deleted before upload");
+    if (fileClass >= RETAIN_CLASSES || fileClass == RETAIN_ROLLUP)
+      violation(path, "never to be deleted");
+    if (fileClass == RETAIN_VITALS && rollupReadings(path) != file.rows)
+      violation(path, "deleted without a whole rollup");
+    used -= file.bytes;
+    files.erase(it);
+    return true;
+  }
+
+  uint32_t micros() override { return (uint32_t)clockUs; }
+
+  // The recorder's side
+  bool grow(SimFile &file, uint64_t length)
+  {
+    if (used + length > capacity)
+    {
+      writeFailures++;
+      return false;
+    }
+    file.bytes += length;
+    used += length;
+    return true;
+  }
+
+  void addRow(const std::string &path)
+  {
+    SimFile &file = files[path];
+    if (grow(file, file.bytes == 0 ? strlen(CSV_HEADER) + rowBytes : rowBytes))
+      file.rows++;
+    file.modifiedS = nowS;
+  }
+
+  void tick(uint32_t now)
+  {
+    nowS = now;
+    if (clockUs < (uint64_t)now * 1000000)
+      clockUs = (uint64_t)now * 1000000;
+  }
+
+  uint64_t capacity;
+  uint64_t used;
+  uint64_t clockUs;
+  uint32_t nowS;
+  uint32_t uploadedS;
+  uint32_t violations;
+  uint32_t writeFailures;
+  std::map<std::string, SimFile> files;
+
+private:
+  static size_t formatRow(uint32_t index, uint32_t startMs, char *row)
+  {
+    bool alert = index % 500 == 499;
+    return (size_t)snprintf(row, 128, "%010lu,%6.2f,%6.2f,%6.2f,%6.2f,%6.2f,%4u,%7.2f,%s\r\n",
+                            (unsigned long)(startMs + index * 1000), 60.0 + index % 40, 120.0, 80.0,
+                            alert ? 89.0 : 97.0, 98.6, 2048 + index % 100, 1013.25,
+                            alert ? "⚠️ ALERT" : "✅ Normal  ");
+  }
+
+  // Sum of the readings column of a trend CSV's rollup
+  uint32_t rollupReadings(const char *path)
+  {
+    std::string rollup(path, strlen(path) - 4);
+    auto it = files.find(rollup + RETENTION_ROLLUP_SUFFIX);
+    if (it == files.end())
+      return 0;
+    uint32_t readings = 0;
+    const std::string &text = it->second.text;
+    for (size_t line = text.find('\n'); line != std::string::npos && line + 1 < text.size();
+         line = text.find('\n', line + 1))
+    {
+      size_t comma = text.find(',', line + 1);
+      if (comma != std::string::npos)
+        readings += (uint32_t)strtoul(text.c_str() + comma + 1, nullptr, 10);
+    }
+    return readings;
+  }
+
+  void violation(const char *path, const char *what)
+  {
+    if (violations++ < 10)
+      printf("❌ %s: %s (modified %u, uploaded through %u)\n", path, what, files[path].modifiedS, uploadedS);
+  }
+
+  size_t rowBytes;
+  std::string cursor;
+  bool listing = false;
+};
+
+int main(int argc, char **argv)
+{
+  uint64_t cardMb = 256;
+  uint32_t days = 120;
+  uint32_t outageDays = 5;
+  uint32_t seed = 1;
+  if (argc > 5 || !positionalOnly(argc, argv) ||
+      (argc > 1 && (!parseUnsigned(argv[1], 1024 * 1024, cardMb) || cardMb == 0)) ||
+      (argc > 2 && (!parseUnsigned(argv[2], days) || days == 0)) ||
+      (argc > 3 && !parseUnsigned(argv[3], outageDays)) || (argc > 4 && !parseUnsigned(argv[4], seed)))
+  {
+    fprintf(stderr, "usage: %s [CARD_MB] [DAYS] [OUTAGE_DAYS] [SEED]\n", argv[0]);
+    return 2;
+  }
+
+  const uint32_t OUTAGE_START_DAY = 100;
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<uint32_t> sessionHours(4, 10);
+
+  SimulatedCard card(cardMb * 1024 * 1024);
+  RetentionEngine retention(card);
+  const RetentionPolicy &policy = retention.rules();
+  card.files["/vitalcare/spare.seg"] = {2 * 1024 * 1024, 0, false, 0, 0, ""};
+  card.used += 2 * 1024 * 1024;
+
+  std::string base, csvPath, edfPath;
+  uint32_t sessionEndS = 0, segmentStartS = 0, segment = 0;
+  uint32_t minFreePercent = 100, secondsBelowWatermark = 0, maxHeld = 0;
+  uint32_t endS = days * 86400;
+  for (uint32_t now = 1; now <= endS; now++)
+  {
+    card.tick(now);
+    uint32_t day = now / 86400, second = now % 86400;
+
+    // A patient from 08:00
+    if (second == 8 * 3600)
+    {
+      char name[64];
+      snprintf(name, sizeof(name), "/vitalcare/VCR%05u_%u", day, now);
+      base = name;
+      csvPath = base + ".csv";
+      card.files[csvPath] = {0, now, true, 0, second * 1000, ""};
+      sessionEndS = now + sessionHours(random) * 3600;
+      segment = 0;
+      segmentStartS = now;
+      edfPath = base + ".edf";
+      card.files[edfPath] = {0, now, true, 0, 0, ""};
+      card.grow(card.files[edfPath], EDF_HEADER_BYTES);
+    }
+    if (!csvPath.empty())
+    {
+      card.addRow(csvPath);
+      SimFile &edf = card.files[edfPath];
+      card.grow(edf, EDF_BYTES_PER_S);
+      edf.modifiedS = now;
+      bool over = now >= sessionEndS;
+      if (over || now - segmentStartS >= SEGMENT_S)
+      {
+        edf.open = false;
+        if (over)
+        {
+          card.files[csvPath].open = false;
+          csvPath.clear();
+        }
+        else
+        {
+          edfPath = base + "-" + std::to_string(++segment) + ".edf";
+          card.files[edfPath] = {0, now, true, 0, 0, ""};
+          card.grow(card.files[edfPath], EDF_HEADER_BYTES);
+          segmentStartS = now;
+        }
+      }
+    }
+
+    // The collector, every second evening
+    bool outage = day >= OUTAGE_START_DAY && day < OUTAGE_START_DAY + outageDays;
+    if (second == 18 * 3600 && day % 2 == 0 && !outage)
+      card.uploadedS = now;
+
+    retention.setClock(now, card.uploadedS);
+    while (retention.step())
+    {
+    }
+
+    uint32_t freePercent = (uint32_t)(card.freeBytes() * 100 / card.totalBytes());
+    minFreePercent = freePercent < minFreePercent ? freePercent : minFreePercent;
+    secondsBelowWatermark += freePercent < policy.minFreePercent ? 1 : 0;
+    maxHeld = retention.stats().held > maxHeld ? retention.stats().held : maxHeld;
+  }
+
+  // Uploaded files left more than a day past their age
+  uint32_t overdue = 0;
+  uint32_t counts[RETAIN_CLASSES] = {0, 0, 0};
+  uint64_t bytes[RETAIN_CLASSES] = {0, 0, 0};
+  for (const auto &entry : card.files)
+  {
+    uint8_t fileClass = retentionClass(entry.first.c_str());
+    if (fileClass >= RETAIN_CLASSES)
+      continue;
+    counts[fileClass]++;
+    bytes[fileClass] += entry.second.bytes;
+    uint32_t maxAge = policy.maxAgeS[fileClass];
+    if (maxAge && !entry.second.open && entry.second.modifiedS <= card.uploadedS &&
+        endS - entry.second.modifiedS > maxAge + 86400)
+      overdue++;
+  }
+
+  const RetentionStats &stats = retention.stats();
+  double budgetShare = stats.busyUs / (endS * 1e6);
+  printf("🗂️ %u days on a %llu MB card, %u-day upload outage from day %u\n", days, (unsigned long long)cardMb,
+         outageDays, OUTAGE_START_DAY);
+  printf("%-9s %8s %10s %8s\n", "class", "files", "MB", "deleted");
+  for (uint8_t i = 0; i < RETAIN_CLASSES; i++)
+    printf("%-9s %8u %10.1f %8u\n", retentionClassName(i), counts[i], bytes[i] / 1048576.0, stats.deleted[i]);
+  printf("compacted %u trend CSVs into %u rollup rows, %.1f MB deleted, %u failures\n", stats.compacted,
+         stats.rollupRows, stats.deletedBytes / 1048576.0, stats.failed);
+  printf("free space: min %u%%, %u s below the %u%% watermark, at most %u files held for upload\n", minFreePercent,
+         secondsBelowWatermark, policy.minFreePercent, maxHeld);
+  printf("budget: %u scans, %.2f%% of the time (allowed %.2f%%), longest step %u us\n", stats.scans,
+         budgetShare * 100, policy.budgetUsPerS / 1e4, stats.maxStepUs);
+
+  bool ok = true;
+  if (card.violations)
+  {
+    printf("❌ %u deletes broke the rules\n", card.violations);
+    ok = false;
+  }
+  if (overdue)
+  {
+    printf("❌ %u uploaded files kept more than a day past their age\n", overdue);
+    ok = false;
+  }
+  if (card.writeFailures)
+  {
+    printf("❌ %u writes failed on a full card\n", card.writeFailures);
+    ok = false;
+  }
+  if (budgetShare * 1e6 > policy.budgetUsPerS * 1.05)
+  {
+    printf("❌ retention took more than its budget\n");
+    ok = false;
+  }
+  if (!ok)
+    return 1;
+  printf("✅ retention kept the card under its watermark rules without losing unuploaded data\n");
+  return 0;
+}
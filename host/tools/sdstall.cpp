@@ -0,0 +1,437 @@
+/*
+ * VitalCare Rural - SD Card Stall Injection
+ *
+ * Runs esp32-main's SD write path on a virtual clock against a simulated
+ * card that stalls: the same StorageChannels (ping-pong vitals buffers
+ * that block, triple waveform buffers that drop), EdfWriter on the
+ * waveform channel and write-behind of the history ring on the vitals
+ * channel, drained by a writer that stands in for the writer task. The
+ * card writes at a fixed rate, and every 2 to 8 s one buffer write stalls
+ * for STALL_MS on top, as cards do while they erase or update the FAT.
+ *
+ * The card checks what reaches it: every CSV row carries its update's
+ * sequence number, so a row that never arrives is a lost vitals update
+ * (repeats after a failed write would be allowed, gaps are not); the EDF+
+ * file must hold every 1 s record with the right count in its header. The
+ * EDF+ file is opened as a preallocated segment, as on the device, and
+ * its logical end must be where the records end.
+ * Exits with 1 if a vitals update or a waveform record was lost; a record
+ * dropped by the waveform policy counts too, though it is marked in the
+ * file as a "Data lost" gap.
+ *
+ * Usage: vitalcare-sd-stall [STALL_MS] [HOURS] [SEED]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <VitalCareCore.h>
+
+#include "Arguments.h"
+
+using namespace vitalcare;
+using namespace vitalcare::tools;
+
+// As esp32-main
+enum WriterChannel : uint8_t
+{
+  WRITER_VITALS = 0,
+  WRITER_WAVEFORM,
+  WRITER_CHANNELS
+};
+enum WriterFile : uint8_t
+{
+  WRITER_CSV = 0,
+  WRITER_EDF,
+  WRITER_FILES
+};
+const size_t WRITER_BUFFER_BYTES = 4096;
+const uint32_t HISTORY_SECONDS = 1800; // Internal RAM ring; PSRAM boards keep 24 h
+const char *CSV_HEADER = "sequence,timestamp\r\n";
+
+class SimulatedCard : public StorageSink
+{
+public:
+  SimulatedCard()
+      : sizes(), positions(), opened(), segment(), bytesWritten(0), nextRow(0), repeatedRows(0), missingRows(0)
+  {
+  }
+
+  bool open(uint8_t file, const char *, bool truncate) override
+  {
+    opened[file] = true;
+    if (truncate)
+    {
+      sizes[file] = 0;
+      if (file == WRITER_EDF)
+        edf.clear();
+    }
+    positions[file] = sizes[file];
+    return true;
+  }
+
+  // Only the EDF+ file is a segment here
+  bool openSegment(uint8_t file, const char *path, uint32_t bytes) override
+  {
+    if (file != WRITER_EDF)
+      return false;
+    segment.begin(bytes);
+    return open(file, path, true);
+  }
+
+  uint32_t size(uint8_t file) override { return sizes[file]; }
+
+  bool write(uint8_t file, const uint8_t *data, size_t length) override
+  {
+    if (!opened[file])
+      return false;
+    bytesWritten += length;
+    if (file == WRITER_EDF)
+      segment.wrote(length);
+    if (file == WRITER_CSV)
+      checkRows(data, length);
+    if (file == WRITER_EDF)
+    {
+      if (edf.size() < positions[file] + length)
+        edf.resize(positions[file] + length);
+      memcpy(edf.data() + positions[file], data, length);
+    }
+    positions[file] += (uint32_t)length;
+    if (positions[file] > sizes[file])
+      sizes[file] = positions[file];
+    return true;
+  }
+
+  bool seek(uint8_t file, uint32_t offset) override
+  {
+    if (!opened[file] || offset > sizes[file] || (file == WRITER_EDF && !segment.seek(offset)))
+      return false;
+    positions[file] = offset;
+    return true;
+  }
+
+  bool flush(uint8_t file) override { return opened[file]; }
+  void close(uint8_t file) override { opened[file] = false; }
+
+  // A header field of the EDF+ file as text
+  std::string edfField(size_t offset, size_t width) const
+  {
+    if (edf.size() < offset + width)
+      return "";
+    std::string text(edf.begin() + offset, edf.begin() + offset + width);
+    return text.substr(0, text.find_last_not_of(' ') + 1);
+  }
+
+  uint32_t sizes[WRITER_FILES];
+  uint32_t positions[WRITER_FILES];
+  bool opened[WRITER_FILES];
+  StorageSegment segment;
+  uint64_t bytesWritten;
+  std::vector<uint8_t> edf;
+  uint32_t nextRow;      // Every update before this one has arrived
+  uint32_t repeatedRows; // Arrived again
+  uint32_t missingRows;  // Skipped over: lost
+
+private:
+  void checkRows(const uint8_t *data, size_t length)
+  {
+    for (size_t i = 0; i < length; i++)
+    {
+      if (data[i] != '\n')
+      {
+        line += (char)data[i];
+        continue;
+      }
+      if (!line.empty() && line[0] >= '0' && line[0] <= '9')
+      {
+        uint32_t sequence = (uint32_t)strtoul(line.c_str(), nullptr, 10);
+        if (sequence < nextRow)
+          repeatedRows++;
+        else
+        {
+          missingRows += sequence - nextRow;
+          nextRow = sequence + 1;
+        }
+      }
+      line.clear();
+    }
+  }
+
+  std::string line;
+};
+
+static StorageChannel channels[WRITER_CHANNELS];
+
+class QueuedEdfOutput : public EdfOutput
+{
+public:
+  bool write(const uint8_t *data, size_t length) override
+  {
+    return channels[WRITER_WAVEFORM].append(STORAGE_WRITE, WRITER_EDF, data, length);
+  }
+
+  bool seek(uint64_t offset) override
+  {
+    uint8_t position[4] = {(uint8_t)offset, (uint8_t)(offset >> 8), (uint8_t)(offset >> 16), (uint8_t)(offset >> 24)};
+    return channels[WRITER_WAVEFORM].append(STORAGE_SEEK, WRITER_EDF, position, sizeof(position));
+  }
+};
+
+int main(int argc, char **argv)
+{
+  uint32_t stallMs = 500;
+  double hours = 2.0;
+  uint32_t seed = 1;
+  if (argc > 4 || !positionalOnly(argc, argv) || (argc > 1 && !parseUnsigned(argv[1], stallMs)) ||
+      (argc > 2 && (!parseNumber(argv[2], 0, 1000, hours) || hours <= 0)) ||
+      (argc > 3 && !parseUnsigned(argv[3], seed)))
+  {
+    fprintf(stderr, "usage: %s [STALL_MS] [HOURS] [SEED]\n", argv[0]);
+    return 2;
+  }
+
+  const uint32_t LOOP_MS = 10;
+  const uint32_t READ_MS = 100;
+  const uint32_t UPDATE_MS = 1000;
+  const uint32_t SAVE_MS = 30000;
+  const uint32_t CARD_BYTES_PER_MS = 200; // 200 KB/s over SPI
+  const uint32_t CARD_WRITE_MS = 2;       // Per buffer: FAT and directory updates
+  uint32_t endMs = (uint32_t)(hours * 3600000);
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<uint32_t> stallGap(2000, 8000);
+
+  static uint8_t vitalsBuffers[2 * WRITER_BUFFER_BYTES];
+  static uint8_t waveformBuffers[3 * WRITER_BUFFER_BYTES];
+  channels[WRITER_VITALS].begin(vitalsBuffers, WRITER_BUFFER_BYTES, 2, STORAGE_BLOCK);
+  channels[WRITER_WAVEFORM].begin(waveformBuffers, WRITER_BUFFER_BYTES, 3, STORAGE_DROP);
+  SimulatedCard card;
+
+  static uint8_t historyStorage[HISTORY_SECONDS * HISTORY_RECORD_SIZE];
+  RecordRing history;
+  history.begin(historyStorage, sizeof(historyStorage), HISTORY_RECORD_SIZE);
+  uint32_t saveCursor = 0, queuedCursor = 0, overwritten = 0, maxWaiting = 0;
+  bool writeFailed = false, csvOpen = false;
+
+  QueuedEdfOutput edfOutput;
+  static uint8_t edfRecord[(10 + 100 + 100) * 2 + EDF_DEFAULT_ANNOTATION_BYTES];
+  EdfWriter edf(edfOutput, edfRecord, sizeof(edfRecord));
+  edf.addSignal({"ECG", "AD8232 chest electrodes", "mV", -16.5f, 16.5f, 0, 4095, "HP:0.5Hz LP:40Hz", 10});
+  edf.addSignal({"PPG Red", "MAX30102", "counts", 0, 32767, 0, 32767, "", 100});
+  edf.addSignal({"PPG IR", "MAX30102", "counts", 0, 32767, 0, 32767, "", 100});
+  EdfRecordingInfo info = {"VCR10000123", 'F', "Stall", "VitalCare-5643000000000001", 0, 0, 0, 0, 0, 0};
+  // The device rotates hourly; this one segment is sized for the run
+  uint8_t segment[4 + STORAGE_MAX_PATH];
+  uint32_t segmentBytes = 2 * 1024 * 1024 * (uint32_t)(hours + 1);
+  size_t segmentLength = encodeStorageSegment(segment, sizeof(segment), segmentBytes, "/vitalcare/stall.edf");
+  channels[WRITER_WAVEFORM].append(STORAGE_OPEN_SEGMENT, WRITER_EDF, segment, segmentLength);
+  edf.begin(info, 1000);
+  uint32_t recordsProduced = 0;
+
+  // The writer task: one buffer at a time, from the lowest channel queued
+  LatencyHistogram writes;
+  uint32_t nextStallMs = stallGap(random), stalls = 0;
+  bool busy = false;
+  uint8_t busyChannel = 0;
+  uint32_t busyTag = 0, busyStartMs = 0, busyUntilMs = 0;
+  bool busyOk = true;
+
+  // esp32-main's saveDataToSD(): rows queued from the ring, the cursor moved
+  // by the writer's completions
+  auto saveVitals = [&]() {
+    if (writeFailed)
+    {
+      if (channels[WRITER_VITALS].queued() > 0)
+        return;
+      writeFailed = false;
+      queuedCursor = saveCursor;
+      csvOpen = false;
+    }
+    if (saveCursor < history.firstSequence())
+    {
+      overwritten += history.firstSequence() - saveCursor;
+      saveCursor = history.firstSequence();
+    }
+    if (queuedCursor < saveCursor)
+      queuedCursor = saveCursor;
+    if (queuedCursor == history.nextSequence())
+      return;
+    if (!csvOpen)
+    {
+      if (!channels[WRITER_VITALS].append(STORAGE_OPEN, WRITER_CSV, "/vitalcare/stall.csv", 20) ||
+          !channels[WRITER_VITALS].append(STORAGE_WRITE_HEADER, WRITER_CSV, CSV_HEADER, strlen(CSV_HEADER)))
+        return;
+      csvOpen = true;
+    }
+    char block[512], line[64];
+    size_t used = 0;
+    uint32_t sequence = queuedCursor;
+    bool queued = true;
+    for (; sequence < history.nextSequence(); sequence++)
+    {
+      HistoryRecord record;
+      decodeHistoryRecord(history.at(sequence), record);
+      size_t length = (size_t)snprintf(line, sizeof(line), "%u,%u\r\n", sequence, record.vitals.timestampMs);
+      if (used + length > sizeof(block))
+      {
+        queued = channels[WRITER_VITALS].append(STORAGE_WRITE, WRITER_CSV, block, used, sequence);
+        if (!queued)
+          break;
+        queuedCursor = sequence;
+        used = 0;
+      }
+      memcpy(block + used, line, length);
+      used += length;
+    }
+    if (queued && used > 0 && channels[WRITER_VITALS].append(STORAGE_WRITE, WRITER_CSV, block, used, sequence))
+      queuedCursor = sequence;
+    channels[WRITER_VITALS].append(STORAGE_FLUSH, WRITER_CSV, nullptr, 0);
+    channels[WRITER_VITALS].submit();
+    uint32_t waiting = history.nextSequence() - queuedCursor;
+    maxWaiting = waiting > maxWaiting ? waiting : maxWaiting;
+  };
+
+  bool closed = false;
+  uint32_t now = 0;
+  for (;; now++)
+  {
+    // Writer, at 1 ms resolution
+    if (busy && now >= busyUntilMs)
+    {
+      channels[busyChannel].release(busyOk);
+      writes.record((busyUntilMs - busyStartMs) * 1000);
+      if (busyChannel == WRITER_VITALS)
+      {
+        if (!busyOk)
+          writeFailed = true;
+        else if (!writeFailed && busyTag > saveCursor)
+          saveCursor = busyTag;
+      }
+      busy = false;
+    }
+    for (uint8_t channel = 0; !busy && channel < WRITER_CHANNELS; channel++)
+    {
+      size_t length = 0;
+      const uint8_t *data = channels[channel].take(length, busyTag);
+      if (!data)
+        continue;
+      busy = true;
+      busyChannel = channel;
+      busyOk = runStorageCommands(card, data, length);
+      busyStartMs = now;
+      busyUntilMs = now + CARD_WRITE_MS + (uint32_t)(length / CARD_BYTES_PER_MS);
+      if (now >= nextStallMs)
+      {
+        busyUntilMs += stallMs;
+        nextStallMs = busyUntilMs + stallGap(random);
+        stalls++;
+      }
+    }
+
+    if (now % LOOP_MS)
+      continue;
+    if (now > endMs)
+    {
+      // Recording over: save the rest, close the file, wait for the card
+      if (!closed)
+      {
+        saveVitals();
+        if (channels[WRITER_WAVEFORM].room() >= 2 * edf.headerSize() + edf.recordSize() * 8)
+        {
+          edf.close();
+          channels[WRITER_WAVEFORM].append(STORAGE_CLOSE, WRITER_EDF, nullptr, 0);
+          channels[WRITER_WAVEFORM].submit();
+          closed = true;
+        }
+      }
+      else if (queuedCursor != history.nextSequence() || saveCursor != history.nextSequence())
+        saveVitals();
+      else if (!busy && channels[WRITER_VITALS].idle() && channels[WRITER_WAVEFORM].idle())
+        break;
+      continue;
+    }
+
+    if (now % READ_MS == 0)
+    {
+      int16_t ppg[10];
+      for (int i = 0; i < 10; i++)
+        ppg[i] = (int16_t)((now / 10 + i) % 2000);
+      edf.addSample(0, (int16_t)(2048 + now % 1000));
+      edf.addSamples(1, ppg, 10);
+      edf.addSamples(2, ppg, 10);
+    }
+    if (now % UPDATE_MS == 0)
+    {
+      HistoryRecord record = {};
+      record.vitals.timestampMs = now;
+      record.vitals.heartRate = 72;
+      encodeHistoryRecord(record, history.reserve());
+      history.commit();
+      recordsProduced++;
+      if (channels[WRITER_WAVEFORM].offer(edf.recordSize()))
+        edf.endRecord();
+      else
+        edf.skipRecord();
+    }
+    if (now % SAVE_MS == 0)
+    {
+      saveVitals();
+      if (channels[WRITER_WAVEFORM].room() >= 2 * edf.headerSize())
+      {
+        edf.sync();
+        channels[WRITER_WAVEFORM].append(STORAGE_FLUSH, WRITER_EDF, nullptr, 0);
+      }
+      channels[WRITER_WAVEFORM].submit();
+    }
+  }
+
+  uint32_t updates = history.nextSequence();
+  uint32_t lostUpdates = card.missingRows + (updates - card.nextRow);
+  uint32_t headerSize = (uint32_t)edf.headerSize();
+  uint32_t cardRecords = card.edf.size() > headerSize ? (uint32_t)((card.edf.size() - headerSize) / edf.recordSize()) : 0;
+  uint32_t headerRecords = (uint32_t)strtoul(card.edfField(236, 8).c_str(), nullptr, 10);
+  const StorageChannelStats &vitals = channels[WRITER_VITALS].stats();
+  const StorageChannelStats &waveform = channels[WRITER_WAVEFORM].stats();
+
+  printf("💾 %.1f h with %u card stalls of %u ms, %llu bytes written, drained %.1f s after the end\n", hours, stalls,
+         stallMs, (unsigned long long)card.bytesWritten, (now - endMs) / 1000.0);
+  printf("buffer writes: %u, p50 %u us, p99 %u us, max %u us\n", writes.count(), writes.percentileUs(50),
+         writes.percentileUs(99), writes.maxUs());
+  printf("%-9s %-6s %10s %10s %10s %10s\n", "channel", "policy", "submitted", "maxQueued", "overflows", "bytes");
+  printf("%-9s %-6s %10u %10u %10u %10llu\n", "vitals", "block", vitals.submitted, vitals.maxQueued,
+         vitals.overflows, (unsigned long long)vitals.overflowBytes);
+  printf("%-9s %-6s %10u %10u %10u %10llu\n", "waveform", "drop", waveform.submitted, waveform.maxQueued,
+         waveform.overflows, (unsigned long long)waveform.overflowBytes);
+  printf("vitals: %u updates, %u on the card, %u repeated, %u lost (%u overwritten in RAM), at most %u waiting\n",
+         updates, card.nextRow - card.missingRows, card.repeatedRows, lostUpdates, overwritten, maxWaiting);
+  printf("waveform: %u records, %u on the card (header says %u, %s), %u skipped, %u samples dropped\n",
+         recordsProduced, cardRecords, headerRecords, card.edfField(192, 44).c_str(), edf.skipped(), edf.dropped());
+  printf("segment: %u bytes preallocated, logical end %u, %u writes past it\n", card.segment.bytes, card.segment.end,
+         card.segment.overruns);
+
+  bool ok = true;
+  if (lostUpdates)
+  {
+    printf("❌ %u vitals updates never reached the card\n", lostUpdates);
+    ok = false;
+  }
+  if (edf.skipped() || edf.dropped() || cardRecords != edf.records() || headerRecords != edf.records() ||
+      edf.records() < recordsProduced)
+  {
+    printf("❌ waveform lost: %u of %u records on the card, %u skipped as gaps\n", cardRecords, recordsProduced,
+           edf.skipped());
+    ok = false;
+  }
+  if (card.segment.end != card.edf.size() || card.segment.overruns)
+  {
+    printf("❌ segment logical end %u, but the EDF+ file is %zu bytes\n", card.segment.end, card.edf.size());
+    ok = false;
+  }
+  if (!ok)
+    return 1;
+  printf("✅ no samples lost with %u ms stalls\n", stallMs);
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * VitalCare Rural - Core Processing Library
+ *
+ * Shared building blocks used by every VitalCare firmware and by the host
+ * tools. Everything here is header-only, templated on capacity and free of
+ * heap allocation, so the same code runs on the ESP32 and in native builds.
+ *
+ * Components:
+ * - RingBuffer          Fixed-capacity circular buffer
+ * - Filters             Moving average, EMA and DC blocker
+ * - BeatDetector        Threshold beat detection, beat quality, rate windows
+ * - HeartRateFusion     Quality-weighted Kalman fusion of ECG and PPG rates
+ * - Hrv                 Time-domain HRV (SDNN, RMSSD, pNN50) over NN intervals
+ * - Alerts              Vital sign threshold tables and evaluator
+ * - BedsideMonitor      esp32-main sensor-to-alert processing on explicit time
+ * - BedsideOutputs      esp32-main EDF+ recording and dashboard vitals frame
+ * - Encoding            Timestamp formatting, JSON and binary writers
+ * - Records             Packed storage/uplink record formats with CRC
+ * - Rollup              Per-period VitalRecord aggregation of 1 Hz readings
+ * - Uplink              Device-to-gateway batch and ack framing
+ * - EcgRecording        Raw ECG segment files for multi-day recordings
+ * - RecordLog           SD record log segments of sector-sized CRC blocks
+ * - Edf                 Streaming EDF+ writer with annotations
+ * - Capture             Sensor capture files for deterministic replay
+ * - History             RAM rings of recent vitals and raw waveform
+ * - StorageTier         SD card health, flash fallback and flash wear estimate
+ * - StorageQueue        Buffered file commands for a writer task, preallocated segments
+ * - Retention           Recording age and free space rules, rollup compaction
+ * - Latency             Sensor-to-screen latency stages and percentiles
+ * - MemoryAccounting    Heap allocations per subsystem and hot path rate
+ * - I2cBus              Asynchronous I2C transaction interface
+ * - I2cScheduler        Prioritised I2C job queue with bus instrumentation
+ * - Max3010x            FIFO-burst red/IR PPG driver (MAX30101/MAX30102)
+ * - SpO2                Fixed-point ratio-of-ratios SpO2 estimator
+ * - Bmp180              Non-blocking BMP180 temperature/pressure driver
+ * - MotionArtifact      Motion intensity and fixed-point NLMS artifact canceller
+ * - Mpu6050             Accelerometer driver paired with the ADC sample tick
+ *
+ * Author: VitalCare Rural Team
+ * Educational Purpose Only - Not for Medical Use
+ */
+
+#pragma once
+
+#include "vitalcare/Vitals.h"
+#include "vitalcare/RingBuffer.h"
+#include "vitalcare/Filters.h"
+#include "vitalcare/BeatDetector.h"
+#include "vitalcare/HeartRateFusion.h"
+#include "vitalcare/Hrv.h"
+#include "vitalcare/Alerts.h"
+#include "vitalcare/Encoding.h"
+#include "vitalcare/Checksum.h"
+#include "vitalcare/Records.h"
+#include "vitalcare/Rollup.h"
+#include "vitalcare/Uplink.h"
+#include "vitalcare/EcgRecording.h"
+#include "vitalcare/RecordLog.h"
+#include "vitalcare/Edf.h"
+#include "vitalcare/BedsideMonitor.h"
+#include "vitalcare/BedsideOutputs.h"
+#include "vitalcare/Capture.h"
+#include "vitalcare/History.h"
+#include "vitalcare/StorageTier.h"
+#include "vitalcare/StorageQueue.h"
+#include "vitalcare/Retention.h"
+#include "vitalcare/Latency.h"
+#include "vitalcare/MemoryAccounting.h"
+#include "vitalcare/I2cBus.h"
+#include "vitalcare/I2cScheduler.h"
+#include "vitalcare/Max3010x.h"
+#include "vitalcare/SpO2.h"
+#include "vitalcare/Bmp180.h"
+#include "vitalcare/MotionArtifact.h"
+#include "vitalcare/Mpu6050.h"
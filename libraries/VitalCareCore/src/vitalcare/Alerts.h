@@ -0,0 +1,109 @@
+/*
+ * VitalCare Rural - Alert Evaluation
+ *
+ * One evaluator and named threshold tables. The bedside monitor, the
+ * communication module and the dashboard used to hard-code their own
+ * comparisons; they now share these tables so a change lands everywhere.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Vitals.h"
+
+namespace vitalcare
+{
+
+enum AlertFlag : uint8_t
+{
+  ALERT_NONE = 0,
+  ALERT_HEART_RATE = 1 << 0,
+  ALERT_BLOOD_PRESSURE = 1 << 1,
+  ALERT_SPO2 = 1 << 2,
+  ALERT_TEMPERATURE = 1 << 3,
+  ALERT_SPO2_NO_READING = 1 << 4, // Oximeter off the finger, moving or missing
+};
+
+struct AlertThresholds
+{
+  float heartRateMin;
+  float heartRateMax;
+  float systolicMin;
+  float systolicMax;
+  float spO2Min;
+  float temperatureMin;
+  float temperatureMax;
+};
+
+// Single-ESP32 monitor checkForAlerts(): buzzer and SMS
+const AlertThresholds BEDSIDE_THRESHOLDS = {50, 120, 80, 160, 90, 95.0f, 102.0f};
+
+// Communication module isEmergency(): emergency upload and alert
+const AlertThresholds EMERGENCY_THRESHOLDS = {50, 120, 90, 160, 90, 96.0f, 102.0f};
+
+// Normal ranges shown on the dashboard; outside them the status is "Alert"
+const AlertThresholds NORMAL_RANGE_THRESHOLDS = {60, 100, 90, 140, 95, 97.0f, 100.0f};
+
+// Returns a mask of AlertFlag bits for every vital outside its range, and
+// ALERT_SPO2_NO_READING for an SpO2 of 0.
+inline uint8_t evaluateAlerts(const VitalSample &vitals, const AlertThresholds &limits)
+{
+  uint8_t flags = ALERT_NONE;
+
+  if (vitals.heartRate < limits.heartRateMin || vitals.heartRate > limits.heartRateMax)
+    flags |= ALERT_HEART_RATE;
+  if (vitals.systolicBP < limits.systolicMin || vitals.systolicBP > limits.systolicMax)
+    flags |= ALERT_BLOOD_PRESSURE;
+  // SpO2 of 0 means no oximeter reading, not desaturation: alerted as such
+  if (vitals.spO2 <= 0)
+    flags |= ALERT_SPO2_NO_READING;
+  else if (vitals.spO2 < limits.spO2Min)
+    flags |= ALERT_SPO2;
+  if (vitals.temperature < limits.temperatureMin || vitals.temperature > limits.temperatureMax)
+    flags |= ALERT_TEMPERATURE;
+
+  return flags;
+}
+
+// Writes the human-readable alert text used in serial logs and SMS, e.g.
+// "Heart Rate: 130.00 BPM. SpO2: 85.00%. ". Returns the length written.
+inline size_t formatAlertMessage(uint8_t flags, const VitalSample &vitals, char *buffer, size_t capacity)
+{
+  if (capacity == 0)
+  {
+    return 0;
+  }
+
+  size_t length = 0;
+  buffer[0] = '\0';
+
+  auto append = [&](int written) {
+    if (written > 0)
+    {
+      length += (size_t)written;
+      if (length >= capacity)
+      {
+        length = capacity - 1;
+      }
+    }
+  };
+
+  if (flags & ALERT_HEART_RATE)
+    append(snprintf(buffer + length, capacity - length, "Heart Rate: %.2f BPM. ", vitals.heartRate));
+  if (flags & ALERT_BLOOD_PRESSURE)
+    append(snprintf(buffer + length, capacity - length, "Blood Pressure: %.2f/%.2f mmHg. ",
+                    vitals.systolicBP, vitals.diastolicBP));
+  if (flags & ALERT_SPO2)
+    append(snprintf(buffer + length, capacity - length, "SpO2: %.2f%%. ", vitals.spO2));
+  if (flags & ALERT_SPO2_NO_READING)
+    append(snprintf(buffer + length, capacity - length, "SpO2: no reading, check the sensor. "));
+  if (flags & ALERT_TEMPERATURE)
+    append(snprintf(buffer + length, capacity - length, "Temperature: %.2f°F. ", vitals.temperature));
+
+  return length;
+}
+
+} // namespace vitalcare
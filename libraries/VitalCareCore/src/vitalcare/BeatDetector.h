@@ -0,0 +1,216 @@
+/*
+ * VitalCare Rural - Beat Detection
+ *
+ * Threshold beat detector shared by the ECG and pulse channels, a per-channel
+ * quality tracker that turns beat intervals into rate measurements, and the
+ * fixed-window beat counter used by the single-ESP32 monitor.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+const float HEART_RATE_MIN_VALID = 40.0f;
+const float HEART_RATE_MAX_VALID = 200.0f;
+
+// Rising-edge threshold detector with hysteresis and a refractory period.
+// A beat fires when the signal crosses above threshold; the detector re-arms
+// once the signal falls to threshold - hysteresis. A crossing inside the
+// refractory period is not a beat and must re-arm like one; a clean signal
+// has none, so suppressedCount() rising means noise.
+class ThresholdBeatDetector
+{
+public:
+  ThresholdBeatDetector(int32_t threshold, int32_t hysteresis = 100, uint32_t refractoryMs = 300)
+      : threshold(threshold), hysteresis(hysteresis), refractoryMs(refractoryMs),
+        armed(true), lastBeat(0), interval(0), beats(0), suppressed(0)
+  {
+  }
+
+  // Returns true on the sample that starts a new beat.
+  bool update(int32_t sample, uint32_t nowMs)
+  {
+    if (!armed)
+    {
+      if (sample <= threshold - hysteresis)
+      {
+        armed = true;
+      }
+      return false;
+    }
+
+    if (sample > threshold && beats != 0 && nowMs - lastBeat <= refractoryMs)
+    {
+      armed = false;
+      suppressed++;
+      return false;
+    }
+
+    if (sample > threshold)
+    {
+      armed = false;
+      interval = beats == 0 ? 0 : nowMs - lastBeat;
+      lastBeat = nowMs;
+      beats++;
+      return true;
+    }
+    return false;
+  }
+
+  void setThreshold(int32_t value) { threshold = value; }
+  int32_t getThreshold() const { return threshold; }
+  uint32_t lastBeatMs() const { return lastBeat; }
+  uint32_t lastIntervalMs() const { return interval; }
+  uint32_t beatCount() const { return beats; }
+  uint32_t suppressedCount() const { return suppressed; }
+
+  void reset()
+  {
+    armed = true;
+    lastBeat = 0;
+    interval = 0;
+    beats = 0;
+    suppressed = 0;
+  }
+
+private:
+  int32_t threshold;
+  int32_t hysteresis;
+  uint32_t refractoryMs;
+  bool armed;
+  uint32_t lastBeat;
+  uint32_t interval;
+  uint32_t beats;
+  uint32_t suppressed;
+};
+
+// Tracks one beat source (ECG or PPG): converts intervals to a rate and keeps
+// a 0..1 quality index based on how regular the intervals are.
+class BeatChannel
+{
+public:
+  BeatChannel() : lastBeat(0), meanInterval(0), quality(0), rate(0), hasBeat(false) {}
+
+  // Feeds a detected beat. Returns true and sets beatRate when the interval
+  // gives a physiologically valid rate.
+  bool onBeat(uint32_t nowMs, float &beatRate)
+  {
+    uint32_t interval = nowMs - lastBeat;
+    bool firstBeat = !hasBeat;
+    lastBeat = nowMs;
+    hasBeat = true;
+
+    if (firstBeat || interval == 0)
+    {
+      return false;
+    }
+
+    float instantRate = 60000.0f / interval;
+    if (instantRate < HEART_RATE_MIN_VALID || instantRate > HEART_RATE_MAX_VALID)
+    {
+      // Missed or double-counted beat: penalise quality, keep last raw value
+      quality *= 0.5f;
+      return false;
+    }
+
+    // Quality follows how regular this interval is against the running mean
+    if (meanInterval <= 0)
+    {
+      meanInterval = interval;
+    }
+    float deviation = fabsf(interval - meanInterval) / meanInterval;
+    float beatQuality = 1.0f - 2.0f * deviation;
+    beatQuality = beatQuality < 0 ? 0 : (beatQuality > 1 ? 1 : beatQuality);
+    quality = 0.7f * quality + 0.3f * beatQuality;
+    meanInterval = 0.8f * meanInterval + 0.2f * interval;
+
+    rate = instantRate;
+    beatRate = instantRate;
+    return true;
+  }
+
+  // Drops quality to zero when no beat has arrived within timeoutMs.
+  void expire(uint32_t nowMs, uint32_t timeoutMs)
+  {
+    if (!hasBeat || nowMs - lastBeat > timeoutMs)
+    {
+      quality = 0;
+    }
+  }
+
+  // Scales quality, e.g. by a motion or contact penalty.
+  void degrade(float factor) { quality *= factor; }
+  void invalidate() { quality = 0; }
+
+  float getQuality() const { return quality; }
+  float getRate() const { return rate; }
+  uint32_t lastBeatMs() const { return lastBeat; }
+
+private:
+  uint32_t lastBeat;  // Time of last detected beat (ms)
+  float meanInterval; // Running mean RR/PP interval (ms)
+  float quality;      // 0..1 signal quality index
+  float rate;         // Last valid raw beat-to-beat rate (BPM)
+  bool hasBeat;
+};
+
+// Counts beats over a fixed window and reports BPM at the end of each window.
+// Reports zero when no beat has been seen for timeoutMs.
+class BeatRateWindow
+{
+public:
+  BeatRateWindow(uint32_t windowMs, uint32_t timeoutMs)
+      : windowMs(windowMs), timeoutMs(timeoutMs), windowStart(0), lastBeat(0), count(0), rate(0)
+  {
+  }
+
+  void begin(uint32_t nowMs)
+  {
+    windowStart = nowMs;
+    count = 0;
+  }
+
+  void onBeat(uint32_t nowMs)
+  {
+    count++;
+    lastBeat = nowMs;
+  }
+
+  // Returns the current rate in BPM, clamped to 0..200.
+  float update(uint32_t nowMs)
+  {
+    if (nowMs - windowStart >= windowMs)
+    {
+      rate = (count * 60000.0f) / windowMs;
+      count = 0;
+      windowStart = nowMs;
+    }
+
+    if (nowMs - lastBeat > timeoutMs)
+    {
+      rate = 0;
+    }
+
+    if (rate < 0)
+      rate = 0;
+    if (rate > HEART_RATE_MAX_VALID)
+      rate = HEART_RATE_MAX_VALID;
+    return rate;
+  }
+
+  float value() const { return rate; }
+
+private:
+  uint32_t windowMs;
+  uint32_t timeoutMs;
+  uint32_t windowStart;
+  uint32_t lastBeat;
+  uint32_t count;
+  float rate;
+};
+
+} // namespace vitalcare
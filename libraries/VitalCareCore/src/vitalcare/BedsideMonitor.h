@@ -0,0 +1,178 @@
+/*
+ * VitalCare Rural - Bedside Monitor Processing
+ *
+ * The sensor-to-alert logic of the single-ESP32 monitor (esp32-main),
+ * separated from its pins, radio and clock so the host can run it
+ * unchanged. readSensors() gathers each 100 ms read into SensorInputs and
+ * hands it to onSensors(); the 1 s UI tick calls update() for the heart
+ * rate, the blood pressure estimate and the alert and SMS decision.
+ *
+ * Time only enters through the timestamps passed in, and the simulated
+ * variations (blood pressure, fallback temperature) come from a seeded
+ * generator, so the same inputs and seed always give the same vitals and
+ * decisions. Capture.h records both on the device for replay on the host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Alerts.h"
+#include "BeatDetector.h"
+#include "Max3010x.h"
+#include "SpO2.h"
+#include "Vitals.h"
+
+namespace vitalcare
+{
+
+const uint8_t BEDSIDE_MAX_PPG_SAMPLES = Max3010x::FIFO_DEPTH; // One full FIFO per read
+
+// Everything one readSensors() call read from the hardware
+struct SensorInputs
+{
+  uint32_t timeMs;      // millis() of the read
+  uint16_t ecg;         // AD8232 ADC count (not read while a lead is off)
+  uint16_t pulse;       // Pulse sensor ADC count
+  bool leadsOff;        // LO+ or LO- high
+  bool environment;     // A BMP180 reading was available
+  float temperatureC;   // BMP180 temperature (environment only)
+  float pressurePa;     // BMP180 pressure (environment only)
+  bool spo2Ready;       // MAX30102 present and configured
+  uint8_t ppgCount;     // Samples drained from its FIFO
+  PpgSample ppg[BEDSIDE_MAX_PPG_SAMPLES];
+};
+
+// Outcome of one 1 s update
+struct BedsideDecision
+{
+  uint8_t alertFlags; // AlertFlags; ALERT_NONE while not monitoring
+  bool sms;           // Send an SMS alert to the emergency contact
+};
+
+class BedsideMonitor
+{
+public:
+  static const int32_t PULSE_THRESHOLD = 2048;
+  static const uint32_t HEART_RATE_WINDOW_MS = 15000;
+  static const uint32_t HEARTBEAT_TIMEOUT_MS = 10000;
+
+  BedsideMonitor()
+      : pulseDetector(PULSE_THRESHOLD, 0, 0), heartRateWindow(HEART_RATE_WINDOW_MS, HEARTBEAT_TIMEOUT_MS),
+        randomState(1), ecg(0), pressure(0)
+  {
+    vitals = {0, 0, 0, 0, 0, 0};
+  }
+
+  void begin(uint32_t nowMs, uint32_t seed)
+  {
+    randomState = seed ? seed : 1;
+    heartRateWindow.begin(nowMs);
+  }
+
+  // One sensor read. Returns true on a pulse beat (the pulse LED).
+  bool onSensors(const SensorInputs &inputs)
+  {
+    ecg = inputs.leadsOff ? 0 : inputs.ecg;
+
+    // Rising-edge pulse detection
+    bool beat = pulseDetector.update(inputs.pulse, inputs.timeMs);
+    if (beat)
+    {
+      heartRateWindow.onBeat(inputs.timeMs);
+    }
+
+    if (inputs.environment)
+    {
+      vitals.temperature = (inputs.temperatureC * 9.0 / 5.0) + 32.0; // Convert to Fahrenheit
+      pressure = inputs.pressurePa / 100.0;                          // Convert to hPa
+    }
+    else
+    {
+      // Fallback temperature simulation
+      vitals.temperature = 98.6 + variation(-10, 11) / 10.0;
+      pressure = 1013.25 + variation(-20, 21); // Standard atmospheric pressure
+    }
+
+    for (uint8_t i = 0; i < inputs.ppgCount; i++)
+    {
+      spo2Estimator.update(inputs.ppg[i]);
+    }
+    // 0 means no valid reading (no finger, motion, sensor missing), alerted as
+    // ALERT_SPO2_NO_READING rather than as a desaturation
+    vitals.spO2 = inputs.spo2Ready && spo2Estimator.valid() ? spo2Estimator.spO2() : 0;
+    return beat;
+  }
+
+  // The 1 s tick. Alerts are only evaluated while monitoring a patient, and
+  // an SMS goes out on every alerting tick when smsReady.
+  BedsideDecision update(uint32_t nowMs, bool monitoring, bool smsReady)
+  {
+    // Beats counted over the window, zeroed on heartbeat timeout, clamped to 0..200
+    vitals.heartRate = heartRateWindow.update(nowMs);
+    estimateBloodPressure();
+    vitals.timestampMs = nowMs;
+
+    BedsideDecision decision = {ALERT_NONE, false};
+    if (monitoring)
+    {
+      decision.alertFlags = evaluateAlerts(vitals, BEDSIDE_THRESHOLDS);
+      decision.sms = decision.alertFlags != ALERT_NONE && smsReady;
+    }
+    return decision;
+  }
+
+  const VitalSample &sample() const { return vitals; }
+  uint16_t ecgValue() const { return ecg; }
+  float pressureHpa() const { return pressure; }
+
+private:
+  // Simplified BP estimation based on heart rate; a real device would need
+  // a cuff and pressure sensors
+  void estimateBloodPressure()
+  {
+    if (vitals.heartRate > 0)
+    {
+      float baseSystolic = 120;
+      float baseDiastolic = 80;
+      if (vitals.heartRate > 100)
+      {
+        baseSystolic += (vitals.heartRate - 100) * 0.5;
+        baseDiastolic += (vitals.heartRate - 100) * 0.3;
+      }
+      else if (vitals.heartRate < 60)
+      {
+        baseSystolic -= (60 - vitals.heartRate) * 0.3;
+        baseDiastolic -= (60 - vitals.heartRate) * 0.2;
+      }
+
+      // Add some realistic variation
+      vitals.systolicBP = baseSystolic + variation(-5, 6);
+      vitals.diastolicBP = baseDiastolic + variation(-3, 4);
+    }
+    else
+    {
+      vitals.systolicBP = 0;
+      vitals.diastolicBP = 0;
+    }
+  }
+
+  // Arduino random(low, high) semantics on a xorshift32 generator
+  int32_t variation(int32_t low, int32_t high)
+  {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return low + (int32_t)(randomState % (uint32_t)(high - low));
+  }
+
+  ThresholdBeatDetector pulseDetector;
+  BeatRateWindow heartRateWindow;
+  SpO2Estimator spo2Estimator;
+  uint32_t randomState;
+  VitalSample vitals;
+  uint16_t ecg;
+  float pressure;
+};
+
+} // namespace vitalcare
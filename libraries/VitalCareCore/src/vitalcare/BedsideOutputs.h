@@ -0,0 +1,175 @@
+/*
+ * VitalCare Rural - Bedside Monitor Outputs
+ *
+ * What esp32-main makes of each sensor read and 1 s update besides the
+ * decision (BedsideMonitor.h): the patient's EDF+ recording and the vitals
+ * frame sent to dashboards. Like BedsideMonitor they take time as an
+ * argument and never allocate, so the host heap soak runs them as they are.
+ *
+ * The recording holds one 1 s data record per update: the 10 ECG reads
+ * (midscale while a lead is off), the 100 Hz PPG red and IR FIFO samples
+ * (the top 15 of their 18 bits) and annotations for leads-off spans and
+ * for each change in the set of alerts.
+ *
+ *   BedsideRecording recording;
+ *   recording.begin(edf, info, nowMs);    // edf built on a record buffer of
+ *                                         // BEDSIDE_EDF_RECORD_BYTES
+ *   recording.onSensors(inputs, ecg);     // every read
+ *   recording.onAlerts(nowMs, flags, text); // every update, then edf.endRecord()
+ *   recording.close(nowMs);
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "BedsideMonitor.h"
+#include "Edf.h"
+#include "Encoding.h"
+#include "Vitals.h"
+
+namespace vitalcare
+{
+
+const uint32_t BEDSIDE_EDF_RECORD_MS = 1000;
+const uint16_t BEDSIDE_ECG_SAMPLES_PER_RECORD = 10; // One per 100 ms read
+const uint16_t BEDSIDE_PPG_SAMPLES_PER_RECORD = Max3010x::SAMPLE_RATE_HZ;
+const size_t BEDSIDE_EDF_RECORD_BYTES =
+    (BEDSIDE_ECG_SAMPLES_PER_RECORD + 2 * BEDSIDE_PPG_SAMPLES_PER_RECORD) * 2 + EDF_DEFAULT_ANNOTATION_BYTES;
+const int16_t BEDSIDE_ECG_LEADS_OFF_SAMPLE = 2048; // Midscale of the 12-bit ADC
+
+// Signal numbers in a bedside recording
+enum BedsideEdfSignal : uint8_t
+{
+  BEDSIDE_EDF_ECG = 0,
+  BEDSIDE_EDF_PPG_RED = 1,
+  BEDSIDE_EDF_PPG_IR = 2,
+};
+
+// Waveform samples of a read, as recorded and kept in the history rings
+inline int16_t bedsideEcgSample(const SensorInputs &inputs, uint16_t ecgValue)
+{
+  return inputs.leadsOff ? BEDSIDE_ECG_LEADS_OFF_SAMPLE : (int16_t)ecgValue;
+}
+
+inline int16_t bedsidePpgSample(uint32_t counts)
+{
+  return (int16_t)(counts >> 3);
+}
+
+class BedsideRecording
+{
+public:
+  BedsideRecording() : edf(nullptr), startMs(0), leadsOffSinceMs(0), leadsOff(false), alertFlags(ALERT_NONE) {}
+
+  // Adds the signals to a new writer and writes the header. leadsOff
+  // carries a span still open in the previous part over into this one.
+  bool begin(EdfWriter &writer, const EdfRecordingInfo &info, uint32_t nowMs, bool leadsOff = false)
+  {
+    // AD8232: gain 100 around midscale of the 3.3 V ADC, so full scale is +-16.5 mV
+    static const EdfSignal ecg = {"ECG", "AD8232 chest electrodes", "mV", -16.5f, 16.5f, 0, 4095,
+                                  "HP:0.5Hz LP:40Hz", BEDSIDE_ECG_SAMPLES_PER_RECORD};
+    static const EdfSignal red = {"PPG Red", "MAX30102 red LED", "counts", 0, 262143, 0, 32767,
+                                  "", BEDSIDE_PPG_SAMPLES_PER_RECORD};
+    static const EdfSignal ir = {"PPG IR", "MAX30102 IR LED", "counts", 0, 262143, 0, 32767,
+                                 "", BEDSIDE_PPG_SAMPLES_PER_RECORD};
+    edf = nullptr;
+    if (!writer.addSignal(ecg) || !writer.addSignal(red) || !writer.addSignal(ir) ||
+        !writer.begin(info, BEDSIDE_EDF_RECORD_MS))
+      return false;
+    edf = &writer;
+    startMs = nowMs;
+    leadsOffSinceMs = nowMs;
+    this->leadsOff = leadsOff;
+    alertFlags = ALERT_NONE;
+    return true;
+  }
+
+  // One read: its samples, and the end of a leads-off span as an annotation.
+  // Leads-off is followed while not recording too, for the next begin().
+  void onSensors(const SensorInputs &inputs, uint16_t ecgValue)
+  {
+    if (edf)
+    {
+      edf->addSample(BEDSIDE_EDF_ECG, bedsideEcgSample(inputs, ecgValue));
+      if (!inputs.leadsOff && leadsOff)
+        edf->annotate(leadsOffSinceMs - startMs, inputs.timeMs - leadsOffSinceMs, "Leads off");
+      for (uint8_t i = 0; i < inputs.ppgCount; i++)
+      {
+        edf->addSample(BEDSIDE_EDF_PPG_RED, bedsidePpgSample(inputs.ppg[i].red));
+        edf->addSample(BEDSIDE_EDF_PPG_IR, bedsidePpgSample(inputs.ppg[i].ir));
+      }
+    }
+    if (inputs.leadsOff && !leadsOff)
+      leadsOffSinceMs = inputs.timeMs;
+    leadsOff = inputs.leadsOff;
+  }
+
+  // One update's alerts: annotated when the set changes, not every second
+  void onAlerts(uint32_t nowMs, uint8_t flags, const char *text)
+  {
+    if (edf && flags != ALERT_NONE && flags != alertFlags)
+      edf->annotate(nowMs - startMs, 0, text);
+    alertFlags = flags;
+  }
+
+  // Annotates a leads-off span still open and closes the writer
+  bool close(uint32_t nowMs)
+  {
+    if (!edf)
+      return false;
+    if (leadsOff)
+      edf->annotate(leadsOffSinceMs - startMs, nowMs - leadsOffSinceMs, "Leads off");
+    bool ok = edf->close();
+    edf = nullptr;
+    return ok;
+  }
+
+  // Lets go of the writer without writing to it (the card is gone)
+  void abandon() { edf = nullptr; }
+
+  bool recording() const { return edf != nullptr; }
+  bool ecgLeadsOff() const { return leadsOff; }
+
+private:
+  EdfWriter *edf;
+  uint32_t startMs;
+  uint32_t leadsOffSinceMs;
+  bool leadsOff;
+  uint8_t alertFlags;
+};
+
+// The 1 s dashboard frame; vitals.timestampMs is the update's millis()
+struct VitalsFrame
+{
+  VitalSample vitals;
+  uint16_t ecgValue;
+  float pressureHpa;
+  const char *status;
+  uint32_t seq;        // Echoed back by the dashboard once rendered
+  uint32_t historySeq; // Newest update in the history ring
+};
+
+// Writes the frame's JSON to out; returns its length, 0 if it did not fit
+inline size_t formatVitalsFrame(const VitalsFrame &frame, char *out, size_t capacity)
+{
+  JsonWriter json(out, capacity);
+  json.beginObject()
+      .string("type", "vitals")
+      .number("heartRate", frame.vitals.heartRate, 1)
+      .number("systolicBP", frame.vitals.systolicBP, 1)
+      .number("diastolicBP", frame.vitals.diastolicBP, 1)
+      .number("spO2", frame.vitals.spO2, 1)
+      .number("temperature", frame.vitals.temperature, 1)
+      .integer("ecgValue", frame.ecgValue)
+      .number("pressure", frame.pressureHpa, 2)
+      .integer("timestamp", frame.vitals.timestampMs)
+      .string("status", frame.status)
+      .integer("seq", frame.seq)
+      .integer("historySeq", frame.historySeq)
+      .endObject();
+  return json.ok() ? json.size() : 0;
+}
+
+} // namespace vitalcare
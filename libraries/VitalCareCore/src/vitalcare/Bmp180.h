@@ -0,0 +1,276 @@
+/*
+ * VitalCare Rural - BMP180 Temperature/Pressure Driver
+ *
+ * Asynchronous replacement for the blocking Adafruit_BMP085 calls. Each
+ * measurement is a chain of short I2C jobs (start conversion, read result)
+ * and the conversion time is waited out between poll() calls instead of
+ * with delay(), so the bus and loop() stay free for the other sensors.
+ *
+ * Compensation follows the integer algorithm in the BMP180 datasheet.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "I2cBus.h"
+
+namespace vitalcare
+{
+
+class Bmp180
+{
+public:
+  static const uint8_t ADDRESS = 0x77;
+  static const uint8_t CHIP_ID = 0x55;
+
+  static const uint8_t REG_CALIBRATION = 0xAA; // 22 bytes, AC1..MD
+  static const uint8_t REG_CHIP_ID = 0xD0;
+  static const uint8_t REG_CONTROL = 0xF4;
+  static const uint8_t REG_RESULT = 0xF6;      // MSB, LSB, XLSB
+  static const uint8_t CMD_TEMPERATURE = 0x2E;
+  static const uint8_t CMD_PRESSURE = 0x34;    // | oversampling << 6
+
+  enum Oversampling : uint8_t
+  {
+    ULTRA_LOW_POWER = 0,
+    STANDARD = 1,
+    HIGH_RESOLUTION = 2,
+    ULTRA_HIGH_RESOLUTION = 3,
+  };
+
+  Bmp180(I2cBus &bus, uint32_t intervalMs = 1000, Oversampling oversampling = ULTRA_HIGH_RESOLUTION,
+         uint8_t priority = I2C_PRIORITY_LOW)
+      : bus(bus), intervalMs(intervalMs), oss(oversampling), priority(priority),
+        state(STATE_UNINITIALISED), deadlineSet(false), deadlineMs(0), lastStartMs(0), started(false),
+        temperatureX10(0), pressure(0), measurements(0), errors(0)
+  {
+  }
+
+  // Starts the asynchronous probe and calibration read.
+  void begin()
+  {
+    state = STATE_PROBING;
+    measurements = 0;
+    submit(REG_CHIP_ID, false, buffer, 1);
+  }
+
+  // Advances the measurement: starts one every intervalMs and collects each
+  // conversion once its time has passed. Call regularly from loop().
+  void poll(uint32_t nowMs)
+  {
+    switch (state)
+    {
+    case STATE_IDLE:
+      if (!started || nowMs - lastStartMs >= intervalMs)
+      {
+        started = true;
+        lastStartMs = nowMs;
+        state = STATE_START_TEMPERATURE;
+        command = CMD_TEMPERATURE;
+        submit(REG_CONTROL, true, &command, 1);
+      }
+      break;
+
+    case STATE_CONVERTING_TEMPERATURE:
+    case STATE_CONVERTING_PRESSURE:
+      // The conversion started somewhere since the last poll; timing from
+      // now is conservative and needs no clock in the callback
+      if (!deadlineSet)
+      {
+        deadlineSet = true;
+        deadlineMs = nowMs + conversionMs(state == STATE_CONVERTING_PRESSURE);
+      }
+      else if ((int32_t)(nowMs - deadlineMs) >= 0)
+      {
+        bool pressureResult = state == STATE_CONVERTING_PRESSURE;
+        state = pressureResult ? STATE_READ_PRESSURE : STATE_READ_TEMPERATURE;
+        submit(REG_RESULT, false, buffer, pressureResult ? 3 : 2);
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  bool ready() const { return state >= STATE_IDLE && state != STATE_FAILED; }
+  bool failed() const { return state == STATE_FAILED; }
+  // Still probing or calibrating
+  bool busy() const { return state == STATE_PROBING || state == STATE_CALIBRATING; }
+  bool hasReading() const { return measurements > 0; }
+
+  float temperatureC() const { return temperatureX10 / 10.0f; }
+  int16_t temperatureC10() const { return temperatureX10; }
+  int32_t pressurePa() const { return pressure; }
+  uint32_t measurementCount() const { return measurements; }
+  uint32_t errorCount() const { return errors; }
+
+  // Conversion times from the datasheet, rounded up to whole milliseconds
+  uint8_t conversionMs(bool pressureConversion) const
+  {
+    static const uint8_t PRESSURE_MS[] = {5, 8, 14, 26};
+    return pressureConversion ? PRESSURE_MS[oss] : 5;
+  }
+
+  struct Calibration
+  {
+    int16_t ac1, ac2, ac3;
+    uint16_t ac4, ac5, ac6;
+    int16_t b1, b2, mb, mc, md;
+  };
+
+  // Datasheet compensation: ut/up raw readings -> 0.1 degC and Pa
+  static void compensate(const Calibration &cal, int32_t ut, int32_t up, uint8_t oss,
+                         int16_t &temperatureX10, int32_t &pressurePa)
+  {
+    int32_t x1 = ((ut - (int32_t)cal.ac6) * (int32_t)cal.ac5) >> 15;
+    int32_t x2 = ((int32_t)cal.mc << 11) / (x1 + cal.md);
+    int32_t b5 = x1 + x2;
+    temperatureX10 = (int16_t)((b5 + 8) >> 4);
+
+    int32_t b6 = b5 - 4000;
+    x1 = ((int32_t)cal.b2 * ((b6 * b6) >> 12)) >> 11;
+    x2 = ((int32_t)cal.ac2 * b6) >> 11;
+    int32_t x3 = x1 + x2;
+    int32_t b3 = ((((int32_t)cal.ac1 * 4 + x3) << oss) + 2) / 4;
+    x1 = ((int32_t)cal.ac3 * b6) >> 13;
+    x2 = ((int32_t)cal.b1 * ((b6 * b6) >> 12)) >> 16;
+    x3 = ((x1 + x2) + 2) >> 2;
+    uint32_t b4 = ((uint32_t)cal.ac4 * (uint32_t)(x3 + 32768)) >> 15;
+    uint32_t b7 = ((uint32_t)up - b3) * (uint32_t)(50000 >> oss);
+    int32_t p = b7 < 0x80000000u ? (int32_t)((b7 * 2) / b4) : (int32_t)((b7 / b4) * 2);
+
+    x1 = (p >> 8) * (p >> 8);
+    x1 = (x1 * 3038) >> 16;
+    x2 = (-7357 * p) >> 16;
+    pressurePa = p + ((x1 + x2 + 3791) >> 4);
+  }
+
+private:
+  enum State : uint8_t
+  {
+    STATE_UNINITIALISED,
+    STATE_PROBING,
+    STATE_CALIBRATING,
+    STATE_IDLE,
+    STATE_START_TEMPERATURE,
+    STATE_CONVERTING_TEMPERATURE,
+    STATE_READ_TEMPERATURE,
+    STATE_START_PRESSURE,
+    STATE_CONVERTING_PRESSURE,
+    STATE_READ_PRESSURE,
+    STATE_FAILED,
+  };
+
+  void submit(uint8_t reg, bool write, uint8_t *data, uint16_t length)
+  {
+    I2cTransaction transaction = {ADDRESS, reg, write, priority, length, data, &Bmp180::onComplete, this};
+    if (!bus.submit(transaction))
+    {
+      fail();
+    }
+  }
+
+  static void onComplete(void *context, const I2cTransaction &, I2cStatus status)
+  {
+    static_cast<Bmp180 *>(context)->handleCompletion(status);
+  }
+
+  // Measurement errors drop back to idle and retry next interval; probe
+  // and calibration errors are permanent
+  void fail()
+  {
+    errors++;
+    state = (state == STATE_PROBING || state == STATE_CALIBRATING) ? STATE_FAILED : STATE_IDLE;
+  }
+
+  void handleCompletion(I2cStatus status)
+  {
+    if (status != I2C_OK)
+    {
+      fail();
+      return;
+    }
+
+    switch (state)
+    {
+    case STATE_PROBING:
+      if (buffer[0] != CHIP_ID)
+      {
+        state = STATE_FAILED;
+        return;
+      }
+      state = STATE_CALIBRATING;
+      submit(REG_CALIBRATION, false, buffer, 22);
+      break;
+
+    case STATE_CALIBRATING:
+      calibration.ac1 = (int16_t)be16(0);
+      calibration.ac2 = (int16_t)be16(2);
+      calibration.ac3 = (int16_t)be16(4);
+      calibration.ac4 = be16(6);
+      calibration.ac5 = be16(8);
+      calibration.ac6 = be16(10);
+      calibration.b1 = (int16_t)be16(12);
+      calibration.b2 = (int16_t)be16(14);
+      calibration.mb = (int16_t)be16(16);
+      calibration.mc = (int16_t)be16(18);
+      calibration.md = (int16_t)be16(20);
+      state = STATE_IDLE;
+      break;
+
+    case STATE_START_TEMPERATURE:
+      deadlineSet = false;
+      state = STATE_CONVERTING_TEMPERATURE;
+      break;
+
+    case STATE_READ_TEMPERATURE:
+      rawTemperature = be16(0);
+      state = STATE_START_PRESSURE;
+      command = (uint8_t)(CMD_PRESSURE | (oss << 6));
+      submit(REG_CONTROL, true, &command, 1);
+      break;
+
+    case STATE_START_PRESSURE:
+      deadlineSet = false;
+      state = STATE_CONVERTING_PRESSURE;
+      break;
+
+    case STATE_READ_PRESSURE:
+    {
+      int32_t rawPressure = (((int32_t)buffer[0] << 16) | ((int32_t)buffer[1] << 8) | buffer[2]) >> (8 - oss);
+      compensate(calibration, rawTemperature, rawPressure, oss, temperatureX10, pressure);
+      measurements++;
+      state = STATE_IDLE;
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  uint16_t be16(uint8_t offset) const { return (uint16_t)((buffer[offset] << 8) | buffer[offset + 1]); }
+
+  I2cBus &bus;
+  uint32_t intervalMs;
+  uint8_t oss;
+  uint8_t priority;
+  State state;
+  bool deadlineSet;
+  uint32_t deadlineMs;
+  uint32_t lastStartMs;
+  bool started;
+  uint8_t command;
+  uint8_t buffer[22];
+  Calibration calibration;
+  int32_t rawTemperature;
+
+  int16_t temperatureX10;
+  int32_t pressure;
+  uint32_t measurements;
+  uint32_t errors;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,283 @@
+/*
+ * VitalCare Rural - Sensor Capture Files
+ *
+ * An optional on-device record of everything BedsideMonitor is given: each
+ * sensor read, each 1 s update with its inputs, patient changes, and the
+ * decision the device acted on. Replaying the events through the same
+ * BedsideMonitor with the recorded seed reproduces the device's vitals,
+ * alerts and SMS decisions exactly, on a virtual clock and much faster
+ * than real time (host/tools/replay). Little-endian throughout.
+ *
+ * Header (CAPTURE_HEADER_SIZE bytes):
+ *   0  u32  magic "VCS1"
+ *   4  u8   version
+ *   5       reserved, zero (3 bytes)
+ *   8  u64  device id
+ *   16 u32  BedsideMonitor seed
+ *   20 u32  time BedsideMonitor::begin() was given (ms)
+ *   24      reserved, zero (4 bytes)
+ *   28 u32  CRC-32 of bytes 0..27
+ *
+ * Events follow back to back, each a u8 type and a u16 payload length
+ * followed by the payload:
+ *   CAPTURE_SENSORS   u32 time, u16 ecg, u16 pulse, u8 flags (CaptureSensorFlags),
+ *                     u8 PPG count, f32 temperature (C), f32 pressure (Pa),
+ *                     then per PPG sample u32 red, u32 ir
+ *   CAPTURE_UPDATE    u32 time, u8 flags (CaptureUpdateFlags)
+ *   CAPTURE_PATIENT   u32 time, u8 id length, id, u8 name length, name
+ *   CAPTURE_DECISION  u32 time, u8 alert flags, u8 SMS sent
+ *
+ * Readers skip event types they do not know. A capture cut short by a
+ * reset or power loss ends at its last whole event.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "BedsideMonitor.h"
+#include "Checksum.h"
+#include "Encoding.h"
+#include "Records.h"
+
+namespace vitalcare
+{
+
+const uint32_t CAPTURE_MAGIC = 0x31534356; // "VCS1"
+const uint8_t CAPTURE_VERSION = 1;
+const size_t CAPTURE_HEADER_SIZE = 32;
+const size_t CAPTURE_EVENT_HEADER_SIZE = 3;
+const size_t CAPTURE_SENSORS_FIXED_SIZE = 18;
+// Largest event: a sensor read that drained a full PPG FIFO
+const size_t CAPTURE_MAX_EVENT_SIZE = CAPTURE_EVENT_HEADER_SIZE + CAPTURE_SENSORS_FIXED_SIZE +
+                                      BEDSIDE_MAX_PPG_SAMPLES * 8;
+
+enum CaptureEventType : uint8_t
+{
+  CAPTURE_SENSORS = 1,
+  CAPTURE_UPDATE = 2,
+  CAPTURE_PATIENT = 3,
+  CAPTURE_DECISION = 4,
+};
+
+enum CaptureSensorFlags : uint8_t
+{
+  CAPTURE_LEADS_OFF = 1 << 0,
+  CAPTURE_ENVIRONMENT = 1 << 1,
+  CAPTURE_SPO2_READY = 1 << 2,
+};
+
+enum CaptureUpdateFlags : uint8_t
+{
+  CAPTURE_MONITORING = 1 << 0,
+  CAPTURE_SMS_READY = 1 << 1,
+};
+
+struct CaptureHeader
+{
+  uint64_t deviceId;
+  uint32_t seed;    // BedsideMonitor::begin() seed
+  uint32_t startMs; // BedsideMonitor::begin() time
+};
+
+// One decoded event; only the fields of its type are set
+struct CaptureEvent
+{
+  uint8_t type;
+  uint32_t timeMs;
+  SensorInputs sensors;                      // CAPTURE_SENSORS
+  bool monitoring;                           // CAPTURE_UPDATE
+  bool smsReady;                             // CAPTURE_UPDATE
+  char patientId[PATIENT_ID_LENGTH + 1];     // CAPTURE_PATIENT, NUL terminated
+  char patientName[PATIENT_NAME_LENGTH + 1]; // CAPTURE_PATIENT, NUL terminated
+  BedsideDecision decision;                  // CAPTURE_DECISION
+};
+
+// Encodes into out, which must hold CAPTURE_HEADER_SIZE bytes.
+inline size_t encodeCaptureHeader(const CaptureHeader &header, uint8_t *out)
+{
+  BinaryWriter writer(out, CAPTURE_HEADER_SIZE);
+  writer.u32(CAPTURE_MAGIC).u8(CAPTURE_VERSION).u8(0).u16(0);
+  writer.u64(header.deviceId).u32(header.seed).u32(header.startMs).u32(0);
+  writer.u32(crc32(out, CAPTURE_HEADER_SIZE - 4));
+  return writer.size();
+}
+
+// Checks magic, version and header CRC.
+inline bool decodeCaptureHeader(const uint8_t *in, size_t length, CaptureHeader &header)
+{
+  if (length < CAPTURE_HEADER_SIZE)
+  {
+    return false;
+  }
+  BinaryReader reader(in, CAPTURE_HEADER_SIZE);
+  if (reader.u32() != CAPTURE_MAGIC || reader.u8() != CAPTURE_VERSION)
+  {
+    return false;
+  }
+  reader.skip(3);
+  header.deviceId = reader.u64();
+  header.seed = reader.u32();
+  header.startMs = reader.u32();
+  reader.skip(4);
+  uint32_t headerCrc = reader.u32();
+  return reader.ok() && headerCrc == crc32(in, CAPTURE_HEADER_SIZE - 4);
+}
+
+// The encoders write one event into out (CAPTURE_MAX_EVENT_SIZE bytes is
+// always enough) and return its size.
+inline size_t encodeCaptureSensors(const SensorInputs &inputs, uint8_t *out)
+{
+  uint8_t count = inputs.ppgCount > BEDSIDE_MAX_PPG_SAMPLES ? BEDSIDE_MAX_PPG_SAMPLES : inputs.ppgCount;
+  uint8_t flags = (inputs.leadsOff ? CAPTURE_LEADS_OFF : 0) | (inputs.environment ? CAPTURE_ENVIRONMENT : 0) |
+                  (inputs.spo2Ready ? CAPTURE_SPO2_READY : 0);
+  BinaryWriter writer(out, CAPTURE_MAX_EVENT_SIZE);
+  writer.u8(CAPTURE_SENSORS).u16((uint16_t)(CAPTURE_SENSORS_FIXED_SIZE + count * 8));
+  writer.u32(inputs.timeMs).u16(inputs.ecg).u16(inputs.pulse).u8(flags).u8(count);
+  writer.f32(inputs.temperatureC).f32(inputs.pressurePa);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    writer.u32(inputs.ppg[i].red).u32(inputs.ppg[i].ir);
+  }
+  return writer.size();
+}
+
+inline size_t encodeCaptureUpdate(uint32_t timeMs, bool monitoring, bool smsReady, uint8_t *out)
+{
+  BinaryWriter writer(out, CAPTURE_MAX_EVENT_SIZE);
+  writer.u8(CAPTURE_UPDATE).u16(5).u32(timeMs);
+  writer.u8((monitoring ? CAPTURE_MONITORING : 0) | (smsReady ? CAPTURE_SMS_READY : 0));
+  return writer.size();
+}
+
+// Longer ids and names are cut to PATIENT_ID_LENGTH and PATIENT_NAME_LENGTH
+inline size_t encodeCapturePatient(uint32_t timeMs, const char *patientId, const char *name, uint8_t *out)
+{
+  size_t idLength = strnlen(patientId, PATIENT_ID_LENGTH);
+  size_t nameLength = strnlen(name, PATIENT_NAME_LENGTH);
+  BinaryWriter writer(out, CAPTURE_MAX_EVENT_SIZE);
+  writer.u8(CAPTURE_PATIENT).u16((uint16_t)(6 + idLength + nameLength)).u32(timeMs);
+  writer.u8((uint8_t)idLength).bytes(patientId, idLength);
+  writer.u8((uint8_t)nameLength).bytes(name, nameLength);
+  return writer.size();
+}
+
+inline size_t encodeCaptureDecision(uint32_t timeMs, const BedsideDecision &decision, uint8_t *out)
+{
+  BinaryWriter writer(out, CAPTURE_MAX_EVENT_SIZE);
+  writer.u8(CAPTURE_DECISION).u16(6).u32(timeMs).u8(decision.alertFlags).u8(decision.sms ? 1 : 0);
+  return writer.size();
+}
+
+// Walks the events of a capture held in memory (after the header):
+//
+//   CaptureReader reader(data + CAPTURE_HEADER_SIZE, length - CAPTURE_HEADER_SIZE);
+//   CaptureEvent event;
+//   while (reader.next(event))
+//     ...
+class CaptureReader
+{
+public:
+  CaptureReader(const uint8_t *data, size_t length) : data(data), length(length), offset(0), cut(false) {}
+
+  // False at the end, or at a malformed or partly written event (truncated())
+  bool next(CaptureEvent &event)
+  {
+    while (offset + CAPTURE_EVENT_HEADER_SIZE <= length)
+    {
+      BinaryReader header(data + offset, CAPTURE_EVENT_HEADER_SIZE);
+      event.type = header.u8();
+      size_t payloadLength = header.u16();
+      if (event.type == 0 || offset + CAPTURE_EVENT_HEADER_SIZE + payloadLength > length)
+      {
+        break;
+      }
+      const uint8_t *payload = data + offset + CAPTURE_EVENT_HEADER_SIZE;
+      offset += CAPTURE_EVENT_HEADER_SIZE + payloadLength;
+
+      BinaryReader reader(payload, payloadLength);
+      event.timeMs = reader.u32();
+      bool valid = true;
+      switch (event.type)
+      {
+      case CAPTURE_SENSORS:
+        valid = decodeSensors(reader, event.timeMs, event.sensors);
+        break;
+      case CAPTURE_UPDATE:
+      {
+        uint8_t flags = reader.u8();
+        event.monitoring = (flags & CAPTURE_MONITORING) != 0;
+        event.smsReady = (flags & CAPTURE_SMS_READY) != 0;
+        break;
+      }
+      case CAPTURE_PATIENT:
+        valid = readText(reader, event.patientId, PATIENT_ID_LENGTH) &&
+                readText(reader, event.patientName, PATIENT_NAME_LENGTH);
+        break;
+      case CAPTURE_DECISION:
+        event.decision.alertFlags = reader.u8();
+        event.decision.sms = reader.u8() != 0;
+        break;
+      default:
+        continue; // Newer event type: skip it
+      }
+      if (!valid || !reader.ok())
+      {
+        offset = length;
+        cut = true;
+        return false;
+      }
+      return true;
+    }
+    cut = cut || offset != length;
+    return false;
+  }
+
+  size_t position() const { return offset; }
+  bool truncated() const { return cut; }
+
+private:
+  static bool decodeSensors(BinaryReader &reader, uint32_t timeMs, SensorInputs &inputs)
+  {
+    inputs.timeMs = timeMs;
+    inputs.ecg = reader.u16();
+    inputs.pulse = reader.u16();
+    uint8_t flags = reader.u8();
+    inputs.leadsOff = (flags & CAPTURE_LEADS_OFF) != 0;
+    inputs.environment = (flags & CAPTURE_ENVIRONMENT) != 0;
+    inputs.spo2Ready = (flags & CAPTURE_SPO2_READY) != 0;
+    inputs.ppgCount = reader.u8();
+    inputs.temperatureC = reader.f32();
+    inputs.pressurePa = reader.f32();
+    if (inputs.ppgCount > BEDSIDE_MAX_PPG_SAMPLES)
+    {
+      return false;
+    }
+    for (uint8_t i = 0; i < inputs.ppgCount; i++)
+    {
+      inputs.ppg[i].red = reader.u32();
+      inputs.ppg[i].ir = reader.u32();
+    }
+    return true;
+  }
+
+  static bool readText(BinaryReader &reader, char *out, size_t capacity)
+  {
+    size_t textLength = reader.u8();
+    if (textLength > capacity || !reader.bytes(out, textLength))
+    {
+      return false;
+    }
+    out[textLength] = '\0';
+    return true;
+  }
+
+  const uint8_t *data;
+  size_t length;
+  size_t offset;
+  bool cut;
+};
+
+} // namespace vitalcare
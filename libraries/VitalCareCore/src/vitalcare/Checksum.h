@@ -0,0 +1,46 @@
+/*
+ * VitalCare Rural - Checksums
+ *
+ * CRC-16/CCITT-FALSE for small records and CRC-32 (IEEE) for blocks and
+ * files. Nibble tables keep flash use at 32/64 bytes.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+inline uint16_t crc16Ccitt(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF)
+{
+  static const uint16_t TABLE[16] = {
+      0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+      0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+
+  for (size_t i = 0; i < length; i++)
+  {
+    crc = (uint16_t)((crc << 4) ^ TABLE[((crc >> 12) ^ (data[i] >> 4)) & 0x0F]);
+    crc = (uint16_t)((crc << 4) ^ TABLE[((crc >> 12) ^ (data[i] & 0x0F)) & 0x0F]);
+  }
+  return crc;
+}
+
+// Pass the previous return value as crc to checksum data in pieces.
+inline uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc = 0)
+{
+  static const uint32_t TABLE[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc = (crc >> 4) ^ TABLE[(crc ^ data[i]) & 0x0F];
+    crc = (crc >> 4) ^ TABLE[(crc ^ (data[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
+}
+
+} // namespace vitalcare
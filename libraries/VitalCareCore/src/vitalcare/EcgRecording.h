@@ -0,0 +1,104 @@
+/*
+ * VitalCare Rural - Raw ECG Recording Segments
+ *
+ * Continuous single-lead ECG written to SD as a run of segment files, each
+ * one header followed by raw ADC samples. Samples are fixed-size, so any
+ * sample of a multi-day recording is one offset away and the host can
+ * memory-map a segment and split it anywhere. Little-endian throughout.
+ *
+ * Segment header (ECG_SEGMENT_HEADER_SIZE bytes):
+ *   0  u32  magic "VCE1"
+ *   4  u8   version
+ *   5  u8   ADC resolution (bits)
+ *   6  u16  sample rate (Hz)
+ *   8  u64  device id
+ *   16 u32  segment index (consecutive within a recording)
+ *   20 u32  sample count (0 while open: take it from the file length)
+ *   24 u64  time of the first sample (ms)
+ *   32 u32  CRC-32 of the samples (0 while open)
+ *   36      reserved, zero
+ *   60 u32  CRC-32 of bytes 0..59
+ *
+ * Samples follow as i16. ECG_LEADS_OFF marks a sample taken with a lead
+ * off. A segment whose first sample is one period after the previous
+ * segment's last continues the same recording.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Checksum.h"
+#include "Encoding.h"
+
+namespace vitalcare
+{
+
+const uint32_t ECG_SEGMENT_MAGIC = 0x31454356; // "VCE1"
+const uint8_t ECG_SEGMENT_VERSION = 1;
+const size_t ECG_SEGMENT_HEADER_SIZE = 64;
+const int16_t ECG_LEADS_OFF = -32768;
+
+struct EcgSegmentHeader
+{
+  uint8_t adcBits;
+  uint16_t sampleRateHz;
+  uint64_t deviceId;
+  uint32_t segmentIndex;
+  uint32_t sampleCount;
+  uint64_t startMs;
+  uint32_t samplesCrc;
+};
+
+// Encodes into out, which must hold ECG_SEGMENT_HEADER_SIZE bytes.
+inline size_t encodeEcgSegmentHeader(const EcgSegmentHeader &header, uint8_t *out)
+{
+  BinaryWriter writer(out, ECG_SEGMENT_HEADER_SIZE);
+  writer.u32(ECG_SEGMENT_MAGIC)
+      .u8(ECG_SEGMENT_VERSION)
+      .u8(header.adcBits)
+      .u16(header.sampleRateHz)
+      .u64(header.deviceId)
+      .u32(header.segmentIndex)
+      .u32(header.sampleCount)
+      .u64(header.startMs)
+      .u32(header.samplesCrc);
+  static const uint8_t RESERVED[ECG_SEGMENT_HEADER_SIZE - 40] = {0};
+  writer.bytes(RESERVED, sizeof(RESERVED));
+  writer.u32(crc32(out, ECG_SEGMENT_HEADER_SIZE - 4));
+  return writer.size();
+}
+
+// Checks magic, version, header CRC and a non-zero sample rate.
+inline bool decodeEcgSegmentHeader(const uint8_t *in, size_t length, EcgSegmentHeader &header)
+{
+  if (length < ECG_SEGMENT_HEADER_SIZE)
+  {
+    return false;
+  }
+  BinaryReader reader(in, ECG_SEGMENT_HEADER_SIZE);
+  if (reader.u32() != ECG_SEGMENT_MAGIC || reader.u8() != ECG_SEGMENT_VERSION)
+  {
+    return false;
+  }
+  header.adcBits = reader.u8();
+  header.sampleRateHz = reader.u16();
+  header.deviceId = reader.u64();
+  header.segmentIndex = reader.u32();
+  header.sampleCount = reader.u32();
+  header.startMs = reader.u64();
+  header.samplesCrc = reader.u32();
+  reader.skip(ECG_SEGMENT_HEADER_SIZE - 4 - reader.position());
+  uint32_t headerCrc = reader.u32();
+
+  return reader.ok() && headerCrc == crc32(in, ECG_SEGMENT_HEADER_SIZE - 4) && header.sampleRateHz != 0;
+}
+
+// Time of sample index within a recording starting at startMs (ms).
+inline uint64_t ecgSampleTimeMs(uint64_t startMs, uint64_t index, uint16_t sampleRateHz)
+{
+  return startMs + index * 1000 / sampleRateHz;
+}
+
+} // namespace vitalcare
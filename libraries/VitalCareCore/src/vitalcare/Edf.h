@@ -0,0 +1,504 @@
+/*
+ * VitalCare Rural - EDF+ Streaming Writer
+ *
+ * Writes recordings as EDF+ (European Data Format, continuous "EDF+C") so
+ * clinicians can open them in standard viewers. Data records are streamed
+ * one at a time through a caller-owned buffer holding exactly one record;
+ * nothing else of the recording is kept in memory, so the same writer runs
+ * on the device while recording and on the host when exporting.
+ *
+ * File layout: a 256-byte header, 256 bytes per signal, then data records
+ * of recordDurationMs each: every signal's samples for that record as i16
+ * little-endian, signal after signal, and last the "EDF Annotations"
+ * signal holding time-stamped annotation lists (TALs). All header fields
+ * are fixed-width ASCII, so sync() and close() can rewrite the header in
+ * place with the final record count; until the first sync() the count
+ * reads -1 ("still recording").
+ *
+ *   EdfWriter edf(output, recordBuffer, sizeof(recordBuffer));
+ *   edf.addSignal(ECG_SIGNAL);
+ *   edf.begin(info, 1000);
+ *   edf.addSample(0, adc);                 // as samples arrive
+ *   edf.annotate(elapsedMs, 0, "Leads off");
+ *   edf.endRecord();                       // once per record duration
+ *   edf.close();
+ *
+ * endRecord() pads a signal that delivered fewer samples than its share
+ * with its last value; samples beyond the share are dropped. Both are
+ * counted. Annotations wait in a small queue until a record has room.
+ *
+ * skipRecord() discards a record the output has no room for. The next
+ * record's timekeeping TAL then jumps past the gap, which is annotated
+ * "Data lost", and the header rewritten by sync() and close() says
+ * "EDF+D" (discontinuous) so viewers leave the gap empty.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace vitalcare
+{
+
+const size_t EDF_MAX_SIGNALS = 8; // data signals; the annotation signal comes on top
+const size_t EDF_MAX_PENDING_ANNOTATIONS = 8;
+const size_t EDF_MAX_ANNOTATION_TEXT = 47;
+const uint16_t EDF_DEFAULT_ANNOTATION_BYTES = 120;
+
+// Where the file goes: an SD File on the device, a FILE * on the host
+class EdfOutput
+{
+public:
+  virtual ~EdfOutput() {}
+
+  virtual bool write(const uint8_t *data, size_t length) = 0;
+  // Moves the write position to offset bytes from the start of the file
+  virtual bool seek(uint64_t offset) = 0;
+};
+
+struct EdfSignal
+{
+  const char *label;      // "ECG", up to 16 characters
+  const char *transducer; // "AD8232 chest electrodes"
+  const char *dimension;  // Physical unit: "mV", "%"
+  float physicalMin;
+  float physicalMax;
+  int16_t digitalMin;
+  int16_t digitalMax;
+  const char *prefilter; // "HP:0.5Hz LP:40Hz" or ""
+  uint16_t samplesPerRecord;
+};
+
+struct EdfRecordingInfo
+{
+  const char *patientCode; // Patient id (spaces become '_')
+  char patientSex;         // 'M', 'F' or 0 for unknown
+  const char *patientName;
+  const char *equipment; // "VitalCare-5643000000000001"
+  // Start date and time; year 0 when unknown (devices without a clock)
+  uint16_t year;
+  uint8_t month, day, hour, minute, second;
+};
+
+class EdfWriter
+{
+public:
+  EdfWriter(EdfOutput &output, uint8_t *buffer, size_t capacity)
+      : output(output), buffer(buffer), capacity(capacity)
+  {
+  }
+
+  // Before begin(); false when EDF_MAX_SIGNALS are set already
+  bool addSignal(const EdfSignal &signal)
+  {
+    if (started || signalCount == EDF_MAX_SIGNALS)
+      return false;
+    signals[signalCount++] = signal;
+    return true;
+  }
+
+  // Writes the header and opens the first record. False when one record
+  // (every signal's share plus annotationBytes) does not fit the buffer
+  // or the write fails.
+  bool begin(const EdfRecordingInfo &recording, uint32_t recordDurationMs,
+             uint16_t annotationBytes = EDF_DEFAULT_ANNOTATION_BYTES)
+  {
+    if (started || recordDurationMs == 0)
+      return false;
+    info = recording;
+    durationMs = recordDurationMs;
+    this->annotationBytes = (uint16_t)((annotationBytes + 1) & ~1u);
+    recordBytes = 0;
+    for (size_t s = 0; s < signalCount; s++)
+    {
+      offsets[s] = recordBytes;
+      recordBytes += signals[s].samplesPerRecord * 2u;
+    }
+    annotationOffset = recordBytes;
+    recordBytes += this->annotationBytes;
+    if (recordBytes > capacity || this->annotationBytes < 16)
+      return false;
+
+    started = true;
+    failed = !writeHeader(-1);
+    clearRecord();
+    return !failed;
+  }
+
+  // Appends to signal's share of the current record; false when full
+  bool addSample(uint8_t signal, int16_t value)
+  {
+    if (!started || signal >= signalCount)
+      return false;
+    if (filled[signal] == signals[signal].samplesPerRecord)
+    {
+      droppedSamples++;
+      return false;
+    }
+    store(signal, filled[signal]++, value);
+    return true;
+  }
+
+  // Bulk addSample(); returns how many samples fitted
+  size_t addSamples(uint8_t signal, const int16_t *samples, size_t count)
+  {
+    if (!started || signal >= signalCount)
+      return 0;
+    size_t room = signals[signal].samplesPerRecord - filled[signal];
+    size_t taken = count < room ? count : room;
+    uint8_t *out = buffer + offsets[signal] + filled[signal] * 2u;
+    for (size_t i = 0; i < taken; i++)
+    {
+      uint16_t value = (uint16_t)samples[i];
+      out[2 * i] = (uint8_t)value;
+      out[2 * i + 1] = (uint8_t)(value >> 8);
+    }
+    filled[signal] += (uint16_t)taken;
+    droppedSamples += count - taken;
+    return taken;
+  }
+
+  // Samples signal still takes before the record is full
+  uint16_t room(uint8_t signal) const
+  {
+    return signal < signalCount ? (uint16_t)(signals[signal].samplesPerRecord - filled[signal]) : 0;
+  }
+
+  // Queues an annotation at onsetMs from the start of the recording
+  // (durationMs 0: an instant). False when the queue is full.
+  bool annotate(uint32_t onsetMs, uint32_t durationMs, const char *text)
+  {
+    if (!started || pendingCount == EDF_MAX_PENDING_ANNOTATIONS)
+    {
+      droppedAnnotations++;
+      return false;
+    }
+    PendingAnnotation &slot = pending[(pendingFirst + pendingCount) % EDF_MAX_PENDING_ANNOTATIONS];
+    slot.onsetMs = onsetMs;
+    slot.durationMs = durationMs;
+    size_t length = 0;
+    for (; text[length] && length < EDF_MAX_ANNOTATION_TEXT; length++)
+    {
+      char c = text[length];
+      slot.text[length] = (c == 0x14 || c == 0x15) ? ' ' : c; // TAL separators
+    }
+    slot.text[length] = '\0';
+    pendingCount++;
+    return true;
+  }
+
+  // Pads short signals, adds the queued annotations that fit and writes
+  // the record.
+  bool endRecord()
+  {
+    if (!started || closed)
+      return false;
+    for (size_t s = 0; s < signalCount; s++)
+    {
+      int16_t last = filled[s] ? load(s, filled[s] - 1) : 0;
+      for (uint16_t i = filled[s]; i < signals[s].samplesPerRecord; i++)
+      {
+        store(s, i, last);
+        paddedSamples++;
+      }
+    }
+    if (gapRecords)
+    {
+      annotate((uint32_t)gapStartMs, gapRecords * durationMs, "Data lost");
+      gapRecords = 0;
+    }
+    writeAnnotations();
+    if (!output.write(buffer, recordBytes))
+      failed = true;
+    recordCount++;
+    clearRecord();
+    return !failed;
+  }
+
+  // Discards the current record's samples instead of writing them; the
+  // recording carries on after the gap
+  bool skipRecord()
+  {
+    if (!started || closed)
+      return false;
+    if (gapRecords == 0)
+      gapStartMs = elapsedMs();
+    gapRecords++;
+    skippedRecords++;
+    clearRecord();
+    return true;
+  }
+
+  // Rewrites the header with the records written so far, so the file is
+  // readable if recording stops without close(), and returns to the end.
+  bool sync()
+  {
+    if (!started || closed)
+      return false;
+    if (!output.seek(0) || !writeHeader((int32_t)recordCount) || !output.seek(endOffset()))
+      failed = true;
+    return !failed;
+  }
+
+  // Ends the partial record (if any samples or annotations wait), then
+  // rewrites the header with the final record count.
+  bool close()
+  {
+    if (!started || closed)
+      return false;
+    bool partial = pendingCount > 0;
+    for (size_t s = 0; s < signalCount; s++)
+      partial = partial || filled[s] > 0;
+    if (partial)
+      endRecord();
+    for (size_t spare = 0; pendingCount && spare < EDF_MAX_PENDING_ANNOTATIONS; spare++)
+      endRecord(); // padding records to carry the last annotations
+    if (!output.seek(0) || !writeHeader((int32_t)recordCount))
+      failed = true;
+    closed = true;
+    return !failed;
+  }
+
+  bool ok() const { return !failed; }
+  uint32_t records() const { return recordCount; }
+  uint32_t skipped() const { return skippedRecords; }
+  uint32_t recordDurationMs() const { return durationMs; }
+  // Start of the current record, from the start of the recording
+  uint64_t elapsedMs() const { return (uint64_t)(recordCount + skippedRecords) * durationMs; }
+  uint32_t recordSize() const { return recordBytes; }
+  uint64_t headerSize() const { return 256u * (signalCount + 2); }
+  uint32_t dropped() const { return droppedSamples; }
+  uint32_t padded() const { return paddedSamples; }
+  uint32_t annotationsDropped() const { return droppedAnnotations; }
+
+private:
+  struct PendingAnnotation
+  {
+    uint32_t onsetMs;
+    uint32_t durationMs;
+    char text[EDF_MAX_ANNOTATION_TEXT + 1];
+  };
+
+  void store(size_t signal, size_t index, int16_t value)
+  {
+    uint8_t *out = buffer + offsets[signal] + index * 2;
+    out[0] = (uint8_t)((uint16_t)value & 0xFF);
+    out[1] = (uint8_t)((uint16_t)value >> 8);
+  }
+
+  int16_t load(size_t signal, size_t index) const
+  {
+    const uint8_t *in = buffer + offsets[signal] + index * 2;
+    return (int16_t)(uint16_t)(in[0] | (in[1] << 8));
+  }
+
+  void clearRecord()
+  {
+    for (size_t s = 0; s < signalCount; s++)
+      filled[s] = 0;
+  }
+
+  uint64_t endOffset() const { return headerSize() + (uint64_t)recordCount * recordBytes; }
+
+  // "+12.345" seconds (no decimals on whole seconds)
+  static size_t formatSeconds(char *out, size_t capacity, uint64_t ms, bool sign)
+  {
+    int written = (ms % 1000)
+                      ? snprintf(out, capacity, "%s%lu.%03u", sign ? "+" : "", (unsigned long)(ms / 1000),
+                                 (unsigned)(ms % 1000))
+                      : snprintf(out, capacity, "%s%lu", sign ? "+" : "", (unsigned long)(ms / 1000));
+    if (written < 0 || (size_t)written >= capacity)
+      return 0;
+    size_t length = (size_t)written;
+    while (ms % 1000 && out[length - 1] == '0')
+      out[--length] = '\0';
+    return length;
+  }
+
+  // The record's timekeeping TAL, then queued annotations while they fit
+  void writeAnnotations()
+  {
+    uint8_t *area = buffer + annotationOffset;
+    memset(area, 0, annotationBytes);
+    char tal[EDF_MAX_ANNOTATION_TEXT + 48];
+    size_t length = formatSeconds(tal, sizeof(tal), elapsedMs(), true);
+    tal[length++] = 0x14;
+    tal[length++] = 0x14;
+    tal[length++] = 0x00;
+    memcpy(area, tal, length);
+    size_t used = length;
+    const size_t timekeeping = length;
+
+    while (pendingCount)
+    {
+      const PendingAnnotation &annotation = pending[pendingFirst];
+      length = formatSeconds(tal, sizeof(tal), annotation.onsetMs, true);
+      if (annotation.durationMs)
+      {
+        tal[length++] = 0x15;
+        length += formatSeconds(tal + length, sizeof(tal) - length, annotation.durationMs, false);
+      }
+      tal[length++] = 0x14;
+      size_t text = strlen(annotation.text);
+      memcpy(tal + length, annotation.text, text);
+      length += text;
+      tal[length++] = 0x14;
+      tal[length++] = 0x00;
+      bool fits = used + length <= annotationBytes;
+      if (!fits && used > timekeeping)
+        break; // next record
+      if (fits)
+        memcpy(area + used, tal, length);
+      else
+        droppedAnnotations++; // longer than a whole record's annotation space
+      used += fits ? length : 0;
+      pendingFirst = (pendingFirst + 1) % EDF_MAX_PENDING_ANNOTATIONS;
+      pendingCount--;
+    }
+  }
+
+  // Left-aligned, space-padded ASCII field
+  bool field(const char *text, size_t width)
+  {
+    char padded[80];
+    size_t length = text ? strnlen(text, width) : 0;
+    memset(padded, ' ', width);
+    for (size_t i = 0; i < length; i++)
+      padded[i] = (text[i] >= 32 && text[i] < 127) ? text[i] : '_';
+    return output.write((const uint8_t *)padded, width);
+  }
+
+  bool numberField(long value, size_t width)
+  {
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", value);
+    return field(text, width);
+  }
+
+  // Physical extremes in 8 characters, as many decimals as fit
+  bool physicalField(float value)
+  {
+    char text[32];
+    for (int decimals = 4; decimals >= 0; decimals--)
+    {
+      snprintf(text, sizeof(text), "%.*f", decimals, (double)value);
+      size_t length = strlen(text);
+      if (decimals > 0)
+      {
+        while (text[length - 1] == '0')
+          text[--length] = '\0';
+        if (text[length - 1] == '.')
+          text[--length] = '\0';
+      }
+      if (length <= 8)
+        return field(text, 8);
+    }
+    return field("0", 8);
+  }
+
+  // EDF+ subfields: spaces inside a subfield become '_', empty is "X"
+  static void subfield(char *out, size_t capacity, size_t &length, const char *text)
+  {
+    if (length + 1 < capacity && length > 0)
+      out[length++] = ' ';
+    if (!text || !*text)
+      text = "X";
+    for (; *text && length + 1 < capacity; text++)
+      out[length++] = *text == ' ' ? '_' : *text;
+    out[length] = '\0';
+  }
+
+  bool writeHeader(int32_t records)
+  {
+    static const char *const MONTHS[12] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN",
+                                           "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+    bool dated = info.year >= 1985 && info.month >= 1 && info.month <= 12 && info.day >= 1;
+    char text[96];
+    size_t length = 0;
+    char sex[2] = {info.patientSex == 'M' || info.patientSex == 'F' ? info.patientSex : 'X', '\0'};
+    subfield(text, sizeof(text), length, info.patientCode);
+    subfield(text, sizeof(text), length, sex);
+    subfield(text, sizeof(text), length, "X"); // birthdate
+    subfield(text, sizeof(text), length, info.patientName);
+    bool ok = field("0", 8) && field(text, 80);
+
+    char date[16];
+    if (dated)
+      snprintf(date, sizeof(date), "%02u-%s-%04u", info.day, MONTHS[info.month - 1], info.year);
+    length = 0;
+    subfield(text, sizeof(text), length, "Startdate");
+    subfield(text, sizeof(text), length, dated ? date : "X");
+    subfield(text, sizeof(text), length, "X"); // admin code
+    subfield(text, sizeof(text), length, "X"); // technician
+    subfield(text, sizeof(text), length, info.equipment);
+    ok = ok && field(text, 80);
+
+    // Unknown dates use the EDF+ placeholder 01.01.85
+    snprintf(date, sizeof(date), "%02u.%02u.%02u", dated ? info.day : 1, dated ? info.month : 1,
+             dated ? info.year % 100 : 85);
+    char time[16];
+    snprintf(time, sizeof(time), "%02u.%02u.%02u", info.hour % 24, info.minute % 60, info.second % 60);
+    char duration[16];
+    formatSeconds(duration, sizeof(duration), durationMs, false);
+    ok = ok && field(date, 8) && field(time, 8) && numberField((long)headerSize(), 8) && field(skippedRecords ? "EDF+D" : "EDF+C", 44) &&
+         numberField(records, 8) && field(duration, 8) && numberField((long)signalCount + 1, 4);
+
+    // Signal headers are field-major: every label, then every transducer, ...
+    const size_t total = signalCount + 1;
+    for (size_t s = 0; s < total; s++)
+      ok = ok && field(s < signalCount ? signals[s].label : "EDF Annotations", 16);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && field(s < signalCount ? signals[s].transducer : "", 80);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && field(s < signalCount ? signals[s].dimension : "", 8);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && (s < signalCount ? physicalField(signals[s].physicalMin) : field("-1", 8));
+    for (size_t s = 0; s < total; s++)
+      ok = ok && (s < signalCount ? physicalField(signals[s].physicalMax) : field("1", 8));
+    for (size_t s = 0; s < total; s++)
+      ok = ok && numberField(s < signalCount ? signals[s].digitalMin : -32768, 8);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && numberField(s < signalCount ? signals[s].digitalMax : 32767, 8);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && field(s < signalCount ? signals[s].prefilter : "", 80);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && numberField(s < signalCount ? signals[s].samplesPerRecord : annotationBytes / 2, 8);
+    for (size_t s = 0; s < total; s++)
+      ok = ok && field("", 32);
+    return ok;
+  }
+
+  EdfOutput &output;
+  uint8_t *buffer;
+  size_t capacity;
+
+  EdfSignal signals[EDF_MAX_SIGNALS] = {};
+  size_t signalCount = 0;
+  uint32_t offsets[EDF_MAX_SIGNALS] = {0};
+  uint16_t filled[EDF_MAX_SIGNALS] = {0};
+  EdfRecordingInfo info = {};
+  uint32_t durationMs = 0;
+  uint16_t annotationBytes = 0;
+  uint32_t annotationOffset = 0;
+  uint32_t recordBytes = 0;
+
+  PendingAnnotation pending[EDF_MAX_PENDING_ANNOTATIONS];
+  size_t pendingFirst = 0;
+  size_t pendingCount = 0;
+
+  uint32_t recordCount = 0;
+  uint32_t skippedRecords = 0;
+  uint32_t gapRecords = 0; // Skipped since the last record written
+  uint64_t gapStartMs = 0;
+  uint32_t droppedSamples = 0;
+  uint32_t paddedSamples = 0;
+  uint32_t droppedAnnotations = 0;
+  bool started = false;
+  bool closed = false;
+  bool failed = false;
+};
+
+} // namespace vitalcare
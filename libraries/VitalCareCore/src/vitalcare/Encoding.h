@@ -0,0 +1,399 @@
+/*
+ * VitalCare Rural - Encoding
+ *
+ * Allocation-free encoders: uptime timestamp formatting, a JSON writer over
+ * a caller-owned buffer, and little-endian binary writer/reader used by the
+ * record formats and the uplink.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace vitalcare
+{
+
+// Formats uptime milliseconds as "H:MM:SS" (hours wrap at 24).
+// Replaces formatTimestamp() / formatDateTime() in the firmwares.
+inline size_t formatTimestamp(uint32_t timestampMs, char *buffer, size_t capacity)
+{
+  unsigned long seconds = timestampMs / 1000;
+  unsigned long minutes = seconds / 60;
+  unsigned long hours = minutes / 60;
+
+  int written = snprintf(buffer, capacity, "%lu:%02lu:%02lu", hours % 24, minutes % 60, seconds % 60);
+  if (written < 0)
+  {
+    return 0;
+  }
+  return (size_t)written < capacity ? (size_t)written : capacity - 1;
+}
+
+// Streaming JSON object writer. Keys are not escaped (they are literals in
+// our code); string values are. ok() turns false on overflow and the output
+// is then truncated but still NUL-terminated.
+class JsonWriter
+{
+public:
+  JsonWriter(char *buffer, size_t capacity) : buffer(buffer), capacity(capacity) { reset(); }
+
+  void reset()
+  {
+    length = 0;
+    depth = 0;
+    overflow = capacity == 0;
+    needComma = false;
+    afterKey = false;
+    if (capacity > 0)
+    {
+      buffer[0] = '\0';
+    }
+  }
+
+  JsonWriter &beginObject() { return open('{'); }
+  JsonWriter &beginObject(const char *key) { return writeKey(key).open('{'); }
+  JsonWriter &endObject() { return close('}'); }
+  JsonWriter &beginArray(const char *key) { return writeKey(key).open('['); }
+  JsonWriter &endArray() { return close(']'); }
+
+  JsonWriter &number(const char *key, double value, uint8_t decimals = 2)
+  {
+    return writeKey(key).numberValue(value, decimals);
+  }
+
+  JsonWriter &integer(const char *key, long long value)
+  {
+    return writeKey(key).integerValue(value);
+  }
+
+  JsonWriter &boolean(const char *key, bool value)
+  {
+    writeKey(key).separate();
+    appendRaw(value ? "true" : "false");
+    return *this;
+  }
+
+  JsonWriter &string(const char *key, const char *value)
+  {
+    return writeKey(key).stringValue(value);
+  }
+
+  // Array element variants
+  JsonWriter &numberValue(double value, uint8_t decimals = 2)
+  {
+    separate();
+    if (isnan(value) || isinf(value))
+    {
+      appendRaw("null");
+    }
+    else
+    {
+      appendFormat("%.*f", (int)decimals, value);
+    }
+    return *this;
+  }
+
+  JsonWriter &integerValue(long long value)
+  {
+    separate();
+    appendFormat("%lld", value);
+    return *this;
+  }
+
+  JsonWriter &stringValue(const char *value)
+  {
+    separate();
+    appendChar('"');
+    for (const char *p = value ? value : ""; *p; p++)
+    {
+      char c = *p;
+      if (c == '"' || c == '\\')
+      {
+        appendChar('\\');
+        appendChar(c);
+      }
+      else if ((unsigned char)c < 0x20)
+      {
+        appendFormat("\\u%04x", (unsigned)c);
+      }
+      else
+      {
+        appendChar(c);
+      }
+    }
+    appendChar('"');
+    return *this;
+  }
+
+  const char *c_str() const { return buffer; }
+  size_t size() const { return length; }
+  bool ok() const { return !overflow; }
+
+private:
+  JsonWriter &open(char c)
+  {
+    separate();
+    appendChar(c);
+    depth++;
+    needComma = false;
+    return *this;
+  }
+
+  JsonWriter &close(char c)
+  {
+    appendChar(c);
+    if (depth > 0)
+    {
+      depth--;
+    }
+    needComma = true;
+    return *this;
+  }
+
+  JsonWriter &writeKey(const char *key)
+  {
+    separate();
+    appendChar('"');
+    appendRaw(key);
+    appendRaw("\":");
+    afterKey = true;
+    return *this;
+  }
+
+  // Emits a comma before the next element of an object or array; a value
+  // directly after its key is not a new element
+  void separate()
+  {
+    if (afterKey)
+    {
+      afterKey = false;
+      return;
+    }
+    if (needComma)
+    {
+      appendChar(',');
+    }
+    needComma = true;
+  }
+
+  void appendChar(char c)
+  {
+    if (length + 1 >= capacity)
+    {
+      overflow = true;
+      return;
+    }
+    buffer[length++] = c;
+    buffer[length] = '\0';
+  }
+
+  void appendRaw(const char *text)
+  {
+    size_t n = strlen(text);
+    if (length + n >= capacity)
+    {
+      overflow = true;
+      n = capacity > length + 1 ? capacity - length - 1 : 0;
+    }
+    memcpy(buffer + length, text, n);
+    length += n;
+    if (capacity > 0)
+    {
+      buffer[length] = '\0';
+    }
+  }
+
+  template <typename... Args>
+  void appendFormat(const char *format, Args... args)
+  {
+    size_t room = capacity - length;
+    int written = snprintf(buffer + length, room, format, args...);
+    if (written < 0 || (size_t)written >= room)
+    {
+      overflow = true;
+      length = capacity > 0 ? capacity - 1 : 0;
+      return;
+    }
+    length += (size_t)written;
+  }
+
+  char *buffer;
+  size_t capacity;
+  size_t length;
+  uint8_t depth;
+  bool overflow;
+  bool needComma;
+  bool afterKey;
+};
+
+// Little-endian binary writer over a caller-owned buffer.
+class BinaryWriter
+{
+public:
+  BinaryWriter(uint8_t *buffer, size_t capacity) : buffer(buffer), capacity(capacity), offset(0), overflow(false) {}
+
+  BinaryWriter &u8(uint8_t value)
+  {
+    if (reserve(1))
+    {
+      buffer[offset++] = value;
+    }
+    return *this;
+  }
+
+  BinaryWriter &u16(uint16_t value)
+  {
+    if (reserve(2))
+    {
+      buffer[offset++] = (uint8_t)value;
+      buffer[offset++] = (uint8_t)(value >> 8);
+    }
+    return *this;
+  }
+
+  BinaryWriter &u32(uint32_t value)
+  {
+    if (reserve(4))
+    {
+      for (int i = 0; i < 4; i++)
+      {
+        buffer[offset++] = (uint8_t)(value >> (8 * i));
+      }
+    }
+    return *this;
+  }
+
+  BinaryWriter &u64(uint64_t value)
+  {
+    return u32((uint32_t)value).u32((uint32_t)(value >> 32));
+  }
+
+  BinaryWriter &i16(int16_t value) { return u16((uint16_t)value); }
+  BinaryWriter &i32(int32_t value) { return u32((uint32_t)value); }
+
+  BinaryWriter &f32(float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return u32(bits);
+  }
+
+  BinaryWriter &bytes(const void *data, size_t n)
+  {
+    if (reserve(n))
+    {
+      memcpy(buffer + offset, data, n);
+      offset += n;
+    }
+    return *this;
+  }
+
+  size_t size() const { return offset; }
+  bool ok() const { return !overflow; }
+  uint8_t *data() { return buffer; }
+
+private:
+  bool reserve(size_t n)
+  {
+    if (overflow || offset + n > capacity)
+    {
+      overflow = true;
+      return false;
+    }
+    return true;
+  }
+
+  uint8_t *buffer;
+  size_t capacity;
+  size_t offset;
+  bool overflow;
+};
+
+// Little-endian reader. Reads past the end return zero and clear ok().
+class BinaryReader
+{
+public:
+  BinaryReader(const uint8_t *buffer, size_t length) : buffer(buffer), length(length), offset(0), underflow(false) {}
+
+  uint8_t u8()
+  {
+    return take(1) ? buffer[offset++] : 0;
+  }
+
+  uint16_t u16()
+  {
+    if (!take(2))
+      return 0;
+    uint16_t value = (uint16_t)(buffer[offset] | (buffer[offset + 1] << 8));
+    offset += 2;
+    return value;
+  }
+
+  uint32_t u32()
+  {
+    if (!take(4))
+      return 0;
+    uint32_t value = (uint32_t)buffer[offset] | ((uint32_t)buffer[offset + 1] << 8) |
+                     ((uint32_t)buffer[offset + 2] << 16) | ((uint32_t)buffer[offset + 3] << 24);
+    offset += 4;
+    return value;
+  }
+
+  uint64_t u64()
+  {
+    uint64_t low = u32();
+    return low | ((uint64_t)u32() << 32);
+  }
+
+  int16_t i16() { return (int16_t)u16(); }
+  int32_t i32() { return (int32_t)u32(); }
+
+  float f32()
+  {
+    uint32_t bits = u32();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  bool bytes(void *out, size_t n)
+  {
+    if (!take(n))
+      return false;
+    memcpy(out, buffer + offset, n);
+    offset += n;
+    return true;
+  }
+
+  void skip(size_t n)
+  {
+    if (take(n))
+      offset += n;
+  }
+
+  size_t position() const { return offset; }
+  size_t remaining() const { return length - offset; }
+  bool ok() const { return !underflow; }
+
+private:
+  bool take(size_t n)
+  {
+    if (underflow || offset + n > length)
+    {
+      underflow = true;
+      return false;
+    }
+    return true;
+  }
+
+  const uint8_t *buffer;
+  size_t length;
+  size_t offset;
+  bool underflow;
+};
+
+} // namespace vitalcare
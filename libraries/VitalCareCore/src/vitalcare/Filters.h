@@ -0,0 +1,123 @@
+/*
+ * VitalCare Rural - Filters
+ *
+ * Small streaming filters for ADC-rate signals. Integer variants use Q15
+ * coefficients so they stay exact and cheap on cores without an FPU path.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RingBuffer.h"
+
+namespace vitalcare
+{
+
+// Sliding-window mean with a running sum (O(1) per sample).
+// Acc must be wide enough to hold N * max(T).
+template <typename T, size_t N, typename Acc = int32_t>
+class MovingAverage
+{
+public:
+  MovingAverage() : sum(0) {}
+
+  T update(T sample)
+  {
+    if (window.full())
+    {
+      sum -= window.oldest();
+    }
+    window.push(sample);
+    sum += sample;
+    return value();
+  }
+
+  T value() const
+  {
+    return window.empty() ? T(0) : T(sum / (Acc)window.size());
+  }
+
+  bool ready() const { return window.full(); }
+
+  void reset()
+  {
+    window.clear();
+    sum = 0;
+  }
+
+private:
+  RingBuffer<T, N> window;
+  Acc sum;
+};
+
+// First-order exponential smoother: y += alpha * (x - y).
+class EmaFilter
+{
+public:
+  explicit EmaFilter(float alpha) : alpha(alpha), state(0), primed(false) {}
+
+  float update(float sample)
+  {
+    if (!primed)
+    {
+      state = sample;
+      primed = true;
+    }
+    else
+    {
+      state += alpha * (sample - state);
+    }
+    return state;
+  }
+
+  float value() const { return state; }
+  bool ready() const { return primed; }
+  void reset()
+  {
+    state = 0;
+    primed = false;
+  }
+
+private:
+  float alpha;
+  float state;
+  bool primed;
+};
+
+// DC blocker y[n] = x[n] - x[n-1] + R * y[n-1] with R in Q15.
+// R = 32604 (0.995) gives a ~0.8 Hz corner at 500 Hz and keeps the QRS.
+class DcBlocker
+{
+public:
+  explicit DcBlocker(int32_t poleQ15 = 32604) : pole(poleQ15), lastInput(0), lastOutput(0), primed(false) {}
+
+  int32_t update(int32_t sample)
+  {
+    if (!primed)
+    {
+      lastInput = sample;
+      primed = true;
+    }
+    int32_t output = sample - lastInput + (int32_t)(((int64_t)pole * lastOutput) >> 15);
+    lastInput = sample;
+    lastOutput = output;
+    return output;
+  }
+
+  void reset()
+  {
+    lastInput = 0;
+    lastOutput = 0;
+    primed = false;
+  }
+
+private:
+  int32_t pole;
+  int32_t lastInput;
+  int32_t lastOutput;
+  bool primed;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,107 @@
+/*
+ * VitalCare Rural - Heart Rate Fusion
+ *
+ * Scalar Kalman filter over the true heart rate. Every detected beat from
+ * either channel is a measurement whose noise grows as that channel's signal
+ * quality drops, so a clean ECG dominates and a noisy PPG only nudges.
+ * A handful of float operations per beat.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+class HeartRateFusion
+{
+public:
+  static constexpr float INITIAL_VARIANCE = 400.0f;  // 20 BPM std-dev before first beat
+  static constexpr float PROCESS_NOISE = 4.0f;       // BPM^2 drift per second
+  static constexpr float MEASUREMENT_NOISE = 9.0f;   // BPM^2 for a perfect-quality beat
+  static constexpr float MIN_QUALITY = 0.05f;        // Below this a beat is ignored
+  static constexpr float GATE_SIGMA = 3.0f;          // Outlier gate on the innovation
+
+  HeartRateFusion() : rate(0), variance(INITIAL_VARIANCE), lastUpdate(0) {}
+
+  void begin(uint32_t nowMs)
+  {
+    rate = 0;
+    variance = INITIAL_VARIANCE;
+    lastUpdate = nowMs;
+  }
+
+  // Fuses one beat-derived rate measurement with the given 0..1 quality.
+  void update(float measurement, float quality, uint32_t nowMs)
+  {
+    if (quality < MIN_QUALITY)
+    {
+      return;
+    }
+
+    // Predict: heart rate is a random walk between beats
+    variance = predictedVariance(nowMs);
+    lastUpdate = nowMs;
+
+    // Measurement noise scales with 1/quality^2
+    float noise = MEASUREMENT_NOISE / (quality * quality);
+
+    if (rate <= 0)
+    {
+      rate = measurement;
+      variance = noise < INITIAL_VARIANCE ? noise : INITIAL_VARIANCE;
+      return;
+    }
+
+    float innovation = measurement - rate;
+    float innovationVariance = variance + noise;
+
+    if (innovation * innovation > GATE_SIGMA * GATE_SIGMA * innovationVariance)
+    {
+      // Outlier: inflate its noise instead of discarding, so a genuine step
+      // change is still tracked after a few consistent beats
+      noise *= 10.0f;
+      innovationVariance = variance + noise;
+    }
+
+    float gain = variance / innovationVariance;
+    rate += gain * innovation;
+    variance *= (1.0f - gain);
+  }
+
+  // Reports the fused rate and a 0..1 confidence at nowMs. Returns false and
+  // resets the estimate once both sources have been silent long enough for
+  // the uncertainty to reach its prior.
+  bool estimate(uint32_t nowMs, float &fusedRate, float &confidence)
+  {
+    float v = predictedVariance(nowMs);
+    if (rate > 0 && v < INITIAL_VARIANCE)
+    {
+      fusedRate = rate;
+      confidence = 1.0f - sqrtf(v / INITIAL_VARIANCE);
+      return true;
+    }
+    rate = 0;
+    fusedRate = 0;
+    confidence = 0;
+    return false;
+  }
+
+  float value() const { return rate; }
+
+private:
+  float predictedVariance(uint32_t nowMs) const
+  {
+    float dt = (nowMs - lastUpdate) / 1000.0f;
+    float v = variance + PROCESS_NOISE * dt;
+    return v < INITIAL_VARIANCE ? v : INITIAL_VARIANCE;
+  }
+
+  float rate;          // Fused heart rate (BPM)
+  float variance;      // Estimate variance (BPM^2)
+  uint32_t lastUpdate; // Time of last predict step (ms)
+};
+
+} // namespace vitalcare
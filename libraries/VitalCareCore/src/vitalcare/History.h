@@ -0,0 +1,228 @@
+/*
+ * VitalCare Rural - In-Memory History
+ *
+ * Recent data held in RAM so the dashboard's history, reconnect backlogs
+ * and SD writes never need to read the card: every 1 s update as a packed
+ * fixed-point HistoryRecord in a RecordRing, and the raw waveform channels
+ * in SampleRings. Storage is handed in (PSRAM on boards that have it,
+ * smaller internal RAM otherwise); the rings never allocate.
+ *
+ * Every record pushed gets the next sequence number, starting at 0, so a
+ * reader that remembers the last one it saw (a reconnecting dashboard, the
+ * SD writer behind the ring) can ask for exactly what it missed, and can
+ * tell when the ring overwrote some of it.
+ *
+ * HistoryRecord layout (HISTORY_RECORD_SIZE bytes, little-endian):
+ *   0  u32  timestamp (ms)
+ *   4  u16  heart rate x10 (BPM)
+ *   6  u16  barometric pressure x10 (hPa)
+ *   8  i16  temperature x10 (°F)
+ *   10 u16  ECG (ADC count)
+ *   12 u8   systolic (mmHg, 0..255)
+ *   13 u8   diastolic (mmHg, 0..255)
+ *   14 u8   SpO2 x2 (%)
+ *   15 u8   alert flags (AlertFlag)
+ *
+ * On the SD card the same records are rows of a trend CSV
+ * (HISTORY_CSV_HEADER); flash fallback logs (.vhr) hold them as they are.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Alerts.h"
+#include "Encoding.h"
+#include "Records.h"
+#include "Vitals.h"
+
+namespace vitalcare
+{
+
+const size_t HISTORY_RECORD_SIZE = 16;
+
+struct HistoryRecord
+{
+  VitalSample vitals;
+  float pressureHpa;
+  uint16_t ecg;
+  uint8_t alertFlags;
+};
+
+inline uint8_t toHistoryByte(float value, float scale)
+{
+  if (!(value > 0))
+    return 0;
+  float scaled = value * scale + 0.5f;
+  return scaled >= 255.0f ? 255 : (uint8_t)scaled;
+}
+
+// Encodes into out, which must hold HISTORY_RECORD_SIZE bytes.
+inline size_t encodeHistoryRecord(const HistoryRecord &record, uint8_t *out)
+{
+  BinaryWriter writer(out, HISTORY_RECORD_SIZE);
+  writer.u32(record.vitals.timestampMs)
+      .u16(toFixed10(record.vitals.heartRate))
+      .u16(toFixed10(record.pressureHpa))
+      .i16(toSignedFixed10(record.vitals.temperature))
+      .u16(record.ecg)
+      .u8(toHistoryByte(record.vitals.systolicBP, 1.0f))
+      .u8(toHistoryByte(record.vitals.diastolicBP, 1.0f))
+      .u8(toHistoryByte(record.vitals.spO2, 2.0f))
+      .u8(record.alertFlags);
+  return writer.size();
+}
+
+inline void decodeHistoryRecord(const uint8_t *in, HistoryRecord &record)
+{
+  BinaryReader reader(in, HISTORY_RECORD_SIZE);
+  record.vitals.timestampMs = reader.u32();
+  record.vitals.heartRate = reader.u16() / 10.0f;
+  record.pressureHpa = reader.u16() / 10.0f;
+  record.vitals.temperature = reader.i16() / 10.0f;
+  record.ecg = reader.u16();
+  record.vitals.systolicBP = reader.u8();
+  record.vitals.diastolicBP = reader.u8();
+  record.vitals.spO2 = reader.u8() / 2.0f;
+  record.alertFlags = reader.u8();
+}
+
+const char *const HISTORY_CSV_HEADER =
+    "timestamp,heartRate,systolicBP,diastolicBP,spO2,temperature,ecgValue,pressure,status\r\n";
+
+// One trend CSV row, line ending included. Returns the length, 0 when it
+// does not fit.
+inline size_t formatHistoryCsvRow(const HistoryRecord &record, char *out, size_t capacity)
+{
+  int length = snprintf(out, capacity, "%lu,%.2f,%.2f,%.2f,%.2f,%.2f,%u,%.2f,%s\r\n",
+                        (unsigned long)record.vitals.timestampMs, record.vitals.heartRate, record.vitals.systolicBP,
+                        record.vitals.diastolicBP, record.vitals.spO2, record.vitals.temperature, record.ecg,
+                        record.pressureHpa, record.alertFlags != ALERT_NONE ? "⚠️ ALERT" : "✅ Normal");
+  return length > 0 && (size_t)length < capacity ? (size_t)length : 0;
+}
+
+// Reads a row back (line ending optional); false when line is not one. The
+// status only says whether the row alerted, so the flags are recomputed as
+// the device set them: evaluateAlerts() against BEDSIDE_THRESHOLDS.
+inline bool parseHistoryCsvRow(const char *line, HistoryRecord &record)
+{
+  char *end;
+  record.vitals.timestampMs = (uint32_t)strtoul(line, &end, 10);
+  if (end == line || *end != ',')
+    return false;
+  float *fields[] = {&record.vitals.heartRate, &record.vitals.systolicBP, &record.vitals.diastolicBP,
+                     &record.vitals.spO2, &record.vitals.temperature};
+  for (float *field : fields)
+  {
+    const char *start = end + 1;
+    *field = strtof(start, &end);
+    if (end == start || *end != ',')
+      return false;
+  }
+  const char *start = end + 1;
+  record.ecg = (uint16_t)strtoul(start, &end, 10);
+  if (end == start || *end != ',')
+    return false;
+  start = end + 1;
+  record.pressureHpa = strtof(start, &end);
+  if (end == start || *end != ',')
+    return false;
+  record.alertFlags =
+      strstr(end + 1, "ALERT") ? evaluateAlerts(record.vitals, BEDSIDE_THRESHOLDS) : (uint8_t)ALERT_NONE;
+  return true;
+}
+
+// Fixed-size records in a ring over caller storage, addressed by sequence
+// number. Holds floor(bytes / recordSize) records; once full, each push
+// overwrites the oldest.
+class RecordRing
+{
+public:
+  RecordRing() : storage(nullptr), recordSize(0), slots(0), next(0) {}
+
+  void begin(uint8_t *buffer, size_t bytes, size_t size)
+  {
+    storage = buffer;
+    recordSize = size;
+    slots = size ? (uint32_t)(bytes / size) : 0;
+    next = 0;
+  }
+
+  // The slot the next record goes into; fill it, then commit()
+  uint8_t *reserve() { return slots ? storage + (size_t)(next % slots) * recordSize : nullptr; }
+  // Returns the committed record's sequence number
+  uint32_t commit() { return next++; }
+
+  uint32_t push(const uint8_t *record)
+  {
+    uint8_t *slot = reserve();
+    if (slot)
+      memcpy(slot, record, recordSize);
+    return commit();
+  }
+
+  // The record with this sequence number, or nullptr if it was overwritten
+  // or not yet written
+  const uint8_t *at(uint32_t sequence) const
+  {
+    if (!slots || sequence >= next || sequence < firstSequence())
+      return nullptr;
+    return storage + (size_t)(sequence % slots) * recordSize;
+  }
+
+  uint32_t firstSequence() const { return next > slots ? next - slots : 0; }
+  uint32_t nextSequence() const { return next; }
+  uint32_t count() const { return next - firstSequence(); }
+  uint32_t capacity() const { return slots; }
+  size_t bytes() const { return (size_t)slots * recordSize; }
+
+private:
+  uint8_t *storage;
+  size_t recordSize;
+  uint32_t slots;
+  uint32_t next;
+};
+
+// One waveform channel: the last capacity samples at a fixed rate
+class SampleRing
+{
+public:
+  SampleRing() : storage(nullptr), slots(0), written(0), rate(0) {}
+
+  void begin(int16_t *buffer, size_t samples, uint16_t rateHz)
+  {
+    storage = buffer;
+    slots = (uint32_t)samples;
+    written = 0;
+    rate = rateHz;
+  }
+
+  void push(int16_t sample)
+  {
+    if (slots)
+      storage[written % slots] = sample;
+    written++;
+  }
+
+  // Samples are numbered from 0 as pushed; the ring holds firstIndex()
+  // up to total() - 1
+  int16_t at(uint32_t index) const { return storage[index % slots]; }
+  uint32_t firstIndex() const { return written - count(); }
+
+  uint32_t count() const { return written < slots ? written : slots; }
+  uint32_t capacity() const { return slots; }
+  uint32_t total() const { return written; }
+  uint16_t rateHz() const { return rate; }
+
+private:
+  int16_t *storage;
+  uint32_t slots;
+  uint32_t written;
+  uint16_t rate;
+};
+
+} // namespace vitalcare
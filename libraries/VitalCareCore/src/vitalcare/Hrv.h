@@ -0,0 +1,144 @@
+/*
+ * VitalCare Rural - Heart Rate Variability
+ *
+ * Time-domain HRV from successive RR intervals: mean NN, SDNN, RMSSD and
+ * pNN50. Only normal-to-normal (NN) intervals count. An interval outside
+ * the valid heart rate range, or more than 20% away from the running NN
+ * reference (ectopic, missed or double-counted beat), is rejected and
+ * breaks the chain of successive differences.
+ *
+ * Sums are kept in integers, so accumulators of consecutive windows merge
+ * exactly (per-minute summaries into hourly or 24 h SDNN).
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "BeatDetector.h"
+
+namespace vitalcare
+{
+
+class HrvAccumulator
+{
+public:
+  static const uint8_t MAX_CHANGE_PERCENT = 20;
+  // After this many rejections in a row the reference follows the rhythm
+  static const uint8_t RESEED_AFTER = 4;
+
+  HrvAccumulator() { reset(); }
+
+  void reset()
+  {
+    reference = 0;
+    lastAccepted = false;
+    misses = 0;
+    count = 0;
+    rejected = 0;
+    successive = 0;
+    over50 = 0;
+    sum = 0;
+    sumSquares = 0;
+    diffSquares = 0;
+    previous = 0;
+  }
+
+  // Feeds one RR interval. Returns true when it was accepted as NN.
+  bool addInterval(uint32_t intervalMs)
+  {
+    if (intervalMs < (uint32_t)(60000.0f / HEART_RATE_MAX_VALID) ||
+        intervalMs > (uint32_t)(60000.0f / HEART_RATE_MIN_VALID))
+    {
+      return reject();
+    }
+
+    if (reference == 0 || misses >= RESEED_AFTER)
+    {
+      reference = intervalMs;
+      misses = 0;
+    }
+    uint32_t change = intervalMs > reference ? intervalMs - reference : reference - intervalMs;
+    if (change * 100 > reference * MAX_CHANGE_PERCENT)
+    {
+      misses++;
+      return reject();
+    }
+
+    // Reference: EMA of accepted intervals with alpha 1/8
+    reference = (reference * 7 + intervalMs + 4) / 8;
+    misses = 0;
+
+    count++;
+    sum += intervalMs;
+    sumSquares += (uint64_t)intervalMs * intervalMs;
+    if (lastAccepted)
+    {
+      uint32_t difference = intervalMs > previous ? intervalMs - previous : previous - intervalMs;
+      successive++;
+      diffSquares += (uint64_t)difference * difference;
+      if (difference > 50)
+        over50++;
+    }
+    previous = intervalMs;
+    lastAccepted = true;
+    return true;
+  }
+
+  // Breaks the successive-difference chain, e.g. across leads-off.
+  void breakChain() { lastAccepted = false; }
+
+  // Adds another window's sums. The chain is not bridged.
+  void merge(const HrvAccumulator &other)
+  {
+    count += other.count;
+    rejected += other.rejected;
+    successive += other.successive;
+    over50 += other.over50;
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+    diffSquares += other.diffSquares;
+  }
+
+  uint32_t intervalCount() const { return count; }
+  uint32_t rejectedCount() const { return rejected; }
+
+  float meanInterval() const { return count ? (float)((double)sum / count) : 0.0f; }
+  float meanRate() const { return count ? (float)(60000.0 * count / (double)sum) : 0.0f; }
+
+  float sdnn() const
+  {
+    if (count < 2)
+      return 0.0f;
+    double mean = (double)sum / count;
+    double variance = (double)sumSquares / count - mean * mean;
+    return variance > 0 ? (float)sqrt(variance) : 0.0f;
+  }
+
+  float rmssd() const { return successive ? (float)sqrt((double)diffSquares / successive) : 0.0f; }
+  float pnn50() const { return successive ? 100.0f * over50 / successive : 0.0f; }
+
+private:
+  bool reject()
+  {
+    rejected++;
+    lastAccepted = false;
+    return false;
+  }
+
+  uint32_t reference; // Running NN reference (ms)
+  uint32_t previous;  // Last accepted NN interval (ms)
+  bool lastAccepted;
+  uint8_t misses;
+
+  uint32_t count;
+  uint32_t rejected;
+  uint32_t successive;
+  uint32_t over50;
+  uint64_t sum;
+  uint64_t sumSquares;
+  uint64_t diffSquares;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,63 @@
+/*
+ * VitalCare Rural - Asynchronous I2C Interface
+ *
+ * Sensor drivers never block on the bus: they submit a register read or
+ * write and continue from the completion callback. The bus implementation
+ * decides when the transfer actually runs (immediately over Wire, from a
+ * driver task, or in a host simulation).
+ *
+ * The data buffer belongs to the submitter and must stay valid until the
+ * callback has run.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+enum I2cStatus : uint8_t
+{
+  I2C_OK = 0,
+  I2C_NACK,
+  I2C_TIMEOUT,
+  I2C_BUS_ERROR,
+  I2C_QUEUE_FULL,
+};
+
+enum I2cPriority : uint8_t
+{
+  I2C_PRIORITY_LOW = 0,
+  I2C_PRIORITY_NORMAL = 1,
+  I2C_PRIORITY_HIGH = 2,
+};
+
+struct I2cTransaction;
+
+typedef void (*I2cCallback)(void *context, const I2cTransaction &transaction, I2cStatus status);
+
+struct I2cTransaction
+{
+  uint8_t address;      // 7-bit device address
+  uint8_t reg;          // First register
+  bool write;           // true: write data to reg, false: read into data
+  uint8_t priority;     // I2cPriority
+  uint16_t length;      // Bytes to transfer
+  uint8_t *data;        // Caller-owned buffer
+  I2cCallback callback; // Runs once the transfer has finished (may be null)
+  void *context;        // Passed back to callback
+};
+
+class I2cBus
+{
+public:
+  virtual ~I2cBus() {}
+
+  // Queues a transaction. Returns false if it could not be accepted, in
+  // which case the callback is not called.
+  virtual bool submit(const I2cTransaction &transaction) = 0;
+};
+
+} // namespace vitalcare
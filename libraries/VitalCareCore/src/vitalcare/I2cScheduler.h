@@ -0,0 +1,232 @@
+/*
+ * VitalCare Rural - I2C Transaction Scheduler
+ *
+ * The queueing and bookkeeping half of a shared asynchronous I2C bus:
+ * drivers' transactions wait in one queue per priority, the bus side takes
+ * the highest-priority job, runs it and reports the result, and completions
+ * are handed back to the submitting context to run their callbacks.
+ *
+ * It also measures the bus: busy time (utilization over 1 s windows),
+ * submit-to-finish latency per priority and a log2 latency histogram.
+ *
+ * Not thread-safe by itself; the bus owning it serialises access (a
+ * critical section on the ESP32, nothing on the single-threaded host).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "I2cBus.h"
+#include "RingBuffer.h"
+
+namespace vitalcare
+{
+
+struct I2cJob
+{
+  I2cTransaction transaction;
+  uint32_t submittedUs;
+  uint32_t startedUs;
+  uint32_t finishedUs;
+  I2cStatus status;
+};
+
+struct I2cBusStats
+{
+  static const uint8_t PRIORITIES = 3;
+  static const uint8_t LATENCY_BUCKETS = 12; // <64us, <128us, ... <65ms, rest
+
+  uint32_t submitted;
+  uint32_t completed;
+  uint32_t failed;   // finished with a status other than I2C_OK
+  uint32_t rejected; // refused at submit (queue full)
+  uint64_t bytes;
+  uint64_t busyUs;   // time spent transferring
+  uint8_t maxOutstanding;
+
+  // Submit to end of transfer (queue wait + transfer), per priority
+  uint32_t latencyCount[PRIORITIES];
+  uint64_t latencySumUs[PRIORITIES];
+  uint32_t latencyMaxUs[PRIORITIES];
+  uint32_t latencyHistogram[LATENCY_BUCKETS];
+
+  uint32_t averageLatencyUs(uint8_t priority) const
+  {
+    return latencyCount[priority] ? (uint32_t)(latencySumUs[priority] / latencyCount[priority]) : 0;
+  }
+
+  uint32_t maxLatencyUs() const
+  {
+    uint32_t result = 0;
+    for (uint8_t i = 0; i < PRIORITIES; i++)
+      result = latencyMaxUs[i] > result ? latencyMaxUs[i] : result;
+    return result;
+  }
+
+  // Upper bound of the histogram bucket holding the given percentile
+  uint32_t latencyPercentileUs(uint8_t percent) const
+  {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+      total += latencyHistogram[i];
+    if (total == 0)
+      return 0;
+
+    uint64_t target = ((uint64_t)total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+      seen += latencyHistogram[i];
+      if (seen >= target)
+        return bucketLimitUs(i);
+    }
+    return bucketLimitUs(LATENCY_BUCKETS - 1);
+  }
+
+  static uint32_t bucketLimitUs(uint8_t bucket) { return 64u << bucket; }
+
+  static uint8_t bucketFor(uint32_t latencyUs)
+  {
+    uint8_t bucket = 0;
+    uint32_t scaled = latencyUs >> 6;
+    while (scaled && bucket < LATENCY_BUCKETS - 1)
+    {
+      scaled >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+};
+
+class I2cScheduler
+{
+public:
+  static const uint8_t QUEUE_DEPTH = 8;        // per priority
+  static const uint8_t MAX_OUTSTANDING = 16;   // queued + in flight + undispatched
+  static const uint32_t UTILIZATION_WINDOW_US = 1000000;
+
+  I2cScheduler() { reset(0); }
+
+  void reset(uint32_t nowUs)
+  {
+    for (uint8_t i = 0; i < I2cBusStats::PRIORITIES; i++)
+      queues[i].clear();
+    completions.clear();
+    outstanding = 0;
+    stats = I2cBusStats();
+    windowStartUs = nowUs;
+    windowBusyUs = 0;
+    lastUtilization = 0;
+  }
+
+  // Submitting side. False (and counted) when the queue is full.
+  bool enqueue(const I2cTransaction &transaction, uint32_t nowUs)
+  {
+    uint8_t priority = transaction.priority < I2cBusStats::PRIORITIES ? transaction.priority
+                                                                       : (uint8_t)I2C_PRIORITY_HIGH;
+    I2cJob job = {transaction, nowUs, 0, 0, I2C_OK};
+    job.transaction.priority = priority;
+    if (outstanding >= MAX_OUTSTANDING || !queues[priority].tryPush(job))
+    {
+      stats.rejected++;
+      return false;
+    }
+    outstanding++;
+    stats.submitted++;
+    if (outstanding > stats.maxOutstanding)
+      stats.maxOutstanding = outstanding;
+    return true;
+  }
+
+  // Bus side: highest priority first, FIFO within a priority.
+  bool next(I2cJob &job)
+  {
+    for (int8_t priority = I2cBusStats::PRIORITIES - 1; priority >= 0; priority--)
+    {
+      if (queues[priority].pop(job))
+        return true;
+    }
+    return false;
+  }
+
+  bool pending() const
+  {
+    for (uint8_t i = 0; i < I2cBusStats::PRIORITIES; i++)
+    {
+      if (!queues[i].empty())
+        return true;
+    }
+    return false;
+  }
+
+  // Bus side: records a finished transfer and queues its completion.
+  void finish(I2cJob &job, I2cStatus status, uint32_t startUs, uint32_t endUs)
+  {
+    job.status = status;
+    job.startedUs = startUs;
+    job.finishedUs = endUs;
+
+    uint32_t busy = endUs - startUs;
+    uint32_t latency = endUs - job.submittedUs;
+    uint8_t priority = job.transaction.priority;
+    stats.completed++;
+    stats.failed += status != I2C_OK ? 1 : 0;
+    stats.bytes += job.transaction.length;
+    stats.busyUs += busy;
+    stats.latencyCount[priority]++;
+    stats.latencySumUs[priority] += latency;
+    if (latency > stats.latencyMaxUs[priority])
+      stats.latencyMaxUs[priority] = latency;
+    stats.latencyHistogram[I2cBusStats::bucketFor(latency)]++;
+
+    rollWindow(endUs);
+    windowBusyUs += busy;
+
+    // Cannot fail: outstanding never exceeds the completion capacity
+    completions.push(job);
+  }
+
+  // Submitting side: takes one finished job whose callback should run.
+  bool takeCompletion(I2cJob &job)
+  {
+    if (!completions.pop(job))
+      return false;
+    outstanding--;
+    return true;
+  }
+
+  // Bus busy time over the last complete 1 s window, in 1/1000
+  uint16_t utilizationPermille(uint32_t nowUs)
+  {
+    rollWindow(nowUs);
+    return lastUtilization;
+  }
+
+  const I2cBusStats &statistics() const { return stats; }
+  uint8_t outstandingCount() const { return outstanding; }
+
+private:
+  void rollWindow(uint32_t nowUs)
+  {
+    uint32_t elapsed = nowUs - windowStartUs;
+    if (elapsed < UTILIZATION_WINDOW_US)
+      return;
+    uint64_t permille = windowBusyUs * 1000 / elapsed;
+    lastUtilization = (uint16_t)(permille > 1000 ? 1000 : permille);
+    windowStartUs = nowUs;
+    windowBusyUs = 0;
+  }
+
+  RingBuffer<I2cJob, QUEUE_DEPTH> queues[I2cBusStats::PRIORITIES];
+  RingBuffer<I2cJob, MAX_OUTSTANDING> completions;
+  uint8_t outstanding;
+
+  I2cBusStats stats;
+  uint32_t windowStartUs;
+  uint64_t windowBusyUs;
+  uint16_t lastUtilization;
+};
+
+} // namespace vitalcare
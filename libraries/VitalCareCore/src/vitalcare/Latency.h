@@ -0,0 +1,266 @@
+/*
+ * VitalCare Rural - Sensor-to-Screen Latency
+ *
+ * Follows each 1 s vitals frame from the sensor read to the dashboard
+ * painting it. The monitor stamps the stages it sees on its own
+ * microsecond clock (a read acquired, a beat detected in it, the snapshot
+ * published, the frame sent) and each dashboard echoes the frame's
+ * sequence number back once it has rendered it, with how long that took
+ * on its clock:
+ *
+ *   acquired -> beat detected -> published -> sent -> received -> rendered
+ *                                                      (client)    (client)
+ *
+ * The two clocks are never compared. The network leg is half the echo
+ * round trip less the client's receive-to-render time, so it assumes a
+ * symmetric link and includes up to one loop() pass before the echo is
+ * read. A beat happens up to one sampling tick before the read that
+ * detects it; that wait cannot be seen and is not counted.
+ *
+ * Every stage keeps a log-linear histogram (four buckets per doubling,
+ * 64 us to 16 s), so percentiles are bucket upper bounds at most 25% high.
+ * All timestamps are 32-bit microseconds and only differences are used;
+ * they wrap after 71 minutes. Not thread-safe; call from one task.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Alerts.h"
+
+namespace vitalcare
+{
+
+class LatencyHistogram
+{
+public:
+  static const uint8_t SUB_BUCKETS = 4;   // per doubling
+  static const uint8_t OCTAVES = 18;      // 64 us .. 16.7 s
+  static const uint8_t BUCKETS = 1 + OCTAVES * SUB_BUCKETS;
+  static const uint32_t FIRST_LIMIT_US = 64;
+
+  LatencyHistogram() { reset(); }
+
+  void reset()
+  {
+    for (uint8_t i = 0; i < BUCKETS; i++)
+      buckets[i] = 0;
+    samples = 0;
+    sumUs = 0;
+    largestUs = 0;
+  }
+
+  void record(uint32_t latencyUs)
+  {
+    buckets[bucketFor(latencyUs)]++;
+    samples++;
+    sumUs += latencyUs;
+    largestUs = latencyUs > largestUs ? latencyUs : largestUs;
+  }
+
+  uint32_t count() const { return samples; }
+  uint32_t maxUs() const { return largestUs; }
+  uint32_t averageUs() const { return samples ? (uint32_t)(sumUs / samples) : 0; }
+
+  // Upper bound of the bucket holding the given percentile, never above the
+  // largest latency recorded (which is also the answer past the last bucket)
+  uint32_t percentileUs(uint8_t percent) const
+  {
+    if (samples == 0)
+      return 0;
+
+    uint64_t target = ((uint64_t)samples * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < BUCKETS; i++)
+    {
+      seen += buckets[i];
+      if (seen >= target && i < BUCKETS - 1)
+      {
+        uint32_t limit = bucketLimitUs(i);
+        return limit < largestUs ? limit : largestUs;
+      }
+    }
+    return largestUs;
+  }
+
+  static uint32_t bucketLimitUs(uint8_t bucket)
+  {
+    if (bucket == 0)
+      return FIRST_LIMIT_US;
+    uint8_t octave = (bucket - 1) / SUB_BUCKETS;
+    uint8_t sub = (bucket - 1) % SUB_BUCKETS;
+    return (uint32_t)(SUB_BUCKETS + sub + 1) << (octave + 4);
+  }
+
+  static uint8_t bucketFor(uint32_t latencyUs)
+  {
+    if (latencyUs < FIRST_LIMIT_US)
+      return 0;
+    uint8_t top = 6; // Highest set bit, at least that of FIRST_LIMIT_US
+    while (top < 31 && (latencyUs >> (top + 1)))
+      top++;
+    if (top >= 6 + OCTAVES)
+      return BUCKETS - 1;
+    uint8_t sub = (latencyUs >> (top - 2)) & (SUB_BUCKETS - 1);
+    return 1 + (top - 6) * SUB_BUCKETS + sub;
+  }
+
+private:
+  uint32_t buckets[BUCKETS];
+  uint32_t samples;
+  uint64_t sumUs;
+  uint32_t largestUs;
+};
+
+enum LatencyStage : uint8_t
+{
+  LATENCY_SAMPLE_TO_BEAT = 0,  // Read acquired to a beat detected in it
+  LATENCY_BEAT_TO_PUBLISH,     // Oldest beat since the last snapshot to the snapshot
+  LATENCY_PUBLISH_TO_SEND,     // Snapshot to frame sent (alert handling, JSON, WebSocket)
+  LATENCY_SEND_TO_RECEIVE,     // Network, one way
+  LATENCY_RECEIVE_TO_RENDER,   // Client, frame received to painted
+  LATENCY_BEAT_TO_RENDER,      // End to end: the beat's read to the frame painted
+  LATENCY_ALARM,               // Alerting frames: their newest read to painted
+  LATENCY_STAGES
+};
+
+inline const char *latencyStageName(uint8_t stage)
+{
+  static const char *const NAMES[LATENCY_STAGES] = {
+      "sampleToBeat", "beatToPublish", "publishToSend", "sendToReceive",
+      "receiveToRender", "beatToRender", "alarm",
+  };
+  return stage < LATENCY_STAGES ? NAMES[stage] : "unknown";
+}
+
+class LatencyTracker
+{
+public:
+  // Frames awaiting an echo; an echo arriving this many frames late is dropped
+  static const uint8_t PENDING_FRAMES = 8;
+
+  LatencyTracker()
+      : lastAcquiredUs(0), beatAcquiredUs(0), beatDetectedUs(0), beatPending(false), nextSeq(1), sentFrames(0),
+        echoes(0), lateEchoes(0)
+  {
+    for (uint8_t i = 0; i < PENDING_FRAMES; i++)
+      frames[i].seq = 0;
+  }
+
+  // A sensor read started
+  void onAcquired(uint32_t nowUs) { lastAcquiredUs = nowUs; }
+
+  // The read acquired at acquiredUs held a beat, detected at nowUs
+  void onBeat(uint32_t acquiredUs, uint32_t nowUs)
+  {
+    stages[LATENCY_SAMPLE_TO_BEAT].record(nowUs - acquiredUs);
+    if (!beatPending)
+    {
+      beatAcquiredUs = acquiredUs;
+      beatDetectedUs = nowUs;
+      beatPending = true;
+    }
+  }
+
+  // The 1 s snapshot was taken; returns the sequence number of its frame
+  uint32_t onPublished(uint32_t nowUs, uint8_t alertFlags)
+  {
+    Frame &frame = frames[nextSeq % PENDING_FRAMES];
+    frame.seq = nextSeq;
+    frame.acquiredUs = lastAcquiredUs;
+    frame.publishedUs = nowUs;
+    frame.sentUs = 0;
+    frame.sent = false;
+    frame.hasBeat = beatPending;
+    frame.beatAcquiredUs = beatAcquiredUs;
+    frame.alertFlags = alertFlags;
+    if (beatPending)
+    {
+      stages[LATENCY_BEAT_TO_PUBLISH].record(nowUs - beatDetectedUs);
+      beatPending = false;
+    }
+    return nextSeq++;
+  }
+
+  // The frame went out to every connected client
+  void onSent(uint32_t seq, uint32_t nowUs)
+  {
+    Frame *frame = find(seq);
+    if (!frame || frame->sent)
+      return;
+    frame->sentUs = nowUs;
+    frame->sent = true;
+    sentFrames++;
+    stages[LATENCY_PUBLISH_TO_SEND].record(nowUs - frame->publishedUs);
+  }
+
+  // A client echoed the frame at nowUs, having taken renderUs from
+  // receiving it to painting it. Each client's echo is one measurement.
+  void onEcho(uint32_t seq, uint32_t nowUs, uint32_t renderUs)
+  {
+    Frame *frame = find(seq);
+    if (!frame || !frame->sent)
+    {
+      lateEchoes++;
+      return;
+    }
+    echoes++;
+    uint32_t roundTripUs = nowUs - frame->sentUs;
+    uint32_t networkUs = roundTripUs > renderUs ? (roundTripUs - renderUs) / 2 : 0;
+    uint32_t sentToRenderedUs = networkUs + renderUs;
+    stages[LATENCY_SEND_TO_RECEIVE].record(networkUs);
+    stages[LATENCY_RECEIVE_TO_RENDER].record(renderUs);
+    if (frame->hasBeat)
+      stages[LATENCY_BEAT_TO_RENDER].record(frame->sentUs - frame->beatAcquiredUs + sentToRenderedUs);
+    if (frame->alertFlags != ALERT_NONE)
+      stages[LATENCY_ALARM].record(frame->sentUs - frame->acquiredUs + sentToRenderedUs);
+  }
+
+  const LatencyHistogram &stage(uint8_t stage) const { return stages[stage]; }
+  uint32_t framesSent() const { return sentFrames; }
+  uint32_t echoesReceived() const { return echoes; }
+  uint32_t echoesDropped() const { return lateEchoes; }
+
+  void reset()
+  {
+    for (uint8_t i = 0; i < LATENCY_STAGES; i++)
+      stages[i].reset();
+    sentFrames = 0;
+    echoes = 0;
+    lateEchoes = 0;
+  }
+
+private:
+  struct Frame
+  {
+    uint32_t seq; // 0 when unused
+    uint32_t acquiredUs;
+    uint32_t beatAcquiredUs;
+    uint32_t publishedUs;
+    uint32_t sentUs;
+    uint8_t alertFlags;
+    bool hasBeat;
+    bool sent;
+  };
+
+  Frame *find(uint32_t seq)
+  {
+    Frame &frame = frames[seq % PENDING_FRAMES];
+    return seq != 0 && frame.seq == seq ? &frame : nullptr;
+  }
+
+  LatencyHistogram stages[LATENCY_STAGES];
+  Frame frames[PENDING_FRAMES];
+  uint32_t lastAcquiredUs;
+  uint32_t beatAcquiredUs;
+  uint32_t beatDetectedUs;
+  bool beatPending;
+  uint32_t nextSeq;
+  uint32_t sentFrames;
+  uint32_t echoes;
+  uint32_t lateEchoes;
+};
+
+} // namespace vitalcare
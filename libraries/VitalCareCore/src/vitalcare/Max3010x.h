@@ -0,0 +1,259 @@
+/*
+ * VitalCare Rural - MAX3010x Red/IR PPG Driver
+ *
+ * Asynchronous driver for MAX30101/MAX30102 pulse oximetry front ends.
+ * poll() reads the FIFO pointers, then drains every pending sample in one
+ * I2C burst of FIFO_DATA instead of one transaction per sample. Everything
+ * runs from I2C completion callbacks, so the caller never waits on the bus.
+ *
+ * Configured for SpO2 mode: 400 sps with 4x on-chip averaging (100 sps
+ * delivered), 411 us pulses (18-bit samples), 4096 nA ADC range.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "I2cBus.h"
+#include "RingBuffer.h"
+
+namespace vitalcare
+{
+
+struct PpgSample
+{
+  uint32_t red; // 18-bit red LED count
+  uint32_t ir;  // 18-bit IR LED count
+};
+
+class Max3010x
+{
+public:
+  static const uint8_t ADDRESS = 0x57;
+  static const uint16_t SAMPLE_RATE_HZ = 100;
+  static const uint8_t FIFO_DEPTH = 32;
+  static const uint8_t BYTES_PER_SAMPLE = 6;
+  static const uint8_t MAX_BURST_SAMPLES = 16; // 96 bytes, fits the Wire buffer
+
+  // Register map
+  static const uint8_t REG_INT_STATUS_1 = 0x00;
+  static const uint8_t REG_FIFO_WR_PTR = 0x04;
+  static const uint8_t REG_OVF_COUNTER = 0x05;
+  static const uint8_t REG_FIFO_RD_PTR = 0x06;
+  static const uint8_t REG_FIFO_DATA = 0x07;
+  static const uint8_t REG_FIFO_CONFIG = 0x08;
+  static const uint8_t REG_MODE_CONFIG = 0x09;
+  static const uint8_t REG_SPO2_CONFIG = 0x0A;
+  static const uint8_t REG_LED1_PA = 0x0C; // Red
+  static const uint8_t REG_LED2_PA = 0x0D; // IR
+  static const uint8_t REG_PART_ID = 0xFF;
+  static const uint8_t PART_ID = 0x15;
+
+  explicit Max3010x(I2cBus &bus, uint8_t priority = I2C_PRIORITY_NORMAL)
+      : bus(bus), priority(priority), state(STATE_UNINITIALISED), configStep(0), pendingSamples(0),
+        overflows(0), samplesRead(0), bursts(0), errors(0)
+  {
+  }
+
+  // Starts the asynchronous probe and configuration sequence.
+  void begin()
+  {
+    state = STATE_PROBING;
+    configStep = 0;
+    samples.clear();
+    submitRead(REG_PART_ID, scratch, 1);
+  }
+
+  // Starts a FIFO drain if the driver is idle. Call at least every
+  // FIFO_DEPTH / SAMPLE_RATE_HZ seconds (320 ms) to avoid overflow.
+  void poll()
+  {
+    if (state != STATE_IDLE)
+    {
+      return;
+    }
+    state = STATE_READ_POINTERS;
+    // WR_PTR, OVF_COUNTER and RD_PTR are consecutive: one 3-byte read
+    submitRead(REG_FIFO_WR_PTR, scratch, 3);
+  }
+
+  bool read(PpgSample &sample) { return samples.pop(sample); }
+  size_t available() const { return samples.size(); }
+
+  bool ready() const { return state == STATE_IDLE || state == STATE_READ_POINTERS || state == STATE_READ_FIFO; }
+  bool failed() const { return state == STATE_FAILED; }
+  bool busy() const { return state != STATE_IDLE && state != STATE_FAILED && state != STATE_UNINITIALISED; }
+
+  uint32_t overflowCount() const { return overflows; }
+  uint32_t sampleCount() const { return samplesRead; }
+  uint32_t burstCount() const { return bursts; }
+  uint32_t errorCount() const { return errors; }
+
+private:
+  enum State : uint8_t
+  {
+    STATE_UNINITIALISED,
+    STATE_PROBING,
+    STATE_CONFIGURING,
+    STATE_IDLE,
+    STATE_READ_POINTERS,
+    STATE_READ_FIFO,
+    STATE_FAILED,
+  };
+
+  struct RegisterValue
+  {
+    uint8_t reg;
+    uint8_t value;
+  };
+
+  static const RegisterValue *configuration(size_t &count)
+  {
+    static const RegisterValue CONFIG[] = {
+        {REG_MODE_CONFIG, 0x00},  // Leave shutdown/reset, mode set last
+        {REG_FIFO_CONFIG, 0x50},  // SMP_AVE=4, FIFO rollover enabled
+        {REG_SPO2_CONFIG, 0x2F},  // 4096 nA range, 400 sps, 411 us (18-bit)
+        {REG_LED1_PA, 0x24},      // ~7 mA red
+        {REG_LED2_PA, 0x24},      // ~7 mA IR
+        {REG_FIFO_WR_PTR, 0x00},  // Empty the FIFO
+        {REG_OVF_COUNTER, 0x00},
+        {REG_FIFO_RD_PTR, 0x00},
+        {REG_MODE_CONFIG, 0x03},  // SpO2 mode (red + IR)
+    };
+    count = sizeof(CONFIG) / sizeof(CONFIG[0]);
+    return CONFIG;
+  }
+
+  void submitRead(uint8_t reg, uint8_t *data, uint16_t length)
+  {
+    submit(reg, false, data, length);
+  }
+
+  void submitWrite(uint8_t reg, uint8_t value)
+  {
+    writeValue = value;
+    submit(reg, true, &writeValue, 1);
+  }
+
+  void submit(uint8_t reg, bool write, uint8_t *data, uint16_t length)
+  {
+    I2cTransaction transaction = {ADDRESS, reg, write, priority, length, data, &Max3010x::onComplete, this};
+    if (!bus.submit(transaction))
+    {
+      // Queue full: fall back to idle and retry on the next poll()
+      errors++;
+      state = (state == STATE_READ_POINTERS || state == STATE_READ_FIFO) ? STATE_IDLE : STATE_FAILED;
+    }
+  }
+
+  static void onComplete(void *context, const I2cTransaction &transaction, I2cStatus status)
+  {
+    static_cast<Max3010x *>(context)->handleCompletion(transaction, status);
+  }
+
+  void handleCompletion(const I2cTransaction &transaction, I2cStatus status)
+  {
+    if (status != I2C_OK)
+    {
+      errors++;
+      state = (state == STATE_READ_POINTERS || state == STATE_READ_FIFO) ? STATE_IDLE : STATE_FAILED;
+      return;
+    }
+
+    switch (state)
+    {
+    case STATE_PROBING:
+      if (scratch[0] != PART_ID)
+      {
+        state = STATE_FAILED;
+        return;
+      }
+      state = STATE_CONFIGURING;
+      nextConfigStep();
+      break;
+
+    case STATE_CONFIGURING:
+      nextConfigStep();
+      break;
+
+    case STATE_READ_POINTERS:
+    {
+      uint8_t writePointer = scratch[0] & 0x1F;
+      uint8_t overflow = scratch[1] & 0x1F;
+      uint8_t readPointer = scratch[2] & 0x1F;
+      overflows += overflow;
+
+      // With rollover, an overflowed FIFO is full even though pointers match
+      pendingSamples = overflow ? FIFO_DEPTH : (uint8_t)((writePointer - readPointer) & (FIFO_DEPTH - 1));
+      readFifoBurst();
+      break;
+    }
+
+    case STATE_READ_FIFO:
+      unpack(transaction.length / BYTES_PER_SAMPLE);
+      readFifoBurst();
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  void nextConfigStep()
+  {
+    size_t count;
+    const RegisterValue *config = configuration(count);
+    if (configStep >= count)
+    {
+      state = STATE_IDLE;
+      return;
+    }
+    const RegisterValue &step = config[configStep++];
+    submitWrite(step.reg, step.value);
+  }
+
+  // Reads up to MAX_BURST_SAMPLES in one transaction; chains until drained
+  void readFifoBurst()
+  {
+    if (pendingSamples == 0)
+    {
+      state = STATE_IDLE;
+      return;
+    }
+    uint8_t burst = pendingSamples < MAX_BURST_SAMPLES ? pendingSamples : MAX_BURST_SAMPLES;
+    pendingSamples -= burst;
+    bursts++;
+    state = STATE_READ_FIFO;
+    submitRead(REG_FIFO_DATA, scratch, (uint16_t)(burst * BYTES_PER_SAMPLE));
+  }
+
+  void unpack(size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      const uint8_t *p = scratch + i * BYTES_PER_SAMPLE;
+      PpgSample sample;
+      sample.red = (((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]) & 0x3FFFF;
+      sample.ir = (((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 8) | p[5]) & 0x3FFFF;
+      samples.push(sample);
+      samplesRead++;
+    }
+  }
+
+  I2cBus &bus;
+  uint8_t priority;
+  State state;
+  uint8_t configStep;
+  uint8_t pendingSamples;
+  uint8_t writeValue;
+  uint8_t scratch[MAX_BURST_SAMPLES * BYTES_PER_SAMPLE];
+  RingBuffer<PpgSample, 64> samples;
+
+  uint32_t overflows;
+  uint32_t samplesRead;
+  uint32_t bursts;
+  uint32_t errors;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,178 @@
+/*
+ * VitalCare Rural - Heap Accounting Per Subsystem
+ *
+ * Counts heap allocations by the subsystem that made them. Code marks what
+ * it is doing with a MemoryScope; whatever hooks the allocator (linker
+ * wrapped malloc on the ESP32, replaced operator new on the host) calls
+ * onAllocate()/onFree() with current(), so String and JSON churn lands on
+ * the subsystem that caused it without changing the code that allocates.
+ *
+ * Per tag it keeps allocation and free counts and the bytes requested;
+ * the allocator does not say which tag a freed block came from, so live
+ * bytes are only known for the whole heap. update() closes 1 s windows for
+ * allocation rates. The sensor read, the vitals update and the vitals
+ * frame are the hot path, which should not allocate at all once running.
+ *
+ * There is no constructor: a global is zero-initialised before any code
+ * runs, so allocations made by other static constructors are counted too.
+ * Locals must call reset(). Not thread-safe; the hook serialises access.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+enum MemoryTag : uint8_t
+{
+  MEMORY_OTHER = 0, // Other tasks (WiFi, lwIP, I2C bus, SD writer) and unscoped code
+  MEMORY_SENSORS,   // 100 ms sensor read
+  MEMORY_VITALS,    // 1 s snapshot and alert handling
+  MEMORY_FRAMES,    // Vitals frame to dashboards
+  MEMORY_STORAGE,   // SD card saves, EDF+ and capture files
+  MEMORY_WEB,       // HTTP requests and WebSocket events
+  MEMORY_SMS,       // SIM800L alerts
+  MEMORY_TAGS
+};
+
+inline const char *memoryTagName(uint8_t tag)
+{
+  static const char *const NAMES[MEMORY_TAGS] = {"other", "sensors", "vitals", "frames", "storage", "web", "sms"};
+  return tag < MEMORY_TAGS ? NAMES[tag] : "unknown";
+}
+
+inline bool isHotPath(uint8_t tag)
+{
+  return tag == MEMORY_SENSORS || tag == MEMORY_VITALS || tag == MEMORY_FRAMES;
+}
+
+struct MemoryTagStats
+{
+  uint32_t allocations; // realloc() counts as one
+  uint32_t frees;
+  uint64_t bytes;       // requested, over all allocations
+};
+
+class MemoryAccounting
+{
+public:
+  static const uint32_t WINDOW_MS = 1000;
+
+  void reset()
+  {
+    for (uint8_t i = 0; i < MEMORY_TAGS; i++)
+      tags[i] = {0, 0, 0};
+    scope = MEMORY_OTHER;
+    windowStartMs = 0;
+    windowStartAllocations = 0;
+    windowStartHotPath = 0;
+    lastRate = 0;
+    lastHotPathRate = 0;
+    peakHotPathRate = 0;
+    lastHotPathWindowMs = 0;
+    windows = 0;
+  }
+
+  void onAllocate(uint8_t tag, size_t bytes)
+  {
+    MemoryTagStats &stats = tags[tag < MEMORY_TAGS ? tag : (uint8_t)MEMORY_OTHER];
+    stats.allocations++;
+    stats.bytes += bytes;
+  }
+
+  void onFree(uint8_t tag) { tags[tag < MEMORY_TAGS ? tag : (uint8_t)MEMORY_OTHER].frees++; }
+
+  // The tag allocations are charged to now; see MemoryScope
+  uint8_t current() const { return scope; }
+  uint8_t enter(uint8_t tag)
+  {
+    uint8_t previous = scope;
+    scope = tag;
+    return previous;
+  }
+  void leave(uint8_t previous) { scope = previous; }
+
+  // Call often; closes a rate window once WINDOW_MS has passed
+  void update(uint32_t nowMs)
+  {
+    uint32_t elapsed = nowMs - windowStartMs;
+    if (elapsed < WINDOW_MS)
+      return;
+    uint32_t all = allocations();
+    uint32_t hot = hotPathAllocations();
+    // The first window starts at boot and includes start-up
+    lastRate = (uint32_t)((uint64_t)(all - windowStartAllocations) * 1000 / elapsed);
+    lastHotPathRate = (uint32_t)((uint64_t)(hot - windowStartHotPath) * 1000 / elapsed);
+    if (windows > 0 && lastHotPathRate > peakHotPathRate)
+      peakHotPathRate = lastHotPathRate;
+    if (hot != windowStartHotPath)
+      lastHotPathWindowMs = nowMs;
+    windowStartMs = nowMs;
+    windowStartAllocations = all;
+    windowStartHotPath = hot;
+    windows++;
+  }
+
+  const MemoryTagStats &tag(uint8_t tag) const { return tags[tag]; }
+
+  uint32_t allocations() const
+  {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < MEMORY_TAGS; i++)
+      total += tags[i].allocations;
+    return total;
+  }
+
+  uint32_t hotPathAllocations() const
+  {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < MEMORY_TAGS; i++)
+      total += isHotPath(i) ? tags[i].allocations : 0;
+    return total;
+  }
+
+  // Over the last closed window
+  uint32_t allocationsPerSecond() const { return lastRate; }
+  uint32_t hotPathPerSecond() const { return lastHotPathRate; }
+  // Highest hot path rate after the first window
+  uint32_t peakHotPathPerSecond() const { return peakHotPathRate; }
+  // End of the last window with a hot path allocation, 0 if none
+  uint32_t lastHotPathAllocationMs() const { return lastHotPathWindowMs; }
+
+private:
+  MemoryTagStats tags[MEMORY_TAGS];
+  uint8_t scope;
+  uint32_t windowStartMs;
+  uint32_t windowStartAllocations;
+  uint32_t windowStartHotPath;
+  uint32_t lastRate;
+  uint32_t lastHotPathRate;
+  uint32_t peakHotPathRate;
+  uint32_t lastHotPathWindowMs;
+  uint32_t windows;
+};
+
+// Charges allocations made while it lives to a tag; scopes nest
+//
+//   void readSensors()
+//   {
+//     vitalcare::MemoryScope scope(memory, vitalcare::MEMORY_SENSORS);
+//     ...
+class MemoryScope
+{
+public:
+  MemoryScope(MemoryAccounting &accounting, uint8_t tag) : accounting(accounting), previous(accounting.enter(tag)) {}
+  ~MemoryScope() { accounting.leave(previous); }
+
+  MemoryScope(const MemoryScope &) = delete;
+  MemoryScope &operator=(const MemoryScope &) = delete;
+
+private:
+  MemoryAccounting &accounting;
+  uint8_t previous;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,215 @@
+/*
+ * VitalCare Rural - Motion Artifact Rejection
+ *
+ * Ambulatory PPG is dominated by motion whenever the patient moves. With an
+ * accelerometer sampled on the same tick as the ADC, two things help:
+ *
+ * - MotionEstimator removes gravity from each axis and tracks how hard the
+ *   patient is moving. Its quality factor scales the signal quality index
+ *   of the beat channels, so the heart rate fusion trusts them less.
+ * - NlmsCanceller is an adaptive noise canceller: it learns how the
+ *   acceleration shows up in the PPG and subtracts that part. Normalised
+ *   LMS in fixed point (weights Q16, one 64-bit divide per sample).
+ *
+ * Both are integer-only and allocation-free; per-sample cost is checked
+ * against a budget in the host benchmarks (bench_motion.cpp).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+struct AccelSample
+{
+  int16_t x;
+  int16_t y;
+  int16_t z;
+};
+
+class MotionEstimator
+{
+public:
+  static const uint8_t AXES = 3;
+  // Defaults for a +-2 g accelerometer (16384 counts per g)
+  static const uint16_t REST_INTENSITY = 300;  // ~0.02 g: tremor and sensor noise
+  static const uint16_t FULL_INTENSITY = 8000; // ~0.5 g: walking, arm swing
+
+  MotionEstimator(uint16_t restIntensity = REST_INTENSITY, uint16_t fullIntensity = FULL_INTENSITY)
+      : rest(restIntensity), full(fullIntensity)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    primed = false;
+    intensityQ4 = 0;
+    for (uint8_t i = 0; i < AXES; i++)
+    {
+      gravityQ8[i] = 0;
+      dynamic[i] = 0;
+    }
+  }
+
+  // Feeds one accelerometer sample; dynamicAcceleration() then holds the
+  // gravity-free axes for the canceller.
+  void update(const AccelSample &sample)
+  {
+    const int16_t axes[AXES] = {sample.x, sample.y, sample.z};
+    if (!primed)
+    {
+      for (uint8_t i = 0; i < AXES; i++)
+        gravityQ8[i] = (int32_t)axes[i] << 8;
+      primed = true;
+    }
+
+    uint32_t magnitude = 0;
+    for (uint8_t i = 0; i < AXES; i++)
+    {
+      // Gravity: EMA with alpha 1/64 (~0.6 s at 100 Hz)
+      gravityQ8[i] += (((int32_t)axes[i] << 8) - gravityQ8[i]) >> 6;
+      int32_t value = axes[i] - (gravityQ8[i] >> 8);
+      value = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+      dynamic[i] = (int16_t)value;
+      magnitude += (uint32_t)(value < 0 ? -value : value);
+    }
+
+    // Intensity: EMA of the L1 dynamic magnitude with alpha 1/16
+    intensityQ4 += ((int32_t)(magnitude << 4) - intensityQ4) >> 4;
+  }
+
+  const int16_t *dynamicAcceleration() const { return dynamic; }
+
+  // Smoothed motion intensity in accelerometer counts
+  uint16_t intensity() const
+  {
+    int32_t value = intensityQ4 >> 4;
+    return (uint16_t)(value > 65535 ? 65535 : value);
+  }
+
+  // 1.0 at rest, falling linearly to 0.0 at full motion
+  float qualityFactor() const
+  {
+    uint16_t level = intensity();
+    if (level <= rest)
+      return 1.0f;
+    if (level >= full)
+      return 0.0f;
+    return 1.0f - (float)(level - rest) / (float)(full - rest);
+  }
+
+private:
+  uint16_t rest;
+  uint16_t full;
+  bool primed;
+  int32_t gravityQ8[AXES];
+  int16_t dynamic[AXES];
+  int32_t intensityQ4;
+};
+
+// REFS reference channels (accelerometer axes), TAPS taps per reference
+// (power of two). The primary's DC is tracked and passed through untouched
+// so threshold beat detectors keep working on the output.
+template <uint8_t REFS, uint8_t TAPS>
+class NlmsCanceller
+{
+  static_assert(TAPS > 0 && (TAPS & (TAPS - 1)) == 0, "TAPS must be a power of two");
+
+public:
+  static const uint16_t DEFAULT_MU_Q15 = 3277; // step size 0.1
+  static const int16_t REFERENCE_LIMIT = 2047; // references are scaled into 12 bits
+  static const int32_t WEIGHT_LIMIT = 1 << 24; // |w| <= 256
+
+  explicit NlmsCanceller(uint16_t muQ15 = DEFAULT_MU_Q15, uint8_t referenceShift = 3)
+      : mu(muQ15), shift(referenceShift)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    head = 0;
+    energy = 0;
+    primed = false;
+    dcQ8 = 0;
+    for (uint8_t r = 0; r < REFS; r++)
+    {
+      for (uint8_t t = 0; t < TAPS; t++)
+      {
+        history[r][t] = 0;
+        weights[r][t] = 0;
+      }
+    }
+  }
+
+  // Returns the primary with the reference-correlated component removed.
+  int32_t update(int32_t primary, const int16_t *references)
+  {
+    if (!primed)
+    {
+      dcQ8 = primary << 8;
+      primed = true;
+    }
+    // Primary DC: EMA with alpha 1/128
+    dcQ8 += ((primary << 8) - dcQ8) >> 7;
+    int32_t dc = dcQ8 >> 8;
+    int32_t desired = primary - dc;
+
+    // Slide the reference history, keeping the window energy incrementally
+    head = (uint8_t)((head + 1) & (TAPS - 1));
+    for (uint8_t r = 0; r < REFS; r++)
+    {
+      int32_t x = references[r] >> shift;
+      x = x > REFERENCE_LIMIT ? REFERENCE_LIMIT : (x < -REFERENCE_LIMIT ? -REFERENCE_LIMIT : x);
+      int32_t old = history[r][head];
+      energy += x * x - old * old;
+      history[r][head] = (int16_t)x;
+    }
+
+    // Estimate of the motion component
+    int64_t accumulator = 0;
+    for (uint8_t r = 0; r < REFS; r++)
+    {
+      for (uint8_t t = 0; t < TAPS; t++)
+        accumulator += (int64_t)weights[r][t] * history[r][(head - t) & (TAPS - 1)];
+    }
+    int32_t estimate = (int32_t)(accumulator >> 16);
+    int32_t error = desired - estimate;
+
+    // w += mu * e * x / (eps + |x|^2); step computed once in Q24
+    int64_t step = ((int64_t)mu * error << 9) / ((int64_t)energy + ENERGY_EPSILON);
+    for (uint8_t r = 0; r < REFS; r++)
+    {
+      for (uint8_t t = 0; t < TAPS; t++)
+      {
+        int32_t weight = weights[r][t] + (int32_t)((step * history[r][(head - t) & (TAPS - 1)]) >> 8);
+        weights[r][t] = weight > WEIGHT_LIMIT ? WEIGHT_LIMIT : (weight < -WEIGHT_LIMIT ? -WEIGHT_LIMIT : weight);
+      }
+    }
+
+    lastEstimate = estimate;
+    return dc + error;
+  }
+
+  // Motion component removed from the last sample
+  int32_t lastMotionEstimate() const { return lastEstimate; }
+
+private:
+  // Keeps the step bounded when the patient is still (no reference energy)
+  static const int32_t ENERGY_EPSILON = 64 * REFS * TAPS;
+
+  uint16_t mu;
+  uint8_t shift;
+  uint8_t head;
+  int32_t energy;
+  bool primed;
+  int32_t dcQ8;
+  int32_t lastEstimate = 0;
+  int16_t history[REFS][TAPS];
+  int32_t weights[REFS][TAPS];
+};
+
+} // namespace vitalcare
@@ -0,0 +1,185 @@
+/*
+ * VitalCare Rural - MPU-6050 Accelerometer Driver
+ *
+ * Asynchronous accelerometer reads for motion artifact rejection. The
+ * sketch calls requestSample() on the same tick it samples the ADC; the
+ * 6-byte burst of ACCEL_XOUT_H..ACCEL_ZOUT_L arrives through the bus
+ * callback and read() hands it over once, so every accelerometer sample
+ * pairs with exactly one PPG sample. Only the accelerometer is used.
+ *
+ * Configured for +-2 g (16384 counts per g) with the 44 Hz low-pass.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "I2cBus.h"
+#include "MotionArtifact.h"
+
+namespace vitalcare
+{
+
+class Mpu6050
+{
+public:
+  static const uint8_t ADDRESS = 0x68;
+  static const uint8_t WHO_AM_I_VALUE = 0x68;
+
+  static const uint8_t REG_CONFIG = 0x1A;
+  static const uint8_t REG_ACCEL_CONFIG = 0x1C;
+  static const uint8_t REG_ACCEL_XOUT_H = 0x3B;
+  static const uint8_t REG_PWR_MGMT_1 = 0x6B;
+  static const uint8_t REG_WHO_AM_I = 0x75;
+
+  explicit Mpu6050(I2cBus &bus, uint8_t address = ADDRESS, uint8_t priority = I2C_PRIORITY_NORMAL)
+      : bus(bus), address(address), priority(priority), state(STATE_UNINITIALISED), configStep(0),
+        fresh(false), samples(0), missed(0), errors(0)
+  {
+  }
+
+  // Starts the asynchronous probe and configuration sequence.
+  void begin()
+  {
+    state = STATE_PROBING;
+    configStep = 0;
+    fresh = false;
+    submit(REG_WHO_AM_I, false, buffer, 1);
+  }
+
+  // Starts a read of the current acceleration. A request while the last
+  // one is still on the bus is counted as missed.
+  void requestSample()
+  {
+    if (state == STATE_READING)
+    {
+      missed++;
+      return;
+    }
+    if (state != STATE_IDLE)
+    {
+      return;
+    }
+    state = STATE_READING;
+    submit(REG_ACCEL_XOUT_H, false, buffer, 6);
+  }
+
+  // Takes the sample produced by the last request, once.
+  bool read(AccelSample &sample)
+  {
+    if (!fresh)
+    {
+      return false;
+    }
+    fresh = false;
+    sample = latest;
+    return true;
+  }
+
+  bool ready() const { return state == STATE_IDLE || state == STATE_READING; }
+  bool failed() const { return state == STATE_FAILED; }
+  bool busy() const { return state == STATE_PROBING || state == STATE_CONFIGURING; }
+
+  uint32_t sampleCount() const { return samples; }
+  uint32_t missedCount() const { return missed; }
+  uint32_t errorCount() const { return errors; }
+
+private:
+  enum State : uint8_t
+  {
+    STATE_UNINITIALISED,
+    STATE_PROBING,
+    STATE_CONFIGURING,
+    STATE_IDLE,
+    STATE_READING,
+    STATE_FAILED,
+  };
+
+  void submit(uint8_t reg, bool write, uint8_t *data, uint16_t length)
+  {
+    I2cTransaction transaction = {address, reg, write, priority, length, data, &Mpu6050::onComplete, this};
+    if (!bus.submit(transaction))
+    {
+      errors++;
+      state = state == STATE_READING ? STATE_IDLE : STATE_FAILED;
+    }
+  }
+
+  static void onComplete(void *context, const I2cTransaction &, I2cStatus status)
+  {
+    static_cast<Mpu6050 *>(context)->handleCompletion(status);
+  }
+
+  void handleCompletion(I2cStatus status)
+  {
+    if (status != I2C_OK)
+    {
+      errors++;
+      state = state == STATE_READING ? STATE_IDLE : STATE_FAILED;
+      return;
+    }
+
+    switch (state)
+    {
+    case STATE_PROBING:
+      if (buffer[0] != WHO_AM_I_VALUE)
+      {
+        state = STATE_FAILED;
+        return;
+      }
+      state = STATE_CONFIGURING;
+      nextConfigStep();
+      break;
+
+    case STATE_CONFIGURING:
+      nextConfigStep();
+      break;
+
+    case STATE_READING:
+      latest.x = (int16_t)((buffer[0] << 8) | buffer[1]);
+      latest.y = (int16_t)((buffer[2] << 8) | buffer[3]);
+      latest.z = (int16_t)((buffer[4] << 8) | buffer[5]);
+      fresh = true;
+      samples++;
+      state = STATE_IDLE;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  void nextConfigStep()
+  {
+    static const uint8_t CONFIG[][2] = {
+        {REG_PWR_MGMT_1, 0x01},   // Wake, PLL with X gyro reference
+        {REG_CONFIG, 0x03},       // DLPF 44 Hz
+        {REG_ACCEL_CONFIG, 0x00}, // +-2 g
+    };
+    if (configStep >= sizeof(CONFIG) / sizeof(CONFIG[0]))
+    {
+      state = STATE_IDLE;
+      return;
+    }
+    // Advance first: an inline bus completes (and re-enters) inside submit()
+    const uint8_t *step = CONFIG[configStep++];
+    writeValue = step[1];
+    submit(step[0], true, &writeValue, 1);
+  }
+
+  I2cBus &bus;
+  uint8_t address;
+  uint8_t priority;
+  State state;
+  uint8_t configStep;
+  uint8_t writeValue;
+  uint8_t buffer[6];
+  AccelSample latest;
+  bool fresh;
+
+  uint32_t samples;
+  uint32_t missed;
+  uint32_t errors;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,242 @@
+/*
+ * VitalCare Rural - SD Record Log Segments
+ *
+ * Devices log VitalRecords and PatientRecords to SD as a run of segment
+ * files: one header, then fixed-size blocks of one SD sector, each holding
+ * packed records of one type. A block is written whole, so a torn write
+ * costs at most the block in flight, and blocks sit at fixed offsets: a
+ * reader never has to search for the next one after a damaged block.
+ * Little-endian throughout.
+ *
+ * Segment header (RECORD_LOG_HEADER_SIZE bytes):
+ *   0  u32  magic "VCL1"
+ *   4  u8   version
+ *   5  u8   reserved, zero
+ *   6  u16  block size (RECORD_LOG_BLOCK_SIZE)
+ *   8  u64  device id
+ *   16 u32  segment index (consecutive per device)
+ *   20 u32  sequence of the segment's first block
+ *   24 u64  segment opened (ms, device clock)
+ *   32 char patient id active when the segment was opened, 20 bytes, NUL
+ *           padded (empty: none)
+ *   52      reserved, zero
+ *   60 u32  CRC-32 of bytes 0..59
+ *
+ * The header is zero-padded to one block, so block n starts at byte
+ * (n + 1) x RECORD_LOG_BLOCK_SIZE and stays sector-aligned.
+ *
+ * Block (RECORD_LOG_BLOCK_SIZE bytes):
+ *   0  u32  magic "VCLB"
+ *   4  u8   record type (UplinkRecordType)
+ *   5  u8   record count
+ *   6  u16  reserved, zero
+ *   8  u32  block sequence (per device, +1 per block across segments)
+ *   12 u32  CRC-32 of bytes 0..11 and the records
+ *   16      records, packed; the rest of the block is zero
+ *
+ * Block n of a segment is live when its sequence is the segment's first
+ * block sequence + n. Anything else - erased space, or stale data left in
+ * a preallocated file - is not part of the log. The patient id in the
+ * header makes every segment decodable on its own: vitals belong to that
+ * patient until a PatientRecord in the log switches to another.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Checksum.h"
+#include "Encoding.h"
+#include "Records.h"
+#include "Uplink.h"
+
+namespace vitalcare
+{
+
+const uint32_t RECORD_LOG_MAGIC = 0x314C4356;       // "VCL1"
+const uint32_t RECORD_LOG_BLOCK_MAGIC = 0x424C4356; // "VCLB"
+const uint8_t RECORD_LOG_VERSION = 1;
+const size_t RECORD_LOG_HEADER_SIZE = 64;
+const size_t RECORD_LOG_BLOCK_SIZE = 512;
+const size_t RECORD_LOG_BLOCK_HEADER_SIZE = 16;
+
+// Byte offset of block n in a segment file
+inline uint64_t recordLogBlockOffset(uint64_t block)
+{
+  return (block + 1) * RECORD_LOG_BLOCK_SIZE;
+}
+
+struct RecordLogHeader
+{
+  uint64_t deviceId;
+  uint32_t segmentIndex;
+  uint32_t firstBlockSequence;
+  uint64_t openedMs;
+  char patientId[PATIENT_ID_LENGTH + 1]; // NUL terminated
+};
+
+struct RecordLogBlock
+{
+  uint8_t recordType;
+  uint8_t recordCount;
+  uint32_t sequence;
+};
+
+enum RecordLogBlockStatus : uint8_t
+{
+  LOG_BLOCK_OK = 0,
+  LOG_BLOCK_BAD_CRC = 1,   // Header readable, contents damaged: records carry their own CRC-16
+  LOG_BLOCK_NOT_BLOCK = 2, // Wrong magic, record type or count
+};
+
+// Records of recordType that fit one block (0 for an unknown type)
+inline size_t recordLogBlockCapacity(uint8_t recordType)
+{
+  size_t recordSize = uplinkRecordSize(recordType);
+  return recordSize ? (RECORD_LOG_BLOCK_SIZE - RECORD_LOG_BLOCK_HEADER_SIZE) / recordSize : 0;
+}
+
+// Encodes into out, which must hold RECORD_LOG_HEADER_SIZE bytes.
+inline size_t encodeRecordLogHeader(const RecordLogHeader &header, uint8_t *out)
+{
+  char patientId[PATIENT_ID_LENGTH] = {0};
+  memcpy(patientId, header.patientId, strnlen(header.patientId, PATIENT_ID_LENGTH));
+
+  BinaryWriter writer(out, RECORD_LOG_HEADER_SIZE);
+  writer.u32(RECORD_LOG_MAGIC)
+      .u8(RECORD_LOG_VERSION)
+      .u8(0)
+      .u16((uint16_t)RECORD_LOG_BLOCK_SIZE)
+      .u64(header.deviceId)
+      .u32(header.segmentIndex)
+      .u32(header.firstBlockSequence)
+      .u64(header.openedMs)
+      .bytes(patientId, PATIENT_ID_LENGTH);
+  static const uint8_t RESERVED[RECORD_LOG_HEADER_SIZE - 56] = {0};
+  writer.bytes(RESERVED, sizeof(RESERVED));
+  writer.u32(crc32(out, RECORD_LOG_HEADER_SIZE - 4));
+  return writer.size();
+}
+
+// Checks magic, version, block size and header CRC.
+inline bool decodeRecordLogHeader(const uint8_t *in, size_t length, RecordLogHeader &header)
+{
+  if (length < RECORD_LOG_HEADER_SIZE)
+  {
+    return false;
+  }
+  BinaryReader reader(in, RECORD_LOG_HEADER_SIZE);
+  if (reader.u32() != RECORD_LOG_MAGIC || reader.u8() != RECORD_LOG_VERSION)
+  {
+    return false;
+  }
+  reader.skip(1);
+  uint16_t blockSize = reader.u16();
+  header.deviceId = reader.u64();
+  header.segmentIndex = reader.u32();
+  header.firstBlockSequence = reader.u32();
+  header.openedMs = reader.u64();
+  reader.bytes(header.patientId, PATIENT_ID_LENGTH);
+  header.patientId[PATIENT_ID_LENGTH] = '\0';
+  reader.skip(RECORD_LOG_HEADER_SIZE - 4 - reader.position());
+  uint32_t headerCrc = reader.u32();
+
+  return reader.ok() && blockSize == RECORD_LOG_BLOCK_SIZE && headerCrc == crc32(in, RECORD_LOG_HEADER_SIZE - 4);
+}
+
+// Reads the block at in (RECORD_LOG_BLOCK_SIZE bytes). block is filled
+// unless the result is LOG_BLOCK_NOT_BLOCK.
+inline RecordLogBlockStatus decodeRecordLogBlock(const uint8_t *in, RecordLogBlock &block)
+{
+  BinaryReader reader(in, RECORD_LOG_BLOCK_HEADER_SIZE);
+  if (reader.u32() != RECORD_LOG_BLOCK_MAGIC)
+  {
+    return LOG_BLOCK_NOT_BLOCK;
+  }
+  block.recordType = reader.u8();
+  block.recordCount = reader.u8();
+  reader.skip(2);
+  block.sequence = reader.u32();
+  uint32_t expected = reader.u32();
+  size_t capacity = recordLogBlockCapacity(block.recordType);
+  if (capacity == 0 || block.recordCount > capacity)
+  {
+    return LOG_BLOCK_NOT_BLOCK;
+  }
+
+  uint32_t crc = crc32(in, RECORD_LOG_BLOCK_HEADER_SIZE - 4);
+  crc = crc32(in + RECORD_LOG_BLOCK_HEADER_SIZE, block.recordCount * uplinkRecordSize(block.recordType), crc);
+  return crc == expected ? LOG_BLOCK_OK : LOG_BLOCK_BAD_CRC;
+}
+
+// Fills one block in a caller-owned RECORD_LOG_BLOCK_SIZE buffer:
+//
+//   RecordLogBlockWriter block(buffer, UPLINK_VITAL_RECORDS, nextSequence++);
+//   while (!block.full() && pending())
+//     block.add(next());
+//   sdWrite(buffer, block.finish());
+class RecordLogBlockWriter
+{
+public:
+  RecordLogBlockWriter(uint8_t *buffer, uint8_t recordType, uint32_t sequence)
+      : buffer(buffer), recordSize(uplinkRecordSize(recordType)), capacity(recordLogBlockCapacity(recordType))
+  {
+    block.recordType = recordType;
+    block.recordCount = 0;
+    block.sequence = sequence;
+  }
+
+  bool add(const VitalRecord &record)
+  {
+    if (block.recordType != UPLINK_VITAL_RECORDS || full())
+      return false;
+    encodeVitalRecord(record, next());
+    block.recordCount++;
+    return true;
+  }
+
+  bool add(const PatientRecord &record)
+  {
+    if (block.recordType != UPLINK_PATIENT_RECORDS || full())
+      return false;
+    encodePatientRecord(record, next());
+    block.recordCount++;
+    return true;
+  }
+
+  bool addEncoded(const uint8_t *record)
+  {
+    if (full())
+      return false;
+    memcpy(next(), record, recordSize);
+    block.recordCount++;
+    return true;
+  }
+
+  uint8_t count() const { return block.recordCount; }
+  bool full() const { return block.recordCount >= capacity; }
+
+  // Zeroes the unused tail and writes the header; returns RECORD_LOG_BLOCK_SIZE.
+  size_t finish()
+  {
+    size_t used = RECORD_LOG_BLOCK_HEADER_SIZE + block.recordCount * recordSize;
+    memset(buffer + used, 0, RECORD_LOG_BLOCK_SIZE - used);
+    BinaryWriter writer(buffer, RECORD_LOG_BLOCK_HEADER_SIZE);
+    writer.u32(RECORD_LOG_BLOCK_MAGIC).u8(block.recordType).u8(block.recordCount).u16(0).u32(block.sequence);
+    uint32_t crc = crc32(buffer, RECORD_LOG_BLOCK_HEADER_SIZE - 4);
+    writer.u32(crc32(buffer + RECORD_LOG_BLOCK_HEADER_SIZE, block.recordCount * recordSize, crc));
+    return RECORD_LOG_BLOCK_SIZE;
+  }
+
+private:
+  uint8_t *next() { return buffer + RECORD_LOG_BLOCK_HEADER_SIZE + block.recordCount * recordSize; }
+
+  uint8_t *buffer;
+  size_t recordSize;
+  size_t capacity;
+  RecordLogBlock block;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,196 @@
+/*
+ * VitalCare Rural - Record Formats
+ *
+ * Fixed-size binary records shared by SD storage, the uplink and the host
+ * tools. All multi-byte fields are little-endian; vitals are stored as
+ * fixed-point x10 so a record is 24 bytes instead of a JSON file each.
+ *
+ * VitalRecord layout (VITAL_RECORD_SIZE bytes):
+ *   0  u8   magic ('V')
+ *   1  u8   version
+ *   2  u8   alert flags (AlertFlag)
+ *   3  u8   record flags (RecordFlag)
+ *   4  u32  sequence number (per device, monotonic)
+ *   8  u32  timestamp (ms)
+ *   12 u16  heart rate x10 (BPM)
+ *   14 u16  systolic x10 (mmHg)
+ *   16 u16  diastolic x10 (mmHg)
+ *   18 u16  SpO2 x10 (%)
+ *   20 i16  temperature x10 (°F)
+ *   22 u16  CRC-16/CCITT of bytes 0..21
+ *
+ * PatientRecord layout (PATIENT_RECORD_SIZE bytes):
+ *   0  u8   magic ('P')
+ *   1  u8   version
+ *   2  u8   gender ('M', 'F', 'O' or 0)
+ *   3  u8   age (years)
+ *   4  u32  sequence number (per device, monotonic)
+ *   8  u32  session start (ms)
+ *   12 char patient id, 20 bytes, NUL padded
+ *   32 char name, 30 bytes, NUL padded
+ *   62 u16  CRC-16/CCITT of bytes 0..61
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Checksum.h"
+#include "Encoding.h"
+#include "Vitals.h"
+
+namespace vitalcare
+{
+
+const uint8_t VITAL_RECORD_MAGIC = 'V';
+const uint8_t VITAL_RECORD_VERSION = 1;
+const size_t VITAL_RECORD_SIZE = 24;
+
+const uint8_t PATIENT_RECORD_MAGIC = 'P';
+const uint8_t PATIENT_RECORD_VERSION = 1;
+const size_t PATIENT_RECORD_SIZE = 64;
+const size_t PATIENT_ID_LENGTH = 20;
+const size_t PATIENT_NAME_LENGTH = 30;
+
+enum RecordFlag : uint8_t
+{
+  RECORD_UPLOADED = 1 << 0,
+  RECORD_EMERGENCY = 1 << 1,
+  RECORD_LEADS_OFF = 1 << 2,
+};
+
+struct VitalRecord
+{
+  uint32_t sequence;
+  VitalSample vitals;
+  uint8_t alertFlags;
+  uint8_t recordFlags;
+};
+
+struct PatientRecord
+{
+  uint32_t sequence;
+  char patientId[PATIENT_ID_LENGTH + 1]; // NUL terminated
+  char name[PATIENT_NAME_LENGTH + 1];
+  uint8_t age;
+  char gender;
+  uint32_t sessionStartMs;
+};
+
+inline uint16_t toFixed10(float value)
+{
+  if (!(value > 0))
+    return 0;
+  float scaled = value * 10.0f + 0.5f;
+  return scaled >= 65535.0f ? 65535 : (uint16_t)scaled;
+}
+
+inline int16_t toSignedFixed10(float value)
+{
+  if (isnan(value))
+    return 0;
+  float scaled = value * 10.0f;
+  scaled += scaled < 0 ? -0.5f : 0.5f;
+  if (scaled > 32767.0f)
+    return 32767;
+  if (scaled < -32768.0f)
+    return -32768;
+  return (int16_t)scaled;
+}
+
+// Encodes into out, which must hold VITAL_RECORD_SIZE bytes.
+inline size_t encodeVitalRecord(const VitalRecord &record, uint8_t *out)
+{
+  BinaryWriter writer(out, VITAL_RECORD_SIZE);
+  writer.u8(VITAL_RECORD_MAGIC)
+      .u8(VITAL_RECORD_VERSION)
+      .u8(record.alertFlags)
+      .u8(record.recordFlags)
+      .u32(record.sequence)
+      .u32(record.vitals.timestampMs)
+      .u16(toFixed10(record.vitals.heartRate))
+      .u16(toFixed10(record.vitals.systolicBP))
+      .u16(toFixed10(record.vitals.diastolicBP))
+      .u16(toFixed10(record.vitals.spO2))
+      .i16(toSignedFixed10(record.vitals.temperature));
+  writer.u16(crc16Ccitt(out, VITAL_RECORD_SIZE - 2));
+  return writer.size();
+}
+
+// Returns false on a bad magic, unknown version or CRC mismatch.
+inline bool decodeVitalRecord(const uint8_t *in, VitalRecord &record)
+{
+  BinaryReader reader(in, VITAL_RECORD_SIZE);
+  if (reader.u8() != VITAL_RECORD_MAGIC || reader.u8() != VITAL_RECORD_VERSION)
+  {
+    return false;
+  }
+  uint16_t expected = (uint16_t)(in[VITAL_RECORD_SIZE - 2] | (in[VITAL_RECORD_SIZE - 1] << 8));
+  if (crc16Ccitt(in, VITAL_RECORD_SIZE - 2) != expected)
+  {
+    return false;
+  }
+
+  record.alertFlags = reader.u8();
+  record.recordFlags = reader.u8();
+  record.sequence = reader.u32();
+  record.vitals.timestampMs = reader.u32();
+  record.vitals.heartRate = reader.u16() / 10.0f;
+  record.vitals.systolicBP = reader.u16() / 10.0f;
+  record.vitals.diastolicBP = reader.u16() / 10.0f;
+  record.vitals.spO2 = reader.u16() / 10.0f;
+  record.vitals.temperature = reader.i16() / 10.0f;
+  return reader.ok();
+}
+
+// Encodes into out, which must hold PATIENT_RECORD_SIZE bytes. Longer
+// strings are truncated.
+inline size_t encodePatientRecord(const PatientRecord &record, uint8_t *out)
+{
+  char patientId[PATIENT_ID_LENGTH] = {0};
+  char name[PATIENT_NAME_LENGTH] = {0};
+  memcpy(patientId, record.patientId, strnlen(record.patientId, PATIENT_ID_LENGTH));
+  memcpy(name, record.name, strnlen(record.name, PATIENT_NAME_LENGTH));
+
+  BinaryWriter writer(out, PATIENT_RECORD_SIZE);
+  writer.u8(PATIENT_RECORD_MAGIC)
+      .u8(PATIENT_RECORD_VERSION)
+      .u8((uint8_t)record.gender)
+      .u8(record.age)
+      .u32(record.sequence)
+      .u32(record.sessionStartMs)
+      .bytes(patientId, PATIENT_ID_LENGTH)
+      .bytes(name, PATIENT_NAME_LENGTH);
+  writer.u16(crc16Ccitt(out, PATIENT_RECORD_SIZE - 2));
+  return writer.size();
+}
+
+// Returns false on a bad magic, unknown version or CRC mismatch.
+inline bool decodePatientRecord(const uint8_t *in, PatientRecord &record)
+{
+  BinaryReader reader(in, PATIENT_RECORD_SIZE);
+  if (reader.u8() != PATIENT_RECORD_MAGIC || reader.u8() != PATIENT_RECORD_VERSION)
+  {
+    return false;
+  }
+  uint16_t expected = (uint16_t)(in[PATIENT_RECORD_SIZE - 2] | (in[PATIENT_RECORD_SIZE - 1] << 8));
+  if (crc16Ccitt(in, PATIENT_RECORD_SIZE - 2) != expected)
+  {
+    return false;
+  }
+
+  record.gender = (char)reader.u8();
+  record.age = reader.u8();
+  record.sequence = reader.u32();
+  record.sessionStartMs = reader.u32();
+  reader.bytes(record.patientId, PATIENT_ID_LENGTH);
+  reader.bytes(record.name, PATIENT_NAME_LENGTH);
+  record.patientId[PATIENT_ID_LENGTH] = '\0';
+  record.name[PATIENT_NAME_LENGTH] = '\0';
+  return reader.ok();
+}
+
+} // namespace vitalcare
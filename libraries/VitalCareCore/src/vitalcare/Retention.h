@@ -0,0 +1,508 @@
+/*
+ * VitalCare Rural - Recording Retention
+ *
+ * Keeps the recordings directory from filling the SD card. Files are
+ * classed by name: raw waveform (EDF+ recordings, sensor captures), 1 Hz
+ * vitals (trend CSVs) and rollups (per-minute summaries of trend CSVs);
+ * anything else, such as the writer's spare segment, is never touched.
+ * RetentionPolicy gives each class a maximum age, 0 keeping it forever.
+ * A file past its age is deleted; a trend CSV is first compacted into a
+ * rollup CSV beside it. Below the free space watermark the oldest files
+ * go before their age, waveform first, so the card never runs full and
+ * cluster allocation stays as cheap as on an emptier card.
+ *
+ * Nothing that has not been uploaded is deleted. Whatever collects the
+ * recordings confirms an upload watermark, the device time up to which it
+ * has taken everything; a file written after it is kept whatever its age
+ * or the free space, and counted as held.
+ *
+ * Ages are in device time, seconds on a clock the firmware keeps across
+ * resets, which the store reports file modification times in.
+ *
+ * The work runs in steps of one directory entry, one chunk of compaction
+ * or one delete, under a time budget of microseconds per second that
+ * steps spend as they take it. On the device the steps run in the SD
+ * writer task's idle time (StorageSink::idle()).
+ *
+ * Rollup rows: device timestamp (ms) of the last reading, readings, mean
+ * heart rate, last systolic and diastolic, mean SpO2 and temperature,
+ * 1 if any reading was an alert (VitalRollup).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Rollup.h"
+#include "StorageQueue.h"
+
+namespace vitalcare
+{
+
+enum RetentionClass : uint8_t
+{
+  RETAIN_WAVEFORM = 0, // EDF+ recordings (.edf) and sensor captures (.vcs)
+  RETAIN_VITALS,       // 1 Hz trend CSVs (.csv)
+  RETAIN_ROLLUP,       // Their per-minute rollups (-rollup.csv)
+  RETAIN_CLASSES,
+  RETAIN_KEEP = 0xFF, // Anything else
+};
+
+const char *const RETENTION_ROLLUP_SUFFIX = "-rollup.csv";
+const char *const RETENTION_ROLLUP_HEADER =
+    "timestamp,readings,heartRate,systolicBP,diastolicBP,spO2,temperature,alert\r\n";
+const uint32_t RETENTION_ROLLUP_MS = 60000;
+const size_t RETENTION_CHUNK_BYTES = 512;
+const size_t RETENTION_MAX_LINE = 160;
+
+inline bool retentionHasSuffix(const char *path, const char *suffix)
+{
+  size_t length = strlen(path);
+  size_t suffixLength = strlen(suffix);
+  return length >= suffixLength && strcmp(path + length - suffixLength, suffix) == 0;
+}
+
+inline uint8_t retentionClass(const char *path)
+{
+  if (retentionHasSuffix(path, RETENTION_ROLLUP_SUFFIX))
+    return RETAIN_ROLLUP;
+  if (retentionHasSuffix(path, ".csv"))
+    return RETAIN_VITALS;
+  if (retentionHasSuffix(path, ".edf") || retentionHasSuffix(path, ".vcs"))
+    return RETAIN_WAVEFORM;
+  return RETAIN_KEEP;
+}
+
+inline const char *retentionClassName(uint8_t retentionClass)
+{
+  static const char *const NAMES[RETAIN_CLASSES] = {"waveform", "vitals", "rollup"};
+  return retentionClass < RETAIN_CLASSES ? NAMES[retentionClass] : "keep";
+}
+
+struct RetentionPolicy
+{
+  uint32_t maxAgeS[RETAIN_CLASSES]; // 0: forever
+  uint8_t minFreePercent;           // The watermark
+  uint32_t budgetUsPerS;            // Step time allowed per second
+  uint32_t scanIntervalS;           // Between directory scans
+};
+
+// Waveform 7 days, vitals 90 days, rollups forever; 10% free; 2% of the
+// time; a scan a minute
+const RetentionPolicy DEFAULT_RETENTION = {{7 * 86400, 90 * 86400, 0}, 10, 20000, 60};
+
+struct RetentionFile
+{
+  char path[STORAGE_MAX_PATH + 1];
+  uint32_t bytes;
+  uint32_t modifiedS; // Device time
+};
+
+// The card as the engine sees it: the SD card in the writer task on the
+// device, a simulated one in vitalcare-retention-sim
+class RetentionStore
+{
+public:
+  virtual ~RetentionStore() {}
+
+  virtual uint64_t totalBytes() = 0;
+  virtual uint64_t freeBytes() = 0;
+  // Lists the recordings directory from the start, a file per next();
+  // files still being written must not be listed
+  virtual bool rewind() = 0;
+  virtual bool next(RetentionFile &file) = 0;
+  // Bytes read at offset: 0 at the end, negative on error
+  virtual int32_t read(const char *path, uint32_t offset, uint8_t *data, size_t length) = 0;
+  virtual bool write(const char *path, const uint8_t *data, size_t length, bool truncate) = 0;
+  virtual bool remove(const char *path) = 0;
+  virtual uint32_t micros() = 0;
+};
+
+struct RetentionStats
+{
+  uint32_t scans;
+  uint32_t deleted[RETAIN_CLASSES]; // Files
+  uint64_t deletedBytes;
+  uint32_t compacted;  // Trend CSVs folded into rollups (and deleted)
+  uint32_t rollupRows; // Written by the compactions
+  uint32_t held;       // Due, or wanted for space, but not uploaded: last scan
+  uint32_t failed;     // Reads, writes and deletes that failed
+  bool pressure;       // Below the watermark with nothing left to delete: last scan
+  uint64_t totalBytes; // At the last scan
+  uint64_t freeBytes;
+  uint64_t busyUs; // Spent in steps
+  uint32_t maxStepUs;
+};
+
+class RetentionEngine
+{
+public:
+  explicit RetentionEngine(RetentionStore &store, const RetentionPolicy &policy = DEFAULT_RETENTION)
+      : store(store), policy(policy)
+  {
+    memset(&totals, 0, sizeof(totals));
+    nowS = 0;
+    uploadedS = 0;
+    clockSet = false;
+    budgetStarted = false;
+    credit = 0;
+    lastRefillUs = 0;
+    restart();
+  }
+
+  // Device time now, and the upload watermark; nothing runs until set
+  void setClock(uint32_t now, uint32_t uploadedThrough)
+  {
+    nowS = now;
+    uploadedS = uploadedThrough;
+    clockSet = true;
+  }
+
+  // Drops any scan or compaction under way, as after the card is
+  // remounted; a compaction starts over next time
+  void restart()
+  {
+    state = WAITING;
+    scanned = false;
+    rescan = false;
+  }
+
+  // One step, if there is work and the budget has time for it. True if
+  // it did something.
+  bool step()
+  {
+    if (!clockSet)
+      return false;
+    uint32_t start = store.micros();
+    refill(start);
+    if (credit <= 0)
+      return false;
+
+    switch (state)
+    {
+    case WAITING:
+      if (scanned && nowS - lastScanS < policy.scanIntervalS)
+        return false;
+      beginScan();
+      break;
+    case SCANNING:
+      scanEntry();
+      break;
+    case COMPACTING:
+      compactChunk();
+      break;
+    }
+
+    uint32_t elapsed = store.micros() - start;
+    credit -= (int64_t)elapsed * 1000000;
+    totals.busyUs += elapsed;
+    if (elapsed > totals.maxStepUs)
+      totals.maxStepUs = elapsed;
+    return true;
+  }
+
+  bool busy() const { return state != WAITING; }
+  const RetentionStats &stats() const { return totals; }
+  const RetentionPolicy &rules() const { return policy; }
+
+private:
+  enum State : uint8_t
+  {
+    WAITING = 0,
+    SCANNING,
+    COMPACTING,
+  };
+
+  // Up to a second's worth of credit builds up while idle
+  void refill(uint32_t nowUs)
+  {
+    int64_t full = (int64_t)policy.budgetUsPerS * 1000000;
+    if (!budgetStarted)
+    {
+      budgetStarted = true;
+      lastRefillUs = nowUs;
+      credit = full;
+      return;
+    }
+    credit += (int64_t)(uint32_t)(nowUs - lastRefillUs) * policy.budgetUsPerS;
+    lastRefillUs = nowUs;
+    if (credit > full)
+      credit = full;
+  }
+
+  void beginScan()
+  {
+    totals.scans++;
+    totals.totalBytes = store.totalBytes();
+    totals.freeBytes = store.freeBytes();
+    pressure = totals.freeBytes * 100 < totals.totalBytes * policy.minFreePercent;
+    candidate.path[0] = '\0';
+    held = 0;
+    if (!store.rewind())
+    {
+      totals.failed++;
+      finishScan();
+      return;
+    }
+    state = SCANNING;
+  }
+
+  void scanEntry()
+  {
+    RetentionFile file;
+    if (!store.next(file))
+    {
+      finishScan();
+      return;
+    }
+    uint8_t fileClass = retentionClass(file.path);
+    if (fileClass >= RETAIN_CLASSES || policy.maxAgeS[fileClass] == 0)
+      return;
+    bool due = file.modifiedS <= nowS && nowS - file.modifiedS >= policy.maxAgeS[fileClass];
+    if (file.modifiedS > uploadedS)
+    {
+      held += (due || pressure) ? 1 : 0;
+      return;
+    }
+    if (due)
+    {
+      act(file, fileClass);
+      return;
+    }
+    // Waveform first, as it is big and kept for the shortest time
+    if (pressure && (candidate.path[0] == '\0' || fileClass < candidateClass ||
+                     (fileClass == candidateClass && file.modifiedS < candidate.modifiedS)))
+    {
+      candidate = file;
+      candidateClass = fileClass;
+    }
+  }
+
+  // Under pressure the oldest file goes, then the directory is scanned
+  // again, until the watermark is met or nothing is left
+  void finishScan()
+  {
+    totals.held = held;
+    totals.pressure = pressure && candidate.path[0] == '\0';
+    lastScanS = nowS;
+    scanned = true;
+    state = WAITING;
+    if (pressure && candidate.path[0] != '\0')
+    {
+      rescan = true;
+      act(candidate, candidateClass);
+    }
+  }
+
+  void act(const RetentionFile &file, uint8_t fileClass)
+  {
+    if (fileClass == RETAIN_VITALS)
+    {
+      beginCompaction(file);
+      return;
+    }
+    actionDone(remove(file, fileClass));
+  }
+
+  bool remove(const RetentionFile &file, uint8_t fileClass)
+  {
+    if (!store.remove(file.path))
+    {
+      totals.failed++;
+      return false;
+    }
+    totals.deleted[fileClass]++;
+    totals.deletedBytes += file.bytes;
+    totals.freeBytes += file.bytes;
+    return true;
+  }
+
+  // Back to the scan it came from, or a fresh one after a deletion for
+  // space; a failure waits for the next scan rather than retrying now
+  void actionDone(bool ok)
+  {
+    if (state == COMPACTING)
+      state = rescan ? WAITING : SCANNING;
+    if (rescan && ok)
+      beginScan();
+    rescan = false;
+  }
+
+  void beginCompaction(const RetentionFile &file)
+  {
+    source = file;
+    size_t baseLength = strlen(file.path) - 4; // Without ".csv"
+    size_t suffixLength = strlen(RETENTION_ROLLUP_SUFFIX);
+    if (baseLength + suffixLength > STORAGE_MAX_PATH)
+    {
+      totals.failed++;
+      actionDone(false);
+      return;
+    }
+    memcpy(rollupPath, file.path, baseLength);
+    memcpy(rollupPath + baseLength, RETENTION_ROLLUP_SUFFIX, suffixLength + 1);
+    // Written from the start, so a compaction cut off by a reset repeats
+    if (!store.write(rollupPath, (const uint8_t *)RETENTION_ROLLUP_HEADER, strlen(RETENTION_ROLLUP_HEADER), true))
+    {
+      totals.failed++;
+      actionDone(false);
+      return;
+    }
+    readOffset = 0;
+    carry = 0;
+    outLength = 0;
+    outFailed = false;
+    rowsWritten = 0;
+    rollup.reset();
+    state = COMPACTING;
+  }
+
+  void compactChunk()
+  {
+    int32_t got = store.read(source.path, readOffset, chunk + carry, sizeof(chunk) - carry);
+    if (got < 0)
+    {
+      endCompaction(false);
+      return;
+    }
+    if (got == 0)
+    {
+      if (carry)
+        foldLine((const char *)chunk, carry);
+      carry = 0;
+      emitPeriod();
+      endCompaction(flushOut());
+      return;
+    }
+    readOffset += (uint32_t)got;
+    size_t length = carry + (size_t)got;
+    size_t lineStart = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+      if (chunk[i] != '\n')
+        continue;
+      foldLine((const char *)chunk + lineStart, i - lineStart);
+      lineStart = i + 1;
+    }
+    carry = length - lineStart;
+    if (carry == sizeof(chunk))
+      carry = 0; // No line is this long: not a trend CSV row
+    memmove(chunk, chunk + lineStart, carry);
+    if (!flushOut())
+      endCompaction(false);
+  }
+
+  // The source goes only once its rollup is written whole
+  void endCompaction(bool ok)
+  {
+    if (ok)
+    {
+      totals.compacted++;
+      totals.rollupRows += rowsWritten;
+      ok = remove(source, RETAIN_VITALS);
+    }
+    else
+      totals.failed++;
+    actionDone(ok);
+  }
+
+  // timestamp,heartRate,systolicBP,diastolicBP,spO2,temperature,ecg,pressure,status
+  void foldLine(const char *line, size_t length)
+  {
+    if (length == 0 || line[0] < '0' || line[0] > '9')
+      return; // The header
+    char text[RETENTION_MAX_LINE];
+    if (length >= sizeof(text))
+      length = sizeof(text) - 1;
+    memcpy(text, line, length);
+    text[length] = '\0';
+
+    char *at = text;
+    VitalSample sample;
+    sample.timestampMs = (uint32_t)strtoul(at, &at, 10);
+    float *fields[] = {&sample.heartRate, &sample.systolicBP, &sample.diastolicBP, &sample.spO2,
+                       &sample.temperature};
+    for (float *field : fields)
+    {
+      if (*at != ',')
+        return;
+      *field = strtof(at + 1, &at);
+    }
+    bool alert = strstr(at, "ALERT") != nullptr;
+
+    uint32_t period = sample.timestampMs / RETENTION_ROLLUP_MS;
+    if (!rollup.empty() && period != rollupPeriod)
+      emitPeriod();
+    rollupPeriod = period;
+    rollup.add(sample, alert ? 1 : 0);
+  }
+
+  void emitPeriod()
+  {
+    uint16_t readings = rollup.readingCount();
+    VitalRecord record;
+    if (!rollup.finish(rowsWritten, record))
+      return;
+    char row[96];
+    int length = snprintf(row, sizeof(row), "%lu,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%u\r\n",
+                          (unsigned long)record.vitals.timestampMs, readings, record.vitals.heartRate,
+                          record.vitals.systolicBP, record.vitals.diastolicBP, record.vitals.spO2,
+                          record.vitals.temperature, record.alertFlags ? 1 : 0);
+    if (length <= 0 || (size_t)length >= sizeof(row))
+      return;
+    if (outLength + length > sizeof(out) && !flushOut())
+    {
+      outFailed = true;
+      return;
+    }
+    memcpy(out + outLength, row, length);
+    outLength += length;
+    rowsWritten++;
+  }
+
+  bool flushOut()
+  {
+    bool ok = !outFailed && (outLength == 0 || store.write(rollupPath, out, outLength, false));
+    outLength = 0;
+    outFailed = outFailed || !ok;
+    return ok;
+  }
+
+  RetentionStore &store;
+  RetentionPolicy policy;
+  RetentionStats totals;
+  uint32_t nowS;
+  uint32_t uploadedS;
+  bool clockSet;
+
+  bool budgetStarted;
+  int64_t credit; // us x 1e6, so short steps refill exactly
+  uint32_t lastRefillUs;
+
+  State state;
+  bool scanned;
+  uint32_t lastScanS;
+  bool pressure;
+  bool rescan;
+  uint32_t held;
+  RetentionFile candidate;
+  uint8_t candidateClass;
+
+  RetentionFile source;
+  char rollupPath[STORAGE_MAX_PATH + 1];
+  uint32_t readOffset;
+  uint8_t chunk[RETENTION_CHUNK_BYTES];
+  size_t carry;
+  uint8_t out[RETENTION_CHUNK_BYTES];
+  size_t outLength;
+  bool outFailed;
+  uint32_t rowsWritten;
+  uint32_t rollupPeriod;
+  VitalRollup rollup;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,101 @@
+/*
+ * VitalCare Rural - Ring Buffer
+ *
+ * Fixed-capacity circular buffer. Capacity is a power of two so indexing is
+ * a mask instead of a modulo, which matters on the per-sample path.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+template <typename T, size_t N>
+class RingBuffer
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+  RingBuffer() : head(0), count(0) {}
+
+  static constexpr size_t capacity() { return N; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count == N; }
+  void clear()
+  {
+    head = 0;
+    count = 0;
+  }
+
+  // Appends a value, overwriting the oldest one when full.
+  // Returns false if an element was overwritten.
+  bool push(const T &value)
+  {
+    items[(head + count) & MASK] = value;
+    if (count < N)
+    {
+      count++;
+      return true;
+    }
+    head = (head + 1) & MASK;
+    return false;
+  }
+
+  // Appends only if there is room. Returns false when full.
+  bool tryPush(const T &value)
+  {
+    if (count == N)
+    {
+      return false;
+    }
+    items[(head + count) & MASK] = value;
+    count++;
+    return true;
+  }
+
+  // Removes the oldest value.
+  bool pop(T &out)
+  {
+    if (count == 0)
+    {
+      return false;
+    }
+    out = items[head];
+    head = (head + 1) & MASK;
+    count--;
+    return true;
+  }
+
+  // Drops up to n of the oldest values.
+  void discard(size_t n)
+  {
+    if (n > count)
+    {
+      n = count;
+    }
+    head = (head + n) & MASK;
+    count -= n;
+  }
+
+  // Index 0 is the oldest element, size() - 1 the newest.
+  T &operator[](size_t i) { return items[(head + i) & MASK]; }
+  const T &operator[](size_t i) const { return items[(head + i) & MASK]; }
+
+  T &oldest() { return items[head]; }
+  const T &oldest() const { return items[head]; }
+  T &newest() { return items[(head + count - 1) & MASK]; }
+  const T &newest() const { return items[(head + count - 1) & MASK]; }
+
+private:
+  static constexpr size_t MASK = N - 1;
+
+  T items[N];
+  size_t head;  // Index of the oldest element
+  size_t count; // Number of valid elements
+};
+
+} // namespace vitalcare
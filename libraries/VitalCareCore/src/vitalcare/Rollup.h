@@ -0,0 +1,119 @@
+/*
+ * VitalCare Rural - On-Device Rollups
+ *
+ * The sensors produce a reading every second. Storing and uploading each one
+ * costs SD writes and airtime a GSM link cannot spare, so a device keeps one
+ * VitalRecord per rollup period. VitalRollup folds one period:
+ *
+ * - heart rate, SpO2 and temperature: mean of the valid readings (0 means
+ *   no reading, as in VitalSample)
+ * - blood pressure: the last cuff measurement, which is not continuous
+ * - alert and record flags: OR of every reading, so one out-of-range
+ *   second still marks the record
+ * - timestamp: the last reading of the period
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Records.h"
+#include "Vitals.h"
+
+namespace vitalcare
+{
+
+class VitalRollup
+{
+public:
+  VitalRollup() { reset(); }
+
+  void reset()
+  {
+    readings = 0;
+    heartRateCount = 0;
+    spO2Count = 0;
+    temperatureCount = 0;
+    heartRateSum = 0;
+    spO2Sum = 0;
+    temperatureSum = 0;
+    systolic = 0;
+    diastolic = 0;
+    lastTimestamp = 0;
+    alerts = 0;
+    flags = 0;
+  }
+
+  void add(const VitalSample &sample, uint8_t alertFlags, uint8_t recordFlags = 0)
+  {
+    readings++;
+    if (sample.heartRate > 0)
+    {
+      heartRateSum += sample.heartRate;
+      heartRateCount++;
+    }
+    if (sample.spO2 > 0)
+    {
+      spO2Sum += sample.spO2;
+      spO2Count++;
+    }
+    if (sample.temperature > 0)
+    {
+      temperatureSum += sample.temperature;
+      temperatureCount++;
+    }
+    if (sample.systolicBP > 0)
+    {
+      systolic = sample.systolicBP;
+      diastolic = sample.diastolicBP;
+    }
+    lastTimestamp = sample.timestampMs;
+    alerts |= alertFlags;
+    flags |= recordFlags;
+  }
+
+  uint16_t readingCount() const { return readings; }
+  bool empty() const { return readings == 0; }
+
+  // Writes the period's record and starts the next period. Blood pressure
+  // carries over until the next cuff reading. False when nothing was added.
+  bool finish(uint32_t sequence, VitalRecord &record)
+  {
+    if (readings == 0)
+    {
+      return false;
+    }
+    record.sequence = sequence;
+    record.vitals.timestampMs = lastTimestamp;
+    record.vitals.heartRate = heartRateCount ? heartRateSum / heartRateCount : 0;
+    record.vitals.systolicBP = systolic;
+    record.vitals.diastolicBP = diastolic;
+    record.vitals.spO2 = spO2Count ? spO2Sum / spO2Count : 0;
+    record.vitals.temperature = temperatureCount ? temperatureSum / temperatureCount : 0;
+    record.alertFlags = alerts;
+    record.recordFlags = flags;
+
+    float keepSystolic = systolic;
+    float keepDiastolic = diastolic;
+    reset();
+    systolic = keepSystolic;
+    diastolic = keepDiastolic;
+    return true;
+  }
+
+private:
+  uint16_t readings;
+  uint16_t heartRateCount;
+  uint16_t spO2Count;
+  uint16_t temperatureCount;
+  float heartRateSum;
+  float spO2Sum;
+  float temperatureSum;
+  float systolic;
+  float diastolic;
+  uint32_t lastTimestamp;
+  uint8_t alerts;
+  uint8_t flags;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,243 @@
+/*
+ * VitalCare Rural - SpO2 Estimation
+ *
+ * Ratio-of-ratios pulse oximetry in fixed point. The IR channel is split
+ * into beats (trough to trough); for each beat the AC (peak - trough) and
+ * DC (mean) of both channels give
+ *
+ *   R = (AC_red / DC_red) / (AC_ir / DC_ir),   SpO2 = 110 - 25 R
+ *
+ * R is kept in Q16 and averaged over the last few accepted beats. Beats
+ * with implausible length, perfusion or R are rejected rather than
+ * averaged in. Integer-only per sample; one 64-bit divide per beat.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Max3010x.h"
+#include "RingBuffer.h"
+
+namespace vitalcare
+{
+
+class SpO2Estimator
+{
+public:
+  static const uint32_t R_ONE = 1u << 16;         // 1.0 in Q16
+  static const uint32_t R_MIN = R_ONE * 3 / 10;   // 0.3 -> ~102%
+  static const uint32_t R_MAX = R_ONE * 2;        // 2.0 -> 60%
+  static const uint32_t MIN_PERFUSION_PPM = 500;  // 0.05% AC/DC on IR
+  static const uint8_t AVERAGE_BEATS = 4;
+  static const uint8_t STALE_SECONDS = 5;         // no accepted beat for this long -> invalid
+
+  explicit SpO2Estimator(uint16_t sampleRateHz = Max3010x::SAMPLE_RATE_HZ)
+      : sampleRate(sampleRateHz)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    baselineQ7 = 0;
+    primed = false;
+    rising = false;
+    extreme = 0;
+    hysteresis = MIN_HYSTERESIS;
+    sampleIndex = 0;
+    beatStart = 0;
+    inBeat = false;
+    ratios.clear();
+    ratioSum = 0;
+    spo2x10 = 0;
+    beatLength = 0;
+    lastAcceptedIndex = 0;
+    accepted = 0;
+    rejected = 0;
+    resetWindow();
+  }
+
+  // Feeds one red/IR sample. Returns true when a beat closed and the
+  // estimate was updated.
+  bool update(const PpgSample &sample)
+  {
+    sampleIndex++;
+    accumulate(sample);
+
+    // Remove the slow DC drift from IR before looking for beats
+    if (!primed)
+    {
+      baselineQ7 = (int64_t)sample.ir << 7;
+      primed = true;
+    }
+    baselineQ7 += (int64_t)sample.ir - (baselineQ7 >> 7);
+    int32_t ac = (int32_t)sample.ir - (int32_t)(baselineQ7 >> 7);
+
+    if (rising)
+    {
+      if (ac > extreme)
+      {
+        extreme = ac;
+      }
+      else if (ac < extreme - hysteresis)
+      {
+        peak = extreme;
+        rising = false;
+        extreme = ac;
+      }
+      return false;
+    }
+
+    if (ac < extreme)
+    {
+      extreme = ac;
+      troughIndex = sampleIndex;
+      return false;
+    }
+    if (ac <= extreme + hysteresis)
+    {
+      return false;
+    }
+
+    // Trough confirmed: it ends the current beat and starts the next one
+    int32_t amplitude = peak - extreme;
+    rising = true;
+    extreme = ac;
+    hysteresis = amplitude / 4 > MIN_HYSTERESIS ? amplitude / 4 : MIN_HYSTERESIS;
+    return closeBeat();
+  }
+
+  bool valid() const
+  {
+    return !ratios.empty() && sampleIndex - lastAcceptedIndex <= (uint32_t)sampleRate * STALE_SECONDS;
+  }
+  // SpO2 in tenths of a percent (0 when no valid estimate)
+  uint16_t spO2x10() const { return valid() ? spo2x10 : 0; }
+  float spO2() const { return spO2x10() / 10.0f; }
+  // Averaged ratio R in Q16
+  uint32_t ratioQ16() const { return valid() ? ratioSum / ratios.size() : 0; }
+  // Length of the last accepted beat in samples (gives PPG heart rate)
+  uint32_t beatSamples() const { return beatLength; }
+  uint32_t acceptedBeats() const { return accepted; }
+  uint32_t rejectedBeats() const { return rejected; }
+
+private:
+  static const int32_t MIN_HYSTERESIS = 16;
+
+  struct Window
+  {
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+  };
+
+  void resetWindow()
+  {
+    red = {0xFFFFFFFFu, 0, 0};
+    ir = {0xFFFFFFFFu, 0, 0};
+    windowCount = 0;
+    peak = 0;
+    troughIndex = sampleIndex;
+  }
+
+  void accumulate(const PpgSample &sample)
+  {
+    add(red, sample.red);
+    add(ir, sample.ir);
+    windowCount++;
+  }
+
+  static void add(Window &window, uint32_t value)
+  {
+    if (value < window.min)
+      window.min = value;
+    if (value > window.max)
+      window.max = value;
+    window.sum += value;
+  }
+
+  bool closeBeat()
+  {
+    uint32_t length = troughIndex - beatStart;
+    bool complete = inBeat;
+    inBeat = true;
+    beatStart = troughIndex;
+
+    Window beatRed = red;
+    Window beatIr = ir;
+    uint32_t count = windowCount;
+    resetWindow();
+
+    // 30..200 BPM
+    if (!complete || count == 0 || length < sampleRate * 3 / 10 || length > sampleRate * 2)
+    {
+      rejected += complete ? 1 : 0;
+      return false;
+    }
+
+    uint32_t acRed = beatRed.max - beatRed.min;
+    uint32_t acIr = beatIr.max - beatIr.min;
+    uint32_t dcRed = (uint32_t)(beatRed.sum / count);
+    uint32_t dcIr = (uint32_t)(beatIr.sum / count);
+
+    if (acIr == 0 || dcRed == 0 || dcIr == 0 ||
+        (uint64_t)acIr * 1000000u / dcIr < MIN_PERFUSION_PPM)
+    {
+      rejected++;
+      return false;
+    }
+
+    uint64_t ratio = (((uint64_t)acRed * dcIr) << 16) / ((uint64_t)dcRed * acIr);
+    if (ratio < R_MIN || ratio > R_MAX)
+    {
+      rejected++;
+      return false;
+    }
+
+    if (ratios.full())
+    {
+      ratioSum -= ratios.oldest();
+    }
+    ratios.push((uint32_t)ratio);
+    ratioSum += (uint32_t)ratio;
+
+    // SpO2 = 110 - 25 R, in tenths
+    int32_t value = 1100 - (int32_t)((250u * (uint64_t)(ratioSum / ratios.size())) >> 16);
+    spo2x10 = (uint16_t)(value < 0 ? 0 : (value > 1000 ? 1000 : value));
+    beatLength = length;
+    lastAcceptedIndex = sampleIndex;
+    accepted++;
+    return true;
+  }
+
+  uint16_t sampleRate;
+
+  // Beat segmentation on IR
+  int64_t baselineQ7;
+  bool primed;
+  bool rising;
+  int32_t extreme;
+  int32_t peak;
+  int32_t hysteresis;
+  uint32_t sampleIndex;
+  uint32_t troughIndex;
+  uint32_t beatStart;
+  bool inBeat;
+
+  // Per-beat accumulation
+  Window red;
+  Window ir;
+  uint32_t windowCount;
+
+  // Result
+  RingBuffer<uint32_t, AVERAGE_BEATS> ratios;
+  uint32_t ratioSum;
+  uint16_t spo2x10;
+  uint32_t beatLength;
+  uint32_t lastAcceptedIndex;
+  uint32_t accepted;
+  uint32_t rejected;
+};
+
+} // namespace vitalcare
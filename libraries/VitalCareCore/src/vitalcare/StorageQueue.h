@@ -0,0 +1,453 @@
+/*
+ * VitalCare Rural - Storage Write Queue
+ *
+ * Hands file writes from loop() to a writer that owns the SD card, so a
+ * card that stalls for hundreds of milliseconds (FAT updates, its own
+ * garbage collection) holds up the writer and never the sampling. Each
+ * StorageChannel has two or three fixed buffers that cycle free, filling,
+ * queued, writing, free: the producer appends commands (open, write, seek,
+ * flush, close a file slot) to the filling buffer and submits it; the
+ * writer runs queued buffers in order through a StorageSink and releases
+ * them. A full buffer is submitted by the append that does not fit it.
+ *
+ * When no buffer has room append() fails, and the channel's overflow
+ * policy says what the producer does about it:
+ * - STORAGE_BLOCK: keeps the data and offers it again later. Vitals stay
+ *   in the history ring until the writer confirms them; nothing is lost
+ *   and the sampling never waits.
+ * - STORAGE_DROP: discards the data and leaves a marker. The waveform
+ *   recording skips the record and annotates the gap.
+ * Both are counted. A command never spans buffers; each buffer carries a
+ * tag (the producer's position in its source) back with the writer's
+ * result.
+ *
+ * A file opened with STORAGE_OPEN_SEGMENT is a segment: the sink gives it
+ * its full size up front (a spare it preallocated while idle, renamed) and
+ * writes go into it at a tracked logical end (StorageSegment), so appends
+ * never allocate clusters; closing it cuts it to that end. Sinks without
+ * preallocation create it empty instead.
+ *
+ * Not thread-safe: TaskStorageWriter serialises the producer and writer
+ * calls. The bytes of a buffer being written are only touched by the
+ * writer, so it needs no lock while writing. Producers that copy without
+ * the lock split append() into reserve(), the copy, and commit(); take()
+ * passes over a buffer until every copy into it is committed.
+ *
+ * Command layout in a buffer (little-endian):
+ *   0  u8   op (StorageOp)
+ *   1  u8   file slot
+ *   2  u16  payload length
+ *   4       payload: the path for opens, the bytes for writes, a u32 offset
+ *           for seeks, the u32 size then the path for segment opens,
+ *           nothing otherwise
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace vitalcare
+{
+
+enum StorageOp : uint8_t
+{
+  STORAGE_OPEN = 1,       // Open for appending, creating it if needed
+  STORAGE_CREATE,         // Open empty, truncating
+  STORAGE_WRITE,          // Write at the current position
+  STORAGE_WRITE_HEADER,   // Write only if the file is empty (a CSV header)
+  STORAGE_SEEK,
+  STORAGE_FLUSH,
+  STORAGE_CLOSE,
+  STORAGE_OPEN_SEGMENT,   // Open empty with its size preallocated
+};
+
+enum StorageOverflow : uint8_t
+{
+  STORAGE_BLOCK = 0,
+  STORAGE_DROP,
+};
+
+const size_t STORAGE_COMMAND_HEADER_SIZE = 4;
+const uint8_t STORAGE_MAX_BUFFERS = 3;
+const size_t STORAGE_MAX_PATH = 63;
+
+// The files behind the slots: SD card Files on the device, a simulated
+// card in vitalcare-sd-stall
+class StorageSink
+{
+public:
+  virtual ~StorageSink() {}
+
+  // (Re)mounts the medium; false when there is none
+  virtual bool mount() { return true; }
+  virtual bool open(uint8_t file, const char *path, bool truncate) = 0;
+  virtual uint32_t size(uint8_t file) = 0;
+  virtual bool write(uint8_t file, const uint8_t *data, size_t length) = 0;
+  virtual bool seek(uint8_t file, uint32_t offset) = 0;
+  virtual bool flush(uint8_t file) = 0;
+  virtual void close(uint8_t file) = 0;
+
+  // A segment of bytes preallocated; sinks that cannot preallocate create
+  // the file empty
+  virtual bool openSegment(uint8_t file, const char *path, uint32_t bytes)
+  {
+    (void)bytes;
+    return open(file, path, true);
+  }
+
+  // Called by the writer when nothing is queued, to get ahead (preallocate
+  // the next segment). True if it did something, so the writer checks the
+  // queues and calls again; each call should be one bounded step.
+  virtual bool idle() { return false; }
+};
+
+// Where a segment's data ends, against the preallocated size the file
+// reports. Writes past the size still work and grow the file, which is
+// what the segment is sized to avoid; they are counted as overruns.
+struct StorageSegment
+{
+  uint32_t bytes;    // Preallocated; 0 when the slot is not a segment
+  uint32_t position; // Of the next write
+  uint32_t end;      // Logical end: the size the file is cut to on close
+  uint32_t overruns; // Writes that went past bytes, over every segment
+
+  void begin(uint32_t size)
+  {
+    bytes = size;
+    position = 0;
+    end = 0;
+  }
+
+  void wrote(size_t length)
+  {
+    if (position + length > bytes)
+      overruns++;
+    position += (uint32_t)length;
+    if (position > end)
+      end = position;
+  }
+
+  // Only within the data written
+  bool seek(uint32_t offset)
+  {
+    if (offset > end)
+      return false;
+    position = offset;
+    return true;
+  }
+};
+
+// A STORAGE_OPEN_SEGMENT payload; its length, or 0 if out is too small
+inline size_t encodeStorageSegment(uint8_t *out, size_t capacity, uint32_t bytes, const char *path)
+{
+  size_t pathLength = strlen(path);
+  if (pathLength > STORAGE_MAX_PATH || 4 + pathLength > capacity)
+    return 0;
+  out[0] = (uint8_t)bytes;
+  out[1] = (uint8_t)(bytes >> 8);
+  out[2] = (uint8_t)(bytes >> 16);
+  out[3] = (uint8_t)(bytes >> 24);
+  memcpy(out + 4, path, pathLength);
+  return 4 + pathLength;
+}
+
+// Runs a buffer's commands in order. False if any failed; the rest still
+// run, so a failed write is still followed by its close.
+inline bool runStorageCommands(StorageSink &sink, const uint8_t *data, size_t length)
+{
+  bool ok = true;
+  size_t at = 0;
+  while (at + STORAGE_COMMAND_HEADER_SIZE <= length)
+  {
+    uint8_t op = data[at];
+    uint8_t file = data[at + 1];
+    size_t bytes = data[at + 2] | (data[at + 3] << 8);
+    const uint8_t *payload = data + at + STORAGE_COMMAND_HEADER_SIZE;
+    at += STORAGE_COMMAND_HEADER_SIZE + bytes;
+    if (at > length)
+      return false;
+    switch (op)
+    {
+    case STORAGE_OPEN:
+    case STORAGE_CREATE:
+    case STORAGE_OPEN_SEGMENT:
+    {
+      uint32_t size = 0;
+      if (op == STORAGE_OPEN_SEGMENT)
+      {
+        if (bytes < 4)
+        {
+          ok = false;
+          break;
+        }
+        size = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+        payload += 4;
+        bytes -= 4;
+      }
+      char path[STORAGE_MAX_PATH + 1];
+      size_t pathLength = bytes < STORAGE_MAX_PATH ? bytes : STORAGE_MAX_PATH;
+      memcpy(path, payload, pathLength);
+      path[pathLength] = '\0';
+      if (op == STORAGE_OPEN_SEGMENT)
+        ok = sink.openSegment(file, path, size) && ok;
+      else
+        ok = sink.open(file, path, op == STORAGE_CREATE) && ok;
+      break;
+    }
+    case STORAGE_WRITE:
+      ok = sink.write(file, payload, bytes) && ok;
+      break;
+    case STORAGE_WRITE_HEADER:
+      ok = (sink.size(file) > 0 || sink.write(file, payload, bytes)) && ok;
+      break;
+    case STORAGE_SEEK:
+      ok = bytes == 4 &&
+           sink.seek(file, payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24)) && ok;
+      break;
+    case STORAGE_FLUSH:
+      ok = sink.flush(file) && ok;
+      break;
+    case STORAGE_CLOSE:
+      sink.close(file);
+      break;
+    default:
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+struct StorageChannelStats
+{
+  uint32_t submitted;     // Buffers queued for the writer
+  uint32_t written;       // Buffers the writer finished
+  uint32_t failed;        // ...with a failed command
+  uint32_t overflows;     // Appends refused for want of a buffer
+  uint64_t overflowBytes; // Their payload
+  uint8_t maxQueued;      // Most buffers queued or writing at once
+};
+
+class StorageChannel
+{
+public:
+  StorageChannel() : storage(nullptr), bufferBytes(0), buffers(0), overflow(STORAGE_BLOCK) { reset(); }
+
+  // storage holds buffers * bytes; buffers is 2 (ping-pong) or 3
+  void begin(uint8_t *buffer, size_t bytes, uint8_t count, StorageOverflow policy)
+  {
+    storage = buffer;
+    bufferBytes = bytes;
+    buffers = count < STORAGE_MAX_BUFFERS ? count : STORAGE_MAX_BUFFERS;
+    overflow = policy;
+    reset();
+  }
+
+  StorageOverflow policy() const { return overflow; }
+
+  // Whether a command with length payload bytes would be taken now
+  bool canAppend(size_t length) const
+  {
+    size_t need = STORAGE_COMMAND_HEADER_SIZE + length;
+    if (need > bufferBytes)
+      return false;
+    if (filling != NONE && used[filling] + need <= bufferBytes)
+      return true;
+    return freeBuffer() != NONE;
+  }
+
+  // canAppend(), counted as an overflow when false: for producers that
+  // drop by policy before appending, as EdfWriter::skipRecord() does
+  bool offer(size_t length)
+  {
+    if (canAppend(length))
+      return true;
+    countOverflow(length);
+    return false;
+  }
+
+  // Payload bytes that fit before the channel overflows, if they come as
+  // few commands; a command that does not fit the filling buffer's rest
+  // starts the next buffer
+  size_t room() const
+  {
+    size_t bytes = filling != NONE ? bufferBytes - used[filling] : 0;
+    for (uint8_t i = 0; i < buffers; i++)
+      bytes += state[i] == FREE ? bufferBytes : 0;
+    return bytes;
+  }
+
+  // Appends a command, submitting the filling buffer and starting a free
+  // one when it is full. tag, if not 0, becomes the buffer's tag. False
+  // when no buffer has room (counted as an overflow).
+  bool append(uint8_t op, uint8_t file, const void *payload, size_t length, uint32_t tag = 0)
+  {
+    uint8_t buffer;
+    uint8_t *out = reserve(op, file, length, tag, buffer);
+    if (!out)
+      return false;
+    if (length)
+      memcpy(out, payload, length);
+    commit(buffer);
+    return true;
+  }
+
+  // append() without the copy: writes the command header, claims length
+  // payload bytes and returns where they go (nullptr as append() fails).
+  // The caller fills them and hands buffer to commit(); until then the
+  // writer does not take that buffer, submitted or not.
+  uint8_t *reserve(uint8_t op, uint8_t file, size_t length, uint32_t tag, uint8_t &buffer)
+  {
+    size_t need = STORAGE_COMMAND_HEADER_SIZE + length;
+    if (need > bufferBytes || length > 0xFFFF)
+    {
+      countOverflow(length);
+      return nullptr;
+    }
+    if (filling == NONE || used[filling] + need > bufferBytes)
+    {
+      uint8_t next = freeBuffer();
+      if (next == NONE)
+      {
+        countOverflow(length);
+        return nullptr;
+      }
+      submit();
+      filling = next;
+      state[next] = FILLING;
+      used[next] = 0;
+      tags[next] = 0;
+    }
+    uint8_t *out = storage + filling * bufferBytes + used[filling];
+    out[0] = op;
+    out[1] = file;
+    out[2] = (uint8_t)length;
+    out[3] = (uint8_t)(length >> 8);
+    used[filling] += need;
+    if (tag)
+      tags[filling] = tag;
+    copying[filling]++;
+    buffer = filling;
+    return out + STORAGE_COMMAND_HEADER_SIZE;
+  }
+
+  // The reserved bytes are filled. True when that makes buffer the next
+  // one the writer can take.
+  bool commit(uint8_t buffer)
+  {
+    if (buffer >= buffers || copying[buffer] == 0)
+      return false;
+    copying[buffer]--;
+    return copying[buffer] == 0 && count > 0 && order[head] == buffer;
+  }
+
+  // Queues the filling buffer for the writer, if anything is in it
+  void submit()
+  {
+    if (filling == NONE)
+      return;
+    if (used[filling] == 0)
+    {
+      state[filling] = FREE;
+      filling = NONE;
+      return;
+    }
+    state[filling] = QUEUED;
+    order[(head + count) % STORAGE_MAX_BUFFERS] = filling;
+    count++;
+    filling = NONE;
+    totals.submitted++;
+    if (count > totals.maxQueued)
+      totals.maxQueued = count;
+  }
+
+  // Writer side: the oldest queued buffer, now being written, or nullptr
+  // (also while a copy into it is not committed). Hand it back with
+  // release() once written.
+  const uint8_t *take(size_t &length, uint32_t &tag)
+  {
+    if (count == 0 || copying[order[head]] > 0)
+      return nullptr;
+    uint8_t index = order[head];
+    state[index] = WRITING;
+    length = used[index];
+    tag = tags[index];
+    return storage + index * bufferBytes;
+  }
+
+  void release(bool ok)
+  {
+    if (count == 0)
+      return;
+    state[order[head]] = FREE;
+    head = (head + 1) % STORAGE_MAX_BUFFERS;
+    count--;
+    totals.written++;
+    totals.failed += ok ? 0 : 1;
+  }
+
+  // Buffers queued or being written
+  uint8_t queued() const { return count; }
+  // Nothing waiting, filling or being written
+  bool idle() const { return count == 0 && (filling == NONE || used[filling] == 0); }
+  const StorageChannelStats &stats() const { return totals; }
+  size_t capacity() const { return (size_t)buffers * bufferBytes; }
+
+private:
+  static const uint8_t NONE = 0xFF;
+  enum BufferState : uint8_t
+  {
+    FREE = 0,
+    FILLING,
+    QUEUED,
+    WRITING,
+  };
+
+  void reset()
+  {
+    for (uint8_t i = 0; i < STORAGE_MAX_BUFFERS; i++)
+    {
+      state[i] = FREE;
+      used[i] = 0;
+      tags[i] = 0;
+      order[i] = 0;
+      copying[i] = 0;
+    }
+    filling = NONE;
+    head = 0;
+    count = 0;
+    totals = {0, 0, 0, 0, 0, 0};
+  }
+
+  uint8_t freeBuffer() const
+  {
+    for (uint8_t i = 0; i < buffers; i++)
+      if (state[i] == FREE)
+        return i;
+    return NONE;
+  }
+
+  void countOverflow(size_t length)
+  {
+    totals.overflows++;
+    totals.overflowBytes += length;
+  }
+
+  uint8_t *storage;
+  size_t bufferBytes;
+  uint8_t buffers;
+  StorageOverflow overflow;
+
+  uint8_t state[STORAGE_MAX_BUFFERS];
+  size_t used[STORAGE_MAX_BUFFERS];
+  uint32_t tags[STORAGE_MAX_BUFFERS];
+  uint8_t order[STORAGE_MAX_BUFFERS]; // Queued buffers, oldest first
+  uint8_t copying[STORAGE_MAX_BUFFERS]; // Reserved, not yet committed
+  uint8_t filling;
+  uint8_t head;
+  uint8_t count;
+  StorageChannelStats totals;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,173 @@
+/*
+ * VitalCare Rural - Tiered Storage
+ *
+ * Where the device keeps its records when the SD card is out. SdCardHealth
+ * decides whether the card is in service: a card that fails several writes
+ * in a row is taken out, and while it is out the card slot is probed with
+ * backoff, so a reinserted card is used again without a reboot. Meanwhile
+ * records go to a LittleFS partition in internal flash; once the card is
+ * back they are moved to it in the background.
+ *
+ * Internal flash survives about 100k erases per block, so FlashWear
+ * estimates what the fallback writes cost it. LittleFS is copy-on-write:
+ * appending to a file whose last block is partly full copies that block to
+ * a freshly erased one, and every write ends with a metadata commit of one
+ * program unit. Writes of whole blocks cost about one erase per block;
+ * small appends cost a block each. LittleFS levels wear over the whole
+ * partition, so erases per block is the average wear.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+enum StorageTier : uint8_t
+{
+  STORAGE_TIER_NONE = 0, // Nowhere to write; records wait in RAM
+  STORAGE_TIER_SD,
+  STORAGE_TIER_FLASH,
+};
+
+inline const char *storageTierName(uint8_t tier)
+{
+  static const char *const NAMES[] = {"none", "sd", "flash"};
+  return tier <= STORAGE_TIER_FLASH ? NAMES[tier] : "unknown";
+}
+
+class SdCardHealth
+{
+public:
+  static const uint8_t FAILURES_TO_REMOVE = 3; // Consecutive failed writes
+  static const uint32_t FIRST_PROBE_MS = 1000;
+  static const uint32_t MAX_PROBE_MS = 30000;
+
+  SdCardHealth()
+      : inService(false), failures(0), probeIntervalMs(FIRST_PROBE_MS), nextProbeMs(0), insertedCount(0),
+        removedCount(0), failedWrites(0)
+  {
+  }
+
+  // Result of the mount at boot
+  void begin(bool mounted, uint32_t nowMs)
+  {
+    inService = mounted;
+    failures = 0;
+    probeIntervalMs = FIRST_PROBE_MS;
+    nextProbeMs = nowMs + probeIntervalMs;
+  }
+
+  bool ready() const { return inService; }
+
+  // A write to the card finished; returns true if this took the card out
+  // of service
+  bool onWrite(bool ok, uint32_t nowMs)
+  {
+    if (ok)
+    {
+      failures = 0;
+      return false;
+    }
+    failedWrites++;
+    if (!inService || ++failures < FAILURES_TO_REMOVE)
+      return false;
+    inService = false;
+    removedCount++;
+    probeIntervalMs = FIRST_PROBE_MS;
+    nextProbeMs = nowMs + probeIntervalMs;
+    return true;
+  }
+
+  // Time to try mounting the card again
+  bool probeDue(uint32_t nowMs) const { return !inService && (int32_t)(nowMs - nextProbeMs) >= 0; }
+
+  // Result of a probe; returns true if the card is back in service.
+  // Failed probes back off, doubling up to MAX_PROBE_MS.
+  bool onProbe(bool mounted, uint32_t nowMs)
+  {
+    if (mounted)
+    {
+      inService = true;
+      failures = 0;
+      insertedCount++;
+      return true;
+    }
+    probeIntervalMs = probeIntervalMs * 2 > MAX_PROBE_MS ? MAX_PROBE_MS : probeIntervalMs * 2;
+    nextProbeMs = nowMs + probeIntervalMs;
+    return false;
+  }
+
+  uint32_t insertions() const { return insertedCount; }
+  uint32_t removals() const { return removedCount; }
+  uint32_t writeFailures() const { return failedWrites; }
+
+private:
+  bool inService;
+  uint8_t failures;
+  uint32_t probeIntervalMs;
+  uint32_t nextProbeMs;
+  uint32_t insertedCount;
+  uint32_t removedCount;
+  uint32_t failedWrites;
+};
+
+// Lifetime totals, kept across reboots by the firmware
+struct FlashWearCounters
+{
+  uint64_t logicalBytes;    // Asked to be written
+  uint64_t programmedBytes; // Estimated written to flash, data and metadata
+  uint32_t erases;          // Estimated block erases
+  uint32_t commits;         // Writes ending in a metadata commit
+};
+
+class FlashWear
+{
+public:
+  FlashWear() : blockSize(4096), programSize(256), blocks(0), totals{0, 0, 0, 0} {}
+
+  void begin(uint32_t blockBytes, uint32_t programBytes, uint32_t blockCount)
+  {
+    blockSize = blockBytes;
+    programSize = programBytes;
+    blocks = blockCount;
+  }
+
+  void restore(const FlashWearCounters &counters) { totals = counters; }
+  const FlashWearCounters &counters() const { return totals; }
+
+  // bytes were appended to a file of fileSize bytes and the file closed
+  void onAppend(uint32_t fileSize, size_t bytes)
+  {
+    if (bytes == 0)
+      return;
+    uint32_t tail = fileSize % blockSize; // Copied to the new block
+    uint64_t rewritten = (uint64_t)tail + bytes;
+    totals.logicalBytes += bytes;
+    totals.programmedBytes += roundUp(rewritten, programSize) + programSize;
+    totals.erases += (uint32_t)((rewritten + blockSize - 1) / blockSize);
+    // A metadata block is erased each time its commits fill it
+    if (++totals.commits % (blockSize / programSize) == 0)
+      totals.erases++;
+  }
+
+  // Flash bytes programmed per byte asked for
+  float writeAmplification() const
+  {
+    return totals.logicalBytes ? (float)totals.programmedBytes / totals.logicalBytes : 0;
+  }
+
+  float erasesPerBlock() const { return blocks ? (float)totals.erases / blocks : 0; }
+
+private:
+  static uint64_t roundUp(uint64_t bytes, uint32_t unit) { return (bytes + unit - 1) / unit * unit; }
+
+  uint32_t blockSize;
+  uint32_t programSize;
+  uint32_t blocks;
+  FlashWearCounters totals;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,145 @@
+/*
+ * VitalCare Rural - Task-Driven Shared I2C Bus
+ *
+ * One FreeRTOS task owns Wire and works through an I2cScheduler queue, so
+ * every sensor on the bus submits non-blocking jobs instead of serialising
+ * blocking transfers inside loop(). Finished jobs are handed back and their
+ * callbacks run from dispatchCompletions(), called from loop(): drivers keep
+ * running in a single context and need no locking of their own.
+ *
+ * Once begin() has been called nothing else may touch Wire directly.
+ *
+ * ESP32 Arduino only: include explicitly, it is not part of VitalCareCore.h.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "I2cBus.h"
+#include "I2cScheduler.h"
+#include "WireI2cBus.h"
+
+namespace vitalcare
+{
+
+class TaskI2cBus : public I2cBus
+{
+public:
+  explicit TaskI2cBus(TwoWire &wire) : wire(wire), task(nullptr)
+  {
+    lock = portMUX_INITIALIZER_UNLOCKED;
+  }
+
+  // Starts the bus task. Wire.begin() must already have been called.
+  // Without the task every submit() is refused.
+  bool begin(uint32_t clockHz = 400000, BaseType_t core = 0, UBaseType_t taskPriority = 3)
+  {
+    wire.setClock(clockHz);
+    scheduler.reset(micros());
+    if (xTaskCreatePinnedToCore(&TaskI2cBus::taskEntry, "i2c-bus", 3072, this, taskPriority, &task, core) != pdPASS)
+    {
+      task = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  // Refused when no task runs: nothing would ever execute the job
+  bool submit(const I2cTransaction &transaction) override
+  {
+    if (!task)
+    {
+      return false;
+    }
+    portENTER_CRITICAL(&lock);
+    bool accepted = scheduler.enqueue(transaction, micros());
+    portEXIT_CRITICAL(&lock);
+    if (accepted)
+    {
+      xTaskNotifyGive(task);
+    }
+    return accepted;
+  }
+
+  // Runs the callbacks of finished jobs. Call from loop(). Returns the
+  // number of callbacks run.
+  size_t dispatchCompletions()
+  {
+    size_t dispatched = 0;
+    I2cJob job;
+    while (true)
+    {
+      portENTER_CRITICAL(&lock);
+      bool taken = scheduler.takeCompletion(job);
+      portEXIT_CRITICAL(&lock);
+      if (!taken)
+      {
+        return dispatched;
+      }
+      if (job.transaction.callback)
+      {
+        job.transaction.callback(job.transaction.context, job.transaction, job.status);
+      }
+      dispatched++;
+    }
+  }
+
+  I2cBusStats statistics()
+  {
+    portENTER_CRITICAL(&lock);
+    I2cBusStats copy = scheduler.statistics();
+    portEXIT_CRITICAL(&lock);
+    return copy;
+  }
+
+  uint16_t utilizationPermille()
+  {
+    portENTER_CRITICAL(&lock);
+    uint16_t value = scheduler.utilizationPermille(micros());
+    portEXIT_CRITICAL(&lock);
+    return value;
+  }
+
+private:
+  static void taskEntry(void *parameter)
+  {
+    static_cast<TaskI2cBus *>(parameter)->run();
+  }
+
+  void run()
+  {
+    while (true)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+      I2cJob job;
+      while (take(job))
+      {
+        uint32_t start = micros();
+        I2cStatus status = WireI2cBus::execute(wire, job.transaction);
+        uint32_t end = micros();
+
+        portENTER_CRITICAL(&lock);
+        scheduler.finish(job, status, start, end);
+        portEXIT_CRITICAL(&lock);
+      }
+    }
+  }
+
+  bool take(I2cJob &job)
+  {
+    portENTER_CRITICAL(&lock);
+    bool taken = scheduler.next(job);
+    portEXIT_CRITICAL(&lock);
+    return taken;
+  }
+
+  TwoWire &wire;
+  I2cScheduler scheduler;
+  portMUX_TYPE lock;
+  TaskHandle_t task;
+};
+
+} // namespace vitalcare
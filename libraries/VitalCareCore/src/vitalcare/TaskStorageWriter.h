@@ -0,0 +1,299 @@
+/*
+ * VitalCare Rural - Task-Driven Storage Writer
+ *
+ * One FreeRTOS task owns the SD card and drains StorageChannels through a
+ * StorageSink, so card stalls land on it and loop() only copies bytes into
+ * buffers. Producer calls take a spinlock for the buffer bookkeeping only:
+ * append() reserves its command's bytes under it and copies the payload
+ * (up to a whole buffer) after letting go, then commits. No lock is held
+ * while a buffer is written. Each written buffer, and each
+ * mount asked for with requestMount(), comes back as a StorageCompletion
+ * taken in loop(), as TaskI2cBus hands back finished jobs. Channels are
+ * drained lowest index first; with nothing queued the task gives the sink
+ * its idle steps (preallocating the next segment, retention) one at a
+ * time, looking at the queues between them. An idle task still wakes every
+ * STORAGE_IDLE_POLL_MS, so budgeted idle work goes on with nothing written.
+ *
+ * Once begin() has been called nothing else may touch the card directly.
+ *
+ * ESP32 Arduino only: include explicitly, it is not part of VitalCareCore.h.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "Latency.h"
+#include "StorageQueue.h"
+
+namespace vitalcare
+{
+
+struct StorageCompletion
+{
+  uint8_t channel; // STORAGE_MOUNT for a mount
+  bool ok;         // Every command succeeded, or the card mounted
+  uint32_t tag;
+};
+
+const uint8_t STORAGE_MOUNT = 0xFF;
+const uint32_t STORAGE_IDLE_POLL_MS = 100;
+
+template <uint8_t CHANNELS>
+class TaskStorageWriter
+{
+public:
+  // Every buffer plus a mount can be outstanding at once
+  static const uint8_t COMPLETIONS = CHANNELS * STORAGE_MAX_BUFFERS + 1;
+
+  explicit TaskStorageWriter(StorageSink &sink)
+      : sink(sink), task(nullptr), mountRequested(false), completionFirst(0), completionCount(0),
+        completionsLost(0)
+  {
+    lock = portMUX_INITIALIZER_UNLOCKED;
+  }
+
+  // Sets up a channel; before begin()
+  void channel(uint8_t index, uint8_t *storage, size_t bufferBytes, uint8_t buffers, StorageOverflow policy)
+  {
+    channels[index].begin(storage, bufferBytes, buffers, policy);
+  }
+
+  // Starts the writer task; the card must already be mounted (or not).
+  // The task starts with the sink's idle work.
+  bool begin(BaseType_t core = 0, UBaseType_t taskPriority = 2)
+  {
+    if (xTaskCreatePinnedToCore(&TaskStorageWriter::taskEntry, "sd-writer", 4096, this, taskPriority, &task,
+                                core) != pdPASS)
+    {
+      return false;
+    }
+    wake();
+    return true;
+  }
+
+  bool canAppend(uint8_t index, size_t length)
+  {
+    portENTER_CRITICAL(&lock);
+    bool fits = channels[index].canAppend(length);
+    portEXIT_CRITICAL(&lock);
+    return fits;
+  }
+
+  bool offer(uint8_t index, size_t length)
+  {
+    portENTER_CRITICAL(&lock);
+    bool fits = channels[index].offer(length);
+    portEXIT_CRITICAL(&lock);
+    return fits;
+  }
+
+  size_t room(uint8_t index)
+  {
+    portENTER_CRITICAL(&lock);
+    size_t bytes = channels[index].room();
+    portEXIT_CRITICAL(&lock);
+    return bytes;
+  }
+
+  bool append(uint8_t index, uint8_t op, uint8_t file, const void *payload, size_t length, uint32_t tag = 0)
+  {
+    uint8_t buffer;
+    portENTER_CRITICAL(&lock);
+    uint8_t before = channels[index].queued();
+    uint8_t *out = channels[index].reserve(op, file, length, tag, buffer);
+    bool submitted = channels[index].queued() != before;
+    portEXIT_CRITICAL(&lock);
+    if (!out)
+    {
+      return false;
+    }
+
+    if (length)
+    {
+      memcpy(out, payload, length);
+    }
+    portENTER_CRITICAL(&lock);
+    bool ready = channels[index].commit(buffer);
+    portEXIT_CRITICAL(&lock);
+    if (submitted || ready)
+    {
+      wake();
+    }
+    return true;
+  }
+
+  void submit(uint8_t index)
+  {
+    portENTER_CRITICAL(&lock);
+    channels[index].submit();
+    portEXIT_CRITICAL(&lock);
+    wake();
+  }
+
+  // Asks the task to (re)mount the card; the result comes back as a
+  // STORAGE_MOUNT completion
+  void requestMount()
+  {
+    portENTER_CRITICAL(&lock);
+    mountRequested = true;
+    portEXIT_CRITICAL(&lock);
+    wake();
+  }
+
+  // Call from loop(); false when none are waiting
+  bool takeCompletion(StorageCompletion &completion)
+  {
+    portENTER_CRITICAL(&lock);
+    bool taken = completionCount > 0;
+    if (taken)
+    {
+      completion = completions[completionFirst];
+      completionFirst = (completionFirst + 1) % COMPLETIONS;
+      completionCount--;
+    }
+    portEXIT_CRITICAL(&lock);
+    return taken;
+  }
+
+  StorageChannelStats statistics(uint8_t index)
+  {
+    portENTER_CRITICAL(&lock);
+    StorageChannelStats copy = channels[index].stats();
+    portEXIT_CRITICAL(&lock);
+    return copy;
+  }
+
+  uint8_t queued(uint8_t index)
+  {
+    portENTER_CRITICAL(&lock);
+    uint8_t count = channels[index].queued();
+    portEXIT_CRITICAL(&lock);
+    return count;
+  }
+
+  // Time to write one buffer, card stalls included
+  LatencyHistogram writeLatency()
+  {
+    portENTER_CRITICAL(&lock);
+    LatencyHistogram copy = latency;
+    portEXIT_CRITICAL(&lock);
+    return copy;
+  }
+
+  // ...of one channel's buffers
+  LatencyHistogram writeLatency(uint8_t index)
+  {
+    portENTER_CRITICAL(&lock);
+    LatencyHistogram copy = channelLatency[index];
+    portEXIT_CRITICAL(&lock);
+    return copy;
+  }
+
+  uint32_t lostCompletions()
+  {
+    portENTER_CRITICAL(&lock);
+    uint32_t lost = completionsLost;
+    portEXIT_CRITICAL(&lock);
+    return lost;
+  }
+
+private:
+  static void taskEntry(void *parameter)
+  {
+    static_cast<TaskStorageWriter *>(parameter)->run();
+  }
+
+  void wake()
+  {
+    if (task)
+    {
+      xTaskNotifyGive(task);
+    }
+  }
+
+  void run()
+  {
+    while (true)
+    {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORAGE_IDLE_POLL_MS));
+
+      bool worked = true;
+      while (worked)
+      {
+        worked = false;
+        portENTER_CRITICAL(&lock);
+        bool mount = mountRequested;
+        mountRequested = false;
+        portEXIT_CRITICAL(&lock);
+        if (mount)
+        {
+          bool mounted = sink.mount();
+          portENTER_CRITICAL(&lock);
+          complete({STORAGE_MOUNT, mounted, 0});
+          portEXIT_CRITICAL(&lock);
+          worked = true;
+        }
+
+        for (uint8_t index = 0; index < CHANNELS; index++)
+        {
+          size_t length = 0;
+          uint32_t tag = 0;
+          portENTER_CRITICAL(&lock);
+          const uint8_t *data = channels[index].take(length, tag);
+          portEXIT_CRITICAL(&lock);
+          if (!data)
+          {
+            continue;
+          }
+          uint32_t start = micros();
+          bool ok = runStorageCommands(sink, data, length);
+          uint32_t elapsed = micros() - start;
+
+          portENTER_CRITICAL(&lock);
+          channels[index].release(ok);
+          latency.record(elapsed);
+          channelLatency[index].record(elapsed);
+          complete({index, ok, tag});
+          portEXIT_CRITICAL(&lock);
+          worked = true;
+          break; // Lower channels first again
+        }
+
+        if (!worked)
+        {
+          worked = sink.idle();
+        }
+      }
+    }
+  }
+
+  // Under the lock. Only overflows if loop() stops taking completions; the
+  // oldest is dropped then.
+  void complete(const StorageCompletion &completion)
+  {
+    if (completionCount == COMPLETIONS)
+    {
+      completionFirst = (completionFirst + 1) % COMPLETIONS;
+      completionCount--;
+      completionsLost++;
+    }
+    completions[(completionFirst + completionCount) % COMPLETIONS] = completion;
+    completionCount++;
+  }
+
+  StorageSink &sink;
+  StorageChannel channels[CHANNELS];
+  LatencyHistogram latency;
+  LatencyHistogram channelLatency[CHANNELS];
+  portMUX_TYPE lock;
+  TaskHandle_t task;
+  bool mountRequested;
+
+  StorageCompletion completions[COMPLETIONS];
+  uint8_t completionFirst;
+  uint8_t completionCount;
+  uint32_t completionsLost;
+};
+
+} // namespace vitalcare
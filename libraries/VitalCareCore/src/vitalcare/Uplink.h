@@ -0,0 +1,256 @@
+/*
+ * VitalCare Rural - Uplink Batches
+ *
+ * Devices upload records to the district gateway in batches: one header
+ * followed by a run of fixed-size VitalRecords or PatientRecords. The same
+ * bytes travel as an HTTP POST body or an MQTT PUBLISH payload, and the
+ * gateway answers every batch with one ack. Little-endian throughout.
+ *
+ * Batch header (UPLINK_HEADER_SIZE bytes):
+ *   0  u32  magic "VCB1"
+ *   4  u8   version
+ *   5  u8   record type (UplinkRecordType)
+ *   6  u16  record count
+ *   8  u64  device id
+ *   16 u32  batch sequence (per device, monotonic)
+ *   20 u32  payload length (count x record size)
+ *   24 u32  CRC-32 of the payload
+ *   28 u32  CRC-32 of bytes 0..27
+ *
+ * Ack (UPLINK_ACK_SIZE bytes):
+ *   0  u32  magic "VCA1"
+ *   4  u8   status (UplinkStatus)
+ *   5  u8   record type
+ *   6  u16  records accepted (new)
+ *   8  u64  device id
+ *   16 u32  batch sequence
+ *   20 u16  duplicates (already stored; safe to drop locally)
+ *   22 u16  rejected (failed validation)
+ *
+ * A device may mark every record of an acked batch as uploaded whatever
+ * the split between accepted and duplicate; rejected records are corrupt
+ * and retrying them will not help.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Checksum.h"
+#include "Encoding.h"
+#include "Records.h"
+
+namespace vitalcare
+{
+
+const uint32_t UPLINK_BATCH_MAGIC = 0x31424356; // "VCB1"
+const uint32_t UPLINK_ACK_MAGIC = 0x31414356;   // "VCA1"
+const uint8_t UPLINK_VERSION = 1;
+const size_t UPLINK_HEADER_SIZE = 32;
+const size_t UPLINK_ACK_SIZE = 24;
+const uint16_t UPLINK_MAX_RECORDS = 1024;
+
+enum UplinkRecordType : uint8_t
+{
+  UPLINK_VITAL_RECORDS = 1,
+  UPLINK_PATIENT_RECORDS = 2,
+};
+
+enum UplinkStatus : uint8_t
+{
+  UPLINK_OK = 0,          // Stored (possibly partly duplicates or rejected)
+  UPLINK_BAD_HEADER = 1,  // Magic, version, header CRC or record type
+  UPLINK_BAD_PAYLOAD = 2, // Length or payload CRC mismatch: resend
+  UPLINK_BUSY = 3,        // Gateway overloaded: retry later
+};
+
+struct UplinkBatchHeader
+{
+  uint8_t recordType;
+  uint16_t recordCount;
+  uint64_t deviceId;
+  uint32_t batchSequence;
+  uint32_t payloadLength;
+  uint32_t payloadCrc;
+};
+
+struct UplinkAck
+{
+  uint8_t status;
+  uint8_t recordType;
+  uint16_t accepted;
+  uint64_t deviceId;
+  uint32_t batchSequence;
+  uint16_t duplicates;
+  uint16_t rejected;
+};
+
+inline size_t uplinkRecordSize(uint8_t recordType)
+{
+  switch (recordType)
+  {
+  case UPLINK_VITAL_RECORDS:
+    return VITAL_RECORD_SIZE;
+  case UPLINK_PATIENT_RECORDS:
+    return PATIENT_RECORD_SIZE;
+  default:
+    return 0;
+  }
+}
+
+// Encodes into out, which must hold UPLINK_HEADER_SIZE bytes.
+inline size_t encodeUplinkHeader(const UplinkBatchHeader &header, uint8_t *out)
+{
+  BinaryWriter writer(out, UPLINK_HEADER_SIZE);
+  writer.u32(UPLINK_BATCH_MAGIC)
+      .u8(UPLINK_VERSION)
+      .u8(header.recordType)
+      .u16(header.recordCount)
+      .u64(header.deviceId)
+      .u32(header.batchSequence)
+      .u32(header.payloadLength)
+      .u32(header.payloadCrc);
+  writer.u32(crc32(out, UPLINK_HEADER_SIZE - 4));
+  return writer.size();
+}
+
+// Checks magic, version, header CRC, record type and that the payload
+// length matches the record count. Does not check the payload CRC.
+inline bool decodeUplinkHeader(const uint8_t *in, size_t length, UplinkBatchHeader &header)
+{
+  if (length < UPLINK_HEADER_SIZE)
+  {
+    return false;
+  }
+  BinaryReader reader(in, UPLINK_HEADER_SIZE);
+  if (reader.u32() != UPLINK_BATCH_MAGIC || reader.u8() != UPLINK_VERSION)
+  {
+    return false;
+  }
+  header.recordType = reader.u8();
+  header.recordCount = reader.u16();
+  header.deviceId = reader.u64();
+  header.batchSequence = reader.u32();
+  header.payloadLength = reader.u32();
+  header.payloadCrc = reader.u32();
+  uint32_t headerCrc = reader.u32();
+
+  size_t recordSize = uplinkRecordSize(header.recordType);
+  return reader.ok() && headerCrc == crc32(in, UPLINK_HEADER_SIZE - 4) && recordSize != 0 &&
+         header.recordCount <= UPLINK_MAX_RECORDS && header.payloadLength == header.recordCount * recordSize;
+}
+
+// Encodes into out, which must hold UPLINK_ACK_SIZE bytes.
+inline size_t encodeUplinkAck(const UplinkAck &ack, uint8_t *out)
+{
+  BinaryWriter writer(out, UPLINK_ACK_SIZE);
+  writer.u32(UPLINK_ACK_MAGIC)
+      .u8(ack.status)
+      .u8(ack.recordType)
+      .u16(ack.accepted)
+      .u64(ack.deviceId)
+      .u32(ack.batchSequence)
+      .u16(ack.duplicates)
+      .u16(ack.rejected);
+  return writer.size();
+}
+
+inline bool decodeUplinkAck(const uint8_t *in, size_t length, UplinkAck &ack)
+{
+  BinaryReader reader(in, length);
+  if (reader.u32() != UPLINK_ACK_MAGIC)
+  {
+    return false;
+  }
+  ack.status = reader.u8();
+  ack.recordType = reader.u8();
+  ack.accepted = reader.u16();
+  ack.deviceId = reader.u64();
+  ack.batchSequence = reader.u32();
+  ack.duplicates = reader.u16();
+  ack.rejected = reader.u16();
+  return reader.ok();
+}
+
+// Builds a batch in a caller-owned buffer of UPLINK_HEADER_SIZE +
+// maxRecords x record size bytes:
+//
+//   UplinkBatchWriter batch(buffer, sizeof(buffer), UPLINK_VITAL_RECORDS, deviceId, sequence);
+//   batch.add(record);
+//   send(buffer, batch.finish());
+class UplinkBatchWriter
+{
+public:
+  UplinkBatchWriter(uint8_t *buffer, size_t capacity, uint8_t recordType, uint64_t deviceId,
+                    uint32_t batchSequence)
+      : buffer(buffer), capacity(capacity), recordSize(uplinkRecordSize(recordType))
+  {
+    header.recordType = recordType;
+    header.recordCount = 0;
+    header.deviceId = deviceId;
+    header.batchSequence = batchSequence;
+    header.payloadLength = 0;
+    header.payloadCrc = 0;
+  }
+
+  bool add(const VitalRecord &record)
+  {
+    if (header.recordType != UPLINK_VITAL_RECORDS || !reserve())
+      return false;
+    encodeVitalRecord(record, buffer + UPLINK_HEADER_SIZE + header.payloadLength);
+    commit();
+    return true;
+  }
+
+  bool add(const PatientRecord &record)
+  {
+    if (header.recordType != UPLINK_PATIENT_RECORDS || !reserve())
+      return false;
+    encodePatientRecord(record, buffer + UPLINK_HEADER_SIZE + header.payloadLength);
+    commit();
+    return true;
+  }
+
+  // Adds an already encoded record (e.g. straight from the SD log)
+  bool addEncoded(const uint8_t *record)
+  {
+    if (!reserve())
+      return false;
+    memcpy(buffer + UPLINK_HEADER_SIZE + header.payloadLength, record, recordSize);
+    commit();
+    return true;
+  }
+
+  uint16_t count() const { return header.recordCount; }
+  bool full() const { return !reserve(); }
+
+  // Writes the header; returns the total batch size in bytes.
+  size_t finish()
+  {
+    header.payloadCrc = crc32(buffer + UPLINK_HEADER_SIZE, header.payloadLength);
+    encodeUplinkHeader(header, buffer);
+    return UPLINK_HEADER_SIZE + header.payloadLength;
+  }
+
+private:
+  bool reserve() const
+  {
+    return recordSize != 0 && header.recordCount < UPLINK_MAX_RECORDS &&
+           UPLINK_HEADER_SIZE + header.payloadLength + recordSize <= capacity;
+  }
+
+  void commit()
+  {
+    header.recordCount++;
+    header.payloadLength += recordSize;
+  }
+
+  uint8_t *buffer;
+  size_t capacity;
+  size_t recordSize;
+  UplinkBatchHeader header;
+};
+
+} // namespace vitalcare
@@ -0,0 +1,25 @@
+/*
+ * VitalCare Rural - Vital Sign Sample
+ *
+ * Plain snapshot of the 1 Hz vitals every module agrees on. Temperatures are
+ * in Fahrenheit and pressures in mmHg, as shown on the dashboard.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace vitalcare
+{
+
+struct VitalSample
+{
+  float heartRate;     // BPM
+  float systolicBP;    // mmHg
+  float diastolicBP;   // mmHg
+  float spO2;          // %
+  float temperature;   // °F
+  uint32_t timestampMs; // millis() when the snapshot was taken
+};
+
+} // namespace vitalcare
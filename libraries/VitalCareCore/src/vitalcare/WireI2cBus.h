@@ -0,0 +1,84 @@
+/*
+ * VitalCare Rural - Wire I2C Bus
+ *
+ * I2cBus backed directly by Arduino Wire. Each transaction runs as soon as
+ * it is submitted and its callback fires before submit() returns, so it is
+ * the simplest possible bus; drivers written against I2cBus work the same
+ * once the transfers move off the loop.
+ *
+ * Arduino only: include explicitly, it is not part of VitalCareCore.h.
+ */
+
+#pragma once
+
+#include <Wire.h>
+
+#include "I2cBus.h"
+
+namespace vitalcare
+{
+
+class WireI2cBus : public I2cBus
+{
+public:
+  explicit WireI2cBus(TwoWire &wire) : wire(wire) {}
+
+  bool submit(const I2cTransaction &transaction) override
+  {
+    I2cStatus status = execute(wire, transaction);
+    if (transaction.callback)
+    {
+      transaction.callback(transaction.context, transaction, status);
+    }
+    return true;
+  }
+
+  // Runs one register transfer synchronously on the given bus.
+  static I2cStatus execute(TwoWire &wire, const I2cTransaction &transaction)
+  {
+    wire.beginTransmission(transaction.address);
+    wire.write(transaction.reg);
+
+    if (transaction.write)
+    {
+      wire.write(transaction.data, transaction.length);
+      return toStatus(wire.endTransmission());
+    }
+
+    // Repeated start so no other master can slip in between
+    I2cStatus status = toStatus(wire.endTransmission(false));
+    if (status != I2C_OK)
+    {
+      return status;
+    }
+
+    size_t received = wire.requestFrom(transaction.address, (size_t)transaction.length);
+    if (received != transaction.length)
+    {
+      return I2C_TIMEOUT;
+    }
+    wire.readBytes(transaction.data, transaction.length);
+    return I2C_OK;
+  }
+
+private:
+  static I2cStatus toStatus(uint8_t wireResult)
+  {
+    switch (wireResult)
+    {
+    case 0:
+      return I2C_OK;
+    case 2:
+    case 3:
+      return I2C_NACK;
+    case 5:
+      return I2C_TIMEOUT;
+    default:
+      return I2C_BUS_ERROR;
+    }
+  }
+
+  TwoWire &wire;
+};
+
+} // namespace vitalcare
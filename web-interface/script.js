@@ -203,6 +203,7 @@ class VitalCareRuralComplete {
     }
 
     handleWebSocketMessage(event) {
+        const receivedMs = performance.now();
         try {
             // Update traffic statistics
             this.updateTrafficStats(event.data.length);
@@ -215,6 +216,7 @@ class VitalCareRuralComplete {
                     break;
                 case 'vitals':
                     this.handleVitalsUpdate(data);
+                    this.echoLatency(data.seq, receivedMs);
                     break;
                 case 'alert':
                     this.handleAlert(data);
@@ -236,6 +238,20 @@ class VitalCareRuralComplete {
         }
     }
     
+    // Sensor-to-screen latency: once the frame has been painted (the next
+    // animation frame has started), tell the monitor how long that took here
+    echoLatency(seq, receivedMs) {
+        if (!seq || document.hidden) return;
+        requestAnimationFrame(() => {
+            requestAnimationFrame(() => {
+                const renderMs = performance.now() - receivedMs;
+                if (this.ws && this.ws.readyState === WebSocket.OPEN) {
+                    this.ws.send(JSON.stringify({ type: 'latency', seq: seq, renderMs: renderMs }));
+                }
+            });
+        });
+    }
+
     updateTrafficStats(messageSize) {
         // Update packet and byte counts
         this.trafficStats.packetsReceived++;